@@ -0,0 +1,281 @@
+/*
+ * adc_acq.c
+ *
+ *  Created on: Oct 18, 2026
+ *      Author: hamxa
+ */
+#include "sdkconfig.h"
+
+#if CONFIG_ADC_ACQ_ENABLE
+
+#include <stdio.h>
+#include <string.h>
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "esp_adc/adc_continuous.h"
+#include "esp_adc/adc_cali.h"
+#include "esp_adc/adc_cali_scheme.h"
+#include "esp_attr.h"
+#include "esp_cpu.h"
+#include "esp_idf_version.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+
+#include "adc_acq.h"
+#include "dsp_decim.h"
+#include "sensor_window.h"
+#include "tasks_common.h"
+
+#if CONFIG_IDF_TARGET_ESP32 || CONFIG_IDF_TARGET_ESP32S2
+	#define ADC_ACQ_OUTPUT_FORMAT		ADC_DIGI_OUTPUT_FORMAT_TYPE1
+	#define ADC_ACQ_GET_CHANNEL(p)		((p)->type1.channel)
+	#define ADC_ACQ_GET_DATA(p)			((p)->type1.data)
+#else
+	#define ADC_ACQ_OUTPUT_FORMAT		ADC_DIGI_OUTPUT_FORMAT_TYPE2
+	#define ADC_ACQ_GET_CHANNEL(p)		((p)->type2.channel)
+	#define ADC_ACQ_GET_DATA(p)			((p)->type2.data)
+#endif
+
+#define ADC_ACQ_FRAME_SIZE			(ADC_ACQ_FRAME_SAMPLES * SOC_ADC_DIGI_RESULT_BYTES)
+//ADC_ATTEN_DB_11 was renamed to the attenuation it actually has, the old name is deprecated
+#if ESP_IDF_VERSION >= ESP_IDF_VERSION_VAL(5, 2, 0)
+	#define ADC_ACQ_ATTEN			ADC_ATTEN_DB_12
+#else
+	#define ADC_ACQ_ATTEN			ADC_ATTEN_DB_11
+#endif
+#define ADC_ACQ_READ_TIMEOUT_MS		1000
+
+//decimated samples averaged into one sliding window sample
+#define ADC_ACQ_AVERAGE_RATE		((uint64_t)CONFIG_ADC_ACQ_SAMPLE_RATE_HZ * CONFIG_ADC_ACQ_PUBLISH_PERIOD_MS / \
+									 ((uint64_t)CONFIG_ADC_ACQ_CIC_RATE * CONFIG_ADC_ACQ_FIR_RATE * 1000))
+
+static const char TAG[] = "adc_acq";
+
+static adc_continuous_handle_t g_adc_handle = NULL;
+
+//NULL when the chip has no calibration data, raw codes are published instead of millivolts
+static adc_cali_handle_t g_adc_cali = NULL;
+
+//decimation chain: CIC on the raw conversions, FIR low-pass, then a boxcar down to the publish period
+static dsp_cic_t g_cic;
+static dsp_fir_t g_fir;
+static dsp_cic_t g_avg;
+
+static adc_acq_stats_t g_adc_stats;
+
+//stage buffers for one DMA frame, every stage decimates by at least one
+static uint8_t g_frame[ADC_ACQ_FRAME_SIZE];
+static int32_t g_raw[ADC_ACQ_FRAME_SAMPLES];
+static int32_t g_cic_out[ADC_ACQ_FRAME_SAMPLES / 2 + 1];
+static int16_t g_fir_in[ADC_ACQ_FRAME_SAMPLES / 2 + 1];
+static int16_t g_fir_out[ADC_ACQ_FRAME_SAMPLES / 2 + 1];
+static int32_t g_avg_in[ADC_ACQ_FRAME_SAMPLES / 2 + 1];
+static int32_t g_avg_out[ADC_ACQ_FRAME_SAMPLES / 2 + 1];
+
+/**
+ * @fn bool adc_acq_pool_ovf_cb(adc_continuous_handle_t, const adc_continuous_evt_data_t*, void*)
+ * @brief count conversions dropped by the driver because the task did not keep up
+ *
+ * @return false, no task needs to be woken up
+ */
+static bool IRAM_ATTR adc_acq_pool_ovf_cb(adc_continuous_handle_t handle, const adc_continuous_evt_data_t *edata, void *user_data)
+{
+	g_adc_stats.pool_overflows++;
+	return false;
+}
+
+/**
+ * @fn bool adc_acq_filters_init(void)
+ * @brief set up the decimation chain from the menuconfig rates
+ *
+ * @return false if a stage rejected its parameters
+ */
+static bool adc_acq_filters_init(void)
+{
+	int16_t coeffs[DSP_FIR_MAX_TAPS];
+	uint32_t avg_rate = ADC_ACQ_AVERAGE_RATE ? (uint32_t)ADC_ACQ_AVERAGE_RATE : 1;
+
+	//keep the FIR pass band below the Nyquist frequency of its decimated output
+	return dsp_cic_init(&g_cic, ADC_ACQ_CIC_STAGES, CONFIG_ADC_ACQ_CIC_RATE) &&
+		   dsp_fir_design_lowpass(coeffs, CONFIG_ADC_ACQ_FIR_TAPS, 0.4f / CONFIG_ADC_ACQ_FIR_RATE) &&
+		   dsp_fir_init(&g_fir, coeffs, CONFIG_ADC_ACQ_FIR_TAPS, CONFIG_ADC_ACQ_FIR_RATE) &&
+		   dsp_cic_init(&g_avg, 1, avg_rate);
+}
+
+/**
+ * @fn void adc_acq_cali_init(void)
+ * @brief create the raw to millivolt calibration if the chip supports it
+ *
+ */
+static void adc_acq_cali_init(void)
+{
+#if ADC_CALI_SCHEME_LINE_FITTING_SUPPORTED
+	adc_cali_line_fitting_config_t cali_config = {
+			.unit_id = ADC_UNIT_1,
+			.atten = ADC_ACQ_ATTEN,
+			.bitwidth = ADC_BITWIDTH_12,
+	};
+	if(adc_cali_create_scheme_line_fitting(&cali_config, &g_adc_cali) != ESP_OK)
+	{
+		g_adc_cali = NULL;
+	}
+#endif
+	if(g_adc_cali == NULL)
+	{
+		ESP_LOGW(TAG, "adc_acq_cali_init: no calibration, publishing raw codes");
+	}
+}
+
+/**
+ * @fn void adc_acq_driver_init(void)
+ * @brief configure the ADC continuous driver for the probe channel
+ *
+ */
+static void adc_acq_driver_init(void)
+{
+	adc_continuous_handle_cfg_t handle_config = {
+			.max_store_buf_size = ADC_ACQ_FRAME_SIZE * ADC_ACQ_FRAME_COUNT,
+			.conv_frame_size = ADC_ACQ_FRAME_SIZE,
+	};
+	ESP_ERROR_CHECK(adc_continuous_new_handle(&handle_config, &g_adc_handle));
+
+	adc_digi_pattern_config_t pattern = {
+			.atten = ADC_ACQ_ATTEN,
+			.channel = CONFIG_ADC_ACQ_CHANNEL,
+			.unit = ADC_UNIT_1,
+			.bit_width = SOC_ADC_DIGI_MAX_BITWIDTH,
+	};
+	adc_continuous_config_t adc_config = {
+			.pattern_num = 1,
+			.adc_pattern = &pattern,
+			.sample_freq_hz = CONFIG_ADC_ACQ_SAMPLE_RATE_HZ,
+			.conv_mode = ADC_CONV_SINGLE_UNIT_1,
+			.format = ADC_ACQ_OUTPUT_FORMAT,
+	};
+	ESP_ERROR_CHECK(adc_continuous_config(g_adc_handle, &adc_config));
+
+	adc_continuous_evt_cbs_t cbs = {
+			.on_pool_ovf = adc_acq_pool_ovf_cb,
+	};
+	ESP_ERROR_CHECK(adc_continuous_register_event_callbacks(g_adc_handle, &cbs, NULL));
+}
+
+/**
+ * @fn void adc_acq_publish(int32_t)
+ * @brief convert a decimated sample and add it to the sliding windows
+ *
+ * @param raw decimated sample in raw ADC codes
+ */
+static void adc_acq_publish(int32_t raw)
+{
+	int value = raw < 0 ? 0 : raw;
+
+	if(g_adc_cali)
+	{
+		adc_cali_raw_to_voltage(g_adc_cali, value, &value);
+	}
+	sensor_window_add(SENSOR_METRIC_ANALOG, value, (uint32_t)(esp_timer_get_time() / 1000));
+	g_adc_stats.published++;
+}
+
+/**
+ * @fn size_t adc_acq_run_filters(size_t)
+ * @brief run one frame of probe conversions through the decimation chain
+ *
+ * @param count conversions in g_raw
+ * @return samples written to g_avg_out
+ */
+static size_t adc_acq_run_filters(size_t count)
+{
+	size_t n = dsp_cic_decimate(&g_cic, g_raw, count, g_cic_out);
+	for(size_t i = 0; i < n; i++)
+	{
+		g_fir_in[i] = (int16_t)g_cic_out[i];
+	}
+	n = dsp_fir_decimate(&g_fir, g_fir_in, n, g_fir_out);
+	for(size_t i = 0; i < n; i++)
+	{
+		g_avg_in[i] = g_fir_out[i];
+	}
+	return dsp_cic_decimate(&g_avg, g_avg_in, n, g_avg_out);
+}
+
+static void adc_acq_task(void *pvParameter)
+{
+	int64_t report_us = esp_timer_get_time();
+	uint64_t reported = 0;
+	uint64_t filter_cycles = 0;
+
+	printf("***** Starting ADC acquisition Task *****\n\n");
+	ESP_ERROR_CHECK(adc_continuous_start(g_adc_handle));
+
+	for(;;)
+	{
+		uint32_t bytes = 0;
+		esp_err_t err = adc_continuous_read(g_adc_handle, g_frame, ADC_ACQ_FRAME_SIZE, &bytes, ADC_ACQ_READ_TIMEOUT_MS);
+		if(err != ESP_OK)
+		{
+			ESP_LOGW(TAG, "adc_acq_task: read failed %s", esp_err_to_name(err));
+			continue;
+		}
+
+		size_t count = 0;
+		for(uint32_t i = 0; i + SOC_ADC_DIGI_RESULT_BYTES <= bytes; i += SOC_ADC_DIGI_RESULT_BYTES)
+		{
+			adc_digi_output_data_t *p = (adc_digi_output_data_t*)&g_frame[i];
+			if(ADC_ACQ_GET_CHANNEL(p) == CONFIG_ADC_ACQ_CHANNEL)
+			{
+				g_raw[count++] = ADC_ACQ_GET_DATA(p);
+			}
+		}
+
+		uint32_t t0 = esp_cpu_get_cycle_count();
+		size_t n = adc_acq_run_filters(count);
+		filter_cycles += esp_cpu_get_cycle_count() - t0;
+		g_adc_stats.conversions += count;
+
+		for(size_t i = 0; i < n; i++)
+		{
+			adc_acq_publish(g_avg_out[i]);
+		}
+
+		int64_t now_us = esp_timer_get_time();
+		if(now_us - report_us >= ADC_ACQ_REPORT_INTERVAL_US)
+		{
+			uint64_t conversions = g_adc_stats.conversions - reported;
+			g_adc_stats.filter_cycles_per_sample = conversions ? (uint32_t)(filter_cycles / conversions) : 0;
+			ESP_LOGI(TAG, "adc_acq_task: %llu conversions in %lld ms, filters %lu cycles/sample, %lu published, %lu pool overflows",
+					(unsigned long long)conversions, (long long)((now_us - report_us) / 1000),
+					(unsigned long)g_adc_stats.filter_cycles_per_sample, (unsigned long)g_adc_stats.published,
+					(unsigned long)g_adc_stats.pool_overflows);
+			reported = g_adc_stats.conversions;
+			report_us = now_us;
+			filter_cycles = 0;
+		}
+	}
+}
+
+void adc_acq_task_start(void)
+{
+	if(!adc_acq_filters_init())
+	{
+		ESP_LOGE(TAG, "adc_acq_task_start: invalid decimation settings");
+		return;
+	}
+	adc_acq_cali_init();
+	adc_acq_driver_init();
+
+	ESP_LOGI(TAG, "adc_acq_task_start: channel %d at %d Hz, decimating %d x %d x %lu",
+			CONFIG_ADC_ACQ_CHANNEL, CONFIG_ADC_ACQ_SAMPLE_RATE_HZ, CONFIG_ADC_ACQ_CIC_RATE, CONFIG_ADC_ACQ_FIR_RATE,
+			(unsigned long)g_avg.rate);
+
+	xTaskCreatePinnedToCore(&adc_acq_task, "adc_acq_task", ADC_ACQ_TASK_STACK_SIZE, NULL, ADC_ACQ_TASK_PRIORITY, NULL, ADC_ACQ_TASK_CORE_ID);
+}
+
+void adc_acq_get_stats(adc_acq_stats_t *stats)
+{
+	*stats = g_adc_stats;
+}
+
+#endif /* CONFIG_ADC_ACQ_ENABLE */
@@ -0,0 +1,51 @@
+/*
+ * adc_acq.h
+ *
+ *  Created on: Oct 18, 2026
+ *      Author: hamxa
+ */
+
+#ifndef MAIN_ADC_ACQ_H_
+#define MAIN_ADC_ACQ_H_
+
+#include <stdint.h>
+
+//Conversions handed over by the DMA driver per read
+#define ADC_ACQ_FRAME_SAMPLES			256
+
+//Number of frames the driver can buffer before it drops conversions
+#define ADC_ACQ_FRAME_COUNT				4
+
+//Order of the CIC stage
+#define ADC_ACQ_CIC_STAGES				3
+
+//Interval between throughput and filter cost reports
+#define ADC_ACQ_REPORT_INTERVAL_US		10000000
+
+/**
+ * Acquisition health and filter cost
+ */
+typedef struct adc_acq_stats
+{
+	uint64_t conversions;				///> raw conversions filtered
+	uint32_t published;					///> samples added to the sliding windows
+	uint32_t pool_overflows;			///> times the driver dropped conversions because the task fell behind
+	uint32_t filter_cycles_per_sample;	///> CPU cycles spent in the decimation chain per raw conversion, last report
+}adc_acq_stats_t;
+
+/**
+ * @fn void adc_acq_task_start(void)
+ * @brief start the ADC continuous driver and the task that decimates the probe and feeds the sliding windows
+ *
+ */
+void adc_acq_task_start(void);
+
+/**
+ * @fn void adc_acq_get_stats(adc_acq_stats_t*)
+ * @brief get the acquisition statistics
+ *
+ * @param stats output statistics
+ */
+void adc_acq_get_stats(adc_acq_stats_t *stats);
+
+#endif /* MAIN_ADC_ACQ_H_ */
@@ -18,6 +18,9 @@ static const char TAG[] = "NVS";
 //nvs namespace used for station mode credentials
 const char app_nvs_sta_creds_nampespace[] = "stacreds";
 
+//nvs namespace used for the copy of the MQTT session journal
+static const char app_nvs_mqtt_session_namespace[] = "mqttsession";
+
 
 esp_err_t app_nvs_save_sta_creds(void)
 {
@@ -148,6 +151,63 @@ esp_err_t app_nvs_clear_sta_creds(void)
 	
 }
 
+esp_err_t app_nvs_save_mqtt_session(const void *data, size_t len)
+{
+	nvs_handle handle;
+	esp_err_t esp_errcheck;
+	esp_errcheck = nvs_open(app_nvs_mqtt_session_namespace, NVS_READWRITE, &handle);
+	if(esp_errcheck != ESP_OK)
+	{
+		printf("app_nvs_save_mqtt_session: Error (%s) opening NVS handle!\n", esp_err_to_name(esp_errcheck));
+		return esp_errcheck;
+	}
+	esp_errcheck = nvs_set_blob(handle, "journal", data, len);
+	if(esp_errcheck == ESP_OK)
+	{
+		esp_errcheck = nvs_commit(handle);
+	}
+	nvs_close(handle);
+	if(esp_errcheck != ESP_OK)
+	{
+		printf("app_nvs_save_mqtt_session: Error (%s) writing journal to NVS!\n", esp_err_to_name(esp_errcheck));
+	}
+	return esp_errcheck;
+}
+
+esp_err_t app_nvs_load_mqtt_session(void *data, size_t *len)
+{
+	nvs_handle handle;
+	esp_err_t esp_errcheck;
+	esp_errcheck = nvs_open(app_nvs_mqtt_session_namespace, NVS_READONLY, &handle);
+	if(esp_errcheck != ESP_OK)
+	{
+		//namespace does not exist before the first save
+		return esp_errcheck;
+	}
+	esp_errcheck = nvs_get_blob(handle, "journal", data, len);
+	nvs_close(handle);
+	return esp_errcheck;
+}
+
+esp_err_t app_nvs_clear_mqtt_session(void)
+{
+	nvs_handle handle;
+	esp_err_t esp_errcheck;
+	esp_errcheck = nvs_open(app_nvs_mqtt_session_namespace, NVS_READWRITE, &handle);
+	if(esp_errcheck != ESP_OK)
+	{
+		printf("app_nvs_clear_mqtt_session: Error (%s) opening NVS handle\n", esp_err_to_name(esp_errcheck));
+		return esp_errcheck;
+	}
+	esp_errcheck = nvs_erase_all(handle);
+	if(esp_errcheck == ESP_OK)
+	{
+		esp_errcheck = nvs_commit(handle);
+	}
+	nvs_close(handle);
+	return esp_errcheck;
+}
+
 
 
 
@@ -10,6 +10,7 @@
 
 #include "esp_err.h"
 #include "stdbool.h"
+#include "stddef.h"
 /**
  * @fn esp_err_t app_nvs_save_sta_creds(void)
  * @brief Saves station mode wifi credentials to NVS
@@ -36,4 +37,32 @@ bool app_nvs_load_sta_creds(void);
  */
 esp_err_t app_nvs_clear_sta_creds(void);
 
+/**
+ * @fn esp_err_t app_nvs_save_mqtt_session(const void*, size_t)
+ * @brief Saves the copy of the MQTT session journal to NVS
+ *
+ * @param data journal
+ * @param len length of the journal
+ * @return ESP_OK if successful.
+ */
+esp_err_t app_nvs_save_mqtt_session(const void *data, size_t len);
+
+/**
+ * @fn esp_err_t app_nvs_load_mqtt_session(void*, size_t*)
+ * @brief loads the previously saved MQTT session journal from NVS
+ *
+ * @param data output buffer
+ * @param len in: size of the buffer, out: length of the journal
+ * @return ESP_OK if a journal was found.
+ */
+esp_err_t app_nvs_load_mqtt_session(void *data, size_t *len);
+
+/**
+ * @fn esp_err_t app_nvs_clear_mqtt_session(void)
+ * @brief clear the saved MQTT session journal from NVS
+ *
+ * @return ESP_OK if successful.
+ */
+esp_err_t app_nvs_clear_mqtt_session(void);
+
 #endif /* MAIN_APP_NVS_H_ */
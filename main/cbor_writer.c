@@ -0,0 +1,133 @@
+/*
+ * cbor_writer.c
+ *
+ *  Created on: Oct 18, 2026
+ *      Author: hamxa
+ */
+#include <string.h>
+
+#include "cbor_writer.h"
+
+//major types of the initial byte
+#define CBOR_MAJOR_UINT		0
+#define CBOR_MAJOR_NEGINT	1
+#define CBOR_MAJOR_TEXT		3
+#define CBOR_MAJOR_ARRAY	4
+#define CBOR_MAJOR_MAP		5
+
+//initial byte of a single precision float
+#define CBOR_FLOAT32		0xfa
+
+/**
+ * @fn void cbor_write_bytes(cbor_writer_t*, const void*, size_t)
+ * @brief append raw bytes, or mark the writer overflowed
+ *
+ */
+static void cbor_write_bytes(cbor_writer_t *writer, const void *bytes, size_t len)
+{
+	if(writer->overflow || len > writer->size - writer->len)
+	{
+		writer->overflow = true;
+		return;
+	}
+	memcpy(writer->buf + writer->len, bytes, len);
+	writer->len += len;
+}
+
+/**
+ * @fn void cbor_write_head(cbor_writer_t*, uint8_t, uint64_t)
+ * @brief write the initial byte and the big endian argument in the fewest bytes
+ *
+ */
+static void cbor_write_head(cbor_writer_t *writer, uint8_t major, uint64_t arg)
+{
+	uint8_t head[9];
+	size_t len;
+
+	if(arg < 24)
+	{
+		head[0] = (major << 5) | (uint8_t)arg;
+		len = 1;
+	}
+	else
+	{
+		//24 to 27 select a 1, 2, 4 or 8 byte argument
+		uint8_t width = arg <= UINT8_MAX ? 0 : arg <= UINT16_MAX ? 1 : arg <= UINT32_MAX ? 2 : 3;
+		len = 1 + (1u << width);
+		head[0] = (major << 5) | (24 + width);
+		for(size_t i = len - 1; i > 0; i--)
+		{
+			head[i] = (uint8_t)arg;
+			arg >>= 8;
+		}
+	}
+	cbor_write_bytes(writer, head, len);
+}
+
+void cbor_writer_init(cbor_writer_t *writer, void *buf, size_t size)
+{
+	writer->buf = buf;
+	writer->size = size;
+	writer->len = 0;
+	writer->overflow = false;
+}
+
+void cbor_write_uint(cbor_writer_t *writer, uint64_t value)
+{
+	cbor_write_head(writer, CBOR_MAJOR_UINT, value);
+}
+
+void cbor_write_int(cbor_writer_t *writer, int64_t value)
+{
+	if(value < 0)
+	{
+		//-1 - n, computed without overflowing on INT64_MIN
+		cbor_write_head(writer, CBOR_MAJOR_NEGINT, ~(uint64_t)value);
+	}
+	else
+	{
+		cbor_write_head(writer, CBOR_MAJOR_UINT, (uint64_t)value);
+	}
+}
+
+void cbor_write_float(cbor_writer_t *writer, float value)
+{
+	uint8_t bytes[5];
+	uint32_t bits;
+
+	memcpy(&bits, &value, sizeof(bits));
+	bytes[0] = CBOR_FLOAT32;
+	bytes[1] = (uint8_t)(bits >> 24);
+	bytes[2] = (uint8_t)(bits >> 16);
+	bytes[3] = (uint8_t)(bits >> 8);
+	bytes[4] = (uint8_t)bits;
+	cbor_write_bytes(writer, bytes, sizeof(bytes));
+}
+
+void cbor_write_text(cbor_writer_t *writer, const char *text)
+{
+	size_t len = strlen(text);
+
+	cbor_write_head(writer, CBOR_MAJOR_TEXT, len);
+	cbor_write_bytes(writer, text, len);
+}
+
+void cbor_write_array(cbor_writer_t *writer, size_t count)
+{
+	cbor_write_head(writer, CBOR_MAJOR_ARRAY, count);
+}
+
+void cbor_write_map(cbor_writer_t *writer, size_t count)
+{
+	cbor_write_head(writer, CBOR_MAJOR_MAP, count);
+}
+
+void cbor_write_byte(cbor_writer_t *writer, uint8_t byte)
+{
+	cbor_write_bytes(writer, &byte, 1);
+}
+
+int cbor_writer_finish(const cbor_writer_t *writer)
+{
+	return writer->overflow ? -1 : (int)writer->len;
+}
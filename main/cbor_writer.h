@@ -0,0 +1,96 @@
+/*
+ * cbor_writer.h
+ *
+ *  Created on: Oct 18, 2026
+ *      Author: hamxa
+ */
+
+#ifndef MAIN_CBOR_WRITER_H_
+#define MAIN_CBOR_WRITER_H_
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+//Opens an array whose length is not known up front, closed by CBOR_BREAK
+#define CBOR_ARRAY_INDEFINITE			0x9f
+
+//Closes an indefinite length array
+#define CBOR_BREAK						0xff
+
+/**
+ * CBOR (RFC 8949) encoder writing into a caller buffer, an overflow is only reported by cbor_writer_finish
+ */
+typedef struct cbor_writer
+{
+	uint8_t *buf;
+	size_t size;
+	size_t len;
+	bool overflow;					///> an item did not fit, the buffer holds an incomplete encoding
+}cbor_writer_t;
+
+/**
+ * @fn void cbor_writer_init(cbor_writer_t*, void*, size_t)
+ * @brief start encoding at the beginning of a buffer
+ *
+ */
+void cbor_writer_init(cbor_writer_t *writer, void *buf, size_t size);
+
+/**
+ * @fn void cbor_write_uint(cbor_writer_t*, uint64_t)
+ * @brief encode an unsigned integer in the shortest form
+ *
+ */
+void cbor_write_uint(cbor_writer_t *writer, uint64_t value);
+
+/**
+ * @fn void cbor_write_int(cbor_writer_t*, int64_t)
+ * @brief encode a signed integer in the shortest form
+ *
+ */
+void cbor_write_int(cbor_writer_t *writer, int64_t value);
+
+/**
+ * @fn void cbor_write_float(cbor_writer_t*, float)
+ * @brief encode a single precision float
+ *
+ */
+void cbor_write_float(cbor_writer_t *writer, float value);
+
+/**
+ * @fn void cbor_write_text(cbor_writer_t*, const char*)
+ * @brief encode a terminated UTF-8 string
+ *
+ */
+void cbor_write_text(cbor_writer_t *writer, const char *text);
+
+/**
+ * @fn void cbor_write_array(cbor_writer_t*, size_t)
+ * @brief start an array of count items
+ *
+ */
+void cbor_write_array(cbor_writer_t *writer, size_t count);
+
+/**
+ * @fn void cbor_write_map(cbor_writer_t*, size_t)
+ * @brief start a map of count key and value pairs
+ *
+ */
+void cbor_write_map(cbor_writer_t *writer, size_t count);
+
+/**
+ * @fn void cbor_write_byte(cbor_writer_t*, uint8_t)
+ * @brief write one raw byte, CBOR_ARRAY_INDEFINITE or CBOR_BREAK
+ *
+ */
+void cbor_write_byte(cbor_writer_t *writer, uint8_t byte);
+
+/**
+ * @fn int cbor_writer_finish(const cbor_writer_t*)
+ * @brief get the encoded length
+ *
+ * @return number of bytes written, or -1 if the buffer is too small
+ */
+int cbor_writer_finish(const cbor_writer_t *writer);
+
+#endif /* MAIN_CBOR_WRITER_H_ */
@@ -0,0 +1,196 @@
+/*
+ * device_api.c
+ *
+ *  Created on: Oct 18, 2026
+ *      Author: hamxa
+ */
+#include <stdio.h>
+#include <string.h>
+
+#include "esp_timer.h"
+#include "esp_wifi.h"
+#include "lwip/ip_addr.h"
+
+#include "device_api.h"
+#include "dht11.h"
+#include "http_ota.h"
+#include "mqtt_metrics.h"
+#include "rgb_led.h"
+#include "sensor_window.h"
+#include "wifi_app.h"
+
+/**
+ * @brief one device operation, writes its JSON result to out and its length to len
+ */
+typedef esp_err_t (*device_api_handler_t)(const char *params, size_t params_len, char *out, size_t *len);
+
+/**
+ * Operation name and handler
+ */
+typedef struct device_api_op
+{
+	const char *name;
+	device_api_handler_t handler;
+}device_api_op_t;
+
+/**
+ * @fn esp_err_t device_api_result(int, size_t*)
+ * @brief check the length printed to an output buffer of *len bytes
+ *
+ */
+static esp_err_t device_api_result(int printed, size_t *len)
+{
+	if(printed < 0 || (size_t)printed >= *len)
+	{
+		return ESP_ERR_INVALID_SIZE;
+	}
+	*len = (size_t)printed;
+	return ESP_OK;
+}
+
+/**
+ * @fn esp_err_t device_api_sensor(const char*, size_t, char*, size_t*)
+ * @brief read the DHT11 once
+ *
+ */
+static esp_err_t device_api_sensor(const char *params, size_t params_len, char *out, size_t *len)
+{
+	struct dht11_reading reading = DHT11_read();
+
+	return device_api_result(snprintf(out, *len, "{\"status\":\"%s\",\"temp\":\"%d\",\"humidity\":\"%d\"}",
+			reading.status == DHT11_CRC_ERROR ? "CRC Error" :
+			reading.status == DHT11_TIMEOUT_ERROR ? "Timeout Error" :
+			reading.status == DHT11_OK ? "OK" : "Unknown Status", reading.temperature, reading.humidity), len);
+}
+
+/**
+ * @fn esp_err_t device_api_stats(const char*, size_t, char*, size_t*)
+ * @brief aggregates of each sliding window
+ *
+ */
+static esp_err_t device_api_stats(const char *params, size_t params_len, char *out, size_t *len)
+{
+	int printed = sensor_window_to_json(out, *len, (uint32_t)(esp_timer_get_time() / 1000));
+
+	return printed < 0 ? ESP_ERR_INVALID_SIZE : device_api_result(printed, len);
+}
+
+/**
+ * @fn esp_err_t device_api_wifi_info(const char*, size_t, char*, size_t*)
+ * @brief addresses of the station interface and the AP it is connected to
+ *
+ */
+static esp_err_t device_api_wifi_info(const char *params, size_t params_len, char *out, size_t *len)
+{
+	char ip[IP4ADDR_STRLEN_MAX];
+	char netmask[IP4ADDR_STRLEN_MAX];
+	char gw[IP4ADDR_STRLEN_MAX];
+	wifi_ap_record_t wifi_data;
+	esp_netif_ip_info_t ip_info;
+
+	if(esp_wifi_sta_get_ap_info(&wifi_data) != ESP_OK || esp_netif_get_ip_info(esp_netif_sta, &ip_info) != ESP_OK)
+	{
+		return ESP_ERR_INVALID_STATE;
+	}
+	esp_ip4addr_ntoa(&ip_info.ip, ip, IP4ADDR_STRLEN_MAX);
+	esp_ip4addr_ntoa(&ip_info.netmask, netmask, IP4ADDR_STRLEN_MAX);
+	esp_ip4addr_ntoa(&ip_info.gw, gw, IP4ADDR_STRLEN_MAX);
+
+	return device_api_result(snprintf(out, *len, "{\"ip\":\"%s\",\"netmask\":\"%s\",\"gw\":\"%s\",\"ap\":\"%s\"}",
+			ip, netmask, gw, (const char*)wifi_data.ssid), len);
+}
+
+/**
+ * @fn esp_err_t device_api_metrics(const char*, size_t, char*, size_t*)
+ * @brief PUBACK latency histogram and broker session health
+ *
+ */
+static esp_err_t device_api_metrics(const char *params, size_t params_len, char *out, size_t *len)
+{
+	int printed = mqtt_metrics_to_json(out, *len);
+
+	return printed < 0 ? ESP_ERR_INVALID_SIZE : device_api_result(printed, len);
+}
+
+/**
+ * @fn esp_err_t device_api_led(const char*, size_t, char*, size_t*)
+ * @brief set the RGB LED to the color "r,g,b"
+ *
+ */
+static esp_err_t device_api_led(const char *params, size_t params_len, char *out, size_t *len)
+{
+	unsigned red, green, blue;
+	char end;
+
+	if(params == NULL || sscanf(params, "%u,%u,%u%c", &red, &green, &blue, &end) != 3 ||
+	   red > 255 || green > 255 || blue > 255)
+	{
+		return ESP_ERR_INVALID_ARG;
+	}
+	rgb_led_set((uint8_t)red, (uint8_t)green, (uint8_t)blue);
+	return device_api_result(snprintf(out, *len, "{\"r\":%u,\"g\":%u,\"b\":%u}", red, green, blue), len);
+}
+
+#if CONFIG_HTTP_OTA
+/**
+ * @fn esp_err_t device_api_ota_fetch(const char*, size_t, char*, size_t*)
+ * @brief start fetching the firmware image at the URL in params, followed by the SHA-256 of the file, which an
+ * 			http:// URL requires. The device restarts into the image once written and checked
+ *
+ */
+static esp_err_t device_api_ota_fetch(const char *params, size_t params_len, char *out, size_t *len)
+{
+	char url[HTTP_OTA_URL_MAX_LEN];
+	const char *sha256 = NULL;
+	esp_err_t err;
+
+	if(params == NULL)
+	{
+		return ESP_ERR_INVALID_ARG;
+	}
+	//a URL has no spaces, the SHA-256 follows the first one
+	const char *space = memchr(params, ' ', params_len);
+	size_t url_len = space ? (size_t)(space - params) : params_len;
+	if(url_len >= sizeof(url))
+	{
+		return ESP_ERR_INVALID_ARG;
+	}
+	memcpy(url, params, url_len);
+	url[url_len] = '\0';
+	if(space != NULL)
+	{
+		sha256 = space + 1;
+	}
+
+	err = http_ota_fetch(url, sha256);
+
+	if(err != ESP_OK)
+	{
+		return err;
+	}
+	return device_api_result(snprintf(out, *len, "{\"ota_fetch\":\"started\"}"), len);
+}
+#endif
+
+static const device_api_op_t g_ops[] = {
+		{"sensor", device_api_sensor},
+		{"stats", device_api_stats},
+		{"wifi_info", device_api_wifi_info},
+		{"metrics", device_api_metrics},
+		{"led", device_api_led},
+#if CONFIG_HTTP_OTA
+		{"ota_fetch", device_api_ota_fetch},
+#endif
+};
+
+esp_err_t device_api_call(const char *name, const char *params, size_t params_len, char *out, size_t *len)
+{
+	for(size_t i = 0; i < sizeof(g_ops) / sizeof(g_ops[0]); i++)
+	{
+		if(strcmp(g_ops[i].name, name) == 0)
+		{
+			return g_ops[i].handler(params, params_len, out, len);
+		}
+	}
+	return ESP_ERR_NOT_FOUND;
+}
@@ -0,0 +1,41 @@
+/*
+ * device_api.h
+ *
+ *  Created on: Oct 18, 2026
+ *      Author: hamxa
+ */
+
+#ifndef MAIN_DEVICE_API_H_
+#define MAIN_DEVICE_API_H_
+
+#include <stddef.h>
+
+#include "esp_err.h"
+
+//Buffer size that holds the result of any operation, the sliding-window and MQTT metrics summaries are the largest
+#define DEVICE_API_RESULT_MAX_LEN		1024U
+
+/**
+ * @fn esp_err_t device_api_call(const char*, const char*, size_t, char*, size_t*)
+ * @brief run a device operation by name and write its JSON result. The same operations answer the HTTP server and
+ * 			the MQTT RPC requests:
+ * 			sensor		read the DHT11, {"status":..,"temp":..,"humidity":..}
+ * 			stats		sliding-window aggregates of the readings
+ * 			wifi_info	station IP, netmask, gateway and AP
+ * 			metrics		PUBACK latency histogram and broker session health
+ * 			led			set the RGB LED, params "r,g,b" from 0 to 255
+ * 			ota_fetch	download and boot the firmware image at the URL in params, "<url>" or "<url> <sha256>",
+ * 						with CONFIG_HTTP_OTA
+ *
+ * @param name operation name
+ * @param params operation parameters, terminated, NULL if none
+ * @param params_len parameters length
+ * @param out output buffer of the JSON result
+ * @param len input the size of out, output the result length
+ * @return ESP_OK, ESP_ERR_NOT_FOUND for an unknown operation, ESP_ERR_INVALID_ARG for bad parameters,
+ * 			ESP_ERR_INVALID_SIZE if out is too small, ESP_ERR_INVALID_STATE if the station is not connected
+ * 			or a firmware fetch is running
+ */
+esp_err_t device_api_call(const char *name, const char *params, size_t params_len, char *out, size_t *len);
+
+#endif /* MAIN_DEVICE_API_H_ */
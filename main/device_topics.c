@@ -0,0 +1,222 @@
+/*
+ * device_topics.c
+ *
+ *  Created on: Oct 18, 2026
+ *      Author: hamxa
+ */
+#include <stdbool.h>
+#include <string.h>
+
+#include "esp_log.h"
+#include "esp_random.h"
+#include "esp_timer.h"
+
+#include "backoff_algorithm.h"
+#include "device_topics.h"
+#include "mqtt_agent.h"
+#include "mqtt_ota.h"
+#include "mqtt_rpc.h"
+
+static const char TAG[] = "device_topics";
+
+/**
+ * Subscription of one device topic
+ */
+typedef struct device_topics_route
+{
+	const char *filter;
+	MQTTQoS_t qos;
+	mqtt_agent_incoming_cb_t handler;
+}device_topics_route_t;
+
+/**
+ * Retries of a failed subscription, spread out by the backoff of the connect retries
+ */
+typedef struct device_topics_retry
+{
+	BackoffAlgorithmContext_t backoff;
+	esp_timer_handle_t timer;		///> queues the next attempt
+	bool given_up;					///> out of attempts, subscribed again at the next connect
+}device_topics_retry_t;
+
+static bool g_started = false;
+
+/**
+ * @fn void device_topics_on_cmd(void*, const MQTTPublishInfo_t*)
+ * @brief command addressed to this device, run as a remote call without a reply
+ *
+ */
+static void device_topics_on_cmd(void *ctx, const MQTTPublishInfo_t *publish)
+{
+	static const size_t prefix_len = sizeof(DEVICE_TOPICS_CMD_PREFIX) - 1;
+
+	ESP_LOGI(TAG, "command %.*s: %.*s", (int)(publish->topicNameLength - prefix_len), publish->pTopicName + prefix_len,
+			(int)publish->payloadLength, (const char*)publish->pPayload);
+	mqtt_rpc_submit(DEVICE_TOPICS_CMD_PREFIX, publish);
+}
+
+/**
+ * @fn void device_topics_on_rpc(void*, const MQTTPublishInfo_t*)
+ * @brief remote call, answered on the reply topic of its correlation id
+ *
+ */
+static void device_topics_on_rpc(void *ctx, const MQTTPublishInfo_t *publish)
+{
+	mqtt_rpc_submit(DEVICE_TOPICS_RPC_PREFIX, publish);
+}
+
+/**
+ * @fn void device_topics_on_config(void*, const MQTTPublishInfo_t*)
+ * @brief configuration update for this device
+ *
+ */
+static void device_topics_on_config(void *ctx, const MQTTPublishInfo_t *publish)
+{
+	ESP_LOGI(TAG, "config update: %.*s", (int)publish->payloadLength, (const char*)publish->pPayload);
+}
+
+/**
+ * @fn void device_topics_on_ota(void*, const MQTTPublishInfo_t*)
+ * @brief firmware update job or image block for this device
+ *
+ */
+static void device_topics_on_ota(void *ctx, const MQTTPublishInfo_t *publish)
+{
+#if CONFIG_MQTT_OTA
+	mqtt_ota_submit(publish);
+#else
+	ESP_LOGI(TAG, "OTA message on %.*s, %u bytes", publish->topicNameLength, publish->pTopicName,
+			(unsigned)publish->payloadLength);
+#endif
+}
+
+//calls are QoS0, a broker holding them while the device is away would deliver them after the caller gave up
+static const device_topics_route_t g_routes[] = {
+		{DEVICE_TOPICS_CMD_FILTER, MQTTQoS1, device_topics_on_cmd},
+		{DEVICE_TOPICS_RPC_FILTER, MQTTQoS0, device_topics_on_rpc},
+		{DEVICE_TOPICS_CONFIG_FILTER, MQTTQoS1, device_topics_on_config},
+		{DEVICE_TOPICS_OTA_FILTER, MQTTQoS1, device_topics_on_ota},
+};
+
+#define DEVICE_TOPICS_ROUTES	(sizeof(g_routes) / sizeof(g_routes[0]))
+
+static device_topics_retry_t g_retries[DEVICE_TOPICS_ROUTES];
+
+/**
+ * @fn void device_topics_subscribe(const device_topics_route_t*, TickType_t)
+ * @brief queue the subscription of a route
+ *
+ */
+static void device_topics_subscribe(const device_topics_route_t *route, TickType_t wait);
+
+/**
+ * @fn void device_topics_reset_backoff(device_topics_retry_t*)
+ * @brief start the retries of a route over from the base delay
+ *
+ */
+static void device_topics_reset_backoff(device_topics_retry_t *retry)
+{
+	BackoffAlgorithm_InitializeParams(&retry->backoff, CONFIG_MQTT_RETRY_BACKOFF_BASE_MS,
+									  CONFIG_MQTT_RETRY_BACKOFF_MAX_MS, CONFIG_MQTT_RETRY_MAX_ATTEMPTS);
+}
+
+/**
+ * @fn void device_topics_retry_later(const device_topics_route_t*, esp_err_t)
+ * @brief queue the subscription of a route again after a random delay, doubled after every failed attempt, or give
+ * 			it up once the attempts run out
+ *
+ */
+static void device_topics_retry_later(const device_topics_route_t *route, esp_err_t err)
+{
+	device_topics_retry_t *retry = &g_retries[route - g_routes];
+	uint16_t delay_ms;
+
+	if(BackoffAlgorithm_GetNextBackoff(&retry->backoff, esp_random(), &delay_ms) != BackoffAlgorithmSuccess)
+	{
+		ESP_LOGE(TAG, "subscription to %s failed: %s, giving up after %d attempts until the next connect", route->filter,
+				esp_err_to_name(err), CONFIG_MQTT_RETRY_MAX_ATTEMPTS);
+		__atomic_store_n(&retry->given_up, true, __ATOMIC_RELEASE);
+		return;
+	}
+	ESP_LOGW(TAG, "subscription to %s failed: %s, retrying in %u ms", route->filter, esp_err_to_name(err),
+			(unsigned)delay_ms);
+	esp_timer_start_once(retry->timer, (uint64_t)delay_ms * 1000);
+}
+
+/**
+ * @fn void device_topics_subscribed(void*, esp_err_t)
+ * @brief SUBSCRIBE completion. The agent only renews acknowledged subscriptions, so a failed one is retried
+ *
+ */
+static void device_topics_subscribed(void *ctx, esp_err_t result)
+{
+	const device_topics_route_t *route = ctx;
+
+	if(result == ESP_OK)
+	{
+		device_topics_reset_backoff(&g_retries[route - g_routes]);
+		ESP_LOGI(TAG, "subscribed to %s", route->filter);
+		return;
+	}
+	device_topics_retry_later(route, result);
+}
+
+/**
+ * @fn void device_topics_retry(void*)
+ * @brief backoff timer of a route expired, queue its subscription again
+ *
+ */
+static void device_topics_retry(void *arg)
+{
+	//runs on the timer task, it must not wait for room in the agent queue
+	device_topics_subscribe(arg, 0);
+}
+
+static void device_topics_subscribe(const device_topics_route_t *route, TickType_t wait)
+{
+	esp_err_t err = mqtt_agent_subscribe(route->filter, route->qos, route->handler, NULL, device_topics_subscribed, (void*)route, wait);
+
+	if(err != ESP_OK)
+	{
+		//no completion will come, a full queue is retried like a failed SUBSCRIBE
+		device_topics_retry_later(route, err);
+	}
+}
+
+void device_topics_start(void)
+{
+	//the Wi-Fi connected callback runs on every reconnect, the agent renews the subscriptions itself, only the ones
+	//given up are queued again
+	if(g_started)
+	{
+		for(size_t i = 0; i < DEVICE_TOPICS_ROUTES; i++)
+		{
+			if(__atomic_exchange_n(&g_retries[i].given_up, false, __ATOMIC_ACQ_REL))
+			{
+				device_topics_reset_backoff(&g_retries[i]);
+				device_topics_subscribe(&g_routes[i], portMAX_DELAY);
+			}
+		}
+		return;
+	}
+	g_started = true;
+	mqtt_rpc_start();
+#if CONFIG_MQTT_OTA
+	mqtt_ota_start();
+#endif
+
+	for(size_t i = 0; i < DEVICE_TOPICS_ROUTES; i++)
+	{
+		const esp_timer_create_args_t args = {
+				.callback = device_topics_retry,
+				.arg = (void*)&g_routes[i],
+				.name = "device_topics",
+		};
+		device_topics_reset_backoff(&g_retries[i]);
+		ESP_ERROR_CHECK(esp_timer_create(&args, &g_retries[i].timer));
+	}
+	for(size_t i = 0; i < DEVICE_TOPICS_ROUTES; i++)
+	{
+		device_topics_subscribe(&g_routes[i], portMAX_DELAY);
+	}
+}
@@ -0,0 +1,50 @@
+/*
+ * device_topics.h
+ *
+ *  Created on: Oct 18, 2026
+ *      Author: hamxa
+ */
+
+#ifndef MAIN_DEVICE_TOPICS_H_
+#define MAIN_DEVICE_TOPICS_H_
+
+#include "sdkconfig.h"
+
+//Root of the topics addressed to this device
+#define DEVICE_TOPICS_ROOT				"devices/" CONFIG_MQTT_CLIENT_IDENTIFIER
+
+//Commands, the last level names the command: devices/<id>/cmd/<name>
+#define DEVICE_TOPICS_CMD_PREFIX		DEVICE_TOPICS_ROOT "/cmd/"
+#define DEVICE_TOPICS_CMD_FILTER		DEVICE_TOPICS_CMD_PREFIX "+"
+
+//Remote calls, devices/<id>/rpc/<method>/<correlation id>, see mqtt_rpc.h
+#define DEVICE_TOPICS_RPC_PREFIX		DEVICE_TOPICS_ROOT "/rpc/"
+#define DEVICE_TOPICS_RPC_FILTER		DEVICE_TOPICS_RPC_PREFIX "+/+"
+
+//Replies to remote calls, the last level is the correlation id: devices/<id>/reply/<correlation id>
+#define DEVICE_TOPICS_RPC_REPLY_PREFIX	DEVICE_TOPICS_ROOT "/reply/"
+
+//Configuration updates
+#define DEVICE_TOPICS_CONFIG_FILTER		DEVICE_TOPICS_ROOT "/config"
+
+//Firmware update messages, any depth below ota, see mqtt_ota.h: the job announcement on ota/job and the
+//image blocks on ota/data/<job>/<index>
+#define DEVICE_TOPICS_OTA_FILTER		DEVICE_TOPICS_ROOT "/ota/#"
+#define DEVICE_TOPICS_OTA_JOB			DEVICE_TOPICS_ROOT "/ota/job"
+#define DEVICE_TOPICS_OTA_DATA_PREFIX	DEVICE_TOPICS_ROOT "/ota/data/"
+
+//Block requests and job status of the device, outside the OTA filter so the device does not receive them
+#define DEVICE_TOPICS_OTA_GET			DEVICE_TOPICS_ROOT "/ota_get"
+#define DEVICE_TOPICS_OTA_STATUS		DEVICE_TOPICS_ROOT "/ota_status"
+
+/**
+ * @fn void device_topics_start(void)
+ * @brief subscribe to the command, RPC, config and OTA topics of this device through the MQTT agent, which renews
+ * 			them whenever the broker lost the session, and start the RPC and OTA tasks. A failed subscription is
+ * 			retried with the backoff of the connect retries. Call again on every connect, subscriptions that ran out
+ * 			of retries are queued again
+ *
+ */
+void device_topics_start(void);
+
+#endif /* MAIN_DEVICE_TOPICS_H_ */
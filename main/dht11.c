@@ -22,18 +22,56 @@
  * SOFTWARE.
 */
 
+#include <stdbool.h>
+#include <stdio.h>
+#include <time.h>
+
 #include "dht11.h"
+#include "dht11_sim.h"
+#include "esp_log.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#if !CONFIG_IDF_TARGET_LINUX
 #include "esp_timer.h"
 #include "driver/gpio.h"
 #include "rom/ets_sys.h"
-#include "freertos/FreeRTOS.h"
-#include "freertos/task.h"
+#include "dht11_edge.h"
+#include "ota_health.h"
+#endif
 
 #include "tasks_common.h"
+#include "sensor_window.h"
+
+//interval between throughput reports of the simulated backend
+#define DHT11_SIM_REPORT_INTERVAL_US	10000000
+
+static const char TAG[] = "dht11";
+
 static gpio_num_t dht_gpio;
+static bool dht_initialized = false;
 static int64_t last_read_time = -2000000;
 static struct dht11_reading last_read;
 
+#if CONFIG_DHT11_DEFAULT_BACKEND_SIM || CONFIG_IDF_TARGET_LINUX
+static dht11_backend_e dht_backend = DHT11_BACKEND_SIM;
+#elif CONFIG_DHT11_DEFAULT_BACKEND_EDGE
+static dht11_backend_e dht_backend = DHT11_BACKEND_EDGE;
+#else
+static dht11_backend_e dht_backend = DHT11_BACKEND_GPIO;
+#endif
+
+static int64_t _timeUs() {
+#if CONFIG_IDF_TARGET_LINUX
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+#else
+    return esp_timer_get_time();
+#endif
+}
+
+#if !CONFIG_IDF_TARGET_LINUX
+
 static int _waitOrTimeout(uint16_t microSeconds, int level) {
     int micros_ticks = 0;
     while(gpio_get_level(dht_gpio) == level) { 
@@ -72,6 +110,8 @@ static int _checkResponse() {
     return DHT11_OK;
 }
 
+#endif /* !CONFIG_IDF_TARGET_LINUX */
+
 static struct dht11_reading _timeoutError() {
     struct dht11_reading timeoutError = {DHT11_TIMEOUT_ERROR, -1, -1};
     return timeoutError;
@@ -86,16 +126,20 @@ void DHT11_init(gpio_num_t gpio_num) {
     /* Wait 1 seconds to make the device pass its initial unstable status */
     vTaskDelay(1000 / portTICK_PERIOD_MS);
     dht_gpio = gpio_num;
-}
-
-struct dht11_reading DHT11_read() {
-    /* Tried to sense too son since last read (dht11 needs ~2 seconds to make a new read) */
-    if(esp_timer_get_time() - 2000000 < last_read_time) {
-        return last_read;
+    dht_initialized = true;
+#if !CONFIG_IDF_TARGET_LINUX
+    /* The edge capture ISR is only attached while its backend is selected */
+    if(dht_backend == DHT11_BACKEND_EDGE && DHT11_edge_init(gpio_num) != ESP_OK) {
+        ESP_LOGW(TAG, "DHT11_init: edge capture not available on GPIO %d, using the GPIO backend", gpio_num);
+        dht_backend = DHT11_BACKEND_GPIO;
     }
+#endif
+}
 
-    last_read_time = esp_timer_get_time();
-
+static struct dht11_reading _readGpio() {
+#if CONFIG_IDF_TARGET_LINUX
+    return last_read = _timeoutError();
+#else
     uint8_t data[5] = {0,0,0,0,0};
 
     _sendStartSignal();
@@ -123,6 +167,126 @@ struct dht11_reading DHT11_read() {
     } else {
         return last_read = _crcError();
     }
+#endif /* CONFIG_IDF_TARGET_LINUX */
+}
+
+struct dht11_reading DHT11_read() {
+    /* The simulated backend has no minimum interval between reads */
+    if(dht_backend == DHT11_BACKEND_SIM)
+        return last_read = DHT11_sim_read_at(_timeUs());
+
+    /* Tried to sense too son since last read (dht11 needs ~2 seconds to make a new read) */
+    if(_timeUs() - 2000000 < last_read_time) {
+        return last_read;
+    }
+
+    last_read_time = _timeUs();
+
+#if !CONFIG_IDF_TARGET_LINUX
+    if(dht_backend == DHT11_BACKEND_EDGE)
+        return last_read = DHT11_edge_read(dht_gpio);
+#endif
+
+    return _readGpio();
+}
+
+void DHT11_set_backend(dht11_backend_e backend) {
+#if CONFIG_IDF_TARGET_LINUX
+    if(backend != DHT11_BACKEND_SIM) {
+        ESP_LOGW(TAG, "DHT11_set_backend: GPIO backends not available on the Linux target");
+        return;
+    }
+#else
+    /* Before DHT11_init there is no line yet, it attaches the edge capture itself */
+    if(dht_initialized && backend != dht_backend) {
+        if(backend == DHT11_BACKEND_EDGE && DHT11_edge_init(dht_gpio) != ESP_OK) {
+            ESP_LOGW(TAG, "DHT11_set_backend: edge capture not available on GPIO %d", dht_gpio);
+            return;
+        }
+        if(dht_backend == DHT11_BACKEND_EDGE)
+            DHT11_edge_deinit(dht_gpio);
+    }
+#endif
+    dht_backend = backend;
+}
+
+dht11_backend_e DHT11_get_backend(void) {
+    return dht_backend;
+}
+
+/**
+ * @fn void DHT11_feed_consumers(const struct dht11_reading*, uint32_t)
+ * @brief hand a reading to the sliding windows and the OTA health check, the only per-sample consumers. MQTT
+ * 			and HTTP do not see each sample, they read the latest reading or the window summaries on their own period
+ * 
+ * @param reading the sampled reading
+ * @param timestamp_ms monotonic sample time in milliseconds
+ */
+static void DHT11_feed_consumers(const struct dht11_reading *reading, uint32_t timestamp_ms)
+{
+	if(reading->status == DHT11_OK)
+	{
+		sensor_window_add(SENSOR_METRIC_TEMPERATURE, reading->temperature, timestamp_ms);
+		sensor_window_add(SENSOR_METRIC_HUMIDITY, reading->humidity, timestamp_ms);
+#if CONFIG_OTA_HEALTH
+		ota_health_report(OTA_HEALTH_SENSOR);
+#endif
+	}
+}
+
+/**
+ * @fn void DHT11_sim_run(void)
+ * @brief produce simulated samples at the configured rate and report the consumer throughput,
+ * 			runs for as long as the simulated backend is selected
+ * 
+ */
+static void DHT11_sim_run(void)
+{
+	uint32_t rate_hz = DHT11_sim_get_sample_rate();
+	int64_t start_us = _timeUs();
+	int64_t report_us = start_us;
+	uint64_t produced = 0;
+	uint64_t reported = 0;
+	int64_t busy_us = 0;
+	int64_t max_us = 0;
+
+	ESP_LOGI(TAG, "DHT11_sim_run: generating %lu samples/s", (unsigned long)rate_hz);
+
+	while(dht_backend == DHT11_BACKEND_SIM)
+	{
+		//the tick is much coarser than the sample period at kHz rates, so catch up on every sample due
+		int64_t now_us = _timeUs();
+		uint64_t due = (uint64_t)(now_us - start_us) * rate_hz / 1000000;
+		while(produced < due)
+		{
+			int64_t sample_us = start_us + (int64_t)(produced * 1000000 / rate_hz);
+			int64_t t0 = _timeUs();
+			struct dht11_reading reading = DHT11_sim_read_at(sample_us);
+			DHT11_feed_consumers(&reading, (uint32_t)(sample_us / 1000));
+			int64_t cost_us = _timeUs() - t0;
+			busy_us += cost_us;
+			if(cost_us > max_us)
+			{
+				max_us = cost_us;
+			}
+			produced++;
+		}
+
+		if(now_us - report_us >= DHT11_SIM_REPORT_INTERVAL_US)
+		{
+			uint64_t samples = produced - reported;
+			ESP_LOGI(TAG, "DHT11_sim_run: %llu samples in %lld ms (%llu/s), consumers avg %lld us max %lld us per sample, backlog %llu",
+					(unsigned long long)samples, (long long)((now_us - report_us) / 1000),
+					(unsigned long long)(samples * 1000000 / (uint64_t)(now_us - report_us)),
+					(long long)(samples ? busy_us / samples : 0), (long long)max_us,
+					(unsigned long long)((uint64_t)(_timeUs() - start_us) * rate_hz / 1000000 - produced));
+			reported = produced;
+			report_us = now_us;
+			busy_us = 0;
+			max_us = 0;
+		}
+		vTaskDelay(1);
+	}
 }
 
 static void DHT11_task(void *pvParameter)
@@ -132,21 +296,22 @@ static void DHT11_task(void *pvParameter)
 	
 	for(;;)
 	{
-		/*printf("=== Reading DHT11 ===\n");
-		printf("Temperature is %d \n", DHT11_read().temperature);
-		printf("Humidity is %d\n", DHT11_read().humidity);
-		printf("Status code is %s\n\n", DHT11_read().status == DHT11_CRC_ERROR ? "CRC Error" :
-								DHT11_read().status == DHT11_TIMEOUT_ERROR ? "Timeout Error" :
-								DHT11_read().status == DHT11_OK ? "OK" : "Unknown Status");
-		
-		*/
-		vTaskDelay(4000/portTICK_PERIOD_MS);
+		if(dht_backend == DHT11_BACKEND_SIM)
+		{
+			DHT11_sim_run();
+			continue;
+		}
+		struct dht11_reading reading = DHT11_read();
+		DHT11_feed_consumers(&reading, (uint32_t)(_timeUs() / 1000));
+		vTaskDelay(DHT11_SAMPLE_PERIOD_MS/portTICK_PERIOD_MS);
 	}
-	
-	
 }
 
 void DHT11_task_start(void)
 {
+	dht11_sim_config_t sim_config;
+	DHT11_sim_get_default_config(&sim_config);
+	DHT11_sim_configure(&sim_config);
+	
 	xTaskCreatePinnedToCore(&DHT11_task, "DHT11_task", DHT11_TASK_STACK_SIZE, NULL, DHT11_TASK_PRIORITY, NULL, DHT11_TASK_CORE_ID);
 }
\ No newline at end of file
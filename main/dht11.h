@@ -25,12 +25,21 @@
 #ifndef DHT11_H_
 #define DHT11_H_
 
-#include "driver/gpio.h"
-
+#include "sdkconfig.h"
 
+#if CONFIG_IDF_TARGET_LINUX
+//no GPIO driver on the Linux target, only the simulated backend is available
+typedef int gpio_num_t;
+#define GPIO_NUM_17		17
+#else
+#include "driver/gpio.h"
+#endif
 
 #define DHT11_GPIO_PIN	GPIO_NUM_17
 
+//DHT11 sampling period of the DHT11 task, feeds the sliding-window aggregates
+#define DHT11_SAMPLE_PERIOD_MS	4000
+
 /**
  * @fn void DHT11_task_start(void)
  * @brief	Start the DHT11 reading task 
@@ -49,8 +58,33 @@ struct dht11_reading {
     int humidity;
 };
 
+/**
+ * Sources a reading can come from, selectable at build time and at run time
+ */
+typedef enum dht11_backend {
+    DHT11_BACKEND_GPIO = 0,     /**< bit-banged single-wire sensor */
+    DHT11_BACKEND_SIM,          /**< synthetic waveform generator, see dht11_sim.h */
+    DHT11_BACKEND_EDGE          /**< single-wire sensor decoded from interrupt timestamped edges, see dht11_edge.h */
+} dht11_backend_e;
+
 void DHT11_init(gpio_num_t);
 
 struct dht11_reading DHT11_read();
 
+/**
+ * @fn void DHT11_set_backend(dht11_backend_e)
+ * @brief switch the source of DHT11_read() and of the DHT11 task
+ * 
+ * @param backend backend to use, the GPIO and edge backends are not available on the Linux target
+ */
+void DHT11_set_backend(dht11_backend_e backend);
+
+/**
+ * @fn dht11_backend_e DHT11_get_backend(void)
+ * @brief get the active backend
+ * 
+ * @return active backend
+ */
+dht11_backend_e DHT11_get_backend(void);
+
 #endif
\ No newline at end of file
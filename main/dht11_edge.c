@@ -0,0 +1,295 @@
+/*
+ * dht11_edge.c
+ *
+ *  Created on: Oct 18, 2026
+ *      Author: hamxa
+ */
+#include <string.h>
+
+#include "sdkconfig.h"
+
+#include "freertos/FreeRTOS.h"
+
+#if !CONFIG_IDF_TARGET_LINUX
+#include "freertos/task.h"
+#include "driver/gpio.h"
+#include "hal/gpio_ll.h"
+#include "soc/gpio_struct.h"
+#include "esp_cpu.h"
+#include "esp_rom_sys.h"
+#include "esp_attr.h"
+#include "esp_log.h"
+#endif
+
+#include "dht11_edge.h"
+
+//Longest a valid high pulse can be, the response high phase is 80 us
+#define DHT11_EDGE_PULSE_MAX_US		100
+
+//Shortest a valid high pulse can be
+#define DHT11_EDGE_PULSE_MIN_US		10
+
+//Time the task sleeps while the ~4 ms frame is captured
+#define DHT11_EDGE_FRAME_WAIT_MS	10
+
+static dht11_edge_stats_t g_edge_stats = {
+		.zero_min_us = UINT32_MAX,
+		.one_min_us = UINT32_MAX,
+};
+
+//the reading task updates the statistics, any task may read them
+static portMUX_TYPE g_edge_stats_lock = portMUX_INITIALIZER_UNLOCKED;
+
+#if !CONFIG_IDF_TARGET_LINUX
+static const char TAG[] = "dht11_edge";
+
+/**
+ * Single producer (ISR) single consumer (task) ring of edge timestamps for one line
+ */
+typedef struct dht11_edge_ring
+{
+	gpio_num_t gpio_num;
+	bool in_use;
+	uint32_t head;		///> written by the ISR only
+	uint32_t tail;		///> written by the task only
+	uint32_t overflows;	///> written by the ISR only
+	uint32_t edge[DHT11_EDGE_RING_SIZE];
+}dht11_edge_ring_t;
+
+static dht11_edge_ring_t g_edge_rings[DHT11_EDGE_MAX_PINS];
+
+/**
+ * @fn void dht11_edge_isr_handler(void*)
+ * @brief timestamp an edge with the cycle counter and push it to the line's ring, nothing else
+ *
+ * @param arg ring of the line
+ */
+static void IRAM_ATTR DHT11_edge_isr_handler(void *arg)
+{
+	dht11_edge_ring_t *ring = (dht11_edge_ring_t*)arg;
+	uint32_t stamp = (esp_cpu_get_cycle_count() & ~1u) | (gpio_ll_get_level(&GPIO, ring->gpio_num) & 1u);
+	uint32_t head = ring->head;
+
+	if(head - __atomic_load_n(&ring->tail, __ATOMIC_ACQUIRE) < DHT11_EDGE_RING_SIZE)
+	{
+		ring->edge[head % DHT11_EDGE_RING_SIZE] = stamp;
+		__atomic_store_n(&ring->head, head + 1, __ATOMIC_RELEASE);
+	}
+	else
+	{
+		__atomic_store_n(&ring->overflows, ring->overflows + 1, __ATOMIC_RELAXED);
+	}
+}
+
+/**
+ * @fn dht11_edge_ring_t dht11_edge_find_ring*(gpio_num_t)
+ * @brief find the capture ring attached to a line
+ *
+ * @param gpio_num line to look up
+ * @return ring, or NULL if the line has no capture attached
+ */
+static dht11_edge_ring_t* DHT11_edge_find_ring(gpio_num_t gpio_num)
+{
+	for(int i = 0; i < DHT11_EDGE_MAX_PINS; i++)
+	{
+		if(g_edge_rings[i].in_use && g_edge_rings[i].gpio_num == gpio_num)
+		{
+			return &g_edge_rings[i];
+		}
+	}
+	return NULL;
+}
+
+/**
+ * @fn void DHT11_edge_update_stats(int, const uint16_t*)
+ * @brief account a decoded frame and widen the bit pulse extremes
+ *
+ * @param status decode status
+ * @param pulse_us bit high pulse widths of the frame
+ */
+static void DHT11_edge_update_stats(int status, const uint16_t *pulse_us)
+{
+	g_edge_stats.frames++;
+	if(status == DHT11_TIMEOUT_ERROR)
+	{
+		g_edge_stats.decode_errors++;
+		return;
+	}
+	if(status == DHT11_CRC_ERROR)
+	{
+		g_edge_stats.crc_errors++;
+		return;
+	}
+	for(int i = 0; i < 40; i++)
+	{
+		uint32_t *min = pulse_us[i] > DHT11_EDGE_BIT_THRESHOLD_US ? &g_edge_stats.one_min_us : &g_edge_stats.zero_min_us;
+		uint32_t *max = pulse_us[i] > DHT11_EDGE_BIT_THRESHOLD_US ? &g_edge_stats.one_max_us : &g_edge_stats.zero_max_us;
+		if(pulse_us[i] < *min)
+		{
+			*min = pulse_us[i];
+		}
+		if(pulse_us[i] > *max)
+		{
+			*max = pulse_us[i];
+		}
+	}
+}
+
+esp_err_t DHT11_edge_init(gpio_num_t gpio_num)
+{
+	dht11_edge_ring_t *ring = DHT11_edge_find_ring(gpio_num);
+
+	for(int i = 0; ring == NULL && i < DHT11_EDGE_MAX_PINS; i++)
+	{
+		if(!g_edge_rings[i].in_use)
+		{
+			ring = &g_edge_rings[i];
+			memset(ring, 0x00, sizeof(dht11_edge_ring_t));
+			ring->gpio_num = gpio_num;
+			ring->in_use = true;
+		}
+	}
+	if(ring == NULL)
+	{
+		ESP_LOGE(TAG, "DHT11_edge_init: no free capture slot for GPIO %d", gpio_num);
+		return ESP_ERR_NO_MEM;
+	}
+
+	//the handler runs with the cache disabled, so the service must be an IRAM one
+	esp_err_t err = gpio_install_isr_service(ESP_INTR_FLAG_IRAM);
+	if(err != ESP_OK && err != ESP_ERR_INVALID_STATE)
+	{
+		ring->in_use = false;
+		return err;
+	}
+
+	gpio_set_intr_type(gpio_num, GPIO_INTR_ANYEDGE);
+	gpio_intr_disable(gpio_num);
+	err = gpio_isr_handler_add(gpio_num, DHT11_edge_isr_handler, ring);
+	if(err != ESP_OK)
+	{
+		ring->in_use = false;
+		return err;
+	}
+	ESP_LOGI(TAG, "DHT11_edge_init: capturing GPIO %d", gpio_num);
+	return ESP_OK;
+}
+
+void DHT11_edge_deinit(gpio_num_t gpio_num)
+{
+	dht11_edge_ring_t *ring = DHT11_edge_find_ring(gpio_num);
+
+	if(ring == NULL)
+	{
+		return;
+	}
+	gpio_intr_disable(gpio_num);
+	gpio_set_intr_type(gpio_num, GPIO_INTR_DISABLE);
+	gpio_isr_handler_remove(gpio_num);
+	ring->in_use = false;
+	ESP_LOGI(TAG, "DHT11_edge_deinit: released GPIO %d", gpio_num);
+}
+#endif /* !CONFIG_IDF_TARGET_LINUX */
+
+int DHT11_edge_decode(const uint32_t *edges, size_t count, uint32_t cycles_per_us, uint8_t data[5], uint16_t *pulse_us)
+{
+	uint16_t last_pulses[40];
+	size_t pulses = 0;
+
+	//keep the last 40 complete high pulses (rising edge then falling edge), the frame ends with them
+	for(size_t i = 1; i < count; i++)
+	{
+		if((edges[i - 1] & 1u) == 1u && (edges[i] & 1u) == 0u)
+		{
+			uint32_t width_us = ((edges[i] & ~1u) - (edges[i - 1] & ~1u)) / cycles_per_us;
+			last_pulses[pulses % 40] = width_us > UINT16_MAX ? UINT16_MAX : (uint16_t)width_us;
+			pulses++;
+		}
+	}
+	if(pulses < 40)
+	{
+		return DHT11_TIMEOUT_ERROR;
+	}
+
+	memset(data, 0x00, 5);
+	for(int bit = 0; bit < 40; bit++)
+	{
+		uint16_t width_us = last_pulses[(pulses + bit) % 40];
+		if(width_us < DHT11_EDGE_PULSE_MIN_US || width_us > DHT11_EDGE_PULSE_MAX_US)
+		{
+			return DHT11_TIMEOUT_ERROR;
+		}
+		if(width_us > DHT11_EDGE_BIT_THRESHOLD_US)
+		{
+			data[bit / 8] |= (1 << (7 - (bit % 8)));
+		}
+		if(pulse_us)
+		{
+			pulse_us[bit] = width_us;
+		}
+	}
+
+	if(data[4] != (uint8_t)(data[0] + data[1] + data[2] + data[3]))
+	{
+		return DHT11_CRC_ERROR;
+	}
+	return DHT11_OK;
+}
+
+#if !CONFIG_IDF_TARGET_LINUX
+struct dht11_reading DHT11_edge_read(gpio_num_t gpio_num)
+{
+	struct dht11_reading reading = { DHT11_TIMEOUT_ERROR, -1, -1 };
+	dht11_edge_ring_t *ring = DHT11_edge_find_ring(gpio_num);
+	uint32_t edges[DHT11_EDGE_RING_SIZE];
+	uint16_t pulse_us[40];
+	uint8_t data[5];
+	size_t count = 0;
+
+	if(ring == NULL)
+	{
+		return reading;
+	}
+
+	//start signal, the 20 ms low phase sleeps instead of busy waiting
+	gpio_set_direction(gpio_num, GPIO_MODE_OUTPUT);
+	gpio_set_level(gpio_num, 0);
+	vTaskDelay(pdMS_TO_TICKS(20) + 1);
+
+	//drop stale edges, then capture the whole frame from the release of the line
+	__atomic_store_n(&ring->tail, __atomic_load_n(&ring->head, __ATOMIC_ACQUIRE), __ATOMIC_RELEASE);
+	gpio_intr_enable(gpio_num);
+	gpio_set_level(gpio_num, 1);
+	esp_rom_delay_us(40);
+	gpio_set_direction(gpio_num, GPIO_MODE_INPUT);
+
+	vTaskDelay(pdMS_TO_TICKS(DHT11_EDGE_FRAME_WAIT_MS) + 1);
+	gpio_intr_disable(gpio_num);
+
+	uint32_t head = __atomic_load_n(&ring->head, __ATOMIC_ACQUIRE);
+	for(uint32_t tail = ring->tail; tail != head; tail++)
+	{
+		edges[count++] = ring->edge[tail % DHT11_EDGE_RING_SIZE];
+	}
+	__atomic_store_n(&ring->tail, head, __ATOMIC_RELEASE);
+
+	reading.status = DHT11_edge_decode(edges, count, esp_rom_get_cpu_ticks_per_us(), data, pulse_us);
+	portENTER_CRITICAL(&g_edge_stats_lock);
+	g_edge_stats.ring_overflows = __atomic_load_n(&ring->overflows, __ATOMIC_RELAXED);
+	DHT11_edge_update_stats(reading.status, pulse_us);
+	portEXIT_CRITICAL(&g_edge_stats_lock);
+	if(reading.status == DHT11_OK)
+	{
+		reading.temperature = data[2];
+		reading.humidity = data[0];
+	}
+	return reading;
+}
+#endif /* !CONFIG_IDF_TARGET_LINUX */
+
+void DHT11_edge_get_stats(dht11_edge_stats_t *stats)
+{
+	portENTER_CRITICAL(&g_edge_stats_lock);
+	*stats = g_edge_stats;
+	portEXIT_CRITICAL(&g_edge_stats_lock);
+}
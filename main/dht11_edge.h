@@ -0,0 +1,91 @@
+/*
+ * dht11_edge.h
+ *
+ *  Created on: Oct 18, 2026
+ *      Author: hamxa
+ */
+
+#ifndef MAIN_DHT11_EDGE_H_
+#define MAIN_DHT11_EDGE_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "esp_err.h"
+#include "dht11.h"
+
+//Single-wire lines that can be captured at the same time
+#define DHT11_EDGE_MAX_PINS			4
+
+//Edges kept per line, a DHT11 frame is about 85 edges
+#define DHT11_EDGE_RING_SIZE		128
+
+//High pulses longer than this are a 1 bit (nominal 26-28 us for 0, 70 us for 1)
+#define DHT11_EDGE_BIT_THRESHOLD_US	48
+
+/**
+ * Edge capture health, bit pulse extremes give the timing jitter seen by the decoder
+ */
+typedef struct dht11_edge_stats
+{
+	uint32_t frames;
+	uint32_t decode_errors;			///> too few edges or pulses out of range
+	uint32_t crc_errors;
+	uint32_t ring_overflows;		///> edges dropped by the ISR
+	uint32_t zero_min_us;
+	uint32_t zero_max_us;
+	uint32_t one_min_us;
+	uint32_t one_max_us;
+}dht11_edge_stats_t;
+
+#if !CONFIG_IDF_TARGET_LINUX
+/**
+ * @fn esp_err_t DHT11_edge_init(gpio_num_t)
+ * @brief attach the edge capture ISR to a line, installs the GPIO ISR service with ESP_INTR_FLAG_IRAM if nothing
+ * 			installed it yet
+ *
+ * @param gpio_num single-wire line of the sensor
+ * @return ESP_OK, ESP_ERR_NO_MEM if all capture slots are in use, or the GPIO driver error
+ */
+esp_err_t DHT11_edge_init(gpio_num_t gpio_num);
+
+/**
+ * @fn void DHT11_edge_deinit(gpio_num_t)
+ * @brief detach the edge capture ISR from a line and free its capture slot
+ *
+ * @param gpio_num line previously passed to DHT11_edge_init
+ */
+void DHT11_edge_deinit(gpio_num_t gpio_num);
+
+/**
+ * @fn struct dht11_reading DHT11_edge_read(gpio_num_t)
+ * @brief trigger a frame and decode the edges captured by the ISR, the task sleeps while the frame arrives
+ *
+ * @param gpio_num line previously passed to DHT11_edge_init
+ * @return decoded reading
+ */
+struct dht11_reading DHT11_edge_read(gpio_num_t gpio_num);
+#endif
+
+/**
+ * @fn int DHT11_edge_decode(const uint32_t*, size_t, uint32_t, uint8_t*, uint16_t*)
+ * @brief decode a 40 bit frame from captured edges, also usable on recorded edge streams
+ *
+ * @param edges edge timestamps in cycles, bit 0 holds the line level after the edge
+ * @param count number of edges
+ * @param cycles_per_us timestamp resolution
+ * @param data output frame, 5 bytes
+ * @param pulse_us optional output of the 40 bit high pulse widths in microseconds, may be NULL
+ * @return DHT11_OK, DHT11_CRC_ERROR or DHT11_TIMEOUT_ERROR if the frame is incomplete
+ */
+int DHT11_edge_decode(const uint32_t *edges, size_t count, uint32_t cycles_per_us, uint8_t data[5], uint16_t *pulse_us);
+
+/**
+ * @fn void DHT11_edge_get_stats(dht11_edge_stats_t*)
+ * @brief get the capture and decode statistics
+ *
+ * @param stats output statistics
+ */
+void DHT11_edge_get_stats(dht11_edge_stats_t *stats);
+
+#endif /* MAIN_DHT11_EDGE_H_ */
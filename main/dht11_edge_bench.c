@@ -0,0 +1,159 @@
+/*
+ * dht11_edge_bench.c
+ *
+ *  Created on: Oct 19, 2026
+ *      Author: hamxa
+ */
+#include <stdint.h>
+#include <time.h>
+
+#include "esp_log.h"
+
+#include "dht11_edge.h"
+#include "dht11_edge_bench.h"
+#include "dht11_sim.h"
+
+static const char TAG[] = "dht11_edge_bench";
+
+//interval between frames, the DHT11 task period
+#define DHT11_EDGE_BENCH_PERIOD_US		4000000LL
+
+/**
+ * Outcome of the frames decoded at one jitter level
+ */
+typedef struct dht11_edge_bench_result
+{
+	uint32_t frames;
+	uint32_t decoded;			///> decoded to the reading the frame carried
+	uint32_t decode_errors;		///> reported as a timeout
+	uint32_t crc_errors;
+	uint32_t wrong;				///> decoded with a good checksum to another reading
+	uint32_t missed;			///> injected error decoded as a good reading
+	dht11_edge_stats_t pulses;	///> bit pulse extremes of the decoded frames
+	int64_t decode_ns;
+}dht11_edge_bench_result_t;
+
+/**
+ * @fn int64_t dht11_edge_bench_now_ns(void)
+ * @brief monotonic time
+ *
+ */
+static int64_t dht11_edge_bench_now_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (int64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+/**
+ * @fn void dht11_edge_bench_pulses(dht11_edge_stats_t*, const uint16_t*)
+ * @brief widen the bit pulse extremes with a decoded frame, as the edge backend does
+ *
+ */
+static void dht11_edge_bench_pulses(dht11_edge_stats_t *stats, const uint16_t *pulse_us)
+{
+	for(int i = 0; i < 40; i++)
+	{
+		uint32_t *min = pulse_us[i] > DHT11_EDGE_BIT_THRESHOLD_US ? &stats->one_min_us : &stats->zero_min_us;
+		uint32_t *max = pulse_us[i] > DHT11_EDGE_BIT_THRESHOLD_US ? &stats->one_max_us : &stats->zero_max_us;
+		*min = pulse_us[i] < *min ? pulse_us[i] : *min;
+		*max = pulse_us[i] > *max ? pulse_us[i] : *max;
+	}
+}
+
+/**
+ * @fn void dht11_edge_bench_decode(uint32_t, uint32_t, uint32_t, dht11_edge_bench_result_t*)
+ * @brief decode a day of simulated frames, every edge moved by up to +/- jitter_us
+ *
+ * @param crc_error_ppm injected CRC errors
+ * @param timeout_error_ppm injected frames cut short
+ */
+static void dht11_edge_bench_decode(uint32_t jitter_us, uint32_t crc_error_ppm, uint32_t timeout_error_ppm,
+									dht11_edge_bench_result_t *result)
+{
+	dht11_sim_config_t config;
+	uint32_t edges[DHT11_SIM_FRAME_EDGES];
+	uint16_t pulse_us[40];
+	uint8_t data[5];
+
+	*result = (dht11_edge_bench_result_t){
+			.pulses.zero_min_us = UINT32_MAX,
+			.pulses.one_min_us = UINT32_MAX,
+	};
+	DHT11_sim_get_default_config(&config);
+	config.noise_amplitude = 1;
+	config.crc_error_ppm = crc_error_ppm;
+	config.timeout_error_ppm = timeout_error_ppm;
+	config.seed = 1;
+	DHT11_sim_configure(&config);
+
+	for(uint32_t i = 0; i < DHT11_EDGE_BENCH_FRAMES; i++)
+	{
+		struct dht11_reading reading;
+		//the 32 bit cycle counter wraps every 18 s at 240 MHz, a few frames apart
+		size_t count = DHT11_sim_edges_at(i * DHT11_EDGE_BENCH_PERIOD_US, DHT11_EDGE_BENCH_CYCLES_PER_US, jitter_us,
+										  edges, DHT11_SIM_FRAME_EDGES, &reading);
+
+		int64_t start = dht11_edge_bench_now_ns();
+		int status = DHT11_edge_decode(edges, count, DHT11_EDGE_BENCH_CYCLES_PER_US, data, pulse_us);
+		result->decode_ns += dht11_edge_bench_now_ns() - start;
+		result->frames++;
+
+		if(status == DHT11_TIMEOUT_ERROR)
+		{
+			result->decode_errors++;
+		}
+		else if(status == DHT11_CRC_ERROR)
+		{
+			result->crc_errors++;
+		}
+		else if(reading.status != DHT11_OK)
+		{
+			result->missed++;
+		}
+		else if(data[0] != reading.humidity || data[2] != reading.temperature)
+		{
+			result->wrong++;
+		}
+		else
+		{
+			result->decoded++;
+			dht11_edge_bench_pulses(&result->pulses, pulse_us);
+		}
+	}
+}
+
+bool dht11_edge_bench_run(void)
+{
+	static const uint32_t jitters_us[] = {0, 2, 5, DHT11_EDGE_BENCH_MAX_JITTER_US, 10, 12, 15, 20};
+	dht11_edge_bench_result_t result;
+	bool passed = true;
+
+	for(size_t i = 0; i < sizeof(jitters_us) / sizeof(jitters_us[0]); i++)
+	{
+		dht11_edge_bench_decode(jitters_us[i], 0, 0, &result);
+
+		//past the bound frames are lost, and the 8 bit checksum may let a rare wrong one through, both are only logged
+		bool ok = jitters_us[i] > DHT11_EDGE_BENCH_MAX_JITTER_US || result.decoded == result.frames;
+		passed = ok && passed;
+		ESP_LOGI(TAG, "jitter +/-%lu us: %s, %lu frames, %lu decode errors, %lu CRC errors, %lu wrong, "
+				"0 bits %lu-%lu us, 1 bits %lu-%lu us, %lld ns per frame", (unsigned long)jitters_us[i],
+				ok ? "PASS" : "FAIL", (unsigned long)result.frames, (unsigned long)result.decode_errors,
+				(unsigned long)result.crc_errors, (unsigned long)result.wrong,
+				(unsigned long)(result.decoded ? result.pulses.zero_min_us : 0), (unsigned long)result.pulses.zero_max_us,
+				(unsigned long)(result.decoded ? result.pulses.one_min_us : 0), (unsigned long)result.pulses.one_max_us,
+				(long long)(result.decode_ns / result.frames));
+	}
+
+	//frames cut short and bad checksums, with the jitter of a busy core, must never decode to a reading
+	dht11_edge_bench_decode(5, 20000, 20000, &result);
+	bool ok = result.missed == 0 && result.wrong == 0 &&
+			result.decoded + result.decode_errors + result.crc_errors == result.frames;
+	passed = ok && passed;
+	ESP_LOGI(TAG, "injected errors, jitter +/-5 us: %s, %lu frames, %lu decoded, %lu decode errors, %lu CRC errors, "
+			"%lu missed, %lu wrong", ok ? "PASS" : "FAIL", (unsigned long)result.frames, (unsigned long)result.decoded,
+			(unsigned long)result.decode_errors, (unsigned long)result.crc_errors, (unsigned long)result.missed,
+			(unsigned long)result.wrong);
+	return passed;
+}
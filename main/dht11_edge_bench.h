@@ -0,0 +1,33 @@
+/*
+ * dht11_edge_bench.h
+ *
+ *  Created on: Oct 19, 2026
+ *      Author: hamxa
+ */
+
+#ifndef MAIN_DHT11_EDGE_BENCH_H_
+#define MAIN_DHT11_EDGE_BENCH_H_
+
+#include <stdbool.h>
+
+//Frames decoded per jitter level, a day of readings every 4 s
+#define DHT11_EDGE_BENCH_FRAMES			21600
+
+//Timestamp resolution, the cycle counter of an ESP32 at 240 MHz
+#define DHT11_EDGE_BENCH_CYCLES_PER_US	240
+
+//Largest jitter per edge, in microseconds, at which every clean frame must still decode. A 27 us 0 bit shortened by
+//twice the jitter stays above the 10 us glitch bound of the decoder
+#define DHT11_EDGE_BENCH_MAX_JITTER_US	8
+
+/**
+ * @fn bool dht11_edge_bench_run(void)
+ * @brief decode simulated frames with increasing jitter on every edge and log the decode and CRC errors, the bit
+ * 			pulse extremes the decoder saw and the decode time, then decode frames with injected timeouts and CRC errors
+ *
+ * @return true if every clean frame up to DHT11_EDGE_BENCH_MAX_JITTER_US decoded to its reading, and no injected
+ * 			error decoded to a reading
+ */
+bool dht11_edge_bench_run(void);
+
+#endif /* MAIN_DHT11_EDGE_BENCH_H_ */
@@ -0,0 +1,238 @@
+/*
+ * dht11_sim.c
+ *
+ *  Created on: Oct 18, 2026
+ *      Author: hamxa
+ */
+#include <math.h>
+#include <string.h>
+
+#include "freertos/FreeRTOS.h"
+#include "sdkconfig.h"
+#include "dht11_sim.h"
+
+#ifndef M_PI
+	#define M_PI	3.14159265358979323846
+#endif
+
+//active configuration
+static dht11_sim_config_t g_sim_config;
+
+//xorshift32 state driving the noise and the error injection, shared by the DHT11 task and DHT11_read callers
+static uint32_t g_sim_rng_state = 1;
+static portMUX_TYPE g_sim_rng_lock = portMUX_INITIALIZER_UNLOCKED;
+
+/**
+ * @fn uint32_t DHT11_sim_rand(void)
+ * @brief xorshift32 pseudo random generator, reproducible from the configured seed
+ *
+ * @return next pseudo random value
+ */
+static uint32_t DHT11_sim_rand(void)
+{
+	uint32_t x;
+
+	portENTER_CRITICAL(&g_sim_rng_lock);
+	x = g_sim_rng_state;
+	x ^= x << 13;
+	x ^= x >> 17;
+	x ^= x << 5;
+	g_sim_rng_state = x;
+	portEXIT_CRITICAL(&g_sim_rng_lock);
+	return x;
+}
+
+/**
+ * @fn float DHT11_sim_wave(int64_t)
+ * @brief evaluate the configured waveform in the range [-1, 1]
+ *
+ * @param time_us sample time in microseconds
+ * @return waveform value
+ */
+static float DHT11_sim_wave(int64_t time_us)
+{
+	if(g_sim_config.period_ms == 0)
+	{
+		return 0.0f;
+	}
+	int64_t period_us = (int64_t)g_sim_config.period_ms * 1000;
+	float phase = (float)(time_us % period_us) / (float)period_us;
+
+	switch(g_sim_config.waveform)
+	{
+		case DHT11_SIM_WAVE_SINE:
+			return sinf(2.0f * (float)M_PI * phase);
+		case DHT11_SIM_WAVE_TRIANGLE:
+			return phase < 0.5f ? 4.0f * phase - 1.0f : 3.0f - 4.0f * phase;
+		case DHT11_SIM_WAVE_SQUARE:
+			return phase < 0.5f ? 1.0f : -1.0f;
+		case DHT11_SIM_WAVE_SAWTOOTH:
+			return 2.0f * phase - 1.0f;
+		case DHT11_SIM_WAVE_CONSTANT:
+		default:
+			return 0.0f;
+	}
+}
+
+/**
+ * @fn int DHT11_sim_noise(void)
+ * @brief uniform noise in [-noise_amplitude, noise_amplitude]
+ *
+ * @return noise value
+ */
+static int DHT11_sim_noise(void)
+{
+	if(g_sim_config.noise_amplitude <= 0)
+	{
+		return 0;
+	}
+	uint32_t span = 2 * (uint32_t)g_sim_config.noise_amplitude + 1;
+	return (int)(DHT11_sim_rand() % span) - g_sim_config.noise_amplitude;
+}
+
+void DHT11_sim_get_default_config(dht11_sim_config_t *config)
+{
+	memset(config, 0x00, sizeof(dht11_sim_config_t));
+#if CONFIG_DHT11_SIM_WAVE_SINE
+	config->waveform = DHT11_SIM_WAVE_SINE;
+#elif CONFIG_DHT11_SIM_WAVE_TRIANGLE
+	config->waveform = DHT11_SIM_WAVE_TRIANGLE;
+#elif CONFIG_DHT11_SIM_WAVE_SQUARE
+	config->waveform = DHT11_SIM_WAVE_SQUARE;
+#elif CONFIG_DHT11_SIM_WAVE_SAWTOOTH
+	config->waveform = DHT11_SIM_WAVE_SAWTOOTH;
+#else
+	config->waveform = DHT11_SIM_WAVE_CONSTANT;
+#endif
+	config->period_ms = CONFIG_DHT11_SIM_PERIOD_MS;
+	config->temperature_offset = 25;
+	config->temperature_amplitude = 5;
+	config->humidity_offset = 50;
+	config->humidity_amplitude = 10;
+	config->noise_amplitude = CONFIG_DHT11_SIM_NOISE_AMPLITUDE;
+	config->crc_error_ppm = CONFIG_DHT11_SIM_CRC_ERROR_PPM;
+	config->timeout_error_ppm = CONFIG_DHT11_SIM_TIMEOUT_ERROR_PPM;
+	config->sample_rate_hz = CONFIG_DHT11_SIM_SAMPLE_RATE_HZ;
+	config->seed = CONFIG_DHT11_SIM_SEED;
+}
+
+void DHT11_sim_configure(const dht11_sim_config_t *config)
+{
+	g_sim_config = *config;
+	if(g_sim_config.sample_rate_hz == 0)
+	{
+		g_sim_config.sample_rate_hz = 1;
+	}
+	//xorshift must never be seeded with zero
+	portENTER_CRITICAL(&g_sim_rng_lock);
+	g_sim_rng_state = config->seed ? config->seed : 1;
+	portEXIT_CRITICAL(&g_sim_rng_lock);
+}
+
+uint32_t DHT11_sim_get_sample_rate(void)
+{
+	return g_sim_config.sample_rate_hz;
+}
+
+struct dht11_reading DHT11_sim_read_at(int64_t time_us)
+{
+	struct dht11_reading reading;
+	uint32_t roll = DHT11_sim_rand() % 1000000;
+
+	if(roll < g_sim_config.timeout_error_ppm)
+	{
+		reading.status = DHT11_TIMEOUT_ERROR;
+		reading.temperature = -1;
+		reading.humidity = -1;
+		return reading;
+	}
+	if(roll < g_sim_config.timeout_error_ppm + g_sim_config.crc_error_ppm)
+	{
+		reading.status = DHT11_CRC_ERROR;
+		reading.temperature = -1;
+		reading.humidity = -1;
+		return reading;
+	}
+
+	float wave = DHT11_sim_wave(time_us);
+	reading.status = DHT11_OK;
+	reading.temperature = g_sim_config.temperature_offset + (int)lroundf(wave * g_sim_config.temperature_amplitude) + DHT11_sim_noise();
+	reading.humidity = g_sim_config.humidity_offset + (int)lroundf(wave * g_sim_config.humidity_amplitude) + DHT11_sim_noise();
+	return reading;
+}
+
+/**
+ * @fn size_t DHT11_sim_edge(uint32_t*, size_t, size_t, uint32_t*, uint32_t, uint32_t, uint32_t, int)
+ * @brief move the line level after a phase of the frame and timestamp the edge, with jitter, never before the last one
+ *
+ * @return edges written
+ */
+static size_t DHT11_sim_edge(uint32_t *edges, size_t count, size_t max, uint32_t *nominal_us, uint32_t phase_us,
+							 uint32_t cycles_per_us, uint32_t jitter_us, int level)
+{
+	int32_t shift_us = 0;
+	uint32_t stamp;
+
+	if(count >= max)
+	{
+		return count;
+	}
+	*nominal_us += phase_us;
+	if(jitter_us > 0)
+	{
+		shift_us = (int32_t)(DHT11_sim_rand() % (2 * jitter_us + 1)) - (int32_t)jitter_us;
+	}
+	stamp = (*nominal_us + shift_us) * cycles_per_us;
+	if(count > 0 && (int32_t)((stamp & ~1u) - (edges[count - 1] & ~1u)) <= 0)
+	{
+		stamp = (edges[count - 1] & ~1u) + 2;
+	}
+	edges[count] = (stamp & ~1u) | (uint32_t)(level & 1);
+	return count + 1;
+}
+
+size_t DHT11_sim_edges_at(int64_t time_us, uint32_t cycles_per_us, uint32_t jitter_us, uint32_t *edges, size_t max,
+						  struct dht11_reading *reading)
+{
+	//DHT11 timing: response low and high 80 us, then each bit is 50 us low and 27 us (0) or 70 us (1) high
+	uint32_t nominal_us = (uint32_t)time_us;
+	uint8_t data[5];
+	size_t bits = 40;
+	size_t count = 0;
+
+	*reading = DHT11_sim_read_at(time_us);
+	data[0] = (uint8_t)reading->humidity;
+	data[1] = 0;
+	data[2] = (uint8_t)reading->temperature;
+	data[3] = 0;
+	data[4] = (uint8_t)(data[0] + data[1] + data[2] + data[3]);
+	if(reading->status == DHT11_TIMEOUT_ERROR)
+	{
+		//the sensor stopped answering part way through the frame
+		bits = DHT11_sim_rand() % 39;
+	}
+	else if(reading->status == DHT11_CRC_ERROR)
+	{
+		data[0] = (uint8_t)(g_sim_config.humidity_offset);
+		data[2] = (uint8_t)(g_sim_config.temperature_offset);
+		data[4] = (uint8_t)(data[0] + data[2] + 1 + DHT11_sim_rand() % 255);
+	}
+
+	//the host releases the line, the sensor answers 20 to 40 us later
+	count = DHT11_sim_edge(edges, count, max, &nominal_us, 0, cycles_per_us, 0, 1);
+	count = DHT11_sim_edge(edges, count, max, &nominal_us, 30, cycles_per_us, jitter_us, 0);
+	count = DHT11_sim_edge(edges, count, max, &nominal_us, 80, cycles_per_us, jitter_us, 1);
+	count = DHT11_sim_edge(edges, count, max, &nominal_us, 80, cycles_per_us, jitter_us, 0);
+	for(size_t bit = 0; bit < bits; bit++)
+	{
+		uint32_t high_us = data[bit / 8] & (1 << (7 - bit % 8)) ? 70 : 27;
+		count = DHT11_sim_edge(edges, count, max, &nominal_us, 50, cycles_per_us, jitter_us, 1);
+		count = DHT11_sim_edge(edges, count, max, &nominal_us, high_us, cycles_per_us, jitter_us, 0);
+	}
+	if(bits == 40)
+	{
+		//the sensor lets the line go after the last bit
+		count = DHT11_sim_edge(edges, count, max, &nominal_us, 50, cycles_per_us, jitter_us, 1);
+	}
+	return count;
+}
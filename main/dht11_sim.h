@@ -0,0 +1,100 @@
+/*
+ * dht11_sim.h
+ *
+ *  Created on: Oct 18, 2026
+ *      Author: hamxa
+ */
+
+#ifndef MAIN_DHT11_SIM_H_
+#define MAIN_DHT11_SIM_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "dht11.h"
+
+//Edges of a whole frame: release of the start signal, the response low and high phases, 40 bits and the release
+//of the line after the last one
+#define DHT11_SIM_FRAME_EDGES		(1 + 3 + 40 * 2 + 1)
+
+/**
+ * Waveforms the simulated sensor can generate
+ */
+typedef enum dht11_sim_waveform
+{
+	DHT11_SIM_WAVE_CONSTANT = 0,	/**< DHT11_SIM_WAVE_CONSTANT */
+	DHT11_SIM_WAVE_SINE,			/**< DHT11_SIM_WAVE_SINE */
+	DHT11_SIM_WAVE_TRIANGLE,		/**< DHT11_SIM_WAVE_TRIANGLE */
+	DHT11_SIM_WAVE_SQUARE,			/**< DHT11_SIM_WAVE_SQUARE */
+	DHT11_SIM_WAVE_SAWTOOTH			/**< DHT11_SIM_WAVE_SAWTOOTH */
+}dht11_sim_waveform_e;
+
+/**
+ * Simulated sensor configuration
+ */
+typedef struct dht11_sim_config
+{
+	dht11_sim_waveform_e waveform;
+	uint32_t period_ms;				///> waveform period
+	int temperature_offset;
+	int temperature_amplitude;
+	int humidity_offset;
+	int humidity_amplitude;
+	int noise_amplitude;			///> uniform noise added to both channels, +/- this value
+	uint32_t crc_error_ppm;			///> injected CRC errors, parts per million of samples
+	uint32_t timeout_error_ppm;		///> injected timeout errors, parts per million of samples
+	uint32_t sample_rate_hz;		///> rate the DHT11 task produces samples at
+	uint32_t seed;					///> noise and error injection seed, same seed gives the same stream
+}dht11_sim_config_t;
+
+/**
+ * @fn void DHT11_sim_get_default_config(dht11_sim_config_t*)
+ * @brief fill a configuration with the menuconfig defaults
+ *
+ * @param config output configuration
+ */
+void DHT11_sim_get_default_config(dht11_sim_config_t *config);
+
+/**
+ * @fn void DHT11_sim_configure(const dht11_sim_config_t*)
+ * @brief apply a configuration and restart the noise and error stream from its seed
+ *
+ * @param config configuration to apply
+ */
+void DHT11_sim_configure(const dht11_sim_config_t *config);
+
+/**
+ * @fn uint32_t DHT11_sim_get_sample_rate(void)
+ * @brief get the configured sample rate
+ *
+ * @return sample rate in Hz
+ */
+uint32_t DHT11_sim_get_sample_rate(void);
+
+/**
+ * @fn struct dht11_reading DHT11_sim_read_at(int64_t)
+ * @brief generate the simulated reading for a point in time, there is no minimum interval between reads
+ *
+ * @param time_us sample time in microseconds
+ * @return simulated reading, including injected errors
+ */
+struct dht11_reading DHT11_sim_read_at(int64_t time_us);
+
+/**
+ * @fn size_t DHT11_sim_edges_at(int64_t, uint32_t, uint32_t, uint32_t*, size_t, struct dht11_reading*)
+ * @brief generate the frame of the reading for a point in time as the edge capture backend timestamps it, from the
+ * 			release of the start signal. An injected timeout ends the frame early, an injected CRC error corrupts the
+ * 			checksum
+ *
+ * @param time_us sample time in microseconds, the timestamps start from it and wrap as the cycle counter does
+ * @param cycles_per_us timestamp resolution
+ * @param jitter_us each edge is moved by up to +/- this, as the interrupt latency would
+ * @param edges output edge timestamps, bit 0 holds the line level after the edge, as DHT11_edge_decode expects
+ * @param max room in edges, DHT11_SIM_FRAME_EDGES is enough
+ * @param reading output reading the frame carries, including injected errors
+ * @return number of edges
+ */
+size_t DHT11_sim_edges_at(int64_t time_us, uint32_t cycles_per_us, uint32_t jitter_us, uint32_t *edges, size_t max,
+						  struct dht11_reading *reading);
+
+#endif /* MAIN_DHT11_SIM_H_ */
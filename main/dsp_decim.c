@@ -0,0 +1,187 @@
+/*
+ * dsp_decim.c
+ *
+ *  Created on: Oct 18, 2026
+ *      Author: hamxa
+ *
+ *  Portable fixed-point decimation kernels, no ESP-IDF dependency so they also build on the host.
+ */
+#include <math.h>
+#include <string.h>
+
+#include "dsp_decim.h"
+
+#ifndef M_PI
+	#define M_PI	3.14159265358979323846
+#endif
+
+bool dsp_cic_init(dsp_cic_t *cic, uint8_t stages, uint32_t rate)
+{
+	uint64_t gain = 1;
+
+	if(stages == 0 || stages > DSP_CIC_MAX_STAGES || rate == 0)
+	{
+		return false;
+	}
+	for(int i = 0; i < stages; i++)
+	{
+		gain *= rate;
+		if(gain > INT32_MAX)
+		{
+			return false;
+		}
+	}
+
+	memset(cic, 0x00, sizeof(dsp_cic_t));
+	cic->stages = stages;
+	cic->rate = rate;
+	cic->gain = (uint32_t)gain;
+	return true;
+}
+
+size_t dsp_cic_decimate(dsp_cic_t *cic, const int32_t *in, size_t count, int32_t *out)
+{
+	size_t produced = 0;
+	const uint8_t stages = cic->stages;
+
+	for(size_t n = 0; n < count; n++)
+	{
+		//integrators run at the input rate, wrap around is harmless as long as the output fits in 32 bits
+		uint32_t acc = (uint32_t)in[n];
+		for(int i = 0; i < stages; i++)
+		{
+			cic->integ[i] += acc;
+			acc = cic->integ[i];
+		}
+
+		if(++cic->phase < cic->rate)
+		{
+			continue;
+		}
+		cic->phase = 0;
+
+		//combs run at the output rate
+		for(int i = 0; i < stages; i++)
+		{
+			uint32_t prev = cic->comb[i];
+			cic->comb[i] = acc;
+			acc -= prev;
+		}
+
+		int64_t value = (int32_t)acc;
+		out[produced++] = (int32_t)((value >= 0 ? value + cic->gain / 2 : value - cic->gain / 2) / (int64_t)cic->gain);
+	}
+	return produced;
+}
+
+bool dsp_fir_init(dsp_fir_t *fir, const int16_t *coeffs, uint16_t taps, uint16_t rate)
+{
+	if(taps == 0 || taps > DSP_FIR_MAX_TAPS || rate == 0)
+	{
+		return false;
+	}
+
+	memset(fir, 0x00, sizeof(dsp_fir_t));
+	fir->taps = taps;
+	fir->rate = rate;
+	//stored reversed so the dot product walks both arrays forward, oldest sample first
+	for(uint16_t i = 0; i < taps; i++)
+	{
+		fir->coeffs[i] = coeffs[taps - 1 - i];
+	}
+	return true;
+}
+
+/**
+ * @fn int32_t dsp_fir_dot(const int16_t*, const int16_t*, uint16_t)
+ * @brief Q15 dot product, four independent accumulators so the compiler can pipeline or vectorize it
+ *
+ * @param x samples
+ * @param h coefficients
+ * @param taps length of both arrays
+ * @return result rounded back to Q0 and saturated to 16 bits
+ */
+static int32_t dsp_fir_dot(const int16_t *restrict x, const int16_t *restrict h, uint16_t taps)
+{
+	int64_t acc0 = 0, acc1 = 0, acc2 = 0, acc3 = 0;
+	uint16_t i = 0;
+
+	for(; i + 4 <= taps; i += 4)
+	{
+		acc0 += (int32_t)x[i] * h[i];
+		acc1 += (int32_t)x[i + 1] * h[i + 1];
+		acc2 += (int32_t)x[i + 2] * h[i + 2];
+		acc3 += (int32_t)x[i + 3] * h[i + 3];
+	}
+	for(; i < taps; i++)
+	{
+		acc0 += (int32_t)x[i] * h[i];
+	}
+
+	int64_t acc = (acc0 + acc1 + acc2 + acc3 + (1 << 14)) >> 15;
+	if(acc > INT16_MAX)
+	{
+		return INT16_MAX;
+	}
+	if(acc < INT16_MIN)
+	{
+		return INT16_MIN;
+	}
+	return (int32_t)acc;
+}
+
+size_t dsp_fir_decimate(dsp_fir_t *fir, const int16_t *in, size_t count, int16_t *out)
+{
+	size_t produced = 0;
+
+	for(size_t n = 0; n < count; n++)
+	{
+		fir->delay[fir->pos] = in[n];
+		fir->delay[fir->pos + fir->taps] = in[n];
+		if(++fir->pos == fir->taps)
+		{
+			fir->pos = 0;
+		}
+
+		//outputs that are decimated away are never computed
+		if(++fir->phase < fir->rate)
+		{
+			continue;
+		}
+		fir->phase = 0;
+		out[produced++] = (int16_t)dsp_fir_dot(&fir->delay[fir->pos], fir->coeffs, fir->taps);
+	}
+	return produced;
+}
+
+bool dsp_fir_design_lowpass(int16_t *coeffs, uint16_t taps, float cutoff)
+{
+	float h[DSP_FIR_MAX_TAPS];
+	float sum = 0.0f;
+	int32_t qsum = 0;
+
+	if(taps == 0 || taps > DSP_FIR_MAX_TAPS || cutoff <= 0.0f || cutoff > 0.5f)
+	{
+		return false;
+	}
+
+	for(uint16_t i = 0; i < taps; i++)
+	{
+		float m = (float)i - (float)(taps - 1) / 2.0f;
+		float sinc = m == 0.0f ? 2.0f * cutoff : sinf(2.0f * (float)M_PI * cutoff * m) / ((float)M_PI * m);
+		float window = taps > 1 ? 0.54f - 0.46f * cosf(2.0f * (float)M_PI * i / (float)(taps - 1)) : 1.0f;
+		h[i] = sinc * window;
+		sum += h[i];
+	}
+
+	for(uint16_t i = 0; i < taps; i++)
+	{
+		coeffs[i] = (int16_t)lroundf(h[i] / sum * 32768.0f);
+		qsum += coeffs[i];
+	}
+	//put the rounding residue on the center tap so the taps sum to 32768, a DC gain of exactly 1 in Q15. A center
+	//tap of 1.0 has no Q15 value, a single tap saturates to 32767/32768
+	int32_t center = coeffs[taps / 2] + 32768 - qsum;
+	coeffs[taps / 2] = (int16_t)(center > INT16_MAX ? INT16_MAX : center);
+	return true;
+}
@@ -0,0 +1,107 @@
+/*
+ * dsp_decim.h
+ *
+ *  Created on: Oct 18, 2026
+ *      Author: hamxa
+ */
+
+#ifndef MAIN_DSP_DECIM_H_
+#define MAIN_DSP_DECIM_H_
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+//Maximum number of integrator/comb stages of a CIC decimator
+#define DSP_CIC_MAX_STAGES		4
+
+//Maximum number of taps of a FIR decimator
+#define DSP_FIR_MAX_TAPS		64
+
+/**
+ * Cascaded integrator-comb decimator, 32 bit modular arithmetic.
+ * The output of every stage must fit in 32 bits: input bits + stages * log2(rate) <= 32
+ */
+typedef struct dsp_cic
+{
+	uint8_t stages;
+	uint32_t rate;
+	uint32_t phase;						///> input samples since the last output
+	uint32_t gain;						///> rate ^ stages, divided out of the output
+	uint32_t integ[DSP_CIC_MAX_STAGES];
+	uint32_t comb[DSP_CIC_MAX_STAGES];	///> previous input of each comb stage
+}dsp_cic_t;
+
+/**
+ * FIR decimator with Q15 coefficients.
+ * The delay line is stored twice so the dot product always runs over contiguous memory
+ */
+typedef struct dsp_fir
+{
+	uint16_t taps;
+	uint16_t rate;
+	uint16_t pos;						///> next write position in the delay line
+	uint16_t phase;						///> input samples since the last output
+	int16_t coeffs[DSP_FIR_MAX_TAPS];
+	int16_t delay[2 * DSP_FIR_MAX_TAPS];
+}dsp_fir_t;
+
+/**
+ * @fn bool dsp_cic_init(dsp_cic_t*, uint8_t, uint32_t)
+ * @brief initialize a CIC decimator with a unity DC gain output
+ *
+ * @param cic decimator to initialize
+ * @param stages number of integrator/comb pairs, 1 to DSP_CIC_MAX_STAGES
+ * @param rate decimation factor
+ * @return false if the parameters are out of range or the gain does not fit in 32 bits
+ */
+bool dsp_cic_init(dsp_cic_t *cic, uint8_t stages, uint32_t rate);
+
+/**
+ * @fn size_t dsp_cic_decimate(dsp_cic_t*, const int32_t*, size_t, int32_t*)
+ * @brief decimate a block of samples, state carries over between blocks
+ *
+ * @param cic decimator
+ * @param in input samples
+ * @param count number of input samples
+ * @param out output samples, room for count / rate + 1 samples
+ * @return number of output samples written
+ */
+size_t dsp_cic_decimate(dsp_cic_t *cic, const int32_t *in, size_t count, int32_t *out);
+
+/**
+ * @fn bool dsp_fir_init(dsp_fir_t*, const int16_t*, uint16_t, uint16_t)
+ * @brief initialize a FIR decimator
+ *
+ * @param fir decimator to initialize
+ * @param coeffs Q15 coefficients
+ * @param taps number of coefficients, 1 to DSP_FIR_MAX_TAPS
+ * @param rate decimation factor
+ * @return false if the parameters are out of range
+ */
+bool dsp_fir_init(dsp_fir_t *fir, const int16_t *coeffs, uint16_t taps, uint16_t rate);
+
+/**
+ * @fn size_t dsp_fir_decimate(dsp_fir_t*, const int16_t*, size_t, int16_t*)
+ * @brief filter and decimate a block of samples, only the kept outputs are computed
+ *
+ * @param fir decimator
+ * @param in input samples
+ * @param count number of input samples
+ * @param out output samples, room for count / rate + 1 samples
+ * @return number of output samples written
+ */
+size_t dsp_fir_decimate(dsp_fir_t *fir, const int16_t *in, size_t count, int16_t *out);
+
+/**
+ * @fn bool dsp_fir_design_lowpass(int16_t*, uint16_t, float)
+ * @brief Hamming windowed-sinc low-pass design, the taps sum to 32768 for a unity DC gain, 32767 for a single tap
+ *
+ * @param coeffs output Q15 coefficients
+ * @param taps number of coefficients, 1 to DSP_FIR_MAX_TAPS
+ * @param cutoff cutoff frequency as a fraction of the sample rate, 0 to 0.5
+ * @return false if the parameters are out of range
+ */
+bool dsp_fir_design_lowpass(int16_t *coeffs, uint16_t taps, float cutoff);
+
+#endif /* MAIN_DSP_DECIM_H_ */
@@ -0,0 +1,325 @@
+/*
+ * dsp_decim_bench.c
+ *
+ *  Created on: Oct 19, 2026
+ *      Author: hamxa
+ */
+#include <math.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include "esp_log.h"
+
+#include "dsp_decim.h"
+#include "dsp_decim_bench.h"
+
+static const char TAG[] = "dsp_decim_bench";
+
+//raw conversions, and the outputs of each stage, too large for the stack
+static int32_t g_raw[DSP_DECIM_BENCH_SAMPLES];
+static int16_t g_fir_in[DSP_DECIM_BENCH_SAMPLES];
+static int32_t g_cic_out[DSP_DECIM_BENCH_SAMPLES + 1];
+static int16_t g_fir_out[DSP_DECIM_BENCH_SAMPLES + 1];
+
+//keeps the outputs observable so the kernels are not optimized away
+static volatile int32_t g_sink;
+
+/**
+ * @fn int64_t dsp_decim_bench_now_ns(void)
+ * @brief monotonic time
+ *
+ */
+static int64_t dsp_decim_bench_now_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (int64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+/**
+ * @fn uint32_t dsp_decim_bench_random(uint32_t*)
+ * @brief xorshift32, the same samples on every run
+ *
+ */
+static uint32_t dsp_decim_bench_random(uint32_t *state)
+{
+	uint32_t x = *state;
+
+	x ^= x << 13;
+	x ^= x >> 17;
+	x ^= x << 5;
+	*state = x;
+	return x;
+}
+
+/**
+ * @fn size_t dsp_decim_bench_chunk(uint32_t*)
+ * @brief length of the next block handed to a kernel, 1 to a whole frame
+ *
+ */
+static size_t dsp_decim_bench_chunk(uint32_t *state)
+{
+	return 1 + dsp_decim_bench_random(state) % DSP_DECIM_BENCH_FRAME;
+}
+
+/**
+ * @fn bool dsp_decim_bench_check_cic(uint8_t, uint32_t, size_t)
+ * @brief feed 12 bit conversions in blocks of random length and compare every output with the direct convolution
+ * 			of the input with rate-long boxcars, one per stage, divided by the gain
+ *
+ */
+static bool dsp_decim_bench_check_cic(uint8_t stages, uint32_t rate, size_t count)
+{
+	int64_t h[DSP_CIC_MAX_STAGES * 64 + 1] = {1};
+	size_t h_len = 1;
+	dsp_cic_t cic;
+	uint32_t seed = 1;
+	size_t produced = 0;
+
+	if(!dsp_cic_init(&cic, stages, rate) || (size_t)stages * (rate - 1) + 1 > sizeof(h) / sizeof(h[0]))
+	{
+		ESP_LOGE(TAG, "dsp_decim_bench_check_cic: %u stages of rate %lu refused", stages, (unsigned long)rate);
+		return false;
+	}
+	//impulse response of the cascade
+	for(uint8_t s = 0; s < stages; s++)
+	{
+		for(size_t j = h_len + rate - 1; j-- > 0;)
+		{
+			int64_t sum = 0;
+			for(uint32_t k = 0; k < rate && k <= j; k++)
+			{
+				sum += j - k < h_len ? h[j - k] : 0;
+			}
+			h[j] = sum;
+		}
+		h_len += rate - 1;
+	}
+
+	for(size_t i = 0; i < count; i++)
+	{
+		g_raw[i] = (int32_t)(dsp_decim_bench_random(&seed) & 0xfff);
+	}
+	for(size_t done = 0; done < count;)
+	{
+		size_t n = dsp_decim_bench_chunk(&seed);
+		n = n < count - done ? n : count - done;
+		produced += dsp_cic_decimate(&cic, &g_raw[done], n, &g_cic_out[produced]);
+		done += n;
+	}
+	if(produced != count / rate)
+	{
+		ESP_LOGE(TAG, "dsp_decim_bench_check_cic: %u outputs from %u inputs at rate %lu", (unsigned)produced,
+				(unsigned)count, (unsigned long)rate);
+		return false;
+	}
+
+	for(size_t m = 0; m < produced; m++)
+	{
+		size_t n = m * rate + rate - 1;
+		int64_t acc = 0;
+		for(size_t j = 0; j < h_len && j <= n; j++)
+		{
+			acc += h[j] * g_raw[n - j];
+		}
+		int64_t expected = (acc + (int64_t)cic.gain / 2) / (int64_t)cic.gain;
+		if(g_cic_out[m] != expected)
+		{
+			ESP_LOGE(TAG, "dsp_decim_bench_check_cic: %u stages rate %lu, output %u is %ld, expected %lld", stages,
+					(unsigned long)rate, (unsigned)m, (long)g_cic_out[m], (long long)expected);
+			return false;
+		}
+	}
+	return true;
+}
+
+/**
+ * @fn bool dsp_decim_bench_check_fir(uint16_t, uint16_t, size_t)
+ * @brief feed full scale samples in blocks of random length and compare every output with the direct Q15
+ * 			convolution, rounded and saturated the same way
+ *
+ */
+static bool dsp_decim_bench_check_fir(uint16_t taps, uint16_t rate, size_t count)
+{
+	int16_t coeffs[DSP_FIR_MAX_TAPS];
+	dsp_fir_t fir;
+	uint32_t seed = 2;
+	size_t produced = 0;
+
+	if(!dsp_fir_design_lowpass(coeffs, taps, 0.4f / rate) || !dsp_fir_init(&fir, coeffs, taps, rate))
+	{
+		ESP_LOGE(TAG, "dsp_decim_bench_check_fir: %u taps at rate %u refused", taps, rate);
+		return false;
+	}
+	for(size_t i = 0; i < count; i++)
+	{
+		g_fir_in[i] = (int16_t)dsp_decim_bench_random(&seed);
+	}
+	for(size_t done = 0; done < count;)
+	{
+		size_t n = dsp_decim_bench_chunk(&seed);
+		n = n < count - done ? n : count - done;
+		produced += dsp_fir_decimate(&fir, &g_fir_in[done], n, &g_fir_out[produced]);
+		done += n;
+	}
+	if(produced != count / rate)
+	{
+		ESP_LOGE(TAG, "dsp_decim_bench_check_fir: %u outputs from %u inputs at rate %u", (unsigned)produced,
+				(unsigned)count, rate);
+		return false;
+	}
+
+	for(size_t m = 0; m < produced; m++)
+	{
+		size_t n = m * rate + rate - 1;
+		int64_t acc = 0;
+		for(size_t k = 0; k < taps && k <= n; k++)
+		{
+			acc += (int32_t)coeffs[k] * g_fir_in[n - k];
+		}
+		acc = (acc + (1 << 14)) >> 15;
+		int64_t expected = acc > INT16_MAX ? INT16_MAX : acc < INT16_MIN ? INT16_MIN : acc;
+		if(g_fir_out[m] != expected)
+		{
+			ESP_LOGE(TAG, "dsp_decim_bench_check_fir: %u taps rate %u, output %u is %d, expected %lld", taps, rate,
+					(unsigned)m, g_fir_out[m], (long long)expected);
+			return false;
+		}
+	}
+	return true;
+}
+
+/**
+ * @fn bool dsp_decim_bench_check_design(uint16_t, float)
+ * @brief check the low-pass design keeps DC as it is, and measure its attenuation of a tone at three times the cutoff
+ *
+ */
+static bool dsp_decim_bench_check_design(uint16_t taps, float cutoff)
+{
+	int16_t coeffs[DSP_FIR_MAX_TAPS];
+	int32_t sum = 0;
+	dsp_fir_t fir;
+	int32_t peak = 0;
+	size_t count = 4096;
+
+	if(!dsp_fir_design_lowpass(coeffs, taps, cutoff) || !dsp_fir_init(&fir, coeffs, taps, 1))
+	{
+		return false;
+	}
+	for(uint16_t i = 0; i < taps; i++)
+	{
+		sum += coeffs[i];
+	}
+
+	for(size_t i = 0; i < count; i++)
+	{
+		g_fir_in[i] = (int16_t)lroundf(16384.0f * sinf(2.0f * 3.14159265f * 3.0f * cutoff * (float)i));
+	}
+	dsp_fir_decimate(&fir, g_fir_in, count, g_fir_out);
+	//past the first taps the delay line is full
+	for(size_t i = taps; i < count; i++)
+	{
+		peak = abs(g_fir_out[i]) > peak ? abs(g_fir_out[i]) : peak;
+	}
+	float attenuation_db = 20.0f * log10f(16384.0f / (float)(peak > 0 ? peak : 1));
+
+	bool passed = sum == 32768 && attenuation_db >= DSP_DECIM_BENCH_STOPBAND_DB;
+	ESP_LOGI(TAG, "low-pass %u taps, cutoff %.3f: %s, DC gain %ld/32768, %.1f dB at %.3f, bound %d dB", taps, cutoff,
+			passed ? "PASS" : "FAIL", (long)sum, attenuation_db, 3.0f * cutoff, DSP_DECIM_BENCH_STOPBAND_DB);
+	return passed;
+}
+
+/**
+ * @fn void dsp_decim_bench_measure(void)
+ * @brief time the analog probe chain on frames as the ADC task reads them, per kernel and per raw conversion
+ *
+ */
+static void dsp_decim_bench_measure(void)
+{
+	int16_t coeffs[DSP_FIR_MAX_TAPS];
+	dsp_cic_t cic;
+	dsp_fir_t fir;
+	dsp_fir_t fir_max;
+	uint32_t seed = 3;
+	size_t cic_out = 0;
+	size_t fir_out = 0;
+	int64_t start;
+	int64_t cic_ns;
+	int64_t fir_ns;
+	int64_t fir_max_ns;
+
+	dsp_cic_init(&cic, DSP_DECIM_BENCH_CIC_STAGES, DSP_DECIM_BENCH_CIC_RATE);
+	dsp_fir_design_lowpass(coeffs, DSP_DECIM_BENCH_FIR_TAPS, 0.4f / DSP_DECIM_BENCH_FIR_RATE);
+	dsp_fir_init(&fir, coeffs, DSP_DECIM_BENCH_FIR_TAPS, DSP_DECIM_BENCH_FIR_RATE);
+	dsp_fir_design_lowpass(coeffs, DSP_FIR_MAX_TAPS, 0.4f / DSP_DECIM_BENCH_FIR_RATE);
+	dsp_fir_init(&fir_max, coeffs, DSP_FIR_MAX_TAPS, DSP_DECIM_BENCH_FIR_RATE);
+	for(size_t i = 0; i < DSP_DECIM_BENCH_SAMPLES; i++)
+	{
+		g_raw[i] = (int32_t)(dsp_decim_bench_random(&seed) & 0xfff);
+		g_fir_in[i] = (int16_t)(g_raw[i] - 2048);
+	}
+
+	start = dsp_decim_bench_now_ns();
+	for(size_t i = 0; i < DSP_DECIM_BENCH_SAMPLES; i += DSP_DECIM_BENCH_FRAME)
+	{
+		cic_out += dsp_cic_decimate(&cic, &g_raw[i], DSP_DECIM_BENCH_FRAME, &g_cic_out[cic_out]);
+	}
+	cic_ns = dsp_decim_bench_now_ns() - start;
+
+	//the FIR stage is timed on a full rate input, its cost per input sample does not depend on where the input came from
+	start = dsp_decim_bench_now_ns();
+	for(size_t i = 0; i < DSP_DECIM_BENCH_SAMPLES; i += DSP_DECIM_BENCH_FRAME)
+	{
+		fir_out += dsp_fir_decimate(&fir, &g_fir_in[i], DSP_DECIM_BENCH_FRAME, &g_fir_out[fir_out]);
+	}
+	fir_ns = dsp_decim_bench_now_ns() - start;
+
+	start = dsp_decim_bench_now_ns();
+	for(size_t i = 0, out = 0; i < DSP_DECIM_BENCH_SAMPLES; i += DSP_DECIM_BENCH_FRAME)
+	{
+		out += dsp_fir_decimate(&fir_max, &g_fir_in[i], DSP_DECIM_BENCH_FRAME, &g_fir_out[out]);
+	}
+	fir_max_ns = dsp_decim_bench_now_ns() - start;
+	g_sink += g_cic_out[cic_out - 1] + g_fir_out[fir_out - 1];
+
+	ESP_LOGI(TAG, "CIC %u stages rate %u: %.2f ns per input sample", DSP_DECIM_BENCH_CIC_STAGES,
+			DSP_DECIM_BENCH_CIC_RATE, (double)cic_ns / DSP_DECIM_BENCH_SAMPLES);
+	ESP_LOGI(TAG, "FIR %u taps rate %u: %.2f ns per input sample, %.1f ns per output", DSP_DECIM_BENCH_FIR_TAPS,
+			DSP_DECIM_BENCH_FIR_RATE, (double)fir_ns / DSP_DECIM_BENCH_SAMPLES, (double)fir_ns / fir_out);
+	ESP_LOGI(TAG, "FIR %u taps rate %u: %.2f ns per input sample", DSP_FIR_MAX_TAPS, DSP_DECIM_BENCH_FIR_RATE,
+			(double)fir_max_ns / DSP_DECIM_BENCH_SAMPLES);
+	//the FIR only sees one sample in CIC rate of the conversions
+	ESP_LOGI(TAG, "chain: %.2f ns per raw conversion", ((double)cic_ns + (double)fir_ns / DSP_DECIM_BENCH_CIC_RATE) /
+			DSP_DECIM_BENCH_SAMPLES);
+}
+
+bool dsp_decim_bench_run(void)
+{
+	static const uint32_t cic_rates[] = {2, 7, DSP_DECIM_BENCH_CIC_RATE, 64};
+	static const uint16_t fir_taps[] = {1, 5, DSP_DECIM_BENCH_FIR_TAPS, DSP_FIR_MAX_TAPS};
+	static const uint16_t fir_rates[] = {1, 3, DSP_DECIM_BENCH_FIR_RATE, 16};
+	bool passed = true;
+
+	for(uint8_t stages = 1; stages <= DSP_DECIM_BENCH_CIC_STAGES; stages++)
+	{
+		for(size_t i = 0; i < sizeof(cic_rates) / sizeof(cic_rates[0]); i++)
+		{
+			passed = dsp_decim_bench_check_cic(stages, cic_rates[i], 64 * 1024 + 13) && passed;
+		}
+	}
+	for(size_t i = 0; i < sizeof(fir_taps) / sizeof(fir_taps[0]); i++)
+	{
+		for(size_t j = 0; j < sizeof(fir_rates) / sizeof(fir_rates[0]); j++)
+		{
+			passed = dsp_decim_bench_check_fir(fir_taps[i], fir_rates[j], 16 * 1024 + 5) && passed;
+		}
+	}
+	ESP_LOGI(TAG, "CIC and FIR outputs against direct convolution: %s", passed ? "PASS" : "FAIL");
+	passed = dsp_decim_bench_check_design(DSP_DECIM_BENCH_FIR_TAPS, 0.4f / DSP_DECIM_BENCH_FIR_RATE) && passed;
+	passed = dsp_decim_bench_check_design(DSP_FIR_MAX_TAPS, 0.4f / DSP_DECIM_BENCH_FIR_RATE) && passed;
+
+	dsp_decim_bench_measure();
+	return passed;
+}
@@ -0,0 +1,35 @@
+/*
+ * dsp_decim_bench.h
+ *
+ *  Created on: Oct 19, 2026
+ *      Author: hamxa
+ */
+
+#ifndef MAIN_DSP_DECIM_BENCH_H_
+#define MAIN_DSP_DECIM_BENCH_H_
+
+#include <stdbool.h>
+
+//Input samples per timed run, and per call as the ADC task hands them over
+#define DSP_DECIM_BENCH_SAMPLES			(1 << 20)
+#define DSP_DECIM_BENCH_FRAME			256
+
+//Stages of the analog probe chain, its default Kconfig values
+#define DSP_DECIM_BENCH_CIC_STAGES		3
+#define DSP_DECIM_BENCH_CIC_RATE		50
+#define DSP_DECIM_BENCH_FIR_TAPS		32
+#define DSP_DECIM_BENCH_FIR_RATE		4
+
+//Least attenuation of the low-pass design for a tone well past its cutoff
+#define DSP_DECIM_BENCH_STOPBAND_DB		40
+
+/**
+ * @fn bool dsp_decim_bench_run(void)
+ * @brief check the CIC and FIR decimators against a direct convolution, whatever the block sizes they are fed, and
+ * 			the low-pass design against its DC gain and stopband, then log the time per input sample of each kernel
+ *
+ * @return true if the kernels matched their reference
+ */
+bool dsp_decim_bench_run(void);
+
+#endif /* MAIN_DSP_DECIM_BENCH_H_ */
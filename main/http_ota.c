@@ -0,0 +1,576 @@
+/*
+ * http_ota.c
+ *
+ *  Created on: Oct 18, 2026
+ *      Author: hamxa
+ */
+#include <stdio.h>
+#include <string.h>
+
+#include "esp_log.h"
+
+#include "http_ota.h"
+
+#if !CONFIG_IDF_TARGET_LINUX
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "esp_crt_bundle.h"
+#include "esp_http_client.h"
+#include "esp_ota_ops.h"
+#include "esp_system.h"
+#include "esp_timer.h"
+
+#include "mqtt_session_store.h"
+#include "ota_verify.h"
+#include "tasks_common.h"
+#endif
+
+static http_ota_stats_t g_stats;
+
+/**
+ * @fn bool http_ota_parse_content_range(const char*, uint32_t*, uint32_t*)
+ * @brief read the first byte and the image size of "bytes <first>-<last>/<size>"
+ *
+ */
+static bool http_ota_parse_content_range(const char *content_range, uint32_t *first, uint32_t *size)
+{
+	unsigned long start, last, total;
+	char end;
+
+	if(sscanf(content_range, "bytes %lu-%lu/%lu%c", &start, &last, &total, &end) != 3 || start > last ||
+	   last >= total || total > UINT32_MAX)
+	{
+		return false;
+	}
+	*first = (uint32_t)start;
+	*size = (uint32_t)total;
+	return true;
+}
+
+void http_ota_begin(http_ota_t *ota)
+{
+	memset(ota, 0, sizeof(*ota));
+}
+
+int http_ota_range(const http_ota_t *ota, char *range, size_t size)
+{
+	if(ota->offset == 0)
+	{
+		return 0;
+	}
+	int len = snprintf(range, size, "bytes=%lu-", (unsigned long)ota->offset);
+	return len < 0 || (size_t)len >= size ? -1 : len;
+}
+
+esp_err_t http_ota_response(http_ota_t *ota, int status, int64_t content_length, const char *content_range,
+							const char *validator)
+{
+	uint32_t first;
+	uint32_t size;
+
+	ota->skip = 0;
+	if(ota->size == 0)
+	{
+		if(status != 200)
+		{
+			return ESP_ERR_INVALID_RESPONSE;
+		}
+		if(content_length <= 0 || content_length > UINT32_MAX)
+		{
+			return ESP_ERR_INVALID_SIZE;
+		}
+		ota->size = (uint32_t)content_length;
+		//without a validator a changed image cannot be told apart, the first bytes are trusted as they are
+		snprintf(ota->validator, sizeof(ota->validator), "%s", validator != NULL ? validator : "");
+		return ESP_OK;
+	}
+
+	if(status == 206)
+	{
+		if(content_range == NULL || !http_ota_parse_content_range(content_range, &first, &size) ||
+		   first != ota->offset || size != ota->size)
+		{
+			return ESP_ERR_INVALID_RESPONSE;
+		}
+		ota->resumes++;
+		__atomic_fetch_add(&g_stats.resumes, 1, __ATOMIC_RELAXED);
+		return ESP_OK;
+	}
+	if(status == 200)
+	{
+		//If-Range did not match, or the server does not do ranges
+		if(ota->validator[0] == '\0' || validator == NULL || strcmp(validator, ota->validator) != 0 ||
+		   content_length != ota->size)
+		{
+			return ESP_ERR_INVALID_STATE;
+		}
+		ota->skip = ota->offset;
+		ota->resumes++;
+		__atomic_fetch_add(&g_stats.resumes, 1, __ATOMIC_RELAXED);
+		__atomic_fetch_add(&g_stats.restarted, 1, __ATOMIC_RELAXED);
+		return ESP_OK;
+	}
+	return ESP_ERR_INVALID_RESPONSE;
+}
+
+size_t http_ota_received(http_ota_t *ota, uint8_t *data, size_t len)
+{
+	size_t dropped = len < ota->skip ? len : ota->skip;
+
+	__atomic_fetch_add(&g_stats.bytes, len, __ATOMIC_RELAXED);
+	ota->skip -= dropped;
+	len -= dropped;
+	//the server may send more than it announced, the image ends where the first response said
+	if(len > ota->size - ota->offset)
+	{
+		len = ota->size - ota->offset;
+	}
+	if(dropped > 0 && len > 0)
+	{
+		memmove(data, data + dropped, len);
+	}
+	ota->offset += len;
+	return len;
+}
+
+bool http_ota_complete(const http_ota_t *ota)
+{
+	return ota->size > 0 && ota->offset == ota->size;
+}
+
+void http_ota_pipe_init(http_ota_pipe_t *pipe)
+{
+	for(size_t i = 0; i < HTTP_OTA_PIPE_DEPTH; i++)
+	{
+		pipe->chunks[i].len = 0;
+	}
+	pipe->pushed = 0;
+	pipe->popped = 0;
+}
+
+http_ota_chunk_t *http_ota_pipe_fill(http_ota_pipe_t *pipe)
+{
+	uint32_t popped = __atomic_load_n(&pipe->popped, __ATOMIC_ACQUIRE);
+
+	if(pipe->pushed - popped >= HTTP_OTA_PIPE_DEPTH)
+	{
+		return NULL;
+	}
+	return &pipe->chunks[pipe->pushed % HTTP_OTA_PIPE_DEPTH];
+}
+
+void http_ota_pipe_push(http_ota_pipe_t *pipe)
+{
+	__atomic_store_n(&pipe->pushed, pipe->pushed + 1, __ATOMIC_RELEASE);
+}
+
+http_ota_chunk_t *http_ota_pipe_peek(http_ota_pipe_t *pipe)
+{
+	uint32_t pushed = __atomic_load_n(&pipe->pushed, __ATOMIC_ACQUIRE);
+
+	if(pushed == pipe->popped)
+	{
+		return NULL;
+	}
+	return &pipe->chunks[pipe->popped % HTTP_OTA_PIPE_DEPTH];
+}
+
+void http_ota_pipe_pop(http_ota_pipe_t *pipe)
+{
+	pipe->chunks[pipe->popped % HTTP_OTA_PIPE_DEPTH].len = 0;
+	__atomic_store_n(&pipe->popped, pipe->popped + 1, __ATOMIC_RELEASE);
+}
+
+bool http_ota_pipe_empty(const http_ota_pipe_t *pipe)
+{
+	return __atomic_load_n(&pipe->popped, __ATOMIC_ACQUIRE) == pipe->pushed;
+}
+
+void http_ota_get_stats(http_ota_stats_t *stats)
+{
+	stats->fetches = __atomic_load_n(&g_stats.fetches, __ATOMIC_RELAXED);
+	stats->completed = __atomic_load_n(&g_stats.completed, __ATOMIC_RELAXED);
+	stats->resumes = __atomic_load_n(&g_stats.resumes, __ATOMIC_RELAXED);
+	stats->restarted = __atomic_load_n(&g_stats.restarted, __ATOMIC_RELAXED);
+	stats->bytes = __atomic_load_n(&g_stats.bytes, __ATOMIC_RELAXED);
+}
+
+#if !CONFIG_IDF_TARGET_LINUX
+static const char TAG[] = "http_ota";
+
+static char g_url[HTTP_OTA_URL_MAX_LEN];
+static uint8_t g_sha256[OTA_VERIFY_DIGEST_LEN];
+static bool g_has_sha256;
+//g_busy claims the URL and the SHA-256 for a caller of http_ota_fetch, g_requested hands them to the fetch task. Both
+//are cleared once the fetch is over
+static bool g_busy;
+static bool g_requested;
+static TaskHandle_t g_fetch_task;
+static TaskHandle_t g_flash_task;
+
+//owned by the fetch task, the flash task only sees the chunks
+static http_ota_t g_ota;
+static http_ota_pipe_t g_pipe;
+static const esp_partition_t *g_partition;
+static bool g_active;
+static int64_t g_start_us;
+
+//written by the fetch task before it pushes the first chunk
+static esp_ota_handle_t g_handle;
+//owned by the flash task while chunks are pushed, by the fetch task once they are all written
+static ota_verify_t g_verify;
+//first image check or esp_ota_write error, set by the flash task
+static esp_err_t g_flash_err;
+
+/**
+ * @fn void http_ota_flash_task(void*)
+ * @brief hash the chunks and write them to the OTA partition in the order they were received
+ *
+ */
+static void http_ota_flash_task(void *pvParameters)
+{
+	http_ota_chunk_t *chunk;
+
+	for(;;)
+	{
+		ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+		while((chunk = http_ota_pipe_peek(&g_pipe)) != NULL)
+		{
+			//after an error the chunks are only given back, the fetch task gives the image up
+			if(__atomic_load_n(&g_flash_err, __ATOMIC_RELAXED) == ESP_OK)
+			{
+				//a chunk that is not part of an app image is given up before it is written
+				esp_err_t err = ota_verify_update(&g_verify, chunk->data, chunk->len);
+				if(err == ESP_OK)
+				{
+					err = esp_ota_write(g_handle, chunk->data, chunk->len);
+				}
+				if(err != ESP_OK)
+				{
+					__atomic_store_n(&g_flash_err, err, __ATOMIC_RELAXED);
+				}
+			}
+			http_ota_pipe_pop(&g_pipe);
+			xTaskNotifyGive(g_fetch_task);
+		}
+	}
+}
+
+/**
+ * @fn esp_err_t http_ota_request(esp_http_client_handle_t)
+ * @brief request the image from the first byte not received and check the response, opening the image in the
+ * 			OTA partition on the first one
+ *
+ * @return ESP_OK, ESP_FAIL if the connection failed, another error if the fetch cannot go on
+ */
+static esp_err_t http_ota_request(esp_http_client_handle_t client)
+{
+	char range[HTTP_OTA_RANGE_MAX_LEN];
+	char *content_range = NULL;
+	char *validator = NULL;
+	int64_t content_length;
+	esp_err_t err;
+
+	if(http_ota_range(&g_ota, range, sizeof(range)) > 0)
+	{
+		esp_http_client_set_header(client, "Range", range);
+		if(g_ota.validator[0] != '\0')
+		{
+			esp_http_client_set_header(client, "If-Range", g_ota.validator);
+		}
+	}
+	//a kept-alive connection is reused, a dropped one opened again
+	if(esp_http_client_open(client, 0) != ESP_OK)
+	{
+		return ESP_FAIL;
+	}
+	content_length = esp_http_client_fetch_headers(client);
+	if(content_length < 0)
+	{
+		return ESP_FAIL;
+	}
+	esp_http_client_get_header(client, "Content-Range", &content_range);
+	if(esp_http_client_get_header(client, "ETag", &validator) != ESP_OK || validator == NULL)
+	{
+		esp_http_client_get_header(client, "Last-Modified", &validator);
+	}
+
+	err = http_ota_response(&g_ota, esp_http_client_get_status_code(client), content_length, content_range, validator);
+	if(err != ESP_OK || g_active)
+	{
+		return err;
+	}
+
+	g_partition = esp_ota_get_next_update_partition(NULL);
+	if(g_partition == NULL || g_ota.size > g_partition->size)
+	{
+		return ESP_ERR_INVALID_SIZE;
+	}
+	//sectors are erased as the chunks are written, so the first chunk is not held up by erasing the partition
+	err = esp_ota_begin(g_partition, OTA_WITH_SEQUENTIAL_WRITES, &g_handle);
+	if(err != ESP_OK)
+	{
+		return err;
+	}
+	g_active = true;
+	ESP_LOGI(TAG, "%s: %lu bytes into partition subtype %d at offset 0x%lx", g_url, (unsigned long)g_ota.size,
+			g_partition->subtype, (unsigned long)g_partition->address);
+	return ESP_OK;
+}
+
+/**
+ * @fn esp_err_t http_ota_receive(esp_http_client_handle_t)
+ * @brief read the body into the pipe until the image is complete, while the flash task writes it
+ *
+ * @return ESP_OK once every chunk is pushed, ESP_FAIL if the connection dropped, the image check or esp_ota_write
+ * 			error
+ */
+static esp_err_t http_ota_receive(esp_http_client_handle_t client)
+{
+	http_ota_chunk_t *chunk;
+	esp_err_t err;
+
+	while(!http_ota_complete(&g_ota))
+	{
+		//the flash task notifies after every chunk it gives back
+		while((chunk = http_ota_pipe_fill(&g_pipe)) == NULL)
+		{
+			ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(HTTP_OTA_POLL_MS));
+		}
+		err = __atomic_load_n(&g_flash_err, __ATOMIC_RELAXED);
+		if(err != ESP_OK)
+		{
+			return err;
+		}
+
+		int read = esp_http_client_read(client, (char*)chunk->data + chunk->len, HTTP_OTA_CHUNK_SIZE - chunk->len);
+		if(read <= 0)
+		{
+			return ESP_FAIL;
+		}
+		chunk->len += http_ota_received(&g_ota, chunk->data + chunk->len, (size_t)read);
+		//whole chunks keep the flash writes sector sized
+		if(chunk->len == HTTP_OTA_CHUNK_SIZE || (chunk->len > 0 && http_ota_complete(&g_ota)))
+		{
+			http_ota_pipe_push(&g_pipe);
+			xTaskNotifyGive(g_flash_task);
+		}
+	}
+	return ESP_OK;
+}
+
+/**
+ * @fn esp_err_t http_ota_download(esp_http_client_handle_t)
+ * @brief receive the whole image, resuming after a dropped connection, and wait for it to be written
+ *
+ */
+static esp_err_t http_ota_download(esp_http_client_handle_t client)
+{
+	uint32_t attempts = 0;
+	uint32_t progress = 0;
+	int64_t dropped_us = 0;
+	esp_err_t err;
+
+	for(;;)
+	{
+		err = http_ota_request(client);
+		if(err == ESP_OK && dropped_us != 0)
+		{
+			ESP_LOGI(TAG, "%s: resumed at byte %lu, %lld ms after the drop%s", g_url, (unsigned long)g_ota.offset,
+					(long long)((esp_timer_get_time() - dropped_us) / 1000), g_ota.skip ? ", the server sent the whole image" : "");
+		}
+		if(err == ESP_OK)
+		{
+			err = http_ota_receive(client);
+		}
+		//the Range and If-Range headers are only for resumes
+		esp_http_client_delete_header(client, "Range");
+		esp_http_client_delete_header(client, "If-Range");
+		if(err != ESP_FAIL)
+		{
+			break;
+		}
+
+		esp_http_client_close(client);
+		if(g_ota.offset != progress)
+		{
+			progress = g_ota.offset;
+			attempts = 0;
+		}
+		if(++attempts > CONFIG_HTTP_OTA_RETRIES)
+		{
+			break;
+		}
+		ESP_LOGW(TAG, "%s: connection lost at byte %lu of %lu, attempt %lu of %u", g_url, (unsigned long)g_ota.offset,
+				(unsigned long)g_ota.size, (unsigned long)attempts, CONFIG_HTTP_OTA_RETRIES);
+		dropped_us = esp_timer_get_time();
+		vTaskDelay(pdMS_TO_TICKS(CONFIG_HTTP_OTA_RETRY_DELAY_MS));
+	}
+	if(err != ESP_OK)
+	{
+		//the chunks still queued are only given back, not written
+		esp_err_t none = ESP_OK;
+		__atomic_compare_exchange_n(&g_flash_err, &none, err, false, __ATOMIC_RELAXED, __ATOMIC_RELAXED);
+	}
+
+	//whatever the result, the handle and the hash are only given up once the flash task is done with them
+	while(!http_ota_pipe_empty(&g_pipe))
+	{
+		ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(HTTP_OTA_POLL_MS));
+	}
+	return __atomic_load_n(&g_flash_err, __ATOMIC_RELAXED);
+}
+
+/**
+ * @fn void http_ota_run(void)
+ * @brief fetch the image at g_url, make it the boot image and restart into it
+ *
+ */
+static void http_ota_run(void)
+{
+	esp_http_client_config_t config = {
+			.url = g_url,
+			.timeout_ms = CONFIG_HTTP_OTA_TIMEOUT_MS,
+			//TCP keep-alive finds a dead server while a read waits, the HTTP connection itself is kept between requests
+			.keep_alive_enable = true,
+			.keep_alive_idle = 5,
+			.keep_alive_interval = 5,
+			.keep_alive_count = 3,
+			.crt_bundle_attach = esp_crt_bundle_attach,
+	};
+	esp_http_client_handle_t client;
+	esp_err_t err;
+
+	__atomic_fetch_add(&g_stats.fetches, 1, __ATOMIC_RELAXED);
+	http_ota_begin(&g_ota);
+	//the last fetch left the pipe empty, only the chunk it was filling when it gave up is left over. The counts are not
+	//reset, the flash task may still be checking them after the last chunk it gave back
+	http_ota_pipe_fill(&g_pipe)->len = 0;
+	ota_verify_begin(&g_verify, g_has_sha256 ? g_sha256 : NULL);
+	g_flash_err = ESP_OK;
+	g_active = false;
+	g_start_us = esp_timer_get_time();
+
+	client = esp_http_client_init(&config);
+	if(client == NULL)
+	{
+		ESP_LOGE(TAG, "%s: esp_http_client_init failed", g_url);
+		ota_verify_abort(&g_verify);
+		return;
+	}
+	err = http_ota_download(client);
+	esp_http_client_cleanup(client);
+
+	int64_t end_us = esp_timer_get_time();
+	int64_t elapsed_us = end_us - g_start_us;
+	if(err == ESP_OK)
+	{
+		//the SHA-256 was computed as the chunks were written, a bad image is given up without reading it back
+		err = ota_verify_finish(&g_verify);
+	}
+	if(err == ESP_OK)
+	{
+		//checks the image header and its hash again, the handle is freed whatever the result
+		g_active = false;
+		err = esp_ota_end(g_handle);
+	}
+	if(err == ESP_OK)
+	{
+		err = esp_ota_set_boot_partition(g_partition);
+	}
+	if(err != ESP_OK)
+	{
+		ESP_LOGE(TAG, "%s: failed at byte %lu of %lu, %s", g_url, (unsigned long)g_ota.offset, (unsigned long)g_ota.size,
+				esp_err_to_name(err));
+		ota_verify_abort(&g_verify);
+		if(g_active)
+		{
+			esp_ota_abort(g_handle);
+			g_active = false;
+		}
+		return;
+	}
+
+	__atomic_fetch_add(&g_stats.completed, 1, __ATOMIC_RELAXED);
+	ESP_LOGI(TAG, "%s: %lu bytes in %lld ms, %lu KB/s, %lu resumes, %lld ms to boot it, restarting in %u ms", g_url,
+			(unsigned long)g_ota.size, (long long)(elapsed_us / 1000),
+			(unsigned long)(elapsed_us > 0 ? (uint64_t)g_ota.size * 1000000 / 1024 / elapsed_us : 0),
+			(unsigned long)g_ota.resumes, (long long)((esp_timer_get_time() - end_us) / 1000), HTTP_OTA_RESTART_DELAY_MS);
+	//the result of the call that started the fetch goes out before the restart
+	vTaskDelay(pdMS_TO_TICKS(HTTP_OTA_RESTART_DELAY_MS));
+#if CONFIG_MQTT_SESSION_STORE
+	//the new image may lay out RTC memory differently, it takes the unacked publishes over from NVS
+	mqtt_session_store_flush();
+#endif
+	esp_restart();
+}
+
+/**
+ * @fn void http_ota_fetch_task(void*)
+ * @brief run each fetch asked for, one at a time
+ *
+ */
+static void http_ota_fetch_task(void *pvParameters)
+{
+	for(;;)
+	{
+		//the flash task notifies too, a fetch only runs when one was asked for
+		if(__atomic_load_n(&g_requested, __ATOMIC_ACQUIRE))
+		{
+			http_ota_run();
+			__atomic_store_n(&g_requested, false, __ATOMIC_RELAXED);
+			__atomic_store_n(&g_busy, false, __ATOMIC_RELEASE);
+		}
+		ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+	}
+}
+
+esp_err_t http_ota_fetch(const char *url, const char *sha256)
+{
+	uint8_t digest[OTA_VERIFY_DIGEST_LEN];
+	bool busy = false;
+
+	if(url == NULL || strlen(url) >= sizeof(g_url) || (strncmp(url, "http://", 7) != 0 && strncmp(url, "https://", 8) != 0))
+	{
+		return ESP_ERR_INVALID_ARG;
+	}
+	//the digest appended to the image only catches corruption, over plain HTTP anyone on the path can rewrite both
+	if(sha256 == NULL && strncmp(url, "http://", 7) == 0)
+	{
+		ESP_LOGE(TAG, "fetch of %s refused, an http:// URL needs the SHA-256 of the image", url);
+		return ESP_ERR_INVALID_ARG;
+	}
+	if(sha256 != NULL && !ota_verify_parse_digest(sha256, strlen(sha256), digest))
+	{
+		return ESP_ERR_INVALID_ARG;
+	}
+	if(!__atomic_compare_exchange_n(&g_busy, &busy, true, false, __ATOMIC_ACQ_REL, __ATOMIC_RELAXED))
+	{
+		return ESP_ERR_INVALID_STATE;
+	}
+	//no fetch is running, the fetch task reads the URL and the SHA-256 once g_requested is set
+	strcpy(g_url, url);
+	g_has_sha256 = sha256 != NULL;
+	if(g_has_sha256)
+	{
+		memcpy(g_sha256, digest, sizeof(g_sha256));
+	}
+	__atomic_store_n(&g_requested, true, __ATOMIC_RELEASE);
+
+	if(g_fetch_task == NULL)
+	{
+		http_ota_pipe_init(&g_pipe);
+		//the receive runs above the flash writes, so the socket is read whenever data is waiting
+		xTaskCreatePinnedToCore(&http_ota_flash_task, "http_ota_flash", HTTP_OTA_FLASH_TASK_STACK_SIZE, NULL,
+				HTTP_OTA_FLASH_TASK_PRIORITY, &g_flash_task, HTTP_OTA_FLASH_TASK_CORE_ID);
+		xTaskCreatePinnedToCore(&http_ota_fetch_task, "http_ota", HTTP_OTA_TASK_STACK_SIZE, NULL,
+				HTTP_OTA_TASK_PRIORITY, &g_fetch_task, HTTP_OTA_TASK_CORE_ID);
+	}
+	else
+	{
+		xTaskNotifyGive(g_fetch_task);
+	}
+	ESP_LOGI(TAG, "fetch of %s started", url);
+	return ESP_OK;
+}
+#endif
@@ -0,0 +1,198 @@
+/*
+ * http_ota.h
+ *
+ *  Created on: Oct 18, 2026
+ *      Author: hamxa
+ */
+
+#ifndef MAIN_HTTP_OTA_H_
+#define MAIN_HTTP_OTA_H_
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "esp_err.h"
+#include "sdkconfig.h"
+
+//Longest image URL
+#define HTTP_OTA_URL_MAX_LEN			128
+
+//Image bytes per flash write, the last chunk of an image is shorter
+#define HTTP_OTA_CHUNK_SIZE				CONFIG_HTTP_OTA_CHUNK_SIZE
+
+//Chunks received ahead of the flash writes
+#define HTTP_OTA_PIPE_DEPTH				CONFIG_HTTP_OTA_PIPE_DEPTH
+
+//Longest ETag or Last-Modified kept to check that a resumed image is the same one
+#define HTTP_OTA_VALIDATOR_MAX_LEN		64
+
+//Range header value, "bytes=<first>-"
+#define HTTP_OTA_RANGE_MAX_LEN			24
+
+//Longest the fetch task waits for the flash task before it checks it again
+#define HTTP_OTA_POLL_MS				100
+
+//Time the fetch result has to be reported before the restart into the new image
+#define HTTP_OTA_RESTART_DELAY_MS		3000
+
+/**
+ * Download state of one fetch. The image is requested whole, a dropped connection is resumed with a Range
+ * request from the first byte not received
+ */
+typedef struct http_ota
+{
+	uint32_t size;				///> image bytes, 0 until the first response
+	uint32_t offset;			///> bytes received
+	uint32_t skip;				///> bytes still to drop from a full response to a resume
+	uint32_t resumes;			///> responses that continued the image, ranged or full
+	char validator[HTTP_OTA_VALIDATOR_MAX_LEN];	///> ETag, or Last-Modified, of the first response
+}http_ota_t;
+
+/**
+ * Image bytes on their way from the receive to the flash write
+ */
+typedef struct http_ota_chunk
+{
+	uint32_t len;
+	uint8_t data[HTTP_OTA_CHUNK_SIZE];
+}http_ota_chunk_t;
+
+/**
+ * Chunks handed from the receiving task to the flash task in order, without a lock. Only one task fills and only
+ * one task writes
+ */
+typedef struct http_ota_pipe
+{
+	http_ota_chunk_t chunks[HTTP_OTA_PIPE_DEPTH];
+	uint32_t pushed;			///> chunks filled, written by the receiving task
+	uint32_t popped;			///> chunks written to flash, written by the flash task
+}http_ota_pipe_t;
+
+/**
+ * HTTP OTA counters since boot
+ */
+typedef struct http_ota_stats
+{
+	uint32_t fetches;			///> fetches started
+	uint32_t completed;			///> images that became the boot image
+	uint32_t resumes;			///> requests that continued an image after a dropped connection
+	uint32_t restarted;			///> resumes the server answered with the whole image
+	uint64_t bytes;				///> image bytes received, the dropped ones of a restarted image included
+}http_ota_stats_t;
+
+/**
+ * @fn void http_ota_begin(http_ota_t*)
+ * @brief start a fetch from the first byte
+ *
+ */
+void http_ota_begin(http_ota_t *ota);
+
+/**
+ * @fn int http_ota_range(const http_ota_t*, char*, size_t)
+ * @brief build the Range header of the next request, "bytes=<offset>-". Sent with If-Range set to the validator,
+ * 			so a server whose image changed answers with the whole new image
+ *
+ * @return header length, 0 if the image is requested from the start, -1 if the buffer is too small
+ */
+int http_ota_range(const http_ota_t *ota, char *range, size_t size);
+
+/**
+ * @fn esp_err_t http_ota_response(http_ota_t*, int, int64_t, const char*, const char*)
+ * @brief check the response to a request against the image received so far. A server that ignores Range answers
+ * 			a resume with the whole image, its first bytes are then skipped if its validator shows it is the
+ * 			same image
+ *
+ * @param status HTTP status code
+ * @param content_length Content-Length, -1 if absent
+ * @param content_range Content-Range, NULL if absent
+ * @param validator ETag, or Last-Modified if there is no ETag, NULL if neither
+ * @return ESP_OK, ESP_ERR_INVALID_STATE if the image changed since the first response, ESP_ERR_INVALID_SIZE if
+ * 			its length is unknown or too large, ESP_ERR_INVALID_RESPONSE for any other status or range
+ */
+esp_err_t http_ota_response(http_ota_t *ota, int status, int64_t content_length, const char *content_range,
+							const char *validator);
+
+/**
+ * @fn size_t http_ota_received(http_ota_t*, uint8_t*, size_t)
+ * @brief account for bytes read from the body, dropping the ones a full response repeats
+ *
+ * @param data the bytes read, the kept ones are moved to its start
+ * @return bytes kept
+ */
+size_t http_ota_received(http_ota_t *ota, uint8_t *data, size_t len);
+
+/**
+ * @fn bool http_ota_complete(const http_ota_t*)
+ * @brief check whether the whole image was received
+ *
+ */
+bool http_ota_complete(const http_ota_t *ota);
+
+/**
+ * @fn void http_ota_pipe_init(http_ota_pipe_t*)
+ * @brief empty the pipe, before either task uses it
+ *
+ */
+void http_ota_pipe_init(http_ota_pipe_t *pipe);
+
+/**
+ * @fn http_ota_chunk_t http_ota_pipe_fill*(http_ota_pipe_t*)
+ * @brief receiving task: the chunk being filled. It keeps its bytes until pushed, a resume fills it on
+ *
+ * @return the chunk, NULL if every chunk waits for the flash task
+ */
+http_ota_chunk_t *http_ota_pipe_fill(http_ota_pipe_t *pipe);
+
+/**
+ * @fn void http_ota_pipe_push(http_ota_pipe_t*)
+ * @brief receiving task: hand the filled chunk to the flash task
+ *
+ */
+void http_ota_pipe_push(http_ota_pipe_t *pipe);
+
+/**
+ * @fn http_ota_chunk_t http_ota_pipe_peek*(http_ota_pipe_t*)
+ * @brief flash task: the oldest filled chunk
+ *
+ * @return the chunk, NULL if none is filled
+ */
+http_ota_chunk_t *http_ota_pipe_peek(http_ota_pipe_t *pipe);
+
+/**
+ * @fn void http_ota_pipe_pop(http_ota_pipe_t*)
+ * @brief flash task: give the written chunk back to the receiving task
+ *
+ */
+void http_ota_pipe_pop(http_ota_pipe_t *pipe);
+
+/**
+ * @fn bool http_ota_pipe_empty(const http_ota_pipe_t*)
+ * @brief receiving task: check whether every pushed chunk was written
+ *
+ */
+bool http_ota_pipe_empty(const http_ota_pipe_t *pipe);
+
+/**
+ * @fn void http_ota_get_stats(http_ota_stats_t*)
+ * @brief get the HTTP OTA counters
+ *
+ */
+void http_ota_get_stats(http_ota_stats_t *stats);
+
+#if !CONFIG_IDF_TARGET_LINUX
+/**
+ * @fn esp_err_t http_ota_fetch(const char*, const char*)
+ * @brief download the image at an http:// or https:// URL into the next OTA partition in the background and
+ * 			boot it once its SHA-256 and esp_ota_end accept it. The connection is kept alive and a dropped one
+ * 			resumed from the first byte not received, while the received bytes are hashed and written to flash
+ *
+ * @param sha256 SHA-256 of the file as sha256sum prints it. Required for an http:// URL, NULL for an https:// one
+ * 			only checks the digest appended to the image
+ * @return ESP_OK if the fetch started, ESP_ERR_INVALID_ARG for a bad URL or SHA-256 or an http:// URL without it,
+ * 			ESP_ERR_INVALID_STATE if a fetch is running
+ */
+esp_err_t http_ota_fetch(const char *url, const char *sha256);
+#endif
+
+#endif /* MAIN_HTTP_OTA_H_ */
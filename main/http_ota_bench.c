@@ -0,0 +1,839 @@
+/*
+ * http_ota_bench.c
+ *
+ *  Created on: Oct 18, 2026
+ *      Author: hamxa
+ */
+#include <errno.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <poll.h>
+#include <pthread.h>
+#include <semaphore.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <sys/socket.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "esp_log.h"
+#include "esp_rom_crc.h"
+#include "sdkconfig.h"
+
+#include "http_ota.h"
+#include "http_ota_bench.h"
+#include "mqtt_posix_transport.h"
+
+//a short last chunk, as real images have
+#define HTTP_OTA_BENCH_IMAGE_SIZE		(CONFIG_HTTP_OTA_BENCH_IMAGE_KB * 1024 - 100)
+
+//bytes the in-process server writes at a time
+#define HTTP_OTA_BENCH_SEND_SLICE		4096
+
+//receive window of the link model, the default lwIP window of the device. The sender stops once it is full, so
+//the time the receive loop spends on flash writes is lost to the link
+#define HTTP_OTA_BENCH_TCP_WINDOW		5744
+
+//how often the server waits look at the stop flag
+#define HTTP_OTA_BENCH_POLL_MS			100
+
+static const char TAG[] = "http_ota_bench";
+
+/**
+ * Device side connection, kept between requests unless the server closes it
+ */
+typedef struct http_ota_bench_client
+{
+	NetworkContext_t network;
+	bool connected;
+	bool close_after;			///> the server closes the connection after this response
+	char host[64];
+	uint16_t port;
+	char path[HTTP_OTA_URL_MAX_LEN];
+	char header[HTTP_OTA_BENCH_HEADER_MAX_LEN];
+	size_t body_pos;			///> body bytes read with the header, not taken yet
+	size_t body_len;
+	uint32_t connections;
+	uint32_t requests;
+}http_ota_bench_client_t;
+
+//the image served by the in-process server, and the flash the device side writes it to
+static uint8_t g_image[HTTP_OTA_BENCH_IMAGE_SIZE];
+static uint8_t g_flash[HTTP_OTA_BENCH_IMAGE_SIZE];
+static uint32_t g_flash_len;
+static bool g_flash_overflow;
+
+//in-process server, a plain thread as the MQTT broker stand-in
+static pthread_t g_server_thread;
+static int g_listen_socket = -1;
+static bool g_server_stop;
+
+//device side
+static http_ota_bench_client_t g_client;
+static http_ota_t g_ota;
+static http_ota_pipe_t g_pipe;
+static pthread_t g_flash_thread;
+static sem_t g_flash_wake;
+static sem_t g_pipe_space;
+static bool g_flash_stop;
+static bool g_resuming;
+static int64_t g_dropped_ns;
+static int64_t g_resume_ns_total;
+static int64_t g_resume_ns_max;
+//arrival time of the last byte taken from the link model
+static int64_t g_link_ns;
+
+/**
+ * @fn int64_t http_ota_bench_clock_ns(void)
+ * @brief read the monotonic clock in ns
+ *
+ */
+static int64_t http_ota_bench_clock_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (int64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+/**
+ * @fn void http_ota_bench_sleep_until(int64_t)
+ * @brief wait for a time of the monotonic clock
+ *
+ */
+static void http_ota_bench_sleep_until(int64_t deadline_ns)
+{
+	struct timespec ts = {.tv_sec = deadline_ns / 1000000000, .tv_nsec = deadline_ns % 1000000000};
+
+	while(clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL) == EINTR)
+	{
+	}
+}
+
+/**
+ * @fn bool http_ota_bench_header(const char*, const char*, char*, size_t)
+ * @brief copy the value of a header field out of a request or response header, the name in any case
+ *
+ */
+static bool http_ota_bench_header(const char *header, const char *name, char *value, size_t size)
+{
+	size_t name_len = strlen(name);
+
+	for(const char *line = strstr(header, "\r\n"); line != NULL && line[2] != '\r'; line = strstr(line + 2, "\r\n"))
+	{
+		const char *field = line + 2;
+		if(strncasecmp(field, name, name_len) != 0 || field[name_len] != ':')
+		{
+			continue;
+		}
+		field += name_len + 1;
+		while(*field == ' ')
+		{
+			field++;
+		}
+		size_t len = strcspn(field, "\r");
+		if(len >= size)
+		{
+			return false;
+		}
+		memcpy(value, field, len);
+		value[len] = '\0';
+		return true;
+	}
+	return false;
+}
+
+/**
+ * @fn bool http_ota_bench_server_send(int, const void*, size_t)
+ * @brief write the whole buffer to a client
+ *
+ */
+static bool http_ota_bench_server_send(int sock, const void *data, size_t len)
+{
+	const uint8_t *pos = data;
+
+	while(len > 0)
+	{
+		ssize_t sent = send(sock, pos, len, MSG_NOSIGNAL);
+		if(sent < 0 && errno == EINTR)
+		{
+			continue;
+		}
+		if(sent <= 0)
+		{
+			return false;
+		}
+		pos += sent;
+		len -= (size_t)sent;
+	}
+	return true;
+}
+
+/**
+ * @fn bool http_ota_bench_server_respond(int, const char*)
+ * @brief answer one GET of the image, from the Range if its If-Range still matches
+ *
+ * @return false if the client is gone
+ */
+static bool http_ota_bench_server_respond(int sock, const char *request)
+{
+	char response[256];
+	char value[64];
+	unsigned long first = 0;
+	int len;
+
+	if(strncmp(request, "GET " HTTP_OTA_BENCH_PATH " ", strlen("GET " HTTP_OTA_BENCH_PATH " ")) != 0)
+	{
+		len = snprintf(response, sizeof(response), "HTTP/1.1 404 Not Found\r\nContent-Length: 0\r\n\r\n");
+		return http_ota_bench_server_send(sock, response, (size_t)len);
+	}
+	if(http_ota_bench_header(request, "Range", value, sizeof(value)) && sscanf(value, "bytes=%lu-", &first) == 1 &&
+	   first < HTTP_OTA_BENCH_IMAGE_SIZE &&
+	   (!http_ota_bench_header(request, "If-Range", value, sizeof(value)) || strcmp(value, HTTP_OTA_BENCH_ETAG) == 0))
+	{
+		len = snprintf(response, sizeof(response), "HTTP/1.1 206 Partial Content\r\nETag: %s\r\n"
+				"Content-Range: bytes %lu-%u/%u\r\nContent-Length: %lu\r\n\r\n", HTTP_OTA_BENCH_ETAG, first,
+				HTTP_OTA_BENCH_IMAGE_SIZE - 1, HTTP_OTA_BENCH_IMAGE_SIZE, HTTP_OTA_BENCH_IMAGE_SIZE - first);
+	}
+	else
+	{
+		first = 0;
+		len = snprintf(response, sizeof(response), "HTTP/1.1 200 OK\r\nETag: %s\r\nAccept-Ranges: bytes\r\n"
+				"Content-Length: %u\r\n\r\n", HTTP_OTA_BENCH_ETAG, HTTP_OTA_BENCH_IMAGE_SIZE);
+	}
+	if(!http_ota_bench_server_send(sock, response, (size_t)len))
+	{
+		return false;
+	}
+
+	//in slices, so a stop is seen while the client holds the connection open without reading
+	for(size_t sent = 0; first + sent < HTTP_OTA_BENCH_IMAGE_SIZE;)
+	{
+		size_t slice = HTTP_OTA_BENCH_IMAGE_SIZE - first - sent;
+		if(slice > HTTP_OTA_BENCH_SEND_SLICE)
+		{
+			slice = HTTP_OTA_BENCH_SEND_SLICE;
+		}
+		if(__atomic_load_n(&g_server_stop, __ATOMIC_RELAXED) || !http_ota_bench_server_send(sock, &g_image[first + sent], slice))
+		{
+			return false;
+		}
+		sent += slice;
+	}
+	return true;
+}
+
+/**
+ * @fn void http_ota_bench_server_serve(int)
+ * @brief answer the requests of one kept-alive connection until the client closes it
+ *
+ */
+static void http_ota_bench_server_serve(int sock)
+{
+	char request[HTTP_OTA_BENCH_HEADER_MAX_LEN];
+	struct pollfd fd = {.fd = sock, .events = POLLIN};
+	size_t len = 0;
+
+	while(!__atomic_load_n(&g_server_stop, __ATOMIC_RELAXED))
+	{
+		if(poll(&fd, 1, HTTP_OTA_BENCH_POLL_MS) <= 0)
+		{
+			continue;
+		}
+		ssize_t received = recv(sock, request + len, sizeof(request) - 1 - len, 0);
+		if(received <= 0)
+		{
+			return;
+		}
+		len += (size_t)received;
+		request[len] = '\0';
+
+		//the device sends one request at a time, nothing follows the header
+		if(strstr(request, "\r\n\r\n") == NULL)
+		{
+			if(len == sizeof(request) - 1)
+			{
+				return;
+			}
+			continue;
+		}
+		if(!http_ota_bench_server_respond(sock, request))
+		{
+			return;
+		}
+		len = 0;
+	}
+}
+
+/**
+ * @fn void http_ota_bench_server_thread*(void*)
+ * @brief accept and serve clients one after the other until stopped
+ *
+ */
+static void *http_ota_bench_server_thread(void *arg)
+{
+	struct pollfd fd = {.fd = g_listen_socket, .events = POLLIN};
+
+	while(!__atomic_load_n(&g_server_stop, __ATOMIC_RELAXED))
+	{
+		if(poll(&fd, 1, HTTP_OTA_BENCH_POLL_MS) <= 0)
+		{
+			continue;
+		}
+		int sock = accept(g_listen_socket, NULL, NULL);
+		if(sock < 0)
+		{
+			continue;
+		}
+		http_ota_bench_server_serve(sock);
+		close(sock);
+	}
+	return NULL;
+}
+
+/**
+ * @fn bool http_ota_bench_server_start(uint16_t*)
+ * @brief start the in-process HTTP server on the loopback interface
+ *
+ * @param port output, the port it listens on
+ */
+static bool http_ota_bench_server_start(uint16_t *port)
+{
+	struct sockaddr_in addr = {.sin_family = AF_INET, .sin_addr.s_addr = htonl(INADDR_LOOPBACK), .sin_port = 0};
+	socklen_t addr_len = sizeof(addr);
+
+	g_listen_socket = socket(AF_INET, SOCK_STREAM, 0);
+	if(g_listen_socket < 0 || bind(g_listen_socket, (struct sockaddr*)&addr, sizeof(addr)) != 0 ||
+	   listen(g_listen_socket, 1) != 0 || getsockname(g_listen_socket, (struct sockaddr*)&addr, &addr_len) != 0)
+	{
+		ESP_LOGE(TAG, "http_ota_bench_server_start: cannot listen, errno %d", errno);
+		if(g_listen_socket >= 0)
+		{
+			close(g_listen_socket);
+			g_listen_socket = -1;
+		}
+		return false;
+	}
+	g_server_stop = false;
+	if(pthread_create(&g_server_thread, NULL, http_ota_bench_server_thread, NULL) != 0)
+	{
+		ESP_LOGE(TAG, "http_ota_bench_server_start: thread not started");
+		close(g_listen_socket);
+		g_listen_socket = -1;
+		return false;
+	}
+	*port = ntohs(addr.sin_port);
+	return true;
+}
+
+/**
+ * @fn void http_ota_bench_server_stop(void)
+ * @brief stop the in-process server and wait for its thread
+ *
+ */
+static void http_ota_bench_server_stop(void)
+{
+	__atomic_store_n(&g_server_stop, true, __ATOMIC_RELAXED);
+	pthread_join(g_server_thread, NULL);
+	close(g_listen_socket);
+	g_listen_socket = -1;
+}
+
+/**
+ * @fn bool http_ota_bench_parse_url(const char*)
+ * @brief take the host, port and path of an http:// URL, the device side has no TLS
+ *
+ */
+static bool http_ota_bench_parse_url(const char *url)
+{
+	unsigned port = 80;
+	const char *host = url + strlen("http://");
+	const char *path;
+	size_t host_len;
+
+	if(strncmp(url, "http://", strlen("http://")) != 0 || (path = strchr(host, '/')) == NULL ||
+	   strlen(path) >= sizeof(g_client.path))
+	{
+		return false;
+	}
+	host_len = strcspn(host, ":/");
+	if(host_len == 0 || host_len >= sizeof(g_client.host) ||
+	   (host[host_len] == ':' && (sscanf(host + host_len, ":%u", &port) != 1 || port == 0 || port > UINT16_MAX)))
+	{
+		return false;
+	}
+	memcpy(g_client.host, host, host_len);
+	g_client.host[host_len] = '\0';
+	g_client.port = (uint16_t)port;
+	strcpy(g_client.path, path);
+	return true;
+}
+
+/**
+ * @fn void http_ota_bench_close(void)
+ * @brief close the device side connection
+ *
+ */
+static void http_ota_bench_close(void)
+{
+	if(g_client.connected)
+	{
+		mqtt_posix_transport_disconnect(&g_client.network);
+		g_client.connected = false;
+	}
+	g_client.body_pos = 0;
+	g_client.body_len = 0;
+}
+
+/**
+ * @fn int64_t http_ota_bench_link_ns(size_t)
+ * @brief time the link takes to carry bytes at CONFIG_HTTP_OTA_BENCH_LINK_KBPS
+ *
+ */
+static int64_t http_ota_bench_link_ns(size_t len)
+{
+	return (int64_t)len * 1000000000 / (CONFIG_HTTP_OTA_BENCH_LINK_KBPS * 1024);
+}
+
+/**
+ * @fn void http_ota_bench_link_take(size_t)
+ * @brief wait until bytes read from the socket would have come over the link. They arrive at the link rate into
+ * 			a window of HTTP_OTA_BENCH_TCP_WINDOW bytes, and no faster than the window empties
+ *
+ */
+static void http_ota_bench_link_take(size_t len)
+{
+	int64_t now_ns = http_ota_bench_clock_ns();
+
+	if(g_link_ns < now_ns - http_ota_bench_link_ns(HTTP_OTA_BENCH_TCP_WINDOW))
+	{
+		g_link_ns = now_ns - http_ota_bench_link_ns(HTTP_OTA_BENCH_TCP_WINDOW);
+	}
+	g_link_ns += http_ota_bench_link_ns(len);
+	if(g_link_ns > now_ns)
+	{
+		http_ota_bench_sleep_until(g_link_ns);
+	}
+}
+
+/**
+ * @fn int http_ota_bench_read(void*, size_t, int64_t)
+ * @brief device side: read body bytes, the ones that came with the header first
+ *
+ * @return bytes read, -1 if the connection closed or nothing came before the deadline
+ */
+static int http_ota_bench_read(void *buf, size_t len, int64_t deadline_ns)
+{
+	if(g_client.body_pos < g_client.body_len)
+	{
+		size_t taken = g_client.body_len - g_client.body_pos < len ? g_client.body_len - g_client.body_pos : len;
+		memcpy(buf, g_client.header + g_client.body_pos, taken);
+		g_client.body_pos += taken;
+		return (int)taken;
+	}
+	if(len > HTTP_OTA_BENCH_TCP_WINDOW)
+	{
+		len = HTTP_OTA_BENCH_TCP_WINDOW;
+	}
+	while(http_ota_bench_clock_ns() < deadline_ns)
+	{
+		int32_t received = mqtt_posix_transport_recv(&g_client.network, buf, len);
+		if(received > 0)
+		{
+			http_ota_bench_link_take((size_t)received);
+		}
+		if(received != 0)
+		{
+			return received < 0 ? -1 : (int)received;
+		}
+	}
+	return -1;
+}
+
+/**
+ * @fn esp_err_t http_ota_bench_request(void)
+ * @brief device side: request the image from the first byte not received, over the kept connection if there is
+ * 			one, and check the response as http_ota_request does
+ *
+ * @return ESP_OK, ESP_FAIL if the connection failed, another error if the fetch cannot go on
+ */
+static esp_err_t http_ota_bench_request(void)
+{
+	char request[HTTP_OTA_BENCH_HEADER_MAX_LEN];
+	char range[HTTP_OTA_RANGE_MAX_LEN];
+	char content_range[64];
+	char content_length[24];
+	char validator[HTTP_OTA_VALIDATOR_MAX_LEN];
+	char connection[16];
+	int64_t deadline_ns = http_ota_bench_clock_ns() + (int64_t)CONFIG_HTTP_OTA_TIMEOUT_MS * 1000000;
+	size_t header_len = 0;
+	char *body;
+	int status;
+	int len;
+
+	if(!g_client.connected)
+	{
+		if(!mqtt_posix_transport_connect(&g_client.network, g_client.host, g_client.port))
+		{
+			return ESP_FAIL;
+		}
+		g_client.connected = true;
+		g_client.connections++;
+	}
+
+	len = snprintf(request, sizeof(request), "GET %s HTTP/1.1\r\nHost: %s:%u\r\nConnection: keep-alive\r\n",
+			g_client.path, g_client.host, g_client.port);
+	if(http_ota_range(&g_ota, range, sizeof(range)) > 0)
+	{
+		len += snprintf(request + len, sizeof(request) - len, "Range: %s\r\n", range);
+		if(g_ota.validator[0] != '\0')
+		{
+			len += snprintf(request + len, sizeof(request) - len, "If-Range: %s\r\n", g_ota.validator);
+		}
+	}
+	len += snprintf(request + len, sizeof(request) - len, "\r\n");
+	if(mqtt_posix_transport_send(&g_client.network, request, (size_t)len) != len)
+	{
+		return ESP_FAIL;
+	}
+	g_client.requests++;
+	//nothing was in flight before the request
+	g_link_ns = http_ota_bench_clock_ns();
+
+	//the body bytes read with the header are kept for http_ota_bench_read
+	g_client.body_pos = 0;
+	g_client.body_len = 0;
+	g_client.header[0] = '\0';
+	while((body = strstr(g_client.header, "\r\n\r\n")) == NULL)
+	{
+		if(header_len == sizeof(g_client.header) - 1)
+		{
+			return ESP_ERR_INVALID_RESPONSE;
+		}
+		int received = http_ota_bench_read(g_client.header + header_len, sizeof(g_client.header) - 1 - header_len,
+				deadline_ns);
+		if(received < 0)
+		{
+			return ESP_FAIL;
+		}
+		header_len += (size_t)received;
+		g_client.header[header_len] = '\0';
+	}
+	g_client.body_pos = (size_t)(body + 4 - g_client.header);
+	g_client.body_len = header_len;
+	body[2] = '\0';
+
+	if(sscanf(g_client.header, "HTTP/1.%*c %d", &status) != 1)
+	{
+		return ESP_ERR_INVALID_RESPONSE;
+	}
+	//an HTTP/1.0 server such as python3 -m http.server closes after every response
+	g_client.close_after = strncmp(g_client.header, "HTTP/1.0", 8) == 0 ||
+			(http_ota_bench_header(g_client.header, "Connection", connection, sizeof(connection)) &&
+			 strcasecmp(connection, "close") == 0);
+	if(!http_ota_bench_header(g_client.header, "ETag", validator, sizeof(validator)) &&
+	   !http_ota_bench_header(g_client.header, "Last-Modified", validator, sizeof(validator)))
+	{
+		validator[0] = '\0';
+	}
+	return http_ota_response(&g_ota, status,
+			http_ota_bench_header(g_client.header, "Content-Length", content_length, sizeof(content_length)) ?
+					strtoll(content_length, NULL, 10) : -1,
+			http_ota_bench_header(g_client.header, "Content-Range", content_range, sizeof(content_range)) ?
+					content_range : NULL,
+			validator[0] != '\0' ? validator : NULL);
+}
+
+/**
+ * @fn void http_ota_bench_flash_write(const http_ota_chunk_t*)
+ * @brief write a chunk to the emulated flash, at the flash write rate
+ *
+ */
+static void http_ota_bench_flash_write(const http_ota_chunk_t *chunk)
+{
+	int64_t start_ns = http_ota_bench_clock_ns();
+
+	if(g_flash_len + chunk->len > sizeof(g_flash))
+	{
+		g_flash_overflow = true;
+		return;
+	}
+	memcpy(&g_flash[g_flash_len], chunk->data, chunk->len);
+	g_flash_len += chunk->len;
+	http_ota_bench_sleep_until(start_ns + (int64_t)chunk->len * 1000000000 / (CONFIG_HTTP_OTA_BENCH_FLASH_KBPS * 1024));
+}
+
+/**
+ * @fn void http_ota_bench_flash_drain(void)
+ * @brief write every pushed chunk, as http_ota_flash_task does
+ *
+ */
+static void http_ota_bench_flash_drain(void)
+{
+	http_ota_chunk_t *chunk;
+
+	while((chunk = http_ota_pipe_peek(&g_pipe)) != NULL)
+	{
+		http_ota_bench_flash_write(chunk);
+		http_ota_pipe_pop(&g_pipe);
+		sem_post(&g_pipe_space);
+	}
+}
+
+/**
+ * @fn void http_ota_bench_flash_thread*(void*)
+ * @brief the flash task of the device, woken by every pushed chunk
+ *
+ */
+static void *http_ota_bench_flash_thread(void *arg)
+{
+	for(;;)
+	{
+		sem_wait(&g_flash_wake);
+		//stopped once every chunk was written, so this drain is the final one
+		bool stop = __atomic_load_n(&g_flash_stop, __ATOMIC_ACQUIRE);
+		http_ota_bench_flash_drain();
+		if(stop)
+		{
+			return NULL;
+		}
+	}
+}
+
+/**
+ * @fn esp_err_t http_ota_bench_receive(bool, uint32_t, uint32_t*)
+ * @brief device side: read the body into the pipe as http_ota_receive does, dropping the connection at the
+ * 			next drop point
+ *
+ * @param pipelined false to write each chunk in the receive loop, as the upload handler of the web page does
+ * @param drops connections dropped over the image
+ * @param dropped input and output, connections dropped so far
+ * @return ESP_OK once every chunk is pushed, ESP_FAIL if the connection dropped
+ */
+static esp_err_t http_ota_bench_receive(bool pipelined, uint32_t drops, uint32_t *dropped)
+{
+	int64_t deadline_ns;
+	http_ota_chunk_t *chunk;
+
+	while(!http_ota_complete(&g_ota))
+	{
+		while((chunk = http_ota_pipe_fill(&g_pipe)) == NULL)
+		{
+			sem_wait(&g_pipe_space);
+		}
+		if(*dropped < drops && g_ota.offset >= g_ota.size / (drops + 1) * (*dropped + 1))
+		{
+			//as a Wi-Fi roam or an AP restart would, with the bytes in flight lost
+			http_ota_bench_close();
+			(*dropped)++;
+			g_dropped_ns = http_ota_bench_clock_ns();
+			g_resuming = true;
+			return ESP_FAIL;
+		}
+
+		deadline_ns = http_ota_bench_clock_ns() + (int64_t)CONFIG_HTTP_OTA_TIMEOUT_MS * 1000000;
+		int read = http_ota_bench_read(chunk->data + chunk->len, HTTP_OTA_CHUNK_SIZE - chunk->len, deadline_ns);
+		if(read <= 0)
+		{
+			http_ota_bench_close();
+			return ESP_FAIL;
+		}
+		size_t kept = http_ota_received(&g_ota, chunk->data + chunk->len, (size_t)read);
+		chunk->len += kept;
+		if(kept > 0 && g_resuming)
+		{
+			int64_t resume_ns = http_ota_bench_clock_ns() - g_dropped_ns;
+			g_resume_ns_total += resume_ns;
+			if(resume_ns > g_resume_ns_max)
+			{
+				g_resume_ns_max = resume_ns;
+			}
+			g_resuming = false;
+		}
+		if(chunk->len == HTTP_OTA_CHUNK_SIZE || (chunk->len > 0 && http_ota_complete(&g_ota)))
+		{
+			http_ota_pipe_push(&g_pipe);
+			if(pipelined)
+			{
+				sem_post(&g_flash_wake);
+			}
+			else
+			{
+				http_ota_bench_flash_drain();
+			}
+		}
+	}
+	if(g_client.close_after)
+	{
+		http_ota_bench_close();
+	}
+	return ESP_OK;
+}
+
+/**
+ * @fn bool http_ota_bench_measure(const char*, bool, uint32_t, uint32_t*)
+ * @brief fetch the image once and check what was written
+ *
+ * @param crc input the CRC-32 the image must have, 0 to take the first one, output the CRC-32 written
+ * @return true if the image was written whole and, with the in-process server, intact
+ */
+static bool http_ota_bench_measure(const char *label, bool pipelined, uint32_t drops, uint32_t *crc)
+{
+	uint32_t connections = g_client.connections;
+	uint32_t requests = g_client.requests;
+	uint32_t dropped = 0;
+	uint32_t attempts = 0;
+	uint32_t progress = 0;
+	uint32_t written_crc;
+	http_ota_stats_t before;
+	http_ota_stats_t after;
+	int64_t start_ns;
+	int64_t elapsed_ns;
+	esp_err_t err;
+	bool ok = true;
+
+	http_ota_begin(&g_ota);
+	http_ota_pipe_init(&g_pipe);
+	memset(g_flash, 0, sizeof(g_flash));
+	g_flash_len = 0;
+	g_flash_overflow = false;
+	g_resuming = false;
+	g_resume_ns_total = 0;
+	g_resume_ns_max = 0;
+	sem_init(&g_flash_wake, 0, 0);
+	sem_init(&g_pipe_space, 0, 0);
+	g_flash_stop = false;
+	if(pipelined && pthread_create(&g_flash_thread, NULL, http_ota_bench_flash_thread, NULL) != 0)
+	{
+		ESP_LOGE(TAG, "http_ota_bench_measure: flash thread not started");
+		return false;
+	}
+	http_ota_get_stats(&before);
+
+	start_ns = http_ota_bench_clock_ns();
+	for(;;)
+	{
+		err = http_ota_bench_request();
+		if(err == ESP_OK)
+		{
+			err = http_ota_bench_receive(pipelined, drops, &dropped);
+		}
+		if(err != ESP_FAIL)
+		{
+			break;
+		}
+		http_ota_bench_close();
+		if(g_ota.offset != progress)
+		{
+			progress = g_ota.offset;
+			attempts = 0;
+		}
+		if(++attempts > HTTP_OTA_BENCH_RETRIES || http_ota_bench_clock_ns() - start_ns > (int64_t)HTTP_OTA_BENCH_TIMEOUT_MS * 1000000)
+		{
+			break;
+		}
+	}
+	if(err != ESP_OK)
+	{
+		ESP_LOGE(TAG, "http_ota_bench_measure: %s: failed at byte %lu of %lu, %s", label, (unsigned long)g_ota.offset,
+				(unsigned long)g_ota.size, esp_err_to_name(err));
+		http_ota_bench_close();
+		ok = false;
+	}
+
+	if(pipelined)
+	{
+		while(!http_ota_pipe_empty(&g_pipe))
+		{
+			sem_wait(&g_pipe_space);
+		}
+		__atomic_store_n(&g_flash_stop, true, __ATOMIC_RELEASE);
+		sem_post(&g_flash_wake);
+		pthread_join(g_flash_thread, NULL);
+	}
+	elapsed_ns = http_ota_bench_clock_ns() - start_ns;
+	sem_destroy(&g_flash_wake);
+	sem_destroy(&g_pipe_space);
+	http_ota_get_stats(&after);
+	written_crc = esp_rom_crc32_le(0, g_flash, g_flash_len);
+
+	if(ok && (g_flash_overflow || g_flash_len != g_ota.size || (*crc != 0 && written_crc != *crc)))
+	{
+		ESP_LOGE(TAG, "http_ota_bench_measure: %s: written image does not match", label);
+		ok = false;
+	}
+	if(*crc == 0)
+	{
+		*crc = written_crc;
+	}
+	ESP_LOGI(TAG, "%s: %lu bytes in %lld ms, %llu KB/s, %lu requests over %lu connections, %lu resumes, %lu of them "
+			"answered with the whole image, %llu bytes received", label, (unsigned long)g_flash_len,
+			(long long)(elapsed_ns / 1000000),
+			(unsigned long long)(elapsed_ns > 0 ? (uint64_t)g_flash_len * 1000000000 / 1024 / elapsed_ns : 0),
+			(unsigned long)(g_client.requests - requests), (unsigned long)(g_client.connections - connections),
+			(unsigned long)(after.resumes - before.resumes), (unsigned long)(after.restarted - before.restarted),
+			(unsigned long long)(after.bytes - before.bytes));
+	if(drops)
+	{
+		ESP_LOGI(TAG, "%s: %lu connections dropped, drop to the next image byte avg %lld us, max %lld us", label,
+				(unsigned long)dropped, (long long)(dropped ? g_resume_ns_total / dropped / 1000 : 0),
+				(long long)(g_resume_ns_max / 1000));
+	}
+	return ok;
+}
+
+bool http_ota_bench_run(void)
+{
+	const char *url = CONFIG_HTTP_OTA_BENCH_URL;
+	char local_url[HTTP_OTA_URL_MAX_LEN];
+	uint32_t crc = 0;
+	uint32_t seed = 1;
+	uint16_t port = 0;
+	bool ok;
+
+	if(url[0] == '\0')
+	{
+		//an incompressible image, so no layer can take a shortcut on it
+		for(size_t i = 0; i < sizeof(g_image); i++)
+		{
+			seed = seed * 1664525 + 1013904223;
+			g_image[i] = (uint8_t)(seed >> 24);
+		}
+		crc = esp_rom_crc32_le(0, g_image, sizeof(g_image));
+		if(!http_ota_bench_server_start(&port))
+		{
+			return false;
+		}
+		snprintf(local_url, sizeof(local_url), "http://127.0.0.1:%u" HTTP_OTA_BENCH_PATH, port);
+		url = local_url;
+	}
+	if(!http_ota_bench_parse_url(url))
+	{
+		ESP_LOGE(TAG, "http_ota_bench_run: %s is not an http:// URL", url);
+		if(port != 0)
+		{
+			http_ota_bench_server_stop();
+		}
+		return false;
+	}
+	ESP_LOGI(TAG, "http_ota_bench_run: %s, link at %u KB/s with a %u byte window, flash at %u KB/s, %u byte chunks, "
+			"%u in the pipe", url, CONFIG_HTTP_OTA_BENCH_LINK_KBPS, HTTP_OTA_BENCH_TCP_WINDOW,
+			CONFIG_HTTP_OTA_BENCH_FLASH_KBPS, HTTP_OTA_CHUNK_SIZE, HTTP_OTA_PIPE_DEPTH);
+
+	//every run is logged whatever the ones before found
+	memset(&g_client.network, 0, sizeof(g_client.network));
+	g_client.connected = false;
+	ok = http_ota_bench_measure("flash in the receive loop", false, 0, &crc);
+	ok = http_ota_bench_measure("pipelined", true, 0, &crc) && ok;
+	ok = http_ota_bench_measure("pipelined, dropped connections", true, CONFIG_HTTP_OTA_BENCH_DISCONNECTS, &crc) && ok;
+	http_ota_bench_close();
+	ESP_LOGI(TAG, "http_ota_bench_run: image CRC-32 0x%08lx", (unsigned long)crc);
+
+	if(port != 0)
+	{
+		http_ota_bench_server_stop();
+	}
+	return ok;
+}
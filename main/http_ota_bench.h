@@ -0,0 +1,41 @@
+/*
+ * http_ota_bench.h
+ *
+ *  Created on: Oct 18, 2026
+ *      Author: hamxa
+ */
+
+#ifndef MAIN_HTTP_OTA_BENCH_H_
+#define MAIN_HTTP_OTA_BENCH_H_
+
+#include <stdbool.h>
+
+//Path and ETag of the image the in-process server serves
+#define HTTP_OTA_BENCH_PATH				"/firmware.bin"
+#define HTTP_OTA_BENCH_ETAG				"\"bench-1.0.0\""
+
+//Longest a run may take before it counts as stalled
+#define HTTP_OTA_BENCH_TIMEOUT_MS		60000
+
+//Longest request or response header
+#define HTTP_OTA_BENCH_HEADER_MAX_LEN	1024
+
+//Attempts to resume a run without progress, as CONFIG_HTTP_OTA_RETRIES on the device
+#define HTTP_OTA_BENCH_RETRIES			5
+
+/**
+ * @fn bool http_ota_bench_run(void)
+ * @brief fetch an image over HTTP the way http_ota does on the device: keep-alive requests, Range and If-Range
+ * 			resumes and a pipe of CONFIG_HTTP_OTA_PIPE_DEPTH chunks between the receive and the flash writes. The
+ * 			image comes from CONFIG_HTTP_OTA_BENCH_URL, for example python3 -m http.server, or from an in-process
+ * 			HTTP/1.1 server. Reads are paced as over a CONFIG_HTTP_OTA_BENCH_LINK_KBPS link with the receive window
+ * 			of lwIP, flash writes at CONFIG_HTTP_OTA_BENCH_FLASH_KBPS.
+ * 			Runs with the flash writes in the receive loop, pipelined, and pipelined with
+ * 			CONFIG_HTTP_OTA_BENCH_DISCONNECTS dropped connections. Logs the KB/s, the requests per connection and
+ * 			the time from each drop to the next image byte received
+ *
+ * @return true if every run wrote the image intact
+ */
+bool http_ota_bench_run(void);
+
+#endif /* MAIN_HTTP_OTA_BENCH_H_ */
@@ -20,6 +20,12 @@
 #include "string.h" 
 #include "stdint.h"
 #include "sntp_time_sync.h"
+#include "device_api.h"
+#include "mqtt_metrics.h"
+#include "mqtt_session_store.h"
+#include "ota_verify.h"
+#include "sensor_window.h"
+#include "telemetry_codec.h"
 
 //Tag used for ESP serial console messages
 static const char TAG[] = "http_server";
@@ -227,68 +233,116 @@ static esp_err_t http_server_favicon_ico_handler(httpd_req_t *req)
 }
 /**
  * @fn esp_err_t http_server_OTA_update_handler(httpd_req_t*)
- * @brief		Recieves the .bin file via the web page and handles the firmware update  
+ * @brief		Recieves the .bin file via the web page and handles the firmware update. The image is hashed as it
+ * 				is written, so a file that is not an app image or does not match its appended SHA-256 is given up
+ * 				before esp_ota_end
  * 
  * @param req	HTTP request for which the uri needs to be handled
- * @return		ESP_OK, otherwise ESP_FAIL if timeout occures and the update cannot be started. 
+ * @return		ESP_OK, otherwise ESP_FAIL if the connection fails and the update cannot be completed. 
  */
 esp_err_t http_server_OTA_update_handler(httpd_req_t *req)
 {
 	esp_ota_handle_t ota_handle;
+	ota_verify_t ota_verify;
 	char ota_buff[1024];
 	int content_length = req->content_len;
 	int content_recieved = 0;
 	int recv_len;
+	int recv_timeouts = 0;
 	bool is_req_body_started = false;
 	bool flash_successful = false;
+	esp_err_t err = ESP_OK;
 	
 	const esp_partition_t  *update_partition = esp_ota_get_next_update_partition(NULL);
 	
-	do {
+	for(;;)
+	{
 		//read data for the request
-		if((recv_len = httpd_req_recv(req, ota_buff, MIN(content_length,sizeof(ota_buff))))<0)
+		//one byte is kept to terminate the multipart headers of the first part
+		if((recv_len = httpd_req_recv(req, ota_buff, MIN(content_length,sizeof(ota_buff) - 1)))<0)
 		{
 			//check if timeout occurred
-			if(recv_len == HTTPD_SOCK_ERR_TIMEOUT)
+			if(recv_len == HTTPD_SOCK_ERR_TIMEOUT && ++recv_timeouts < OTA_UPDATE_RECV_TIMEOUTS)
 			{
 				ESP_LOGI(TAG, "http_server_ota_update_handler: Socket Timeout");
 				continue;
 			}
 			ESP_LOGI(TAG,"http_server_ota_update_handler: OTA other error: %d",recv_len);
+			if(is_req_body_started)
+			{
+				esp_ota_abort(ota_handle);
+				ota_verify_abort(&ota_verify);
+			}
 			return ESP_FAIL;
 		}
+		if(recv_len == 0)
+		{
+			break;
+		}
+		recv_timeouts = 0;
 		printf("http_server_ota_update_handler:OTA RX: %d of %d\r",content_recieved,content_length);
+		char *data_p = ota_buff;
+		int data_len = recv_len;
 		//first we check if this is the first data we are 
 		if(!is_req_body_started)
 		{
-			is_req_body_started = true;
 			//Get the location of the .bin file content(remove the web from data)
-			char *body_start_p = strstr(ota_buff,"\r\n\r\n") + strlen("\r\n\r\n");
-			int body_part_len = recv_len - (body_start_p - ota_buff);
+			ota_buff[recv_len] = '\0';
+			char *body_start_p = strstr(ota_buff,"\r\n\r\n");
+			if(body_start_p == NULL)
+			{
+				ESP_LOGI(TAG,"http_server_ota_update_handler: no file in the first part of the request");
+				return ESP_FAIL;
+			}
+			data_p = body_start_p + strlen("\r\n\r\n");
+			data_len = recv_len - (data_p - ota_buff);
 			
 			printf("http_server_ota_update_handler: OTA file size: %d\r\n",content_length);
-			esp_err_t err = esp_ota_begin(update_partition, OTA_SIZE_UNKNOWN, &ota_handle);
+			err = esp_ota_begin(update_partition, OTA_SIZE_UNKNOWN, &ota_handle);
 			if(err != ESP_OK)
 			{
-				printf("http_server_ota_update_handler: Error with OTA begin, canceling OTA\r\n");
+				printf("http_server_ota_update_handler: Error with OTA begin, canceling OTA: %s\r\n", esp_err_to_name(err));
 				return ESP_FAIL;
 			}
 			else
 			{
 				printf("http_server_ota_update_handler: Writing to partition subtype %d at offset 0x%lx\r\n", update_partition->subtype,update_partition->address);
 			}
-			//write the first part of the data
-			esp_ota_write(ota_handle, body_start_p, body_part_len);
-			content_recieved += body_part_len;
+			is_req_body_started = true;
+			ota_verify_begin(&ota_verify, NULL);
 		}
-		else
+		//the image is checked before it is written, a bad one is given up at the first chunk that shows it
+		err = ota_verify_update(&ota_verify, data_p, data_len);
+		if(err == ESP_OK)
+		{
+			err = esp_ota_write(ota_handle, data_p, data_len);
+		}
+		if(err != ESP_OK)
+		{
+			ESP_LOGE(TAG,"http_server_ota_update_handler: image rejected at byte %d: %s", content_recieved, esp_err_to_name(err));
+			break;
+		}
+		content_recieved += data_len;
+		if(content_recieved >= content_length)
 		{
-			//write OTA data
-			esp_ota_write(ota_handle, ota_buff, recv_len);
-			content_recieved += recv_len;
+			break;
 		}
-	} while (recv_len>0 && content_recieved<content_length);
-	if(esp_ota_end(ota_handle) == ESP_OK)
+	}
+	if(!is_req_body_started)
+	{
+		ESP_LOGI(TAG,"http_server_ota_update_handler: empty request");
+		return ESP_FAIL;
+	}
+	if(err == ESP_OK)
+	{
+		err = ota_verify_finish(&ota_verify);
+	}
+	if(err != ESP_OK)
+	{
+		ota_verify_abort(&ota_verify);
+		esp_ota_abort(ota_handle);
+	}
+	else if(esp_ota_end(ota_handle) == ESP_OK)
 	{
 		//lets update the partitoin
 		if(esp_ota_set_boot_partition(update_partition) == ESP_OK)
@@ -334,9 +388,29 @@ esp_err_t http_server_OTA_status_handler(httpd_req_t *req)
 	httpd_resp_send(req, otaJSON, strlen(otaJSON));
 	return ESP_OK;
 }
+
+/**
+ * @fn bool http_server_accepts_cbor(httpd_req_t*)
+ * @brief check whether the client asked for application/cbor in its Accept header
+ * 
+ * @param req  HTTP request to check
+ * @return true if the response should be CBOR
+ */
+static bool http_server_accepts_cbor(httpd_req_t *req)
+{
+	char accept[64];
+	size_t len = httpd_req_get_hdr_value_len(req, "Accept");
+	//browsers send long Accept headers without CBOR, those are answered in JSON
+	if(len == 0 || len >= sizeof(accept) || httpd_req_get_hdr_value_str(req, "Accept", accept, sizeof(accept)) != ESP_OK)
+	{
+		return false;
+	}
+	return strstr(accept, "application/cbor") != NULL;
+}
+
 /**
  * @fn esp_err_t http_server_get_dhtSensor_readings_json_handler()
- * @brief respond with dht11 sensor data
+ * @brief respond with dht11 sensor data, as a telemetry sample in CBOR if the client accepts it
  * 
  * @param req  HTTP request for which the uri needs to be handled
  * @return ESP_OK
@@ -344,13 +418,62 @@ esp_err_t http_server_OTA_status_handler(httpd_req_t *req)
 static esp_err_t http_server_get_dhtSensor_readings_json_handler(httpd_req_t *req)
 {
 	ESP_LOGI(TAG,"/dhtSensor.json requested");
+	if(http_server_accepts_cbor(req))
+	{
+		uint8_t dhtSensorCBOR[TELEMETRY_CODEC_SAMPLE_MAX_LEN];
+		struct dht11_reading reading = DHT11_read();
+		telemetry_sample_t sample = {
+				.t_ms = (uint32_t)(esp_timer_get_time() / 1000),
+				.temperature = reading.temperature,
+				.humidity = reading.humidity,
+				.rssi = wifi_app_get_rssi(),
+				.status = reading.status,
+		};
+		int len = telemetry_codec_encode_sample(TELEMETRY_CODEC_CBOR, &sample, dhtSensorCBOR, sizeof(dhtSensorCBOR));
+		//-1 is HTTPD_RESP_USE_STRLEN, the buffer must not be sent as a string
+		if(len < 0)
+		{
+			httpd_resp_send_err(req, HTTPD_500_INTERNAL_SERVER_ERROR, "sample buffer too small");
+			return ESP_OK;
+		}
+		httpd_resp_set_type(req, telemetry_codec_content_type(TELEMETRY_CODEC_CBOR));
+		httpd_resp_send(req, (const char*)dhtSensorCBOR, len);
+		return ESP_OK;
+	}
 	char dhtSensorJSON[100];
-	sprintf(dhtSensorJSON,"{\"status\":\"%s\",\"temp\":\"%d\",\"humidity\":\"%d\"}",DHT11_read().status == DHT11_CRC_ERROR ? "CRC Error" :
-			DHT11_read().status == DHT11_TIMEOUT_ERROR ? "Timeout Error" :
-			DHT11_read().status == DHT11_OK ? "OK" : "Unknown Status",DHT11_read().temperature,DHT11_read().humidity);
-//	sprintf(dhtSensorJSON,"{\"status\":\"%s\",\"temp\":\"%d\",\"humidity\":\"%d\"}","OK",10,20);
+	size_t len = sizeof(dhtSensorJSON);
+	if(device_api_call("sensor", NULL, 0, dhtSensorJSON, &len) != ESP_OK)
+	{
+		len = 0;
+	}
 	httpd_resp_set_type(req, "application/json");
-	httpd_resp_send(req, dhtSensorJSON, strlen(dhtSensorJSON));
+	httpd_resp_send(req, dhtSensorJSON, len);
+	return ESP_OK;
+}
+
+/**
+ * @fn esp_err_t http_server_get_dhtSensor_stats_json_handler(httpd_req_t*)
+ * @brief respond with the min/max/mean/count of the dht11 readings over each sliding window, in CBOR if the
+ * 			client accepts it
+ * 
+ * @param req  HTTP request for which the uri needs to be handled
+ * @return ESP_OK
+ */
+static esp_err_t http_server_get_dhtSensor_stats_json_handler(httpd_req_t *req)
+{
+	ESP_LOGI(TAG,"/dhtStats.json requested");
+	char dhtStatsJSON[SENSOR_WINDOW_JSON_MAX_LEN];
+	bool cbor = http_server_accepts_cbor(req);
+	uint32_t now_ms = (uint32_t)(esp_timer_get_time() / 1000);
+	int len = cbor ? sensor_window_to_cbor(dhtStatsJSON, sizeof(dhtStatsJSON), now_ms) :
+			sensor_window_to_json(dhtStatsJSON, sizeof(dhtStatsJSON), now_ms);
+	if(len < 0)
+	{
+		httpd_resp_send_err(req, HTTPD_500_INTERNAL_SERVER_ERROR, "stats buffer too small");
+		return ESP_OK;
+	}
+	httpd_resp_set_type(req, telemetry_codec_content_type(cbor ? TELEMETRY_CODEC_CBOR : TELEMETRY_CODEC_JSON));
+	httpd_resp_send(req, dhtStatsJSON, len);
 	return ESP_OK;
 }
 
@@ -432,26 +555,14 @@ static esp_err_t http_server_get_wifi_connect_info_handler(httpd_req_t *req)
 {
 	ESP_LOGI(TAG, "/wifiConnectInfo.json requested");
 	char ipInfoJSON[200];
-	memset(ipInfoJSON,0x00,sizeof(ipInfoJSON));  
-	char ip[IP4ADDR_STRLEN_MAX];
-	char netmask[IP4ADDR_STRLEN_MAX];
-	char gw[IP4ADDR_STRLEN_MAX];
-	if(g_wifi_connect_status == HTTP_WIFI_STATUS_CONNECT_SUCCESS)
+	size_t len = sizeof(ipInfoJSON);
+	if(g_wifi_connect_status != HTTP_WIFI_STATUS_CONNECT_SUCCESS ||
+	   device_api_call("wifi_info", NULL, 0, ipInfoJSON, &len) != ESP_OK)
 	{
-		wifi_ap_record_t wifi_data;
-		ESP_ERROR_CHECK(esp_wifi_sta_get_ap_info(&wifi_data));
-		char *ssid = (char*)wifi_data.ssid;
-		
-		esp_netif_ip_info_t ip_info;
-		ESP_ERROR_CHECK(esp_netif_get_ip_info(esp_netif_sta, &ip_info));
-		esp_ip4addr_ntoa(&ip_info.ip, ip, IP4ADDR_STRLEN_MAX);
-		esp_ip4addr_ntoa(&ip_info.netmask, netmask, IP4ADDR_STRLEN_MAX);
-		esp_ip4addr_ntoa(&ip_info.gw, gw, IP4ADDR_STRLEN_MAX);
-		
-		sprintf(ipInfoJSON,"{\"ip\":\"%s\",\"netmask\":\"%s\",\"gw\":\"%s\",\"ap\":\"%s\"}",ip,netmask,gw,ssid);	
+		len = 0;
 	}
 	httpd_resp_set_type(req, "application/json");
-	httpd_resp_send(req, ipInfoJSON, strlen(ipInfoJSON));
+	httpd_resp_send(req, ipInfoJSON, len);
 		
 		return ESP_OK;
 }
@@ -512,6 +623,28 @@ static esp_err_t http_server_get_ap_ssid_json_handler(httpd_req_t *req)
 			
 	return ESP_OK;
 }
+
+/**
+ * @fn esp_err_t http_server_get_mqtt_metrics_json_handler(httpd_req_t*)
+ * @brief respond with the PUBACK latency histogram and the health of the broker sessions
+ * 
+ * @param req  HTTP request for which the uri needs to be handled
+ * @return ESP_OK
+ */
+static esp_err_t http_server_get_mqtt_metrics_json_handler(httpd_req_t *req)
+{
+	ESP_LOGI(TAG, "/metrics.json requested");
+	char metricsJSON[MQTT_METRICS_JSON_MAX_LEN];
+	size_t len = sizeof(metricsJSON);
+	if(device_api_call("metrics", NULL, 0, metricsJSON, &len) != ESP_OK)
+	{
+		httpd_resp_send_err(req, HTTPD_500_INTERNAL_SERVER_ERROR, "metrics buffer too small");
+		return ESP_OK;
+	}
+	httpd_resp_set_type(req, "application/json");
+	httpd_resp_send(req, metricsJSON, len);
+	return ESP_OK;
+}
 static httpd_handle_t http_server_configure()
 {
 	//Generate the default configuration
@@ -607,6 +740,14 @@ static httpd_handle_t http_server_configure()
 				.user_ctx = NULL
 		};
 		httpd_register_uri_handler(http_server_handle, &dht_sensor_json);
+		//register dhtStats.json handler 
+		httpd_uri_t dht_stats_json = {
+				.uri = "/dhtStats.json",
+				.method = HTTP_GET,
+				.handler = http_server_get_dhtSensor_stats_json_handler,
+				.user_ctx = NULL
+		};
+		httpd_register_uri_handler(http_server_handle, &dht_stats_json);
 		//register WifiConnect.json handler 
 		httpd_uri_t wifi_connect_json = {
 				.uri = "/wifiConnect.json",
@@ -659,6 +800,15 @@ static httpd_handle_t http_server_configure()
 		};
 		httpd_register_uri_handler(http_server_handle, &ap_ssid_json);
 		
+		//register metrics.json handler 
+		httpd_uri_t mqtt_metrics_json = {
+				.uri = "/metrics.json",
+				.method = HTTP_GET,
+				.handler = http_server_get_mqtt_metrics_json_handler,
+				.user_ctx = NULL
+		};
+		httpd_register_uri_handler(http_server_handle, &mqtt_metrics_json);
+		
 		return http_server_handle;
 	}
 	return NULL;
@@ -699,6 +849,10 @@ BaseType_t http_server_monitor_send_message(http_server_message_e msgID)
 void http_server_fw_update_reset_callback(void *arg)
 {
 	ESP_LOGI(TAG,"http_server_fw_update_reset_callback: timer timed-out, restarting the device");
+#if CONFIG_MQTT_SESSION_STORE
+	//the new image may lay out RTC memory differently, it takes the unacked publishes over from NVS
+	mqtt_session_store_flush();
+#endif
 	esp_restart();
 }
 
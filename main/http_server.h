@@ -12,6 +12,9 @@
 #define OTA_UPDATE_SUCCESSFULL	1
 #define OTA_UPDATE_FAILED		-1
 
+//Socket timeouts in a row after which a firmware upload is given up
+#define OTA_UPDATE_RECV_TIMEOUTS	5
+
 typedef enum http_server_wifi_connect_status{
 	NONE = 0,
 	HTTP_WIFI_STATUS_CONNECTING,
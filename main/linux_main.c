@@ -0,0 +1,187 @@
+/**
+ * @fn void app_main(void)
+ * @brief Linux target entry point, runs the sampling path against the simulated
+ * 			DHT11 backend to load test the downstream consumers
+ * 
+ */
+
+#include <stdio.h>
+#include <time.h>
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "esp_log.h"
+#include "dht11.h"
+#include "dht11_edge_bench.h"
+#include "dsp_decim_bench.h"
+#include "http_ota_bench.h"
+#include "mqtt_agent_bench.h"
+#include "mqtt_batch_bench.h"
+#include "mqtt_bench.h"
+#include "mqtt_impair_bench.h"
+#include "mqtt_ota_bench.h"
+#include "mqtt_outbox_sim.h"
+#include "mqtt_router_bench.h"
+#include "mqtt_rpc_bench.h"
+#include "mqtt_session_store_bench.h"
+#include "report_filter_bench.h"
+#include "sensor_window.h"
+#include "sensor_window_bench.h"
+#include "telemetry_codec_bench.h"
+#include "telemetry_sink_bench.h"
+
+static const char TAG[] = "linux_main";
+
+//interval between sliding-window summaries
+#define LINUX_MAIN_SUMMARY_INTERVAL_MS	10000
+
+void app_main(void)
+{
+	char summary[SENSOR_WINDOW_JSON_MAX_LEN];
+	struct timespec ts;
+	
+#if CONFIG_MQTT_OUTBOX_SIM
+	//check the outbox against scheduled outages before the load test starts
+	if(!mqtt_outbox_sim_run())
+	{
+		ESP_LOGE(TAG, "outbox simulation failed");
+	}
+#endif
+
+#if CONFIG_DHT11_EDGE_BENCH
+	//decode errors and timing jitter of the edge capture decoder on simulated frames
+	if(!dht11_edge_bench_run())
+	{
+		ESP_LOGE(TAG, "DHT11 edge decoder lost clean frames");
+	}
+#endif
+
+#if CONFIG_SENSOR_WINDOW_BENCH
+	//the sliding-window aggregates against a rescan of their samples, and the cost of an add and a query
+	if(!sensor_window_bench_run())
+	{
+		ESP_LOGE(TAG, "sliding-window aggregates did not match a rescan");
+	}
+#endif
+
+#if CONFIG_DSP_DECIM_BENCH
+	//the decimation kernels of the analog probe chain against their reference, and their cost per sample
+	if(!dsp_decim_bench_run())
+	{
+		ESP_LOGE(TAG, "decimation kernels did not match their reference");
+	}
+#endif
+
+#if CONFIG_MQTT_SESSION_STORE_BENCH
+	//the QoS1 journal against a model across random acks and resets, and the time to take it over after each
+	if(!mqtt_session_store_bench_run())
+	{
+		ESP_LOGE(TAG, "session journal did not match its model");
+	}
+#endif
+
+#if CONFIG_MQTT_ROUTER_BENCH
+	//compare the subscription trie with a scan of every filter
+	if(!mqtt_router_bench_run())
+	{
+		ESP_LOGE(TAG, "router benchmark failed");
+	}
+#endif
+
+#if CONFIG_MQTT_REPORT_BENCH
+	//messages saved by report-by-exception on day-long traces, before the simulation is reconfigured for the load test
+	if(!report_filter_bench_run())
+	{
+		ESP_LOGE(TAG, "report-by-exception replay out of bounds");
+	}
+#endif
+
+#if CONFIG_TELEMETRY_CODEC_BENCH
+	//payload size and encode time of the text, JSON and CBOR samples
+	if(!telemetry_codec_bench_run())
+	{
+		ESP_LOGE(TAG, "telemetry encoding benchmark failed");
+	}
+#endif
+
+#if CONFIG_TELEMETRY_SINK_BENCH
+	//cost per extra telemetry sink, and fast sinks kept fed next to a slow one
+	if(!telemetry_sink_bench_run())
+	{
+		ESP_LOGE(TAG, "telemetry fan-out benchmark failed");
+	}
+#endif
+
+#if CONFIG_MQTT_BENCH
+	//publish rate, PUBACK latency and CPU per message of coreMQTT against a local broker
+	if(!mqtt_bench_run())
+	{
+		ESP_LOGE(TAG, "MQTT benchmark failed");
+	}
+#endif
+
+#if CONFIG_MQTT_AGENT_BENCH
+	//sustained publish rate through the agent queue from concurrent producers, against publishing directly
+	if(!mqtt_agent_bench_run())
+	{
+		ESP_LOGE(TAG, "MQTT agent benchmark failed");
+	}
+#endif
+
+#if CONFIG_MQTT_BATCH_BENCH
+	//bytes and PUBACKs per sample at each batch size, the framing and acks a batch saves
+	if(!mqtt_batch_bench_run())
+	{
+		ESP_LOGE(TAG, "MQTT batching benchmark failed");
+	}
+#endif
+
+#if CONFIG_MQTT_RPC_BENCH
+	//round trip of remote calls answered by a coreMQTT client, idle and under telemetry load
+	if(!mqtt_rpc_bench_run())
+	{
+		ESP_LOGE(TAG, "MQTT RPC benchmark missed its latency target");
+	}
+#endif
+
+#if CONFIG_MQTT_OTA_BENCH
+	//image download over the MQTT session, steady and across dropped connections
+	if(!mqtt_ota_bench_run())
+	{
+		ESP_LOGE(TAG, "MQTT OTA benchmark failed");
+	}
+#endif
+
+#if CONFIG_HTTP_OTA_BENCH
+	//image fetch over HTTP, flash writes in the receive loop against pipelined, and resumed with Range requests
+	if(!http_ota_bench_run())
+	{
+		ESP_LOGE(TAG, "HTTP OTA benchmark failed");
+	}
+#endif
+
+#if CONFIG_MQTT_IMPAIR_BENCH
+	//recovery, duplicates and loss of the QoS1 session on an impaired link
+	if(!mqtt_impair_bench_run())
+	{
+		ESP_LOGE(TAG, "MQTT impairment scenarios lost samples");
+	}
+#endif
+
+	//initialize the sliding-window aggregates fed by the DHT11 task
+	sensor_window_init();
+	
+	//start DHT11 task on the simulated backend
+	DHT11_set_backend(DHT11_BACKEND_SIM);
+	DHT11_task_start();
+	
+	for(;;)
+	{
+		vTaskDelay(LINUX_MAIN_SUMMARY_INTERVAL_MS/portTICK_PERIOD_MS);
+		clock_gettime(CLOCK_MONOTONIC, &ts);
+		if(sensor_window_to_json(summary, sizeof(summary), (uint32_t)(ts.tv_sec * 1000 + ts.tv_nsec / 1000000)) > 0)
+		{
+			ESP_LOGI(TAG, "%s", summary);
+		}
+	}
+}
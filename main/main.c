@@ -6,23 +6,33 @@
 
 #include "nvs_flash.h"
 #include "esp_log.h"
+#include "ota_health.h"
 #include "sntp_time_sync.h"
 #include "wifi_app.h"
 #include "dht11.h"
+#include "sensor_window.h"
+#include "adc_acq.h"
+#include "mqtt_agent.h"
+#include "device_topics.h"
+#include "telemetry.h"
 //#include "aws_iot.h"
 #include "wifi_reset_btn.h"
 
 
 static const char TAG[] = "main";
 
-int aws_iot_demo_main( int argc, char ** argv );
-
 void wifi_application_connected_events(void)
 {
 	ESP_LOGI(TAG,"WIFI Application Connected!!");
 	sntp_time_sync_task_start();
 //	aws_iot_start();
-	aws_iot_demo_main(0,NULL);
+	//the agent task owns the broker connection, other tasks publish through its queue
+	mqtt_agent_task_start();
+#if CONFIG_MQTT_PERSISTENT_SESSION
+	telemetry_task_start();
+	//command, config and OTA topics of this device
+	device_topics_start();
+#endif
 }
 void app_main(void)
 {
@@ -35,15 +45,28 @@ void app_main(void)
 	}
 	ESP_ERROR_CHECK(ret);
 	
+#if CONFIG_OTA_HEALTH
+	//on the first boot of a new image, check it before the components it checks report
+	ota_health_start();
+#endif
+	
 	//start wifi
 	wifi_app_start();
 	
 	//Wifi reset button config
 	wifi_reset_button_config();
 	
+	//initialize the sliding-window aggregates fed by the DHT11 task
+	sensor_window_init();
+	
 	//start DHT11 task
 	DHT11_task_start();
 	
+#if CONFIG_ADC_ACQ_ENABLE
+	//start the analog probe acquisition, it feeds the same sliding windows
+	adc_acq_task_start();
+#endif
+	
 	//set connected event callback
 	wifi_app_set_callback(&wifi_application_connected_events);
 }
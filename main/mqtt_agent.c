@@ -0,0 +1,379 @@
+/*
+ * mqtt_agent.c
+ *
+ *  Created on: Oct 18, 2026
+ *      Author: hamxa
+ */
+#include <stdio.h>
+#include <string.h>
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/queue.h"
+#include "freertos/task.h"
+#include "esp_log.h"
+#include "sdkconfig.h"
+
+#include "mqtt_agent.h"
+#include "mqtt_router.h"
+#include "mqtt_slab.h"
+#include "mqtt_topic_alias.h"
+#include "tasks_common.h"
+
+static const char TAG[] = "mqtt_agent";
+
+/**
+ * Active subscription, indexed by the router id of its filter. Only touched by the agent task
+ */
+typedef struct mqtt_agent_subscription
+{
+	MQTTQoS_t qos;
+	mqtt_agent_incoming_cb_t incoming_cb;
+	void *incoming_ctx;
+}mqtt_agent_subscription_t;
+
+static QueueHandle_t g_agent_queue = NULL;
+#if !CONFIG_IDF_TARGET_LINUX
+static TaskHandle_t g_agent_task = NULL;
+#endif
+
+static mqtt_agent_subscription_t g_subscriptions[MQTT_ROUTER_MAX_FILTERS];
+
+//updated by producers and the agent task alike
+static mqtt_agent_stats_t g_agent_stats;
+
+//set by the agent task while it serves a broker connection
+static bool g_agent_connected = false;
+
+#if !CONFIG_IDF_TARGET_LINUX
+int aws_iot_demo_main( int argc, char ** argv );
+#endif
+
+/**
+ * @fn esp_err_t mqtt_agent_cmd_alloc(mqtt_agent_cmd_t*, const char*, const void*, size_t)
+ * @brief copy topic and payload into one pool block owned by the command
+ *
+ * @return ESP_OK, ESP_ERR_INVALID_ARG, ESP_ERR_NO_MEM
+ */
+static esp_err_t mqtt_agent_cmd_alloc(mqtt_agent_cmd_t *cmd, const char *topic, const void *payload, size_t len)
+{
+	size_t topic_len = topic ? strlen(topic) : 0;
+
+	if(topic_len == 0 || topic_len > UINT16_MAX || (payload == NULL && len > 0))
+	{
+		return ESP_ERR_INVALID_ARG;
+	}
+
+	char *block = mqtt_slab_alloc(topic_len + 1 + len);
+	if(block == NULL)
+	{
+		return ESP_ERR_NO_MEM;
+	}
+	memcpy(block, topic, topic_len + 1);
+	if(len > 0)
+	{
+		memcpy(block + topic_len + 1, payload, len);
+	}
+
+	cmd->topic = block;
+	cmd->topic_len = (uint16_t)topic_len;
+	cmd->payload = (const uint8_t*)(block + topic_len + 1);
+	cmd->payload_len = len;
+	return ESP_OK;
+}
+
+/**
+ * @fn esp_err_t mqtt_agent_send(mqtt_agent_cmd_t*, TickType_t)
+ * @brief queue a command, it is freed here if the queue stays full
+ *
+ * @return ESP_OK, ESP_ERR_INVALID_STATE before the agent started, ESP_ERR_TIMEOUT
+ */
+static esp_err_t mqtt_agent_send(mqtt_agent_cmd_t *cmd, TickType_t wait)
+{
+	if(g_agent_queue == NULL)
+	{
+		mqtt_slab_free(cmd->topic);
+		return ESP_ERR_INVALID_STATE;
+	}
+	cmd->queued_at = xTaskGetTickCount();
+	if(xQueueSend(g_agent_queue, cmd, wait) != pdTRUE)
+	{
+		mqtt_slab_free(cmd->topic);
+		__atomic_add_fetch(&g_agent_stats.queue_full, 1, __ATOMIC_RELAXED);
+		return ESP_ERR_TIMEOUT;
+	}
+
+	uint32_t depth = uxQueueMessagesWaiting(g_agent_queue);
+	uint32_t max_depth = __atomic_load_n(&g_agent_stats.max_depth, __ATOMIC_RELAXED);
+	while(depth > max_depth &&
+		  !__atomic_compare_exchange_n(&g_agent_stats.max_depth, &max_depth, depth, true, __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+	{
+	}
+	__atomic_add_fetch(&g_agent_stats.enqueued, 1, __ATOMIC_RELAXED);
+	return ESP_OK;
+}
+
+/**
+ * @fn esp_err_t mqtt_agent_add_subscription(const mqtt_agent_cmd_t*)
+ * @brief add or refresh the table entry of an acknowledged subscription
+ *
+ * @return ESP_OK, ESP_ERR_NO_MEM if the table is full
+ */
+static esp_err_t mqtt_agent_add_subscription(const mqtt_agent_cmd_t *cmd)
+{
+	uint16_t id;
+
+	esp_err_t err = mqtt_router_add(cmd->topic, cmd->topic_len, &id);
+	if(err != ESP_OK)
+	{
+		ESP_LOGE(TAG, "mqtt_agent_add_subscription: dropping %s: %s", cmd->topic, esp_err_to_name(err));
+		return err;
+	}
+
+	g_subscriptions[id].qos = cmd->qos;
+	g_subscriptions[id].incoming_cb = cmd->incoming_cb;
+	g_subscriptions[id].incoming_ctx = cmd->incoming_ctx;
+	return ESP_OK;
+}
+
+/**
+ * @fn void mqtt_agent_deliver(void*, uint16_t)
+ * @brief hand an incoming publish to the subscription of a matching filter
+ *
+ * @param arg the incoming publish
+ * @param id router id of the filter
+ */
+static void mqtt_agent_deliver(void *arg, uint16_t id)
+{
+	if(g_subscriptions[id].incoming_cb)
+	{
+		g_subscriptions[id].incoming_cb(g_subscriptions[id].incoming_ctx, arg);
+	}
+}
+
+#if !CONFIG_IDF_TARGET_LINUX
+static void mqtt_agent_task(void *pvParameter)
+{
+	printf("***** Starting MQTT agent Task *****\n\n");
+
+	//only returns if the MQTT library could not be initialized
+	aws_iot_demo_main(0, NULL);
+
+	ESP_LOGE(TAG, "mqtt_agent_task: MQTT session loop exited");
+	g_agent_task = NULL;
+	vTaskDelete(NULL);
+}
+
+void mqtt_agent_task_start(void)
+{
+	//the Wi-Fi connected callback runs on every reconnect, the agent keeps its own connection alive
+	if(g_agent_task != NULL || mqtt_agent_init() != ESP_OK)
+	{
+		return;
+	}
+
+	xTaskCreatePinnedToCore(&mqtt_agent_task, "mqtt_agent_task", MQTT_AGENT_TASK_STACK_SIZE, NULL, MQTT_AGENT_TASK_PRIORITY, &g_agent_task, MQTT_AGENT_TASK_CORE_ID);
+}
+#endif
+
+esp_err_t mqtt_agent_init(void)
+{
+	if(g_agent_queue == NULL)
+	{
+		g_agent_queue = xQueueCreate(MQTT_AGENT_QUEUE_LENGTH, sizeof(mqtt_agent_cmd_t));
+		if(g_agent_queue == NULL)
+		{
+			ESP_LOGE(TAG, "mqtt_agent_init: queue allocation failed");
+			return ESP_ERR_NO_MEM;
+		}
+	}
+	return ESP_OK;
+}
+
+esp_err_t mqtt_agent_cmd_init_publish(mqtt_agent_cmd_t *cmd, const char *topic, const void *payload, size_t len, MQTTQoS_t qos,
+									  mqtt_agent_done_cb_t done_cb, void *ctx)
+{
+	memset(cmd, 0, sizeof(*cmd));
+	if(qos == MQTTQoS2)
+	{
+		//QoS2 needs PUBREC/PUBREL bookkeeping the agent does not keep
+		return ESP_ERR_INVALID_ARG;
+	}
+	cmd->type = MQTT_AGENT_CMD_PUBLISH;
+	cmd->qos = qos;
+	cmd->done_cb = done_cb;
+	cmd->ctx = ctx;
+	return mqtt_agent_cmd_alloc(cmd, topic, payload, len);
+}
+
+esp_err_t mqtt_agent_publish(const char *topic, const void *payload, size_t len, MQTTQoS_t qos,
+							 mqtt_agent_done_cb_t done_cb, void *ctx, TickType_t wait)
+{
+	mqtt_agent_cmd_t cmd;
+
+#if CONFIG_MQTT_TOPIC_ALIASES
+	topic = topic ? mqtt_topic_alias_lookup(topic) : NULL;
+#endif
+	esp_err_t err = mqtt_agent_cmd_init_publish(&cmd, topic, payload, len, qos, done_cb, ctx);
+	if(err != ESP_OK)
+	{
+		return err;
+	}
+	return mqtt_agent_send(&cmd, wait);
+}
+
+esp_err_t mqtt_agent_subscribe(const char *filter, MQTTQoS_t qos, mqtt_agent_incoming_cb_t incoming_cb, void *incoming_ctx,
+							   mqtt_agent_done_cb_t done_cb, void *ctx, TickType_t wait)
+{
+	mqtt_agent_cmd_t cmd = {
+			.type = MQTT_AGENT_CMD_SUBSCRIBE,
+			.qos = qos,
+			.done_cb = done_cb,
+			.ctx = ctx,
+			.incoming_cb = incoming_cb,
+			.incoming_ctx = incoming_ctx,
+	};
+
+	if(filter == NULL || strlen(filter) > MQTT_ROUTER_MAX_FILTER_LENGTH)
+	{
+		return ESP_ERR_INVALID_SIZE;
+	}
+	esp_err_t err = mqtt_agent_cmd_alloc(&cmd, filter, NULL, 0);
+	if(err != ESP_OK)
+	{
+		return err;
+	}
+	return mqtt_agent_send(&cmd, wait);
+}
+
+esp_err_t mqtt_agent_unsubscribe(const char *filter, mqtt_agent_done_cb_t done_cb, void *ctx, TickType_t wait)
+{
+	mqtt_agent_cmd_t cmd = {
+			.type = MQTT_AGENT_CMD_UNSUBSCRIBE,
+			.done_cb = done_cb,
+			.ctx = ctx,
+	};
+
+	esp_err_t err = mqtt_agent_cmd_alloc(&cmd, filter, NULL, 0);
+	if(err != ESP_OK)
+	{
+		return err;
+	}
+	return mqtt_agent_send(&cmd, wait);
+}
+
+void mqtt_agent_get_stats(mqtt_agent_stats_t *stats)
+{
+	stats->enqueued = __atomic_load_n(&g_agent_stats.enqueued, __ATOMIC_RELAXED);
+	stats->completed = __atomic_load_n(&g_agent_stats.completed, __ATOMIC_RELAXED);
+	stats->failed = __atomic_load_n(&g_agent_stats.failed, __ATOMIC_RELAXED);
+	stats->queue_full = __atomic_load_n(&g_agent_stats.queue_full, __ATOMIC_RELAXED);
+	stats->max_depth = __atomic_load_n(&g_agent_stats.max_depth, __ATOMIC_RELAXED);
+	stats->expired = __atomic_load_n(&g_agent_stats.expired, __ATOMIC_RELAXED);
+}
+
+bool mqtt_agent_is_connected(void)
+{
+	return __atomic_load_n(&g_agent_connected, __ATOMIC_RELAXED);
+}
+
+size_t mqtt_agent_queue_space(void)
+{
+	if(g_agent_queue == NULL)
+	{
+		return 0;
+	}
+	return uxQueueSpacesAvailable(g_agent_queue);
+}
+
+void mqtt_agent_set_connected(bool connected)
+{
+	__atomic_store_n(&g_agent_connected, connected, __ATOMIC_RELAXED);
+}
+
+bool mqtt_agent_receive(mqtt_agent_cmd_t *cmd, TickType_t wait)
+{
+	if(g_agent_queue == NULL)
+	{
+		vTaskDelay(wait);
+		return false;
+	}
+	while(xQueueReceive(g_agent_queue, cmd, wait) == pdTRUE)
+	{
+#if CONFIG_MQTT_MESSAGE_EXPIRY_MS > 0
+		//a QoS0 reading that sat out a reconnect is stale, newer ones follow; QoS1 publishes are kept
+		if(cmd->type == MQTT_AGENT_CMD_PUBLISH && cmd->qos == MQTTQoS0 &&
+		   xTaskGetTickCount() - cmd->queued_at > pdMS_TO_TICKS(CONFIG_MQTT_MESSAGE_EXPIRY_MS))
+		{
+			__atomic_add_fetch(&g_agent_stats.expired, 1, __ATOMIC_RELAXED);
+			mqtt_agent_complete(cmd, ESP_ERR_TIMEOUT);
+			wait = 0;
+			continue;
+		}
+#endif
+		return true;
+	}
+	return false;
+}
+
+void mqtt_agent_complete(mqtt_agent_cmd_t *cmd, esp_err_t result)
+{
+	if(cmd->topic == NULL)
+	{
+		return;
+	}
+
+	if(result == ESP_OK && cmd->type == MQTT_AGENT_CMD_SUBSCRIBE)
+	{
+		result = mqtt_agent_add_subscription(cmd);
+	}
+	else if(cmd->type == MQTT_AGENT_CMD_UNSUBSCRIBE)
+	{
+		//the broker may have dropped the subscription even if the UNSUBACK got lost, stop dispatching either way
+		uint16_t id;
+		if(mqtt_router_remove(cmd->topic, cmd->topic_len, &id) == ESP_OK)
+		{
+			memset(&g_subscriptions[id], 0, sizeof(g_subscriptions[id]));
+		}
+	}
+
+	if(result == ESP_OK)
+	{
+		__atomic_add_fetch(&g_agent_stats.completed, 1, __ATOMIC_RELAXED);
+	}
+	else
+	{
+		__atomic_add_fetch(&g_agent_stats.failed, 1, __ATOMIC_RELAXED);
+	}
+
+	if(cmd->done_cb)
+	{
+		cmd->done_cb(cmd->ctx, result);
+	}
+	mqtt_slab_free(cmd->topic);
+	memset(cmd, 0, sizeof(*cmd));
+}
+
+size_t mqtt_agent_get_subscriptions(MQTTSubscribeInfo_t *list, size_t max, uint16_t *cursor)
+{
+	size_t count = 0;
+
+	while(count < max)
+	{
+		uint16_t id = mqtt_router_next(*cursor);
+		if(id == MQTT_ROUTER_NONE)
+		{
+			break;
+		}
+		list[count].qos = g_subscriptions[id].qos;
+		list[count].pTopicFilter = mqtt_router_filter(id, &list[count].topicFilterLength);
+		count++;
+		*cursor = id;
+	}
+	return count;
+}
+
+bool mqtt_agent_dispatch_incoming(const MQTTPublishInfo_t *publish)
+{
+	//the router only reads the publish through mqtt_agent_deliver
+	return mqtt_router_match(publish->pTopicName, publish->topicNameLength, mqtt_agent_deliver, (void*)publish) > 0;
+}
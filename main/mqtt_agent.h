@@ -0,0 +1,225 @@
+/*
+ * mqtt_agent.h
+ *
+ *  Created on: Oct 18, 2026
+ *      Author: hamxa
+ */
+
+#ifndef MAIN_MQTT_AGENT_H_
+#define MAIN_MQTT_AGENT_H_
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "freertos/FreeRTOS.h"
+#include "esp_err.h"
+#include "core_mqtt.h"
+#include "sdkconfig.h"
+
+//Commands that can wait for the agent task
+#define MQTT_AGENT_QUEUE_LENGTH			16
+
+//Topic filters renewed per SUBSCRIBE after a clean session, the agent holds up to MQTT_ROUTER_MAX_FILTERS
+#define MQTT_AGENT_RESUBSCRIBE_BATCH	8
+
+//Time the agent waits for a command before servicing the connection
+#define MQTT_AGENT_POLL_MS				10
+
+/**
+ * Operations the agent performs on behalf of other tasks
+ */
+typedef enum mqtt_agent_cmd_type
+{
+	MQTT_AGENT_CMD_PUBLISH = 0,
+	MQTT_AGENT_CMD_SUBSCRIBE,
+	MQTT_AGENT_CMD_UNSUBSCRIBE
+}mqtt_agent_cmd_type_e;
+
+/**
+ * @brief called by the agent task once a command is done: after the send for QoS0, after the ack otherwise
+ *
+ * @param ctx context given with the command
+ * @param result ESP_OK, or the reason the command failed
+ */
+typedef void (*mqtt_agent_done_cb_t)(void *ctx, esp_err_t result);
+
+/**
+ * @brief called by the agent task for every incoming publish matching a subscription, must not block
+ *
+ * @param ctx context given with the subscription
+ * @param publish the incoming publish, only valid during the call
+ */
+typedef void (*mqtt_agent_incoming_cb_t)(void *ctx, const MQTTPublishInfo_t *publish);
+
+/**
+ * A queued command, topic and payload live in one mqtt_slab block owned by the command
+ */
+typedef struct mqtt_agent_cmd
+{
+	mqtt_agent_cmd_type_e type;
+	MQTTQoS_t qos;
+	bool retain;
+	char *topic;
+	uint16_t topic_len;
+	const uint8_t *payload;
+	size_t payload_len;
+	mqtt_agent_done_cb_t done_cb;
+	void *ctx;
+	mqtt_agent_incoming_cb_t incoming_cb;		///> subscribe only
+	void *incoming_ctx;
+	TickType_t queued_at;						///> tick count when it was queued
+}mqtt_agent_cmd_t;
+
+/**
+ * Agent counters since boot
+ */
+typedef struct mqtt_agent_stats
+{
+	uint32_t enqueued;
+	uint32_t completed;
+	uint32_t failed;
+	uint32_t queue_full;		///> commands rejected because the queue stayed full
+	uint32_t max_depth;			///> highest queue depth seen by a producer
+	uint32_t expired;			///> QoS0 publishes dropped after CONFIG_MQTT_MESSAGE_EXPIRY_MS in the queue
+}mqtt_agent_stats_t;
+
+#if !CONFIG_IDF_TARGET_LINUX
+/**
+ * @fn void mqtt_agent_task_start(void)
+ * @brief start the agent task, it owns the MQTT context and the broker connection. Safe to call again
+ *
+ */
+void mqtt_agent_task_start(void);
+#endif
+
+/**
+ * @fn esp_err_t mqtt_agent_init(void)
+ * @brief create the command queue, mqtt_agent_task_start does it. On the Linux target the benchmark serves the
+ * 			queue itself. Safe to call again
+ *
+ * @return ESP_OK, ESP_ERR_NO_MEM
+ */
+esp_err_t mqtt_agent_init(void);
+
+/**
+ * @fn esp_err_t mqtt_agent_publish(const char*, const void*, size_t, MQTTQoS_t, mqtt_agent_done_cb_t, void*, TickType_t)
+ * @brief queue a publish, topic and payload are copied so the caller's buffers can be reused at once. A topic
+ * 			with an announced alias is published to its alias topic instead
+ *
+ * @param topic topic name
+ * @param payload payload, may be NULL if len is 0
+ * @param len payload length
+ * @param qos MQTTQoS0 or MQTTQoS1
+ * @param done_cb optional completion callback
+ * @param ctx context passed to done_cb
+ * @param wait ticks to wait for room in the queue
+ * @return ESP_OK if queued, ESP_ERR_NO_MEM, ESP_ERR_TIMEOUT if the queue stayed full
+ */
+esp_err_t mqtt_agent_publish(const char *topic, const void *payload, size_t len, MQTTQoS_t qos,
+							 mqtt_agent_done_cb_t done_cb, void *ctx, TickType_t wait);
+
+/**
+ * @fn esp_err_t mqtt_agent_subscribe(const char*, MQTTQoS_t, mqtt_agent_incoming_cb_t, void*, mqtt_agent_done_cb_t, void*, TickType_t)
+ * @brief queue a subscription, it is renewed by the agent whenever the broker lost the session
+ *
+ * @param filter topic filter, wildcards allowed
+ * @param qos maximum QoS requested
+ * @param incoming_cb receives the matching publishes
+ * @param incoming_ctx context passed to incoming_cb
+ * @param done_cb optional completion callback, called once the SUBACK arrived
+ * @param ctx context passed to done_cb
+ * @param wait ticks to wait for room in the queue
+ * @return ESP_OK if queued, ESP_ERR_INVALID_SIZE if the filter is too long, ESP_ERR_NO_MEM, ESP_ERR_TIMEOUT
+ */
+esp_err_t mqtt_agent_subscribe(const char *filter, MQTTQoS_t qos, mqtt_agent_incoming_cb_t incoming_cb, void *incoming_ctx,
+							   mqtt_agent_done_cb_t done_cb, void *ctx, TickType_t wait);
+
+/**
+ * @fn esp_err_t mqtt_agent_unsubscribe(const char*, mqtt_agent_done_cb_t, void*, TickType_t)
+ * @brief queue the removal of a subscription
+ *
+ * @return ESP_OK if queued, ESP_ERR_NO_MEM, ESP_ERR_TIMEOUT
+ */
+esp_err_t mqtt_agent_unsubscribe(const char *filter, mqtt_agent_done_cb_t done_cb, void *ctx, TickType_t wait);
+
+/**
+ * @fn void mqtt_agent_get_stats(mqtt_agent_stats_t*)
+ * @brief get the agent counters
+ *
+ * @param stats output counters
+ */
+void mqtt_agent_get_stats(mqtt_agent_stats_t *stats);
+
+/**
+ * @fn bool mqtt_agent_is_connected(void)
+ * @brief check whether the agent currently serves a broker connection
+ *
+ */
+bool mqtt_agent_is_connected(void);
+
+/**
+ * @fn size_t mqtt_agent_queue_space(void)
+ * @brief free slots in the command queue, lets background producers leave room for live data
+ *
+ */
+size_t mqtt_agent_queue_space(void);
+
+/*
+ * Agent side, only called from the task that owns the MQTT context
+ */
+
+/**
+ * @fn void mqtt_agent_set_connected(bool)
+ * @brief publish the connection state seen by mqtt_agent_is_connected
+ *
+ */
+void mqtt_agent_set_connected(bool connected);
+
+/**
+ * @fn esp_err_t mqtt_agent_cmd_init_publish(mqtt_agent_cmd_t*, const char*, const void*, size_t, MQTTQoS_t, mqtt_agent_done_cb_t, void*)
+ * @brief build a publish command with its own copy of topic and payload
+ *
+ * @return ESP_OK, ESP_ERR_INVALID_ARG, ESP_ERR_NO_MEM
+ */
+esp_err_t mqtt_agent_cmd_init_publish(mqtt_agent_cmd_t *cmd, const char *topic, const void *payload, size_t len, MQTTQoS_t qos,
+									  mqtt_agent_done_cb_t done_cb, void *ctx);
+
+/**
+ * @fn bool mqtt_agent_receive(mqtt_agent_cmd_t*, TickType_t)
+ * @brief take the next queued command. QoS0 publishes that waited longer than CONFIG_MQTT_MESSAGE_EXPIRY_MS
+ * 			are completed with ESP_ERR_TIMEOUT and skipped
+ *
+ * @return true if a command was taken
+ */
+bool mqtt_agent_receive(mqtt_agent_cmd_t *cmd, TickType_t wait);
+
+/**
+ * @fn void mqtt_agent_complete(mqtt_agent_cmd_t*, esp_err_t)
+ * @brief finish a command: update the subscription table, call its completion callback and free it
+ *
+ * @param cmd command to finish, cleared on return
+ * @param result outcome of the command
+ */
+void mqtt_agent_complete(mqtt_agent_cmd_t *cmd, esp_err_t result);
+
+/**
+ * @fn size_t mqtt_agent_get_subscriptions(MQTTSubscribeInfo_t*, size_t, uint16_t*)
+ * @brief list the active subscriptions in chunks, used to renew them after a clean session
+ *
+ * @param list output list, the filters point into the router
+ * @param max room in the list
+ * @param cursor MQTT_ROUTER_NONE for the first chunk, advanced past the subscriptions written
+ * @return number of subscriptions written, 0 once all were listed
+ */
+size_t mqtt_agent_get_subscriptions(MQTTSubscribeInfo_t *list, size_t max, uint16_t *cursor);
+
+/**
+ * @fn bool mqtt_agent_dispatch_incoming(const MQTTPublishInfo_t*)
+ * @brief hand an incoming publish to every subscription whose filter matches, looked up in the topic trie
+ *
+ * @return true if at least one subscription matched
+ */
+bool mqtt_agent_dispatch_incoming(const MQTTPublishInfo_t *publish);
+
+#endif /* MAIN_MQTT_AGENT_H_ */
@@ -0,0 +1,514 @@
+/*
+ * mqtt_agent_bench.c
+ *
+ *  Created on: Oct 19, 2026
+ *      Author: hamxa
+ */
+#include <string.h>
+#include <time.h>
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "esp_log.h"
+#include "sdkconfig.h"
+
+#include "core_mqtt.h"
+#include "clock.h"
+
+#include "dht11.h"
+#include "mqtt_agent.h"
+#include "mqtt_agent_bench.h"
+#include "mqtt_bench.h"
+#include "mqtt_bench_broker.h"
+#include "mqtt_posix_transport.h"
+#include "telemetry_codec.h"
+
+static const char TAG[] = "mqtt_agent_bench";
+
+/**
+ * A producer task and what it saw of the queue
+ */
+typedef struct mqtt_agent_bench_producer
+{
+	MQTTQoS_t qos;
+	uint32_t first;				///> index of its first sample
+	uint32_t messages;
+	uint32_t errors;			///> publishes the queue refused
+	int64_t wait_ns;			///> time spent in mqtt_agent_publish, waiting for room included
+	bool done;
+}mqtt_agent_bench_producer_t;
+
+/**
+ * Completions seen when the connection was last serviced, a run that stops completing has lost the broker
+ */
+typedef struct mqtt_agent_bench_progress
+{
+	uint32_t completed;
+	uint32_t at_ms;
+}mqtt_agent_bench_progress_t;
+
+/**
+ * A QoS1 publish awaiting its PUBACK, the command is completed with it
+ */
+typedef struct mqtt_agent_bench_slot
+{
+	uint16_t packet_id;			///> MQTT_PACKET_ID_INVALID when free
+	mqtt_agent_cmd_t cmd;
+}mqtt_agent_bench_slot_t;
+
+static MQTTContext_t g_context;
+static NetworkContext_t g_network;
+static uint8_t g_buffer[CONFIG_MQTT_NETWORK_BUFFER_SIZE];
+static MQTTPubAckInfo_t g_outgoing_records[CONFIG_MQTT_INFLIGHT_WINDOW];
+static MQTTPubAckInfo_t g_incoming_records[1];
+
+static mqtt_agent_bench_slot_t g_slots[CONFIG_MQTT_INFLIGHT_WINDOW];
+static uint32_t g_in_flight;
+
+//publishes of the run that completed, counted on the serving task
+static uint32_t g_completed;
+static uint32_t g_failed;
+
+static mqtt_agent_bench_producer_t g_producers[MQTT_AGENT_BENCH_MAX_PRODUCERS];
+
+/**
+ * @fn int64_t mqtt_agent_bench_clock_ns(clockid_t)
+ * @brief read a clock in ns
+ *
+ */
+static int64_t mqtt_agent_bench_clock_ns(clockid_t clock)
+{
+	struct timespec ts;
+
+	clock_gettime(clock, &ts);
+	return (int64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+/**
+ * @fn int mqtt_agent_bench_sample(uint32_t, uint8_t*)
+ * @brief encode the i-th sample the telemetry task would publish, one reading every 4 s
+ *
+ * @return payload length, -1 if it did not fit
+ */
+static int mqtt_agent_bench_sample(uint32_t i, uint8_t *payload)
+{
+	telemetry_sample_t sample = {.t_ms = i * 4000, .temperature = 23, .humidity = 45, .rssi = -60, .status = DHT11_OK};
+
+	return telemetry_codec_encode_sample(TELEMETRY_CODEC_CBOR, &sample, payload, TELEMETRY_CODEC_SAMPLE_MAX_LEN);
+}
+
+/**
+ * @fn void mqtt_agent_bench_done(void*, esp_err_t)
+ * @brief completion callback of the queued publishes, runs on the serving task
+ *
+ */
+static void mqtt_agent_bench_done(void *ctx, esp_err_t result)
+{
+	if(result == ESP_OK)
+	{
+		g_completed++;
+	}
+	else
+	{
+		g_failed++;
+	}
+}
+
+/**
+ * @fn void mqtt_agent_bench_event_callback(MQTTContext_t*, MQTTPacketInfo_t*, MQTTDeserializedInfo_t*)
+ * @brief complete the publish of a PUBACK, nothing else is expected
+ *
+ */
+static void mqtt_agent_bench_event_callback(MQTTContext_t *pContext, MQTTPacketInfo_t *pPacketInfo,
+											MQTTDeserializedInfo_t *pDeserializedInfo)
+{
+	if((pPacketInfo->type & 0xf0U) != MQTT_PACKET_TYPE_PUBACK)
+	{
+		return;
+	}
+	for(size_t i = 0; i < CONFIG_MQTT_INFLIGHT_WINDOW; i++)
+	{
+		if(g_slots[i].packet_id != MQTT_PACKET_ID_INVALID && g_slots[i].packet_id == pDeserializedInfo->packetIdentifier)
+		{
+			//a publish sent without the queue has no command to complete
+			if(g_slots[i].cmd.topic != NULL)
+			{
+				mqtt_agent_complete(&g_slots[i].cmd, ESP_OK);
+			}
+			else
+			{
+				g_completed++;
+			}
+			g_slots[i].packet_id = MQTT_PACKET_ID_INVALID;
+			g_in_flight--;
+			return;
+		}
+	}
+}
+
+/**
+ * @fn bool mqtt_agent_bench_connect(const char*, uint16_t)
+ * @brief open the connection and the MQTT session, as the device does but without TLS
+ *
+ */
+static bool mqtt_agent_bench_connect(const char *host, uint16_t port)
+{
+	TransportInterface_t transport = {0};
+	MQTTFixedBuffer_t buffer = {.pBuffer = g_buffer, .size = sizeof(g_buffer)};
+	MQTTConnectInfo_t connect_info = {0};
+	bool session_present = false;
+	MQTTStatus_t status;
+
+	if(!mqtt_posix_transport_connect(&g_network, host, port))
+	{
+		return false;
+	}
+
+	transport.pNetworkContext = &g_network;
+	transport.send = mqtt_posix_transport_send;
+	transport.recv = mqtt_posix_transport_recv;
+#if CONFIG_MQTT_TRANSPORT_WRITEV
+	//packets gathered into one write, as the device gathers them into one TLS record
+	transport.writev = mqtt_posix_transport_writev;
+#else
+	transport.writev = NULL;
+#endif
+
+	status = MQTT_Init(&g_context, &transport, Clock_GetTimeMs, mqtt_agent_bench_event_callback, &buffer);
+	if(status == MQTTSuccess)
+	{
+		status = MQTT_InitStatefulQoS(&g_context, g_outgoing_records, CONFIG_MQTT_INFLIGHT_WINDOW,
+									  g_incoming_records, 1);
+	}
+	if(status != MQTTSuccess)
+	{
+		ESP_LOGE(TAG, "mqtt_agent_bench_connect: init failed, %s", MQTT_Status_strerror(status));
+		mqtt_posix_transport_disconnect(&g_network);
+		return false;
+	}
+
+	connect_info.cleanSession = true;
+	connect_info.pClientIdentifier = CONFIG_MQTT_CLIENT_IDENTIFIER "-agent-bench";
+	connect_info.clientIdentifierLength = (uint16_t)strlen(connect_info.pClientIdentifier);
+	connect_info.keepAliveSeconds = 60;
+
+	status = MQTT_Connect(&g_context, &connect_info, NULL, MQTT_BENCH_ACK_TIMEOUT_MS, &session_present);
+	if(status != MQTTSuccess)
+	{
+		ESP_LOGE(TAG, "mqtt_agent_bench_connect: CONNECT failed, %s", MQTT_Status_strerror(status));
+		mqtt_posix_transport_disconnect(&g_network);
+		return false;
+	}
+	return true;
+}
+
+/**
+ * @fn bool mqtt_agent_bench_publish(mqtt_agent_cmd_t*, const char*, const void*, size_t, MQTTQoS_t)
+ * @brief send one publish into a free slot of the window, a command given is completed on its PUBACK, or at
+ * 			once for QoS0
+ *
+ */
+static bool mqtt_agent_bench_publish(mqtt_agent_cmd_t *cmd, const char *topic, const void *payload, size_t len,
+									 MQTTQoS_t qos)
+{
+	MQTTPublishInfo_t publish_info = {
+			.qos = qos,
+			.pTopicName = topic,
+			.topicNameLength = (uint16_t)strlen(topic),
+			.pPayload = payload,
+			.payloadLength = len,
+	};
+	mqtt_agent_bench_slot_t *slot = NULL;
+	uint16_t packet_id = MQTT_PACKET_ID_INVALID;
+
+	if(qos != MQTTQoS0)
+	{
+		for(size_t i = 0; i < CONFIG_MQTT_INFLIGHT_WINDOW && slot == NULL; i++)
+		{
+			slot = g_slots[i].packet_id == MQTT_PACKET_ID_INVALID ? &g_slots[i] : NULL;
+		}
+		packet_id = MQTT_GetPacketId(&g_context);
+		slot->packet_id = packet_id;
+		if(cmd != NULL)
+		{
+			//the slot takes over the command, the publish info points into its block
+			slot->cmd = *cmd;
+			memset(cmd, 0, sizeof(*cmd));
+		}
+		g_in_flight++;
+	}
+
+	MQTTStatus_t status = MQTT_Publish(&g_context, &publish_info, packet_id);
+	if(status != MQTTSuccess)
+	{
+		ESP_LOGE(TAG, "mqtt_agent_bench_publish: MQTT_Publish failed, %s", MQTT_Status_strerror(status));
+		if(slot != NULL)
+		{
+			mqtt_agent_complete(&slot->cmd, ESP_FAIL);
+			slot->packet_id = MQTT_PACKET_ID_INVALID;
+			g_in_flight--;
+		}
+	}
+	if(qos == MQTTQoS0)
+	{
+		if(cmd != NULL)
+		{
+			mqtt_agent_complete(cmd, status == MQTTSuccess ? ESP_OK : ESP_FAIL);
+		}
+		else if(status == MQTTSuccess)
+		{
+			g_completed++;
+		}
+	}
+	return status == MQTTSuccess;
+}
+
+/**
+ * @fn bool mqtt_agent_bench_process(mqtt_agent_bench_progress_t*)
+ * @brief run MQTT_ProcessLoop once, fail once nothing completed for MQTT_BENCH_ACK_TIMEOUT_MS
+ *
+ */
+static bool mqtt_agent_bench_process(mqtt_agent_bench_progress_t *progress)
+{
+	MQTTStatus_t status = MQTT_ProcessLoop(&g_context);
+
+	if(status != MQTTSuccess && status != MQTTNeedMoreBytes)
+	{
+		ESP_LOGE(TAG, "mqtt_agent_bench_process: MQTT_ProcessLoop failed, %s", MQTT_Status_strerror(status));
+		return false;
+	}
+	if(g_completed + g_failed != progress->completed)
+	{
+		progress->completed = g_completed + g_failed;
+		progress->at_ms = Clock_GetTimeMs();
+	}
+	else if(Clock_GetTimeMs() - progress->at_ms > MQTT_BENCH_ACK_TIMEOUT_MS)
+	{
+		ESP_LOGE(TAG, "mqtt_agent_bench_process: nothing completed for %u ms, %lu of %u, %lu in flight",
+				MQTT_BENCH_ACK_TIMEOUT_MS, (unsigned long)progress->completed, MQTT_AGENT_BENCH_MESSAGES,
+				(unsigned long)g_in_flight);
+		return false;
+	}
+	return true;
+}
+
+/**
+ * @fn void mqtt_agent_bench_producer(void*)
+ * @brief publish the producer's share of the samples through the agent queue, waiting for room as long as needed
+ *
+ */
+static void mqtt_agent_bench_producer(void *pvParameters)
+{
+	mqtt_agent_bench_producer_t *producer = pvParameters;
+	uint8_t payload[TELEMETRY_CODEC_SAMPLE_MAX_LEN];
+
+	for(uint32_t i = producer->first; i < producer->first + producer->messages; i++)
+	{
+		int len = mqtt_agent_bench_sample(i, payload);
+		int64_t start_ns = mqtt_agent_bench_clock_ns(CLOCK_MONOTONIC);
+		esp_err_t err = len < 0 ? ESP_ERR_INVALID_SIZE :
+				mqtt_agent_publish(MQTT_BENCH_TOPIC, payload, (size_t)len, producer->qos, mqtt_agent_bench_done, NULL,
+								   portMAX_DELAY);
+		producer->wait_ns += mqtt_agent_bench_clock_ns(CLOCK_MONOTONIC) - start_ns;
+		if(err != ESP_OK)
+		{
+			producer->errors++;
+		}
+	}
+	__atomic_store_n(&producer->done, true, __ATOMIC_RELEASE);
+	vTaskDelete(NULL);
+}
+
+/**
+ * @fn bool mqtt_agent_bench_serve(void)
+ * @brief serve the agent queue until every queued sample completed: commands are taken while the window has room,
+ * 			the first receive waits MQTT_AGENT_POLL_MS, then the connection is serviced, as the agent task does
+ *
+ */
+static bool mqtt_agent_bench_serve(void)
+{
+	uint32_t expected = MQTT_AGENT_BENCH_MESSAGES;
+	mqtt_agent_cmd_t cmd = {0};
+	mqtt_agent_bench_progress_t progress = {.completed = 0, .at_ms = Clock_GetTimeMs()};
+
+	while(g_completed + g_failed < expected)
+	{
+		TickType_t wait = pdMS_TO_TICKS(MQTT_AGENT_POLL_MS);
+
+		for(;;)
+		{
+			if(cmd.topic == NULL && !mqtt_agent_receive(&cmd, wait))
+			{
+				break;
+			}
+			//hold the command until a PUBACK frees a slot, the producers see the queue fill up
+			if(cmd.qos != MQTTQoS0 && g_in_flight >= CONFIG_MQTT_INFLIGHT_WINDOW)
+			{
+				break;
+			}
+			wait = 0;
+			if(!mqtt_agent_bench_publish(&cmd, cmd.topic, cmd.payload, cmd.payload_len, cmd.qos))
+			{
+				mqtt_agent_complete(&cmd, ESP_FAIL);
+				return false;
+			}
+		}
+		if(!mqtt_agent_bench_process(&progress))
+		{
+			mqtt_agent_complete(&cmd, ESP_FAIL);
+			return false;
+		}
+
+		//a producer that gave up on some samples leaves fewer to complete
+		uint32_t errors = 0;
+		for(size_t p = 0; p < MQTT_AGENT_BENCH_MAX_PRODUCERS; p++)
+		{
+			errors += __atomic_load_n(&g_producers[p].errors, __ATOMIC_RELAXED);
+		}
+		expected = MQTT_AGENT_BENCH_MESSAGES - errors;
+	}
+	return true;
+}
+
+/**
+ * @fn bool mqtt_agent_bench_direct(MQTTQoS_t)
+ * @brief publish every sample from the serving task itself, the baseline without the queue
+ *
+ */
+static bool mqtt_agent_bench_direct(MQTTQoS_t qos)
+{
+	uint8_t payload[TELEMETRY_CODEC_SAMPLE_MAX_LEN];
+	mqtt_agent_bench_progress_t progress = {.completed = 0, .at_ms = Clock_GetTimeMs()};
+
+	for(uint32_t i = 0; i < MQTT_AGENT_BENCH_MESSAGES; i++)
+	{
+		int len = mqtt_agent_bench_sample(i, payload);
+		if(len < 0 || !mqtt_agent_bench_publish(NULL, MQTT_BENCH_TOPIC, payload, (size_t)len, qos))
+		{
+			return false;
+		}
+		while(qos != MQTTQoS0 && g_in_flight >= CONFIG_MQTT_INFLIGHT_WINDOW)
+		{
+			if(!mqtt_agent_bench_process(&progress))
+			{
+				return false;
+			}
+		}
+	}
+	while(g_completed < MQTT_AGENT_BENCH_MESSAGES)
+	{
+		if(!mqtt_agent_bench_process(&progress))
+		{
+			return false;
+		}
+	}
+	return true;
+}
+
+/**
+ * @fn bool mqtt_agent_bench_measure(MQTTQoS_t, uint32_t)
+ * @brief publish the samples from the producers through the queue, or directly for no producers, and log the rate
+ *
+ */
+static bool mqtt_agent_bench_measure(MQTTQoS_t qos, uint32_t producers)
+{
+	int64_t wait_ns = 0;
+	uint32_t errors = 0;
+	bool ok;
+
+	g_completed = 0;
+	g_failed = 0;
+	g_in_flight = 0;
+	memset(g_producers, 0, sizeof(g_producers));
+
+	int64_t start_ns = mqtt_agent_bench_clock_ns(CLOCK_MONOTONIC);
+	int64_t start_cpu_ns = mqtt_agent_bench_clock_ns(CLOCK_THREAD_CPUTIME_ID);
+	if(producers == 0)
+	{
+		ok = mqtt_agent_bench_direct(qos);
+	}
+	else
+	{
+		for(uint32_t p = 0; p < producers; p++)
+		{
+			g_producers[p].qos = qos;
+			g_producers[p].first = p * (MQTT_AGENT_BENCH_MESSAGES / producers);
+			g_producers[p].messages = p + 1 < producers ? MQTT_AGENT_BENCH_MESSAGES / producers :
+					MQTT_AGENT_BENCH_MESSAGES - g_producers[p].first;
+			if(xTaskCreate(&mqtt_agent_bench_producer, "agent_bench", MQTT_AGENT_BENCH_STACK_SIZE, &g_producers[p],
+						   uxTaskPriorityGet(NULL), NULL) != pdPASS)
+			{
+				ESP_LOGE(TAG, "mqtt_agent_bench_measure: producer task not created");
+				g_producers[p].errors = g_producers[p].messages;
+				g_producers[p].done = true;
+			}
+		}
+		ok = mqtt_agent_bench_serve();
+
+		//a producer may still be on its way out of its last publish
+		for(uint32_t p = 0; p < producers; p++)
+		{
+			while(ok && !__atomic_load_n(&g_producers[p].done, __ATOMIC_ACQUIRE))
+			{
+				vTaskDelay(1);
+			}
+			wait_ns += g_producers[p].wait_ns;
+			errors += g_producers[p].errors;
+		}
+	}
+	int64_t elapsed_ns = mqtt_agent_bench_clock_ns(CLOCK_MONOTONIC) - start_ns;
+	int64_t cpu_ns = mqtt_agent_bench_clock_ns(CLOCK_THREAD_CPUTIME_ID) - start_cpu_ns;
+
+	ok = ok && errors == 0 && g_failed == 0 && g_completed == MQTT_AGENT_BENCH_MESSAGES;
+	if(producers == 0)
+	{
+		ESP_LOGI(TAG, "QoS%d, direct: %s, %llu publishes/s, %lld ns CPU per message", (int)qos, ok ? "PASS" : "FAIL",
+				(unsigned long long)((uint64_t)g_completed * 1000000000 / (elapsed_ns ? elapsed_ns : 1)),
+				(long long)(cpu_ns / MQTT_AGENT_BENCH_MESSAGES));
+	}
+	else
+	{
+		ESP_LOGI(TAG, "QoS%d, %lu producers: %s, %llu publishes/s, %lld ns CPU per message on the agent, "
+				"%lld ns per queued publish in the producers, %lu failed, %lu refused", (int)qos,
+				(unsigned long)producers, ok ? "PASS" : "FAIL",
+				(unsigned long long)((uint64_t)g_completed * 1000000000 / (elapsed_ns ? elapsed_ns : 1)),
+				(long long)(cpu_ns / MQTT_AGENT_BENCH_MESSAGES), (long long)(wait_ns / MQTT_AGENT_BENCH_MESSAGES),
+				(unsigned long)g_failed, (unsigned long)errors);
+	}
+	return ok;
+}
+
+bool mqtt_agent_bench_run(void)
+{
+	static const uint32_t producers[] = MQTT_AGENT_BENCH_PRODUCERS;
+	static const MQTTQoS_t qos[] = {MQTTQoS0, MQTTQoS1};
+	mqtt_agent_stats_t stats;
+	uint16_t port = 0;
+	bool ok;
+
+	if(mqtt_agent_init() != ESP_OK || !mqtt_bench_broker_start(&port))
+	{
+		return false;
+	}
+	ok = mqtt_agent_bench_connect("127.0.0.1", port);
+	for(size_t q = 0; ok && q < sizeof(qos) / sizeof(qos[0]); q++)
+	{
+		ok = mqtt_agent_bench_measure(qos[q], 0);
+		for(size_t p = 0; ok && p < sizeof(producers) / sizeof(producers[0]); p++)
+		{
+			ok = mqtt_agent_bench_measure(qos[q], producers[p]);
+		}
+	}
+	if(ok)
+	{
+		MQTT_Disconnect(&g_context);
+	}
+	mqtt_posix_transport_disconnect(&g_network);
+	mqtt_bench_broker_stop();
+
+	mqtt_agent_get_stats(&stats);
+	ESP_LOGI(TAG, "mqtt_agent_bench_run: %lu queued, %lu completed, %lu failed, deepest queue %lu of %u",
+			(unsigned long)stats.enqueued, (unsigned long)stats.completed, (unsigned long)stats.failed,
+			(unsigned long)stats.max_depth, MQTT_AGENT_QUEUE_LENGTH);
+	return ok;
+}
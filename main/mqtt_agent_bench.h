@@ -0,0 +1,36 @@
+/*
+ * mqtt_agent_bench.h
+ *
+ *  Created on: Oct 19, 2026
+ *      Author: hamxa
+ */
+
+#ifndef MAIN_MQTT_AGENT_BENCH_H_
+#define MAIN_MQTT_AGENT_BENCH_H_
+
+#include <stdbool.h>
+
+//Samples published per run, split evenly between the producers
+#define MQTT_AGENT_BENCH_MESSAGES		20000
+
+//Producer task counts of the runs through the agent queue
+#define MQTT_AGENT_BENCH_PRODUCERS		{ 1, 2, 4 }
+
+//Largest producer count above, the tasks are created per run
+#define MQTT_AGENT_BENCH_MAX_PRODUCERS	4
+
+#define MQTT_AGENT_BENCH_STACK_SIZE		4096
+
+/**
+ * @fn bool mqtt_agent_bench_run(void)
+ * @brief start the in-process broker and serve the agent queue on the calling task, as the agent task does on
+ * 			the device, with the in-flight window of MQTT_INFLIGHT_WINDOW. Publishes MQTT_AGENT_BENCH_MESSAGES
+ * 			telemetry samples at QoS0 and QoS1 from one, two and four producer tasks through the queue, and the
+ * 			same samples from the serving task itself without the queue. Logs the sustained publishes per second,
+ * 			the CPU time of the serving task per message and the time producers waited for room in the queue
+ *
+ * @return true if every publish completed without an error
+ */
+bool mqtt_agent_bench_run(void);
+
+#endif /* MAIN_MQTT_AGENT_BENCH_H_ */
@@ -0,0 +1,152 @@
+/*
+ * mqtt_batch.c
+ *
+ *  Created on: Oct 18, 2026
+ *      Author: hamxa
+ */
+#include <string.h>
+
+#include "cbor_writer.h"
+#include "mqtt_batch.h"
+
+/**
+ * @fn size_t mqtt_batch_separator(const mqtt_batch_t*)
+ * @brief bytes between the last sample and the next one, CBOR items need none
+ *
+ */
+static size_t mqtt_batch_separator(const mqtt_batch_t *batch)
+{
+	return batch->codec == TELEMETRY_CODEC_JSON && batch->count ? 1 : 0;
+}
+
+void mqtt_batch_init(mqtt_batch_t *batch, telemetry_codec_e codec, uint16_t min_samples, uint16_t max_samples,
+					 uint32_t max_age_ms)
+{
+	memset(batch, 0, sizeof(*batch));
+	batch->codec = codec;
+	batch->min_samples = min_samples ? min_samples : 1;
+	batch->max_samples = max_samples < batch->min_samples ? batch->min_samples : max_samples;
+	batch->max_age_ms = max_age_ms;
+	batch->target = batch->min_samples;
+	batch->payload[0] = codec == TELEMETRY_CODEC_CBOR ? (char)CBOR_ARRAY_INDEFINITE : '[';
+	batch->len = 1;
+}
+
+char *mqtt_batch_reserve(mqtt_batch_t *batch, size_t *room)
+{
+	size_t start = batch->len + mqtt_batch_separator(batch);
+
+	//keep a byte for the closing bracket or break
+	*room = start + 1 < sizeof(batch->payload) ? sizeof(batch->payload) - start - 1 : 0;
+	return &batch->payload[start];
+}
+
+void mqtt_batch_commit(mqtt_batch_t *batch, size_t len, int64_t now_us)
+{
+	if(mqtt_batch_separator(batch))
+	{
+		batch->payload[batch->len++] = ',';
+	}
+	if(batch->count == 0)
+	{
+		batch->first_us = now_us;
+	}
+	batch->len += len;
+	batch->count++;
+}
+
+bool mqtt_batch_add(mqtt_batch_t *batch, const char *sample, size_t len, int64_t now_us)
+{
+	size_t room;
+	char *tail = mqtt_batch_reserve(batch, &room);
+
+	if(len > room)
+	{
+		return false;
+	}
+	memcpy(tail, sample, len);
+	mqtt_batch_commit(batch, len, now_us);
+	return true;
+}
+
+bool mqtt_batch_ready(const mqtt_batch_t *batch, int64_t now_us)
+{
+	return batch->count >= batch->target ||
+		   (batch->count > 0 && now_us - batch->first_us >= (int64_t)batch->max_age_ms * 1000);
+}
+
+const char *mqtt_batch_finish(mqtt_batch_t *batch, size_t *len)
+{
+	if(batch->count == 0)
+	{
+		return NULL;
+	}
+	batch->payload[batch->len] = batch->codec == TELEMETRY_CODEC_CBOR ? (char)CBOR_BREAK : ']';
+	*len = batch->len + 1;
+	return batch->payload;
+}
+
+void mqtt_batch_sent(mqtt_batch_t *batch, bool queued)
+{
+	if(queued)
+	{
+		batch->stats.samples += batch->count;
+		batch->stats.batches++;
+		batch->stats.payload_bytes += batch->len + 1;
+	}
+	else
+	{
+		batch->stats.rejected++;
+	}
+	batch->count = 0;
+	batch->len = 1;
+}
+
+void mqtt_batch_result(void *ctx, esp_err_t result)
+{
+	mqtt_batch_t *batch = ctx;
+
+	if(result == ESP_OK)
+	{
+		__atomic_add_fetch(&batch->stats.acked, 1, __ATOMIC_RELAXED);
+	}
+	else
+	{
+		__atomic_add_fetch(&batch->stats.failed, 1, __ATOMIC_RELAXED);
+	}
+}
+
+void mqtt_batch_adapt(mqtt_batch_t *batch, int8_t rssi, bool congested)
+{
+	uint32_t acked = __atomic_load_n(&batch->stats.acked, __ATOMIC_RELAXED);
+	uint32_t failed = __atomic_load_n(&batch->stats.failed, __ATOMIC_RELAXED);
+	bool failing = failed != batch->seen_failed || batch->stats.rejected != batch->seen_rejected;
+
+	//a weak, lossy or congested link pays the framing and retransmission per message, send fewer larger ones
+	if(failing || congested || rssi < MQTT_BATCH_WEAK_RSSI)
+	{
+		uint32_t target = (uint32_t)batch->target * 2;
+		batch->target = target > batch->max_samples ? batch->max_samples : (uint16_t)target;
+		batch->streak = 0;
+	}
+	else if(acked != batch->seen_acked)
+	{
+		batch->streak += acked - batch->seen_acked;
+		if(batch->streak >= MQTT_BATCH_SHRINK_STREAK && batch->target > batch->min_samples)
+		{
+			batch->target--;
+			batch->streak = 0;
+		}
+	}
+	batch->seen_acked = acked;
+	batch->seen_failed = failed;
+	batch->seen_rejected = batch->stats.rejected;
+}
+
+void mqtt_batch_get_stats(const mqtt_batch_t *batch, mqtt_batch_stats_t *stats)
+{
+	*stats = batch->stats;
+	stats->acked = __atomic_load_n(&batch->stats.acked, __ATOMIC_RELAXED);
+	stats->failed = __atomic_load_n(&batch->stats.failed, __ATOMIC_RELAXED);
+	stats->target = batch->target;
+}
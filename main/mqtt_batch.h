@@ -0,0 +1,161 @@
+/*
+ * mqtt_batch.h
+ *
+ *  Created on: Oct 18, 2026
+ *      Author: hamxa
+ */
+
+#ifndef MAIN_MQTT_BATCH_H_
+#define MAIN_MQTT_BATCH_H_
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "esp_err.h"
+#include "sdkconfig.h"
+#include "telemetry_codec.h"
+
+//Room left in the network buffer for the PUBLISH fixed header, topic and packet id
+#define MQTT_BATCH_HEADER_ROOM			128
+
+//Largest batch payload, a whole PUBLISH fits in the MQTT network buffer
+#define MQTT_BATCH_MAX_PAYLOAD			(CONFIG_MQTT_NETWORK_BUFFER_SIZE - MQTT_BATCH_HEADER_ROOM)
+
+//RSSI below which the link is treated as weak and batches are grown
+#define MQTT_BATCH_WEAK_RSSI			-75
+
+//Acknowledged batches in a row on a good link before the batch size is reduced by one
+#define MQTT_BATCH_SHRINK_STREAK		4
+
+/**
+ * Batching counters since boot
+ */
+typedef struct mqtt_batch_stats
+{
+	uint32_t samples;				///> samples handed to the agent in batches
+	uint32_t batches;				///> batches handed to the agent
+	uint32_t rejected;				///> batches the agent queue did not take
+	uint32_t acked;					///> batches completed by the broker, PUBACKs for QoS1
+	uint32_t failed;				///> batches the agent failed after queuing them
+	uint64_t payload_bytes;			///> payload bytes of the batches handed to the agent
+	uint16_t target;				///> samples per batch currently aimed for
+}mqtt_batch_stats_t;
+
+/**
+ * JSON or CBOR array of samples collected for one PUBLISH, owned by one task
+ */
+typedef struct mqtt_batch
+{
+	char payload[MQTT_BATCH_MAX_PAYLOAD];
+	size_t len;
+	telemetry_codec_e codec;
+	uint16_t count;
+	uint16_t target;
+	uint16_t min_samples;
+	uint16_t max_samples;
+	uint32_t max_age_ms;
+	int64_t first_us;				///> time the oldest sample of the batch was added
+	uint32_t seen_acked;			///> acked, failed and rejected counts at the last adaptation
+	uint32_t seen_failed;
+	uint32_t seen_rejected;
+	uint16_t streak;
+	mqtt_batch_stats_t stats;
+}mqtt_batch_t;
+
+/**
+ * @fn void mqtt_batch_init(mqtt_batch_t*, telemetry_codec_e, uint16_t, uint16_t, uint32_t)
+ * @brief set up an empty batch
+ *
+ * @param batch batch to set up
+ * @param codec encoding of the samples, a JSON array or an indefinite length CBOR array
+ * @param min_samples batch size used on a good link
+ * @param max_samples batch size used on a weak or failing link
+ * @param max_age_ms a batch is sent once its oldest sample is this old, whatever its size
+ */
+void mqtt_batch_init(mqtt_batch_t *batch, telemetry_codec_e codec, uint16_t min_samples, uint16_t max_samples, uint32_t max_age_ms);
+
+/**
+ * @fn char mqtt_batch_reserve*(mqtt_batch_t*, size_t*)
+ * @brief get the room for the next sample, so it can be encoded straight into the payload
+ *
+ * @param batch batch to append to
+ * @param room bytes the next sample may take
+ * @return where the next sample goes, committed with mqtt_batch_commit
+ */
+char *mqtt_batch_reserve(mqtt_batch_t *batch, size_t *room);
+
+/**
+ * @fn void mqtt_batch_commit(mqtt_batch_t*, size_t, int64_t)
+ * @brief append the sample encoded at mqtt_batch_reserve
+ *
+ * @param batch batch to append to
+ * @param len length of the sample, at most the room reserved
+ * @param now_us current time
+ */
+void mqtt_batch_commit(mqtt_batch_t *batch, size_t len, int64_t now_us);
+
+/**
+ * @fn bool mqtt_batch_add(mqtt_batch_t*, const char*, size_t, int64_t)
+ * @brief append one encoded sample to the batch
+ *
+ * @param batch batch to append to
+ * @param sample encoded sample, in the codec of the batch
+ * @param len length of the sample
+ * @param now_us current time
+ * @return false if the sample does not fit, send the batch and add it again
+ */
+bool mqtt_batch_add(mqtt_batch_t *batch, const char *sample, size_t len, int64_t now_us);
+
+/**
+ * @fn bool mqtt_batch_ready(const mqtt_batch_t*, int64_t)
+ * @brief check whether the batch reached its target size or age
+ *
+ */
+bool mqtt_batch_ready(const mqtt_batch_t *batch, int64_t now_us);
+
+/**
+ * @fn const char mqtt_batch_finish*(mqtt_batch_t*, size_t*)
+ * @brief close the array
+ *
+ * @param batch batch to close
+ * @param len output payload length
+ * @return the payload, NULL if the batch is empty
+ */
+const char *mqtt_batch_finish(mqtt_batch_t *batch, size_t *len);
+
+/**
+ * @fn void mqtt_batch_sent(mqtt_batch_t*, bool)
+ * @brief account for the finished batch and start a new one
+ *
+ * @param batch the batch
+ * @param queued whether the agent took the batch
+ */
+void mqtt_batch_sent(mqtt_batch_t *batch, bool queued);
+
+/**
+ * @fn void mqtt_batch_result(void*, esp_err_t)
+ * @brief MQTT agent completion callback of a batch publish, ctx is the batch. Safe from the agent task
+ *
+ */
+void mqtt_batch_result(void *ctx, esp_err_t result);
+
+/**
+ * @fn void mqtt_batch_adapt(mqtt_batch_t*, int8_t, bool)
+ * @brief adjust the target batch size to the link: doubled on failures, weak RSSI or congestion, reduced by one after
+ * a run of acks
+ *
+ * @param batch the batch
+ * @param rssi current Wi-Fi RSSI
+ * @param congested publishes back up in the MQTT agent queue, the link takes fewer than are queued
+ */
+void mqtt_batch_adapt(mqtt_batch_t *batch, int8_t rssi, bool congested);
+
+/**
+ * @fn void mqtt_batch_get_stats(const mqtt_batch_t*, mqtt_batch_stats_t*)
+ * @brief get the batching counters
+ *
+ */
+void mqtt_batch_get_stats(const mqtt_batch_t *batch, mqtt_batch_stats_t *stats);
+
+#endif /* MAIN_MQTT_BATCH_H_ */
@@ -0,0 +1,284 @@
+/*
+ * mqtt_batch_bench.c
+ *
+ *  Created on: Oct 19, 2026
+ *      Author: hamxa
+ */
+#include <string.h>
+#include <time.h>
+
+#include "esp_log.h"
+#include "sdkconfig.h"
+
+#include "core_mqtt.h"
+#include "clock.h"
+
+#include "dht11.h"
+#include "mqtt_batch.h"
+#include "mqtt_batch_bench.h"
+#include "mqtt_bench.h"
+#include "mqtt_bench_broker.h"
+#include "mqtt_posix_transport.h"
+#include "telemetry_codec.h"
+
+static const char TAG[] = "mqtt_batch_bench";
+
+static MQTTContext_t g_context;
+static NetworkContext_t g_network;
+static uint8_t g_buffer[CONFIG_MQTT_NETWORK_BUFFER_SIZE];
+static MQTTPubAckInfo_t g_outgoing_records[CONFIG_MQTT_INFLIGHT_WINDOW];
+static MQTTPubAckInfo_t g_incoming_records[1];
+
+//too large for the stack of the main task
+static mqtt_batch_t g_batch;
+static uint32_t g_in_flight;
+
+/**
+ * @fn int64_t mqtt_batch_bench_clock_ns(clockid_t)
+ * @brief read a clock in ns
+ *
+ */
+static int64_t mqtt_batch_bench_clock_ns(clockid_t clock)
+{
+	struct timespec ts;
+
+	clock_gettime(clock, &ts);
+	return (int64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+/**
+ * @fn void mqtt_batch_bench_event_callback(MQTTContext_t*, MQTTPacketInfo_t*, MQTTDeserializedInfo_t*)
+ * @brief complete the batch of a PUBACK, as the agent does, nothing else is expected
+ *
+ */
+static void mqtt_batch_bench_event_callback(MQTTContext_t *pContext, MQTTPacketInfo_t *pPacketInfo,
+											MQTTDeserializedInfo_t *pDeserializedInfo)
+{
+	if((pPacketInfo->type & 0xf0U) != MQTT_PACKET_TYPE_PUBACK)
+	{
+		return;
+	}
+	mqtt_batch_result(&g_batch, ESP_OK);
+	g_in_flight--;
+}
+
+/**
+ * @fn bool mqtt_batch_bench_connect(const char*, uint16_t)
+ * @brief open the connection and the MQTT session, as the device does but without TLS
+ *
+ */
+static bool mqtt_batch_bench_connect(const char *host, uint16_t port)
+{
+	TransportInterface_t transport = {0};
+	MQTTFixedBuffer_t buffer = {.pBuffer = g_buffer, .size = sizeof(g_buffer)};
+	MQTTConnectInfo_t connect_info = {0};
+	bool session_present = false;
+	MQTTStatus_t status;
+
+	if(!mqtt_posix_transport_connect(&g_network, host, port))
+	{
+		return false;
+	}
+
+	transport.pNetworkContext = &g_network;
+	transport.send = mqtt_posix_transport_send;
+	transport.recv = mqtt_posix_transport_recv;
+#if CONFIG_MQTT_TRANSPORT_WRITEV
+	//packets gathered into one write, as the device gathers them into one TLS record
+	transport.writev = mqtt_posix_transport_writev;
+#else
+	transport.writev = NULL;
+#endif
+
+	status = MQTT_Init(&g_context, &transport, Clock_GetTimeMs, mqtt_batch_bench_event_callback, &buffer);
+	if(status == MQTTSuccess)
+	{
+		status = MQTT_InitStatefulQoS(&g_context, g_outgoing_records, CONFIG_MQTT_INFLIGHT_WINDOW,
+									  g_incoming_records, 1);
+	}
+	if(status != MQTTSuccess)
+	{
+		ESP_LOGE(TAG, "mqtt_batch_bench_connect: init failed, %s", MQTT_Status_strerror(status));
+		mqtt_posix_transport_disconnect(&g_network);
+		return false;
+	}
+
+	connect_info.cleanSession = true;
+	connect_info.pClientIdentifier = CONFIG_MQTT_CLIENT_IDENTIFIER "-batch-bench";
+	connect_info.clientIdentifierLength = (uint16_t)strlen(connect_info.pClientIdentifier);
+	connect_info.keepAliveSeconds = 60;
+
+	status = MQTT_Connect(&g_context, &connect_info, NULL, MQTT_BENCH_ACK_TIMEOUT_MS, &session_present);
+	if(status != MQTTSuccess)
+	{
+		ESP_LOGE(TAG, "mqtt_batch_bench_connect: CONNECT failed, %s", MQTT_Status_strerror(status));
+		mqtt_posix_transport_disconnect(&g_network);
+		return false;
+	}
+	return true;
+}
+
+/**
+ * @fn bool mqtt_batch_bench_wait_acks(uint32_t)
+ * @brief run MQTT_ProcessLoop until no more than in_flight batches await their PUBACK
+ *
+ */
+static bool mqtt_batch_bench_wait_acks(uint32_t in_flight)
+{
+	uint32_t start_ms = Clock_GetTimeMs();
+
+	while(g_in_flight > in_flight)
+	{
+		uint32_t waiting = g_in_flight;
+		MQTTStatus_t status = MQTT_ProcessLoop(&g_context);
+		if(status != MQTTSuccess && status != MQTTNeedMoreBytes)
+		{
+			ESP_LOGE(TAG, "mqtt_batch_bench_wait_acks: MQTT_ProcessLoop failed, %s", MQTT_Status_strerror(status));
+			return false;
+		}
+		if(g_in_flight != waiting)
+		{
+			start_ms = Clock_GetTimeMs();
+		}
+		else if(Clock_GetTimeMs() - start_ms > MQTT_BENCH_ACK_TIMEOUT_MS)
+		{
+			ESP_LOGE(TAG, "mqtt_batch_bench_wait_acks: no PUBACK for %u ms, %lu in flight", MQTT_BENCH_ACK_TIMEOUT_MS,
+					(unsigned long)g_in_flight);
+			return false;
+		}
+	}
+	return true;
+}
+
+/**
+ * @fn bool mqtt_batch_bench_send(void)
+ * @brief publish the batch at QoS1 and start the next one, waiting for a PUBACK once the window is full
+ *
+ */
+static bool mqtt_batch_bench_send(void)
+{
+	MQTTPublishInfo_t publish_info = {
+			.qos = MQTTQoS1,
+			.pTopicName = MQTT_BENCH_TOPIC "/batch",
+			.topicNameLength = (uint16_t)strlen(MQTT_BENCH_TOPIC "/batch"),
+	};
+	size_t len = 0;
+
+	publish_info.pPayload = mqtt_batch_finish(&g_batch, &len);
+	publish_info.payloadLength = len;
+	if(publish_info.pPayload == NULL)
+	{
+		return true;
+	}
+
+	g_in_flight++;
+	MQTTStatus_t status = MQTT_Publish(&g_context, &publish_info, MQTT_GetPacketId(&g_context));
+	mqtt_batch_sent(&g_batch, status == MQTTSuccess);
+	if(status != MQTTSuccess)
+	{
+		ESP_LOGE(TAG, "mqtt_batch_bench_send: MQTT_Publish failed, %s", MQTT_Status_strerror(status));
+		return false;
+	}
+	return g_in_flight < CONFIG_MQTT_INFLIGHT_WINDOW || mqtt_batch_bench_wait_acks(CONFIG_MQTT_INFLIGHT_WINDOW - 1);
+}
+
+/**
+ * @fn bool mqtt_batch_bench_measure(telemetry_codec_e, uint16_t)
+ * @brief publish the samples in batches of one size and log their cost per sample
+ *
+ */
+static bool mqtt_batch_bench_measure(telemetry_codec_e codec, uint16_t size)
+{
+	telemetry_sample_t sample = {.t_ms = 0, .temperature = 23, .humidity = 45, .rssi = -60, .status = DHT11_OK};
+	uint8_t encoded[TELEMETRY_CODEC_SAMPLE_MAX_LEN];
+	mqtt_bench_broker_stats_t before, after;
+	mqtt_batch_stats_t stats;
+	uint64_t bytes_sent = g_network.bytes_sent;
+	uint64_t bytes_received = g_network.bytes_received;
+	bool ok = true;
+
+	//a fixed size, the adaptation is left to the telemetry task
+	mqtt_batch_init(&g_batch, codec, size, size, UINT32_MAX);
+	g_in_flight = 0;
+	mqtt_bench_broker_get_stats(&before);
+
+	int64_t start_ns = mqtt_batch_bench_clock_ns(CLOCK_MONOTONIC);
+	int64_t start_cpu_ns = mqtt_batch_bench_clock_ns(CLOCK_THREAD_CPUTIME_ID);
+	for(uint32_t i = 0; ok && i < MQTT_BATCH_BENCH_SAMPLES; i++)
+	{
+		//the samples the telemetry task batches, one reading every 4 s
+		sample.t_ms = i * 4000;
+		sample.temperature = 20 + (int)(i % 8);
+		int len = telemetry_codec_encode_sample(codec, &sample, encoded, sizeof(encoded));
+		if(len < 0)
+		{
+			ok = false;
+			break;
+		}
+		//a batch full before its size goes out early, as in the telemetry task
+		if(!mqtt_batch_add(&g_batch, (const char*)encoded, (size_t)len, 0))
+		{
+			ok = mqtt_batch_bench_send() && mqtt_batch_add(&g_batch, (const char*)encoded, (size_t)len, 0);
+		}
+		if(ok && mqtt_batch_ready(&g_batch, 0))
+		{
+			ok = mqtt_batch_bench_send();
+		}
+	}
+	ok = ok && mqtt_batch_bench_send() && mqtt_batch_bench_wait_acks(0);
+	int64_t elapsed_ns = mqtt_batch_bench_clock_ns(CLOCK_MONOTONIC) - start_ns;
+	int64_t cpu_ns = mqtt_batch_bench_clock_ns(CLOCK_THREAD_CPUTIME_ID) - start_cpu_ns;
+
+	mqtt_bench_broker_get_stats(&after);
+	mqtt_batch_get_stats(&g_batch, &stats);
+	uint32_t pubacks = after.pubacks - before.pubacks;
+	uint64_t payload_bytes = after.payload_bytes - before.payload_bytes;
+	ok = ok && stats.samples == MQTT_BATCH_BENCH_SAMPLES && stats.acked == stats.batches && stats.failed == 0 &&
+			pubacks == stats.batches && payload_bytes == stats.payload_bytes;
+
+	ESP_LOGI(TAG, "%s, batches of %u: %s, %lu.%02lu samples per PUBLISH, %llu.%02llu payload bytes, %llu.%02llu bytes "
+			"sent and %llu.%02llu received per sample, %lu PUBACKs, %llu samples/s, %lld ns CPU per sample",
+			codec == TELEMETRY_CODEC_CBOR ? "CBOR" : "JSON", (unsigned)size, ok ? "PASS" : "FAIL",
+			(unsigned long)(stats.batches ? stats.samples / stats.batches : 0),
+			(unsigned long)(stats.batches ? stats.samples * 100 / stats.batches % 100 : 0),
+			(unsigned long long)(stats.payload_bytes / MQTT_BATCH_BENCH_SAMPLES),
+			(unsigned long long)(stats.payload_bytes * 100 / MQTT_BATCH_BENCH_SAMPLES % 100),
+			(unsigned long long)((g_network.bytes_sent - bytes_sent) / MQTT_BATCH_BENCH_SAMPLES),
+			(unsigned long long)((g_network.bytes_sent - bytes_sent) * 100 / MQTT_BATCH_BENCH_SAMPLES % 100),
+			(unsigned long long)((g_network.bytes_received - bytes_received) / MQTT_BATCH_BENCH_SAMPLES),
+			(unsigned long long)((g_network.bytes_received - bytes_received) * 100 / MQTT_BATCH_BENCH_SAMPLES % 100),
+			(unsigned long)pubacks,
+			(unsigned long long)((uint64_t)MQTT_BATCH_BENCH_SAMPLES * 1000000000 / (elapsed_ns ? elapsed_ns : 1)),
+			(long long)(cpu_ns / MQTT_BATCH_BENCH_SAMPLES));
+	return ok;
+}
+
+bool mqtt_batch_bench_run(void)
+{
+	static const uint16_t sizes[] = MQTT_BATCH_BENCH_SIZES;
+	static const telemetry_codec_e codecs[] = {TELEMETRY_CODEC_JSON, TELEMETRY_CODEC_CBOR};
+	uint16_t port = 0;
+	bool ok;
+
+	if(!mqtt_bench_broker_start(&port))
+	{
+		return false;
+	}
+	ok = mqtt_batch_bench_connect("127.0.0.1", port);
+	ESP_LOGI(TAG, "mqtt_batch_bench_run: %u samples per run, batch payloads up to %u bytes, %u in flight",
+			MQTT_BATCH_BENCH_SAMPLES, (unsigned)MQTT_BATCH_MAX_PAYLOAD, CONFIG_MQTT_INFLIGHT_WINDOW);
+	for(size_t c = 0; ok && c < sizeof(codecs) / sizeof(codecs[0]); c++)
+	{
+		for(size_t s = 0; ok && s < sizeof(sizes) / sizeof(sizes[0]); s++)
+		{
+			ok = mqtt_batch_bench_measure(codecs[c], sizes[s]);
+		}
+	}
+	if(ok)
+	{
+		MQTT_Disconnect(&g_context);
+	}
+	mqtt_posix_transport_disconnect(&g_network);
+	mqtt_bench_broker_stop();
+	return ok;
+}
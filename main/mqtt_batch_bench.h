@@ -0,0 +1,30 @@
+/*
+ * mqtt_batch_bench.h
+ *
+ *  Created on: Oct 19, 2026
+ *      Author: hamxa
+ */
+
+#ifndef MAIN_MQTT_BATCH_BENCH_H_
+#define MAIN_MQTT_BATCH_BENCH_H_
+
+#include <stdbool.h>
+
+//Samples published per run, a multiple of every batch size
+#define MQTT_BATCH_BENCH_SAMPLES		9600
+
+//Samples per batch of the runs, the larger ones are cut short by MQTT_BATCH_MAX_PAYLOAD
+#define MQTT_BATCH_BENCH_SIZES			{ 1, 2, 4, 8, 16, 32 }
+
+/**
+ * @fn bool mqtt_batch_bench_run(void)
+ * @brief publish MQTT_BATCH_BENCH_SAMPLES telemetry samples at QoS1 with the in-flight window to the in-process
+ * 			broker, in JSON and CBOR batches of each size, as the telemetry task batches them. Logs the samples
+ * 			per PUBLISH, the payload and wire bytes sent and received per sample, the PUBACKs per sample, the
+ * 			samples per second and the CPU time per sample
+ *
+ * @return true if every batch was acked and the broker received every payload byte
+ */
+bool mqtt_batch_bench_run(void);
+
+#endif /* MAIN_MQTT_BATCH_BENCH_H_ */
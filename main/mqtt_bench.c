@@ -0,0 +1,369 @@
+/*
+ * mqtt_bench.c
+ *
+ *  Created on: Oct 18, 2026
+ *      Author: hamxa
+ */
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "esp_log.h"
+#include "sdkconfig.h"
+
+#include "core_mqtt.h"
+#include "clock.h"
+
+#include "dht11.h"
+#include "mqtt_bench.h"
+#include "mqtt_bench_broker.h"
+#include "mqtt_posix_transport.h"
+#include "mqtt_topic_alias.h"
+#include "telemetry.h"
+#include "telemetry_codec.h"
+
+static const char TAG[] = "mqtt_bench";
+
+/**
+ * One measured run
+ */
+typedef struct mqtt_bench_result
+{
+	uint32_t messages;
+	int64_t elapsed_ns;
+	int64_t cpu_ns;				///> CPU time of the client thread, serialization, coreMQTT state and socket calls
+	uint64_t bytes_sent;
+	uint32_t writes;
+}mqtt_bench_result_t;
+
+static MQTTContext_t g_context;
+static NetworkContext_t g_network;
+static uint8_t g_buffer[CONFIG_MQTT_NETWORK_BUFFER_SIZE];
+static MQTTPubAckInfo_t g_outgoing_records[CONFIG_MQTT_INFLIGHT_WINDOW];
+static MQTTPubAckInfo_t g_incoming_records[1];
+
+//send time of each publish awaiting its PUBACK, by packet id
+static int64_t g_sent_ns[MQTT_BENCH_ID_SLOTS];
+
+//PUBACK latency of every acked publish of the run, sorted for the percentiles
+static uint32_t g_latency_us[CONFIG_MQTT_BENCH_MESSAGES];
+static uint32_t g_acked;
+static uint32_t g_in_flight;
+
+/**
+ * @fn int64_t mqtt_bench_clock_ns(clockid_t)
+ * @brief read a clock in ns
+ *
+ */
+static int64_t mqtt_bench_clock_ns(clockid_t clock)
+{
+	struct timespec ts;
+
+	clock_gettime(clock, &ts);
+	return (int64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+/**
+ * @fn void mqtt_bench_event_callback(MQTTContext_t*, MQTTPacketInfo_t*, MQTTDeserializedInfo_t*)
+ * @brief time the PUBACKs, nothing else is expected
+ *
+ */
+static void mqtt_bench_event_callback(MQTTContext_t *pContext, MQTTPacketInfo_t *pPacketInfo,
+									  MQTTDeserializedInfo_t *pDeserializedInfo)
+{
+	if((pPacketInfo->type & 0xf0U) != MQTT_PACKET_TYPE_PUBACK)
+	{
+		return;
+	}
+	int64_t latency_ns = mqtt_bench_clock_ns(CLOCK_MONOTONIC) -
+			g_sent_ns[pDeserializedInfo->packetIdentifier & (MQTT_BENCH_ID_SLOTS - 1)];
+	if(g_acked < CONFIG_MQTT_BENCH_MESSAGES)
+	{
+		g_latency_us[g_acked] = (uint32_t)(latency_ns / 1000);
+	}
+	g_acked++;
+	g_in_flight--;
+}
+
+/**
+ * @fn bool mqtt_bench_connect(const char*, uint16_t, bool)
+ * @brief open the connection and the MQTT session, as the device does but without TLS
+ *
+ * @param writev give coreMQTT the vectored send, as CONFIG_MQTT_TRANSPORT_WRITEV does on the device
+ */
+static bool mqtt_bench_connect(const char *host, uint16_t port, bool writev)
+{
+	TransportInterface_t transport = {0};
+	MQTTFixedBuffer_t buffer = {.pBuffer = g_buffer, .size = sizeof(g_buffer)};
+	MQTTConnectInfo_t connect_info = {0};
+	bool session_present = false;
+	MQTTStatus_t status;
+
+	if(!mqtt_posix_transport_connect(&g_network, host, port))
+	{
+		return false;
+	}
+
+	//without the vectored send coreMQTT sends each part of a packet with its own write
+	transport.pNetworkContext = &g_network;
+	transport.send = mqtt_posix_transport_send;
+	transport.recv = mqtt_posix_transport_recv;
+	transport.writev = writev ? mqtt_posix_transport_writev : NULL;
+
+	status = MQTT_Init(&g_context, &transport, Clock_GetTimeMs, mqtt_bench_event_callback, &buffer);
+	if(status == MQTTSuccess)
+	{
+		status = MQTT_InitStatefulQoS(&g_context, g_outgoing_records, CONFIG_MQTT_INFLIGHT_WINDOW,
+									  g_incoming_records, 1);
+	}
+	if(status != MQTTSuccess)
+	{
+		ESP_LOGE(TAG, "mqtt_bench_connect: init failed, %s", MQTT_Status_strerror(status));
+		mqtt_posix_transport_disconnect(&g_network);
+		return false;
+	}
+
+	connect_info.cleanSession = true;
+	connect_info.pClientIdentifier = CONFIG_MQTT_CLIENT_IDENTIFIER "-bench";
+	connect_info.clientIdentifierLength = (uint16_t)strlen(connect_info.pClientIdentifier);
+	connect_info.keepAliveSeconds = 60;
+
+	status = MQTT_Connect(&g_context, &connect_info, NULL, MQTT_BENCH_ACK_TIMEOUT_MS, &session_present);
+	if(status != MQTTSuccess)
+	{
+		ESP_LOGE(TAG, "mqtt_bench_connect: CONNECT failed, %s", MQTT_Status_strerror(status));
+		mqtt_posix_transport_disconnect(&g_network);
+		return false;
+	}
+	return true;
+}
+
+/**
+ * @fn bool mqtt_bench_wait_acks(uint32_t)
+ * @brief run MQTT_ProcessLoop until no more than in_flight publishes await their PUBACK
+ *
+ */
+static bool mqtt_bench_wait_acks(uint32_t in_flight)
+{
+	uint32_t start_ms = Clock_GetTimeMs();
+
+	while(g_in_flight > in_flight)
+	{
+		uint32_t acked = g_acked;
+		MQTTStatus_t status = MQTT_ProcessLoop(&g_context);
+		if(status != MQTTSuccess && status != MQTTNeedMoreBytes)
+		{
+			ESP_LOGE(TAG, "mqtt_bench_wait_acks: MQTT_ProcessLoop failed, %s", MQTT_Status_strerror(status));
+			return false;
+		}
+		if(g_acked != acked)
+		{
+			start_ms = Clock_GetTimeMs();
+		}
+		else if(Clock_GetTimeMs() - start_ms > MQTT_BENCH_ACK_TIMEOUT_MS)
+		{
+			ESP_LOGE(TAG, "mqtt_bench_wait_acks: no PUBACK for %u ms, %lu in flight", MQTT_BENCH_ACK_TIMEOUT_MS,
+					(unsigned long)g_in_flight);
+			return false;
+		}
+	}
+	return true;
+}
+
+/**
+ * @fn bool mqtt_bench_publish(const char*, MQTTQoS_t, const void*, size_t)
+ * @brief publish one sample, keeping its send time for the PUBACK
+ *
+ */
+static bool mqtt_bench_publish(const char *topic, MQTTQoS_t qos, const void *payload, size_t len)
+{
+	MQTTPublishInfo_t publish_info = {0};
+	uint16_t packet_id = 0;
+	MQTTStatus_t status;
+
+	publish_info.qos = qos;
+	publish_info.pTopicName = topic;
+	publish_info.topicNameLength = (uint16_t)strlen(topic);
+	publish_info.pPayload = payload;
+	publish_info.payloadLength = len;
+
+	if(qos != MQTTQoS0)
+	{
+		packet_id = MQTT_GetPacketId(&g_context);
+		g_sent_ns[packet_id & (MQTT_BENCH_ID_SLOTS - 1)] = mqtt_bench_clock_ns(CLOCK_MONOTONIC);
+		g_in_flight++;
+	}
+	status = MQTT_Publish(&g_context, &publish_info, packet_id);
+	if(status != MQTTSuccess)
+	{
+		ESP_LOGE(TAG, "mqtt_bench_publish: MQTT_Publish failed, %s", MQTT_Status_strerror(status));
+		return false;
+	}
+	return true;
+}
+
+/**
+ * @fn int mqtt_bench_compare(const void*, const void*)
+ * @brief qsort order of the latencies
+ *
+ */
+static int mqtt_bench_compare(const void *a, const void *b)
+{
+	uint32_t x = *(const uint32_t*)a;
+	uint32_t y = *(const uint32_t*)b;
+
+	return (x > y) - (x < y);
+}
+
+/**
+ * @fn uint32_t mqtt_bench_percentile(uint32_t, uint8_t)
+ * @brief percentile of the sorted latencies
+ *
+ */
+static uint32_t mqtt_bench_percentile(uint32_t count, uint8_t percent)
+{
+	uint32_t rank = (uint32_t)(((uint64_t)count * percent + 99) / 100);
+
+	return count ? g_latency_us[rank ? rank - 1 : 0] : 0;
+}
+
+/**
+ * @fn bool mqtt_bench_measure(const char*, const char*, MQTTQoS_t, uint32_t)
+ * @brief publish the samples and log the rate, the latencies and the cost per message
+ *
+ * @param topic topic of the samples
+ * @param window QoS1 publishes in flight at once, ignored for QoS0
+ */
+static bool mqtt_bench_measure(const char *label, const char *topic, MQTTQoS_t qos, uint32_t window)
+{
+	telemetry_sample_t sample = {.t_ms = 0, .temperature = 23, .humidity = 45, .rssi = -60, .status = DHT11_OK};
+	uint8_t payload[TELEMETRY_CODEC_SAMPLE_MAX_LEN];
+	mqtt_bench_result_t result = {0};
+	uint64_t bytes_sent = g_network.bytes_sent;
+	uint32_t writes = g_network.writes;
+	int64_t start_ns;
+	int64_t start_cpu_ns;
+	uint32_t count;
+	int len = 0;
+
+	g_acked = 0;
+	g_in_flight = 0;
+
+	start_ns = mqtt_bench_clock_ns(CLOCK_MONOTONIC);
+	start_cpu_ns = mqtt_bench_clock_ns(CLOCK_THREAD_CPUTIME_ID);
+	for(uint32_t i = 0; i < CONFIG_MQTT_BENCH_MESSAGES; i++)
+	{
+		//the samples the telemetry task publishes, one reading every 4 s
+		sample.t_ms = i * 4000;
+		len = telemetry_codec_encode_sample(TELEMETRY_CODEC_CBOR, &sample, payload, sizeof(payload));
+		if(len < 0 || !mqtt_bench_publish(topic, qos, payload, (size_t)len))
+		{
+			return false;
+		}
+		if(qos != MQTTQoS0 && g_in_flight >= window && !mqtt_bench_wait_acks(window - 1))
+		{
+			return false;
+		}
+	}
+
+	//a QoS0 run ends with a QoS1 publish, its PUBACK shows the broker took everything before it
+	if(qos == MQTTQoS0)
+	{
+		if(!mqtt_bench_publish(topic, MQTTQoS1, payload, (size_t)len))
+		{
+			return false;
+		}
+	}
+	if(!mqtt_bench_wait_acks(0))
+	{
+		return false;
+	}
+
+	result.messages = CONFIG_MQTT_BENCH_MESSAGES;
+	result.elapsed_ns = mqtt_bench_clock_ns(CLOCK_MONOTONIC) - start_ns;
+	result.cpu_ns = mqtt_bench_clock_ns(CLOCK_THREAD_CPUTIME_ID) - start_cpu_ns;
+	result.bytes_sent = g_network.bytes_sent - bytes_sent;
+	result.writes = g_network.writes - writes;
+
+	ESP_LOGI(TAG, "%s: %llu publishes/s, %lld ns CPU, %llu bytes and %lu.%02lu writes per message", label,
+			(unsigned long long)((uint64_t)result.messages * 1000000000 / (result.elapsed_ns ? result.elapsed_ns : 1)),
+			(long long)(result.cpu_ns / result.messages), (unsigned long long)(result.bytes_sent / result.messages),
+			(unsigned long)(result.writes / result.messages),
+			(unsigned long)(result.writes * 100ULL / result.messages % 100));
+
+	if(qos != MQTTQoS0)
+	{
+		count = g_acked < CONFIG_MQTT_BENCH_MESSAGES ? g_acked : CONFIG_MQTT_BENCH_MESSAGES;
+		qsort(g_latency_us, count, sizeof(g_latency_us[0]), mqtt_bench_compare);
+		ESP_LOGI(TAG, "%s: PUBACK latency p50 %lu us, p90 %lu us, p99 %lu us, max %lu us", label,
+				(unsigned long)mqtt_bench_percentile(count, 50), (unsigned long)mqtt_bench_percentile(count, 90),
+				(unsigned long)mqtt_bench_percentile(count, 99), (unsigned long)mqtt_bench_percentile(count, 100));
+	}
+	return true;
+}
+
+bool mqtt_bench_run(void)
+{
+	const char *host = CONFIG_MQTT_BENCH_BROKER_HOST;
+	uint16_t port = CONFIG_MQTT_BENCH_BROKER_PORT;
+	bool in_process = host[0] == '\0';
+	const char *alias;
+	bool ok;
+
+	if(in_process)
+	{
+		host = "127.0.0.1";
+		if(!mqtt_bench_broker_start(&port))
+		{
+			return false;
+		}
+	}
+	ESP_LOGI(TAG, "mqtt_bench_run: %s broker on %s:%u, %u messages", in_process ? "in-process" : "external", host, port,
+			CONFIG_MQTT_BENCH_MESSAGES);
+
+	//the device's own sample topic, the broker stand-in routes nothing so the alias map is taken as announced
+	if(mqtt_topic_alias_add(TELEMETRY_SAMPLE_TOPIC) == ESP_OK)
+	{
+		mqtt_topic_alias_set_announced(mqtt_topic_alias_count());
+	}
+	alias = mqtt_topic_alias_lookup(TELEMETRY_SAMPLE_TOPIC);
+	ESP_LOGI(TAG, "mqtt_bench_run: topic %s of %u bytes, alias topic %s of %u bytes", TELEMETRY_SAMPLE_TOPIC,
+			(unsigned)strlen(TELEMETRY_SAMPLE_TOPIC), alias, (unsigned)strlen(alias));
+
+	ok = mqtt_bench_connect(host, port, false);
+	if(ok)
+	{
+		ok = mqtt_bench_measure("QoS0", MQTT_BENCH_TOPIC, MQTTQoS0, 1) &&
+			 mqtt_bench_measure("QoS1, one in flight", MQTT_BENCH_TOPIC, MQTTQoS1, 1) &&
+			 mqtt_bench_measure("QoS1, in-flight window", MQTT_BENCH_TOPIC, MQTTQoS1, CONFIG_MQTT_INFLIGHT_WINDOW) &&
+			 mqtt_bench_measure("QoS0, telemetry topic", TELEMETRY_SAMPLE_TOPIC, MQTTQoS0, 1) &&
+			 mqtt_bench_measure("QoS0, alias topic", alias, MQTTQoS0, 1) &&
+			 mqtt_bench_measure("QoS1, in-flight window, telemetry topic", TELEMETRY_SAMPLE_TOPIC, MQTTQoS1,
+					 CONFIG_MQTT_INFLIGHT_WINDOW) &&
+			 mqtt_bench_measure("QoS1, in-flight window, alias topic", alias, MQTTQoS1, CONFIG_MQTT_INFLIGHT_WINDOW);
+		MQTT_Disconnect(&g_context);
+		mqtt_posix_transport_disconnect(&g_network);
+	}
+
+	//the same publishes with each packet gathered into one write, a TLS record on the device
+	ok = ok && mqtt_bench_connect(host, port, true);
+	if(ok)
+	{
+		ok = mqtt_bench_measure("QoS0, vectored send", MQTT_BENCH_TOPIC, MQTTQoS0, 1) &&
+			 mqtt_bench_measure("QoS1, in-flight window, vectored send", MQTT_BENCH_TOPIC, MQTTQoS1,
+					 CONFIG_MQTT_INFLIGHT_WINDOW);
+		MQTT_Disconnect(&g_context);
+		mqtt_posix_transport_disconnect(&g_network);
+	}
+
+	if(in_process)
+	{
+		mqtt_bench_broker_stats_t stats;
+
+		mqtt_bench_broker_stop();
+		mqtt_bench_broker_get_stats(&stats);
+		ESP_LOGI(TAG, "mqtt_bench_run: broker received %lu publishes, %llu payload bytes, sent %lu PUBACKs",
+				(unsigned long)stats.publishes, (unsigned long long)stats.payload_bytes, (unsigned long)stats.pubacks);
+	}
+	return ok;
+}
@@ -0,0 +1,36 @@
+/*
+ * mqtt_bench.h
+ *
+ *  Created on: Oct 18, 2026
+ *      Author: hamxa
+ */
+
+#ifndef MAIN_MQTT_BENCH_H_
+#define MAIN_MQTT_BENCH_H_
+
+#include <stdbool.h>
+
+#include "sdkconfig.h"
+
+//Topic the benchmark publishes to, the broker stand-in routes nothing so it never reaches a subscriber
+#define MQTT_BENCH_TOPIC				"bench/" CONFIG_MQTT_CLIENT_IDENTIFIER "/telemetry"
+
+//Slots of the send times, indexed by packet id, twice the largest in-flight window
+#define MQTT_BENCH_ID_SLOTS				64
+
+//Longest the benchmark waits for an ack before it gives up on the broker
+#define MQTT_BENCH_ACK_TIMEOUT_MS		5000
+
+/**
+ * @fn bool mqtt_bench_run(void)
+ * @brief connect coreMQTT over plaintext TCP to a local broker, or to a broker stand-in started in-process,
+ * 			publish CONFIG_MQTT_BENCH_MESSAGES telemetry samples at QoS0, at QoS1 one at a time and at QoS1 with
+ * 			the in-flight window, then at QoS0 and windowed QoS1 to the telemetry sample topic and to its alias
+ * 			topic, then at QoS0 and windowed QoS1 again with the vectored send. Logs the publishes per second, the
+ * 			bytes and writes per message, the PUBACK latency percentiles and the CPU time of the client per message
+ *
+ * @return true if every publish was sent and acked
+ */
+bool mqtt_bench_run(void);
+
+#endif /* MAIN_MQTT_BENCH_H_ */
@@ -0,0 +1,469 @@
+/*
+ * mqtt_bench_broker.c
+ *
+ *  Created on: Oct 18, 2026
+ *      Author: hamxa
+ */
+#include <errno.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <poll.h>
+#include <pthread.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include "esp_log.h"
+
+#include "mqtt_bench_broker.h"
+
+static const char TAG[] = "mqtt_bench_broker";
+
+//how often the accept and receive waits look at the stop flag
+#define MQTT_BENCH_BROKER_POLL_MS		100
+
+#define MQTT_BENCH_BROKER_CONNECT		0x10
+#define MQTT_BENCH_BROKER_PUBLISH		0x30
+#define MQTT_BENCH_BROKER_SUBSCRIBE		0x80
+#define MQTT_BENCH_BROKER_UNSUBSCRIBE	0xa0
+#define MQTT_BENCH_BROKER_PINGREQ		0xc0
+#define MQTT_BENCH_BROKER_DISCONNECT	0xe0
+
+/**
+ * Buffered reader of one client connection, most packets are read with a single recv
+ */
+typedef struct mqtt_bench_broker_conn
+{
+	int socket;
+	uint8_t buf[MQTT_BENCH_BROKER_MAX_PACKET];
+	size_t pos;
+	size_t len;
+}mqtt_bench_broker_conn_t;
+
+//the broker runs in a plain thread, a simulator task blocked in a socket call would stall every other task
+static pthread_t g_thread;
+static int g_listen_socket = -1;
+static bool g_stop;
+
+static mqtt_bench_broker_stats_t g_stats;
+static mqtt_bench_broker_publish_hook_t g_publish_hook;
+
+//client of the session kept after a connect without clean session
+static char g_session_client[64];
+static bool g_session_kept;
+static mqtt_bench_broker_conn_t g_conn;
+static uint8_t g_packet[MQTT_BENCH_BROKER_MAX_PACKET];
+
+//socket of the client being served, -1 between clients. Publishes to it come from other threads, every write holds
+//the lock so packets do not interleave
+static pthread_mutex_t g_write_lock = PTHREAD_MUTEX_INITIALIZER;
+static int g_client_socket = -1;
+
+/**
+ * @fn bool mqtt_bench_broker_fill(mqtt_bench_broker_conn_t*)
+ * @brief receive more bytes, keeping the unread ones
+ *
+ * @return false if the client closed or the broker is stopping
+ */
+static bool mqtt_bench_broker_fill(mqtt_bench_broker_conn_t *conn)
+{
+	struct pollfd fd = {.fd = conn->socket, .events = POLLIN};
+	ssize_t received;
+
+	memmove(conn->buf, conn->buf + conn->pos, conn->len - conn->pos);
+	conn->len -= conn->pos;
+	conn->pos = 0;
+
+	while(!__atomic_load_n(&g_stop, __ATOMIC_RELAXED))
+	{
+		int ready = poll(&fd, 1, MQTT_BENCH_BROKER_POLL_MS);
+		if(ready < 0 && errno != EINTR)
+		{
+			return false;
+		}
+		if(ready <= 0)
+		{
+			continue;
+		}
+		received = recv(conn->socket, conn->buf + conn->len, sizeof(conn->buf) - conn->len, 0);
+		if(received < 0 && errno == EINTR)
+		{
+			continue;
+		}
+		if(received <= 0)
+		{
+			return false;
+		}
+		conn->len += received;
+		return true;
+	}
+	return false;
+}
+
+/**
+ * @fn bool mqtt_bench_broker_read(mqtt_bench_broker_conn_t*, void*, size_t)
+ * @brief read exactly len bytes
+ *
+ */
+static bool mqtt_bench_broker_read(mqtt_bench_broker_conn_t *conn, void *out, size_t len)
+{
+	while(conn->len - conn->pos < len)
+	{
+		if(!mqtt_bench_broker_fill(conn))
+		{
+			return false;
+		}
+	}
+	memcpy(out, conn->buf + conn->pos, len);
+	conn->pos += len;
+	return true;
+}
+
+/**
+ * @fn bool mqtt_bench_broker_send(int, const uint8_t*, size_t)
+ * @brief send a complete packet, with the write lock held
+ *
+ */
+static bool mqtt_bench_broker_send(int sock, const uint8_t *packet, size_t len)
+{
+	while(len > 0)
+	{
+		ssize_t sent = send(sock, packet, len, MSG_NOSIGNAL);
+		if(sent < 0 && errno == EINTR)
+		{
+			continue;
+		}
+		if(sent <= 0)
+		{
+			return false;
+		}
+		packet += sent;
+		len -= sent;
+	}
+	return true;
+}
+
+/**
+ * @fn bool mqtt_bench_broker_write(int, const uint8_t*, size_t)
+ * @brief send a complete response packet
+ *
+ */
+static bool mqtt_bench_broker_write(int sock, const uint8_t *packet, size_t len)
+{
+	bool ok;
+
+	pthread_mutex_lock(&g_write_lock);
+	ok = mqtt_bench_broker_send(sock, packet, len);
+	pthread_mutex_unlock(&g_write_lock);
+	return ok;
+}
+
+/**
+ * @fn bool mqtt_bench_broker_handle(mqtt_bench_broker_conn_t*, uint8_t, const uint8_t*, size_t)
+ * @brief answer one packet
+ *
+ * @return false if the connection should be closed
+ */
+static bool mqtt_bench_broker_handle(mqtt_bench_broker_conn_t *conn, uint8_t header, const uint8_t *body, size_t len)
+{
+	uint8_t response[8];
+
+	switch(header & 0xf0)
+	{
+		case MQTT_BENCH_BROKER_CONNECT:
+		{
+			//protocol name, level, flags and keep alive come before the client identifier
+			size_t name_len;
+			size_t id_len;
+			bool clean;
+			bool present;
+
+			if(len < 2)
+			{
+				return false;
+			}
+			name_len = ((size_t)body[0] << 8) | body[1];
+			if(2 + name_len + 6 > len)
+			{
+				return false;
+			}
+			clean = body[2 + name_len + 1] & 0x02;
+			id_len = ((size_t)body[2 + name_len + 4] << 8) | body[2 + name_len + 5];
+			if(2 + name_len + 6 + id_len > len || id_len >= sizeof(g_session_client))
+			{
+				return false;
+			}
+
+			//only the session state is kept, the publishes it acked are the client's to resend
+			present = !clean && g_session_kept && strlen(g_session_client) == id_len &&
+					memcmp(g_session_client, body + 2 + name_len + 6, id_len) == 0;
+			memcpy(g_session_client, body + 2 + name_len + 6, id_len);
+			g_session_client[id_len] = '\0';
+			g_session_kept = !clean;
+
+			response[0] = 0x20;
+			response[1] = 2;
+			response[2] = present ? 1 : 0;
+			response[3] = 0;
+			return mqtt_bench_broker_write(conn->socket, response, 4);
+		}
+
+		case MQTT_BENCH_BROKER_PUBLISH:
+		{
+			uint8_t qos = (header >> 1) & 3;
+			size_t topic_len;
+			size_t offset;
+
+			if(len < 2)
+			{
+				return false;
+			}
+			topic_len = ((size_t)body[0] << 8) | body[1];
+			offset = 2 + topic_len + (qos > 0 ? 2 : 0);
+			if(offset > len || qos > 1)
+			{
+				//QoS2 is not used by the device
+				return false;
+			}
+			__atomic_fetch_add(&g_stats.publishes, 1, __ATOMIC_RELAXED);
+			__atomic_fetch_add(&g_stats.payload_bytes, len - offset, __ATOMIC_RELAXED);
+			if(g_publish_hook)
+			{
+				g_publish_hook(body + offset, len - offset);
+			}
+			if(qos == 0)
+			{
+				return true;
+			}
+			response[0] = 0x40;
+			response[1] = 2;
+			response[2] = body[2 + topic_len];
+			response[3] = body[3 + topic_len];
+			__atomic_fetch_add(&g_stats.pubacks, 1, __ATOMIC_RELAXED);
+			return mqtt_bench_broker_write(conn->socket, response, 4);
+		}
+
+		case MQTT_BENCH_BROKER_SUBSCRIBE:
+		{
+			//one return code per filter, granting the requested QoS, in a one byte remaining length
+			uint8_t suback[2 + 127];
+			size_t count = 0;
+			size_t offset = 2;
+
+			if(len < 2)
+			{
+				return false;
+			}
+			while(offset + 2 <= len)
+			{
+				offset += 2 + (((size_t)body[offset] << 8) | body[offset + 1]);
+				if(offset >= len || count >= sizeof(suback) - 4)
+				{
+					return false;
+				}
+				suback[4 + count++] = body[offset++] & 3;
+			}
+			suback[0] = 0x90;
+			suback[1] = (uint8_t)(2 + count);
+			suback[2] = body[0];
+			suback[3] = body[1];
+			return mqtt_bench_broker_write(conn->socket, suback, 4 + count);
+		}
+
+		case MQTT_BENCH_BROKER_UNSUBSCRIBE:
+			if(len < 2)
+			{
+				return false;
+			}
+			response[0] = 0xb0;
+			response[1] = 2;
+			response[2] = body[0];
+			response[3] = body[1];
+			return mqtt_bench_broker_write(conn->socket, response, 4);
+
+		case MQTT_BENCH_BROKER_PINGREQ:
+			response[0] = 0xd0;
+			response[1] = 0;
+			return mqtt_bench_broker_write(conn->socket, response, 2);
+
+		case MQTT_BENCH_BROKER_DISCONNECT:
+			return false;
+
+		default:
+			//acks of inbound publishes, none are sent
+			return true;
+	}
+}
+
+/**
+ * @fn void mqtt_bench_broker_serve(int)
+ * @brief read and answer packets until the client disconnects
+ *
+ */
+static void mqtt_bench_broker_serve(int sock)
+{
+	mqtt_bench_broker_conn_t *conn = &g_conn;
+	uint8_t header;
+
+	conn->socket = sock;
+	conn->pos = 0;
+	conn->len = 0;
+
+	while(mqtt_bench_broker_read(conn, &header, 1))
+	{
+		size_t len = 0;
+		uint8_t digit;
+		uint32_t shift = 0;
+
+		//remaining length, 7 bits per byte
+		do
+		{
+			if(shift > 21 || !mqtt_bench_broker_read(conn, &digit, 1))
+			{
+				return;
+			}
+			len |= (size_t)(digit & 0x7f) << shift;
+			shift += 7;
+		} while(digit & 0x80);
+
+		if(len > sizeof(g_packet))
+		{
+			ESP_LOGE(TAG, "mqtt_bench_broker_serve: packet of %u bytes refused", (unsigned)len);
+			return;
+		}
+		if(!mqtt_bench_broker_read(conn, g_packet, len) || !mqtt_bench_broker_handle(conn, header, g_packet, len))
+		{
+			return;
+		}
+	}
+}
+
+/**
+ * @fn void mqtt_bench_broker_thread*(void*)
+ * @brief accept and serve clients one after the other until stopped
+ *
+ */
+static void *mqtt_bench_broker_thread(void *arg)
+{
+	struct pollfd fd = {.fd = g_listen_socket, .events = POLLIN};
+	int one = 1;
+
+	while(!__atomic_load_n(&g_stop, __ATOMIC_RELAXED))
+	{
+		int ready = poll(&fd, 1, MQTT_BENCH_BROKER_POLL_MS);
+		if(ready <= 0)
+		{
+			continue;
+		}
+		int sock = accept(g_listen_socket, NULL, NULL);
+		if(sock < 0)
+		{
+			continue;
+		}
+		setsockopt(sock, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+		__atomic_fetch_add(&g_stats.connections, 1, __ATOMIC_RELAXED);
+		pthread_mutex_lock(&g_write_lock);
+		g_client_socket = sock;
+		pthread_mutex_unlock(&g_write_lock);
+		mqtt_bench_broker_serve(sock);
+		pthread_mutex_lock(&g_write_lock);
+		g_client_socket = -1;
+		pthread_mutex_unlock(&g_write_lock);
+		close(sock);
+	}
+	return NULL;
+}
+
+bool mqtt_bench_broker_start(uint16_t *port)
+{
+	struct sockaddr_in addr = {.sin_family = AF_INET, .sin_addr.s_addr = htonl(INADDR_LOOPBACK), .sin_port = 0};
+	socklen_t addr_len = sizeof(addr);
+
+	g_listen_socket = socket(AF_INET, SOCK_STREAM, 0);
+	if(g_listen_socket < 0)
+	{
+		ESP_LOGE(TAG, "mqtt_bench_broker_start: socket failed, errno %d", errno);
+		return false;
+	}
+	//any free port, the client is told which
+	if(bind(g_listen_socket, (struct sockaddr*)&addr, sizeof(addr)) != 0 || listen(g_listen_socket, 1) != 0 ||
+	   getsockname(g_listen_socket, (struct sockaddr*)&addr, &addr_len) != 0)
+	{
+		ESP_LOGE(TAG, "mqtt_bench_broker_start: cannot listen, errno %d", errno);
+		close(g_listen_socket);
+		g_listen_socket = -1;
+		return false;
+	}
+
+	memset(&g_stats, 0, sizeof(g_stats));
+	g_session_kept = false;
+	g_stop = false;
+	if(pthread_create(&g_thread, NULL, mqtt_bench_broker_thread, NULL) != 0)
+	{
+		ESP_LOGE(TAG, "mqtt_bench_broker_start: thread not started");
+		close(g_listen_socket);
+		g_listen_socket = -1;
+		return false;
+	}
+	*port = ntohs(addr.sin_port);
+	return true;
+}
+
+void mqtt_bench_broker_set_publish_hook(mqtt_bench_broker_publish_hook_t hook)
+{
+	g_publish_hook = hook;
+}
+
+bool mqtt_bench_broker_publish(const char *topic, const void *payload, size_t len)
+{
+	uint8_t packet[MQTT_BENCH_BROKER_MAX_PACKET];
+	size_t topic_len = strlen(topic);
+	size_t remaining = 2 + topic_len + len;
+	size_t pos = 1;
+	bool ok;
+
+	if(remaining + 5 > sizeof(packet))
+	{
+		return false;
+	}
+	packet[0] = MQTT_BENCH_BROKER_PUBLISH;
+	do
+	{
+		packet[pos++] = (uint8_t)((remaining & 0x7f) | (remaining > 0x7f ? 0x80 : 0));
+		remaining >>= 7;
+	} while(remaining > 0);
+	packet[pos++] = (uint8_t)(topic_len >> 8);
+	packet[pos++] = (uint8_t)topic_len;
+	memcpy(packet + pos, topic, topic_len);
+	pos += topic_len;
+	if(len > 0)
+	{
+		memcpy(packet + pos, payload, len);
+		pos += len;
+	}
+
+	pthread_mutex_lock(&g_write_lock);
+	ok = g_client_socket >= 0 && mqtt_bench_broker_send(g_client_socket, packet, pos);
+	pthread_mutex_unlock(&g_write_lock);
+	return ok;
+}
+
+void mqtt_bench_broker_stop(void)
+{
+	if(g_listen_socket < 0)
+	{
+		return;
+	}
+	__atomic_store_n(&g_stop, true, __ATOMIC_RELAXED);
+	pthread_join(g_thread, NULL);
+	close(g_listen_socket);
+	g_listen_socket = -1;
+}
+
+void mqtt_bench_broker_get_stats(mqtt_bench_broker_stats_t *stats)
+{
+	stats->connections = __atomic_load_n(&g_stats.connections, __ATOMIC_RELAXED);
+	stats->publishes = __atomic_load_n(&g_stats.publishes, __ATOMIC_RELAXED);
+	stats->pubacks = __atomic_load_n(&g_stats.pubacks, __ATOMIC_RELAXED);
+	stats->payload_bytes = __atomic_load_n(&g_stats.payload_bytes, __ATOMIC_RELAXED);
+}
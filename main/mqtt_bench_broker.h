@@ -0,0 +1,75 @@
+/*
+ * mqtt_bench_broker.h
+ *
+ *  Created on: Oct 18, 2026
+ *      Author: hamxa
+ */
+
+#ifndef MAIN_MQTT_BENCH_BROKER_H_
+#define MAIN_MQTT_BENCH_BROKER_H_
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+//Largest packet the broker accepts, the device network buffer is at most 2048 bytes
+#define MQTT_BENCH_BROKER_MAX_PACKET	4096
+
+/**
+ * Packets the broker stand-in received since it started
+ */
+typedef struct mqtt_bench_broker_stats
+{
+	uint32_t connections;
+	uint32_t publishes;			///> PUBLISH packets of any QoS
+	uint32_t pubacks;			///> PUBACKs sent for QoS1 publishes
+	uint64_t payload_bytes;		///> payload of the publishes
+}mqtt_bench_broker_stats_t;
+
+/**
+ * @brief called from the broker thread with the payload of every publish received, duplicates included
+ */
+typedef void (*mqtt_bench_broker_publish_hook_t)(const uint8_t *payload, size_t len);
+
+/**
+ * @fn bool mqtt_bench_broker_start(uint16_t*)
+ * @brief start a minimal MQTT 3.1.1 broker on the loopback interface, in a thread of its own. It accepts any
+ * 			CONNECT, acks QoS1 publishes, subscribes and pings, and serves one client at a time. Nothing is routed,
+ * 			publishes to the client come from mqtt_bench_broker_publish.
+ * 			A client that reconnects without a clean session is told its session is present
+ *
+ * @param port output, the port it listens on
+ * @return true if it is listening
+ */
+bool mqtt_bench_broker_start(uint16_t *port);
+
+/**
+ * @fn void mqtt_bench_broker_set_publish_hook(mqtt_bench_broker_publish_hook_t)
+ * @brief set the function that sees every publish, before the broker starts
+ *
+ */
+void mqtt_bench_broker_set_publish_hook(mqtt_bench_broker_publish_hook_t hook);
+
+/**
+ * @fn bool mqtt_bench_broker_publish(const char*, const void*, size_t)
+ * @brief send a QoS0 publish to the connected client, whatever it subscribed to. Safe from any thread
+ *
+ * @return false if no client is connected or the send failed
+ */
+bool mqtt_bench_broker_publish(const char *topic, const void *payload, size_t len);
+
+/**
+ * @fn void mqtt_bench_broker_stop(void)
+ * @brief stop the broker and wait for its thread
+ *
+ */
+void mqtt_bench_broker_stop(void);
+
+/**
+ * @fn void mqtt_bench_broker_get_stats(mqtt_bench_broker_stats_t*)
+ * @brief get the packets received
+ *
+ */
+void mqtt_bench_broker_get_stats(mqtt_bench_broker_stats_t *stats);
+
+#endif /* MAIN_MQTT_BENCH_BROKER_H_ */
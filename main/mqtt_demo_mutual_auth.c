@@ -75,8 +75,24 @@
 
 /* Clock for timer. */
 #include "clock.h"
+#include "esp_timer.h"
+
+/* Agent poll delay. */
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
 
 #include "dht11.h"
+#include "mqtt_agent.h"
+#include "mqtt_metrics.h"
+#include "mqtt_pacer.h"
+#include "mqtt_router.h"
+#include "mqtt_rpc.h"
+#include "mqtt_session_store.h"
+#include "mqtt_slab.h"
+#include "mqtt_topic_alias.h"
+#include "mqtt_transport.h"
+#include "sensor_window.h"
+#include "telemetry_codec.h"
 #include "wifi_app.h"
 
 #ifdef CONFIG_EXAMPLE_USE_ESP_SECURE_CERT_MGR
@@ -162,17 +178,17 @@ extern const char root_cert_auth_end[]   asm("_binary_aws_root_ca_pem_end");
 /**
  * @brief The maximum number of retries for connecting to server.
  */
-#define CONNECTION_RETRY_MAX_ATTEMPTS            ( 5U )
+#define CONNECTION_RETRY_MAX_ATTEMPTS            ( ( uint32_t ) CONFIG_MQTT_RETRY_MAX_ATTEMPTS )
 
 /**
  * @brief The maximum back-off delay (in milliseconds) for retrying connection to server.
  */
-#define CONNECTION_RETRY_MAX_BACKOFF_DELAY_MS    ( 5000U )
+#define CONNECTION_RETRY_MAX_BACKOFF_DELAY_MS    ( ( uint16_t ) CONFIG_MQTT_RETRY_BACKOFF_MAX_MS )
 
 /**
  * @brief The base back-off delay (in milliseconds) to use for connection retry attempts.
  */
-#define CONNECTION_RETRY_BACKOFF_BASE_MS         ( 500U )
+#define CONNECTION_RETRY_BACKOFF_BASE_MS         ( ( uint16_t ) CONFIG_MQTT_RETRY_BACKOFF_BASE_MS )
 
 /**
  * @brief Timeout for receiving CONNACK packet in milli seconds.
@@ -192,6 +208,42 @@ extern const char root_cert_auth_end[]   asm("_binary_aws_root_ca_pem_end");
  */
 #define MQTT_EXAMPLE_TOPIC_LENGTH           ( ( uint16_t ) ( sizeof( MQTT_EXAMPLE_TOPIC ) - 1 ) )
 
+/**
+ * @brief The topic the sliding-window sensor summary is published to.
+ */
+#define MQTT_SUMMARY_TOPIC                  MQTT_EXAMPLE_TOPIC "/summary"
+
+/**
+ * @brief Length of the sensor summary topic.
+ */
+#define MQTT_SUMMARY_TOPIC_LENGTH           ( ( uint16_t ) ( sizeof( MQTT_SUMMARY_TOPIC ) - 1 ) )
+
+/**
+ * @brief Size of the buffer holding the JSON sensor summary.
+ */
+#define MQTT_SUMMARY_PAYLOAD_SIZE           ( SENSOR_WINDOW_JSON_MAX_LEN )
+
+/**
+ * @brief Size of the buffer holding one telemetry sample.
+ */
+#define MQTT_TELEMETRY_PAYLOAD_SIZE         ( TELEMETRY_CODEC_SAMPLE_MAX_LEN )
+
+/**
+ * @brief Keep one session open and serve the MQTT agent command queue
+ * instead of running subscribePublishLoop() on a fresh connection every
+ * iteration.
+ */
+#ifdef CONFIG_MQTT_PERSISTENT_SESSION
+    #define MQTT_PERSISTENT_SESSION         ( true )
+#else
+    #define MQTT_PERSISTENT_SESSION         ( false )
+#endif /* CONFIG_MQTT_PERSISTENT_SESSION */
+
+/**
+ * @brief Interval between connection and traffic statistics reports.
+ */
+#define MQTT_STATS_REPORT_INTERVAL_MS       ( 60000U )
+
 /**
  * @brief The MQTT message published in this example.
  */
@@ -205,8 +257,24 @@ extern const char root_cert_auth_end[]   asm("_binary_aws_root_ca_pem_end");
 /**
  * @brief Maximum number of outgoing publishes maintained in the application
  * until an ack is received from the broker.
+ *
+ * This is the QoS1 in-flight window. It should cover the bandwidth-delay
+ * product of the link, the publish rate times the PUBACK round trip, or the
+ * agent stalls waiting for acks. See the statistics report for both values.
+ */
+#define MAX_OUTGOING_PUBLISHES              ( ( uint8_t ) CONFIG_MQTT_INFLIGHT_WINDOW )
+
+/**
+ * @brief Size of the packet identifier index of the outgoing publishes, a
+ * power of two at least twice #MAX_OUTGOING_PUBLISHES.
+ */
+#define OUTGOING_PUBLISH_INDEX_SIZE         ( 64U )
+
+/**
+ * @brief Maximum number of SUBSCRIBE and UNSUBSCRIBE requests of the agent
+ * waiting for their ack at once.
  */
-#define MAX_OUTGOING_PUBLISHES              ( 5U )
+#define MAX_PENDING_ACKS                    ( 4U )
 
 /**
  * @brief Invalid packet identifier for the MQTT packets. Zero is always an
@@ -276,7 +344,7 @@ extern const char root_cert_auth_end[]   asm("_binary_aws_root_ca_pem_end");
  * @brief The length of the outgoing publish records array used by the coreMQTT
  * library to track QoS > 0 packet ACKS for outgoing publishes.
  */
-#define OUTGOING_PUBLISH_RECORD_LEN    ( 10U )
+#define OUTGOING_PUBLISH_RECORD_LEN    ( MAX_OUTGOING_PUBLISHES )
 
 /**
  * @brief The length of the incoming publish records array used by the coreMQTT
@@ -301,8 +369,38 @@ typedef struct PublishPackets
      * @brief Publish info of the publish packet.
      */
     MQTTPublishInfo_t pubInfo;
+
+    /**
+     * @brief Agent command owning the topic and payload, pubInfo points into
+     * it so a resend after a reconnect does not depend on the caller's buffer.
+     */
+    mqtt_agent_cmd_t cmd;
+
+    /**
+     * @brief Time the publish was sent, used to measure the PUBACK round trip.
+     */
+    uint32_t sentTimeMs;
 } PublishPackets_t;
 
+/**
+ * @brief Structure to keep the agent SUBSCRIBE and UNSUBSCRIBE requests
+ * until the broker acks them.
+ */
+typedef struct PendingAck
+{
+    /**
+     * @brief Packet identifier of the request, MQTT_PACKET_ID_INVALID when
+     * the entry is free.
+     */
+    uint16_t packetId;
+
+    /**
+     * @brief Agent command completed by the ack. Left empty when the agent
+     * renews its own subscriptions after a clean session.
+     */
+    mqtt_agent_cmd_t cmd;
+} PendingAck_t;
+
 /*-----------------------------------------------------------*/
 
 /**
@@ -332,6 +430,36 @@ static uint16_t globalUnsubscribePacketIdentifier = 0U;
  */
 static PublishPackets_t outgoingPublishPackets[ MAX_OUTGOING_PUBLISHES ] = { 0 };
 
+/**
+ * @brief Open addressed index from packet identifier to the slot in
+ * #outgoingPublishPackets, holding the slot plus one and zero when empty.
+ * Packet identifiers are handed out in sequence so the low bits spread them
+ * evenly and a PUBACK finds its slot without a scan.
+ */
+static uint8_t outgoingPublishIndex[ OUTGOING_PUBLISH_INDEX_SIZE ] = { 0 };
+
+/**
+ * @brief Stack of the free slots in #outgoingPublishPackets.
+ */
+static uint8_t freeOutgoingPublishes[ MAX_OUTGOING_PUBLISHES ];
+
+/**
+ * @brief Number of entries in #freeOutgoingPublishes.
+ */
+static uint8_t freeOutgoingPublishCount = 0U;
+
+/**
+ * @brief Array to keep the agent SUBSCRIBE and UNSUBSCRIBE requests waiting
+ * for their ack.
+ */
+static PendingAck_t pendingAcks[ MAX_PENDING_ACKS ] = { 0 };
+
+/**
+ * @brief Agent command taken off the queue that is waiting for a free
+ * outgoing publish or pending ack slot. Kept across reconnects.
+ */
+static mqtt_agent_cmd_t heldAgentCommand = { 0 };
+
 /**
  * @brief Array to keep subscription topics.
  * Used to re-subscribe to topics that failed initial subscription attempts.
@@ -373,6 +501,43 @@ static MQTTPubAckInfo_t pIncomingPublishRecords[ INCOMING_PUBLISH_RECORD_LEN ];
  */
 static StaticSemaphore_t xTlsContextSemaphoreBuffer;
 
+/**
+ * @brief Number of telemetry samples handed to MQTT_Publish, used to report
+ * the bytes on the wire per sample.
+ */
+static uint32_t globalPublishedSamples = 0U;
+
+/**
+ * @brief Agent commands completed at the last statistics report, used to
+ * report the command rate.
+ */
+static uint32_t globalReportedCommands = 0U;
+
+/**
+ * @brief PUBACKs counted by mqtt_metrics at the last statistics report.
+ */
+static uint32_t globalReportedPubAcks = 0U;
+
+/**
+ * @brief Highest number of publishes awaiting a PUBACK at once, and the
+ * agent loop iterations a publish waited for a free slot.
+ */
+static uint8_t globalPeakInFlight = 0U;
+static uint32_t globalWindowFullWaits = 0U;
+
+/**
+ * @brief Topic aliases whose map was handed to the agent. Reset when the
+ * broker did not ack the map, so it is announced again.
+ */
+static uint8_t globalAliasesAnnounced = 0U;
+
+/**
+ * @brief AIMD window and pacing of the QoS1 publishes of the current
+ * connection, and the loop iterations a publish waited for it.
+ */
+static mqtt_pacer_t globalPacer;
+static uint32_t globalPacerWaits = 0U;
+
 /*-----------------------------------------------------------*/
 
 int aws_iot_demo_main( int argc, char ** argv );
@@ -418,6 +583,163 @@ static int connectToServerWithBackoffRetries( NetworkContext_t * pNetworkContext
  */
 static int subscribePublishLoop( MQTTContext_t * pMqttContext );
 
+/**
+ * @brief Serve the MQTT agent command queue over the connected session,
+ * running #MQTT_ProcessLoop in between for acks, incoming publishes and
+ * keep alive.
+ *
+ * Only returns when the connection fails, so the caller can reconnect.
+ *
+ * @param[in] pMqttContext MQTT context pointer.
+ * @param[in] brokerSessionPresent Whether the broker kept the subscriptions
+ * of the previous session.
+ *
+ * @return EXIT_FAILURE once the connection is no longer usable.
+ */
+static int agentCommandLoop( MQTTContext_t * pMqttContext,
+                             bool brokerSessionPresent );
+
+/**
+ * @brief Check whether an agent command can be sent now, QoS1 publishes need
+ * a free outgoing publish slot and subscription changes a free pending ack.
+ *
+ * @param[in] pCommand Agent command to check.
+ *
+ * @return true if the command can be executed.
+ */
+static bool agentCommandHasRoom( const mqtt_agent_cmd_t * pCommand );
+
+/**
+ * @brief Send an agent command. The command is moved into the outgoing
+ * publish or pending ack table, or completed straight away.
+ *
+ * @param[in] pMqttContext MQTT context pointer.
+ * @param[in,out] pCommand Agent command, cleared on return.
+ *
+ * @return EXIT_FAILURE if the packet could not be sent; EXIT_SUCCESS otherwise.
+ */
+static int executeAgentCommand( MQTTContext_t * pMqttContext,
+                                mqtt_agent_cmd_t * pCommand );
+
+/**
+ * @brief Send a publish command. QoS1 publishes are kept in
+ * #outgoingPublishPackets until the PUBACK completes them, QoS0 publishes
+ * complete once sent.
+ *
+ * @param[in] pMqttContext MQTT context pointer.
+ * @param[in,out] pCommand Publish command, cleared on return.
+ *
+ * @return EXIT_FAILURE if there was no free slot or the PUBLISH could not
+ * be sent; EXIT_SUCCESS otherwise.
+ */
+static int publishCommand( MQTTContext_t * pMqttContext,
+                           mqtt_agent_cmd_t * pCommand );
+
+/**
+ * @brief Renew the agent subscriptions after the broker started a clean
+ * session, #MQTT_AGENT_RESUBSCRIBE_BATCH topic filters per SUBSCRIBE.
+ *
+ * @param[in] pMqttContext MQTT context pointer.
+ *
+ * @return EXIT_FAILURE if a SUBSCRIBE could not be sent; EXIT_SUCCESS otherwise.
+ */
+static int resubscribeAgentTopics( MQTTContext_t * pMqttContext );
+
+/**
+ * @brief Build the retained QoS1 publish of the topic alias map once more
+ * aliases were given than announced.
+ *
+ * @param[out] pCommand Command to fill, left empty if nothing is to announce.
+ */
+static void announceTopicAliases( mqtt_agent_cmd_t * pCommand );
+
+/**
+ * @brief Completion of the alias map publish, the aliases are used from
+ * the PUBACK on so the map always reaches the broker first.
+ *
+ * @param[in] pContext Number of aliases in the map.
+ * @param[in] result Outcome of the publish.
+ */
+static void topicAliasesAnnounced( void * pContext,
+                                   esp_err_t result );
+
+/**
+ * @brief Tell the pacer about a publish whose PUBACK is overdue, the agent
+ * does not resend it before a reconnect but sends less meanwhile.
+ *
+ * @param[in] ulCurrentTime Current time in ms.
+ */
+static void checkOverduePublishes( uint32_t ulCurrentTime );
+
+#if CONFIG_MQTT_SESSION_STORE
+
+/**
+ * @brief Put the publishes journaled before the last reset back into the
+ * outgoing publish table and the coreMQTT state once the CONNACK arrived, so
+ * that handlePublishResend() sends them. They keep their packet ids if the
+ * broker resumed the session, and get new ones if it did not. Only the first
+ * call after boot restores, later ones clear the journal without a session.
+ *
+ * @param[in] pMqttContext MQTT context pointer.
+ * @param[in] brokerSessionPresent Session present flag of the CONNACK.
+ */
+    static void restoreJournaledPublishes( MQTTContext_t * pMqttContext,
+                                           bool brokerSessionPresent );
+
+/**
+ * @brief Restore one journaled publish, the #mqtt_session_store_visit_t
+ * called by restoreJournaledPublishes().
+ */
+    static void restoreJournaledPublish( void * pContext,
+                                         uint16_t packetId,
+                                         const char * pTopic,
+                                         uint16_t topicLength,
+                                         const uint8_t * pPayload,
+                                         size_t payloadLength,
+                                         bool retain );
+
+#endif /* CONFIG_MQTT_SESSION_STORE */
+
+/**
+ * @brief Function to get the free index at which a pending SUBSCRIBE or
+ * UNSUBSCRIBE can be stored.
+ *
+ * @param[out] pIndex The output parameter to return the free index.
+ *
+ * @return EXIT_FAILURE if all entries are in use; EXIT_SUCCESS otherwise.
+ */
+static int getNextFreeIndexForPendingAcks( uint8_t * pIndex );
+
+/**
+ * @brief Complete the agent request acked by a SUBACK or UNSUBACK.
+ *
+ * @param[in] pPacketInfo The SUBACK or UNSUBACK packet.
+ * @param[in] packetId Packet identifier of the ack.
+ *
+ * @return true if the ack belonged to an agent request.
+ */
+static bool completePendingAck( MQTTPacketInfo_t * pPacketInfo,
+                                uint16_t packetId );
+
+/**
+ * @brief Fail the agent requests still waiting for an ack, the broker does
+ * not resend acks for a broken connection.
+ */
+static void failPendingAcks( void );
+
+/**
+ * @brief Log the TLS handshake count and rate and the MQTT bytes sent and
+ * received per published sample.
+ */
+static void logTransportStats( void );
+
+/**
+ * @brief Log the agent command rate, queue depth and rejected commands.
+ *
+ * @param[in] ulElapsedMs Time since the previous report.
+ */
+static void logAgentStats( uint32_t ulElapsedMs );
+
 /**
  * @brief The function to handle the incoming publishes.
  *
@@ -511,6 +833,17 @@ static int unsubscribeFromTopic( MQTTContext_t * pMqttContext );
  */
 static int publishToTopic( MQTTContext_t * pMqttContext );
 
+/**
+ * @brief Sends a QoS0 MQTT PUBLISH of the sliding-window sensor aggregates
+ * to #MQTT_SUMMARY_TOPIC.
+ *
+ * @param[in] pMqttContext MQTT context pointer.
+ *
+ * @return EXIT_SUCCESS if PUBLISH was successfully sent;
+ * EXIT_FAILURE otherwise.
+ */
+static int publishSummaryToTopic( MQTTContext_t * pMqttContext );
+
 /**
  * @brief Function to get the free index at which an outgoing publish
  * can be stored.
@@ -523,6 +856,36 @@ static int publishToTopic( MQTTContext_t * pMqttContext );
  */
 static int getNextFreeIndexForOutgoingPublishes( uint8_t * pIndex );
 
+/**
+ * @brief Function to take the free slot returned by
+ * #getNextFreeIndexForOutgoingPublishes for a publish and index it by its
+ * packet identifier.
+ *
+ * @param[in] index The slot to take.
+ * @param[in] packetId Packet identifier of the publish.
+ */
+static void storeOutgoingPublishAt( uint8_t index,
+                                    uint16_t packetId );
+
+/**
+ * @brief Function to find the outgoing publish with the given packet id.
+ *
+ * @param[in] packetId Packet identifier of the publish.
+ *
+ * @return The slot of the publish, #MAX_OUTGOING_PUBLISHES if none matches.
+ */
+static uint8_t findOutgoingPublish( uint16_t packetId );
+
+/**
+ * @brief Function to get a new packet id, skipping the ids of the outgoing
+ * publishes restored from the journal with the ids they were sent with.
+ *
+ * @param[in] pMqttContext MQTT context pointer.
+ *
+ * @return The packet id.
+ */
+static uint16_t getFreePacketId( MQTTContext_t * pMqttContext );
+
 /**
  * @brief Function to clean up an outgoing publish at given index from the
  * #outgoingPublishPackets array.
@@ -639,6 +1002,7 @@ static int connectToServerWithBackoffRetries( NetworkContext_t * pNetworkContext
     TlsTransportStatus_t tlsStatus = TLS_TRANSPORT_SUCCESS;
     BackoffAlgorithmContext_t reconnectParams;
     bool createCleanSession;
+    uint32_t ulAttemptStartMs;
 
     pNetworkContext->pcHostname = AWS_IOT_ENDPOINT;
     pNetworkContext->xPort = AWS_MQTT_PORT;
@@ -734,7 +1098,9 @@ static int connectToServerWithBackoffRetries( NetworkContext_t * pNetworkContext
                    AWS_IOT_ENDPOINT_LENGTH,
                    AWS_IOT_ENDPOINT,
                    AWS_MQTT_PORT ) );
-        tlsStatus = xTlsConnect ( pNetworkContext );
+        ulAttemptStartMs = Clock_GetTimeMs();
+        returnStatus = EXIT_FAILURE;
+        tlsStatus = mqtt_transport_connect( pNetworkContext );
 
         if( tlsStatus == TLS_TRANSPORT_SUCCESS )
         {
@@ -754,6 +1120,8 @@ static int connectToServerWithBackoffRetries( NetworkContext_t * pNetworkContext
             }
         }
 
+        mqtt_metrics_record_connect( returnStatus == EXIT_SUCCESS, Clock_GetTimeMs() - ulAttemptStartMs );
+
         if( returnStatus == EXIT_FAILURE )
         {
             /* Generate a random number and get back-off value (in milliseconds) for the next connection retry. */
@@ -769,6 +1137,7 @@ static int connectToServerWithBackoffRetries( NetworkContext_t * pNetworkContext
                 LogWarn( ( "Connection to the broker failed. Retrying connection "
                            "after %hu ms backoff.",
                            ( unsigned short ) nextRetryBackOff ) );
+                mqtt_metrics_record_backoff( nextRetryBackOff );
                 Clock_SleepMs( nextRetryBackOff );
             }
         }
@@ -782,34 +1151,139 @@ static int connectToServerWithBackoffRetries( NetworkContext_t * pNetworkContext
 static int getNextFreeIndexForOutgoingPublishes( uint8_t * pIndex )
 {
     int returnStatus = EXIT_FAILURE;
-    uint8_t index = 0;
 
-    assert( outgoingPublishPackets != NULL );
     assert( pIndex != NULL );
 
-    for( index = 0; index < MAX_OUTGOING_PUBLISHES; index++ )
+    /* The slot stays free until storeOutgoingPublishAt() takes it, so this
+     * can also be used to check for room. */
+    *pIndex = MAX_OUTGOING_PUBLISHES;
+
+    if( freeOutgoingPublishCount > 0U )
+    {
+        *pIndex = freeOutgoingPublishes[ freeOutgoingPublishCount - 1U ];
+        returnStatus = EXIT_SUCCESS;
+    }
+
+    return returnStatus;
+}
+
+/*-----------------------------------------------------------*/
+
+static void storeOutgoingPublishAt( uint8_t index,
+                                    uint16_t packetId )
+{
+    uint32_t bucket = packetId & ( OUTGOING_PUBLISH_INDEX_SIZE - 1U );
+    uint8_t inFlight;
+
+    assert( index < MAX_OUTGOING_PUBLISHES );
+    assert( freeOutgoingPublishCount > 0U );
+    assert( freeOutgoingPublishes[ freeOutgoingPublishCount - 1U ] == index );
+    assert( packetId != MQTT_PACKET_ID_INVALID );
+
+    freeOutgoingPublishCount--;
+    outgoingPublishPackets[ index ].packetId = packetId;
+
+    /* Linear probing, the index is never more than half full. */
+    while( outgoingPublishIndex[ bucket ] != 0U )
+    {
+        bucket = ( bucket + 1U ) & ( OUTGOING_PUBLISH_INDEX_SIZE - 1U );
+    }
+
+    outgoingPublishIndex[ bucket ] = index + 1U;
+
+    inFlight = MAX_OUTGOING_PUBLISHES - freeOutgoingPublishCount;
+
+    if( inFlight > globalPeakInFlight )
+    {
+        globalPeakInFlight = inFlight;
+    }
+}
+
+/*-----------------------------------------------------------*/
+
+static uint8_t findOutgoingPublish( uint16_t packetId )
+{
+    uint32_t bucket = packetId & ( OUTGOING_PUBLISH_INDEX_SIZE - 1U );
+    uint8_t slot;
+
+    while( ( slot = outgoingPublishIndex[ bucket ] ) != 0U )
     {
-        /* A free index is marked by invalid packet id.
-         * Check if the the index has a free slot. */
-        if( outgoingPublishPackets[ index ].packetId == MQTT_PACKET_ID_INVALID )
+        if( outgoingPublishPackets[ slot - 1U ].packetId == packetId )
         {
-            returnStatus = EXIT_SUCCESS;
-            break;
+            return slot - 1U;
         }
+
+        bucket = ( bucket + 1U ) & ( OUTGOING_PUBLISH_INDEX_SIZE - 1U );
     }
 
-    /* Copy the available index into the output param. */
-    *pIndex = index;
+    return MAX_OUTGOING_PUBLISHES;
+}
 
-    return returnStatus;
+/*-----------------------------------------------------------*/
+
+static uint16_t getFreePacketId( MQTTContext_t * pMqttContext )
+{
+    uint16_t packetId;
+
+    /* At most MAX_OUTGOING_PUBLISHES ids are taken, so this ends. */
+    do
+    {
+        packetId = MQTT_GetPacketId( pMqttContext );
+    } while( findOutgoingPublish( packetId ) < MAX_OUTGOING_PUBLISHES );
+
+    return packetId;
 }
+
 /*-----------------------------------------------------------*/
 
 static void cleanupOutgoingPublishAt( uint8_t index )
 {
+    uint16_t packetId;
+    uint32_t bucket, next, home;
+    uint8_t slot;
+
     assert( outgoingPublishPackets != NULL );
     assert( index < MAX_OUTGOING_PUBLISHES );
 
+    packetId = outgoingPublishPackets[ index ].packetId;
+
+    if( packetId != MQTT_PACKET_ID_INVALID )
+    {
+        #if CONFIG_MQTT_SESSION_STORE
+            mqtt_session_store_remove( packetId );
+        #endif
+
+        /* Find the index entry of the slot. */
+        bucket = packetId & ( OUTGOING_PUBLISH_INDEX_SIZE - 1U );
+
+        while( outgoingPublishIndex[ bucket ] != index + 1U )
+        {
+            bucket = ( bucket + 1U ) & ( OUTGOING_PUBLISH_INDEX_SIZE - 1U );
+        }
+
+        /* Remove it and shift back the entries of the probe run after it,
+         * so lookups never stop at the hole. */
+        outgoingPublishIndex[ bucket ] = 0U;
+        next = ( bucket + 1U ) & ( OUTGOING_PUBLISH_INDEX_SIZE - 1U );
+
+        while( ( slot = outgoingPublishIndex[ next ] ) != 0U )
+        {
+            home = outgoingPublishPackets[ slot - 1U ].packetId & ( OUTGOING_PUBLISH_INDEX_SIZE - 1U );
+
+            if( ( ( next - home ) & ( OUTGOING_PUBLISH_INDEX_SIZE - 1U ) ) >=
+                ( ( next - bucket ) & ( OUTGOING_PUBLISH_INDEX_SIZE - 1U ) ) )
+            {
+                outgoingPublishIndex[ bucket ] = slot;
+                outgoingPublishIndex[ next ] = 0U;
+                bucket = next;
+            }
+
+            next = ( next + 1U ) & ( OUTGOING_PUBLISH_INDEX_SIZE - 1U );
+        }
+
+        freeOutgoingPublishes[ freeOutgoingPublishCount++ ] = index;
+    }
+
     /* Clear the outgoing publish packet. */
     ( void ) memset( &( outgoingPublishPackets[ index ] ),
                      0x00,
@@ -820,31 +1294,51 @@ static void cleanupOutgoingPublishAt( uint8_t index )
 
 static void cleanupOutgoingPublishes( void )
 {
+    uint8_t index = 0;
+
     assert( outgoingPublishPackets != NULL );
 
+    /* The broker dropped the session, so these will never be acked. */
+    for( ; index < MAX_OUTGOING_PUBLISHES; index++ )
+    {
+        mqtt_agent_complete( &( outgoingPublishPackets[ index ].cmd ), ESP_FAIL );
+    }
+
     /* Clean up all the outgoing publish packets. */
     ( void ) memset( outgoingPublishPackets, 0x00, sizeof( outgoingPublishPackets ) );
+    ( void ) memset( outgoingPublishIndex, 0x00, sizeof( outgoingPublishIndex ) );
+
+    /* Every slot is free again, handed out from the lowest. */
+    for( index = 0; index < MAX_OUTGOING_PUBLISHES; index++ )
+    {
+        freeOutgoingPublishes[ index ] = MAX_OUTGOING_PUBLISHES - 1U - index;
+    }
+
+    freeOutgoingPublishCount = MAX_OUTGOING_PUBLISHES;
 }
 
 /*-----------------------------------------------------------*/
 
 static void cleanupOutgoingPublishWithPacketID( uint16_t packetId )
 {
-    uint8_t index = 0;
+    uint8_t index;
+    uint32_t rttMs;
 
     assert( outgoingPublishPackets != NULL );
     assert( packetId != MQTT_PACKET_ID_INVALID );
 
-    /* Clean up all the saved outgoing publishes. */
-    for( ; index < MAX_OUTGOING_PUBLISHES; index++ )
+    index = findOutgoingPublish( packetId );
+
+    if( index < MAX_OUTGOING_PUBLISHES )
     {
-        if( outgoingPublishPackets[ index ].packetId == packetId )
-        {
-            cleanupOutgoingPublishAt( index );
-            LogInfo( ( "Cleaned up outgoing publish packet with packet id %u.\n\n",
-                       packetId ) );
-            break;
-        }
+        rttMs = Clock_GetTimeMs() - outgoingPublishPackets[ index ].sentTimeMs;
+        mqtt_metrics_record_puback( rttMs );
+        mqtt_pacer_on_ack( &globalPacer, rttMs, Clock_GetTimeMs() );
+
+        mqtt_agent_complete( &( outgoingPublishPackets[ index ].cmd ), ESP_OK );
+        cleanupOutgoingPublishAt( index );
+        LogInfo( ( "Cleaned up outgoing publish packet with packet id %u.\n\n",
+                   packetId ) );
     }
 }
 
@@ -865,43 +1359,42 @@ static int handlePublishResend( MQTTContext_t * pMqttContext )
     /* MQTT_PublishToResend() provides a packet ID of the next PUBLISH packet
      * that should be resent. In accordance with the MQTT v3.1.1 spec,
      * MQTT_PublishToResend() preserves the ordering of when the original
-     * PUBLISH packets were sent. The outgoingPublishPackets array is searched
-     * through for the associated packet ID. If the application requires
-     * increased efficiency in the look up of the packet ID, then a hashmap of
-     * packetId key and PublishPacket_t values may be used instead. */
+     * PUBLISH packets were sent. The outgoingPublishIndex maps the packet ID
+     * to its slot in the outgoingPublishPackets array. */
     packetIdToResend = MQTT_PublishToResend( pMqttContext, &cursor );
 
     while( packetIdToResend != MQTT_PACKET_ID_INVALID )
     {
         foundPacketId = false;
 
-        for( index = 0U; index < MAX_OUTGOING_PUBLISHES; index++ )
+        index = findOutgoingPublish( packetIdToResend );
+
+        if( index < MAX_OUTGOING_PUBLISHES )
         {
-            if( outgoingPublishPackets[ index ].packetId == packetIdToResend )
+            foundPacketId = true;
+            outgoingPublishPackets[ index ].sentTimeMs = Clock_GetTimeMs();
+            outgoingPublishPackets[ index ].pubInfo.dup = true;
+            mqtt_metrics_record_resend();
+
+            LogInfo( ( "Sending duplicate PUBLISH with packet id %u.",
+                       outgoingPublishPackets[ index ].packetId ) );
+            mqttStatus = MQTT_Publish( pMqttContext,
+                                       &outgoingPublishPackets[ index ].pubInfo,
+                                       outgoingPublishPackets[ index ].packetId );
+
+            if( mqttStatus != MQTTSuccess )
             {
-                foundPacketId = true;
-                outgoingPublishPackets[ index ].pubInfo.dup = true;
-
-                LogInfo( ( "Sending duplicate PUBLISH with packet id %u.",
+                LogError( ( "Sending duplicate PUBLISH for packet id %u "
+                            " failed with status %s.",
+                            outgoingPublishPackets[ index ].packetId,
+                            MQTT_Status_strerror( mqttStatus ) ) );
+                returnStatus = EXIT_FAILURE;
+                break;
+            }
+            else
+            {
+                LogInfo( ( "Sent duplicate PUBLISH successfully for packet id %u.\n\n",
                            outgoingPublishPackets[ index ].packetId ) );
-                mqttStatus = MQTT_Publish( pMqttContext,
-                                           &outgoingPublishPackets[ index ].pubInfo,
-                                           outgoingPublishPackets[ index ].packetId );
-
-                if( mqttStatus != MQTTSuccess )
-                {
-                    LogError( ( "Sending duplicate PUBLISH for packet id %u "
-                                " failed with status %s.",
-                                outgoingPublishPackets[ index ].packetId,
-                                MQTT_Status_strerror( mqttStatus ) ) );
-                    returnStatus = EXIT_FAILURE;
-                    break;
-                }
-                else
-                {
-                    LogInfo( ( "Sent duplicate PUBLISH successfully for packet id %u.\n\n",
-                               outgoingPublishPackets[ index ].packetId ) );
-                }
             }
         }
 
@@ -933,8 +1426,15 @@ static void handleIncomingPublish( MQTTPublishInfo_t * pPublishInfo,
     /* Process incoming Publish. */
     LogInfo( ( "Incoming QOS : %d.", pPublishInfo->qos ) );
 
+    /* Hand the publish to the agent subscriptions first. */
+    if( mqtt_agent_dispatch_incoming( pPublishInfo ) == true )
+    {
+        LogDebug( ( "Incoming Publish Topic Name: %.*s dispatched to the agent subscriptions.",
+                    pPublishInfo->topicNameLength,
+                    pPublishInfo->pTopicName ) );
+    }
     /* Verify the received publish is for the topic we have subscribed to. */
-    if( ( pPublishInfo->topicNameLength == MQTT_EXAMPLE_TOPIC_LENGTH ) &&
+    else if( ( pPublishInfo->topicNameLength == MQTT_EXAMPLE_TOPIC_LENGTH ) &&
         ( 0 == strncmp( MQTT_EXAMPLE_TOPIC,
                         pPublishInfo->pTopicName,
                         pPublishInfo->topicNameLength ) ) )
@@ -1087,6 +1587,12 @@ static void eventCallback( MQTTContext_t * pMqttContext,
         {
             case MQTT_PACKET_TYPE_SUBACK:
 
+                /* Requests of the agent complete their own command. */
+                if( completePendingAck( pPacketInfo, packetIdentifier ) == true )
+                {
+                    break;
+                }
+
                 /* A SUBACK from the broker, containing the server response to our subscription request, has been received.
                  * It contains the status code indicating server approval/rejection for the subscription to the single topic
                  * requested. The SUBACK will be parsed to obtain the status code, and this status code will be stored in global
@@ -1112,6 +1618,13 @@ static void eventCallback( MQTTContext_t * pMqttContext,
                 break;
 
             case MQTT_PACKET_TYPE_UNSUBACK:
+
+                /* Requests of the agent complete their own command. */
+                if( completePendingAck( pPacketInfo, packetIdentifier ) == true )
+                {
+                    break;
+                }
+
                 LogInfo( ( "Unsubscribed from the topic %.*s.\n\n",
                            MQTT_EXAMPLE_TOPIC_LENGTH,
                            MQTT_EXAMPLE_TOPIC ) );
@@ -1340,54 +1853,187 @@ static int unsubscribeFromTopic( MQTTContext_t * pMqttContext )
 
 static int publishToTopic( MQTTContext_t * pMqttContext )
 {
-	char cPayload[100];
-	sprintf(cPayload, "%s : %d, %s : %d, %s : %d","WiFi RSSI",wifi_app_get_rssi(),"Temperature", DHT11_read().temperature, "Humidity", DHT11_read().humidity);
+    int returnStatus = EXIT_SUCCESS;
+    char cPayload[ MQTT_TELEMETRY_PAYLOAD_SIZE ];
+    mqtt_agent_cmd_t command;
+    struct dht11_reading reading = DHT11_read();
+    telemetry_sample_t sample = { 0 };
+    int payloadLength;
+
+    assert( pMqttContext != NULL );
+
+    sample.t_ms = ( uint32_t ) ( esp_timer_get_time() / 1000 );
+    sample.temperature = reading.temperature;
+    sample.humidity = reading.humidity;
+    sample.rssi = wifi_app_get_rssi();
+    sample.status = reading.status;
+
+    /* The demo echoes its publishes back to the log, so it keeps to JSON
+     * whatever encoding the telemetry task uses. */
+    payloadLength = telemetry_codec_encode_sample( TELEMETRY_CODEC_JSON, &sample, cPayload, sizeof( cPayload ) );
+
+    /* This example publishes to only one topic and uses QOS1. The command
+     * keeps its own copy of the payload for a resend after a reconnect. */
+    if( mqtt_agent_cmd_init_publish( &command, MQTT_EXAMPLE_TOPIC, cPayload, ( size_t ) payloadLength,
+                                     MQTTQoS1, NULL, NULL ) != ESP_OK )
+    {
+        LogError( ( "Unable to allocate the outgoing PUBLISH message.\n\n" ) );
+        returnStatus = EXIT_FAILURE;
+    }
+    else
+    {
+        returnStatus = publishCommand( pMqttContext, &command );
+    }
+
+    return returnStatus;
+}
+
+/*-----------------------------------------------------------*/
+
+static int publishCommand( MQTTContext_t * pMqttContext,
+                           mqtt_agent_cmd_t * pCommand )
+{
     int returnStatus = EXIT_SUCCESS;
     MQTTStatus_t mqttStatus = MQTTSuccess;
+    MQTTPublishInfo_t publishInfo = { 0 };
     uint8_t publishIndex = MAX_OUTGOING_PUBLISHES;
 
     assert( pMqttContext != NULL );
+    assert( pCommand != NULL );
 
-    /* Get the next free index for the outgoing publish. All QoS1 outgoing
-     * publishes are stored until a PUBACK is received. These messages are
-     * stored for supporting a resend if a network connection is broken before
-     * receiving a PUBACK. */
-    returnStatus = getNextFreeIndexForOutgoingPublishes( &publishIndex );
+    publishInfo.qos = pCommand->qos;
+    publishInfo.retain = pCommand->retain;
+    publishInfo.pTopicName = pCommand->topic;
+    publishInfo.topicNameLength = pCommand->topic_len;
+    publishInfo.pPayload = pCommand->payload;
+    publishInfo.payloadLength = pCommand->payload_len;
 
-    if( returnStatus == EXIT_FAILURE )
+    if( pCommand->qos == MQTTQoS0 )
     {
-        LogError( ( "Unable to find a free spot for outgoing PUBLISH message.\n\n" ) );
+        /* Nothing is kept for resend, the command completes once sent. */
+        mqttStatus = MQTT_Publish( pMqttContext, &publishInfo, MQTT_PACKET_ID_INVALID );
+
+        if( mqttStatus != MQTTSuccess )
+        {
+            LogError( ( "Failed to send PUBLISH packet to broker with error = %s.",
+                        MQTT_Status_strerror( mqttStatus ) ) );
+            returnStatus = EXIT_FAILURE;
+        }
+
+        mqtt_agent_complete( pCommand, ( returnStatus == EXIT_SUCCESS ) ? ESP_OK : ESP_FAIL );
     }
     else
     {
-        /* This example publishes to only one topic and uses QOS1. */
-        outgoingPublishPackets[ publishIndex ].pubInfo.qos = MQTTQoS1;
-        outgoingPublishPackets[ publishIndex ].pubInfo.pTopicName = MQTT_EXAMPLE_TOPIC;
-        outgoingPublishPackets[ publishIndex ].pubInfo.topicNameLength = MQTT_EXAMPLE_TOPIC_LENGTH;
-        outgoingPublishPackets[ publishIndex ].pubInfo.pPayload = cPayload;
-        outgoingPublishPackets[ publishIndex ].pubInfo.payloadLength = strlen(cPayload);
+        /* Get the next free index for the outgoing publish. All QoS1 outgoing
+         * publishes are stored until a PUBACK is received. These messages are
+         * stored for supporting a resend if a network connection is broken before
+         * receiving a PUBACK. */
+        returnStatus = getNextFreeIndexForOutgoingPublishes( &publishIndex );
 
-        /* Get a new packet id. */
-        outgoingPublishPackets[ publishIndex ].packetId = MQTT_GetPacketId( pMqttContext );
+        if( returnStatus == EXIT_FAILURE )
+        {
+            LogError( ( "Unable to find a free spot for outgoing PUBLISH message.\n\n" ) );
+            mqtt_agent_complete( pCommand, ESP_ERR_NO_MEM );
+        }
+        else
+        {
+            /* The slot takes over the command, pubInfo points into its buffer. */
+            outgoingPublishPackets[ publishIndex ].cmd = *pCommand;
+            ( void ) memset( pCommand, 0x00, sizeof( *pCommand ) );
+            outgoingPublishPackets[ publishIndex ].pubInfo = publishInfo;
+
+            /* Get a new packet id and index the slot by it. */
+            storeOutgoingPublishAt( publishIndex, getFreePacketId( pMqttContext ) );
+            outgoingPublishPackets[ publishIndex ].sentTimeMs = Clock_GetTimeMs();
+
+            #if CONFIG_MQTT_SESSION_STORE
+                /* Journaled before the send, a reset while it is on the way
+                 * resends it after boot. One that does not fit is only kept
+                 * in RAM, as before. */
+                ( void ) mqtt_session_store_add( outgoingPublishPackets[ publishIndex ].packetId,
+                                                 publishInfo.pTopicName,
+                                                 publishInfo.topicNameLength,
+                                                 publishInfo.pPayload,
+                                                 publishInfo.payloadLength,
+                                                 publishInfo.retain );
+            #endif
+
+            /* Send PUBLISH packet. */
+            mqttStatus = MQTT_Publish( pMqttContext,
+                                       &outgoingPublishPackets[ publishIndex ].pubInfo,
+                                       outgoingPublishPackets[ publishIndex ].packetId );
+
+            if( mqttStatus != MQTTSuccess )
+            {
+                LogError( ( "Failed to send PUBLISH packet to broker with error = %s.",
+                            MQTT_Status_strerror( mqttStatus ) ) );
+                mqtt_pacer_on_loss( &globalPacer, outgoingPublishPackets[ publishIndex ].sentTimeMs, Clock_GetTimeMs() );
+                mqtt_agent_complete( &( outgoingPublishPackets[ publishIndex ].cmd ), ESP_FAIL );
+                cleanupOutgoingPublishAt( publishIndex );
+                returnStatus = EXIT_FAILURE;
+            }
+            else
+            {
+                mqtt_pacer_on_send( &globalPacer, outgoingPublishPackets[ publishIndex ].sentTimeMs );
+            }
+        }
+    }
+
+    if( returnStatus == EXIT_SUCCESS )
+    {
+        globalPublishedSamples++;
+        LogDebug( ( "PUBLISH sent for topic %.*s to broker with packet ID %u.\n\n",
+                    publishInfo.topicNameLength,
+                    publishInfo.pTopicName,
+                    ( publishInfo.qos == MQTTQoS0 ) ? MQTT_PACKET_ID_INVALID : outgoingPublishPackets[ publishIndex ].packetId ) );
+    }
+
+    return returnStatus;
+}
+
+/*-----------------------------------------------------------*/
+
+static int publishSummaryToTopic( MQTTContext_t * pMqttContext )
+{
+    /* Kept off the stack, the summary grows with every metric fed to the windows. */
+    static char cPayload[ MQTT_SUMMARY_PAYLOAD_SIZE ];
+    int payloadLength;
+    int returnStatus = EXIT_SUCCESS;
+    MQTTStatus_t mqttStatus = MQTTSuccess;
+    MQTTPublishInfo_t publishInfo = { 0 };
+
+    assert( pMqttContext != NULL );
+
+    payloadLength = sensor_window_to_json( cPayload, sizeof( cPayload ), ( uint32_t ) ( esp_timer_get_time() / 1000 ) );
+
+    if( payloadLength < 0 )
+    {
+        LogError( ( "Sensor summary does not fit in %u bytes.", MQTT_SUMMARY_PAYLOAD_SIZE ) );
+        returnStatus = EXIT_FAILURE;
+    }
+    else
+    {
+        /* The summary is superseded by the next one, so QoS0 is used and
+         * nothing is kept for resend. */
+        publishInfo.qos = MQTTQoS0;
+        publishInfo.pTopicName = MQTT_SUMMARY_TOPIC;
+        publishInfo.topicNameLength = MQTT_SUMMARY_TOPIC_LENGTH;
+        publishInfo.pPayload = cPayload;
+        publishInfo.payloadLength = ( size_t ) payloadLength;
 
-        /* Send PUBLISH packet. */
-        mqttStatus = MQTT_Publish( pMqttContext,
-                                   &outgoingPublishPackets[ publishIndex ].pubInfo,
-                                   outgoingPublishPackets[ publishIndex ].packetId );
+        mqttStatus = MQTT_Publish( pMqttContext, &publishInfo, MQTT_PACKET_ID_INVALID );
 
         if( mqttStatus != MQTTSuccess )
         {
-            LogError( ( "Failed to send PUBLISH packet to broker with error = %s.",
+            LogError( ( "Failed to send summary PUBLISH packet to broker with error = %s.",
                         MQTT_Status_strerror( mqttStatus ) ) );
-            cleanupOutgoingPublishAt( publishIndex );
             returnStatus = EXIT_FAILURE;
         }
         else
         {
-            LogInfo( ( "PUBLISH sent for topic %.*s to broker with packet ID %u.\n\n",
-                       MQTT_EXAMPLE_TOPIC_LENGTH,
-                       MQTT_EXAMPLE_TOPIC,
-                       outgoingPublishPackets[ publishIndex ].packetId ) );
+            LogInfo( ( "PUBLISH sent for topic %.*s to broker.\n\n",
+                       MQTT_SUMMARY_TOPIC_LENGTH,
+                       MQTT_SUMMARY_TOPIC ) );
         }
     }
 
@@ -1411,9 +2057,15 @@ static int initializeMqtt( MQTTContext_t * pMqttContext,
      * For this demo, TCP sockets are used to send and receive data
      * from network. Network context is SSL context for OpenSSL.*/
     transport.pNetworkContext = pNetworkContext;
-    transport.send = espTlsTransportSend;
-    transport.recv = espTlsTransportRecv;
+    transport.send = mqtt_transport_send;
+    transport.recv = mqtt_transport_recv;
+#if CONFIG_MQTT_TRANSPORT_WRITEV
+    /* Publishes go out as one TLS record instead of one per header, topic
+     * and payload. */
+    transport.writev = mqtt_transport_writev;
+#else
     transport.writev = NULL;
+#endif
 
     /* Fill the values for network buffer. */
     networkBuffer.pBuffer = buffer;
@@ -1433,6 +2085,9 @@ static int initializeMqtt( MQTTContext_t * pMqttContext,
     }
     else
     {
+        /* Start with every outgoing publish slot free. */
+        cleanupOutgoingPublishes();
+
         mqttStatus = MQTT_InitStatefulQoS( pMqttContext,
                                            pOutgoingPublishRecords,
                                            OUTGOING_PUBLISH_RECORD_LEN,
@@ -1526,6 +2181,7 @@ static int subscribePublishLoop( MQTTContext_t * pMqttContext )
             {
                 LogError( ( "MQTT_ProcessLoop returned with status = %s.",
                             MQTT_Status_strerror( mqttStatus ) ) );
+                mqtt_metrics_record_loop_error( mqttStatus );
                 returnStatus = EXIT_FAILURE;
                 break;
             }
@@ -1537,6 +2193,12 @@ static int subscribePublishLoop( MQTTContext_t * pMqttContext )
         }
     }
 
+    if( returnStatus == EXIT_SUCCESS )
+    {
+        /* Publish the sliding-window aggregates once per iteration. */
+        returnStatus = publishSummaryToTopic( pMqttContext );
+    }
+
     if( returnStatus == EXIT_SUCCESS )
     {
         /* Unsubscribe from the topic. */
@@ -1580,6 +2242,737 @@ static int subscribePublishLoop( MQTTContext_t * pMqttContext )
 
 /*-----------------------------------------------------------*/
 
+static int agentCommandLoop( MQTTContext_t * pMqttContext,
+                             bool brokerSessionPresent )
+{
+    int returnStatus = EXIT_SUCCESS;
+    MQTTStatus_t mqttStatus = MQTTSuccess;
+    uint32_t ulCurrentTime;
+    uint32_t ulLastReportTime;
+    TickType_t xWait;
+
+    #if CONFIG_MQTT_SESSION_STORE && ( CONFIG_MQTT_SESSION_STORE_FLUSH_S > 0 )
+        uint32_t ulLastFlushTime;
+    #endif
+
+    assert( pMqttContext != NULL );
+
+    ulLastReportTime = pMqttContext->getTime();
+
+    #if CONFIG_MQTT_SESSION_STORE && ( CONFIG_MQTT_SESSION_STORE_FLUSH_S > 0 )
+        ulLastFlushTime = ulLastReportTime;
+    #endif
+
+    /* A new connection may take another route, the window starts over. */
+    mqtt_pacer_init( &globalPacer, MAX_OUTGOING_PUBLISHES, ulLastReportTime );
+
+    /* A clean session lost the subscriptions made through the agent. */
+    if( brokerSessionPresent == false )
+    {
+        returnStatus = resubscribeAgentTopics( pMqttContext );
+    }
+
+    /* Producers queue live data again instead of keeping it back. */
+    mqtt_agent_set_connected( returnStatus == EXIT_SUCCESS );
+
+    while( returnStatus == EXIT_SUCCESS )
+    {
+        ulCurrentTime = pMqttContext->getTime();
+
+        /* Time comparisons are done on the difference so they survive the
+         * 32 bit millisecond counter wrapping. */
+        if( ( uint32_t ) ( ulCurrentTime - ulLastReportTime ) >= MQTT_STATS_REPORT_INTERVAL_MS )
+        {
+            logTransportStats();
+            logAgentStats( ulCurrentTime - ulLastReportTime );
+            ulLastReportTime = ulCurrentTime;
+        }
+
+        #if CONFIG_MQTT_SESSION_STORE && ( CONFIG_MQTT_SESSION_STORE_FLUSH_S > 0 )
+            /* One NVS write covers every publish and PUBACK since the last. */
+            if( ( uint32_t ) ( ulCurrentTime - ulLastFlushTime ) >= CONFIG_MQTT_SESSION_STORE_FLUSH_S * 1000U )
+            {
+                ( void ) mqtt_session_store_flush();
+                ulLastFlushTime = ulCurrentTime;
+            }
+        #endif
+
+        /* Drain the command queue. Only the first receive blocks, so an idle
+         * agent still gets to MQTT_ProcessLoop every MQTT_AGENT_POLL_MS. */
+        xWait = pdMS_TO_TICKS( MQTT_AGENT_POLL_MS );
+
+        for( ; ; )
+        {
+            if( heldAgentCommand.topic == NULL )
+            {
+                announceTopicAliases( &heldAgentCommand );
+            }
+
+            if( ( heldAgentCommand.topic == NULL ) &&
+                ( mqtt_agent_receive( &heldAgentCommand, xWait ) == false ) )
+            {
+                break;
+            }
+
+            if( agentCommandHasRoom( &heldAgentCommand ) == false )
+            {
+                /* Hold the command until an ack frees a slot; producers see
+                 * the queue fill up instead of the agent dropping commands. */
+                if( xWait != 0 )
+                {
+                    vTaskDelay( xWait );
+                }
+
+                break;
+            }
+
+            xWait = 0;
+            returnStatus = executeAgentCommand( pMqttContext, &heldAgentCommand );
+
+            if( returnStatus != EXIT_SUCCESS )
+            {
+                break;
+            }
+        }
+
+        if( returnStatus != EXIT_SUCCESS )
+        {
+            break;
+        }
+
+        checkOverduePublishes( pMqttContext->getTime() );
+
+        /* Receive acks and incoming publishes. MQTT_ProcessLoop sends PINGREQ
+         * on its own once MQTT_KEEP_ALIVE_INTERVAL_SECONDS pass without other
+         * traffic. */
+        mqttStatus = MQTT_ProcessLoop( pMqttContext );
+
+        if( ( mqttStatus != MQTTSuccess ) && ( mqttStatus != MQTTNeedMoreBytes ) )
+        {
+            LogError( ( "MQTT_ProcessLoop returned with status = %s.",
+                        MQTT_Status_strerror( mqttStatus ) ) );
+            mqtt_metrics_record_loop_error( mqttStatus );
+            returnStatus = EXIT_FAILURE;
+        }
+    }
+
+    mqtt_agent_set_connected( false );
+
+    return returnStatus;
+}
+
+/*-----------------------------------------------------------*/
+
+static bool agentCommandHasRoom( const mqtt_agent_cmd_t * pCommand )
+{
+    uint8_t index = 0U;
+
+    assert( pCommand != NULL );
+
+    if( pCommand->type == MQTT_AGENT_CMD_PUBLISH )
+    {
+        if( ( pCommand->qos != MQTTQoS0 ) &&
+            ( getNextFreeIndexForOutgoingPublishes( &index ) != EXIT_SUCCESS ) )
+        {
+            globalWindowFullWaits++;
+            return false;
+        }
+
+        #if CONFIG_MQTT_PACER
+            /* The queue fills up behind a held publish, which is the
+             * backpressure producers see. */
+            if( ( pCommand->qos != MQTTQoS0 ) &&
+                ( mqtt_pacer_can_send( &globalPacer,
+                                       MAX_OUTGOING_PUBLISHES - freeOutgoingPublishCount,
+                                       Clock_GetTimeMs() ) == false ) )
+            {
+                globalPacerWaits++;
+                return false;
+            }
+        #endif /* CONFIG_MQTT_PACER */
+
+        return true;
+    }
+
+    return getNextFreeIndexForPendingAcks( &index ) == EXIT_SUCCESS;
+}
+
+/*-----------------------------------------------------------*/
+
+static int executeAgentCommand( MQTTContext_t * pMqttContext,
+                                mqtt_agent_cmd_t * pCommand )
+{
+    int returnStatus = EXIT_SUCCESS;
+    MQTTStatus_t mqttStatus = MQTTSuccess;
+    MQTTSubscribeInfo_t subscription = { 0 };
+    uint8_t ackIndex = MAX_PENDING_ACKS;
+
+    assert( pMqttContext != NULL );
+    assert( pCommand != NULL );
+
+    if( pCommand->type == MQTT_AGENT_CMD_PUBLISH )
+    {
+        return publishCommand( pMqttContext, pCommand );
+    }
+
+    if( getNextFreeIndexForPendingAcks( &ackIndex ) == EXIT_FAILURE )
+    {
+        LogError( ( "Unable to find a free spot for the agent %s request.",
+                    ( pCommand->type == MQTT_AGENT_CMD_SUBSCRIBE ) ? "SUBSCRIBE" : "UNSUBSCRIBE" ) );
+        mqtt_agent_complete( pCommand, ESP_ERR_NO_MEM );
+        return EXIT_SUCCESS;
+    }
+
+    /* The pending entry takes over the command until the ack arrives. */
+    pendingAcks[ ackIndex ].cmd = *pCommand;
+    ( void ) memset( pCommand, 0x00, sizeof( *pCommand ) );
+    pendingAcks[ ackIndex ].packetId = getFreePacketId( pMqttContext );
+
+    subscription.qos = pendingAcks[ ackIndex ].cmd.qos;
+    subscription.pTopicFilter = pendingAcks[ ackIndex ].cmd.topic;
+    subscription.topicFilterLength = pendingAcks[ ackIndex ].cmd.topic_len;
+
+    if( pendingAcks[ ackIndex ].cmd.type == MQTT_AGENT_CMD_SUBSCRIBE )
+    {
+        mqttStatus = MQTT_Subscribe( pMqttContext, &subscription, 1, pendingAcks[ ackIndex ].packetId );
+    }
+    else
+    {
+        mqttStatus = MQTT_Unsubscribe( pMqttContext, &subscription, 1, pendingAcks[ ackIndex ].packetId );
+    }
+
+    if( mqttStatus != MQTTSuccess )
+    {
+        LogError( ( "Failed to send agent request for %.*s to broker with error = %s.",
+                    subscription.topicFilterLength,
+                    subscription.pTopicFilter,
+                    MQTT_Status_strerror( mqttStatus ) ) );
+        mqtt_agent_complete( &( pendingAcks[ ackIndex ].cmd ), ESP_FAIL );
+        pendingAcks[ ackIndex ].packetId = MQTT_PACKET_ID_INVALID;
+        returnStatus = EXIT_FAILURE;
+    }
+
+    return returnStatus;
+}
+
+/*-----------------------------------------------------------*/
+
+static int resubscribeAgentTopics( MQTTContext_t * pMqttContext )
+{
+    int returnStatus = EXIT_SUCCESS;
+    MQTTStatus_t mqttStatus = MQTTSuccess;
+    MQTTSubscribeInfo_t subscriptions[ MQTT_AGENT_RESUBSCRIBE_BATCH ];
+    size_t subscriptionCount;
+    size_t renewedCount = 0U;
+    uint16_t cursor = MQTT_ROUTER_NONE;
+    uint8_t ackIndex = MAX_PENDING_ACKS;
+    uint32_t ulEntryTime;
+
+    assert( pMqttContext != NULL );
+
+    /* One SUBSCRIBE per batch keeps every packet within the network buffer. */
+    while( returnStatus == EXIT_SUCCESS )
+    {
+        subscriptionCount = mqtt_agent_get_subscriptions( subscriptions, MQTT_AGENT_RESUBSCRIBE_BATCH, &cursor );
+
+        if( subscriptionCount == 0U )
+        {
+            break;
+        }
+
+        /* Once every pending entry is taken, wait for the SUBACK of an
+         * earlier batch. failPendingAcks() emptied the table when the last
+         * session ended. */
+        ulEntryTime = pMqttContext->getTime();
+
+        while( ( returnStatus == EXIT_SUCCESS ) &&
+               ( getNextFreeIndexForPendingAcks( &ackIndex ) == EXIT_FAILURE ) )
+        {
+            mqttStatus = MQTT_ProcessLoop( pMqttContext );
+
+            if( ( ( mqttStatus != MQTTSuccess ) && ( mqttStatus != MQTTNeedMoreBytes ) ) ||
+                ( ( pMqttContext->getTime() - ulEntryTime ) > MQTT_PROCESS_LOOP_TIMEOUT_MS ) )
+            {
+                LogError( ( "No SUBACK for the renewed agent subscriptions, status = %s.",
+                            MQTT_Status_strerror( mqttStatus ) ) );
+                returnStatus = EXIT_FAILURE;
+            }
+        }
+
+        if( returnStatus != EXIT_SUCCESS )
+        {
+            break;
+        }
+
+        /* The entry has no command, the SUBACK only needs to be matched. */
+        pendingAcks[ ackIndex ].packetId = getFreePacketId( pMqttContext );
+
+        mqttStatus = MQTT_Subscribe( pMqttContext,
+                                     subscriptions,
+                                     subscriptionCount,
+                                     pendingAcks[ ackIndex ].packetId );
+
+        if( mqttStatus != MQTTSuccess )
+        {
+            LogError( ( "Failed to renew %u agent subscriptions with error = %s.",
+                        ( unsigned int ) subscriptionCount,
+                        MQTT_Status_strerror( mqttStatus ) ) );
+            pendingAcks[ ackIndex ].packetId = MQTT_PACKET_ID_INVALID;
+            returnStatus = EXIT_FAILURE;
+        }
+        else
+        {
+            renewedCount += subscriptionCount;
+        }
+    }
+
+    if( renewedCount > 0U )
+    {
+        LogInfo( ( "Renewing %u agent subscriptions on the clean session.",
+                   ( unsigned int ) renewedCount ) );
+    }
+
+    return returnStatus;
+}
+
+/*-----------------------------------------------------------*/
+
+static void announceTopicAliases( mqtt_agent_cmd_t * pCommand )
+{
+    /* Only the agent task builds the map, it is copied into the command. */
+    static char aliasMap[ MQTT_TOPIC_ALIAS_MAP_MAX_LEN ];
+    uint8_t aliasCount = mqtt_topic_alias_count();
+    int mapLength;
+
+    assert( pCommand != NULL );
+
+    if( aliasCount == globalAliasesAnnounced )
+    {
+        return;
+    }
+
+    mapLength = mqtt_topic_alias_map_json( aliasCount, aliasMap, sizeof( aliasMap ) );
+
+    if( ( mapLength < 0 ) ||
+        ( mqtt_agent_cmd_init_publish( pCommand, MQTT_TOPIC_ALIAS_MAP_TOPIC, aliasMap, ( size_t ) mapLength,
+                                       MQTTQoS1, topicAliasesAnnounced, ( void * ) ( uintptr_t ) aliasCount ) != ESP_OK ) )
+    {
+        /* The pool is short of blocks, the next loop iteration tries again. */
+        LogDebug( ( "Topic alias map of %u aliases not announced yet.", aliasCount ) );
+        return;
+    }
+
+    /* A subscriber that starts later still gets the map. */
+    pCommand->retain = true;
+    globalAliasesAnnounced = aliasCount;
+
+    LogInfo( ( "Announcing %u topic aliases on %s.", aliasCount, MQTT_TOPIC_ALIAS_MAP_TOPIC ) );
+}
+
+/*-----------------------------------------------------------*/
+
+static void topicAliasesAnnounced( void * pContext,
+                                   esp_err_t result )
+{
+    if( result == ESP_OK )
+    {
+        mqtt_topic_alias_set_announced( ( uint8_t ) ( uintptr_t ) pContext );
+    }
+    else
+    {
+        globalAliasesAnnounced = 0U;
+    }
+}
+
+/*-----------------------------------------------------------*/
+
+static void checkOverduePublishes( uint32_t ulCurrentTime )
+{
+    uint8_t index;
+    uint32_t rtoMs = mqtt_pacer_rto_ms( &globalPacer );
+
+    if( freeOutgoingPublishCount == MAX_OUTGOING_PUBLISHES )
+    {
+        return;
+    }
+
+    for( index = 0; index < MAX_OUTGOING_PUBLISHES; index++ )
+    {
+        if( ( outgoingPublishPackets[ index ].packetId != MQTT_PACKET_ID_INVALID ) &&
+            ( ( uint32_t ) ( ulCurrentTime - outgoingPublishPackets[ index ].sentTimeMs ) > rtoMs ) )
+        {
+            /* The pacer backs off at most once per round trip, and ignores publishes
+             * sent before its last back off. */
+            mqtt_pacer_on_loss( &globalPacer, outgoingPublishPackets[ index ].sentTimeMs, ulCurrentTime );
+        }
+    }
+}
+
+/*-----------------------------------------------------------*/
+
+#if CONFIG_MQTT_SESSION_STORE
+
+/**
+ * @brief State of restoreJournaledPublishes() handed to
+ * restoreJournaledPublish().
+ */
+    typedef struct JournalRestore
+    {
+        MQTTContext_t * pMqttContext;
+        bool brokerSessionPresent;
+        uint8_t count;                              /**< Publishes put back into the table. */
+        uint8_t indexes[ MAX_OUTGOING_PUBLISHES ];  /**< Their slots, oldest first. */
+        uint32_t lost;                              /**< Publishes that could not be put back. */
+    } JournalRestore_t;
+
+/* The journal is only taken over on the first connection after boot. */
+    static bool journalRestorePending = true;
+
+    static void restoreJournaledPublishes( MQTTContext_t * pMqttContext,
+                                           bool brokerSessionPresent )
+    {
+        JournalRestore_t restore = { 0 };
+        PublishPackets_t * pPublish;
+        uint8_t i;
+
+        if( journalRestorePending == false )
+        {
+            if( brokerSessionPresent == false )
+            {
+                /* The publishes still journaled were failed with their slots. */
+                mqtt_session_store_clear();
+            }
+
+            return;
+        }
+
+        journalRestorePending = false;
+        restore.pMqttContext = pMqttContext;
+        restore.brokerSessionPresent = brokerSessionPresent;
+        mqtt_session_store_foreach( restoreJournaledPublish, &restore );
+
+        if( brokerSessionPresent == false )
+        {
+            /* The entries carry the packet ids of the lost session, journal
+             * the publishes again under their new ones. */
+            mqtt_session_store_clear();
+
+            for( i = 0; i < restore.count; i++ )
+            {
+                pPublish = &( outgoingPublishPackets[ restore.indexes[ i ] ] );
+                ( void ) mqtt_session_store_add( pPublish->packetId,
+                                                 pPublish->pubInfo.pTopicName,
+                                                 pPublish->pubInfo.topicNameLength,
+                                                 pPublish->pubInfo.pPayload,
+                                                 pPublish->pubInfo.payloadLength,
+                                                 pPublish->pubInfo.retain );
+            }
+        }
+
+        if( ( restore.count > 0U ) || ( restore.lost > 0U ) )
+        {
+            LogInfo( ( "%u journaled publishes restored %s, %lu lost.",
+                       restore.count,
+                       brokerSessionPresent ? "with their packet ids" : "under new packet ids",
+                       ( unsigned long ) restore.lost ) );
+        }
+    }
+
+/*-----------------------------------------------------------*/
+
+    static void restoreJournaledPublish( void * pContext,
+                                         uint16_t packetId,
+                                         const char * pTopic,
+                                         uint16_t topicLength,
+                                         const uint8_t * pPayload,
+                                         size_t payloadLength,
+                                         bool retain )
+    {
+        JournalRestore_t * pRestore = ( JournalRestore_t * ) pContext;
+        MQTTContext_t * pMqttContext = pRestore->pMqttContext;
+        MQTTPublishState_t publishState;
+        mqtt_agent_cmd_t command;
+        uint8_t index;
+
+        ( void ) topicLength;
+
+        if( ( pRestore->brokerSessionPresent == true ) && ( findOutgoingPublish( packetId ) < MAX_OUTGOING_PUBLISHES ) )
+        {
+            LogWarn( ( "Journaled PUBLISH with packet id %u is a duplicate, it is lost.", packetId ) );
+            pRestore->lost++;
+            mqtt_session_store_remove( packetId );
+            return;
+        }
+
+        if( ( getNextFreeIndexForOutgoingPublishes( &index ) != EXIT_SUCCESS ) ||
+            ( mqtt_agent_cmd_init_publish( &command, pTopic, pPayload, payloadLength, MQTTQoS1, NULL, NULL ) != ESP_OK ) )
+        {
+            LogWarn( ( "Journaled PUBLISH with packet id %u cannot be restored, it is lost.", packetId ) );
+            pRestore->lost++;
+            mqtt_session_store_remove( packetId );
+            return;
+        }
+
+        /* Without a session the broker never acks the old id, the publish is
+         * sent again under a new one. It keeps the DUP flag of the other
+         * resends, the broker may have seen it under the old id. */
+        if( pRestore->brokerSessionPresent == false )
+        {
+            packetId = getFreePacketId( pMqttContext );
+        }
+
+        /* coreMQTT lists it for MQTT_PublishToResend() as if it was sent on
+         * this connection. */
+        if( ( MQTT_ReserveState( pMqttContext, packetId, MQTTQoS1 ) != MQTTSuccess ) ||
+            ( MQTT_UpdateStatePublish( pMqttContext, packetId, MQTT_SEND, MQTTQoS1, &publishState ) != MQTTSuccess ) )
+        {
+            LogWarn( ( "Journaled PUBLISH with packet id %u has no room in the MQTT state, it is lost.", packetId ) );
+            pRestore->lost++;
+            mqtt_agent_complete( &command, ESP_FAIL );
+            mqtt_session_store_remove( packetId );
+            return;
+        }
+
+        command.retain = retain;
+        outgoingPublishPackets[ index ].cmd = command;
+        outgoingPublishPackets[ index ].pubInfo.qos = MQTTQoS1;
+        outgoingPublishPackets[ index ].pubInfo.retain = retain;
+        outgoingPublishPackets[ index ].pubInfo.pTopicName = command.topic;
+        outgoingPublishPackets[ index ].pubInfo.topicNameLength = command.topic_len;
+        outgoingPublishPackets[ index ].pubInfo.pPayload = command.payload;
+        outgoingPublishPackets[ index ].pubInfo.payloadLength = command.payload_len;
+        storeOutgoingPublishAt( index, packetId );
+        outgoingPublishPackets[ index ].sentTimeMs = Clock_GetTimeMs();
+        pRestore->indexes[ pRestore->count++ ] = index;
+    }
+
+#endif /* CONFIG_MQTT_SESSION_STORE */
+
+/*-----------------------------------------------------------*/
+
+static int getNextFreeIndexForPendingAcks( uint8_t * pIndex )
+{
+    int returnStatus = EXIT_FAILURE;
+    uint8_t index = 0;
+
+    assert( pIndex != NULL );
+
+    for( index = 0; index < MAX_PENDING_ACKS; index++ )
+    {
+        if( pendingAcks[ index ].packetId == MQTT_PACKET_ID_INVALID )
+        {
+            returnStatus = EXIT_SUCCESS;
+            break;
+        }
+    }
+
+    *pIndex = index;
+
+    return returnStatus;
+}
+
+/*-----------------------------------------------------------*/
+
+static bool completePendingAck( MQTTPacketInfo_t * pPacketInfo,
+                                uint16_t packetId )
+{
+    uint8_t index = 0U;
+    uint8_t * pStatusCodes = NULL;
+    size_t statusCount = 0U;
+    size_t i;
+    esp_err_t result = ESP_OK;
+
+    assert( pPacketInfo != NULL );
+
+    for( ; index < MAX_PENDING_ACKS; index++ )
+    {
+        if( ( packetId != MQTT_PACKET_ID_INVALID ) && ( pendingAcks[ index ].packetId == packetId ) )
+        {
+            break;
+        }
+    }
+
+    if( index == MAX_PENDING_ACKS )
+    {
+        return false;
+    }
+
+    if( ( pPacketInfo->type == MQTT_PACKET_TYPE_SUBACK ) &&
+        ( MQTT_GetSubAckStatusCodes( pPacketInfo, &pStatusCodes, &statusCount ) == MQTTSuccess ) )
+    {
+        for( i = 0U; i < statusCount; i++ )
+        {
+            if( pStatusCodes[ i ] == ( uint8_t ) MQTTSubAckFailure )
+            {
+                LogWarn( ( "Broker rejected topic filter %u of SUBSCRIBE packet id %u.",
+                           ( unsigned int ) i,
+                           packetId ) );
+                result = ESP_FAIL;
+            }
+        }
+    }
+
+    mqtt_agent_complete( &( pendingAcks[ index ].cmd ), result );
+    pendingAcks[ index ].packetId = MQTT_PACKET_ID_INVALID;
+
+    return true;
+}
+
+/*-----------------------------------------------------------*/
+
+static void failPendingAcks( void )
+{
+    uint8_t index = 0U;
+
+    for( ; index < MAX_PENDING_ACKS; index++ )
+    {
+        mqtt_agent_complete( &( pendingAcks[ index ].cmd ), ESP_FAIL );
+        pendingAcks[ index ].packetId = MQTT_PACKET_ID_INVALID;
+    }
+}
+
+/*-----------------------------------------------------------*/
+
+static void logTransportStats( void )
+{
+    mqtt_transport_stats_t stats;
+    uint32_t fullHandshakes;
+
+    mqtt_transport_get_stats( &stats );
+    fullHandshakes = stats.handshakes - stats.resumed_handshakes;
+
+    LogInfo( ( "Transport: %lu TLS handshakes (%lu failed) in %lld s, %lu per hour; "
+               "%lu full avg %lu ms %lu cycles, %lu resumed avg %lu ms %lu cycles; "
+               "%llu bytes sent, %llu bytes received, %lu samples, %lu bytes per sample, "
+               "%lu TLS writes, %lu.%02lu per publish, %lu cycles per publish.",
+               ( unsigned long ) stats.handshakes,
+               ( unsigned long ) stats.handshake_failures,
+               ( long long ) ( stats.uptime_us / 1000000 ),
+               ( unsigned long ) ( stats.uptime_us > 0 ? ( uint64_t ) stats.handshakes * 3600000000ULL / ( uint64_t ) stats.uptime_us : 0 ),
+               ( unsigned long ) fullHandshakes,
+               ( unsigned long ) ( fullHandshakes ? ( stats.handshake_us - stats.resumed_handshake_us ) / fullHandshakes / 1000 : 0 ),
+               ( unsigned long ) ( fullHandshakes ? ( stats.handshake_cycles - stats.resumed_handshake_cycles ) / fullHandshakes : 0 ),
+               ( unsigned long ) stats.resumed_handshakes,
+               ( unsigned long ) ( stats.resumed_handshakes ? stats.resumed_handshake_us / stats.resumed_handshakes / 1000 : 0 ),
+               ( unsigned long ) ( stats.resumed_handshakes ? stats.resumed_handshake_cycles / stats.resumed_handshakes : 0 ),
+               ( unsigned long long ) stats.bytes_sent,
+               ( unsigned long long ) stats.bytes_received,
+               ( unsigned long ) globalPublishedSamples,
+               ( unsigned long ) ( globalPublishedSamples ? ( stats.bytes_sent + stats.bytes_received ) / globalPublishedSamples : 0 ),
+               ( unsigned long ) stats.tls_writes,
+               ( unsigned long ) ( globalPublishedSamples ? stats.tls_writes / globalPublishedSamples : 0 ),
+               ( unsigned long ) ( globalPublishedSamples ? ( stats.tls_writes * 100U / globalPublishedSamples ) % 100U : 0 ),
+               ( unsigned long ) ( globalPublishedSamples ? stats.tls_write_cycles / globalPublishedSamples : 0 ) ) );
+}
+
+/*-----------------------------------------------------------*/
+
+static void logAgentStats( uint32_t ulElapsedMs )
+{
+    mqtt_agent_stats_t stats;
+    mqtt_slab_stats_t slabStats;
+    mqtt_metrics_t metrics;
+    mqtt_rpc_stats_t rpcStats;
+    #if CONFIG_MQTT_SESSION_STORE
+        mqtt_session_store_stats_t storeStats;
+    #endif
+    uint32_t commands;
+    uint32_t pubAcks;
+    uint32_t rttAvgMs;
+    uint32_t suggestedWindow;
+    uint8_t inFlight = MAX_OUTGOING_PUBLISHES - freeOutgoingPublishCount;
+
+    mqtt_agent_get_stats( &stats );
+    mqtt_slab_get_stats( &slabStats );
+    mqtt_metrics_get( &metrics );
+    commands = ( stats.completed + stats.failed ) - globalReportedCommands;
+    globalReportedCommands = stats.completed + stats.failed;
+    pubAcks = metrics.puback_rtt.count - globalReportedPubAcks;
+    globalReportedPubAcks = metrics.puback_rtt.count;
+
+    /* Bandwidth-delay product: the publishes that must be in flight to keep
+     * the PUBACK rate of this interval going at the measured round trip. */
+    rttAvgMs = metrics.puback_rtt.count ? ( uint32_t ) ( metrics.puback_rtt.sum_ms / metrics.puback_rtt.count ) : 0U;
+    suggestedWindow = ulElapsedMs ? ( uint32_t ) ( ( ( uint64_t ) pubAcks * rttAvgMs + ulElapsedMs - 1U ) / ulElapsedMs ) : 0U;
+
+    LogInfo( ( "Agent: %lu commands in %lu ms, %lu per second; %lu completed, %lu failed, "
+               "%lu rejected on a full queue, %lu expired in the queue, max queue depth %lu of %u, "
+               "%u of %u publishes awaiting PUBACK.",
+               ( unsigned long ) commands,
+               ( unsigned long ) ulElapsedMs,
+               ( unsigned long ) ( ulElapsedMs ? ( uint64_t ) commands * 1000U / ulElapsedMs : 0 ),
+               ( unsigned long ) stats.completed,
+               ( unsigned long ) stats.failed,
+               ( unsigned long ) stats.queue_full,
+               ( unsigned long ) stats.expired,
+               ( unsigned long ) stats.max_depth,
+               MQTT_AGENT_QUEUE_LENGTH,
+               inFlight,
+               MAX_OUTGOING_PUBLISHES ) );
+    LogInfo( ( "QoS1 window: %lu PUBACKs, RTT avg %lu ms p90 %lu ms p99 %lu ms max %lu ms, peak %u of %u in flight, "
+               "%lu waits for a free slot, window needed for this rate %lu.",
+               ( unsigned long ) pubAcks,
+               ( unsigned long ) rttAvgMs,
+               ( unsigned long ) mqtt_metrics_percentile( &metrics.puback_rtt, 90 ),
+               ( unsigned long ) mqtt_metrics_percentile( &metrics.puback_rtt, 99 ),
+               ( unsigned long ) metrics.puback_rtt.max_ms,
+               globalPeakInFlight,
+               MAX_OUTGOING_PUBLISHES,
+               ( unsigned long ) globalWindowFullWaits,
+               ( unsigned long ) suggestedWindow ) );
+    LogInfo( ( "Pacer: window %lu of %u, %lu publishes per second, RTT smoothed %lu ms lowest %lu ms, "
+               "%lu increases, %lu backoffs on delay, %lu on loss, %lu waits.",
+               ( unsigned long ) mqtt_pacer_window( &globalPacer ),
+               MAX_OUTGOING_PUBLISHES,
+               ( unsigned long ) mqtt_pacer_rate( &globalPacer ),
+               ( unsigned long ) globalPacer.srtt_ms,
+               ( unsigned long ) globalPacer.min_rtt_ms,
+               ( unsigned long ) globalPacer.stats.increases,
+               ( unsigned long ) globalPacer.stats.delay_backoffs,
+               ( unsigned long ) globalPacer.stats.loss_backoffs,
+               ( unsigned long ) globalPacerWaits ) );
+    #if CONFIG_MQTT_SESSION_STORE
+        mqtt_session_store_get_stats( &storeStats );
+        LogInfo( ( "Session store: %lu publishes journaled, %lu not kept, %lu compactions, %lu flash writes "
+                   "(%lu per 1000 publishes), %lu restored after boot, %lu corrupt, resent %lu ms after boot.",
+                   ( unsigned long ) storeStats.journaled,
+                   ( unsigned long ) storeStats.skipped,
+                   ( unsigned long ) storeStats.compactions,
+                   ( unsigned long ) storeStats.flash_writes,
+                   ( unsigned long ) ( storeStats.journaled ? ( uint64_t ) storeStats.flash_writes * 1000U / storeStats.journaled : 0 ),
+                   ( unsigned long ) storeStats.restored,
+                   ( unsigned long ) storeStats.corrupt,
+                   ( unsigned long ) storeStats.recovery_ms ) );
+    #endif
+    mqtt_rpc_get_stats( &rpcStats );
+    LogInfo( ( "RPC: %lu calls, %lu one-way, %lu errors, %lu timed out, %lu dropped, longest wait %lu us.",
+               ( unsigned long ) rpcStats.requests,
+               ( unsigned long ) rpcStats.one_way,
+               ( unsigned long ) rpcStats.errors,
+               ( unsigned long ) rpcStats.timeouts,
+               ( unsigned long ) rpcStats.dropped,
+               ( unsigned long ) rpcStats.wait_us_max ) );
+    LogInfo( ( "Payload pool: small %lu used peak %lu of %u, large %lu used peak %lu of %u, %lu heap fallbacks.",
+               ( unsigned long ) slabStats.small_used,
+               ( unsigned long ) slabStats.small_peak,
+               MQTT_SLAB_SMALL_COUNT,
+               ( unsigned long ) slabStats.large_used,
+               ( unsigned long ) slabStats.large_peak,
+               MQTT_SLAB_LARGE_COUNT,
+               ( unsigned long ) slabStats.heap_fallbacks ) );
+    LogInfo( ( "Session: %lu sessions, %lu connect failures, %llu ms in backoff, connect p90 %lu ms, "
+               "%lu resends, %lu ack timeouts, %lu ProcessLoop errors.",
+               ( unsigned long ) metrics.sessions,
+               ( unsigned long ) metrics.connect_failures,
+               ( unsigned long long ) metrics.backoff_ms,
+               ( unsigned long ) mqtt_metrics_percentile( &metrics.connect, 90 ),
+               ( unsigned long ) metrics.resends,
+               ( unsigned long ) metrics.ack_timeouts,
+               ( unsigned long ) metrics.loop_errors ) );
+}
+
+/*-----------------------------------------------------------*/
+
 static int waitForPacketAck( MQTTContext_t * pMqttContext,
                              uint16_t usPacketIdentifier,
                              uint32_t ulTimeout )
@@ -1617,6 +3010,15 @@ static int waitForPacketAck( MQTTContext_t * pMqttContext,
                     usPacketIdentifier,
                     ( ulCurrentTime - ulMqttProcessLoopEntryTime ),
                     MQTT_Status_strerror( eMqttStatus ) ) );
+
+        if( ( eMqttStatus != MQTTSuccess ) && ( eMqttStatus != MQTTNeedMoreBytes ) )
+        {
+            mqtt_metrics_record_loop_error( eMqttStatus );
+        }
+        else
+        {
+            mqtt_metrics_record_ack_timeout();
+        }
     }
     else
     {
@@ -1674,6 +3076,7 @@ int aws_iot_demo_main( int argc,
     MQTTContext_t mqttContext = { 0 };
     NetworkContext_t xNetworkContext = { 0 };
     bool clientSessionPresent = false, brokerSessionPresent = false;
+    bool connectFailed = false;
     struct timespec tp;
 
     ( void ) argc;
@@ -1691,6 +3094,15 @@ int aws_iot_demo_main( int argc,
      * done only once in this demo. */
     returnStatus = initializeMqtt( &mqttContext, &xNetworkContext );
 
+    #if CONFIG_MQTT_SESSION_STORE
+        if( returnStatus == EXIT_SUCCESS )
+        {
+            /* Resume the session the broker kept from before the reset
+             * instead of starting a clean one that drops its publishes. */
+            clientSessionPresent = mqtt_session_store_restore();
+        }
+    #endif
+
     if( returnStatus == EXIT_SUCCESS )
     {
         for( ; ; )
@@ -1701,6 +3113,7 @@ int aws_iot_demo_main( int argc,
              * returns EXIT_FAILURE if the TCP connection cannot be established to
              * broker after configured number of attempts. */
             returnStatus = connectToServerWithBackoffRetries( &xNetworkContext, &mqttContext, &clientSessionPresent, &brokerSessionPresent );
+            connectFailed = ( returnStatus == EXIT_FAILURE );
 
             if( returnStatus == EXIT_FAILURE )
             {
@@ -1716,6 +3129,11 @@ int aws_iot_demo_main( int argc,
                  * Once this flag is set, MQTT connect in the following iterations of
                  * this demo will be attempted without requesting for a clean session. */
                 clientSessionPresent = true;
+                mqtt_metrics_session_start();
+
+                #if CONFIG_MQTT_SESSION_STORE
+                    mqtt_session_store_set_session( true );
+                #endif
 
                 /* Check if session is present and if there are any outgoing publishes
                  * that need to resend. This is only valid if the broker is
@@ -1725,8 +3143,19 @@ int aws_iot_demo_main( int argc,
                     LogInfo( ( "An MQTT session with broker is re-established. "
                                "Resending unacked publishes." ) );
 
+                    #if CONFIG_MQTT_SESSION_STORE
+                        restoreJournaledPublishes( &mqttContext, true );
+                    #endif
+
                     /* Handle all the resend of publish messages. */
                     returnStatus = handlePublishResend( &mqttContext );
+
+                    #if CONFIG_MQTT_SESSION_STORE
+                        if( returnStatus == EXIT_SUCCESS )
+                        {
+                            mqtt_session_store_recovered();
+                        }
+                    #endif
                 }
                 else
                 {
@@ -1736,12 +3165,37 @@ int aws_iot_demo_main( int argc,
                     /* Clean up the outgoing publishes waiting for ack as this new
                      * connection doesn't re-establish an existing session. */
                     cleanupOutgoingPublishes();
+
+                    #if CONFIG_MQTT_SESSION_STORE
+                        /* The publishes journaled before the reset are sent
+                         * again under new packet ids rather than dropped. */
+                        restoreJournaledPublishes( &mqttContext, false );
+                        returnStatus = handlePublishResend( &mqttContext );
+
+                        if( returnStatus == EXIT_SUCCESS )
+                        {
+                            mqtt_session_store_recovered();
+                        }
+                    #endif
                 }
 
-                /* If TLS session is established, execute Subscribe/Publish loop. */
-                returnStatus = subscribePublishLoop( &mqttContext );
+                if( MQTT_PERSISTENT_SESSION == true )
+                {
+                    /* Keep the session open and serve the agent queue, this
+                     * only returns once the connection failed. */
+                    returnStatus = agentCommandLoop( &mqttContext, brokerSessionPresent );
+                }
+                else
+                {
+                    /* If TLS session is established, execute Subscribe/Publish loop. */
+                    returnStatus = subscribePublishLoop( &mqttContext );
+                }
+
+                /* Subscription changes still waiting for an ack will not get one. */
+                failPendingAcks();
 
                 /* End TLS session, then close TCP connection. */
+                mqtt_metrics_session_end();
                 cleanupESPSecureMgrCerts( &xNetworkContext );
                 ( void ) xTlsDisconnect( &xNetworkContext );
             }
@@ -1752,6 +3206,16 @@ int aws_iot_demo_main( int argc,
                 LogInfo( ( "Demo completed successfully." ) );
             }
 
+            logTransportStats();
+
+            /* In the persistent session mode a broken session is reconnected
+             * straight away, the connect backoff already spaces out attempts to
+             * an unreachable broker. */
+            if( ( MQTT_PERSISTENT_SESSION == true ) && ( connectFailed == false ) )
+            {
+                continue;
+            }
+
             LogInfo( ( "Short delay before starting the next iteration....\n" ) );
             sleep( MQTT_SUBPUB_LOOP_DELAY_SECONDS );
         }
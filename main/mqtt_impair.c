@@ -0,0 +1,392 @@
+/*
+ * mqtt_impair.c
+ *
+ *  Created on: Oct 18, 2026
+ *      Author: hamxa
+ */
+#include <string.h>
+
+#include "clock.h"
+
+#include "mqtt_impair.h"
+
+//active impairments and the transport they wrap, only used by the task that owns the MQTT context
+static mqtt_impair_config_t g_config;
+static TransportSend_t g_send;
+static TransportRecv_t g_recv;
+static mqtt_impair_stats_t g_stats;
+
+//xorshift32 state driving every random decision
+static uint32_t g_rng_state = 1;
+
+//set by an injected disconnect, until a connect after the outage
+static bool g_broken;
+static uint32_t g_disconnect_ms;
+
+//end of the current freeze, and the losses in a row
+static uint32_t g_stall_until_ms;
+static bool g_stalled;
+static uint32_t g_consecutive_losses;
+
+/**
+ * Data taken in by one transport receive, delivered once the link would have carried it
+ */
+typedef struct mqtt_impair_segment
+{
+	size_t len;					///> bytes not delivered yet
+	uint32_t release_ms;
+}mqtt_impair_segment_t;
+
+//data received from the transport, in order of arrival, and the segments it came in
+static uint8_t g_hold[MQTT_IMPAIR_HOLD_SIZE];
+static size_t g_hold_pos;
+static size_t g_hold_len;
+static mqtt_impair_segment_t g_segments[MQTT_IMPAIR_HOLD_SEGMENTS];
+static size_t g_segment_head;
+static size_t g_segment_count;
+
+//failure of the transport receive, returned once the data received before it was delivered
+static int32_t g_recv_status;
+
+//data sent, passed on to the transport at the uplink rate
+static uint8_t g_uplink[MQTT_IMPAIR_UPLINK_SIZE];
+static size_t g_uplink_head;
+static size_t g_uplink_len;
+static uint64_t g_uplink_us;
+
+/**
+ * @fn uint32_t mqtt_impair_rand(void)
+ * @brief xorshift32 pseudo random generator, reproducible from the configured seed
+ *
+ */
+static uint32_t mqtt_impair_rand(void)
+{
+	uint32_t x = g_rng_state;
+	x ^= x << 13;
+	x ^= x >> 17;
+	x ^= x << 5;
+	g_rng_state = x;
+	return x;
+}
+
+/**
+ * @fn bool mqtt_impair_roll(uint32_t)
+ * @brief true with the given probability in parts per million
+ *
+ */
+static bool mqtt_impair_roll(uint32_t ppm)
+{
+	return ppm > 0 && mqtt_impair_rand() % 1000000 < ppm;
+}
+
+/**
+ * @fn int32_t mqtt_impair_check(void)
+ * @brief impairments both directions share
+ *
+ * @return 1 if the call may go ahead, 0 while the link is frozen, -1 once it is broken
+ */
+static int32_t mqtt_impair_check(void)
+{
+	uint32_t now_ms = Clock_GetTimeMs();
+
+	if(g_broken)
+	{
+		return -1;
+	}
+	if(g_stalled)
+	{
+		if((int32_t)(now_ms - g_stall_until_ms) < 0)
+		{
+			return 0;
+		}
+		g_stalled = false;
+	}
+	if(mqtt_impair_roll(g_config.disconnect_ppm))
+	{
+		g_broken = true;
+		g_disconnect_ms = now_ms;
+		g_stats.disconnects++;
+		return -1;
+	}
+	if(mqtt_impair_roll(g_config.stall_ppm))
+	{
+		g_stalled = true;
+		g_stall_until_ms = now_ms + g_config.stall_ms;
+		g_stats.stalls++;
+		return 0;
+	}
+	return 1;
+}
+
+void mqtt_impair_init(const mqtt_impair_config_t *config, TransportSend_t send, TransportRecv_t recv)
+{
+	g_config = *config;
+	g_send = send;
+	g_recv = recv;
+	//xorshift must never be seeded with zero
+	g_rng_state = config->seed ? config->seed : 1;
+	g_broken = false;
+	g_stalled = false;
+	g_consecutive_losses = 0;
+	g_hold_pos = 0;
+	g_hold_len = 0;
+	g_segment_count = 0;
+	g_recv_status = 0;
+	g_uplink_head = 0;
+	g_uplink_len = 0;
+	g_uplink_us = (uint64_t)Clock_GetTimeMs() * 1000;
+	g_stats = (mqtt_impair_stats_t){0};
+}
+
+/**
+ * @fn int32_t mqtt_impair_uplink_flush(NetworkContext_t*)
+ * @brief pass on the queued data the uplink carried since the last call
+ *
+ * @return 0, or the negative transport status once the connection failed
+ */
+static int32_t mqtt_impair_uplink_flush(NetworkContext_t *pNetworkContext)
+{
+	uint64_t now_us = (uint64_t)Clock_GetTimeMs() * 1000;
+	size_t budget;
+
+	//an idle uplink does not save up its rate
+	if(g_uplink_len == 0)
+	{
+		g_uplink_us = now_us;
+		return 0;
+	}
+	budget = (size_t)((now_us - g_uplink_us) * g_config.uplink_bps / 8000000);
+	if(budget >= g_uplink_len)
+	{
+		budget = g_uplink_len;
+		g_uplink_us = now_us;
+	}
+	else
+	{
+		g_uplink_us += (uint64_t)budget * 8000000 / g_config.uplink_bps;
+	}
+
+	while(budget > 0)
+	{
+		size_t chunk = MQTT_IMPAIR_UPLINK_SIZE - g_uplink_head < budget ? MQTT_IMPAIR_UPLINK_SIZE - g_uplink_head : budget;
+		int32_t sent = g_send(pNetworkContext, g_uplink + g_uplink_head, chunk);
+		if(sent <= 0)
+		{
+			return sent < 0 ? sent : 0;
+		}
+		g_uplink_head = (g_uplink_head + (size_t)sent) % MQTT_IMPAIR_UPLINK_SIZE;
+		g_uplink_len -= (size_t)sent;
+		budget -= (size_t)sent;
+	}
+	return 0;
+}
+
+/**
+ * @fn int32_t mqtt_impair_uplink_send(NetworkContext_t*, const void*, size_t)
+ * @brief queue data behind the uplink, as much as the queue has room for
+ *
+ * @return bytes queued, 0 while the queue is full, or a negative value once the connection failed
+ */
+static int32_t mqtt_impair_uplink_send(NetworkContext_t *pNetworkContext, const void *pBuffer, size_t bytesToSend)
+{
+	size_t limit = g_config.uplink_queue > 0 && g_config.uplink_queue < MQTT_IMPAIR_UPLINK_SIZE ?
+			g_config.uplink_queue : MQTT_IMPAIR_UPLINK_SIZE;
+	int32_t status = mqtt_impair_uplink_flush(pNetworkContext);
+	size_t len;
+	size_t tail;
+	size_t first;
+
+	if(status < 0)
+	{
+		return status;
+	}
+	len = limit - g_uplink_len < bytesToSend ? limit - g_uplink_len : bytesToSend;
+	if(len == 0)
+	{
+		g_stats.uplink_full++;
+		return 0;
+	}
+
+	tail = (g_uplink_head + g_uplink_len) % MQTT_IMPAIR_UPLINK_SIZE;
+	first = MQTT_IMPAIR_UPLINK_SIZE - tail < len ? MQTT_IMPAIR_UPLINK_SIZE - tail : len;
+	memcpy(g_uplink + tail, pBuffer, first);
+	memcpy(g_uplink, (const uint8_t*)pBuffer + first, len - first);
+	g_uplink_len += len;
+	if(g_uplink_len > g_stats.max_uplink_queue)
+	{
+		g_stats.max_uplink_queue = (uint32_t)g_uplink_len;
+	}
+	return (int32_t)len;
+}
+
+int32_t mqtt_impair_send(NetworkContext_t *pNetworkContext, const void *pBuffer, size_t bytesToSend)
+{
+	int32_t status = mqtt_impair_check();
+
+	if(status <= 0)
+	{
+		return status;
+	}
+	if(g_config.uplink_bps > 0)
+	{
+		return mqtt_impair_uplink_send(pNetworkContext, pBuffer, bytesToSend);
+	}
+	return g_send(pNetworkContext, pBuffer, bytesToSend);
+}
+
+/**
+ * @fn uint32_t mqtt_impair_delay_ms(void)
+ * @brief delay of the data just received, the round trip with its jitter and any retransmission
+ *
+ */
+static uint32_t mqtt_impair_delay_ms(void)
+{
+	uint32_t delay_ms = g_config.latency_ms;
+
+	if(g_config.jitter_ms > 0)
+	{
+		delay_ms += mqtt_impair_rand() % (g_config.jitter_ms + 1);
+	}
+	if(mqtt_impair_roll(g_config.loss_ppm))
+	{
+		//TCP hides the loss behind its retransmission timeout, which backs off while the losses go on
+		uint32_t rto_ms = MQTT_IMPAIR_RTO_MS << (g_consecutive_losses < 5 ? g_consecutive_losses : 5);
+		delay_ms += rto_ms < MQTT_IMPAIR_RTO_MAX_MS ? rto_ms : MQTT_IMPAIR_RTO_MAX_MS;
+		g_consecutive_losses++;
+		g_stats.losses++;
+	}
+	else
+	{
+		g_consecutive_losses = 0;
+	}
+	return delay_ms;
+}
+
+/**
+ * @fn void mqtt_impair_take_in(NetworkContext_t*)
+ * @brief receive what the transport has and time its delivery, TCP delivers in order so no data is released
+ * 			before the data that arrived ahead of it. Waits for the transport receive timeout if nothing arrived
+ *
+ */
+static void mqtt_impair_take_in(NetworkContext_t *pNetworkContext)
+{
+	int32_t received;
+
+	if(g_recv_status < 0 || g_segment_count == MQTT_IMPAIR_HOLD_SEGMENTS)
+	{
+		return;
+	}
+	if(g_hold_pos > 0)
+	{
+		memmove(g_hold, g_hold + g_hold_pos, g_hold_len - g_hold_pos);
+		g_hold_len -= g_hold_pos;
+		g_hold_pos = 0;
+	}
+	if(g_hold_len == sizeof(g_hold))
+	{
+		return;
+	}
+
+	received = g_recv(pNetworkContext, g_hold + g_hold_len, sizeof(g_hold) - g_hold_len);
+	if(received < 0)
+	{
+		g_recv_status = received;
+	}
+	else if(received > 0)
+	{
+		uint32_t delay_ms = mqtt_impair_delay_ms();
+		uint32_t release_ms = Clock_GetTimeMs() + delay_ms;
+		if(g_segment_count > 0)
+		{
+			uint32_t last_ms = g_segments[(g_segment_head + g_segment_count - 1) % MQTT_IMPAIR_HOLD_SEGMENTS].release_ms;
+			if((int32_t)(release_ms - last_ms) < 0)
+			{
+				release_ms = last_ms;
+			}
+		}
+		g_segments[(g_segment_head + g_segment_count) % MQTT_IMPAIR_HOLD_SEGMENTS] =
+				(mqtt_impair_segment_t){.len = (size_t)received, .release_ms = release_ms};
+		g_segment_count++;
+		g_hold_len += (size_t)received;
+		g_stats.delay_ms += delay_ms;
+	}
+}
+
+int32_t mqtt_impair_recv(NetworkContext_t *pNetworkContext, void *pBuffer, size_t bytesToRecv)
+{
+	int32_t status = mqtt_impair_check();
+	mqtt_impair_segment_t *segment;
+	size_t len;
+
+	if(status <= 0)
+	{
+		return status;
+	}
+	//coreMQTT polls the receive, which keeps the uplink moving between sends
+	if(g_config.uplink_bps > 0)
+	{
+		status = mqtt_impair_uplink_flush(pNetworkContext);
+		if(status < 0)
+		{
+			return status;
+		}
+	}
+
+	//data due is delivered without waiting on the transport, coreMQTT reads a packet in several calls
+	segment = &g_segments[g_segment_head];
+	if(g_segment_count == 0 || (int32_t)(Clock_GetTimeMs() - segment->release_ms) < 0)
+	{
+		mqtt_impair_take_in(pNetworkContext);
+	}
+	if(g_segment_count == 0)
+	{
+		return g_recv_status;
+	}
+	//nothing arrived yet as far as coreMQTT can tell
+	if((int32_t)(Clock_GetTimeMs() - segment->release_ms) < 0)
+	{
+		return 0;
+	}
+
+	len = segment->len < bytesToRecv ? segment->len : bytesToRecv;
+	memcpy(pBuffer, g_hold + g_hold_pos, len);
+	g_hold_pos += len;
+	segment->len -= len;
+	if(segment->len == 0)
+	{
+		g_segment_head = (g_segment_head + 1) % MQTT_IMPAIR_HOLD_SEGMENTS;
+		g_segment_count--;
+	}
+	return (int32_t)len;
+}
+
+bool mqtt_impair_link_up(void)
+{
+	if(g_broken)
+	{
+		if(Clock_GetTimeMs() - g_disconnect_ms < g_config.outage_ms)
+		{
+			return false;
+		}
+		g_broken = false;
+		g_stalled = false;
+	}
+	//a new connection follows, what was held or queued belonged to the old one
+	g_hold_pos = 0;
+	g_hold_len = 0;
+	g_segment_count = 0;
+	g_recv_status = 0;
+	g_uplink_head = 0;
+	g_uplink_len = 0;
+	return true;
+}
+
+uint32_t mqtt_impair_last_disconnect_ms(void)
+{
+	return g_disconnect_ms;
+}
+
+void mqtt_impair_get_stats(mqtt_impair_stats_t *stats)
+{
+	*stats = g_stats;
+}
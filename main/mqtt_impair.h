@@ -0,0 +1,112 @@
+/*
+ * mqtt_impair.h
+ *
+ *  Created on: Oct 18, 2026
+ *      Author: hamxa
+ */
+
+#ifndef MAIN_MQTT_IMPAIR_H_
+#define MAIN_MQTT_IMPAIR_H_
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "core_mqtt.h"
+
+//Bytes held back to delay their delivery, at least one network buffer
+#define MQTT_IMPAIR_HOLD_SIZE		2048
+
+//Transport receives whose data can be held back at once, each one is delayed on its own
+#define MQTT_IMPAIR_HOLD_SEGMENTS	32
+
+//Delay a lost segment adds before TCP retransmits it, doubled for every loss in a row
+#define MQTT_IMPAIR_RTO_MS			250
+
+//Longest retransmission delay of consecutive losses
+#define MQTT_IMPAIR_RTO_MAX_MS		4000
+
+//Largest queue of a rate limited uplink, the socket send buffer of the device
+#define MQTT_IMPAIR_UPLINK_SIZE		4096
+
+/**
+ * Impairments of the link, rates are per transport call in parts per million
+ */
+typedef struct mqtt_impair_config
+{
+	uint32_t latency_ms;		///> round trip added to the data received
+	uint32_t jitter_ms;			///> random extra delay of the data received, 0 to jitter_ms
+	uint32_t loss_ppm;			///> receives that lose a segment, each one waits a retransmission timeout
+	uint32_t stall_ppm;			///> calls that freeze the link, nothing moves in either direction
+	uint32_t stall_ms;			///> length of a freeze
+	uint32_t disconnect_ppm;	///> calls that break the connection
+	uint32_t outage_ms;			///> time a broken link stays down, connects fail meanwhile
+	uint32_t uplink_bps;		///> rate the data sent leaves at, 0 for no limit
+	uint32_t uplink_queue;		///> bytes sent that can wait for the uplink, sends stall once it is full,
+								///> 0 for MQTT_IMPAIR_UPLINK_SIZE
+	uint32_t seed;				///> xorshift seed, the same seed replays the same impairments
+}mqtt_impair_config_t;
+
+/**
+ * What was injected since mqtt_impair_init()
+ */
+typedef struct mqtt_impair_stats
+{
+	uint32_t losses;
+	uint32_t stalls;
+	uint32_t disconnects;
+	uint64_t delay_ms;			///> latency, jitter and retransmission delay added to the data received
+	uint32_t uplink_full;		///> sends that found the uplink queue full
+	uint32_t max_uplink_queue;	///> most bytes waiting for the uplink at once
+}mqtt_impair_stats_t;
+
+/**
+ * @fn void mqtt_impair_init(const mqtt_impair_config_t*, TransportSend_t, TransportRecv_t)
+ * @brief set the impairments and the transport functions they wrap, the link starts up
+ *
+ * @param send transport send called once the impairments let the data through
+ * @param recv transport receive
+ */
+void mqtt_impair_init(const mqtt_impair_config_t *config, TransportSend_t send, TransportRecv_t recv);
+
+/**
+ * @fn int32_t mqtt_impair_send(NetworkContext_t*, const void*, size_t)
+ * @brief coreMQTT send function, queues the data behind a rate limited uplink, stalls the send, or fails it
+ * 			when the link breaks
+ *
+ * @return bytes sent, 0 while stalled, or a negative value once the link is broken
+ */
+int32_t mqtt_impair_send(NetworkContext_t *pNetworkContext, const void *pBuffer, size_t bytesToSend);
+
+/**
+ * @fn int32_t mqtt_impair_recv(NetworkContext_t*, void*, size_t)
+ * @brief coreMQTT receive function, holds data back for the latency, jitter and retransmissions of the link,
+ * 			stalls the receive, or fails it when the link breaks. Later data is never delivered before earlier data
+ *
+ * @return bytes received, 0 while stalled or without data, or a negative value once the link is broken
+ */
+int32_t mqtt_impair_recv(NetworkContext_t *pNetworkContext, void *pBuffer, size_t bytesToRecv);
+
+/**
+ * @fn bool mqtt_impair_link_up(void)
+ * @brief whether a connect can reach the broker, false during an outage. Called before every connect, it
+ * 			clears the broken state once the outage is over and drops the data held for the old connection
+ *
+ */
+bool mqtt_impair_link_up(void);
+
+/**
+ * @fn uint32_t mqtt_impair_last_disconnect_ms(void)
+ * @brief Clock_GetTimeMs() of the last injected disconnect, the start of its recovery
+ *
+ */
+uint32_t mqtt_impair_last_disconnect_ms(void);
+
+/**
+ * @fn void mqtt_impair_get_stats(mqtt_impair_stats_t*)
+ * @brief get what was injected
+ *
+ */
+void mqtt_impair_get_stats(mqtt_impair_stats_t *stats);
+
+#endif /* MAIN_MQTT_IMPAIR_H_ */
@@ -0,0 +1,590 @@
+/*
+ * mqtt_impair_bench.c
+ *
+ *  Created on: Oct 18, 2026
+ *      Author: hamxa
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "esp_log.h"
+#include "sdkconfig.h"
+
+#include "backoff_algorithm.h"
+#include "clock.h"
+#include "core_mqtt.h"
+
+#include "mqtt_bench.h"
+#include "mqtt_bench_broker.h"
+#include "mqtt_impair.h"
+#include "mqtt_impair_bench.h"
+#include "mqtt_pacer.h"
+#include "mqtt_posix_transport.h"
+
+static const char TAG[] = "mqtt_impair_bench";
+
+//payload of a sample, its sequence number followed by filler up to the size of a CBOR sample
+#define MQTT_IMPAIR_BENCH_PAYLOAD_LEN	16
+
+/**
+ * One impairment scenario
+ */
+typedef struct mqtt_impair_bench_scenario
+{
+	const char *name;
+	mqtt_impair_config_t config;
+}mqtt_impair_bench_scenario_t;
+
+//rates are per transport call, an idle connection is polled every MQTT_POSIX_TRANSPORT_RECV_TIMEOUT_MS
+static const mqtt_impair_bench_scenario_t g_scenarios[] = {
+		{"clean", {.seed = 1}},
+		{"80 ms latency, 40 ms jitter", {.latency_ms = 80, .jitter_ms = 40, .seed = 2}},
+		{"2% segment loss", {.loss_ppm = 20000, .seed = 3}},
+		{"3 s stalls", {.stall_ppm = 1500, .stall_ms = 3000, .seed = 4}},
+		{"disconnects, 1 s outages", {.disconnect_ppm = 2000, .outage_ms = 1000, .seed = 5}},
+		{"disconnect, 15 s outage", {.disconnect_ppm = 1500, .outage_ms = 15000, .seed = 6}},
+};
+
+//links the samples are published to as fast as the window allows, once with the fixed window and once paced
+static const mqtt_impair_bench_scenario_t g_pacing_scenarios[] = {
+		{"80 ms latency", {.latency_ms = 80, .seed = 7}},
+		{"20 kbit/s uplink", {.uplink_bps = 20000, .seed = 8}},
+		{"20 kbit/s uplink, 80 ms latency", {.uplink_bps = 20000, .latency_ms = 80, .seed = 9}},
+		{"40 ms latency, 5% segment loss", {.latency_ms = 40, .loss_ppm = 50000, .seed = 10}},
+};
+
+//links the samples are published to as fast as windows from one publish up to MQTT_INFLIGHT_WINDOW allow
+static const mqtt_impair_bench_scenario_t g_window_scenarios[] = {
+		{"20 ms latency", {.latency_ms = 20, .seed = 11}},
+		{"80 ms latency", {.latency_ms = 80, .seed = 12}},
+		{"20 kbit/s uplink, 20 ms latency", {.uplink_bps = 20000, .latency_ms = 20, .seed = 13}},
+};
+
+//windows of the sweep, doubling up to MQTT_INFLIGHT_WINDOW
+#define MQTT_IMPAIR_BENCH_WINDOWS	8
+
+/**
+ * A publish awaiting its PUBACK, resent with the same packet id after a reconnect
+ */
+typedef struct mqtt_impair_bench_unacked
+{
+	uint16_t packet_id;
+	uint32_t seq;
+	uint32_t sent_ms;		///> first send, the ack latency includes the resends
+	uint32_t last_ms;		///> last send, the round trip the pacer sees
+}mqtt_impair_bench_unacked_t;
+
+/**
+ * Outcome of one scenario
+ */
+typedef struct mqtt_impair_bench_result
+{
+	uint32_t drops;				///> connections given up after a transport failure
+	uint32_t recoveries;
+	uint64_t recovery_ms;		///> fault to CONNACK, summed over the recoveries
+	uint32_t max_recovery_ms;
+	uint32_t attempts;			///> connect attempts after the first connection
+	uint32_t exhausted;			///> rounds of backoff that ran out of attempts
+	uint32_t resends;
+}mqtt_impair_bench_result_t;
+
+static MQTTContext_t g_context;
+static NetworkContext_t g_network;
+static uint8_t g_buffer[CONFIG_MQTT_NETWORK_BUFFER_SIZE];
+static MQTTPubAckInfo_t g_outgoing_records[CONFIG_MQTT_INFLIGHT_WINDOW];
+static MQTTPubAckInfo_t g_incoming_records[1];
+
+static mqtt_impair_bench_unacked_t g_unacked[CONFIG_MQTT_INFLIGHT_WINDOW];
+static uint32_t g_unacked_count;
+static bool g_connected;
+static bool g_session;
+
+//copies of every sample the broker received, counted from its thread
+static uint16_t g_received[MQTT_IMPAIR_BENCH_MESSAGES];
+
+//ack latency of every sample, sorted for the percentiles
+static uint32_t g_ack_ms[MQTT_IMPAIR_BENCH_MESSAGES];
+static uint32_t g_acked;
+
+//set while a run is paced, fed with the PUBACKs
+static mqtt_pacer_t *g_pacer;
+
+//acked samples per second of the last scenario
+static uint32_t g_goodput;
+
+/**
+ * @fn void mqtt_impair_bench_publish_hook(const uint8_t*, size_t)
+ * @brief count the sample in the broker thread
+ *
+ */
+static void mqtt_impair_bench_publish_hook(const uint8_t *payload, size_t len)
+{
+	uint32_t seq;
+
+	if(len != MQTT_IMPAIR_BENCH_PAYLOAD_LEN)
+	{
+		return;
+	}
+	seq = ((uint32_t)payload[0] << 24) | ((uint32_t)payload[1] << 16) | ((uint32_t)payload[2] << 8) | payload[3];
+	if(seq < MQTT_IMPAIR_BENCH_MESSAGES)
+	{
+		__atomic_fetch_add(&g_received[seq], 1, __ATOMIC_RELAXED);
+	}
+}
+
+/**
+ * @fn void mqtt_impair_bench_event_callback(MQTTContext_t*, MQTTPacketInfo_t*, MQTTDeserializedInfo_t*)
+ * @brief release the publish a PUBACK acks
+ *
+ */
+static void mqtt_impair_bench_event_callback(MQTTContext_t *pContext, MQTTPacketInfo_t *pPacketInfo,
+											 MQTTDeserializedInfo_t *pDeserializedInfo)
+{
+	if((pPacketInfo->type & 0xf0U) != MQTT_PACKET_TYPE_PUBACK)
+	{
+		return;
+	}
+	for(uint32_t i = 0; i < g_unacked_count; i++)
+	{
+		if(g_unacked[i].packet_id == pDeserializedInfo->packetIdentifier)
+		{
+			uint32_t now_ms = Clock_GetTimeMs();
+			if(g_acked < MQTT_IMPAIR_BENCH_MESSAGES)
+			{
+				g_ack_ms[g_acked++] = now_ms - g_unacked[i].sent_ms;
+			}
+			if(g_pacer)
+			{
+				mqtt_pacer_on_ack(g_pacer, now_ms - g_unacked[i].last_ms, now_ms);
+			}
+			g_unacked[i] = g_unacked[--g_unacked_count];
+			return;
+		}
+	}
+}
+
+/**
+ * @fn bool mqtt_impair_bench_publish(mqtt_impair_bench_unacked_t*, bool)
+ * @brief send one sample at QoS1
+ *
+ */
+static bool mqtt_impair_bench_publish(mqtt_impair_bench_unacked_t *unacked, bool dup)
+{
+	uint8_t payload[MQTT_IMPAIR_BENCH_PAYLOAD_LEN] = {0};
+	MQTTPublishInfo_t publish_info = {0};
+
+	payload[0] = (uint8_t)(unacked->seq >> 24);
+	payload[1] = (uint8_t)(unacked->seq >> 16);
+	payload[2] = (uint8_t)(unacked->seq >> 8);
+	payload[3] = (uint8_t)unacked->seq;
+
+	publish_info.qos = MQTTQoS1;
+	publish_info.dup = dup;
+	publish_info.pTopicName = MQTT_BENCH_TOPIC;
+	publish_info.topicNameLength = (uint16_t)(sizeof(MQTT_BENCH_TOPIC) - 1);
+	publish_info.pPayload = payload;
+	publish_info.payloadLength = sizeof(payload);
+
+	unacked->last_ms = Clock_GetTimeMs();
+	if(MQTT_Publish(&g_context, &publish_info, unacked->packet_id) != MQTTSuccess)
+	{
+		if(g_pacer)
+		{
+			mqtt_pacer_on_loss(g_pacer, unacked->last_ms, Clock_GetTimeMs());
+		}
+		return false;
+	}
+	return true;
+}
+
+/**
+ * @fn void mqtt_impair_bench_check_acks(void)
+ * @brief tell the pacer about the publishes whose PUBACK is overdue
+ *
+ */
+static void mqtt_impair_bench_check_acks(void)
+{
+	uint32_t now_ms = Clock_GetTimeMs();
+
+	for(uint32_t i = 0; i < g_unacked_count; i++)
+	{
+		if(now_ms - g_unacked[i].last_ms > mqtt_pacer_rto_ms(g_pacer))
+		{
+			mqtt_pacer_on_loss(g_pacer, g_unacked[i].last_ms, now_ms);
+		}
+	}
+}
+
+/**
+ * @fn void mqtt_impair_bench_drop(mqtt_impair_bench_result_t*)
+ * @brief give up the connection after a transport failure, as the demo does when its loop fails
+ *
+ */
+static void mqtt_impair_bench_drop(mqtt_impair_bench_result_t *result)
+{
+	(void)MQTT_Disconnect(&g_context);
+	mqtt_posix_transport_disconnect(&g_network);
+	g_connected = false;
+	result->drops++;
+}
+
+/**
+ * @fn bool mqtt_impair_bench_attempt(bool*, uint16_t)
+ * @brief one connect attempt, TCP and CONNACK
+ *
+ */
+static bool mqtt_impair_bench_attempt(bool *session_present, uint16_t port)
+{
+	MQTTConnectInfo_t connect_info = {0};
+
+	if(!mqtt_impair_link_up() || !mqtt_posix_transport_connect(&g_network, "127.0.0.1", port))
+	{
+		return false;
+	}
+
+	connect_info.cleanSession = !g_session;
+	connect_info.pClientIdentifier = CONFIG_MQTT_CLIENT_IDENTIFIER "-impair";
+	connect_info.clientIdentifierLength = (uint16_t)strlen(connect_info.pClientIdentifier);
+	connect_info.keepAliveSeconds = 60;
+
+	if(MQTT_Connect(&g_context, &connect_info, NULL, MQTT_BENCH_ACK_TIMEOUT_MS, session_present) != MQTTSuccess)
+	{
+		(void)MQTT_Disconnect(&g_context);
+		mqtt_posix_transport_disconnect(&g_network);
+		return false;
+	}
+	return true;
+}
+
+/**
+ * @fn bool mqtt_impair_bench_connect(mqtt_impair_bench_result_t*, uint16_t, uint32_t, uint32_t)
+ * @brief connect with the device's backoff, then resend what is unacked on the resumed session
+ *
+ * @param fault_ms time of the fault that broke the previous connection
+ * @return false if the deadline passed first
+ */
+static bool mqtt_impair_bench_connect(mqtt_impair_bench_result_t *result, uint16_t port, uint32_t fault_ms,
+									  uint32_t deadline_ms)
+{
+	BackoffAlgorithmContext_t backoff;
+	bool session_present = false;
+	bool reconnect = g_session;
+	uint16_t backoff_ms;
+
+	BackoffAlgorithm_InitializeParams(&backoff, CONFIG_MQTT_RETRY_BACKOFF_BASE_MS, CONFIG_MQTT_RETRY_BACKOFF_MAX_MS,
+									  CONFIG_MQTT_RETRY_MAX_ATTEMPTS);
+	for(;;)
+	{
+		if((int32_t)(Clock_GetTimeMs() - deadline_ms) > 0)
+		{
+			return false;
+		}
+		if(reconnect)
+		{
+			result->attempts++;
+		}
+		if(mqtt_impair_bench_attempt(&session_present, port))
+		{
+			break;
+		}
+		if(BackoffAlgorithm_GetNextBackoff(&backoff, (uint32_t)rand(), &backoff_ms) == BackoffAlgorithmRetriesExhausted)
+		{
+			//the demo logs the failure and starts over after a delay
+			result->exhausted++;
+			Clock_SleepMs(MQTT_IMPAIR_BENCH_RETRY_DELAY_MS);
+			BackoffAlgorithm_InitializeParams(&backoff, CONFIG_MQTT_RETRY_BACKOFF_BASE_MS,
+											  CONFIG_MQTT_RETRY_BACKOFF_MAX_MS, CONFIG_MQTT_RETRY_MAX_ATTEMPTS);
+		}
+		else
+		{
+			Clock_SleepMs(backoff_ms);
+		}
+	}
+
+	g_connected = true;
+	g_session = true;
+
+	//without the session the broker forgot the packet ids, the samples still go out again
+	for(uint32_t i = 0; i < g_unacked_count; i++)
+	{
+		result->resends++;
+		if(!mqtt_impair_bench_publish(&g_unacked[i], session_present))
+		{
+			//not recovered yet, the next connect still counts from the same fault
+			mqtt_impair_bench_drop(result);
+			return true;
+		}
+	}
+
+	if(reconnect)
+	{
+		uint32_t recovery_ms = Clock_GetTimeMs() - fault_ms;
+		result->recoveries++;
+		result->recovery_ms += recovery_ms;
+		if(recovery_ms > result->max_recovery_ms)
+		{
+			result->max_recovery_ms = recovery_ms;
+		}
+	}
+	return true;
+}
+
+/**
+ * @fn int mqtt_impair_bench_compare(const void*, const void*)
+ * @brief qsort order of the latencies
+ *
+ */
+static int mqtt_impair_bench_compare(const void *a, const void *b)
+{
+	uint32_t x = *(const uint32_t*)a;
+	uint32_t y = *(const uint32_t*)b;
+
+	return (x > y) - (x < y);
+}
+
+/**
+ * @fn bool mqtt_impair_bench_scenario(const mqtt_impair_bench_scenario_t*, uint16_t, uint32_t, uint32_t, mqtt_pacer_t*)
+ * @brief publish the samples through one scenario and log how the session coped
+ *
+ * @param period_ms time between samples, 0 to publish as fast as the window allows
+ * @param window publishes in flight without a pacer, up to MQTT_INFLIGHT_WINDOW
+ * @param pacer the pacer that sets the window, NULL for the fixed window
+ * @return true if every sample reached the broker
+ */
+static bool mqtt_impair_bench_scenario(const mqtt_impair_bench_scenario_t *scenario, uint16_t port, uint32_t period_ms,
+									   uint32_t window, mqtt_pacer_t *pacer)
+{
+	char name[96];
+	mqtt_impair_bench_result_t result = {0};
+	mqtt_impair_stats_t impair_stats;
+	uint32_t start_ms = Clock_GetTimeMs();
+	uint32_t deadline_ms = start_ms + MQTT_IMPAIR_BENCH_DEADLINE_MS;
+	uint32_t next_ms = start_ms;
+	uint32_t fault_ms = start_ms;
+	uint32_t disconnects = 0;
+	uint32_t seq = 0;
+	uint32_t lost = 0;
+	uint32_t duplicates = 0;
+	uint32_t elapsed_ms;
+
+	if(period_ms > 0 || pacer)
+	{
+		snprintf(name, sizeof(name), "%s%s", scenario->name, period_ms > 0 ? "" : ", AIMD pacer");
+	}
+	else if(window < CONFIG_MQTT_INFLIGHT_WINDOW)
+	{
+		snprintf(name, sizeof(name), "%s, window %lu", scenario->name, (unsigned long)window);
+	}
+	else
+	{
+		snprintf(name, sizeof(name), "%s, fixed window", scenario->name);
+	}
+	if(pacer)
+	{
+		mqtt_pacer_init(pacer, CONFIG_MQTT_INFLIGHT_WINDOW, start_ms);
+	}
+	g_pacer = pacer;
+	memset(g_received, 0, sizeof(g_received));
+	g_unacked_count = 0;
+	g_acked = 0;
+	g_connected = false;
+	g_session = false;
+	mqtt_impair_init(&scenario->config, mqtt_posix_transport_send, mqtt_posix_transport_recv);
+
+	while((seq < MQTT_IMPAIR_BENCH_MESSAGES || g_unacked_count > 0) && (int32_t)(Clock_GetTimeMs() - deadline_ms) < 0)
+	{
+		uint32_t now_ms = Clock_GetTimeMs();
+
+		if(!g_connected)
+		{
+			if(!mqtt_impair_bench_connect(&result, port, fault_ms, deadline_ms))
+			{
+				break;
+			}
+			continue;
+		}
+
+		if(seq < MQTT_IMPAIR_BENCH_MESSAGES && (int32_t)(now_ms - next_ms) >= 0 &&
+		   (pacer ? mqtt_pacer_can_send(pacer, g_unacked_count, now_ms) : g_unacked_count < window))
+		{
+			mqtt_impair_bench_unacked_t *unacked = &g_unacked[g_unacked_count++];
+			unacked->packet_id = MQTT_GetPacketId(&g_context);
+			unacked->seq = seq++;
+			unacked->sent_ms = now_ms;
+			next_ms += period_ms;
+			if(pacer)
+			{
+				mqtt_pacer_on_send(pacer, now_ms);
+			}
+			if(mqtt_impair_bench_publish(unacked, false))
+			{
+				continue;
+			}
+		}
+		else
+		{
+			if(pacer)
+			{
+				mqtt_impair_bench_check_acks();
+			}
+			MQTTStatus_t status = MQTT_ProcessLoop(&g_context);
+			if(status == MQTTSuccess || status == MQTTNeedMoreBytes)
+			{
+				continue;
+			}
+		}
+
+		//an injected disconnect is where the recovery starts, anything else when it was noticed
+		mqtt_impair_get_stats(&impair_stats);
+		fault_ms = impair_stats.disconnects != disconnects ? mqtt_impair_last_disconnect_ms() : Clock_GetTimeMs();
+		disconnects = impair_stats.disconnects;
+		mqtt_impair_bench_drop(&result);
+	}
+
+	if(g_connected)
+	{
+		(void)MQTT_Disconnect(&g_context);
+		mqtt_posix_transport_disconnect(&g_network);
+	}
+
+	//the broker thread may still be counting the last publishes it acked
+	Clock_SleepMs(MQTT_POSIX_TRANSPORT_RECV_TIMEOUT_MS);
+	for(uint32_t i = 0; i < MQTT_IMPAIR_BENCH_MESSAGES; i++)
+	{
+		uint16_t copies = __atomic_load_n(&g_received[i], __ATOMIC_RELAXED);
+		if(copies == 0)
+		{
+			lost++;
+		}
+		else
+		{
+			duplicates += copies - 1;
+		}
+	}
+
+	mqtt_impair_get_stats(&impair_stats);
+	qsort(g_ack_ms, g_acked, sizeof(g_ack_ms[0]), mqtt_impair_bench_compare);
+	elapsed_ms = Clock_GetTimeMs() - start_ms;
+	g_goodput = (uint32_t)((uint64_t)g_acked * 1000 / (elapsed_ms ? elapsed_ms : 1));
+	ESP_LOGI(TAG, "%s: %u samples, %lu lost, %lu duplicates, %lu resent; ack p50 %lu ms, p99 %lu ms, max %lu ms; "
+			"took %lu ms, goodput %lu samples/s", name, MQTT_IMPAIR_BENCH_MESSAGES, (unsigned long)lost,
+			(unsigned long)duplicates, (unsigned long)result.resends,
+			(unsigned long)(g_acked ? g_ack_ms[(g_acked - 1) / 2] : 0),
+			(unsigned long)(g_acked ? g_ack_ms[(g_acked * 99 + 99) / 100 - 1] : 0),
+			(unsigned long)(g_acked ? g_ack_ms[g_acked - 1] : 0), (unsigned long)elapsed_ms, (unsigned long)g_goodput);
+	if(pacer)
+	{
+		ESP_LOGI(TAG, "%s: window %lu of %u, srtt %lu ms, min rtt %lu ms, %lu increases, %lu delay and %lu loss backoffs",
+				name, (unsigned long)mqtt_pacer_window(pacer), CONFIG_MQTT_INFLIGHT_WINDOW, (unsigned long)pacer->srtt_ms,
+				(unsigned long)pacer->min_rtt_ms, (unsigned long)pacer->stats.increases,
+				(unsigned long)pacer->stats.delay_backoffs, (unsigned long)pacer->stats.loss_backoffs);
+	}
+	if(scenario->config.uplink_bps > 0)
+	{
+		ESP_LOGI(TAG, "%s: up to %lu bytes queued for the uplink, %lu sends found it full", name,
+				(unsigned long)impair_stats.max_uplink_queue, (unsigned long)impair_stats.uplink_full);
+	}
+	ESP_LOGI(TAG, "%s: %lu disconnects, %lu stalls, %lu losses injected; %lu recoveries, avg %lu ms, max %lu ms, "
+			"%lu connect attempts, %lu times out of retries", name, (unsigned long)impair_stats.disconnects,
+			(unsigned long)impair_stats.stalls, (unsigned long)impair_stats.losses, (unsigned long)result.recoveries,
+			(unsigned long)(result.recoveries ? result.recovery_ms / result.recoveries : 0),
+			(unsigned long)result.max_recovery_ms, (unsigned long)result.attempts, (unsigned long)result.exhausted);
+	return lost == 0;
+}
+
+/**
+ * @fn bool mqtt_impair_bench_windows(const mqtt_impair_bench_scenario_t*, uint16_t)
+ * @brief publish as fast as windows doubling from one publish up to MQTT_INFLIGHT_WINDOW allow over one link, and log
+ * 			the goodput of each and the smallest window that reaches 90% of the best, the bandwidth-delay product
+ *
+ * @return true if every sample reached the broker
+ */
+static bool mqtt_impair_bench_windows(const mqtt_impair_bench_scenario_t *scenario, uint16_t port)
+{
+	uint32_t windows[MQTT_IMPAIR_BENCH_WINDOWS];
+	uint32_t goodput[MQTT_IMPAIR_BENCH_WINDOWS];
+	uint32_t best = 0, needed = CONFIG_MQTT_INFLIGHT_WINDOW;
+	size_t count = 0;
+	char table[160];
+	int used = 0;
+	bool ok = true;
+
+	for(uint32_t window = 1; count < MQTT_IMPAIR_BENCH_WINDOWS; window *= 2)
+	{
+		windows[count] = window < CONFIG_MQTT_INFLIGHT_WINDOW ? window : CONFIG_MQTT_INFLIGHT_WINDOW;
+		ok &= mqtt_impair_bench_scenario(scenario, port, 0, windows[count], NULL);
+		goodput[count] = g_goodput;
+		best = g_goodput > best ? g_goodput : best;
+		if(windows[count++] == CONFIG_MQTT_INFLIGHT_WINDOW)
+		{
+			break;
+		}
+	}
+
+	for(size_t i = count; i-- > 0;)
+	{
+		if(goodput[i] * 10 >= best * 9)
+		{
+			needed = windows[i];
+		}
+	}
+	for(size_t i = 0; i < count && used >= 0 && used < (int)sizeof(table); i++)
+	{
+		used += snprintf(&table[used], sizeof(table) - used, "%s%lu: %lu", i ? ", " : "", (unsigned long)windows[i],
+						 (unsigned long)goodput[i]);
+	}
+	ESP_LOGI(TAG, "%s: goodput by window %s samples/s, 90%% of the best from a window of %lu", scenario->name, table,
+			(unsigned long)needed);
+	return ok;
+}
+
+bool mqtt_impair_bench_run(void)
+{
+	TransportInterface_t transport = {0};
+	MQTTFixedBuffer_t buffer = {.pBuffer = g_buffer, .size = sizeof(g_buffer)};
+	uint16_t port;
+	bool ok = true;
+
+	mqtt_bench_broker_set_publish_hook(mqtt_impair_bench_publish_hook);
+	if(!mqtt_bench_broker_start(&port))
+	{
+		return false;
+	}
+
+	transport.pNetworkContext = &g_network;
+	transport.send = mqtt_impair_send;
+	transport.recv = mqtt_impair_recv;
+	//the impairment transport has no vectored send, each part of a packet is its own write
+	transport.writev = NULL;
+	if(MQTT_Init(&g_context, &transport, Clock_GetTimeMs, mqtt_impair_bench_event_callback, &buffer) != MQTTSuccess ||
+	   MQTT_InitStatefulQoS(&g_context, g_outgoing_records, CONFIG_MQTT_INFLIGHT_WINDOW, g_incoming_records, 1) != MQTTSuccess)
+	{
+		mqtt_bench_broker_stop();
+		return false;
+	}
+
+	ESP_LOGI(TAG, "mqtt_impair_bench_run: backoff base %u ms, max %u ms, %u attempts, %u in flight",
+			CONFIG_MQTT_RETRY_BACKOFF_BASE_MS, CONFIG_MQTT_RETRY_BACKOFF_MAX_MS, CONFIG_MQTT_RETRY_MAX_ATTEMPTS,
+			CONFIG_MQTT_INFLIGHT_WINDOW);
+	for(size_t i = 0; i < sizeof(g_scenarios) / sizeof(g_scenarios[0]); i++)
+	{
+		ok &= mqtt_impair_bench_scenario(&g_scenarios[i], port, MQTT_IMPAIR_BENCH_PERIOD_MS, CONFIG_MQTT_INFLIGHT_WINDOW, NULL);
+	}
+	for(size_t i = 0; i < sizeof(g_pacing_scenarios) / sizeof(g_pacing_scenarios[0]); i++)
+	{
+		mqtt_pacer_t pacer;
+
+		ok &= mqtt_impair_bench_scenario(&g_pacing_scenarios[i], port, 0, CONFIG_MQTT_INFLIGHT_WINDOW, NULL);
+		ok &= mqtt_impair_bench_scenario(&g_pacing_scenarios[i], port, 0, CONFIG_MQTT_INFLIGHT_WINDOW, &pacer);
+	}
+	for(size_t i = 0; i < sizeof(g_window_scenarios) / sizeof(g_window_scenarios[0]); i++)
+	{
+		ok &= mqtt_impair_bench_windows(&g_window_scenarios[i], port);
+	}
+	g_pacer = NULL;
+
+	mqtt_bench_broker_stop();
+	mqtt_bench_broker_set_publish_hook(NULL);
+	return ok;
+}
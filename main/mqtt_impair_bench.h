@@ -0,0 +1,37 @@
+/*
+ * mqtt_impair_bench.h
+ *
+ *  Created on: Oct 18, 2026
+ *      Author: hamxa
+ */
+
+#ifndef MAIN_MQTT_IMPAIR_BENCH_H_
+#define MAIN_MQTT_IMPAIR_BENCH_H_
+
+#include <stdbool.h>
+
+//QoS1 samples published per scenario, one every period
+#define MQTT_IMPAIR_BENCH_MESSAGES		200
+#define MQTT_IMPAIR_BENCH_PERIOD_MS		25
+
+//A scenario that has not delivered everything by then counts the rest as lost
+#define MQTT_IMPAIR_BENCH_DEADLINE_MS	90000
+
+//Wait after the connect retries ran out, the demo's delay between iterations
+#define MQTT_IMPAIR_BENCH_RETRY_DELAY_MS	5000
+
+/**
+ * @fn bool mqtt_impair_bench_run(void)
+ * @brief publish QoS1 samples through the impairment transport to the in-process broker under scenarios of
+ * 			latency, loss, stalls and disconnects, reconnecting with the device's backoff settings and resending
+ * 			unacked publishes on the resumed session. Logs per scenario the samples lost and duplicated, the
+ * 			time to recover from each disconnect and the connect attempts it took. Then publishes as fast as the
+ * 			window allows over slow and lossy links, with the fixed in-flight window and with the AIMD pacer, and
+ * 			logs the goodput and ack latency of both. Last sweeps the window from one publish up to
+ * 			MQTT_INFLIGHT_WINDOW at two round trips and over a slow uplink, and logs the goodput of each window
+ *
+ * @return true if every scenario delivered every sample
+ */
+bool mqtt_impair_bench_run(void);
+
+#endif /* MAIN_MQTT_IMPAIR_BENCH_H_ */
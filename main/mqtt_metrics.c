@@ -0,0 +1,253 @@
+/*
+ * mqtt_metrics.c
+ *
+ *  Created on: Oct 18, 2026
+ *      Author: hamxa
+ */
+#include <stdio.h>
+#include <string.h>
+
+#include "freertos/FreeRTOS.h"
+#include "esp_timer.h"
+
+#include "mqtt_metrics.h"
+#include "mqtt_transport.h"
+
+//the agent task records, the HTTP server and telemetry task read; the sections only copy or bump counters
+static portMUX_TYPE g_metrics_lock = portMUX_INITIALIZER_UNLOCKED;
+
+static mqtt_metrics_t g_metrics;
+
+/**
+ * @fn uint64_t mqtt_metrics_transport_bytes(void)
+ * @brief bytes the transport sent and received since boot
+ *
+ */
+static uint64_t mqtt_metrics_transport_bytes(void)
+{
+	mqtt_transport_stats_t stats;
+
+	mqtt_transport_get_stats(&stats);
+	return stats.bytes_sent + stats.bytes_received;
+}
+
+/**
+ * @fn void mqtt_metrics_hist_add(mqtt_metrics_hist_t*, uint32_t)
+ * @brief count a value in its log2 bucket, called with the lock held
+ *
+ */
+static void mqtt_metrics_hist_add(mqtt_metrics_hist_t *hist, uint32_t value_ms)
+{
+	uint32_t bucket = value_ms ? 32 - __builtin_clz(value_ms) : 0;
+
+	hist->buckets[bucket < MQTT_METRICS_HIST_BUCKETS ? bucket : MQTT_METRICS_HIST_BUCKETS - 1]++;
+	hist->count++;
+	hist->sum_ms += value_ms;
+	if(value_ms > hist->max_ms)
+	{
+		hist->max_ms = value_ms;
+	}
+}
+
+void mqtt_metrics_record_puback(uint32_t rtt_ms)
+{
+	portENTER_CRITICAL(&g_metrics_lock);
+	mqtt_metrics_hist_add(&g_metrics.puback_rtt, rtt_ms);
+	portEXIT_CRITICAL(&g_metrics_lock);
+}
+
+void mqtt_metrics_record_connect(bool success, uint32_t duration_ms)
+{
+	portENTER_CRITICAL(&g_metrics_lock);
+	if(success)
+	{
+		mqtt_metrics_hist_add(&g_metrics.connect, duration_ms);
+	}
+	else
+	{
+		g_metrics.connect_failures++;
+	}
+	portEXIT_CRITICAL(&g_metrics_lock);
+}
+
+void mqtt_metrics_record_backoff(uint32_t backoff_ms)
+{
+	portENTER_CRITICAL(&g_metrics_lock);
+	g_metrics.backoff_ms += backoff_ms;
+	portEXIT_CRITICAL(&g_metrics_lock);
+}
+
+void mqtt_metrics_record_resend(void)
+{
+	portENTER_CRITICAL(&g_metrics_lock);
+	g_metrics.resends++;
+	portEXIT_CRITICAL(&g_metrics_lock);
+}
+
+void mqtt_metrics_record_ack_timeout(void)
+{
+	portENTER_CRITICAL(&g_metrics_lock);
+	g_metrics.ack_timeouts++;
+	portEXIT_CRITICAL(&g_metrics_lock);
+}
+
+void mqtt_metrics_record_loop_error(int32_t status)
+{
+	portENTER_CRITICAL(&g_metrics_lock);
+	g_metrics.loop_errors++;
+	g_metrics.last_loop_error = status;
+	portEXIT_CRITICAL(&g_metrics_lock);
+}
+
+void mqtt_metrics_session_start(void)
+{
+	uint64_t bytes = mqtt_metrics_transport_bytes();
+	int64_t now_us = esp_timer_get_time();
+
+	portENTER_CRITICAL(&g_metrics_lock);
+	g_metrics.sessions++;
+	g_metrics.connected = true;
+	g_metrics.session_start_us = now_us;
+	g_metrics.session_start_bytes = bytes;
+	portEXIT_CRITICAL(&g_metrics_lock);
+}
+
+void mqtt_metrics_session_end(void)
+{
+	uint64_t bytes = mqtt_metrics_transport_bytes();
+	int64_t now_us = esp_timer_get_time();
+
+	portENTER_CRITICAL(&g_metrics_lock);
+	if(g_metrics.connected)
+	{
+		g_metrics.connected = false;
+		g_metrics.last_session_s = (uint32_t)((now_us - g_metrics.session_start_us) / 1000000);
+		g_metrics.last_session_bytes = bytes - g_metrics.session_start_bytes;
+	}
+	portEXIT_CRITICAL(&g_metrics_lock);
+}
+
+void mqtt_metrics_get(mqtt_metrics_t *metrics)
+{
+	portENTER_CRITICAL(&g_metrics_lock);
+	*metrics = g_metrics;
+	portEXIT_CRITICAL(&g_metrics_lock);
+}
+
+uint32_t mqtt_metrics_percentile(const mqtt_metrics_hist_t *hist, uint8_t percent)
+{
+	//rank of the sample at the percentile, rounded up so p100 is the last sample
+	uint64_t rank = ((uint64_t)hist->count * percent + 99) / 100;
+	uint64_t seen = 0;
+
+	if(hist->count == 0)
+	{
+		return 0;
+	}
+	for(uint32_t i = 0; i < MQTT_METRICS_HIST_BUCKETS - 1; i++)
+	{
+		seen += hist->buckets[i];
+		if(seen >= rank)
+		{
+			//the upper bound of the bucket, but no sample was above the maximum
+			uint32_t bound = 1u << i;
+			return bound < hist->max_ms ? bound : hist->max_ms;
+		}
+	}
+	return hist->max_ms;
+}
+
+/**
+ * @fn int mqtt_metrics_hist_to_json(char*, size_t, const char*, const mqtt_metrics_hist_t*)
+ * @brief format one histogram with its count, mean, maximum and percentiles
+ *
+ */
+static int mqtt_metrics_hist_to_json(char *buf, size_t len, const char *name, const mqtt_metrics_hist_t *hist)
+{
+	size_t pos = 0;
+	int n;
+
+	n = snprintf(buf, len, "\"%s\":{\"count\":%lu,\"avg\":%lu,\"max\":%lu,\"p50\":%lu,\"p90\":%lu,\"p99\":%lu,\"buckets\":[",
+			name, (unsigned long)hist->count, (unsigned long)(hist->count ? hist->sum_ms / hist->count : 0),
+			(unsigned long)hist->max_ms, (unsigned long)mqtt_metrics_percentile(hist, 50),
+			(unsigned long)mqtt_metrics_percentile(hist, 90), (unsigned long)mqtt_metrics_percentile(hist, 99));
+	if(n < 0 || (size_t)n >= len)
+	{
+		return -1;
+	}
+	pos += n;
+
+	for(uint32_t i = 0; i < MQTT_METRICS_HIST_BUCKETS; i++)
+	{
+		n = snprintf(buf + pos, len - pos, "%s%lu", i ? "," : "", (unsigned long)hist->buckets[i]);
+		if(n < 0 || (size_t)n >= len - pos)
+		{
+			return -1;
+		}
+		pos += n;
+	}
+
+	n = snprintf(buf + pos, len - pos, "]}");
+	if(n < 0 || (size_t)n >= len - pos)
+	{
+		return -1;
+	}
+	return (int)(pos + n);
+}
+
+int mqtt_metrics_to_json(char *buf, size_t len)
+{
+	mqtt_metrics_t metrics;
+	uint64_t bytes = mqtt_metrics_transport_bytes();
+	int64_t now_us = esp_timer_get_time();
+	size_t pos = 0;
+	int n;
+
+	mqtt_metrics_get(&metrics);
+
+	n = snprintf(buf, len, "{");
+	if(n < 0 || (size_t)n >= len)
+	{
+		return -1;
+	}
+	pos += n;
+
+	n = mqtt_metrics_hist_to_json(buf + pos, len - pos, "puback_rtt_ms", &metrics.puback_rtt);
+	if(n < 0)
+	{
+		return -1;
+	}
+	pos += n;
+
+	n = snprintf(buf + pos, len - pos, ",");
+	if(n < 0 || (size_t)n >= len - pos)
+	{
+		return -1;
+	}
+	pos += n;
+
+	n = mqtt_metrics_hist_to_json(buf + pos, len - pos, "connect_ms", &metrics.connect);
+	if(n < 0)
+	{
+		return -1;
+	}
+	pos += n;
+
+	n = snprintf(buf + pos, len - pos, ",\"connected\":%s,\"sessions\":%lu,\"reconnects\":%lu,\"connect_failures\":%lu,"
+			"\"backoff_ms\":%llu,\"resends\":%lu,\"ack_timeouts\":%lu,\"loop_errors\":%lu,\"last_loop_error\":%ld,"
+			"\"session_s\":%lu,\"session_bytes\":%llu,\"last_session_s\":%lu,\"last_session_bytes\":%llu}",
+			metrics.connected ? "true" : "false", (unsigned long)metrics.sessions,
+			(unsigned long)(metrics.sessions ? metrics.sessions - 1 : 0), (unsigned long)metrics.connect_failures,
+			(unsigned long long)metrics.backoff_ms, (unsigned long)metrics.resends, (unsigned long)metrics.ack_timeouts,
+			(unsigned long)metrics.loop_errors, (long)metrics.last_loop_error,
+			(unsigned long)(metrics.connected ? (now_us - metrics.session_start_us) / 1000000 : 0),
+			(unsigned long long)(metrics.connected ? bytes - metrics.session_start_bytes : 0),
+			(unsigned long)metrics.last_session_s, (unsigned long long)metrics.last_session_bytes);
+	if(n < 0 || (size_t)n >= len - pos)
+	{
+		return -1;
+	}
+	pos += n;
+
+	return (int)pos;
+}
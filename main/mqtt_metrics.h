@@ -0,0 +1,139 @@
+/*
+ * mqtt_metrics.h
+ *
+ *  Created on: Oct 18, 2026
+ *      Author: hamxa
+ */
+
+#ifndef MAIN_MQTT_METRICS_H_
+#define MAIN_MQTT_METRICS_H_
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+//Buckets of the latency histograms, bucket 0 counts values below 1 ms, bucket i values from 2^(i-1) up to 2^i ms,
+//the last one everything above
+#define MQTT_METRICS_HIST_BUCKETS		16
+
+//Buffer size that holds mqtt_metrics_to_json()
+#define MQTT_METRICS_JSON_MAX_LEN		1024U
+
+/**
+ * Latency histogram with log2 millisecond buckets
+ */
+typedef struct mqtt_metrics_hist
+{
+	uint32_t buckets[MQTT_METRICS_HIST_BUCKETS];
+	uint32_t count;
+	uint64_t sum_ms;
+	uint32_t max_ms;
+}mqtt_metrics_hist_t;
+
+/**
+ * Health of the broker connection since boot
+ */
+typedef struct mqtt_metrics
+{
+	mqtt_metrics_hist_t puback_rtt;		///> QoS1 PUBLISH to PUBACK, from the last time the packet was sent
+	mqtt_metrics_hist_t connect;		///> TLS handshake to CONNACK of the successful connects
+	uint32_t sessions;					///> MQTT sessions established, the first one and every reconnect
+	uint32_t connect_failures;			///> connect attempts that failed at TLS or CONNACK
+	uint64_t backoff_ms;				///> time waited between connect attempts
+	uint32_t resends;					///> unacknowledged publishes resent on a resumed session
+	uint32_t ack_timeouts;				///> acks waited for in vain while MQTT_ProcessLoop kept succeeding
+	uint32_t loop_errors;				///> MQTT_ProcessLoop failures, each one ends the session
+	int32_t last_loop_error;			///> MQTTStatus_t of the last failure
+	bool connected;
+	int64_t session_start_us;			///> start of the current session
+	uint64_t session_start_bytes;		///> bytes the transport sent and received before the current session
+	uint32_t last_session_s;			///> length of the last session that ended
+	uint64_t last_session_bytes;		///> bytes sent and received during the last session that ended
+}mqtt_metrics_t;
+
+/**
+ * @fn void mqtt_metrics_record_puback(uint32_t)
+ * @brief add the round trip of an acknowledged QoS1 publish
+ *
+ */
+void mqtt_metrics_record_puback(uint32_t rtt_ms);
+
+/**
+ * @fn void mqtt_metrics_record_connect(bool, uint32_t)
+ * @brief count a connect attempt
+ *
+ * @param success whether the CONNACK accepted the connection
+ * @param duration_ms TLS handshake to CONNACK, added to the histogram on success
+ */
+void mqtt_metrics_record_connect(bool success, uint32_t duration_ms);
+
+/**
+ * @fn void mqtt_metrics_record_backoff(uint32_t)
+ * @brief add the wait before the next connect attempt
+ *
+ */
+void mqtt_metrics_record_backoff(uint32_t backoff_ms);
+
+/**
+ * @fn void mqtt_metrics_record_resend(void)
+ * @brief count a publish resent after a reconnect
+ *
+ */
+void mqtt_metrics_record_resend(void);
+
+/**
+ * @fn void mqtt_metrics_record_ack_timeout(void)
+ * @brief count an ack that did not arrive in time
+ *
+ */
+void mqtt_metrics_record_ack_timeout(void);
+
+/**
+ * @fn void mqtt_metrics_record_loop_error(int32_t)
+ * @brief count a failed MQTT_ProcessLoop
+ *
+ * @param status MQTTStatus_t returned
+ */
+void mqtt_metrics_record_loop_error(int32_t status);
+
+/**
+ * @fn void mqtt_metrics_session_start(void)
+ * @brief mark the start of an MQTT session
+ *
+ */
+void mqtt_metrics_session_start(void);
+
+/**
+ * @fn void mqtt_metrics_session_end(void)
+ * @brief mark the end of the current MQTT session, keeping its length and the bytes it moved
+ *
+ */
+void mqtt_metrics_session_end(void);
+
+/**
+ * @fn void mqtt_metrics_get(mqtt_metrics_t*)
+ * @brief get a consistent copy of the metrics. Safe from any task
+ *
+ */
+void mqtt_metrics_get(mqtt_metrics_t *metrics);
+
+/**
+ * @fn uint32_t mqtt_metrics_percentile(const mqtt_metrics_hist_t*, uint8_t)
+ * @brief estimate a percentile from the histogram, rounded up to its bucket bound
+ *
+ * @param percent percentile, 1 to 100
+ * @return latency in ms, 0 if the histogram is empty
+ */
+uint32_t mqtt_metrics_percentile(const mqtt_metrics_hist_t *hist, uint8_t percent);
+
+/**
+ * @fn int mqtt_metrics_to_json(char*, size_t)
+ * @brief format the metrics as JSON, for the HTTP endpoint and the diagnostics topic
+ *
+ * @param buf output buffer
+ * @param len size of the output buffer
+ * @return number of characters written, or -1 if the buffer is too small
+ */
+int mqtt_metrics_to_json(char *buf, size_t len);
+
+#endif /* MAIN_MQTT_METRICS_H_ */
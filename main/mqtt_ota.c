@@ -0,0 +1,668 @@
+/*
+ * mqtt_ota.c
+ *
+ *  Created on: Oct 18, 2026
+ *      Author: hamxa
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "esp_log.h"
+#include "esp_rom_crc.h"
+
+#include "mqtt_ota.h"
+
+#if !CONFIG_IDF_TARGET_LINUX
+#include "freertos/FreeRTOS.h"
+#include "freertos/queue.h"
+#include "freertos/task.h"
+#include "esp_app_desc.h"
+#include "esp_ota_ops.h"
+#include "esp_system.h"
+#include "esp_timer.h"
+
+#include "mqtt_agent.h"
+#include "mqtt_session_store.h"
+#include "ota_verify.h"
+#include "tasks_common.h"
+#endif
+
+//the topic, the packet id and the block header take up to 128 bytes of the network buffer
+#if CONFIG_MQTT_OTA_BLOCK_SIZE + 128 > CONFIG_MQTT_NETWORK_BUFFER_SIZE
+#error "MQTT_OTA_BLOCK_SIZE does not fit in MQTT_NETWORK_BUFFER_SIZE"
+#endif
+
+static mqtt_ota_stats_t g_stats;
+
+/**
+ * @fn bool mqtt_ota_id_valid(const char*, size_t)
+ * @brief check that a job id can be copied into topics and JSON as it is
+ *
+ */
+static bool mqtt_ota_id_valid(const char *id, size_t len)
+{
+	for(size_t i = 0; i < len; i++)
+	{
+		char c = id[i];
+		if(!((c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || (c >= '0' && c <= '9') ||
+			 c == '-' || c == '_' || c == '.' || c == ':'))
+		{
+			return false;
+		}
+	}
+	return len > 0;
+}
+
+/**
+ * @fn const char mqtt_ota_json_value*(const char*, const char*)
+ * @brief find the value of a key in a flat JSON object
+ *
+ * @return the first character of the value, NULL if the key is missing
+ */
+static const char *mqtt_ota_json_value(const char *json, const char *key)
+{
+	char pattern[16];
+	const char *value;
+
+	snprintf(pattern, sizeof(pattern), "\"%s\":", key);
+	value = strstr(json, pattern);
+	if(value == NULL)
+	{
+		return NULL;
+	}
+	value += strlen(pattern);
+	while(*value == ' ')
+	{
+		value++;
+	}
+	return value;
+}
+
+/**
+ * @fn bool mqtt_ota_json_u32(const char*, const char*, uint32_t*)
+ * @brief read an unsigned 32 bit value of a flat JSON object
+ *
+ */
+static bool mqtt_ota_json_u32(const char *json, const char *key, uint32_t *out)
+{
+	const char *value = mqtt_ota_json_value(json, key);
+	char *end;
+
+	if(value == NULL || *value < '0' || *value > '9')
+	{
+		return false;
+	}
+	unsigned long long parsed = strtoull(value, &end, 10);
+	if(parsed > UINT32_MAX || (*end != ',' && *end != '}' && *end != ' '))
+	{
+		return false;
+	}
+	*out = (uint32_t)parsed;
+	return true;
+}
+
+esp_err_t mqtt_ota_parse(const MQTTPublishInfo_t *publish, mqtt_ota_msg_t *msg)
+{
+	static const size_t data_prefix_len = sizeof(DEVICE_TOPICS_OTA_DATA_PREFIX) - 1;
+	const char *topic = publish->pTopicName;
+	size_t topic_len = publish->topicNameLength;
+
+	if(topic_len == sizeof(DEVICE_TOPICS_OTA_JOB) - 1 && memcmp(topic, DEVICE_TOPICS_OTA_JOB, topic_len) == 0)
+	{
+		if(publish->payloadLength > MQTT_OTA_JOB_MAX_LEN)
+		{
+			return ESP_ERR_INVALID_SIZE;
+		}
+		msg->type = MQTT_OTA_MSG_JOB;
+		msg->job[0] = '\0';
+		msg->index = 0;
+	}
+	else
+	{
+		//devices/<id>/ota/data/<job>/<index>
+		if(topic_len <= data_prefix_len || memcmp(topic, DEVICE_TOPICS_OTA_DATA_PREFIX, data_prefix_len) != 0)
+		{
+			return ESP_ERR_INVALID_ARG;
+		}
+		const char *job = topic + data_prefix_len;
+		size_t rest_len = topic_len - data_prefix_len;
+		const char *slash = memchr(job, '/', rest_len);
+		if(slash == NULL || !mqtt_ota_id_valid(job, slash - job))
+		{
+			return ESP_ERR_INVALID_ARG;
+		}
+		size_t job_len = slash - job;
+		size_t digits = rest_len - job_len - 1;
+		if(job_len > MQTT_OTA_JOB_ID_MAX || digits == 0 || digits > 9 ||
+		   publish->payloadLength <= MQTT_OTA_BLOCK_HEADER_LEN || publish->payloadLength > MQTT_OTA_BLOCK_HEADER_LEN + MQTT_OTA_BLOCK_SIZE)
+		{
+			return ESP_ERR_INVALID_SIZE;
+		}
+
+		msg->index = 0;
+		for(size_t i = 0; i < digits; i++)
+		{
+			char c = slash[1 + i];
+			if(c < '0' || c > '9')
+			{
+				return ESP_ERR_INVALID_ARG;
+			}
+			msg->index = msg->index * 10 + (c - '0');
+		}
+		msg->type = MQTT_OTA_MSG_BLOCK;
+		memcpy(msg->job, job, job_len);
+		msg->job[job_len] = '\0';
+	}
+
+	memcpy(msg->data, publish->pPayload, publish->payloadLength);
+	msg->len = (uint16_t)publish->payloadLength;
+	return ESP_OK;
+}
+
+esp_err_t mqtt_ota_parse_job(const mqtt_ota_msg_t *msg, mqtt_ota_job_t *job)
+{
+	char json[MQTT_OTA_JOB_MAX_LEN + 1];
+	const char *id;
+	const char *id_end;
+	const char *sha256;
+
+	if(msg->type != MQTT_OTA_MSG_JOB || msg->len > MQTT_OTA_JOB_MAX_LEN)
+	{
+		return ESP_ERR_INVALID_ARG;
+	}
+	memcpy(json, msg->data, msg->len);
+	json[msg->len] = '\0';
+
+	id = mqtt_ota_json_value(json, "job");
+	if(id == NULL || *id++ != '"' || (id_end = strchr(id, '"')) == NULL ||
+	   id_end - id > MQTT_OTA_JOB_ID_MAX || !mqtt_ota_id_valid(id, id_end - id))
+	{
+		return ESP_ERR_INVALID_ARG;
+	}
+	if(!mqtt_ota_json_u32(json, "size", &job->size) || job->size == 0 || !mqtt_ota_json_u32(json, "crc", &job->crc))
+	{
+		return ESP_ERR_INVALID_ARG;
+	}
+	sha256 = mqtt_ota_json_value(json, "sha256");
+	if(sha256 != NULL && (*sha256++ != '"' || strspn(sha256, "0123456789abcdefABCDEF") != MQTT_OTA_SHA256_HEX_LEN ||
+						  sha256[MQTT_OTA_SHA256_HEX_LEN] != '"'))
+	{
+		return ESP_ERR_INVALID_ARG;
+	}
+	memcpy(job->id, id, id_end - id);
+	job->id[id_end - id] = '\0';
+	job->sha256[0] = '\0';
+	if(sha256 != NULL)
+	{
+		memcpy(job->sha256, sha256, MQTT_OTA_SHA256_HEX_LEN);
+		job->sha256[MQTT_OTA_SHA256_HEX_LEN] = '\0';
+	}
+	return ESP_OK;
+}
+
+void mqtt_ota_begin(mqtt_ota_t *ota, const mqtt_ota_job_t *job, uint32_t window, uint32_t retry_ms, int64_t now_us)
+{
+	*ota = (mqtt_ota_t){0};
+	ota->job = *job;
+	ota->blocks = (job->size + MQTT_OTA_BLOCK_SIZE - 1) / MQTT_OTA_BLOCK_SIZE;
+	ota->window = window ? window : 1;
+	ota->retry_ms = retry_ms;
+	ota->progress_us = now_us;
+	__atomic_fetch_add(&g_stats.jobs, 1, __ATOMIC_RELAXED);
+}
+
+esp_err_t mqtt_ota_accept(mqtt_ota_t *ota, const mqtt_ota_msg_t *msg, int64_t now_us, const uint8_t **data, size_t *len)
+{
+	size_t block_len;
+	uint32_t crc;
+
+	if(msg->type != MQTT_OTA_MSG_BLOCK || msg->index != ota->next || ota->next >= ota->blocks ||
+	   strcmp(msg->job, ota->job.id) != 0)
+	{
+		__atomic_fetch_add(&g_stats.stale, 1, __ATOMIC_RELAXED);
+		return ESP_ERR_INVALID_STATE;
+	}
+
+	block_len = msg->index == ota->blocks - 1 ? ota->job.size - msg->index * MQTT_OTA_BLOCK_SIZE : MQTT_OTA_BLOCK_SIZE;
+	crc = ((uint32_t)msg->data[0] << 24) | ((uint32_t)msg->data[1] << 16) | ((uint32_t)msg->data[2] << 8) | msg->data[3];
+	if(msg->len != MQTT_OTA_BLOCK_HEADER_LEN + block_len ||
+	   esp_rom_crc32_le(0, msg->data + MQTT_OTA_BLOCK_HEADER_LEN, block_len) != crc)
+	{
+		//the blocks behind it are stale, ask for it again without waiting for the retry time
+		__atomic_fetch_add(&g_stats.corrupt, 1, __ATOMIC_RELAXED);
+		ota->requested = ota->next;
+		return msg->len != MQTT_OTA_BLOCK_HEADER_LEN + block_len ? ESP_ERR_INVALID_SIZE : ESP_ERR_INVALID_CRC;
+	}
+
+	*data = msg->data + MQTT_OTA_BLOCK_HEADER_LEN;
+	*len = block_len;
+	ota->crc = esp_rom_crc32_le(ota->crc, *data, block_len);
+	ota->next++;
+	if(ota->requested < ota->next)
+	{
+		//a block of a request given up on arrived after all
+		ota->requested = ota->next;
+	}
+	ota->progress_us = now_us;
+	__atomic_fetch_add(&g_stats.blocks, 1, __ATOMIC_RELAXED);
+	return ESP_OK;
+}
+
+int mqtt_ota_request(mqtt_ota_t *ota, int64_t now_us, char *payload, size_t size)
+{
+	uint32_t end;
+	int printed;
+
+	if(ota->next >= ota->blocks)
+	{
+		return 0;
+	}
+	if(ota->requested > ota->next && now_us - ota->progress_us >= (int64_t)ota->retry_ms * 1000)
+	{
+		//a block or a request was lost, the blocks after it were dropped as stale
+		__atomic_fetch_add(&g_stats.retries, 1, __ATOMIC_RELAXED);
+		ota->requested = ota->next;
+	}
+	//refilled once half the window was written, so the broker always has blocks to send
+	if(ota->requested - ota->next > ota->window / 2)
+	{
+		return 0;
+	}
+	end = ota->next + ota->window < ota->blocks ? ota->next + ota->window : ota->blocks;
+	if(end <= ota->requested)
+	{
+		return 0;
+	}
+
+	printed = snprintf(payload, size, "{\"job\":\"%s\",\"block\":%lu,\"count\":%lu,\"size\":%u}", ota->job.id,
+			(unsigned long)ota->requested, (unsigned long)(end - ota->requested), MQTT_OTA_BLOCK_SIZE);
+	if(printed < 0 || (size_t)printed >= size)
+	{
+		return -1;
+	}
+	ota->requested = end;
+	ota->progress_us = now_us;
+	__atomic_fetch_add(&g_stats.requests, 1, __ATOMIC_RELAXED);
+	return printed;
+}
+
+void mqtt_ota_resume(mqtt_ota_t *ota)
+{
+	ota->requested = ota->next;
+}
+
+bool mqtt_ota_complete(const mqtt_ota_t *ota)
+{
+	return ota->blocks > 0 && ota->next >= ota->blocks;
+}
+
+bool mqtt_ota_image_valid(const mqtt_ota_t *ota)
+{
+	return mqtt_ota_complete(ota) && ota->crc == ota->job.crc;
+}
+
+int mqtt_ota_status(const mqtt_ota_t *ota, const char *state, char *payload, size_t size)
+{
+	uint32_t offset = ota->next * MQTT_OTA_BLOCK_SIZE < ota->job.size ? ota->next * MQTT_OTA_BLOCK_SIZE : ota->job.size;
+	int printed = snprintf(payload, size, "{\"job\":\"%s\",\"state\":\"%s\",\"offset\":%lu}", ota->job.id, state,
+			(unsigned long)offset);
+
+	return printed < 0 || (size_t)printed >= size ? -1 : printed;
+}
+
+void mqtt_ota_get_stats(mqtt_ota_stats_t *stats)
+{
+	stats->jobs = __atomic_load_n(&g_stats.jobs, __ATOMIC_RELAXED);
+	stats->blocks = __atomic_load_n(&g_stats.blocks, __ATOMIC_RELAXED);
+	stats->requests = __atomic_load_n(&g_stats.requests, __ATOMIC_RELAXED);
+	stats->retries = __atomic_load_n(&g_stats.retries, __ATOMIC_RELAXED);
+	stats->stale = __atomic_load_n(&g_stats.stale, __ATOMIC_RELAXED);
+	stats->corrupt = __atomic_load_n(&g_stats.corrupt, __ATOMIC_RELAXED);
+	stats->dropped = __atomic_load_n(&g_stats.dropped, __ATOMIC_RELAXED);
+}
+
+#if !CONFIG_IDF_TARGET_LINUX
+static const char TAG[] = "mqtt_ota";
+
+static QueueHandle_t g_ota_queue;
+
+//owned by the OTA task, too large for its stack
+static mqtt_ota_msg_t g_msg;
+static mqtt_ota_t g_ota;
+static esp_ota_handle_t g_handle;
+static ota_verify_t g_verify;
+static const esp_partition_t *g_partition;
+static bool g_active;
+static int64_t g_start_us;
+
+//owned by the agent task
+static mqtt_ota_msg_t g_submit_msg;
+
+//set by the agent task once the rolled_back status was acked
+static bool g_rollback_acked;
+
+/**
+ * @fn esp_err_t mqtt_ota_publish_job_status(const mqtt_ota_t*, const char*, mqtt_agent_done_cb_t)
+ * @brief publish the state of a job at QoS1, the cloud clears the job once it is done, failed or rolled back
+ *
+ */
+static esp_err_t mqtt_ota_publish_job_status(const mqtt_ota_t *ota, const char *state, mqtt_agent_done_cb_t done_cb)
+{
+	char status[MQTT_OTA_REQUEST_MAX_LEN];
+	int len = mqtt_ota_status(ota, state, status, sizeof(status));
+
+	if(len < 0 || mqtt_agent_publish(DEVICE_TOPICS_OTA_STATUS, status, (size_t)len, MQTTQoS1, done_cb, NULL,
+									 pdMS_TO_TICKS(MQTT_OTA_PUBLISH_WAIT_MS)) != ESP_OK)
+	{
+		ESP_LOGW(TAG, "mqtt_ota_publish_status: %s status of %s not queued", state, ota->job.id);
+		return ESP_FAIL;
+	}
+	return ESP_OK;
+}
+
+/**
+ * @fn void mqtt_ota_publish_status(const char*)
+ * @brief publish the state of the job being downloaded
+ *
+ */
+static void mqtt_ota_publish_status(const char *state)
+{
+	mqtt_ota_publish_job_status(&g_ota, state, NULL);
+}
+
+/**
+ * @fn bool mqtt_ota_rolled_back(const char*)
+ * @brief check whether a job is the image the bootloader last rolled back from, its id is the image version
+ *
+ */
+static bool mqtt_ota_rolled_back(const char *id)
+{
+	const esp_partition_t *invalid = esp_ota_get_last_invalid_partition();
+	esp_app_desc_t desc;
+
+	return invalid != NULL && esp_ota_get_partition_description(invalid, &desc) == ESP_OK && strcmp(desc.version, id) == 0;
+}
+
+/**
+ * @fn void mqtt_ota_fail(const char*, esp_err_t)
+ * @brief give the job up, the running image stays the boot image
+ *
+ */
+static void mqtt_ota_fail(const char *what, esp_err_t err)
+{
+	ESP_LOGE(TAG, "job %s failed at block %lu: %s, %s", g_ota.job.id, (unsigned long)g_ota.next, what, esp_err_to_name(err));
+	if(g_active)
+	{
+		esp_ota_abort(g_handle);
+		ota_verify_abort(&g_verify);
+		g_active = false;
+	}
+	mqtt_ota_publish_status("failed");
+}
+
+/**
+ * @fn void mqtt_ota_job(const mqtt_ota_msg_t*)
+ * @brief start downloading an announced image into the next OTA partition
+ *
+ */
+static void mqtt_ota_job(const mqtt_ota_msg_t *msg)
+{
+	mqtt_ota_job_t job;
+	esp_err_t err;
+
+	if(mqtt_ota_parse_job(msg, &job) != ESP_OK)
+	{
+		__atomic_fetch_add(&g_stats.dropped, 1, __ATOMIC_RELAXED);
+		ESP_LOGW(TAG, "malformed job: %.*s", (int)msg->len, (const char*)msg->data);
+		return;
+	}
+	//the job stays retained until the cloud saw the status of the new image, which carries its id as version
+	if(strcmp(job.id, esp_app_get_description()->version) == 0)
+	{
+		ESP_LOGI(TAG, "job %s is the running image", job.id);
+		return;
+	}
+	//a job still retained after its image failed the checks on its first boot would be downloaded and rolled back
+	//over and over
+	if(mqtt_ota_rolled_back(job.id))
+	{
+		mqtt_ota_t refused = {.job = job};
+
+		ESP_LOGW(TAG, "job %s is the image rolled back from, refused", job.id);
+		mqtt_ota_publish_job_status(&refused, "rolled_back", NULL);
+		return;
+	}
+	if(g_active)
+	{
+		//a repeated announcement of the job being downloaded
+		if(strcmp(job.id, g_ota.job.id) == 0 && job.size == g_ota.job.size && job.crc == g_ota.job.crc &&
+		   strcmp(job.sha256, g_ota.job.sha256) == 0)
+		{
+			return;
+		}
+		ESP_LOGW(TAG, "job %s superseded by %s", g_ota.job.id, job.id);
+		esp_ota_abort(g_handle);
+		ota_verify_abort(&g_verify);
+		g_active = false;
+	}
+
+	mqtt_ota_begin(&g_ota, &job, CONFIG_MQTT_OTA_WINDOW, CONFIG_MQTT_OTA_RETRY_MS, esp_timer_get_time());
+	g_partition = esp_ota_get_next_update_partition(NULL);
+	if(g_partition == NULL || job.size > g_partition->size)
+	{
+		mqtt_ota_fail("no partition fits the image", ESP_ERR_INVALID_SIZE);
+		return;
+	}
+	//sectors are erased as the blocks are written, so the first block is not held up by erasing the partition
+	err = esp_ota_begin(g_partition, OTA_WITH_SEQUENTIAL_WRITES, &g_handle);
+	if(err != ESP_OK)
+	{
+		mqtt_ota_fail("esp_ota_begin", err);
+		return;
+	}
+	uint8_t sha256[OTA_VERIFY_DIGEST_LEN];
+	ota_verify_begin(&g_verify, ota_verify_parse_digest(job.sha256, strlen(job.sha256), sha256) ? sha256 : NULL);
+	g_active = true;
+	g_start_us = esp_timer_get_time();
+	ESP_LOGI(TAG, "job %s: %lu bytes in %lu blocks into partition subtype %d at offset 0x%lx", job.id,
+			(unsigned long)job.size, (unsigned long)g_ota.blocks, g_partition->subtype, (unsigned long)g_partition->address);
+	mqtt_ota_publish_status("downloading");
+}
+
+/**
+ * @fn void mqtt_ota_finish(void)
+ * @brief check the complete image, make it the boot image and restart into it
+ *
+ */
+static void mqtt_ota_finish(void)
+{
+	int64_t elapsed_us = esp_timer_get_time() - g_start_us;
+	int64_t end_us;
+	esp_err_t err;
+
+	if(!mqtt_ota_image_valid(&g_ota))
+	{
+		mqtt_ota_fail("image CRC mismatch", ESP_ERR_INVALID_CRC);
+		return;
+	}
+	//the SHA-256 was computed as the blocks were written, a bad image is given up without reading it back
+	err = ota_verify_finish(&g_verify);
+	if(err != ESP_OK)
+	{
+		mqtt_ota_fail("image SHA-256 mismatch", err);
+		return;
+	}
+	//checks the image header and its hash again, the handle is freed whatever the result
+	g_active = false;
+	end_us = esp_timer_get_time();
+	err = esp_ota_end(g_handle);
+	if(err != ESP_OK)
+	{
+		mqtt_ota_fail("esp_ota_end", err);
+		return;
+	}
+	err = esp_ota_set_boot_partition(g_partition);
+	if(err != ESP_OK)
+	{
+		mqtt_ota_fail("esp_ota_set_boot_partition", err);
+		return;
+	}
+
+	ESP_LOGI(TAG, "job %s: %lu bytes in %lld ms, %lu KB/s, %lld ms to boot it, restarting in %u ms", g_ota.job.id,
+			(unsigned long)g_ota.job.size, (long long)(elapsed_us / 1000),
+			(unsigned long)(elapsed_us > 0 ? (uint64_t)g_ota.job.size * 1000000 / 1024 / elapsed_us : 0),
+			(long long)((esp_timer_get_time() - end_us) / 1000), MQTT_OTA_RESTART_DELAY_MS);
+	mqtt_ota_publish_status("done");
+	//the status goes out before the restart
+	vTaskDelay(pdMS_TO_TICKS(MQTT_OTA_RESTART_DELAY_MS));
+#if CONFIG_MQTT_SESSION_STORE
+	//the new image may lay out RTC memory differently, it takes the unacked publishes over from NVS
+	mqtt_session_store_flush();
+#endif
+	esp_restart();
+}
+
+/**
+ * @fn void mqtt_ota_block(const mqtt_ota_msg_t*)
+ * @brief write the next block of the image
+ *
+ */
+static void mqtt_ota_block(const mqtt_ota_msg_t *msg)
+{
+	const uint8_t *data;
+	size_t len;
+	esp_err_t err;
+
+	//stale and corrupt blocks are requested again
+	if(!g_active || mqtt_ota_accept(&g_ota, msg, esp_timer_get_time(), &data, &len) != ESP_OK)
+	{
+		return;
+	}
+	//a block that is not part of an app image is given up before it is written
+	err = ota_verify_update(&g_verify, data, len);
+	if(err != ESP_OK)
+	{
+		mqtt_ota_fail("image check", err);
+		return;
+	}
+	err = esp_ota_write(g_handle, data, len);
+	if(err != ESP_OK)
+	{
+		mqtt_ota_fail("esp_ota_write", err);
+		return;
+	}
+	if(mqtt_ota_complete(&g_ota))
+	{
+		mqtt_ota_finish();
+	}
+}
+
+/**
+ * @fn void mqtt_ota_task(void*)
+ * @brief write the blocks as they arrive and keep a window of blocks requested
+ *
+ */
+static void mqtt_ota_task(void *pvParameters)
+{
+	char request[MQTT_OTA_REQUEST_MAX_LEN];
+	bool connected = false;
+
+	for(;;)
+	{
+		if(xQueueReceive(g_ota_queue, &g_msg, pdMS_TO_TICKS(MQTT_OTA_POLL_MS)) == pdTRUE)
+		{
+			if(g_msg.type == MQTT_OTA_MSG_JOB)
+			{
+				mqtt_ota_job(&g_msg);
+			}
+			else
+			{
+				mqtt_ota_block(&g_msg);
+			}
+		}
+
+		//the blocks in flight were lost with the connection, they are asked for again once it is back
+		bool was_connected = connected;
+		connected = mqtt_agent_is_connected();
+		if(!g_active || !connected)
+		{
+			continue;
+		}
+		if(!was_connected)
+		{
+			mqtt_ota_resume(&g_ota);
+		}
+
+		//QoS0, a lost request is repeated after the retry time
+		int len = mqtt_ota_request(&g_ota, esp_timer_get_time(), request, sizeof(request));
+		if(len > 0 && mqtt_agent_publish(DEVICE_TOPICS_OTA_GET, request, (size_t)len, MQTTQoS0, NULL, NULL,
+										 pdMS_TO_TICKS(MQTT_OTA_PUBLISH_WAIT_MS)) != ESP_OK)
+		{
+			ESP_LOGW(TAG, "mqtt_ota_task: request for block %lu not queued", (unsigned long)g_ota.next);
+		}
+	}
+}
+
+void mqtt_ota_start(void)
+{
+	if(g_ota_queue != NULL)
+	{
+		return;
+	}
+	g_ota_queue = xQueueCreate(MQTT_OTA_QUEUE_LENGTH, sizeof(mqtt_ota_msg_t));
+	xTaskCreatePinnedToCore(&mqtt_ota_task, "mqtt_ota", MQTT_OTA_TASK_STACK_SIZE, NULL, MQTT_OTA_TASK_PRIORITY, NULL,
+			MQTT_OTA_TASK_CORE_ID);
+}
+
+void mqtt_ota_submit(const MQTTPublishInfo_t *publish)
+{
+	esp_err_t err = mqtt_ota_parse(publish, &g_submit_msg);
+
+	//a block that finds the queue full is stale by the time there is room, it is requested again
+	if(err == ESP_OK && (g_ota_queue == NULL || xQueueSend(g_ota_queue, &g_submit_msg, 0) != pdTRUE))
+	{
+		err = ESP_ERR_NO_MEM;
+	}
+	if(err != ESP_OK)
+	{
+		__atomic_fetch_add(&g_stats.dropped, 1, __ATOMIC_RELAXED);
+		ESP_LOGW(TAG, "publish on %.*s dropped: %s", publish->topicNameLength, publish->pTopicName, esp_err_to_name(err));
+	}
+}
+
+/**
+ * @fn void mqtt_ota_rollback_acked(void*, esp_err_t)
+ * @brief completion of the rolled_back status, called from the agent task
+ *
+ */
+static void mqtt_ota_rollback_acked(void *ctx, esp_err_t result)
+{
+	if(result == ESP_OK)
+	{
+		__atomic_store_n(&g_rollback_acked, true, __ATOMIC_RELAXED);
+	}
+}
+
+void mqtt_ota_report_rollback(void)
+{
+	//the job id of an image is its version
+	mqtt_ota_t running = {0};
+	int64_t deadline_us = esp_timer_get_time() + (int64_t)MQTT_OTA_ROLLBACK_WAIT_MS * 1000;
+
+	snprintf(running.job.id, sizeof(running.job.id), "%s", esp_app_get_description()->version);
+	if(mqtt_ota_publish_job_status(&running, "rolled_back", &mqtt_ota_rollback_acked) != ESP_OK)
+	{
+		return;
+	}
+	//polled rather than notified, the completion may come after the caller gave up waiting
+	while(!__atomic_load_n(&g_rollback_acked, __ATOMIC_RELAXED) && esp_timer_get_time() < deadline_us)
+	{
+		vTaskDelay(pdMS_TO_TICKS(MQTT_OTA_POLL_MS));
+	}
+	if(!__atomic_load_n(&g_rollback_acked, __ATOMIC_RELAXED))
+	{
+		ESP_LOGW(TAG, "rolled_back status of %s not acked within %d ms", running.job.id, MQTT_OTA_ROLLBACK_WAIT_MS);
+	}
+}
+#endif
@@ -0,0 +1,229 @@
+/*
+ * mqtt_ota.h
+ *
+ *  Created on: Oct 18, 2026
+ *      Author: hamxa
+ */
+
+#ifndef MAIN_MQTT_OTA_H_
+#define MAIN_MQTT_OTA_H_
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "esp_err.h"
+#include "core_mqtt.h"
+#include "sdkconfig.h"
+
+#include "device_topics.h"
+
+//Longest job id, a version string or a UUID fits
+#define MQTT_OTA_JOB_ID_MAX				36
+
+//Image bytes per block, the last block of an image is shorter
+#define MQTT_OTA_BLOCK_SIZE				CONFIG_MQTT_OTA_BLOCK_SIZE
+
+//Block payload: the CRC-32 of the block, big endian, then the image bytes
+#define MQTT_OTA_BLOCK_HEADER_LEN		4
+
+//SHA-256 of the image file in a job, 64 hex digits
+#define MQTT_OTA_SHA256_HEX_LEN			64
+
+//Largest job announcement and block request
+#define MQTT_OTA_JOB_MAX_LEN			192
+#define MQTT_OTA_REQUEST_MAX_LEN		(MQTT_OTA_JOB_ID_MAX + 64)
+
+//Largest payload of an incoming OTA publish, a block with its header or a job announcement
+#define MQTT_OTA_MSG_MAX_LEN			(MQTT_OTA_BLOCK_HEADER_LEN + MQTT_OTA_BLOCK_SIZE > MQTT_OTA_JOB_MAX_LEN ? \
+										 MQTT_OTA_BLOCK_HEADER_LEN + MQTT_OTA_BLOCK_SIZE : MQTT_OTA_JOB_MAX_LEN)
+
+//Blocks waiting for the OTA task, a window of blocks and a job announcement
+#define MQTT_OTA_QUEUE_LENGTH			(CONFIG_MQTT_OTA_WINDOW + 1)
+
+//Longest the OTA task waits for a block before it checks its requests
+#define MQTT_OTA_POLL_MS				100
+
+//Longest the OTA task waits for room in the agent queue for a request or a status
+#define MQTT_OTA_PUBLISH_WAIT_MS		100
+
+//Time the done status has to go out before the restart into the new image
+#define MQTT_OTA_RESTART_DELAY_MS		3000
+
+//Longest a failed image waits for the PUBACK of its rolled_back status before the rollback
+#define MQTT_OTA_ROLLBACK_WAIT_MS		5000
+
+/**
+ * What an incoming OTA publish carries
+ */
+typedef enum mqtt_ota_msg_type
+{
+	MQTT_OTA_MSG_JOB = 0,		/**< MQTT_OTA_MSG_JOB, a new image on devices/<id>/ota/job */
+	MQTT_OTA_MSG_BLOCK			/**< MQTT_OTA_MSG_BLOCK, a block on devices/<id>/ota/data/<job>/<index> */
+}mqtt_ota_msg_type_e;
+
+/**
+ * Image announced by a job: {"job":"<id>","size":<bytes>,"crc":<CRC-32 of the image>,"sha256":"<hex>"}, the
+ * SHA-256 of the file as sha256sum prints it is optional
+ */
+typedef struct mqtt_ota_job
+{
+	char id[MQTT_OTA_JOB_ID_MAX + 1];
+	uint32_t size;
+	uint32_t crc;
+	char sha256[MQTT_OTA_SHA256_HEX_LEN + 1];	///> empty if the job has none
+}mqtt_ota_job_t;
+
+/**
+ * Incoming OTA publish, copied out of the network buffer
+ */
+typedef struct mqtt_ota_msg
+{
+	mqtt_ota_msg_type_e type;
+	char job[MQTT_OTA_JOB_ID_MAX + 1];	///> job of a block
+	uint32_t index;						///> block number
+	uint16_t len;						///> bytes in data
+	uint8_t data[MQTT_OTA_MSG_MAX_LEN];	///> job JSON, or the block with its header
+}mqtt_ota_msg_t;
+
+/**
+ * OTA counters since boot
+ */
+typedef struct mqtt_ota_stats
+{
+	uint32_t jobs;				///> jobs started
+	uint32_t blocks;			///> blocks written
+	uint32_t requests;			///> block requests built, retries included
+	uint32_t retries;			///> requests repeated because no block arrived in time
+	uint32_t stale;				///> blocks of another job, already written or past a lost one
+	uint32_t corrupt;			///> blocks whose CRC did not match
+	uint32_t dropped;			///> malformed publishes, and publishes that found a full queue
+}mqtt_ota_stats_t;
+
+/**
+ * Download state of one job. Blocks are requested a window ahead and written in order, a lost block makes the
+ * next ones stale until the request timeout goes back to it
+ */
+typedef struct mqtt_ota
+{
+	mqtt_ota_job_t job;
+	uint32_t blocks;			///> blocks in the image
+	uint32_t next;				///> next block to write
+	uint32_t requested;			///> first block not requested yet
+	uint32_t window;			///> blocks requested ahead of next
+	uint32_t crc;				///> CRC-32 of the blocks written
+	int64_t progress_us;		///> last block written or request sent
+	uint32_t retry_ms;
+}mqtt_ota_t;
+
+/**
+ * @fn esp_err_t mqtt_ota_parse(const MQTTPublishInfo_t*, mqtt_ota_msg_t*)
+ * @brief take a job announcement or a block from a publish on the OTA topics of this device
+ *
+ * @return ESP_OK, ESP_ERR_INVALID_ARG for another topic, ESP_ERR_INVALID_SIZE if it does not fit
+ */
+esp_err_t mqtt_ota_parse(const MQTTPublishInfo_t *publish, mqtt_ota_msg_t *msg);
+
+/**
+ * @fn esp_err_t mqtt_ota_parse_job(const mqtt_ota_msg_t*, mqtt_ota_job_t*)
+ * @brief read the job JSON of a job announcement
+ *
+ * @return ESP_OK, ESP_ERR_INVALID_ARG if a field is missing, the id is not made of letters, digits, '-', '_',
+ * 			'.' or ':' or the SHA-256 is not 64 hex digits
+ */
+esp_err_t mqtt_ota_parse_job(const mqtt_ota_msg_t *msg, mqtt_ota_job_t *job);
+
+/**
+ * @fn void mqtt_ota_begin(mqtt_ota_t*, const mqtt_ota_job_t*, uint32_t, uint32_t, int64_t)
+ * @brief start downloading a job from its first block
+ *
+ * @param window blocks requested ahead of the next one to write
+ * @param retry_ms time without a block after which the blocks from the next one are requested again
+ */
+void mqtt_ota_begin(mqtt_ota_t *ota, const mqtt_ota_job_t *job, uint32_t window, uint32_t retry_ms, int64_t now_us);
+
+/**
+ * @fn esp_err_t mqtt_ota_accept(mqtt_ota_t*, const mqtt_ota_msg_t*, int64_t, const uint8_t**, size_t*)
+ * @brief check a block against the job, its position and its CRC. An accepted block must be written at once,
+ * 			the job moves past it
+ *
+ * @param data output, the image bytes of the block
+ * @param len output, their length
+ * @return ESP_OK if it is the next block, ESP_ERR_INVALID_STATE if it is stale, ESP_ERR_INVALID_CRC if it is
+ * 			corrupt, ESP_ERR_INVALID_SIZE if its length is wrong
+ */
+esp_err_t mqtt_ota_accept(mqtt_ota_t *ota, const mqtt_ota_msg_t *msg, int64_t now_us, const uint8_t **data, size_t *len);
+
+/**
+ * @fn int mqtt_ota_request(mqtt_ota_t*, int64_t, char*, size_t)
+ * @brief build the request for more blocks once half the window was written, or for the blocks from the next one
+ * 			again after the retry time: {"job":"<id>","block":<first>,"count":<blocks>,"size":<block size>}, to
+ * 			be published on devices/<id>/ota_get
+ *
+ * @return request length, 0 if nothing is to be requested, -1 if the buffer is too small
+ */
+int mqtt_ota_request(mqtt_ota_t *ota, int64_t now_us, char *payload, size_t size);
+
+/**
+ * @fn void mqtt_ota_resume(mqtt_ota_t*)
+ * @brief request the blocks from the next one again on the next mqtt_ota_request, after a reconnect dropped the
+ * 			blocks in flight
+ *
+ */
+void mqtt_ota_resume(mqtt_ota_t *ota);
+
+/**
+ * @fn bool mqtt_ota_complete(const mqtt_ota_t*)
+ * @brief check whether every block was written
+ *
+ */
+bool mqtt_ota_complete(const mqtt_ota_t *ota);
+
+/**
+ * @fn bool mqtt_ota_image_valid(const mqtt_ota_t*)
+ * @brief check the CRC-32 of the written image against the job
+ *
+ */
+bool mqtt_ota_image_valid(const mqtt_ota_t *ota);
+
+/**
+ * @fn int mqtt_ota_status(const mqtt_ota_t*, const char*, char*, size_t)
+ * @brief build the status published on devices/<id>/ota_status: {"job":"<id>","state":"<state>","offset":<bytes>}
+ *
+ * @return status length, -1 if the buffer is too small
+ */
+int mqtt_ota_status(const mqtt_ota_t *ota, const char *state, char *payload, size_t size);
+
+/**
+ * @fn void mqtt_ota_get_stats(mqtt_ota_stats_t*)
+ * @brief get the OTA counters
+ *
+ */
+void mqtt_ota_get_stats(mqtt_ota_stats_t *stats);
+
+#if !CONFIG_IDF_TARGET_LINUX
+/**
+ * @fn void mqtt_ota_start(void)
+ * @brief start the task that downloads the announced images into the next OTA partition and boots them once
+ * 			verified. Safe to call again
+ *
+ */
+void mqtt_ota_start(void);
+
+/**
+ * @fn void mqtt_ota_submit(const MQTTPublishInfo_t*)
+ * @brief queue a job or a block for the OTA task, without waiting. Called from the agent task
+ *
+ */
+void mqtt_ota_submit(const MQTTPublishInfo_t *publish);
+
+/**
+ * @fn void mqtt_ota_report_rollback(void)
+ * @brief publish the rolled_back status of the running image, before it rolls back to the previous one, and wait up
+ * 			to MQTT_OTA_ROLLBACK_WAIT_MS for its PUBACK. The cloud clears the job, the previous image refuses it anyway
+ *
+ */
+void mqtt_ota_report_rollback(void);
+#endif
+
+#endif /* MAIN_MQTT_OTA_H_ */
@@ -0,0 +1,398 @@
+/*
+ * mqtt_ota_bench.c
+ *
+ *  Created on: Oct 18, 2026
+ *      Author: hamxa
+ */
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+#include "esp_log.h"
+#include "esp_rom_crc.h"
+#include "sdkconfig.h"
+
+#include "core_mqtt.h"
+#include "clock.h"
+
+#include "device_topics.h"
+#include "mqtt_bench.h"
+#include "mqtt_bench_broker.h"
+#include "mqtt_ota.h"
+#include "mqtt_ota_bench.h"
+#include "mqtt_posix_transport.h"
+
+//a short last block, as real images have
+#define MQTT_OTA_BENCH_IMAGE_SIZE		(CONFIG_MQTT_OTA_BENCH_IMAGE_KB * 1024 - 100)
+
+static const char TAG[] = "mqtt_ota_bench";
+
+static MQTTContext_t g_context;
+static NetworkContext_t g_network;
+static uint8_t g_buffer[CONFIG_MQTT_NETWORK_BUFFER_SIZE];
+static MQTTPubAckInfo_t g_outgoing_records[CONFIG_MQTT_INFLIGHT_WINDOW];
+static MQTTPubAckInfo_t g_incoming_records[1];
+static bool g_subscribed;
+
+//the image served by the broker thread, and the flash the device side writes it to
+static uint8_t g_image[MQTT_OTA_BENCH_IMAGE_SIZE];
+static uint8_t g_flash[MQTT_OTA_BENCH_IMAGE_SIZE];
+static uint32_t g_image_crc;
+
+//block the broker thread corrupts once, UINT32_MAX for none
+static uint32_t g_corrupt_block;
+
+//device side, run from MQTT_ProcessLoop
+static mqtt_ota_msg_t g_msg;
+static mqtt_ota_t g_ota;
+static bool g_job_started;
+static bool g_resuming;
+static int64_t g_reconnect_ns;
+static int64_t g_resume_ns_total;
+static int64_t g_resume_ns_max;
+
+/**
+ * @fn int64_t mqtt_ota_bench_clock_ns(void)
+ * @brief read the monotonic clock in ns
+ *
+ */
+static int64_t mqtt_ota_bench_clock_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (int64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+/**
+ * @fn void mqtt_ota_bench_on_publish(const uint8_t*, size_t)
+ * @brief broker thread, the cloud side: publish the blocks of a request to the device
+ *
+ */
+static void mqtt_ota_bench_on_publish(const uint8_t *payload, size_t len)
+{
+	//only the broker thread uses them
+	static uint8_t block[MQTT_OTA_BLOCK_HEADER_LEN + MQTT_OTA_BLOCK_SIZE];
+	static char topic[sizeof(DEVICE_TOPICS_OTA_DATA_PREFIX) + MQTT_OTA_JOB_ID_MAX + 24];
+	char request[MQTT_OTA_REQUEST_MAX_LEN];
+	char job[MQTT_OTA_JOB_ID_MAX + 1];
+	unsigned long first;
+	unsigned long count;
+	unsigned size;
+
+	if(len >= sizeof(request))
+	{
+		return;
+	}
+	memcpy(request, payload, len);
+	request[len] = '\0';
+	if(sscanf(request, "{\"job\":\"%36[^\"]\",\"block\":%lu,\"count\":%lu,\"size\":%u}", job, &first, &count, &size) != 4 ||
+	   size != MQTT_OTA_BLOCK_SIZE || strcmp(job, MQTT_OTA_BENCH_JOB) != 0)
+	{
+		return;
+	}
+
+	for(unsigned long i = first; i < first + count && i * MQTT_OTA_BLOCK_SIZE < MQTT_OTA_BENCH_IMAGE_SIZE; i++)
+	{
+		size_t offset = i * MQTT_OTA_BLOCK_SIZE;
+		size_t block_len = MQTT_OTA_BENCH_IMAGE_SIZE - offset < MQTT_OTA_BLOCK_SIZE ? MQTT_OTA_BENCH_IMAGE_SIZE - offset :
+				MQTT_OTA_BLOCK_SIZE;
+		uint32_t crc = esp_rom_crc32_le(0, &g_image[offset], block_len);
+		uint32_t corrupt = (uint32_t)i;
+
+		block[0] = (uint8_t)(crc >> 24);
+		block[1] = (uint8_t)(crc >> 16);
+		block[2] = (uint8_t)(crc >> 8);
+		block[3] = (uint8_t)crc;
+		memcpy(block + MQTT_OTA_BLOCK_HEADER_LEN, &g_image[offset], block_len);
+		if(__atomic_compare_exchange_n(&g_corrupt_block, &corrupt, UINT32_MAX, false, __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+		{
+			block[MQTT_OTA_BLOCK_HEADER_LEN] ^= 0xff;
+		}
+		snprintf(topic, sizeof(topic), DEVICE_TOPICS_OTA_DATA_PREFIX "%s/%lu", job, i);
+		if(!mqtt_bench_broker_publish(topic, block, MQTT_OTA_BLOCK_HEADER_LEN + block_len))
+		{
+			//the device dropped the connection, it asks again once it is back
+			return;
+		}
+	}
+}
+
+/**
+ * @fn void mqtt_ota_bench_event_callback(MQTTContext_t*, MQTTPacketInfo_t*, MQTTDeserializedInfo_t*)
+ * @brief device side: start the job and write the blocks, as the OTA task does
+ *
+ */
+static void mqtt_ota_bench_event_callback(MQTTContext_t *pContext, MQTTPacketInfo_t *pPacketInfo,
+										  MQTTDeserializedInfo_t *pDeserializedInfo)
+{
+	mqtt_ota_job_t job;
+	const uint8_t *data;
+	size_t len;
+
+	switch(pPacketInfo->type & 0xf0U)
+	{
+		case MQTT_PACKET_TYPE_SUBACK:
+			g_subscribed = true;
+			break;
+
+		case MQTT_PACKET_TYPE_PUBLISH:
+			if(mqtt_ota_parse(pDeserializedInfo->pPublishInfo, &g_msg) != ESP_OK)
+			{
+				break;
+			}
+			if(g_msg.type == MQTT_OTA_MSG_JOB)
+			{
+				if(mqtt_ota_parse_job(&g_msg, &job) == ESP_OK)
+				{
+					mqtt_ota_begin(&g_ota, &job, CONFIG_MQTT_OTA_WINDOW, MQTT_OTA_BENCH_RETRY_MS, mqtt_ota_bench_clock_ns() / 1000);
+					g_job_started = true;
+				}
+				break;
+			}
+			if(!g_job_started || mqtt_ota_accept(&g_ota, &g_msg, mqtt_ota_bench_clock_ns() / 1000, &data, &len) != ESP_OK)
+			{
+				break;
+			}
+			memcpy(&g_flash[(g_ota.next - 1) * MQTT_OTA_BLOCK_SIZE], data, len);
+			if(g_resuming)
+			{
+				int64_t resume_ns = mqtt_ota_bench_clock_ns() - g_reconnect_ns;
+				g_resume_ns_total += resume_ns;
+				if(resume_ns > g_resume_ns_max)
+				{
+					g_resume_ns_max = resume_ns;
+				}
+				g_resuming = false;
+			}
+			break;
+
+		default:
+			break;
+	}
+}
+
+/**
+ * @fn bool mqtt_ota_bench_connect(uint16_t, bool)
+ * @brief open the session and subscribe to the OTA topics on a clean one, as the device does but without TLS
+ *
+ */
+static bool mqtt_ota_bench_connect(uint16_t port, bool clean)
+{
+	TransportInterface_t transport = {0};
+	MQTTFixedBuffer_t buffer = {.pBuffer = g_buffer, .size = sizeof(g_buffer)};
+	MQTTConnectInfo_t connect_info = {0};
+	MQTTSubscribeInfo_t subscription = {0};
+	bool session_present = false;
+	uint32_t start_ms;
+	MQTTStatus_t status;
+
+	if(!mqtt_posix_transport_connect(&g_network, "127.0.0.1", port))
+	{
+		return false;
+	}
+
+	transport.pNetworkContext = &g_network;
+	transport.send = mqtt_posix_transport_send;
+	transport.recv = mqtt_posix_transport_recv;
+#if CONFIG_MQTT_TRANSPORT_WRITEV
+	//packets gathered into one write, as the device gathers them into one TLS record
+	transport.writev = mqtt_posix_transport_writev;
+#else
+	transport.writev = NULL;
+#endif
+
+	status = MQTT_Init(&g_context, &transport, Clock_GetTimeMs, mqtt_ota_bench_event_callback, &buffer);
+	if(status == MQTTSuccess)
+	{
+		status = MQTT_InitStatefulQoS(&g_context, g_outgoing_records, CONFIG_MQTT_INFLIGHT_WINDOW,
+									  g_incoming_records, 1);
+	}
+	if(status == MQTTSuccess)
+	{
+		connect_info.cleanSession = clean;
+		connect_info.pClientIdentifier = CONFIG_MQTT_CLIENT_IDENTIFIER "-ota-bench";
+		connect_info.clientIdentifierLength = (uint16_t)strlen(connect_info.pClientIdentifier);
+		connect_info.keepAliveSeconds = 60;
+		status = MQTT_Connect(&g_context, &connect_info, NULL, MQTT_BENCH_ACK_TIMEOUT_MS, &session_present);
+	}
+	if(status == MQTTSuccess && (clean || !session_present))
+	{
+		subscription.qos = MQTTQoS1;
+		subscription.pTopicFilter = DEVICE_TOPICS_OTA_FILTER;
+		subscription.topicFilterLength = (uint16_t)strlen(DEVICE_TOPICS_OTA_FILTER);
+		g_subscribed = false;
+		status = MQTT_Subscribe(&g_context, &subscription, 1, MQTT_GetPacketId(&g_context));
+		start_ms = Clock_GetTimeMs();
+		while(status == MQTTSuccess && !g_subscribed && Clock_GetTimeMs() - start_ms < MQTT_BENCH_ACK_TIMEOUT_MS)
+		{
+			status = MQTT_ProcessLoop(&g_context);
+			if(status == MQTTNeedMoreBytes)
+			{
+				status = MQTTSuccess;
+			}
+		}
+		if(!g_subscribed)
+		{
+			status = MQTTRecvFailed;
+		}
+	}
+	if(status != MQTTSuccess)
+	{
+		ESP_LOGE(TAG, "mqtt_ota_bench_connect: session not set up, %s", MQTT_Status_strerror(status));
+		mqtt_posix_transport_disconnect(&g_network);
+		return false;
+	}
+	return true;
+}
+
+/**
+ * @fn bool mqtt_ota_bench_measure(const char*, uint16_t, uint32_t)
+ * @brief announce the job and run the device side until the image is written
+ *
+ * @param drops connections dropped on the way, spread over the image, with a corrupt block before the first
+ * @return true if the image was written intact
+ */
+static bool mqtt_ota_bench_measure(const char *label, uint16_t port, uint32_t drops)
+{
+	char job[MQTT_OTA_JOB_MAX_LEN];
+	char request[MQTT_OTA_REQUEST_MAX_LEN];
+	uint32_t blocks = (MQTT_OTA_BENCH_IMAGE_SIZE + MQTT_OTA_BLOCK_SIZE - 1) / MQTT_OTA_BLOCK_SIZE;
+	uint32_t dropped = 0;
+	mqtt_ota_stats_t before;
+	mqtt_ota_stats_t after;
+	int64_t start_ns;
+	int64_t elapsed_ns;
+	bool ok = true;
+
+	memset(g_flash, 0, sizeof(g_flash));
+	g_job_started = false;
+	g_resuming = false;
+	g_resume_ns_total = 0;
+	g_resume_ns_max = 0;
+	__atomic_store_n(&g_corrupt_block, drops ? blocks / (drops + 1) / 2 : UINT32_MAX, __ATOMIC_RELAXED);
+	mqtt_ota_get_stats(&before);
+
+	int len = snprintf(job, sizeof(job), "{\"job\":\"%s\",\"size\":%u,\"crc\":%lu}", MQTT_OTA_BENCH_JOB,
+			MQTT_OTA_BENCH_IMAGE_SIZE, (unsigned long)g_image_crc);
+	start_ns = mqtt_ota_bench_clock_ns();
+	if(!mqtt_bench_broker_publish(DEVICE_TOPICS_OTA_JOB, job, (size_t)len))
+	{
+		ESP_LOGE(TAG, "mqtt_ota_bench_measure: job not announced");
+		return false;
+	}
+
+	while(ok && !(g_job_started && mqtt_ota_complete(&g_ota)))
+	{
+		if(mqtt_ota_bench_clock_ns() - start_ns > (int64_t)MQTT_OTA_BENCH_TIMEOUT_MS * 1000000)
+		{
+			ESP_LOGE(TAG, "mqtt_ota_bench_measure: stalled at block %lu of %lu", (unsigned long)g_ota.next, (unsigned long)blocks);
+			ok = false;
+			break;
+		}
+
+		MQTTStatus_t status = MQTT_ProcessLoop(&g_context);
+		if(status != MQTTSuccess && status != MQTTNeedMoreBytes)
+		{
+			ESP_LOGE(TAG, "mqtt_ota_bench_measure: MQTT_ProcessLoop failed, %s", MQTT_Status_strerror(status));
+			ok = false;
+			break;
+		}
+		if(!g_job_started)
+		{
+			continue;
+		}
+
+		if(dropped < drops && g_ota.next >= blocks / (drops + 1) * (dropped + 1))
+		{
+			//gone as the demo gives up a failed connection, the blocks in flight are lost with it
+			(void)MQTT_Disconnect(&g_context);
+			mqtt_posix_transport_disconnect(&g_network);
+			dropped++;
+			g_reconnect_ns = mqtt_ota_bench_clock_ns();
+			if(!mqtt_ota_bench_connect(port, false))
+			{
+				ok = false;
+				break;
+			}
+			mqtt_ota_resume(&g_ota);
+			g_resuming = true;
+		}
+
+		len = mqtt_ota_request(&g_ota, mqtt_ota_bench_clock_ns() / 1000, request, sizeof(request));
+		if(len > 0)
+		{
+			MQTTPublishInfo_t publish_info = {0};
+
+			publish_info.qos = MQTTQoS0;
+			publish_info.pTopicName = DEVICE_TOPICS_OTA_GET;
+			publish_info.topicNameLength = (uint16_t)strlen(DEVICE_TOPICS_OTA_GET);
+			publish_info.pPayload = request;
+			publish_info.payloadLength = (size_t)len;
+			status = MQTT_Publish(&g_context, &publish_info, 0);
+			if(status != MQTTSuccess)
+			{
+				ESP_LOGE(TAG, "mqtt_ota_bench_measure: request not sent, %s", MQTT_Status_strerror(status));
+				ok = false;
+			}
+		}
+	}
+	elapsed_ns = mqtt_ota_bench_clock_ns() - start_ns;
+	mqtt_ota_get_stats(&after);
+
+	if(ok && (!mqtt_ota_image_valid(&g_ota) || memcmp(g_flash, g_image, sizeof(g_image)) != 0))
+	{
+		ESP_LOGE(TAG, "mqtt_ota_bench_measure: written image does not match");
+		ok = false;
+	}
+	ESP_LOGI(TAG, "%s: %u bytes in %lld ms, %llu KB/s, %lu requests, %lu retries, %lu stale, %lu corrupt blocks", label,
+			MQTT_OTA_BENCH_IMAGE_SIZE, (long long)(elapsed_ns / 1000000),
+			(unsigned long long)(elapsed_ns > 0 ? (uint64_t)MQTT_OTA_BENCH_IMAGE_SIZE * 1000000000 / 1024 / elapsed_ns : 0),
+			(unsigned long)(after.requests - before.requests), (unsigned long)(after.retries - before.retries),
+			(unsigned long)(after.stale - before.stale), (unsigned long)(after.corrupt - before.corrupt));
+	if(drops)
+	{
+		ESP_LOGI(TAG, "%s: %lu connections dropped, reconnect to the next block written avg %lld us, max %lld us", label,
+				(unsigned long)dropped, (long long)(dropped ? g_resume_ns_total / dropped / 1000 : 0),
+				(long long)(g_resume_ns_max / 1000));
+	}
+	return ok;
+}
+
+bool mqtt_ota_bench_run(void)
+{
+	uint32_t seed = 1;
+	uint16_t port;
+	bool ok;
+
+	//an incompressible image, so no layer can take a shortcut on it
+	for(size_t i = 0; i < sizeof(g_image); i++)
+	{
+		seed = seed * 1664525 + 1013904223;
+		g_image[i] = (uint8_t)(seed >> 24);
+	}
+	g_image_crc = esp_rom_crc32_le(0, g_image, sizeof(g_image));
+
+	//the broker stand-in routes nothing, the job is injected and the block requests answered from the hook
+	mqtt_bench_broker_set_publish_hook(mqtt_ota_bench_on_publish);
+	if(!mqtt_bench_broker_start(&port))
+	{
+		return false;
+	}
+	ESP_LOGI(TAG, "mqtt_ota_bench_run: in-process broker on 127.0.0.1:%u, %u byte image in %u byte blocks, window %u",
+			port, MQTT_OTA_BENCH_IMAGE_SIZE, MQTT_OTA_BLOCK_SIZE, CONFIG_MQTT_OTA_WINDOW);
+
+	ok = mqtt_ota_bench_connect(port, true);
+	if(ok)
+	{
+		//both runs are logged whatever the first one found
+		ok = mqtt_ota_bench_measure("steady connection", port, 0);
+		ok = mqtt_ota_bench_measure("dropped connections", port, CONFIG_MQTT_OTA_BENCH_DISCONNECTS) && ok;
+		MQTT_Disconnect(&g_context);
+		mqtt_posix_transport_disconnect(&g_network);
+	}
+
+	mqtt_bench_broker_stop();
+	mqtt_bench_broker_set_publish_hook(NULL);
+	return ok;
+}
@@ -0,0 +1,33 @@
+/*
+ * mqtt_ota_bench.h
+ *
+ *  Created on: Oct 18, 2026
+ *      Author: hamxa
+ */
+
+#ifndef MAIN_MQTT_OTA_BENCH_H_
+#define MAIN_MQTT_OTA_BENCH_H_
+
+#include <stdbool.h>
+
+//Job id of the generated image
+#define MQTT_OTA_BENCH_JOB				"bench-1.0.0"
+
+//Longest a run may take before it counts as stalled
+#define MQTT_OTA_BENCH_TIMEOUT_MS		60000
+
+//Retry time of the device side, short so a lost request does not dominate the run
+#define MQTT_OTA_BENCH_RETRY_MS			200
+
+/**
+ * @fn bool mqtt_ota_bench_run(void)
+ * @brief start the in-process broker, serve the blocks of a generated image from its publish hook as the cloud
+ * 			would, and download it with a coreMQTT client through mqtt_ota as the device does: once on a steady
+ * 			connection, once with CONFIG_MQTT_OTA_BENCH_DISCONNECTS dropped connections and a corrupt block. Logs
+ * 			the KB/s, the requests and retries and the time from each reconnect to the next block written
+ *
+ * @return true if both downloads completed with the image intact
+ */
+bool mqtt_ota_bench_run(void);
+
+#endif /* MAIN_MQTT_OTA_BENCH_H_ */
@@ -0,0 +1,615 @@
+/*
+ * mqtt_outbox.c
+ *
+ *  Created on: Oct 18, 2026
+ *      Author: hamxa
+ */
+#include <string.h>
+
+#include "esp_log.h"
+#include "esp_rom_crc.h"
+
+#include "mqtt_outbox.h"
+
+#if !CONFIG_IDF_TARGET_LINUX
+#include "esp_partition.h"
+#endif
+
+#define MQTT_OUTBOX_RECORD_MAGIC		0x4f42
+#define MQTT_OUTBOX_ERASED				0xffffffff
+
+//slot states, kept in the low bits of the slot word under the token
+#define MQTT_OUTBOX_SLOT_FREE			0
+#define MQTT_OUTBOX_SLOT_SENT			1
+#define MQTT_OUTBOX_SLOT_ACKED			2
+#define MQTT_OUTBOX_SLOT_FAILED			3
+#define MQTT_OUTBOX_SLOT_STATE_MASK		3
+
+#define MQTT_OUTBOX_ALIGN(x)			(((x) + 3) & ~3u)
+
+static const char TAG[] = "mqtt_outbox";
+
+/**
+ * Record header, followed by the data padded to a word. Records are laid out back to back in a sector
+ */
+typedef struct mqtt_outbox_record
+{
+	uint32_t seq;
+	uint16_t magic;
+	uint16_t len;			///> topic length byte, topic and payload
+	uint32_t crc;			///> over seq, magic, len and the data
+	uint32_t done;			///> erased until the record is delivered, then cleared in place
+}mqtt_outbox_record_t;
+
+/**
+ * Outcome of reading the record at an offset
+ */
+typedef enum mqtt_outbox_read
+{
+	MQTT_OUTBOX_READ_VALID = 0,
+	MQTT_OUTBOX_READ_CORRUPT,		///> header looks sane, data does not match, the record can be skipped
+	MQTT_OUTBOX_READ_END			///> no more records in this sector
+}mqtt_outbox_read_e;
+
+/**
+ * Record handed to the sender. The word is token << 2 | state and is set by mqtt_outbox_sent from other tasks
+ */
+typedef struct mqtt_outbox_slot
+{
+	uint32_t word;
+	uint32_t offset;
+	uint32_t next;			///> offset following the record
+}mqtt_outbox_slot_t;
+
+static mqtt_outbox_flash_t g_flash;
+static mqtt_outbox_policy_e g_policy;
+static bool g_ready = false;
+static uint32_t g_sectors;
+
+static uint32_t g_seq;				///> sequence number of the next record
+static uint32_t g_head_sector;		///> sector the records are appended to
+static uint32_t g_head_used;		///> programmed bytes of the head sector
+static uint32_t g_tail;				///> oldest undelivered record
+static uint32_t g_read;				///> next record to hand to the sender
+
+//records waiting for the next flash write
+static uint8_t g_stage[MQTT_OUTBOX_WRITE_BUFFER_SIZE];
+static size_t g_staged;
+static uint32_t g_staged_count;
+static int64_t g_staged_us;
+
+//records handed to the sender, completed in order
+static mqtt_outbox_slot_t g_slots[MQTT_OUTBOX_MAX_IN_FLIGHT];
+static uint32_t g_slot_first;
+static uint32_t g_slot_count;
+static uint32_t g_generation;
+
+//data of the record being read, kept off the task stack
+static uint8_t g_record_data[MQTT_OUTBOX_MAX_DATA];
+static char g_record_topic[UINT8_MAX + 1];
+
+static mqtt_outbox_stats_t g_stats;
+
+/**
+ * @fn uint32_t mqtt_outbox_wrap(uint32_t)
+ * @brief fold an offset running past the end back to the first sector
+ *
+ */
+static uint32_t mqtt_outbox_wrap(uint32_t offset)
+{
+	return offset % g_flash.size;
+}
+
+static uint32_t mqtt_outbox_sector(uint32_t offset)
+{
+	return offset / MQTT_OUTBOX_SECTOR_SIZE;
+}
+
+static uint32_t mqtt_outbox_record_size(uint16_t len)
+{
+	return sizeof(mqtt_outbox_record_t) + MQTT_OUTBOX_ALIGN(len);
+}
+
+/**
+ * @fn uint32_t mqtt_outbox_write_pos(void)
+ * @brief offset the next flash write goes to
+ *
+ */
+static uint32_t mqtt_outbox_write_pos(void)
+{
+	return mqtt_outbox_wrap(g_head_sector * MQTT_OUTBOX_SECTOR_SIZE + g_head_used);
+}
+
+static uint32_t mqtt_outbox_crc(const mqtt_outbox_record_t *record, const void *data)
+{
+	uint32_t crc = esp_rom_crc32_le(0, (const uint8_t*)record, offsetof(mqtt_outbox_record_t, crc));
+	return esp_rom_crc32_le(crc, data, record->len);
+}
+
+/**
+ * @fn mqtt_outbox_read_e mqtt_outbox_read_record(uint32_t, mqtt_outbox_record_t*)
+ * @brief read and check the record at offset, its data lands in g_record_data
+ *
+ */
+static mqtt_outbox_read_e mqtt_outbox_read_record(uint32_t offset, mqtt_outbox_record_t *record)
+{
+	uint32_t in_sector = offset % MQTT_OUTBOX_SECTOR_SIZE;
+
+	if(in_sector + sizeof(*record) > MQTT_OUTBOX_SECTOR_SIZE ||
+	   g_flash.read(g_flash.ctx, offset, record, sizeof(*record)) != ESP_OK)
+	{
+		return MQTT_OUTBOX_READ_END;
+	}
+	if(record->magic != MQTT_OUTBOX_RECORD_MAGIC || record->len == 0 || record->len > MQTT_OUTBOX_MAX_DATA ||
+	   in_sector + mqtt_outbox_record_size(record->len) > MQTT_OUTBOX_SECTOR_SIZE)
+	{
+		return MQTT_OUTBOX_READ_END;
+	}
+	if(g_flash.read(g_flash.ctx, offset + sizeof(*record), g_record_data, record->len) != ESP_OK ||
+	   mqtt_outbox_crc(record, g_record_data) != record->crc)
+	{
+		return MQTT_OUTBOX_READ_CORRUPT;
+	}
+	return MQTT_OUTBOX_READ_VALID;
+}
+
+/**
+ * @fn uint32_t mqtt_outbox_count_pending(uint32_t)
+ * @brief count the undelivered records from offset to the end of its sector
+ *
+ */
+static uint32_t mqtt_outbox_count_pending(uint32_t offset)
+{
+	mqtt_outbox_record_t record;
+	uint32_t end = (mqtt_outbox_sector(offset) + 1) * MQTT_OUTBOX_SECTOR_SIZE;
+	uint32_t count = 0;
+
+	while(offset < end)
+	{
+		mqtt_outbox_read_e result = mqtt_outbox_read_record(offset, &record);
+		if(result == MQTT_OUTBOX_READ_END)
+		{
+			break;
+		}
+		if(result == MQTT_OUTBOX_READ_VALID && record.done == MQTT_OUTBOX_ERASED)
+		{
+			count++;
+		}
+		offset += mqtt_outbox_record_size(record.len);
+	}
+	return count;
+}
+
+/**
+ * @fn void mqtt_outbox_discard_slots(void)
+ * @brief forget the records handed to the sender, late completions no longer match a slot
+ *
+ * @return number of records that were in flight
+ */
+static uint32_t mqtt_outbox_discard_slots(void)
+{
+	uint32_t count = g_slot_count;
+
+	for(int i = 0; i < MQTT_OUTBOX_MAX_IN_FLIGHT; i++)
+	{
+		__atomic_store_n(&g_slots[i].word, MQTT_OUTBOX_SLOT_FREE, __ATOMIC_RELEASE);
+	}
+	g_slot_first = 0;
+	g_slot_count = 0;
+	g_generation++;
+	return count;
+}
+
+/**
+ * @fn esp_err_t mqtt_outbox_next_sector(void)
+ * @brief move the head to the next sector, erasing it and dropping its undelivered records when full
+ *
+ * @return ESP_OK, ESP_ERR_NO_MEM if full and dropping the newest, or the erase error
+ */
+static esp_err_t mqtt_outbox_next_sector(void)
+{
+	uint32_t next = (g_head_sector + 1) % g_sectors;
+	uint32_t write_pos = mqtt_outbox_write_pos();
+	bool empty = g_tail == write_pos;
+
+	//the head caught up with the oldest undelivered records
+	if(!empty && mqtt_outbox_sector(g_tail) == next)
+	{
+		if(g_policy == MQTT_OUTBOX_DROP_NEWEST)
+		{
+			return ESP_ERR_NO_MEM;
+		}
+
+		uint32_t dropped = mqtt_outbox_count_pending(g_tail);
+		g_stats.dropped += dropped;
+		g_stats.pending -= dropped < g_stats.pending ? dropped : g_stats.pending;
+		g_tail = mqtt_outbox_wrap((next + 1) * MQTT_OUTBOX_SECTOR_SIZE);
+		if(mqtt_outbox_discard_slots() > 0 || mqtt_outbox_sector(g_read) == next)
+		{
+			g_read = g_tail;
+		}
+		ESP_LOGW(TAG, "mqtt_outbox_next_sector: outbox full, dropped the %lu oldest records", (unsigned long)dropped);
+	}
+
+	esp_err_t err = g_flash.erase(g_flash.ctx, next * MQTT_OUTBOX_SECTOR_SIZE);
+	if(err != ESP_OK)
+	{
+		ESP_LOGE(TAG, "mqtt_outbox_next_sector: erase of sector %lu failed, %s", (unsigned long)next, esp_err_to_name(err));
+		return err;
+	}
+	g_stats.erases++;
+
+	g_head_sector = next;
+	g_head_used = 0;
+	if(empty)
+	{
+		g_tail = mqtt_outbox_write_pos();
+		g_read = g_tail;
+	}
+	return ESP_OK;
+}
+
+#if !CONFIG_IDF_TARGET_LINUX
+static esp_err_t mqtt_outbox_partition_read(void *ctx, size_t offset, void *dst, size_t len)
+{
+	return esp_partition_read(ctx, offset, dst, len);
+}
+
+static esp_err_t mqtt_outbox_partition_write(void *ctx, size_t offset, const void *src, size_t len)
+{
+	return esp_partition_write(ctx, offset, src, len);
+}
+
+static esp_err_t mqtt_outbox_partition_erase(void *ctx, size_t offset)
+{
+	return esp_partition_erase_range(ctx, offset, MQTT_OUTBOX_SECTOR_SIZE);
+}
+
+esp_err_t mqtt_outbox_flash_partition(mqtt_outbox_flash_t *flash, const char *label)
+{
+	const esp_partition_t *partition = esp_partition_find_first(ESP_PARTITION_TYPE_DATA, ESP_PARTITION_SUBTYPE_ANY, label);
+	if(partition == NULL)
+	{
+		return ESP_ERR_NOT_FOUND;
+	}
+
+	flash->ctx = (void*)partition;
+	flash->size = partition->size - partition->size % MQTT_OUTBOX_SECTOR_SIZE;
+	flash->read = mqtt_outbox_partition_read;
+	flash->write = mqtt_outbox_partition_write;
+	flash->erase = mqtt_outbox_partition_erase;
+	return ESP_OK;
+}
+#endif
+
+esp_err_t mqtt_outbox_init(const mqtt_outbox_flash_t *flash, mqtt_outbox_policy_e policy)
+{
+	mqtt_outbox_record_t record;
+	bool found = false;
+	uint32_t max_seq = 0, min_pending_seq = UINT32_MAX;
+	uint32_t head = 0;
+
+	g_ready = false;
+	if(flash->size / MQTT_OUTBOX_SECTOR_SIZE < 2)
+	{
+		return ESP_ERR_INVALID_SIZE;
+	}
+
+	g_flash = *flash;
+	g_policy = policy;
+	g_sectors = g_flash.size / MQTT_OUTBOX_SECTOR_SIZE;
+	g_staged = 0;
+	g_staged_count = 0;
+	memset(&g_stats, 0, sizeof(g_stats));
+	mqtt_outbox_discard_slots();
+
+	//the newest record ends where writing resumes, the oldest undelivered one is where the drain resumes
+	for(uint32_t sector = 0; sector < g_sectors; sector++)
+	{
+		uint32_t offset = sector * MQTT_OUTBOX_SECTOR_SIZE;
+		uint32_t end = offset + MQTT_OUTBOX_SECTOR_SIZE;
+
+		while(offset < end)
+		{
+			mqtt_outbox_read_e result = mqtt_outbox_read_record(offset, &record);
+			if(result == MQTT_OUTBOX_READ_END)
+			{
+				break;
+			}
+			if(result == MQTT_OUTBOX_READ_VALID)
+			{
+				if(!found || record.seq > max_seq)
+				{
+					found = true;
+					max_seq = record.seq;
+					head = offset + mqtt_outbox_record_size(record.len);
+				}
+				if(record.done == MQTT_OUTBOX_ERASED)
+				{
+					g_stats.pending++;
+					if(record.seq < min_pending_seq)
+					{
+						min_pending_seq = record.seq;
+						g_tail = offset;
+					}
+				}
+			}
+			offset += mqtt_outbox_record_size(record.len);
+		}
+	}
+
+	if(!found)
+	{
+		g_seq = 0;
+		g_head_sector = 0;
+		g_head_used = 0;
+		esp_err_t err = g_flash.erase(g_flash.ctx, 0);
+		if(err != ESP_OK)
+		{
+			return err;
+		}
+		g_stats.erases++;
+	}
+	else
+	{
+		g_seq = max_seq + 1;
+		g_head_sector = mqtt_outbox_sector(head - 1);
+		g_head_used = head - g_head_sector * MQTT_OUTBOX_SECTOR_SIZE;
+	}
+	if(g_stats.pending == 0)
+	{
+		g_tail = mqtt_outbox_write_pos();
+	}
+	g_read = g_tail;
+
+	//a write torn by a reset leaves programmed bytes past the last good record, do not append to them
+	if(g_head_used < MQTT_OUTBOX_SECTOR_SIZE)
+	{
+		uint32_t word = 0;
+		if(g_flash.read(g_flash.ctx, mqtt_outbox_write_pos(), &word, sizeof(word)) != ESP_OK || word != MQTT_OUTBOX_ERASED)
+		{
+			g_head_used = MQTT_OUTBOX_SECTOR_SIZE;
+		}
+	}
+
+	g_ready = true;
+	ESP_LOGI(TAG, "mqtt_outbox_init: %lu sectors, %lu records pending, next sequence %lu", (unsigned long)g_sectors,
+			(unsigned long)g_stats.pending, (unsigned long)g_seq);
+	return ESP_OK;
+}
+
+esp_err_t mqtt_outbox_flush(void)
+{
+	if(g_staged == 0)
+	{
+		return ESP_OK;
+	}
+
+	esp_err_t err = g_flash.write(g_flash.ctx, mqtt_outbox_write_pos(), g_stage, g_staged);
+	g_stats.flash_writes++;
+	if(err != ESP_OK)
+	{
+		//the sector may be partly programmed now, the next record starts a new one
+		ESP_LOGE(TAG, "mqtt_outbox_flush: write failed, %s, %lu records lost", esp_err_to_name(err), (unsigned long)g_staged_count);
+		g_stats.rejected += g_staged_count;
+		g_stats.pending -= g_staged_count;
+		g_head_used = MQTT_OUTBOX_SECTOR_SIZE;
+	}
+	else
+	{
+		g_head_used += g_staged;
+	}
+	g_staged = 0;
+	g_staged_count = 0;
+	return err;
+}
+
+esp_err_t mqtt_outbox_put(const char *topic, const void *payload, size_t len, int64_t now_us)
+{
+	size_t topic_len = strlen(topic);
+	size_t data_len = 1 + topic_len + len;
+
+	if(!g_ready)
+	{
+		return ESP_ERR_INVALID_STATE;
+	}
+	if(topic_len > UINT8_MAX || data_len > MQTT_OUTBOX_MAX_DATA)
+	{
+		g_stats.rejected++;
+		return ESP_ERR_INVALID_SIZE;
+	}
+
+	uint32_t size = mqtt_outbox_record_size(data_len);
+	if(g_head_used + g_staged + size > MQTT_OUTBOX_SECTOR_SIZE)
+	{
+		mqtt_outbox_flush();
+		esp_err_t err = mqtt_outbox_next_sector();
+		if(err != ESP_OK)
+		{
+			g_stats.rejected++;
+			return err;
+		}
+	}
+	if(g_staged + size > sizeof(g_stage))
+	{
+		mqtt_outbox_flush();
+	}
+
+	mqtt_outbox_record_t *record = (mqtt_outbox_record_t*)&g_stage[g_staged];
+	uint8_t *data = &g_stage[g_staged + sizeof(*record)];
+
+	data[0] = (uint8_t)topic_len;
+	memcpy(&data[1], topic, topic_len);
+	memcpy(&data[1 + topic_len], payload, len);
+	memset(&data[data_len], 0xff, MQTT_OUTBOX_ALIGN(data_len) - data_len);
+
+	record->seq = g_seq++;
+	record->magic = MQTT_OUTBOX_RECORD_MAGIC;
+	record->len = (uint16_t)data_len;
+	record->crc = mqtt_outbox_crc(record, data);
+	record->done = MQTT_OUTBOX_ERASED;
+
+	if(g_staged == 0)
+	{
+		g_staged_us = now_us;
+	}
+	g_staged += size;
+	g_staged_count++;
+	g_stats.stored++;
+	g_stats.pending++;
+	return ESP_OK;
+}
+
+void mqtt_outbox_poll(int64_t now_us, uint32_t flush_ms)
+{
+	if(g_staged > 0 && now_us - g_staged_us >= (int64_t)flush_ms * 1000)
+	{
+		mqtt_outbox_flush();
+	}
+}
+
+/**
+ * @fn void mqtt_outbox_settle(void)
+ * @brief retire the delivered records in order, rewind to the first failed one
+ *
+ */
+static void mqtt_outbox_settle(void)
+{
+	while(g_slot_count > 0)
+	{
+		mqtt_outbox_slot_t *slot = &g_slots[g_slot_first];
+		uint32_t state = __atomic_load_n(&slot->word, __ATOMIC_ACQUIRE) & MQTT_OUTBOX_SLOT_STATE_MASK;
+
+		if(state == MQTT_OUTBOX_SLOT_SENT)
+		{
+			break;
+		}
+		if(state == MQTT_OUTBOX_SLOT_FAILED)
+		{
+			//send everything from the failed record again, in order
+			g_read = slot->offset;
+			g_stats.resent += mqtt_outbox_discard_slots();
+			break;
+		}
+
+		//the record is delivered either way, without its done mark it is only sent again after a reset
+		uint32_t done = 0;
+		esp_err_t err = g_flash.write(g_flash.ctx, slot->offset + offsetof(mqtt_outbox_record_t, done), &done, sizeof(done));
+		if(err != ESP_OK)
+		{
+			ESP_LOGE(TAG, "mqtt_outbox_settle: done mark at %lu failed, %s", (unsigned long)slot->offset, esp_err_to_name(err));
+			g_stats.unmarked++;
+		}
+		g_tail = slot->next;
+		g_stats.delivered++;
+		if(g_stats.pending > 0)
+		{
+			g_stats.pending--;
+		}
+
+		__atomic_store_n(&slot->word, MQTT_OUTBOX_SLOT_FREE, __ATOMIC_RELEASE);
+		g_slot_first = (g_slot_first + 1) % MQTT_OUTBOX_MAX_IN_FLIGHT;
+		g_slot_count--;
+	}
+}
+
+size_t mqtt_outbox_drain(mqtt_outbox_send_t send, void *ctx, size_t budget)
+{
+	mqtt_outbox_record_t record;
+	size_t sent = 0;
+
+	if(!g_ready)
+	{
+		return 0;
+	}
+	mqtt_outbox_settle();
+	if(budget == 0)
+	{
+		return 0;
+	}
+	mqtt_outbox_flush();
+
+	while(sent < budget && g_slot_count < MQTT_OUTBOX_MAX_IN_FLIGHT && g_read != mqtt_outbox_write_pos())
+	{
+		mqtt_outbox_read_e result = mqtt_outbox_read_record(g_read, &record);
+		if(result == MQTT_OUTBOX_READ_END)
+		{
+			if(mqtt_outbox_sector(g_read) == g_head_sector)
+			{
+				break;
+			}
+			g_read = mqtt_outbox_wrap((mqtt_outbox_sector(g_read) + 1) * MQTT_OUTBOX_SECTOR_SIZE);
+			continue;
+		}
+
+		uint32_t next = mqtt_outbox_wrap(g_read + mqtt_outbox_record_size(record.len));
+		if(result == MQTT_OUTBOX_READ_CORRUPT)
+		{
+			g_stats.corrupt++;
+			if(g_stats.pending > 0)
+			{
+				g_stats.pending--;
+			}
+			g_read = next;
+			continue;
+		}
+		if(record.done != MQTT_OUTBOX_ERASED)
+		{
+			g_read = next;
+			continue;
+		}
+
+		uint8_t topic_len = g_record_data[0];
+		if(1 + topic_len > record.len)
+		{
+			g_stats.corrupt++;
+			g_read = next;
+			continue;
+		}
+		memcpy(g_record_topic, &g_record_data[1], topic_len);
+		g_record_topic[topic_len] = '\0';
+
+		uint32_t index = (g_slot_first + g_slot_count) % MQTT_OUTBOX_MAX_IN_FLIGHT;
+		uint32_t token = ((g_generation & 0x3fffff) << 8) | index;
+		mqtt_outbox_slot_t *slot = &g_slots[index];
+
+		slot->offset = g_read;
+		slot->next = next;
+		__atomic_store_n(&slot->word, (token << 2) | MQTT_OUTBOX_SLOT_SENT, __ATOMIC_RELEASE);
+		if(send(ctx, g_record_topic, &g_record_data[1 + topic_len], record.len - 1 - topic_len, (void*)(uintptr_t)token) != ESP_OK)
+		{
+			__atomic_store_n(&slot->word, MQTT_OUTBOX_SLOT_FREE, __ATOMIC_RELEASE);
+			break;
+		}
+		g_slot_count++;
+		g_read = next;
+		sent++;
+	}
+	return sent;
+}
+
+void mqtt_outbox_sent(void *token, esp_err_t result)
+{
+	uint32_t value = (uint32_t)(uintptr_t)token;
+	uint32_t index = value & 0xff;
+
+	if(index >= MQTT_OUTBOX_MAX_IN_FLIGHT)
+	{
+		return;
+	}
+
+	//a slot discarded or reused since the record was sent no longer carries this token
+	uint32_t expected = (value << 2) | MQTT_OUTBOX_SLOT_SENT;
+	uint32_t desired = (value << 2) | (result == ESP_OK ? MQTT_OUTBOX_SLOT_ACKED : MQTT_OUTBOX_SLOT_FAILED);
+	__atomic_compare_exchange_n(&g_slots[index].word, &expected, desired, false, __ATOMIC_ACQ_REL, __ATOMIC_RELAXED);
+}
+
+uint32_t mqtt_outbox_pending(void)
+{
+	return g_stats.pending;
+}
+
+void mqtt_outbox_get_stats(mqtt_outbox_stats_t *stats)
+{
+	*stats = g_stats;
+}
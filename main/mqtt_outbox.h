@@ -0,0 +1,165 @@
+/*
+ * mqtt_outbox.h
+ *
+ *  Created on: Oct 18, 2026
+ *      Author: hamxa
+ */
+
+#ifndef MAIN_MQTT_OUTBOX_H_
+#define MAIN_MQTT_OUTBOX_H_
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "esp_err.h"
+#include "sdkconfig.h"
+
+//Label of the data partition holding the outbox, see partitions.csv
+#define MQTT_OUTBOX_PARTITION_LABEL		"outbox"
+
+//Erase unit of the flash, records never straddle two sectors
+#define MQTT_OUTBOX_SECTOR_SIZE			4096
+
+//Longest record: topic length byte, topic and payload
+#define MQTT_OUTBOX_MAX_DATA			1024
+
+//Records are staged in RAM and programmed together, this is the largest single flash write
+#define MQTT_OUTBOX_WRITE_BUFFER_SIZE	1536
+
+//Records handed to the sender and waiting for their completion
+#define MQTT_OUTBOX_MAX_IN_FLIGHT		4
+
+/**
+ * Flash the outbox lives on. Writes follow NOR rules: bits only go from 1 to 0 until the sector is erased
+ */
+typedef struct mqtt_outbox_flash
+{
+	void *ctx;
+	size_t size;																///> bytes, a multiple of MQTT_OUTBOX_SECTOR_SIZE
+	esp_err_t (*read)(void *ctx, size_t offset, void *dst, size_t len);
+	esp_err_t (*write)(void *ctx, size_t offset, const void *src, size_t len);
+	esp_err_t (*erase)(void *ctx, size_t offset);								///> erase the sector starting at offset
+}mqtt_outbox_flash_t;
+
+/**
+ * What happens to a new record when the outbox is full
+ */
+typedef enum mqtt_outbox_policy
+{
+	MQTT_OUTBOX_DROP_OLDEST = 0,		///> erase the oldest sector, keeps the most recent data
+	MQTT_OUTBOX_DROP_NEWEST				///> refuse the record, keeps the start of the outage
+}mqtt_outbox_policy_e;
+
+/**
+ * @brief hands a stored record to the network, the record stays stored until mqtt_outbox_sent is called with token
+ *
+ * @param ctx context given to mqtt_outbox_drain
+ * @param topic topic of the record
+ * @param payload payload of the record, only valid during the call
+ * @param len payload length
+ * @param token pass to mqtt_outbox_sent once the record is delivered or failed
+ * @return ESP_OK if the record was taken, anything else stops the drain
+ */
+typedef esp_err_t (*mqtt_outbox_send_t)(void *ctx, const char *topic, const void *payload, size_t len, void *token);
+
+/**
+ * Outbox counters since mqtt_outbox_init
+ */
+typedef struct mqtt_outbox_stats
+{
+	uint32_t stored;				///> records accepted
+	uint32_t delivered;				///> records confirmed by the sender
+	uint32_t pending;				///> records stored and not delivered yet
+	uint32_t dropped;				///> undelivered records erased to make room
+	uint32_t rejected;				///> records refused: too large, outbox full or flash error
+	uint32_t resent;				///> records sent again after a failed delivery
+	uint32_t corrupt;				///> records skipped because their CRC did not match
+	uint32_t unmarked;				///> delivered records whose done mark failed to program, sent again after a reset
+	uint32_t flash_writes;			///> staged writes programmed
+	uint32_t erases;				///> sectors erased
+}mqtt_outbox_stats_t;
+
+#if !CONFIG_IDF_TARGET_LINUX
+/**
+ * @fn esp_err_t mqtt_outbox_flash_partition(mqtt_outbox_flash_t*, const char*)
+ * @brief back the outbox with a data partition
+ *
+ * @param flash output flash description
+ * @param label partition label
+ * @return ESP_OK, ESP_ERR_NOT_FOUND if the partition table has no such partition
+ */
+esp_err_t mqtt_outbox_flash_partition(mqtt_outbox_flash_t *flash, const char *label);
+#endif
+
+/**
+ * @fn esp_err_t mqtt_outbox_init(const mqtt_outbox_flash_t*, mqtt_outbox_policy_e)
+ * @brief recover the records left on flash by the previous run
+ *
+ * @param flash flash to use, copied
+ * @param policy full outbox policy
+ * @return ESP_OK, ESP_ERR_INVALID_SIZE if the flash holds less than two sectors, or the flash error
+ */
+esp_err_t mqtt_outbox_init(const mqtt_outbox_flash_t *flash, mqtt_outbox_policy_e policy);
+
+/**
+ * @fn esp_err_t mqtt_outbox_put(const char*, const void*, size_t, int64_t)
+ * @brief append a record, it reaches flash with the next staged write
+ *
+ * @param topic topic, up to 255 characters
+ * @param payload payload
+ * @param len payload length
+ * @param now_us current time, starts the flush timer of an empty staging buffer
+ * @return ESP_OK, ESP_ERR_INVALID_STATE before init, ESP_ERR_INVALID_SIZE, ESP_ERR_NO_MEM when full and dropping the newest
+ */
+esp_err_t mqtt_outbox_put(const char *topic, const void *payload, size_t len, int64_t now_us);
+
+/**
+ * @fn esp_err_t mqtt_outbox_flush(void)
+ * @brief program the staged records
+ *
+ */
+esp_err_t mqtt_outbox_flush(void);
+
+/**
+ * @fn void mqtt_outbox_poll(int64_t, uint32_t)
+ * @brief flush the staged records once the oldest waited flush_ms
+ *
+ */
+void mqtt_outbox_poll(int64_t now_us, uint32_t flush_ms);
+
+/**
+ * @fn size_t mqtt_outbox_drain(mqtt_outbox_send_t, void*, size_t)
+ * @brief settle the completed records, then hand the next ones to send, oldest first
+ *
+ * @param send sender, may be NULL when budget is 0
+ * @param ctx context passed to send
+ * @param budget most records handed to send in this call, paces the backfill
+ * @return records handed to send
+ */
+size_t mqtt_outbox_drain(mqtt_outbox_send_t send, void *ctx, size_t budget);
+
+/**
+ * @fn void mqtt_outbox_sent(void*, esp_err_t)
+ * @brief report the outcome of a record given to the sender. Safe from any task, matches mqtt_agent_done_cb_t
+ *
+ * @param token token given to the sender
+ * @param result ESP_OK once delivered, the record is sent again otherwise
+ */
+void mqtt_outbox_sent(void *token, esp_err_t result);
+
+/**
+ * @fn uint32_t mqtt_outbox_pending(void)
+ * @brief records stored and not delivered yet
+ *
+ */
+uint32_t mqtt_outbox_pending(void);
+
+/**
+ * @fn void mqtt_outbox_get_stats(mqtt_outbox_stats_t*)
+ * @brief get the outbox counters
+ *
+ */
+void mqtt_outbox_get_stats(mqtt_outbox_stats_t *stats);
+
+#endif /* MAIN_MQTT_OUTBOX_H_ */
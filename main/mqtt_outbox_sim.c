@@ -0,0 +1,347 @@
+/*
+ * mqtt_outbox_sim.c
+ *
+ *  Created on: Oct 18, 2026
+ *      Author: hamxa
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "esp_log.h"
+
+#include "mqtt_outbox.h"
+#include "mqtt_outbox_sim.h"
+
+#define MQTT_OUTBOX_SIM_TOPIC			"test_topic/esp32/batch"
+#define MQTT_OUTBOX_SIM_MAX_IDS			2048
+#define MQTT_OUTBOX_SIM_MAX_PENDING		16
+#define MQTT_OUTBOX_SIM_TICK_MS			1000
+#define MQTT_OUTBOX_SIM_FLUSH_MS		5000
+#define MQTT_OUTBOX_SIM_LEAD_TICKS		20
+#define MQTT_OUTBOX_SIM_MAX_TICKS		20000
+
+static const char TAG[] = "mqtt_outbox_sim";
+
+/**
+ * What happens halfway through the outage
+ */
+typedef enum mqtt_outbox_sim_reset
+{
+	MQTT_OUTBOX_SIM_NO_RESET = 0,
+	MQTT_OUTBOX_SIM_RESET,				///> flush, then reset: nothing may be lost
+	MQTT_OUTBOX_SIM_TORN_WRITE			///> power lost in the middle of a flash write: only records of that write may be lost
+}mqtt_outbox_sim_reset_e;
+
+/**
+ * One scenario of the simulation
+ */
+typedef struct mqtt_outbox_sim_scenario
+{
+	const char *name;
+	mqtt_outbox_policy_e policy;
+	uint32_t outage_percent;			///> outage length in percent of the outbox capacity
+	mqtt_outbox_sim_reset_e reset;
+}mqtt_outbox_sim_scenario_t;
+
+/**
+ * PUBACK the simulated broker still owes
+ */
+typedef struct mqtt_outbox_sim_ack
+{
+	void *token;
+	uint32_t id;
+	uint32_t due;
+}mqtt_outbox_sim_ack_t;
+
+/**
+ * RAM flash with NOR programming rules, a write can be torn once on request
+ */
+typedef struct mqtt_outbox_sim_flash
+{
+	uint8_t data[MQTT_OUTBOX_SIM_SECTORS * MQTT_OUTBOX_SECTOR_SIZE];
+	bool tear_next_write;
+}mqtt_outbox_sim_flash_t;
+
+static const mqtt_outbox_sim_scenario_t g_scenarios[] = {
+		{"outage within capacity", MQTT_OUTBOX_DROP_OLDEST, 80, MQTT_OUTBOX_SIM_NO_RESET},
+		{"reset during outage", MQTT_OUTBOX_DROP_OLDEST, 80, MQTT_OUTBOX_SIM_RESET},
+		{"torn write during outage", MQTT_OUTBOX_DROP_OLDEST, 80, MQTT_OUTBOX_SIM_TORN_WRITE},
+		{"overflow, drop oldest", MQTT_OUTBOX_DROP_OLDEST, 200, MQTT_OUTBOX_SIM_NO_RESET},
+		{"overflow, drop newest", MQTT_OUTBOX_DROP_NEWEST, 200, MQTT_OUTBOX_SIM_NO_RESET},
+};
+
+static mqtt_outbox_sim_flash_t g_sim_flash;
+
+static mqtt_outbox_sim_ack_t g_acks[MQTT_OUTBOX_SIM_MAX_PENDING];
+static uint32_t g_ack_count;
+
+//deliveries per record id, and the highest id first delivered from the outbox
+static uint8_t g_received[MQTT_OUTBOX_SIM_MAX_IDS];
+static int64_t g_last_backfill;
+static uint32_t g_out_of_order;
+
+static esp_err_t mqtt_outbox_sim_read(void *ctx, size_t offset, void *dst, size_t len)
+{
+	if(offset + len > sizeof(g_sim_flash.data))
+	{
+		return ESP_ERR_INVALID_SIZE;
+	}
+	memcpy(dst, &g_sim_flash.data[offset], len);
+	return ESP_OK;
+}
+
+static esp_err_t mqtt_outbox_sim_write(void *ctx, size_t offset, const void *src, size_t len)
+{
+	const uint8_t *bytes = src;
+	size_t programmed = g_sim_flash.tear_next_write ? len / 2 : len;
+
+	if(offset + len > sizeof(g_sim_flash.data))
+	{
+		return ESP_ERR_INVALID_SIZE;
+	}
+	for(size_t i = 0; i < programmed; i++)
+	{
+		g_sim_flash.data[offset + i] &= bytes[i];
+	}
+	if(g_sim_flash.tear_next_write)
+	{
+		g_sim_flash.tear_next_write = false;
+		return ESP_FAIL;
+	}
+	return ESP_OK;
+}
+
+static esp_err_t mqtt_outbox_sim_erase(void *ctx, size_t offset)
+{
+	if(offset % MQTT_OUTBOX_SECTOR_SIZE != 0 || offset >= sizeof(g_sim_flash.data))
+	{
+		return ESP_ERR_INVALID_ARG;
+	}
+	memset(&g_sim_flash.data[offset], 0xff, MQTT_OUTBOX_SECTOR_SIZE);
+	return ESP_OK;
+}
+
+static const mqtt_outbox_flash_t g_flash = {
+		.ctx = &g_sim_flash,
+		.size = sizeof(g_sim_flash.data),
+		.read = mqtt_outbox_sim_read,
+		.write = mqtt_outbox_sim_write,
+		.erase = mqtt_outbox_sim_erase,
+};
+
+/**
+ * @fn esp_err_t mqtt_outbox_sim_send(void*, const char*, const void*, size_t, void*)
+ * @brief simulated MQTT agent, takes the record if its queue has room
+ *
+ */
+static esp_err_t mqtt_outbox_sim_send(void *ctx, const char *topic, const void *payload, size_t len, void *token)
+{
+	uint32_t tick = *(const uint32_t*)ctx;
+	unsigned long id = 0;
+
+	if(g_ack_count == MQTT_OUTBOX_SIM_MAX_PENDING)
+	{
+		return ESP_ERR_TIMEOUT;
+	}
+	if(strcmp(topic, MQTT_OUTBOX_SIM_TOPIC) != 0 || sscanf(payload, "{\"id\":%lu", &id) != 1 || id >= MQTT_OUTBOX_SIM_MAX_IDS)
+	{
+		ESP_LOGE(TAG, "mqtt_outbox_sim_send: record came back damaged");
+		return ESP_FAIL;
+	}
+	g_acks[g_ack_count++] = (mqtt_outbox_sim_ack_t){token, (uint32_t)id, tick + MQTT_OUTBOX_SIM_ACK_DELAY};
+	return ESP_OK;
+}
+
+/**
+ * @fn void mqtt_outbox_sim_fail_pending(void)
+ * @brief the connection dropped, every publish in flight fails like cleanupOutgoingPublishes fails them
+ *
+ */
+static void mqtt_outbox_sim_fail_pending(void)
+{
+	for(uint32_t i = 0; i < g_ack_count; i++)
+	{
+		mqtt_outbox_sent(g_acks[i].token, ESP_FAIL);
+	}
+	g_ack_count = 0;
+}
+
+/**
+ * @fn void mqtt_outbox_sim_deliver(uint32_t)
+ * @brief deliver the publishes whose PUBACK is due, in order
+ *
+ */
+static void mqtt_outbox_sim_deliver(uint32_t tick)
+{
+	while(g_ack_count > 0 && g_acks[0].due <= tick)
+	{
+		if(rand() % 100 < MQTT_OUTBOX_SIM_FAIL_PERCENT)
+		{
+			mqtt_outbox_sim_fail_pending();
+			return;
+		}
+
+		uint32_t id = g_acks[0].id;
+		if(g_received[id] == 0)
+		{
+			if((int64_t)id < g_last_backfill)
+			{
+				g_out_of_order++;
+			}
+			g_last_backfill = id;
+		}
+		if(g_received[id] < UINT8_MAX)
+		{
+			g_received[id]++;
+		}
+		mqtt_outbox_sent(g_acks[0].token, ESP_OK);
+		memmove(&g_acks[0], &g_acks[1], --g_ack_count * sizeof(g_acks[0]));
+	}
+}
+
+/**
+ * @fn uint32_t mqtt_outbox_sim_capacity(void)
+ * @brief records the outbox holds for sure: every sector but the one being reused
+ *
+ */
+static uint32_t mqtt_outbox_sim_capacity(void)
+{
+	uint32_t record = 16 + ((1 + sizeof(MQTT_OUTBOX_SIM_TOPIC) - 1 + MQTT_OUTBOX_SIM_PAYLOAD_SIZE + 3) & ~3u);
+	return (MQTT_OUTBOX_SIM_SECTORS - 2) * (MQTT_OUTBOX_SECTOR_SIZE / record);
+}
+
+/**
+ * @fn bool mqtt_outbox_sim_scenario(const mqtt_outbox_sim_scenario_t*)
+ * @brief run one outage: live traffic, outage, recovery until the outbox is empty
+ *
+ * @return true if the delivered records match what the scenario allows to lose
+ */
+static bool mqtt_outbox_sim_scenario(const mqtt_outbox_sim_scenario_t *scenario)
+{
+	char payload[MQTT_OUTBOX_SIM_PAYLOAD_SIZE + 1];
+	mqtt_outbox_stats_t stats;
+	uint32_t outage = mqtt_outbox_sim_capacity() * scenario->outage_percent / 100;
+	uint32_t outage_start = MQTT_OUTBOX_SIM_LEAD_TICKS;
+	uint32_t outage_end = outage_start + outage;
+	uint32_t produced = 0, lost_in_reset = 0, dropped = 0, rejected = 0, tick;
+	bool link_up, was_up = true;
+
+	memset(g_sim_flash.data, 0xff, sizeof(g_sim_flash.data));
+	g_sim_flash.tear_next_write = false;
+	memset(g_received, 0, sizeof(g_received));
+	g_ack_count = 0;
+	g_last_backfill = -1;
+	g_out_of_order = 0;
+	if(mqtt_outbox_init(&g_flash, scenario->policy) != ESP_OK)
+	{
+		return false;
+	}
+
+	for(tick = 0; tick < MQTT_OUTBOX_SIM_MAX_TICKS; tick++)
+	{
+		link_up = tick < outage_start || tick >= outage_end;
+		if(!link_up && was_up)
+		{
+			mqtt_outbox_sim_fail_pending();
+		}
+		was_up = link_up;
+
+		//one telemetry batch per tick, straight to the broker while the link is up
+		if(tick < outage_end + MQTT_OUTBOX_SIM_LEAD_TICKS)
+		{
+			uint32_t id = produced++;
+			int len = snprintf(payload, sizeof(payload), "{\"id\":%lu,\"samples\":[", (unsigned long)id);
+			memset(&payload[len], 'x', MQTT_OUTBOX_SIM_PAYLOAD_SIZE - len);
+			if(link_up)
+			{
+				g_received[id]++;
+			}
+			else if(mqtt_outbox_put(MQTT_OUTBOX_SIM_TOPIC, payload, MQTT_OUTBOX_SIM_PAYLOAD_SIZE,
+									(int64_t)tick * MQTT_OUTBOX_SIM_TICK_MS * 1000) != ESP_OK)
+			{
+				rejected++;
+			}
+		}
+
+		if(scenario->reset != MQTT_OUTBOX_SIM_NO_RESET && tick == outage_start + outage / 2)
+		{
+			g_sim_flash.tear_next_write = scenario->reset == MQTT_OUTBOX_SIM_TORN_WRITE;
+			mqtt_outbox_flush();
+			mqtt_outbox_get_stats(&stats);
+			lost_in_reset = stats.rejected;
+			dropped += stats.dropped;
+			mqtt_outbox_init(&g_flash, scenario->policy);
+		}
+
+		mqtt_outbox_sim_deliver(tick);
+		mqtt_outbox_poll((int64_t)tick * MQTT_OUTBOX_SIM_TICK_MS * 1000, MQTT_OUTBOX_SIM_FLUSH_MS);
+		mqtt_outbox_drain(mqtt_outbox_sim_send, &tick, link_up ? MQTT_OUTBOX_SIM_DRAIN_RATE : 0);
+
+		if(tick >= outage_end + MQTT_OUTBOX_SIM_LEAD_TICKS && mqtt_outbox_pending() == 0 && g_ack_count == 0)
+		{
+			break;
+		}
+	}
+
+	mqtt_outbox_get_stats(&stats);
+	dropped += stats.dropped;
+
+	//lost records must be the ones the scenario gives up, oldest or newest of the outage in one run
+	uint32_t missing = 0, first_missing = 0, last_missing = 0, duplicates = 0;
+	for(uint32_t id = 0; id < produced; id++)
+	{
+		if(g_received[id] == 0)
+		{
+			if(missing++ == 0)
+			{
+				first_missing = id;
+			}
+			last_missing = id;
+		}
+		else if(g_received[id] > 1)
+		{
+			duplicates += g_received[id] - 1;
+		}
+	}
+
+	bool pass = tick < MQTT_OUTBOX_SIM_MAX_TICKS && g_out_of_order == 0;
+	if(scenario->outage_percent <= 100)
+	{
+		//records the torn write did program completely survive the reset
+		pass = pass && dropped == 0 && rejected == 0 &&
+			   (scenario->reset == MQTT_OUTBOX_SIM_TORN_WRITE ? missing > 0 && missing <= lost_in_reset : missing == 0);
+	}
+	else if(scenario->policy == MQTT_OUTBOX_DROP_OLDEST)
+	{
+		pass = pass && missing > 0 && missing == dropped && first_missing == outage_start &&
+			   last_missing - first_missing + 1 == missing;
+	}
+	else
+	{
+		pass = pass && missing > 0 && missing == rejected && last_missing == outage_end - 1 &&
+			   last_missing - first_missing + 1 == missing;
+	}
+
+	ESP_LOGI(TAG, "%s: %s, %lu produced, %lu during the outage, %lu missing, %lu dropped, %lu rejected, "
+			"%lu at risk in the reset, %lu duplicates, %lu resent, %lu flash writes, %lu erases, drained after %lu ticks",
+			scenario->name, pass ? "PASS" : "FAIL", (unsigned long)produced, (unsigned long)outage, (unsigned long)missing,
+			(unsigned long)dropped, (unsigned long)rejected, (unsigned long)lost_in_reset, (unsigned long)duplicates,
+			(unsigned long)stats.resent, (unsigned long)stats.flash_writes, (unsigned long)stats.erases,
+			(unsigned long)(tick - outage_end));
+	return pass;
+}
+
+bool mqtt_outbox_sim_run(void)
+{
+	bool pass = true;
+
+	srand(1);
+	ESP_LOGI(TAG, "mqtt_outbox_sim_run: %u sectors, capacity %lu records", MQTT_OUTBOX_SIM_SECTORS,
+			(unsigned long)mqtt_outbox_sim_capacity());
+	for(size_t i = 0; i < sizeof(g_scenarios) / sizeof(g_scenarios[0]); i++)
+	{
+		pass = mqtt_outbox_sim_scenario(&g_scenarios[i]) && pass;
+	}
+	return pass;
+}
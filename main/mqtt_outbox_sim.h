@@ -0,0 +1,37 @@
+/*
+ * mqtt_outbox_sim.h
+ *
+ *  Created on: Oct 18, 2026
+ *      Author: hamxa
+ */
+
+#ifndef MAIN_MQTT_OUTBOX_SIM_H_
+#define MAIN_MQTT_OUTBOX_SIM_H_
+
+#include <stdbool.h>
+
+//Sectors of the RAM flash the simulation runs the outbox on
+#define MQTT_OUTBOX_SIM_SECTORS			8
+
+//Payload bytes of a simulated telemetry record
+#define MQTT_OUTBOX_SIM_PAYLOAD_SIZE	120
+
+//Ticks between a send and its simulated PUBACK
+#define MQTT_OUTBOX_SIM_ACK_DELAY		2
+
+//Chance in percent that the simulated connection drops with publishes in flight
+#define MQTT_OUTBOX_SIM_FAIL_PERCENT	5
+
+//Stored records sent per tick while the link is up
+#define MQTT_OUTBOX_SIM_DRAIN_RATE		4
+
+/**
+ * @fn bool mqtt_outbox_sim_run(void)
+ * @brief run the outbox on a RAM flash through scheduled network outages, resets and a torn write,
+ * 			and check that nothing is lost up to the outbox capacity
+ *
+ * @return true if every scenario passed
+ */
+bool mqtt_outbox_sim_run(void);
+
+#endif /* MAIN_MQTT_OUTBOX_SIM_H_ */
@@ -0,0 +1,145 @@
+/*
+ * mqtt_pacer.c
+ *
+ *  Created on: Oct 18, 2026
+ *      Author: hamxa
+ */
+#include "mqtt_pacer.h"
+
+/**
+ * @fn bool mqtt_pacer_decrease(mqtt_pacer_t*, uint32_t, uint32_t)
+ * @brief multiplicative decrease, then none until a round trip later
+ *
+ * @param sent_ms last send of the publish that was late or lost
+ * @return true if the window was decreased
+ */
+static bool mqtt_pacer_decrease(mqtt_pacer_t *pacer, uint32_t sent_ms, uint32_t now_ms)
+{
+	//publishes sent before the decrease still show the old window, a PUBACK that never comes is counted once
+	if((int32_t)(sent_ms - pacer->decreased_ms) < 0 || now_ms - pacer->decreased_ms < pacer->srtt_ms)
+	{
+		return false;
+	}
+	pacer->window = pacer->window * MQTT_PACER_BETA / 256;
+	if(pacer->window < 1)
+	{
+		pacer->window = 1;
+	}
+	pacer->threshold = pacer->window;
+	pacer->decreased_ms = now_ms;
+	return true;
+}
+
+void mqtt_pacer_init(mqtt_pacer_t *pacer, uint32_t max_window, uint32_t now_ms)
+{
+	*pacer = (mqtt_pacer_t){0};
+	pacer->window = 1;
+	pacer->max_window = max_window > 0 ? max_window : 1;
+	pacer->threshold = pacer->max_window;
+	pacer->period_start_ms = now_ms;
+	pacer->decreased_ms = now_ms;
+	pacer->next_send_ms = now_ms;
+}
+
+bool mqtt_pacer_can_send(const mqtt_pacer_t *pacer, uint32_t in_flight, uint32_t now_ms)
+{
+	return in_flight < mqtt_pacer_window(pacer) && (int32_t)(now_ms - pacer->next_send_ms) >= 0;
+}
+
+void mqtt_pacer_on_send(mqtt_pacer_t *pacer, uint32_t now_ms)
+{
+	uint32_t interval_ms = (uint32_t)(pacer->srtt_ms / pacer->window);
+
+	//an idle link does not save up sends for a burst
+	if((int32_t)(now_ms - pacer->next_send_ms) > (int32_t)interval_ms)
+	{
+		pacer->next_send_ms = now_ms;
+	}
+	pacer->next_send_ms += interval_ms;
+}
+
+void mqtt_pacer_on_ack(mqtt_pacer_t *pacer, uint32_t rtt_ms, uint32_t now_ms)
+{
+	pacer->stats.acks++;
+
+	if(!pacer->measured)
+	{
+		pacer->srtt_ms = rtt_ms;
+		pacer->rttvar_ms = rtt_ms / 2;
+		pacer->min_rtt_ms = rtt_ms;
+		pacer->period_min_rtt_ms = rtt_ms;
+		pacer->measured = true;
+	}
+	else
+	{
+		uint32_t deviation = rtt_ms > pacer->srtt_ms ? rtt_ms - pacer->srtt_ms : pacer->srtt_ms - rtt_ms;
+		pacer->rttvar_ms = (3 * pacer->rttvar_ms + deviation) / 4;
+		pacer->srtt_ms = (7 * pacer->srtt_ms + rtt_ms) / 8;
+	}
+
+	if(rtt_ms < pacer->period_min_rtt_ms)
+	{
+		pacer->period_min_rtt_ms = rtt_ms;
+	}
+	if(rtt_ms < pacer->min_rtt_ms)
+	{
+		pacer->min_rtt_ms = rtt_ms;
+	}
+	if(now_ms - pacer->period_start_ms >= MQTT_PACER_MIN_RTT_PERIOD_MS)
+	{
+		pacer->min_rtt_ms = pacer->period_min_rtt_ms;
+		pacer->period_min_rtt_ms = rtt_ms;
+		pacer->period_start_ms = now_ms;
+	}
+
+	uint32_t queued_ms = 2 * pacer->min_rtt_ms + MQTT_PACER_RTT_SLACK_MS;
+	if(rtt_ms > queued_ms && pacer->srtt_ms > queued_ms)
+	{
+		//publishes wait in a queue somewhere on the uplink, shrink the window before it overflows. A single late
+		//PUBACK is not enough, the smoothed round trip has to show the queue too
+		if(mqtt_pacer_decrease(pacer, now_ms - rtt_ms, now_ms))
+		{
+			pacer->stats.delay_backoffs++;
+		}
+	}
+	else if(rtt_ms <= pacer->min_rtt_ms + pacer->min_rtt_ms / 4 + MQTT_PACER_RTT_SLACK_MS &&
+			pacer->window < pacer->max_window)
+	{
+		//one more publish in flight per fast ack up to the threshold, then one per round trip
+		pacer->window += pacer->window < pacer->threshold ? 1.0f : 1.0f / pacer->window;
+		if(pacer->window > pacer->max_window)
+		{
+			pacer->window = pacer->max_window;
+		}
+		pacer->stats.increases++;
+	}
+}
+
+void mqtt_pacer_on_loss(mqtt_pacer_t *pacer, uint32_t sent_ms, uint32_t now_ms)
+{
+	if(mqtt_pacer_decrease(pacer, sent_ms, now_ms))
+	{
+		pacer->stats.loss_backoffs++;
+	}
+}
+
+uint32_t mqtt_pacer_rto_ms(const mqtt_pacer_t *pacer)
+{
+	uint32_t rto_ms = pacer->srtt_ms + 4 * pacer->rttvar_ms;
+
+	return rto_ms > MQTT_PACER_RTO_MIN_MS ? rto_ms : MQTT_PACER_RTO_MIN_MS;
+}
+
+uint32_t mqtt_pacer_window(const mqtt_pacer_t *pacer)
+{
+	return (uint32_t)pacer->window;
+}
+
+uint32_t mqtt_pacer_rate(const mqtt_pacer_t *pacer)
+{
+	if(!pacer->measured)
+	{
+		return 0;
+	}
+	return (uint32_t)(pacer->window * 1000 / (pacer->srtt_ms > 0 ? pacer->srtt_ms : 1));
+}
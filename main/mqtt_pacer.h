@@ -0,0 +1,124 @@
+/*
+ * mqtt_pacer.h
+ *
+ *  Created on: Oct 18, 2026
+ *      Author: hamxa
+ */
+
+#ifndef MAIN_MQTT_PACER_H_
+#define MAIN_MQTT_PACER_H_
+
+#include <stdbool.h>
+#include <stdint.h>
+
+//Queueing delay on top of the lowest round trip that still counts as a fast PUBACK, besides a quarter of it
+#define MQTT_PACER_RTT_SLACK_MS			20
+
+//The lowest round trip is renewed from the acks of this period, so a route change is picked up
+#define MQTT_PACER_MIN_RTT_PERIOD_MS	30000
+
+//Shortest time an unacked publish is given before it counts as lost
+#define MQTT_PACER_RTO_MIN_MS			500
+
+//Window kept by a multiplicative decrease, in 1/256
+#define MQTT_PACER_BETA					128
+
+/**
+ * Pacer counters since init
+ */
+typedef struct mqtt_pacer_stats
+{
+	uint32_t acks;
+	uint32_t increases;			///> acks that grew the window
+	uint32_t delay_backoffs;	///> decreases because the smoothed round trip doubled, a queue built up
+	uint32_t loss_backoffs;		///> decreases because of an ack timeout or a failed send
+}mqtt_pacer_stats_t;
+
+/**
+ * AIMD state of one connection's publishes: the window grows by one publish per round trip while PUBACKs come
+ * back close to the lowest round trip, and is halved once per round trip on a timeout, a failed send, or a smoothed
+ * round trip that doubled. Only publishes sent after the last decrease can decrease it again. Until the first
+ * decrease it doubles per round trip instead. Owned by the task that sends the publishes
+ */
+typedef struct mqtt_pacer
+{
+	float window;					///> QoS1 publishes allowed in flight, 1 to max_window
+	float threshold;				///> the window doubles per round trip below it, the window of the last decrease
+	uint32_t max_window;
+	uint32_t srtt_ms;				///> smoothed PUBACK round trip
+	uint32_t rttvar_ms;				///> smoothed deviation of the round trip
+	uint32_t min_rtt_ms;			///> lowest round trip, the link without a queue
+	uint32_t period_min_rtt_ms;		///> lowest round trip of the current period
+	uint32_t period_start_ms;
+	uint32_t decreased_ms;			///> last decrease, no other one before a round trip later
+	uint32_t next_send_ms;			///> earliest time of the next publish, spreads the window over a round trip
+	bool measured;					///> there was a first round trip
+	mqtt_pacer_stats_t stats;
+}mqtt_pacer_t;
+
+/**
+ * @fn void mqtt_pacer_init(mqtt_pacer_t*, uint32_t, uint32_t)
+ * @brief set up a pacer, the window starts at one publish
+ *
+ * @param max_window largest window, the publishes that can be kept for resend
+ * @param now_ms current time
+ */
+void mqtt_pacer_init(mqtt_pacer_t *pacer, uint32_t max_window, uint32_t now_ms);
+
+/**
+ * @fn bool mqtt_pacer_can_send(const mqtt_pacer_t*, uint32_t, uint32_t)
+ * @brief check whether another QoS1 publish may go out
+ *
+ * @param in_flight publishes awaiting their PUBACK
+ * @param now_ms current time
+ */
+bool mqtt_pacer_can_send(const mqtt_pacer_t *pacer, uint32_t in_flight, uint32_t now_ms);
+
+/**
+ * @fn void mqtt_pacer_on_send(mqtt_pacer_t*, uint32_t)
+ * @brief count a QoS1 publish that went out, the next one is paced a round trip over the window later
+ *
+ */
+void mqtt_pacer_on_send(mqtt_pacer_t *pacer, uint32_t now_ms);
+
+/**
+ * @fn void mqtt_pacer_on_ack(mqtt_pacer_t*, uint32_t, uint32_t)
+ * @brief update the round trip with a PUBACK and grow or shrink the window
+ *
+ * @param rtt_ms time from the last send of the publish to its PUBACK
+ * @param now_ms current time
+ */
+void mqtt_pacer_on_ack(mqtt_pacer_t *pacer, uint32_t rtt_ms, uint32_t now_ms);
+
+/**
+ * @fn void mqtt_pacer_on_loss(mqtt_pacer_t*, uint32_t, uint32_t)
+ * @brief halve the window after an ack timeout or a failed send, at most once per round trip. Safe to call for the
+ * 			same overdue publish until it is acked
+ *
+ * @param sent_ms last send of the publish, the losses of publishes sent before the last decrease are ignored
+ * @param now_ms current time
+ */
+void mqtt_pacer_on_loss(mqtt_pacer_t *pacer, uint32_t sent_ms, uint32_t now_ms);
+
+/**
+ * @fn uint32_t mqtt_pacer_rto_ms(const mqtt_pacer_t*)
+ * @brief time after which an unacked publish counts as lost
+ *
+ */
+uint32_t mqtt_pacer_rto_ms(const mqtt_pacer_t *pacer);
+
+/**
+ * @fn uint32_t mqtt_pacer_window(const mqtt_pacer_t*)
+ * @brief whole publishes the window allows in flight
+ *
+ */
+uint32_t mqtt_pacer_window(const mqtt_pacer_t *pacer);
+
+/**
+ * @fn uint32_t mqtt_pacer_rate(const mqtt_pacer_t*)
+ * @brief publishes per second the window sustains at the smoothed round trip, 0 before the first PUBACK
+ *
+ */
+uint32_t mqtt_pacer_rate(const mqtt_pacer_t *pacer);
+
+#endif /* MAIN_MQTT_PACER_H_ */
@@ -0,0 +1,175 @@
+/*
+ * mqtt_posix_transport.c
+ *
+ *  Created on: Oct 18, 2026
+ *      Author: hamxa
+ */
+#include <errno.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <poll.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include "esp_log.h"
+
+#include "mqtt_posix_transport.h"
+
+static const char TAG[] = "mqtt_posix_transport";
+
+bool mqtt_posix_transport_connect(NetworkContext_t *pNetworkContext, const char *host, uint16_t port)
+{
+	struct addrinfo hints = {.ai_family = AF_UNSPEC, .ai_socktype = SOCK_STREAM};
+	struct addrinfo *result;
+	struct timeval timeout = {.tv_sec = MQTT_POSIX_TRANSPORT_CONNECT_TIMEOUT_MS / 1000,
+							  .tv_usec = (MQTT_POSIX_TRANSPORT_CONNECT_TIMEOUT_MS % 1000) * 1000};
+	char service[8];
+	int one = 1;
+	int err;
+
+	memset(pNetworkContext, 0, sizeof(*pNetworkContext));
+	pNetworkContext->socket = -1;
+
+	snprintf(service, sizeof(service), "%u", port);
+	err = getaddrinfo(host, service, &hints, &result);
+	if(err != 0)
+	{
+		ESP_LOGE(TAG, "mqtt_posix_transport_connect: cannot resolve %s: %s", host, gai_strerror(err));
+		return false;
+	}
+
+	for(struct addrinfo *addr = result; addr != NULL; addr = addr->ai_next)
+	{
+		int sock = socket(addr->ai_family, addr->ai_socktype, addr->ai_protocol);
+		if(sock < 0)
+		{
+			continue;
+		}
+		//the send timeout also bounds the connect
+		setsockopt(sock, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout));
+		if(connect(sock, addr->ai_addr, addr->ai_addrlen) == 0)
+		{
+			//every MQTT packet goes out when it is written, as on the device
+			setsockopt(sock, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+			pNetworkContext->socket = sock;
+			break;
+		}
+		close(sock);
+	}
+	freeaddrinfo(result);
+
+	if(pNetworkContext->socket < 0)
+	{
+		ESP_LOGE(TAG, "mqtt_posix_transport_connect: cannot connect to %s:%u", host, port);
+		return false;
+	}
+	return true;
+}
+
+void mqtt_posix_transport_disconnect(NetworkContext_t *pNetworkContext)
+{
+	if(pNetworkContext->socket >= 0)
+	{
+		close(pNetworkContext->socket);
+		pNetworkContext->socket = -1;
+	}
+}
+
+int32_t mqtt_posix_transport_send(NetworkContext_t *pNetworkContext, const void *pBuffer, size_t bytesToSend)
+{
+	ssize_t sent;
+
+	do
+	{
+		sent = send(pNetworkContext->socket, pBuffer, bytesToSend, MSG_NOSIGNAL);
+	} while(sent < 0 && errno == EINTR);
+
+	if(sent < 0)
+	{
+		//a full send buffer past the timeout is reported as nothing sent, coreMQTT retries
+		return (errno == EAGAIN || errno == EWOULDBLOCK) ? 0 : -1;
+	}
+	pNetworkContext->bytes_sent += sent;
+	pNetworkContext->writes++;
+	return (int32_t)sent;
+}
+
+int32_t mqtt_posix_transport_writev(NetworkContext_t *pNetworkContext, TransportOutVector_t *pIoVec, size_t ioVecCount)
+{
+	size_t staged = 0;
+	size_t i = 0;
+	int32_t sent;
+	int32_t total = 0;
+
+	//copied like the device copies them, so the CPU time of the bench includes the gathering
+	while(i < ioVecCount && staged + pIoVec[i].iov_len <= sizeof(pNetworkContext->coalesce))
+	{
+		memcpy(pNetworkContext->coalesce + staged, pIoVec[i].iov_base, pIoVec[i].iov_len);
+		staged += pIoVec[i].iov_len;
+		i++;
+	}
+
+	if(staged > 0)
+	{
+		sent = mqtt_posix_transport_send(pNetworkContext, pNetworkContext->coalesce, staged);
+		if(sent < 0 || (size_t)sent < staged)
+		{
+			//coreMQTT calls again with the vectors advanced past what was sent
+			return sent;
+		}
+		total = sent;
+	}
+
+	if(i < ioVecCount)
+	{
+		sent = mqtt_posix_transport_send(pNetworkContext, pIoVec[i].iov_base, pIoVec[i].iov_len);
+		if(sent < 0)
+		{
+			return total > 0 ? total : sent;
+		}
+		total += sent;
+	}
+	return total;
+}
+
+int32_t mqtt_posix_transport_recv(NetworkContext_t *pNetworkContext, void *pBuffer, size_t bytesToRecv)
+{
+	struct pollfd fd = {.fd = pNetworkContext->socket, .events = POLLIN};
+	ssize_t received;
+	int ready;
+
+	//the simulator's tick signal interrupts blocking calls, which is not an error
+	do
+	{
+		ready = poll(&fd, 1, MQTT_POSIX_TRANSPORT_RECV_TIMEOUT_MS);
+	} while(ready < 0 && errno == EINTR);
+
+	if(ready < 0)
+	{
+		return -1;
+	}
+	if(ready == 0)
+	{
+		return 0;
+	}
+
+	do
+	{
+		received = recv(pNetworkContext->socket, pBuffer, bytesToRecv, 0);
+	} while(received < 0 && errno == EINTR);
+
+	if(received == 0)
+	{
+		//the broker closed the connection
+		return -1;
+	}
+	if(received < 0)
+	{
+		return (errno == EAGAIN || errno == EWOULDBLOCK) ? 0 : -1;
+	}
+	pNetworkContext->bytes_received += received;
+	return (int32_t)received;
+}
@@ -0,0 +1,84 @@
+/*
+ * mqtt_posix_transport.h
+ *
+ *  Created on: Oct 18, 2026
+ *      Author: hamxa
+ */
+
+#ifndef MAIN_MQTT_POSIX_TRANSPORT_H_
+#define MAIN_MQTT_POSIX_TRANSPORT_H_
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "sdkconfig.h"
+#include "transport_interface.h"
+
+//Longest a receive waits for the first byte before telling coreMQTT there is no data
+#define MQTT_POSIX_TRANSPORT_RECV_TIMEOUT_MS	10
+
+//Timeout of the TCP connect
+#define MQTT_POSIX_TRANSPORT_CONNECT_TIMEOUT_MS	3000
+
+//Size of the buffer mqtt_posix_transport_writev gathers a packet in, as MQTT_TRANSPORT_COALESCE_SIZE on the device
+#define MQTT_POSIX_TRANSPORT_COALESCE_SIZE		CONFIG_MQTT_NETWORK_BUFFER_SIZE
+
+/**
+ * Plaintext TCP connection to a broker on the host, the Linux target counterpart of the TLS network context
+ */
+struct NetworkContext
+{
+	int socket;
+	uint64_t bytes_sent;
+	uint64_t bytes_received;
+	uint32_t writes;			///> send calls, each one a TCP segment with TCP_NODELAY, a TLS record on the device
+	uint8_t coalesce[MQTT_POSIX_TRANSPORT_COALESCE_SIZE];
+};
+
+typedef struct NetworkContext NetworkContext_t;
+
+/**
+ * @fn bool mqtt_posix_transport_connect(NetworkContext_t*, const char*, uint16_t)
+ * @brief open a TCP connection to the broker with Nagle disabled, as the TLS transport does
+ *
+ * @param host host name or address
+ * @param port broker port
+ * @return true if connected
+ */
+bool mqtt_posix_transport_connect(NetworkContext_t *pNetworkContext, const char *host, uint16_t port);
+
+/**
+ * @fn void mqtt_posix_transport_disconnect(NetworkContext_t*)
+ * @brief close the connection
+ *
+ */
+void mqtt_posix_transport_disconnect(NetworkContext_t *pNetworkContext);
+
+/**
+ * @fn int32_t mqtt_posix_transport_send(NetworkContext_t*, const void*, size_t)
+ * @brief coreMQTT send function
+ *
+ * @return bytes sent, or a negative value on error
+ */
+int32_t mqtt_posix_transport_send(NetworkContext_t *pNetworkContext, const void *pBuffer, size_t bytesToSend);
+
+/**
+ * @fn int32_t mqtt_posix_transport_writev(NetworkContext_t*, TransportOutVector_t*, size_t)
+ * @brief coreMQTT vectored send, gathers the vectors into writes as mqtt_transport_writev gathers them into TLS
+ * 			records on the device: one write while they fit MQTT_POSIX_TRANSPORT_COALESCE_SIZE, a larger vector
+ * 			written straight from its buffer
+ *
+ * @return bytes sent, may be fewer than the vectors hold, or a negative value on error
+ */
+int32_t mqtt_posix_transport_writev(NetworkContext_t *pNetworkContext, TransportOutVector_t *pIoVec, size_t ioVecCount);
+
+/**
+ * @fn int32_t mqtt_posix_transport_recv(NetworkContext_t*, void*, size_t)
+ * @brief coreMQTT receive function, waits up to MQTT_POSIX_TRANSPORT_RECV_TIMEOUT_MS for data
+ *
+ * @return bytes received, 0 if there was no data, or a negative value on error or when the broker closed
+ */
+int32_t mqtt_posix_transport_recv(NetworkContext_t *pNetworkContext, void *pBuffer, size_t bytesToRecv);
+
+#endif /* MAIN_MQTT_POSIX_TRANSPORT_H_ */
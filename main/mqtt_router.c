@@ -0,0 +1,591 @@
+/*
+ * mqtt_router.c
+ *
+ *  Created on: Oct 18, 2026
+ *      Author: hamxa
+ */
+#include <string.h>
+
+#include "mqtt_router.h"
+
+/**
+ * Topic filter held by the router
+ */
+typedef struct mqtt_router_entry
+{
+	bool used;
+	bool multi;						///> ends in '#', listed on the node of the level before it
+	uint16_t len;
+	uint16_t node;					///> node the filter is listed on
+	uint16_t next;					///> next filter listed on the same node
+	char filter[MQTT_ROUTER_MAX_FILTER_LENGTH + 1];
+}mqtt_router_entry_t;
+
+/**
+ * One topic level of the trie. The level text is not copied, it points into a filter passing through the node
+ */
+typedef struct mqtt_router_node
+{
+	uint32_t key;					///> hash of the parent and the level, key of the child table
+	uint16_t parent;
+	uint16_t plus;					///> '+' child, 0 if none
+	uint16_t exact;					///> first filter ending at this level
+	uint16_t multi;					///> first filter ending in '#' after this level
+	uint16_t refs;					///> filters passing through
+	uint16_t owner;					///> filter holding the level text
+	uint8_t level_off;
+	uint8_t level_len;
+	uint8_t depth;					///> level number, the root is 0
+}mqtt_router_node_t;
+
+#if MQTT_ROUTER_MAX_NODES >= UINT16_MAX || MQTT_ROUTER_MAX_FILTER_LENGTH > UINT8_MAX
+	#error "router indexes are 16 bit and level offsets 8 bit"
+#endif
+
+//only touched by the task owning the router, the MQTT agent
+static mqtt_router_entry_t g_entries[MQTT_ROUTER_MAX_FILTERS];
+static mqtt_router_node_t g_nodes[MQTT_ROUTER_MAX_NODES];
+
+//open addressed table from parent and level to the child node, 0 when empty as the root is nobody's child
+static uint16_t g_children[MQTT_ROUTER_CHILD_SLOTS];
+
+static uint16_t g_free_nodes[MQTT_ROUTER_MAX_NODES - 1];
+static uint16_t g_free_node_count;
+static size_t g_entry_count;
+static bool g_initialized = false;
+
+/**
+ * @fn void mqtt_router_init(void)
+ * @brief empty the trie, on first use
+ *
+ */
+static void mqtt_router_init(void)
+{
+	if(g_initialized)
+	{
+		return;
+	}
+	mqtt_router_clear();
+}
+
+/**
+ * @fn uint32_t mqtt_router_key(uint16_t, const char*, uint16_t)
+ * @brief FNV-1a of the level, mixed with the parent
+ *
+ */
+static uint32_t mqtt_router_key(uint16_t parent, const char *level, uint16_t len)
+{
+	uint32_t hash = 2166136261u;
+
+	for(uint16_t i = 0; i < len; i++)
+	{
+		hash = (hash ^ (uint8_t)level[i]) * 16777619u;
+	}
+	return hash ^ (parent * 0x9E3779B1u);
+}
+
+/**
+ * @fn uint16_t mqtt_router_level_end(const char*, uint16_t, uint16_t)
+ * @brief find the end of the level starting at pos
+ *
+ * @return index of the '/' after the level, or len
+ */
+static uint16_t mqtt_router_level_end(const char *str, uint16_t pos, uint16_t len)
+{
+	while(pos < len && str[pos] != '/')
+	{
+		pos++;
+	}
+	return pos;
+}
+
+/**
+ * @fn uint16_t mqtt_router_child(uint16_t, const char*, uint16_t)
+ * @brief look up the child of a node for a literal level
+ *
+ * @return the child, 0 if none
+ */
+static uint16_t mqtt_router_child(uint16_t parent, const char *level, uint16_t len)
+{
+	uint32_t key = mqtt_router_key(parent, level, len);
+	uint16_t child;
+
+	for(uint32_t slot = key % MQTT_ROUTER_CHILD_SLOTS; (child = g_children[slot]) != 0; slot = (slot + 1) % MQTT_ROUTER_CHILD_SLOTS)
+	{
+		mqtt_router_node_t *node = &g_nodes[child];
+		if(node->key == key && node->parent == parent && node->level_len == len &&
+		   memcmp(g_entries[node->owner].filter + node->level_off, level, len) == 0)
+		{
+			return child;
+		}
+	}
+	return 0;
+}
+
+/**
+ * @fn void mqtt_router_child_erase(uint16_t)
+ * @brief remove a node from the child table, shifting back the probe run after it so lookups never stop at the hole
+ *
+ */
+static void mqtt_router_child_erase(uint16_t child)
+{
+	uint32_t slot = g_nodes[child].key % MQTT_ROUTER_CHILD_SLOTS;
+	uint32_t next;
+
+	while(g_children[slot] != child)
+	{
+		slot = (slot + 1) % MQTT_ROUTER_CHILD_SLOTS;
+	}
+	g_children[slot] = 0;
+
+	for(next = (slot + 1) % MQTT_ROUTER_CHILD_SLOTS; g_children[next] != 0; next = (next + 1) % MQTT_ROUTER_CHILD_SLOTS)
+	{
+		uint32_t home = g_nodes[g_children[next]].key % MQTT_ROUTER_CHILD_SLOTS;
+		if((next + MQTT_ROUTER_CHILD_SLOTS - home) % MQTT_ROUTER_CHILD_SLOTS >= (next + MQTT_ROUTER_CHILD_SLOTS - slot) % MQTT_ROUTER_CHILD_SLOTS)
+		{
+			g_children[slot] = g_children[next];
+			g_children[next] = 0;
+			slot = next;
+		}
+	}
+}
+
+/**
+ * @fn uint16_t mqtt_router_node_new(uint16_t, uint16_t, uint16_t, uint16_t, bool)
+ * @brief take a free node for a level of a filter
+ *
+ * @param parent parent node
+ * @param owner filter the level text is in
+ * @param off offset of the level in the filter
+ * @param len level length
+ * @param plus the level is '+', it hangs off the parent instead of the child table
+ * @return the node, there is always one as mqtt_router_add checks first
+ */
+static uint16_t mqtt_router_node_new(uint16_t parent, uint16_t owner, uint16_t off, uint16_t len, bool plus)
+{
+	uint16_t child = g_free_nodes[--g_free_node_count];
+	mqtt_router_node_t *node = &g_nodes[child];
+
+	node->key = mqtt_router_key(parent, g_entries[owner].filter + off, len);
+	node->parent = parent;
+	node->plus = 0;
+	node->exact = MQTT_ROUTER_NONE;
+	node->multi = MQTT_ROUTER_NONE;
+	node->refs = 0;
+	node->owner = owner;
+	node->level_off = off;
+	node->level_len = len;
+	node->depth = g_nodes[parent].depth + 1;
+
+	if(plus)
+	{
+		g_nodes[parent].plus = child;
+	}
+	else
+	{
+		uint32_t slot = node->key % MQTT_ROUTER_CHILD_SLOTS;
+		while(g_children[slot] != 0)
+		{
+			slot = (slot + 1) % MQTT_ROUTER_CHILD_SLOTS;
+		}
+		g_children[slot] = child;
+	}
+	return child;
+}
+
+/**
+ * @fn uint16_t mqtt_router_walk(const char*, uint16_t, uint16_t, bool*)
+ * @brief follow the levels of a filter down the trie
+ *
+ * @param owner filter the text belongs to, new nodes are created for it. MQTT_ROUTER_NONE only looks up
+ * @param multi set if the filter ends in '#'
+ * @return the node the filter is listed on, MQTT_ROUTER_NONE if a level is missing
+ */
+static uint16_t mqtt_router_walk(const char *filter, uint16_t len, uint16_t owner, bool *multi)
+{
+	uint16_t node = 0;
+	uint16_t pos = 0;
+
+	*multi = false;
+	for(;;)
+	{
+		uint16_t end = mqtt_router_level_end(filter, pos, len);
+		bool plus = end - pos == 1 && filter[pos] == '+';
+		uint16_t child;
+
+		if(end - pos == 1 && filter[pos] == '#')
+		{
+			*multi = true;
+			return node;
+		}
+
+		child = plus ? g_nodes[node].plus : mqtt_router_child(node, filter + pos, end - pos);
+		if(child == 0)
+		{
+			if(owner == MQTT_ROUTER_NONE)
+			{
+				return MQTT_ROUTER_NONE;
+			}
+			child = mqtt_router_node_new(node, owner, pos, end - pos, plus);
+		}
+		node = child;
+
+		if(end == len)
+		{
+			return node;
+		}
+		pos = end + 1;
+	}
+}
+
+/**
+ * @fn uint16_t mqtt_router_find(const char*, uint16_t)
+ * @brief find the id of a filter held
+ *
+ * @return the id, MQTT_ROUTER_NONE if not held
+ */
+static uint16_t mqtt_router_find(const char *filter, uint16_t len)
+{
+	bool multi;
+	uint16_t node = mqtt_router_walk(filter, len, MQTT_ROUTER_NONE, &multi);
+
+	if(node == MQTT_ROUTER_NONE)
+	{
+		return MQTT_ROUTER_NONE;
+	}
+	for(uint16_t id = multi ? g_nodes[node].multi : g_nodes[node].exact; id != MQTT_ROUTER_NONE; id = g_entries[id].next)
+	{
+		if(g_entries[id].len == len && memcmp(g_entries[id].filter, filter, len) == 0)
+		{
+			return id;
+		}
+	}
+	return MQTT_ROUTER_NONE;
+}
+
+/**
+ * @fn void mqtt_router_reown(uint16_t)
+ * @brief point a node's level text at another filter passing through it, before its owner goes away
+ *
+ */
+static void mqtt_router_reown(uint16_t child)
+{
+	mqtt_router_node_t *node = &g_nodes[child];
+
+	for(uint16_t id = 0; id < MQTT_ROUTER_MAX_FILTERS; id++)
+	{
+		uint16_t n;
+
+		if(!g_entries[id].used)
+		{
+			continue;
+		}
+		for(n = g_entries[id].node; g_nodes[n].depth > node->depth; n = g_nodes[n].parent)
+		{
+		}
+		if(n == child)
+		{
+			//the level sits at the same depth in every filter through the node
+			uint16_t off = 0;
+			for(uint8_t depth = 1; depth < node->depth; depth++)
+			{
+				off = mqtt_router_level_end(g_entries[id].filter, off, g_entries[id].len) + 1;
+			}
+			node->owner = id;
+			node->level_off = off;
+			return;
+		}
+	}
+}
+
+/**
+ * @fn size_t mqtt_router_list(uint16_t, mqtt_router_match_cb_t, void*)
+ * @brief report the filters listed on a node
+ *
+ */
+static size_t mqtt_router_list(uint16_t id, mqtt_router_match_cb_t cb, void *arg)
+{
+	size_t count = 0;
+
+	for(; id != MQTT_ROUTER_NONE; id = g_entries[id].next)
+	{
+		if(cb)
+		{
+			cb(arg, id);
+		}
+		count++;
+	}
+	return count;
+}
+
+/**
+ * @fn size_t mqtt_router_match_node(uint16_t, const char*, uint16_t, uint16_t, bool, mqtt_router_match_cb_t, void*)
+ * @brief match the rest of a topic from a node: the literal child and the '+' child of the next level
+ *
+ * @param pos start of the next level
+ * @param done every level of the topic was consumed
+ */
+static size_t mqtt_router_match_node(uint16_t node, const char *topic, uint16_t pos, uint16_t len, bool done,
+									 mqtt_router_match_cb_t cb, void *arg)
+{
+	//topics starting with '$' are not matched by filters starting with a wildcard
+	bool wildcards = node != 0 || len == 0 || topic[0] != '$';
+	size_t count = 0;
+	uint16_t end;
+	uint16_t child;
+
+	//"a/#" also matches the parent level "a"
+	if(wildcards)
+	{
+		count += mqtt_router_list(g_nodes[node].multi, cb, arg);
+	}
+	if(done)
+	{
+		return count + mqtt_router_list(g_nodes[node].exact, cb, arg);
+	}
+
+	end = mqtt_router_level_end(topic, pos, len);
+	child = mqtt_router_child(node, topic + pos, end - pos);
+	if(child != 0)
+	{
+		count += mqtt_router_match_node(child, topic, end + 1, len, end == len, cb, arg);
+	}
+	if(wildcards && g_nodes[node].plus != 0)
+	{
+		count += mqtt_router_match_node(g_nodes[node].plus, topic, end + 1, len, end == len, cb, arg);
+	}
+	return count;
+}
+
+esp_err_t mqtt_router_add(const char *filter, uint16_t filter_len, uint16_t *id)
+{
+	uint16_t levels = 0;
+	uint16_t pos = 0;
+	uint16_t free_id = MQTT_ROUTER_NONE;
+	uint16_t node;
+	bool multi;
+
+	mqtt_router_init();
+
+	if(filter_len == 0)
+	{
+		return ESP_ERR_INVALID_ARG;
+	}
+	if(filter_len > MQTT_ROUTER_MAX_FILTER_LENGTH)
+	{
+		return ESP_ERR_INVALID_SIZE;
+	}
+
+	//wildcards take a whole level, '#' only the last one
+	for(;;)
+	{
+		uint16_t end = mqtt_router_level_end(filter, pos, filter_len);
+		for(uint16_t i = pos; i < end; i++)
+		{
+			if((filter[i] == '+' || filter[i] == '#') && end - pos != 1)
+			{
+				return ESP_ERR_INVALID_ARG;
+			}
+		}
+		if(end - pos == 1 && filter[pos] == '#' && end != filter_len)
+		{
+			return ESP_ERR_INVALID_ARG;
+		}
+		levels++;
+		if(end == filter_len)
+		{
+			break;
+		}
+		pos = end + 1;
+	}
+
+	*id = mqtt_router_find(filter, filter_len);
+	if(*id != MQTT_ROUTER_NONE)
+	{
+		return ESP_OK;
+	}
+
+	for(uint16_t i = 0; i < MQTT_ROUTER_MAX_FILTERS && free_id == MQTT_ROUTER_NONE; i++)
+	{
+		if(!g_entries[i].used)
+		{
+			free_id = i;
+		}
+	}
+	if(free_id == MQTT_ROUTER_NONE || g_free_node_count < levels)
+	{
+		return ESP_ERR_NO_MEM;
+	}
+
+	mqtt_router_entry_t *entry = &g_entries[free_id];
+	memcpy(entry->filter, filter, filter_len);
+	entry->filter[filter_len] = '\0';
+	entry->len = filter_len;
+
+	node = mqtt_router_walk(entry->filter, filter_len, free_id, &multi);
+	entry->used = true;
+	entry->multi = multi;
+	entry->node = node;
+	if(multi)
+	{
+		entry->next = g_nodes[node].multi;
+		g_nodes[node].multi = free_id;
+	}
+	else
+	{
+		entry->next = g_nodes[node].exact;
+		g_nodes[node].exact = free_id;
+	}
+	for(; node != 0; node = g_nodes[node].parent)
+	{
+		g_nodes[node].refs++;
+	}
+
+	g_entry_count++;
+	*id = free_id;
+	return ESP_OK;
+}
+
+esp_err_t mqtt_router_remove(const char *filter, uint16_t filter_len, uint16_t *id)
+{
+	uint16_t removed;
+	uint16_t *link;
+	uint16_t node;
+
+	mqtt_router_init();
+
+	removed = mqtt_router_find(filter, filter_len);
+	if(removed == MQTT_ROUTER_NONE)
+	{
+		return ESP_ERR_NOT_FOUND;
+	}
+
+	mqtt_router_entry_t *entry = &g_entries[removed];
+	for(link = entry->multi ? &g_nodes[entry->node].multi : &g_nodes[entry->node].exact; *link != removed; link = &g_entries[*link].next)
+	{
+	}
+	*link = entry->next;
+	entry->used = false;
+
+	//free the levels no other filter passes through, the others must not keep pointing at this filter's text
+	for(node = entry->node; node != 0; )
+	{
+		uint16_t parent = g_nodes[node].parent;
+
+		if(--g_nodes[node].refs == 0)
+		{
+			if(g_nodes[parent].plus == node)
+			{
+				g_nodes[parent].plus = 0;
+			}
+			else
+			{
+				mqtt_router_child_erase(node);
+			}
+			g_free_nodes[g_free_node_count++] = node;
+		}
+		else if(g_nodes[node].owner == removed)
+		{
+			mqtt_router_reown(node);
+		}
+		node = parent;
+	}
+
+	g_entry_count--;
+	if(id)
+	{
+		*id = removed;
+	}
+	return ESP_OK;
+}
+
+size_t mqtt_router_match(const char *topic, uint16_t topic_len, mqtt_router_match_cb_t cb, void *arg)
+{
+	mqtt_router_init();
+
+	return mqtt_router_match_node(0, topic, 0, topic_len, false, cb, arg);
+}
+
+uint16_t mqtt_router_next(uint16_t id)
+{
+	for(id = id == MQTT_ROUTER_NONE ? 0 : id + 1; id < MQTT_ROUTER_MAX_FILTERS; id++)
+	{
+		if(g_entries[id].used)
+		{
+			return id;
+		}
+	}
+	return MQTT_ROUTER_NONE;
+}
+
+const char *mqtt_router_filter(uint16_t id, uint16_t *filter_len)
+{
+	if(id >= MQTT_ROUTER_MAX_FILTERS || !g_entries[id].used)
+	{
+		return NULL;
+	}
+	*filter_len = g_entries[id].len;
+	return g_entries[id].filter;
+}
+
+size_t mqtt_router_count(void)
+{
+	return g_entry_count;
+}
+
+void mqtt_router_clear(void)
+{
+	memset(g_entries, 0, sizeof(g_entries));
+	memset(g_children, 0, sizeof(g_children));
+	memset(&g_nodes[0], 0, sizeof(g_nodes[0]));
+	g_nodes[0].exact = MQTT_ROUTER_NONE;
+	g_nodes[0].multi = MQTT_ROUTER_NONE;
+
+	//handed out from the lowest
+	g_free_node_count = 0;
+	for(uint16_t node = MQTT_ROUTER_MAX_NODES - 1; node > 0; node--)
+	{
+		g_free_nodes[g_free_node_count++] = node;
+	}
+	g_entry_count = 0;
+	g_initialized = true;
+}
+
+bool mqtt_router_topic_matches(const char *filter, uint16_t filter_len, const char *topic, uint16_t topic_len)
+{
+	uint16_t f = 0;
+	uint16_t t = 0;
+
+	//topics starting with '$' are not matched by filters starting with a wildcard
+	if(topic_len > 0 && topic[0] == '$' && filter_len > 0 && (filter[0] == '+' || filter[0] == '#'))
+	{
+		return false;
+	}
+
+	while(f < filter_len)
+	{
+		if(filter[f] == '#')
+		{
+			return true;
+		}
+		if(filter[f] == '+')
+		{
+			while(t < topic_len && topic[t] != '/')
+			{
+				t++;
+			}
+			f++;
+		}
+		else
+		{
+			if(t >= topic_len || filter[f] != topic[t])
+			{
+				//"a/#" also matches the parent level "a"
+				return t == topic_len && f + 2 == filter_len && filter[f] == '/' && filter[f + 1] == '#';
+			}
+			f++;
+			t++;
+		}
+	}
+	return t == topic_len;
+}
@@ -0,0 +1,119 @@
+/*
+ * mqtt_router.h
+ *
+ *  Created on: Oct 18, 2026
+ *      Author: hamxa
+ */
+
+#ifndef MAIN_MQTT_ROUTER_H_
+#define MAIN_MQTT_ROUTER_H_
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "esp_err.h"
+#include "sdkconfig.h"
+
+//Topic filters the router holds, the Linux target holds enough for the benchmark
+#if CONFIG_IDF_TARGET_LINUX
+#define MQTT_ROUTER_MAX_FILTERS			512
+#else
+#define MQTT_ROUTER_MAX_FILTERS			32
+#endif
+
+//Longest topic filter
+#define MQTT_ROUTER_MAX_FILTER_LENGTH	64
+
+//Trie nodes, one per distinct topic level prefix
+#define MQTT_ROUTER_MAX_NODES			(MQTT_ROUTER_MAX_FILTERS * 4)
+
+//Slots of the child lookup table, kept at most half full
+#define MQTT_ROUTER_CHILD_SLOTS			(MQTT_ROUTER_MAX_NODES * 2)
+
+//Returned by mqtt_router_next when there is no further filter
+#define MQTT_ROUTER_NONE				UINT16_MAX
+
+/**
+ * @brief called for every filter matching a topic
+ *
+ * @param arg argument given to mqtt_router_match
+ * @param id id of the matching filter
+ */
+typedef void (*mqtt_router_match_cb_t)(void *arg, uint16_t id);
+
+/**
+ * @fn esp_err_t mqtt_router_add(const char*, uint16_t, uint16_t*)
+ * @brief add a topic filter, '+' matches one level and a trailing '#' the remaining levels. Adding a filter
+ * 			that is already held returns its id
+ *
+ * @param filter topic filter, need not be terminated
+ * @param filter_len filter length
+ * @param id id of the filter, stays the same until it is removed
+ * @return ESP_OK, ESP_ERR_INVALID_ARG for a malformed filter, ESP_ERR_INVALID_SIZE if it is too long, ESP_ERR_NO_MEM
+ */
+esp_err_t mqtt_router_add(const char *filter, uint16_t filter_len, uint16_t *id);
+
+/**
+ * @fn esp_err_t mqtt_router_remove(const char*, uint16_t, uint16_t*)
+ * @brief remove a topic filter
+ *
+ * @param id id the filter had, may be NULL
+ * @return ESP_OK, ESP_ERR_NOT_FOUND
+ */
+esp_err_t mqtt_router_remove(const char *filter, uint16_t filter_len, uint16_t *id);
+
+/**
+ * @fn size_t mqtt_router_match(const char*, uint16_t, mqtt_router_match_cb_t, void*)
+ * @brief find every filter matching a topic name, walking one trie path per topic level instead of every filter.
+ * 			Does not allocate
+ *
+ * @param topic topic name, need not be terminated
+ * @param topic_len topic name length
+ * @param cb called for every matching filter, may be NULL
+ * @param arg passed to cb
+ * @return number of matching filters
+ */
+size_t mqtt_router_match(const char *topic, uint16_t topic_len, mqtt_router_match_cb_t cb, void *arg);
+
+/**
+ * @fn uint16_t mqtt_router_next(uint16_t)
+ * @brief iterate over the filters held
+ *
+ * @param id previous id, MQTT_ROUTER_NONE to start
+ * @return next id, MQTT_ROUTER_NONE at the end
+ */
+uint16_t mqtt_router_next(uint16_t id);
+
+/**
+ * @fn const char mqtt_router_filter*(uint16_t, uint16_t*)
+ * @brief get the filter of an id
+ *
+ * @param filter_len filter length
+ * @return the terminated filter, NULL if the id is not in use
+ */
+const char *mqtt_router_filter(uint16_t id, uint16_t *filter_len);
+
+/**
+ * @fn size_t mqtt_router_count(void)
+ * @brief number of filters held
+ *
+ */
+size_t mqtt_router_count(void);
+
+/**
+ * @fn void mqtt_router_clear(void)
+ * @brief remove every filter
+ *
+ */
+void mqtt_router_clear(void);
+
+/**
+ * @fn bool mqtt_router_topic_matches(const char*, uint16_t, const char*, uint16_t)
+ * @brief match one filter against a topic name by scanning both, for callers holding a single filter
+ *
+ * @return true if the topic name matches the filter
+ */
+bool mqtt_router_topic_matches(const char *filter, uint16_t filter_len, const char *topic, uint16_t topic_len);
+
+#endif /* MAIN_MQTT_ROUTER_H_ */
@@ -0,0 +1,223 @@
+/*
+ * mqtt_router_bench.c
+ *
+ *  Created on: Oct 18, 2026
+ *      Author: hamxa
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "esp_log.h"
+
+#include "mqtt_router.h"
+#include "mqtt_router_bench.h"
+
+#define MQTT_ROUTER_BENCH_FLEET_FILTERS	6
+#define MQTT_ROUTER_BENCH_MAX_FILTERS	(MQTT_ROUTER_BENCH_DEVICES * 4 + MQTT_ROUTER_BENCH_FLEET_FILTERS)
+#define MQTT_ROUTER_BENCH_TOPIC_LEN		64
+
+#if MQTT_ROUTER_BENCH_MAX_FILTERS > MQTT_ROUTER_MAX_FILTERS
+	#error "the router does not hold the benchmark filters"
+#endif
+
+static const char TAG[] = "mqtt_router_bench";
+
+//filters every device shares
+static const char *g_fleet_filters[MQTT_ROUTER_BENCH_FLEET_FILTERS] = {
+		"devices/+/broadcast",
+		"devices/+/ota/#",
+		"fleet/#",
+		"+/status",
+		"$aws/things/+/shadow/update/accepted",
+		"#",
+};
+
+/**
+ * Filter as the scan sees it, with whether the router holds it right now
+ */
+typedef struct mqtt_router_bench_filter
+{
+	char filter[MQTT_ROUTER_MAX_FILTER_LENGTH + 1];
+	bool active;
+}mqtt_router_bench_filter_t;
+
+static mqtt_router_bench_filter_t g_filters[MQTT_ROUTER_BENCH_MAX_FILTERS];
+static size_t g_filter_count;
+
+static char g_topics[MQTT_ROUTER_BENCH_TOPICS][MQTT_ROUTER_BENCH_TOPIC_LEN];
+
+/**
+ * @fn int64_t mqtt_router_bench_now_ns(void)
+ * @brief monotonic time
+ *
+ */
+static int64_t mqtt_router_bench_now_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (int64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+/**
+ * @fn bool mqtt_router_bench_add(const char*)
+ * @brief add a filter to the router and to the scan list
+ *
+ */
+static bool mqtt_router_bench_add(const char *filter)
+{
+	uint16_t id;
+	esp_err_t err = mqtt_router_add(filter, strlen(filter), &id);
+
+	if(err != ESP_OK)
+	{
+		ESP_LOGE(TAG, "mqtt_router_bench_add: %s rejected: %s", filter, esp_err_to_name(err));
+		return false;
+	}
+	snprintf(g_filters[g_filter_count].filter, sizeof(g_filters[0].filter), "%s", filter);
+	g_filters[g_filter_count].active = true;
+	g_filter_count++;
+	return true;
+}
+
+/**
+ * @fn size_t mqtt_router_bench_scan(const char*, uint16_t)
+ * @brief match a topic against every filter, as the agent did before the router
+ *
+ */
+static size_t mqtt_router_bench_scan(const char *topic, uint16_t len)
+{
+	size_t count = 0;
+
+	for(size_t i = 0; i < g_filter_count; i++)
+	{
+		if(g_filters[i].active && mqtt_router_topic_matches(g_filters[i].filter, strlen(g_filters[i].filter), topic, len))
+		{
+			count++;
+		}
+	}
+	return count;
+}
+
+/**
+ * @fn bool mqtt_router_bench_measure(const char*)
+ * @brief dispatch every topic through the router and the scan, check they agree and log the time per topic
+ *
+ */
+static bool mqtt_router_bench_measure(const char *label)
+{
+	size_t router_matches = 0;
+	size_t scan_matches = 0;
+	int64_t start;
+	int64_t router_ns;
+	int64_t scan_ns;
+
+	for(size_t i = 0; i < MQTT_ROUTER_BENCH_TOPICS; i++)
+	{
+		uint16_t len = strlen(g_topics[i]);
+		size_t expected = mqtt_router_bench_scan(g_topics[i], len);
+		size_t got = mqtt_router_match(g_topics[i], len, NULL, NULL);
+		if(got != expected)
+		{
+			ESP_LOGE(TAG, "%s: %s matched %u filters, the scan %u", label, g_topics[i], (unsigned)got, (unsigned)expected);
+			return false;
+		}
+	}
+
+	start = mqtt_router_bench_now_ns();
+	for(size_t i = 0; i < MQTT_ROUTER_BENCH_TOPICS; i++)
+	{
+		router_matches += mqtt_router_match(g_topics[i], strlen(g_topics[i]), NULL, NULL);
+	}
+	router_ns = mqtt_router_bench_now_ns() - start;
+
+	start = mqtt_router_bench_now_ns();
+	for(size_t i = 0; i < MQTT_ROUTER_BENCH_TOPICS; i++)
+	{
+		scan_matches += mqtt_router_bench_scan(g_topics[i], strlen(g_topics[i]));
+	}
+	scan_ns = mqtt_router_bench_now_ns() - start;
+
+	ESP_LOGI(TAG, "%s: %u filters, %u topics, %u matches; trie %lld ns per topic, scan %lld ns per topic",
+			label, (unsigned)mqtt_router_count(), MQTT_ROUTER_BENCH_TOPICS, (unsigned)router_matches,
+			(long long)(router_ns / MQTT_ROUTER_BENCH_TOPICS), (long long)(scan_ns / MQTT_ROUTER_BENCH_TOPICS));
+	return router_matches == scan_matches;
+}
+
+bool mqtt_router_bench_run(void)
+{
+	char filter[MQTT_ROUTER_MAX_FILTER_LENGTH + 1];
+
+	mqtt_router_clear();
+	g_filter_count = 0;
+
+	for(unsigned dev = 0; dev < MQTT_ROUTER_BENCH_DEVICES; dev++)
+	{
+		snprintf(filter, sizeof(filter), "devices/dev%03u/cmd/+", dev);
+		bool added = mqtt_router_bench_add(filter);
+		snprintf(filter, sizeof(filter), "devices/dev%03u/config", dev);
+		added = added && mqtt_router_bench_add(filter);
+		snprintf(filter, sizeof(filter), "devices/dev%03u/ota/#", dev);
+		added = added && mqtt_router_bench_add(filter);
+		snprintf(filter, sizeof(filter), "devices/dev%03u/rpc/+/request", dev);
+		added = added && mqtt_router_bench_add(filter);
+		if(!added)
+		{
+			return false;
+		}
+	}
+	//without the catch-all, otherwise every topic matches at least once
+	for(size_t i = 0; i + 1 < MQTT_ROUTER_BENCH_FLEET_FILTERS; i++)
+	{
+		if(!mqtt_router_bench_add(g_fleet_filters[i]))
+		{
+			return false;
+		}
+	}
+
+	srand(1);
+	for(size_t i = 0; i < MQTT_ROUTER_BENCH_TOPICS; i++)
+	{
+		//some devices have no filters, some topics match none
+		unsigned dev = rand() % (MQTT_ROUTER_BENCH_DEVICES + MQTT_ROUTER_BENCH_DEVICES / 4);
+		switch(rand() % 8)
+		{
+		case 0: snprintf(g_topics[i], MQTT_ROUTER_BENCH_TOPIC_LEN, "devices/dev%03u/cmd/reboot", dev); break;
+		case 1: snprintf(g_topics[i], MQTT_ROUTER_BENCH_TOPIC_LEN, "devices/dev%03u/config", dev); break;
+		case 2: snprintf(g_topics[i], MQTT_ROUTER_BENCH_TOPIC_LEN, "devices/dev%03u/ota/chunk/%u", dev, (unsigned)rand() % 64); break;
+		case 3: snprintf(g_topics[i], MQTT_ROUTER_BENCH_TOPIC_LEN, "devices/dev%03u/rpc/%u/request", dev, (unsigned)rand() % 1000); break;
+		case 4: snprintf(g_topics[i], MQTT_ROUTER_BENCH_TOPIC_LEN, "devices/dev%03u/telemetry", dev); break;
+		case 5: snprintf(g_topics[i], MQTT_ROUTER_BENCH_TOPIC_LEN, "devices/dev%03u/broadcast", dev); break;
+		case 6: snprintf(g_topics[i], MQTT_ROUTER_BENCH_TOPIC_LEN, "fleet/region%u/status", dev % 4); break;
+		default: snprintf(g_topics[i], MQTT_ROUTER_BENCH_TOPIC_LEN, "$aws/things/dev%03u/shadow/update/accepted", dev); break;
+		}
+	}
+
+	if(!mqtt_router_bench_measure("loaded"))
+	{
+		return false;
+	}
+
+	//drop every other device, the trie must give back their levels and keep the shared ones intact
+	for(size_t i = 0; i < MQTT_ROUTER_BENCH_DEVICES * 4; i++)
+	{
+		if((i / 4) % 2 == 1)
+		{
+			if(mqtt_router_remove(g_filters[i].filter, strlen(g_filters[i].filter), NULL) != ESP_OK)
+			{
+				ESP_LOGE(TAG, "mqtt_router_bench_run: %s not found for removal", g_filters[i].filter);
+				return false;
+			}
+			g_filters[i].active = false;
+		}
+	}
+	if(!mqtt_router_bench_add(g_fleet_filters[MQTT_ROUTER_BENCH_FLEET_FILTERS - 1]) || !mqtt_router_bench_measure("half removed, catch-all added"))
+	{
+		return false;
+	}
+
+	mqtt_router_clear();
+	return true;
+}
@@ -0,0 +1,28 @@
+/*
+ * mqtt_router_bench.h
+ *
+ *  Created on: Oct 18, 2026
+ *      Author: hamxa
+ */
+
+#ifndef MAIN_MQTT_ROUTER_BENCH_H_
+#define MAIN_MQTT_ROUTER_BENCH_H_
+
+#include <stdbool.h>
+
+//Devices the benchmark registers filters for, four filters each
+#define MQTT_ROUTER_BENCH_DEVICES		120
+
+//Topic names dispatched per measurement
+#define MQTT_ROUTER_BENCH_TOPICS		20000
+
+/**
+ * @fn bool mqtt_router_bench_run(void)
+ * @brief load the router with hundreds of per-device and fleet filters, check that it matches the same filters as
+ * 			a scan of every filter and compare the time per dispatch of both
+ *
+ * @return true if the router and the scan agreed on every topic
+ */
+bool mqtt_router_bench_run(void);
+
+#endif /* MAIN_MQTT_ROUTER_BENCH_H_ */
@@ -0,0 +1,234 @@
+/*
+ * mqtt_rpc.c
+ *
+ *  Created on: Oct 18, 2026
+ *      Author: hamxa
+ */
+#include <stdbool.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "esp_log.h"
+
+#include "mqtt_rpc.h"
+
+#if !CONFIG_IDF_TARGET_LINUX
+#include "freertos/FreeRTOS.h"
+#include "freertos/queue.h"
+#include "freertos/task.h"
+#include "esp_timer.h"
+
+#include "device_api.h"
+#include "mqtt_agent.h"
+#include "tasks_common.h"
+#endif
+
+static const char TAG[] = "mqtt_rpc";
+
+static mqtt_rpc_stats_t g_stats;
+
+/**
+ * @fn bool mqtt_rpc_id_valid(const char*, size_t)
+ * @brief check that a correlation id can be copied into the reply topic and the JSON reply as it is
+ *
+ */
+static bool mqtt_rpc_id_valid(const char *id, size_t len)
+{
+	for(size_t i = 0; i < len; i++)
+	{
+		char c = id[i];
+		if(!((c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || (c >= '0' && c <= '9') ||
+			 c == '-' || c == '_' || c == '.' || c == ':'))
+		{
+			return false;
+		}
+	}
+	return true;
+}
+
+esp_err_t mqtt_rpc_parse(const char *prefix, const MQTTPublishInfo_t *publish, int64_t now_us, mqtt_rpc_request_t *request)
+{
+	size_t prefix_len = strlen(prefix);
+	const char *method = publish->pTopicName + prefix_len;
+	const char *slash;
+	size_t rest_len;
+	size_t method_len;
+	size_t id_len = 0;
+
+	if(publish->topicNameLength <= prefix_len || memcmp(publish->pTopicName, prefix, prefix_len) != 0)
+	{
+		return ESP_ERR_INVALID_ARG;
+	}
+	rest_len = publish->topicNameLength - prefix_len;
+	slash = memchr(method, '/', rest_len);
+	method_len = slash ? (size_t)(slash - method) : rest_len;
+	if(slash)
+	{
+		id_len = rest_len - method_len - 1;
+		if(id_len == 0 || !mqtt_rpc_id_valid(slash + 1, id_len))
+		{
+			return ESP_ERR_INVALID_ARG;
+		}
+	}
+	if(method_len == 0 || method_len > MQTT_RPC_METHOD_MAX || id_len > MQTT_RPC_ID_MAX ||
+	   publish->payloadLength > MQTT_RPC_PARAMS_MAX)
+	{
+		return ESP_ERR_INVALID_SIZE;
+	}
+
+	memcpy(request->method, method, method_len);
+	request->method[method_len] = '\0';
+	memcpy(request->id, slash ? slash + 1 : "", id_len);
+	request->id[id_len] = '\0';
+	if(publish->payloadLength > 0)
+	{
+		memcpy(request->params, publish->pPayload, publish->payloadLength);
+	}
+	request->params[publish->payloadLength] = '\0';
+	request->params_len = publish->payloadLength;
+	request->received_us = now_us;
+	return ESP_OK;
+}
+
+int mqtt_rpc_reply(const mqtt_rpc_request_t *request, mqtt_rpc_call_t call, int64_t now_us, uint32_t timeout_ms,
+				   char *topic, size_t topic_size, char *payload, size_t size)
+{
+	uint32_t wait_us = now_us > request->received_us ? (uint32_t)(now_us - request->received_us) : 0;
+	esp_err_t err = ESP_ERR_TIMEOUT;
+	size_t len = 0;
+	int header;
+
+	__atomic_fetch_add(&g_stats.requests, 1, __ATOMIC_RELAXED);
+	if(wait_us > __atomic_load_n(&g_stats.wait_us_max, __ATOMIC_RELAXED))
+	{
+		__atomic_store_n(&g_stats.wait_us_max, wait_us, __ATOMIC_RELAXED);
+	}
+
+	//the result is written in place, behind the reply header
+	header = snprintf(payload, size, "{\"id\":\"%s\",\"ok\":true,\"result\":", request->id);
+	if(header < 0 || (size_t)header + sizeof("null}") > size)
+	{
+		return -1;
+	}
+	if(wait_us <= timeout_ms * 1000)
+	{
+		len = size - header - 1;
+		err = call(request->method, request->params, request->params_len, payload + header, &len);
+	}
+	else
+	{
+		__atomic_fetch_add(&g_stats.timeouts, 1, __ATOMIC_RELAXED);
+	}
+
+	if(request->id[0] == '\0')
+	{
+		__atomic_fetch_add(&g_stats.one_way, 1, __ATOMIC_RELAXED);
+		if(err != ESP_OK)
+		{
+			ESP_LOGW(TAG, "command %s failed: %s", request->method, esp_err_to_name(err));
+		}
+		return 0;
+	}
+	if(snprintf(topic, topic_size, DEVICE_TOPICS_RPC_REPLY_PREFIX "%s", request->id) >= (int)topic_size)
+	{
+		return -1;
+	}
+
+	if(err != ESP_OK)
+	{
+		__atomic_fetch_add(&g_stats.errors, 1, __ATOMIC_RELAXED);
+		int printed = snprintf(payload, size, "{\"id\":\"%s\",\"ok\":false,\"error\":\"%s\"}", request->id,
+				esp_err_to_name(err));
+		return printed < 0 || (size_t)printed >= size ? -1 : printed;
+	}
+	if(len == 0)
+	{
+		memcpy(payload + header, "null", 4);
+		len = 4;
+	}
+	payload[header + len] = '}';
+	return header + (int)len + 1;
+}
+
+void mqtt_rpc_get_stats(mqtt_rpc_stats_t *stats)
+{
+	stats->requests = __atomic_load_n(&g_stats.requests, __ATOMIC_RELAXED);
+	stats->one_way = __atomic_load_n(&g_stats.one_way, __ATOMIC_RELAXED);
+	stats->errors = __atomic_load_n(&g_stats.errors, __ATOMIC_RELAXED);
+	stats->timeouts = __atomic_load_n(&g_stats.timeouts, __ATOMIC_RELAXED);
+	stats->dropped = __atomic_load_n(&g_stats.dropped, __ATOMIC_RELAXED);
+	stats->wait_us_max = __atomic_load_n(&g_stats.wait_us_max, __ATOMIC_RELAXED);
+}
+
+#if !CONFIG_IDF_TARGET_LINUX
+static QueueHandle_t g_rpc_queue;
+
+//owned by the RPC task, too large for its stack
+static mqtt_rpc_request_t g_request;
+static char g_reply_topic[MQTT_RPC_REPLY_TOPIC_MAX];
+static char g_reply[MQTT_RPC_REPLY_MAX_LEN];
+
+/**
+ * @fn void mqtt_rpc_task(void*)
+ * @brief run the requests one after the other and publish their replies
+ *
+ */
+static void mqtt_rpc_task(void *pvParameters)
+{
+	for(;;)
+	{
+		if(xQueueReceive(g_rpc_queue, &g_request, portMAX_DELAY) != pdTRUE)
+		{
+			continue;
+		}
+		int len = mqtt_rpc_reply(&g_request, device_api_call, esp_timer_get_time(), CONFIG_MQTT_RPC_TIMEOUT_MS,
+				g_reply_topic, sizeof(g_reply_topic), g_reply, sizeof(g_reply));
+		if(len < 0)
+		{
+			__atomic_fetch_add(&g_stats.dropped, 1, __ATOMIC_RELAXED);
+			ESP_LOGE(TAG, "mqtt_rpc_task: reply to %s does not fit", g_request.method);
+			continue;
+		}
+		if(len == 0)
+		{
+			continue;
+		}
+
+		//QoS0, the caller repeats the call after its own timeout and a reply held for a resend would be stale
+		esp_err_t err = mqtt_agent_publish(g_reply_topic, g_reply, (size_t)len, MQTTQoS0, NULL, NULL,
+				pdMS_TO_TICKS(MQTT_RPC_REPLY_WAIT_MS));
+		if(err != ESP_OK)
+		{
+			__atomic_fetch_add(&g_stats.dropped, 1, __ATOMIC_RELAXED);
+			ESP_LOGW(TAG, "mqtt_rpc_task: reply %s not queued: %s", g_request.id, esp_err_to_name(err));
+		}
+	}
+}
+
+void mqtt_rpc_start(void)
+{
+	if(g_rpc_queue != NULL)
+	{
+		return;
+	}
+	g_rpc_queue = xQueueCreate(MQTT_RPC_QUEUE_LENGTH, sizeof(mqtt_rpc_request_t));
+	xTaskCreatePinnedToCore(&mqtt_rpc_task, "mqtt_rpc", MQTT_RPC_TASK_STACK_SIZE, NULL, MQTT_RPC_TASK_PRIORITY, NULL,
+			MQTT_RPC_TASK_CORE_ID);
+}
+
+void mqtt_rpc_submit(const char *prefix, const MQTTPublishInfo_t *publish)
+{
+	mqtt_rpc_request_t request;
+	esp_err_t err = mqtt_rpc_parse(prefix, publish, esp_timer_get_time(), &request);
+
+	if(err == ESP_OK && (g_rpc_queue == NULL || xQueueSend(g_rpc_queue, &request, 0) != pdTRUE))
+	{
+		err = ESP_ERR_NO_MEM;
+	}
+	if(err != ESP_OK)
+	{
+		__atomic_fetch_add(&g_stats.dropped, 1, __ATOMIC_RELAXED);
+		ESP_LOGW(TAG, "request on %.*s dropped: %s", publish->topicNameLength, publish->pTopicName, esp_err_to_name(err));
+	}
+}
+#endif
@@ -0,0 +1,127 @@
+/*
+ * mqtt_rpc.h
+ *
+ *  Created on: Oct 18, 2026
+ *      Author: hamxa
+ */
+
+#ifndef MAIN_MQTT_RPC_H_
+#define MAIN_MQTT_RPC_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "esp_err.h"
+#include "core_mqtt.h"
+
+#include "device_topics.h"
+
+//Longest method name, the topic level after rpc
+#define MQTT_RPC_METHOD_MAX				24
+
+//Longest correlation id, a UUID fits
+#define MQTT_RPC_ID_MAX					36
+
+//Largest request payload, the parameters of the method
+#define MQTT_RPC_PARAMS_MAX				128
+
+//Largest method result, the device API results fit
+#define MQTT_RPC_RESULT_MAX				1024
+
+//Reply payload: the result wrapped with the correlation id
+#define MQTT_RPC_REPLY_MAX_LEN			(MQTT_RPC_RESULT_MAX + MQTT_RPC_ID_MAX + 32)
+
+//Reply topic: the reply prefix and the correlation id
+#define MQTT_RPC_REPLY_TOPIC_MAX		(sizeof(DEVICE_TOPICS_RPC_REPLY_PREFIX) + MQTT_RPC_ID_MAX)
+
+//Requests waiting for the RPC task, more are answered by nothing and the caller times out
+#define MQTT_RPC_QUEUE_LENGTH			4
+
+//Longest the RPC task waits for room in the agent queue for a reply
+#define MQTT_RPC_REPLY_WAIT_MS			100
+
+/**
+ * Request taken from a publish on devices/<id>/rpc/<method>/<correlation id>. Without a correlation id it is a
+ * one-way command and is not answered
+ */
+typedef struct mqtt_rpc_request
+{
+	char method[MQTT_RPC_METHOD_MAX + 1];
+	char id[MQTT_RPC_ID_MAX + 1];		///> empty for a one-way command
+	char params[MQTT_RPC_PARAMS_MAX + 1];	///> payload of the request, terminated
+	size_t params_len;
+	int64_t received_us;				///> time the publish arrived
+}mqtt_rpc_request_t;
+
+/**
+ * RPC counters since boot
+ */
+typedef struct mqtt_rpc_stats
+{
+	uint32_t requests;			///> requests run or timed out, one-way commands included
+	uint32_t one_way;			///> requests without a correlation id, not answered
+	uint32_t errors;			///> requests answered with an error
+	uint32_t timeouts;			///> requests that waited longer than the timeout, not run
+	uint32_t dropped;			///> malformed requests, and requests or replies that found a full queue
+	uint32_t wait_us_max;		///> longest time from the publish to the start of the method
+}mqtt_rpc_stats_t;
+
+/**
+ * @brief run a method, writes its JSON result to out and its length to len, an empty result is sent as null
+ */
+typedef esp_err_t (*mqtt_rpc_call_t)(const char *method, const char *params, size_t params_len, char *out, size_t *len);
+
+/**
+ * @fn esp_err_t mqtt_rpc_parse(const char*, const MQTTPublishInfo_t*, int64_t, mqtt_rpc_request_t*)
+ * @brief take the method and the correlation id from the topic levels after prefix, and the parameters from the
+ * 			payload. The id must be made of letters, digits, '-', '_', '.' or ':', it is copied into the reply
+ *
+ * @param prefix topic up to the method, with its trailing '/'
+ * @param publish incoming publish
+ * @param now_us current time
+ * @param request output
+ * @return ESP_OK, ESP_ERR_INVALID_ARG if the topic does not match, ESP_ERR_INVALID_SIZE if a part is too long
+ */
+esp_err_t mqtt_rpc_parse(const char *prefix, const MQTTPublishInfo_t *publish, int64_t now_us, mqtt_rpc_request_t *request);
+
+/**
+ * @fn int mqtt_rpc_reply(const mqtt_rpc_request_t*, mqtt_rpc_call_t, int64_t, uint32_t, char*, size_t, char*, size_t)
+ * @brief run a request unless it waited longer than timeout_ms, and build the reply:
+ * 			{"id":"<id>","ok":true,"result":<result>} or {"id":"<id>","ok":false,"error":"<error name>"}
+ *
+ * @param call method table
+ * @param now_us current time
+ * @param timeout_ms longest time from the publish to the start of the method
+ * @param topic output, the reply topic
+ * @param payload output, the reply
+ * @return reply length, 0 for a one-way command, -1 if the buffers are too small
+ */
+int mqtt_rpc_reply(const mqtt_rpc_request_t *request, mqtt_rpc_call_t call, int64_t now_us, uint32_t timeout_ms,
+				   char *topic, size_t topic_size, char *payload, size_t size);
+
+/**
+ * @fn void mqtt_rpc_get_stats(mqtt_rpc_stats_t*)
+ * @brief get the RPC counters
+ *
+ */
+void mqtt_rpc_get_stats(mqtt_rpc_stats_t *stats);
+
+#if !CONFIG_IDF_TARGET_LINUX
+/**
+ * @fn void mqtt_rpc_start(void)
+ * @brief start the task that runs the requests through the device API and publishes the replies at QoS0. Safe to
+ * 			call again
+ *
+ */
+void mqtt_rpc_start(void);
+
+/**
+ * @fn void mqtt_rpc_submit(const char*, const MQTTPublishInfo_t*)
+ * @brief queue the request of an incoming publish for the RPC task, without waiting. Called from the agent task
+ *
+ * @param prefix topic up to the method, with its trailing '/'
+ */
+void mqtt_rpc_submit(const char *prefix, const MQTTPublishInfo_t *publish);
+#endif
+
+#endif /* MAIN_MQTT_RPC_H_ */
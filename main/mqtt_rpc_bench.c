@@ -0,0 +1,450 @@
+/*
+ * mqtt_rpc_bench.c
+ *
+ *  Created on: Oct 18, 2026
+ *      Author: hamxa
+ */
+#include <errno.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "esp_log.h"
+#include "sdkconfig.h"
+
+#include "core_mqtt.h"
+#include "clock.h"
+
+#include "device_topics.h"
+#include "dht11.h"
+#include "mqtt_bench.h"
+#include "mqtt_bench_broker.h"
+#include "mqtt_posix_transport.h"
+#include "mqtt_rpc.h"
+#include "mqtt_rpc_bench.h"
+#include "telemetry_codec.h"
+
+static const char TAG[] = "mqtt_rpc_bench";
+
+static MQTTContext_t g_context;
+static NetworkContext_t g_network;
+static uint8_t g_buffer[CONFIG_MQTT_NETWORK_BUFFER_SIZE];
+static MQTTPubAckInfo_t g_outgoing_records[CONFIG_MQTT_INFLIGHT_WINDOW];
+static MQTTPubAckInfo_t g_incoming_records[1];
+
+//requests taken from the incoming publishes, answered once MQTT_ProcessLoop returned as the RPC task does
+static mqtt_rpc_request_t g_requests[MQTT_RPC_QUEUE_LENGTH];
+static uint32_t g_request_count;
+static uint32_t g_dropped;
+static char g_reply_topic[MQTT_RPC_REPLY_TOPIC_MAX];
+static char g_reply[MQTT_RPC_REPLY_MAX_LEN];
+static uint32_t g_in_flight;
+static bool g_subscribed;
+
+//id of the last reply the broker received, the caller thread waits for it
+static pthread_mutex_t g_reply_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t g_reply_cond = PTHREAD_COND_INITIALIZER;
+static uint32_t g_reply_id;
+static uint32_t g_reply_errors;
+
+//round trip of every answered call of the run, sorted for the percentiles. Written by the caller thread only
+static uint32_t g_rtt_us[CONFIG_MQTT_RPC_BENCH_CALLS];
+static uint32_t g_answered;
+static uint32_t g_timeouts;
+static bool g_calls_done;
+
+/**
+ * @fn int64_t mqtt_rpc_bench_clock_ns(void)
+ * @brief read the monotonic clock in ns
+ *
+ */
+static int64_t mqtt_rpc_bench_clock_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (int64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+/**
+ * @fn esp_err_t mqtt_rpc_bench_call(const char*, const char*, size_t, char*, size_t*)
+ * @brief the sensor operation of the device API, on the simulated DHT11
+ *
+ */
+static esp_err_t mqtt_rpc_bench_call(const char *method, const char *params, size_t params_len, char *out, size_t *len)
+{
+	struct dht11_reading reading;
+	int printed;
+
+	if(strcmp(method, "sensor") != 0)
+	{
+		return ESP_ERR_NOT_FOUND;
+	}
+	reading = DHT11_read();
+	printed = snprintf(out, *len, "{\"status\":\"%s\",\"temp\":\"%d\",\"humidity\":\"%d\"}",
+			reading.status == DHT11_OK ? "OK" : "Error", reading.temperature, reading.humidity);
+	if(printed < 0 || (size_t)printed >= *len)
+	{
+		return ESP_ERR_INVALID_SIZE;
+	}
+	*len = (size_t)printed;
+	return ESP_OK;
+}
+
+/**
+ * @fn void mqtt_rpc_bench_event_callback(MQTTContext_t*, MQTTPacketInfo_t*, MQTTDeserializedInfo_t*)
+ * @brief count the acks and keep the calls for mqtt_rpc_bench_answer
+ *
+ */
+static void mqtt_rpc_bench_event_callback(MQTTContext_t *pContext, MQTTPacketInfo_t *pPacketInfo,
+										  MQTTDeserializedInfo_t *pDeserializedInfo)
+{
+	switch(pPacketInfo->type & 0xf0U)
+	{
+		case MQTT_PACKET_TYPE_PUBACK:
+			g_in_flight--;
+			break;
+
+		case MQTT_PACKET_TYPE_SUBACK:
+			g_subscribed = true;
+			break;
+
+		case MQTT_PACKET_TYPE_PUBLISH:
+			if(g_request_count >= MQTT_RPC_QUEUE_LENGTH ||
+			   mqtt_rpc_parse(DEVICE_TOPICS_RPC_PREFIX, pDeserializedInfo->pPublishInfo,
+							  mqtt_rpc_bench_clock_ns() / 1000, &g_requests[g_request_count]) != ESP_OK)
+			{
+				g_dropped++;
+				break;
+			}
+			g_request_count++;
+			break;
+
+		default:
+			break;
+	}
+}
+
+/**
+ * @fn bool mqtt_rpc_bench_answer(void)
+ * @brief run the calls received and publish their replies at QoS0
+ *
+ */
+static bool mqtt_rpc_bench_answer(void)
+{
+	for(uint32_t i = 0; i < g_request_count; i++)
+	{
+		MQTTPublishInfo_t publish_info = {0};
+		MQTTStatus_t status;
+		int len = mqtt_rpc_reply(&g_requests[i], mqtt_rpc_bench_call, mqtt_rpc_bench_clock_ns() / 1000,
+				CONFIG_MQTT_RPC_TIMEOUT_MS, g_reply_topic, sizeof(g_reply_topic), g_reply, sizeof(g_reply));
+		if(len <= 0)
+		{
+			continue;
+		}
+
+		publish_info.qos = MQTTQoS0;
+		publish_info.pTopicName = g_reply_topic;
+		publish_info.topicNameLength = (uint16_t)strlen(g_reply_topic);
+		publish_info.pPayload = g_reply;
+		publish_info.payloadLength = (size_t)len;
+		status = MQTT_Publish(&g_context, &publish_info, 0);
+		if(status != MQTTSuccess)
+		{
+			ESP_LOGE(TAG, "mqtt_rpc_bench_answer: MQTT_Publish failed, %s", MQTT_Status_strerror(status));
+			return false;
+		}
+	}
+	g_request_count = 0;
+	return true;
+}
+
+/**
+ * @fn void mqtt_rpc_bench_on_publish(const uint8_t*, size_t)
+ * @brief broker thread, pass the id of a reply to the caller thread. Telemetry publishes are ignored
+ *
+ */
+static void mqtt_rpc_bench_on_publish(const uint8_t *payload, size_t len)
+{
+	static const char prefix[] = "{\"id\":\"";
+	static const char ok[] = "\",\"ok\":true";
+	size_t pos = sizeof(prefix) - 1;
+	uint32_t id = 0;
+
+	if(len < pos || memcmp(payload, prefix, pos) != 0)
+	{
+		return;
+	}
+	while(pos < len && payload[pos] >= '0' && payload[pos] <= '9')
+	{
+		id = id * 10 + (payload[pos++] - '0');
+	}
+
+	pthread_mutex_lock(&g_reply_lock);
+	g_reply_id = id;
+	if(len - pos < sizeof(ok) - 1 || memcmp(payload + pos, ok, sizeof(ok) - 1) != 0)
+	{
+		g_reply_errors++;
+	}
+	pthread_cond_broadcast(&g_reply_cond);
+	pthread_mutex_unlock(&g_reply_lock);
+}
+
+/**
+ * @fn void mqtt_rpc_bench_caller*(void*)
+ * @brief the cloud side: send the calls through the broker one at a time and time their replies
+ *
+ */
+static void *mqtt_rpc_bench_caller(void *arg)
+{
+	char topic[sizeof(DEVICE_TOPICS_RPC_PREFIX) + MQTT_RPC_METHOD_MAX + MQTT_RPC_ID_MAX + 1];
+
+	for(uint32_t id = 1; id <= CONFIG_MQTT_RPC_BENCH_CALLS && !__atomic_load_n(&g_calls_done, __ATOMIC_RELAXED); id++)
+	{
+		struct timespec deadline;
+		int64_t start_ns;
+		int rc = 0;
+
+		snprintf(topic, sizeof(topic), DEVICE_TOPICS_RPC_PREFIX "sensor/%lu", (unsigned long)id);
+		clock_gettime(CLOCK_REALTIME, &deadline);
+		deadline.tv_sec += MQTT_RPC_BENCH_CALL_TIMEOUT_MS / 1000;
+		deadline.tv_nsec += (MQTT_RPC_BENCH_CALL_TIMEOUT_MS % 1000) * 1000000L;
+		if(deadline.tv_nsec >= 1000000000L)
+		{
+			deadline.tv_sec++;
+			deadline.tv_nsec -= 1000000000L;
+		}
+
+		start_ns = mqtt_rpc_bench_clock_ns();
+		if(!mqtt_bench_broker_publish(topic, NULL, 0))
+		{
+			ESP_LOGE(TAG, "mqtt_rpc_bench_caller: call %lu not sent", (unsigned long)id);
+			g_timeouts++;
+			continue;
+		}
+		pthread_mutex_lock(&g_reply_lock);
+		while(g_reply_id != id && rc == 0)
+		{
+			rc = pthread_cond_timedwait(&g_reply_cond, &g_reply_lock, &deadline);
+		}
+		pthread_mutex_unlock(&g_reply_lock);
+
+		if(rc == ETIMEDOUT)
+		{
+			g_timeouts++;
+			continue;
+		}
+		g_rtt_us[g_answered++] = (uint32_t)((mqtt_rpc_bench_clock_ns() - start_ns) / 1000);
+	}
+	__atomic_store_n(&g_calls_done, true, __ATOMIC_RELAXED);
+	return NULL;
+}
+
+/**
+ * @fn bool mqtt_rpc_bench_connect(const char*, uint16_t)
+ * @brief open the session and subscribe to the RPC topics, as the device does but without TLS
+ *
+ */
+static bool mqtt_rpc_bench_connect(const char *host, uint16_t port)
+{
+	TransportInterface_t transport = {0};
+	MQTTFixedBuffer_t buffer = {.pBuffer = g_buffer, .size = sizeof(g_buffer)};
+	MQTTConnectInfo_t connect_info = {0};
+	MQTTSubscribeInfo_t subscription = {0};
+	bool session_present = false;
+	uint32_t start_ms;
+	MQTTStatus_t status;
+
+	if(!mqtt_posix_transport_connect(&g_network, host, port))
+	{
+		return false;
+	}
+
+	transport.pNetworkContext = &g_network;
+	transport.send = mqtt_posix_transport_send;
+	transport.recv = mqtt_posix_transport_recv;
+#if CONFIG_MQTT_TRANSPORT_WRITEV
+	//packets gathered into one write, as the device gathers them into one TLS record
+	transport.writev = mqtt_posix_transport_writev;
+#else
+	transport.writev = NULL;
+#endif
+
+	status = MQTT_Init(&g_context, &transport, Clock_GetTimeMs, mqtt_rpc_bench_event_callback, &buffer);
+	if(status == MQTTSuccess)
+	{
+		status = MQTT_InitStatefulQoS(&g_context, g_outgoing_records, CONFIG_MQTT_INFLIGHT_WINDOW,
+									  g_incoming_records, 1);
+	}
+	if(status == MQTTSuccess)
+	{
+		connect_info.cleanSession = true;
+		connect_info.pClientIdentifier = CONFIG_MQTT_CLIENT_IDENTIFIER "-rpc-bench";
+		connect_info.clientIdentifierLength = (uint16_t)strlen(connect_info.pClientIdentifier);
+		connect_info.keepAliveSeconds = 60;
+		status = MQTT_Connect(&g_context, &connect_info, NULL, MQTT_BENCH_ACK_TIMEOUT_MS, &session_present);
+	}
+	if(status == MQTTSuccess)
+	{
+		//QoS0 as on the device, a call is worthless once the caller gave up on it
+		subscription.qos = MQTTQoS0;
+		subscription.pTopicFilter = DEVICE_TOPICS_RPC_FILTER;
+		subscription.topicFilterLength = (uint16_t)strlen(DEVICE_TOPICS_RPC_FILTER);
+		g_subscribed = false;
+		status = MQTT_Subscribe(&g_context, &subscription, 1, MQTT_GetPacketId(&g_context));
+	}
+	start_ms = Clock_GetTimeMs();
+	while(status == MQTTSuccess && !g_subscribed && Clock_GetTimeMs() - start_ms < MQTT_BENCH_ACK_TIMEOUT_MS)
+	{
+		status = MQTT_ProcessLoop(&g_context);
+		if(status == MQTTNeedMoreBytes)
+		{
+			status = MQTTSuccess;
+		}
+	}
+	if(status != MQTTSuccess || !g_subscribed)
+	{
+		ESP_LOGE(TAG, "mqtt_rpc_bench_connect: session not set up, %s", MQTT_Status_strerror(status));
+		mqtt_posix_transport_disconnect(&g_network);
+		return false;
+	}
+	return true;
+}
+
+/**
+ * @fn int mqtt_rpc_bench_compare(const void*, const void*)
+ * @brief qsort order of the round trips
+ *
+ */
+static int mqtt_rpc_bench_compare(const void *a, const void *b)
+{
+	uint32_t x = *(const uint32_t*)a;
+	uint32_t y = *(const uint32_t*)b;
+
+	return (x > y) - (x < y);
+}
+
+/**
+ * @fn uint32_t mqtt_rpc_bench_percentile(uint8_t)
+ * @brief percentile of the sorted round trips
+ *
+ */
+static uint32_t mqtt_rpc_bench_percentile(uint8_t percent)
+{
+	uint32_t rank = (uint32_t)(((uint64_t)g_answered * percent + 99) / 100);
+
+	return g_answered ? g_rtt_us[rank ? rank - 1 : 0] : 0;
+}
+
+/**
+ * @fn bool mqtt_rpc_bench_measure(const char*, uint32_t)
+ * @brief run the device side until the caller thread sent every call, and log the round trips
+ *
+ * @param window QoS1 telemetry publishes kept in flight meanwhile, 0 for an idle session
+ * @return true if every call was answered in time
+ */
+static bool mqtt_rpc_bench_measure(const char *label, uint32_t window)
+{
+	telemetry_sample_t sample = {.t_ms = 0, .temperature = 23, .humidity = 45, .rssi = -60, .status = DHT11_OK};
+	uint8_t payload[TELEMETRY_CODEC_SAMPLE_MAX_LEN];
+	uint32_t publishes = 0;
+	pthread_t caller;
+	uint32_t start_ms;
+	bool ok = true;
+
+	g_answered = 0;
+	g_timeouts = 0;
+	g_reply_errors = 0;
+	g_dropped = 0;
+	g_in_flight = 0;
+	g_calls_done = false;
+	if(pthread_create(&caller, NULL, mqtt_rpc_bench_caller, NULL) != 0)
+	{
+		ESP_LOGE(TAG, "mqtt_rpc_bench_measure: caller thread not started");
+		return false;
+	}
+
+	while(ok && !__atomic_load_n(&g_calls_done, __ATOMIC_RELAXED))
+	{
+		while(g_in_flight < window)
+		{
+			MQTTPublishInfo_t publish_info = {0};
+			int len;
+
+			sample.t_ms = publishes++ * 4000;
+			len = telemetry_codec_encode_sample(TELEMETRY_CODEC_CBOR, &sample, payload, sizeof(payload));
+			publish_info.qos = MQTTQoS1;
+			publish_info.pTopicName = MQTT_BENCH_TOPIC;
+			publish_info.topicNameLength = (uint16_t)strlen(MQTT_BENCH_TOPIC);
+			publish_info.pPayload = payload;
+			publish_info.payloadLength = len > 0 ? (size_t)len : 0;
+			if(MQTT_Publish(&g_context, &publish_info, MQTT_GetPacketId(&g_context)) != MQTTSuccess)
+			{
+				ESP_LOGE(TAG, "mqtt_rpc_bench_measure: telemetry publish failed");
+				ok = false;
+				break;
+			}
+			g_in_flight++;
+		}
+
+		MQTTStatus_t status = MQTT_ProcessLoop(&g_context);
+		if(status != MQTTSuccess && status != MQTTNeedMoreBytes)
+		{
+			ESP_LOGE(TAG, "mqtt_rpc_bench_measure: MQTT_ProcessLoop failed, %s", MQTT_Status_strerror(status));
+			ok = false;
+		}
+		ok = ok && mqtt_rpc_bench_answer();
+	}
+	__atomic_store_n(&g_calls_done, true, __ATOMIC_RELAXED);
+	pthread_join(caller, NULL);
+
+	//the next run starts without telemetry in flight
+	start_ms = Clock_GetTimeMs();
+	while(ok && g_in_flight > 0 && Clock_GetTimeMs() - start_ms < MQTT_BENCH_ACK_TIMEOUT_MS)
+	{
+		MQTTStatus_t status = MQTT_ProcessLoop(&g_context);
+		ok = status == MQTTSuccess || status == MQTTNeedMoreBytes;
+	}
+	ok = ok && g_in_flight == 0;
+
+	qsort(g_rtt_us, g_answered, sizeof(g_rtt_us[0]), mqtt_rpc_bench_compare);
+	ESP_LOGI(TAG, "%s: %lu calls answered, round trip p50 %lu us, p90 %lu us, p99 %lu us, max %lu us, "
+			"%lu timed out, %lu errors, %lu dropped, %lu telemetry publishes", label, (unsigned long)g_answered,
+			(unsigned long)mqtt_rpc_bench_percentile(50), (unsigned long)mqtt_rpc_bench_percentile(90),
+			(unsigned long)mqtt_rpc_bench_percentile(99), (unsigned long)mqtt_rpc_bench_percentile(100),
+			(unsigned long)g_timeouts, (unsigned long)g_reply_errors, (unsigned long)g_dropped,
+			(unsigned long)publishes);
+
+	return ok && g_timeouts == 0 && g_reply_errors == 0 &&
+			mqtt_rpc_bench_percentile(99) < MQTT_RPC_BENCH_TARGET_MS * 1000;
+}
+
+bool mqtt_rpc_bench_run(void)
+{
+	uint16_t port;
+	bool ok;
+
+	//the broker stand-in routes nothing, the calls are injected by the caller thread and the replies caught by the hook
+	mqtt_bench_broker_set_publish_hook(mqtt_rpc_bench_on_publish);
+	if(!mqtt_bench_broker_start(&port))
+	{
+		return false;
+	}
+	ESP_LOGI(TAG, "mqtt_rpc_bench_run: in-process broker on 127.0.0.1:%u, %u calls", port, CONFIG_MQTT_RPC_BENCH_CALLS);
+
+	ok = mqtt_rpc_bench_connect("127.0.0.1", port);
+	if(ok)
+	{
+		//both runs are logged whatever the first one found
+		ok = mqtt_rpc_bench_measure("idle session", 0);
+		ok = mqtt_rpc_bench_measure("QoS1 telemetry window in flight", CONFIG_MQTT_INFLIGHT_WINDOW) && ok;
+		MQTT_Disconnect(&g_context);
+		mqtt_posix_transport_disconnect(&g_network);
+	}
+
+	mqtt_bench_broker_stop();
+	mqtt_bench_broker_set_publish_hook(NULL);
+	return ok;
+}
@@ -0,0 +1,30 @@
+/*
+ * mqtt_rpc_bench.h
+ *
+ *  Created on: Oct 18, 2026
+ *      Author: hamxa
+ */
+
+#ifndef MAIN_MQTT_RPC_BENCH_H_
+#define MAIN_MQTT_RPC_BENCH_H_
+
+#include <stdbool.h>
+
+//Longest the caller waits for a reply before it counts the call as timed out
+#define MQTT_RPC_BENCH_CALL_TIMEOUT_MS	1000
+
+//End-to-end latency the p99 of the calls has to stay under
+#define MQTT_RPC_BENCH_TARGET_MS		100
+
+/**
+ * @fn bool mqtt_rpc_bench_run(void)
+ * @brief start the in-process broker, connect a coreMQTT client that subscribes to the RPC topics and answers the
+ * 			calls as the device does, and send CONFIG_MQTT_RPC_BENCH_CALLS sensor calls through the broker one at a
+ * 			time, on an idle session and with QoS1 telemetry publishes in flight. Logs the round-trip percentiles,
+ * 			from the request leaving the broker to the reply reaching it
+ *
+ * @return true if no call timed out and the p99 stayed under MQTT_RPC_BENCH_TARGET_MS
+ */
+bool mqtt_rpc_bench_run(void);
+
+#endif /* MAIN_MQTT_RPC_BENCH_H_ */
@@ -0,0 +1,494 @@
+/*
+ * mqtt_session_store.c
+ *
+ *  Created on: Oct 18, 2026
+ *      Author: hamxa
+ */
+#include <stddef.h>
+#include <string.h>
+#include <time.h>
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+#include "esp_log.h"
+#include "esp_rom_crc.h"
+
+#include "mqtt_session_store.h"
+
+#if !CONFIG_IDF_TARGET_LINUX
+#include "esp_attr.h"
+#include "esp_timer.h"
+
+#include "app_nvs.h"
+#else
+//no RTC memory on the Linux target, a static journal outlives mqtt_session_store_reset the same way
+#define RTC_NOINIT_ATTR
+#endif
+
+static const char TAG[] = "mqtt_session_store";
+
+/**
+ * A journaled publish, its terminated topic and the payload follow each other in the data area
+ */
+typedef struct mqtt_session_store_entry
+{
+	uint16_t packet_id;			///> 0 when the entry is free
+	uint16_t topic_len;
+	uint16_t payload_len;
+	uint16_t offset;			///> of the topic in the data area
+	bool retain;
+	uint32_t crc;				///> of the fields above and the data, a reset during an update fails it
+}mqtt_session_store_entry_t;
+
+/**
+ * Journal in RTC memory, survives software, panic and watchdog resets. The same bytes are the NVS copy
+ */
+typedef struct mqtt_session_store_journal
+{
+	uint32_t magic;
+	uint32_t session_present;
+	mqtt_session_store_entry_t entries[MQTT_SESSION_STORE_MAX_PUBLISHES];
+	uint8_t data[MQTT_SESSION_STORE_DATA_SIZE];
+}mqtt_session_store_journal_t;
+
+//a build with another layout does not take over the journal
+#define MQTT_SESSION_STORE_MAGIC	(0x4d530000u | (uint32_t)sizeof(mqtt_session_store_journal_t))
+
+static RTC_NOINIT_ATTR mqtt_session_store_journal_t g_journal;
+
+//the agent task updates the journal, the flush may run from another task. A mutex rather than a critical section,
+//a compaction moves up to the whole data area
+static SemaphoreHandle_t g_journal_mutex = NULL;
+
+//one flush at a time, g_copy is its staging buffer
+static SemaphoreHandle_t g_flush_mutex = NULL;
+static mqtt_session_store_journal_t g_copy;
+
+//end of the data of the newest publish, new data is appended here
+static uint16_t g_used;
+
+//the journal changed since the NVS copy was written
+static bool g_dirty;
+
+static int64_t g_restored_us;
+static mqtt_session_store_stats_t g_stats;
+
+#if CONFIG_IDF_TARGET_LINUX
+//no NVS on the Linux target, the copy is kept in RAM across mqtt_session_store_reset
+static mqtt_session_store_journal_t g_nvs_copy;
+static bool g_nvs_saved;
+#endif
+
+/**
+ * @fn int64_t mqtt_session_store_time_us(void)
+ * @brief time since boot
+ *
+ */
+static int64_t mqtt_session_store_time_us(void)
+{
+#if CONFIG_IDF_TARGET_LINUX
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (int64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+#else
+	return esp_timer_get_time();
+#endif
+}
+
+/**
+ * @fn esp_err_t mqtt_session_store_nvs_load(mqtt_session_store_journal_t*, size_t*)
+ * @brief load the NVS copy of the journal
+ *
+ */
+static esp_err_t mqtt_session_store_nvs_load(mqtt_session_store_journal_t *journal, size_t *len)
+{
+#if CONFIG_IDF_TARGET_LINUX
+	if(!g_nvs_saved)
+	{
+		return ESP_ERR_NOT_FOUND;
+	}
+	memcpy(journal, &g_nvs_copy, sizeof(*journal));
+	*len = sizeof(*journal);
+	return ESP_OK;
+#else
+	return app_nvs_load_mqtt_session(journal, len);
+#endif
+}
+
+/**
+ * @fn esp_err_t mqtt_session_store_nvs_save(const mqtt_session_store_journal_t*)
+ * @brief write the NVS copy of the journal
+ *
+ */
+static esp_err_t mqtt_session_store_nvs_save(const mqtt_session_store_journal_t *journal)
+{
+#if CONFIG_IDF_TARGET_LINUX
+	memcpy(&g_nvs_copy, journal, sizeof(g_nvs_copy));
+	g_nvs_saved = true;
+	return ESP_OK;
+#else
+	return app_nvs_save_mqtt_session(journal, sizeof(*journal));
+#endif
+}
+
+/**
+ * @fn esp_err_t mqtt_session_store_nvs_clear(void)
+ * @brief erase the NVS copy of the journal
+ *
+ */
+static esp_err_t mqtt_session_store_nvs_clear(void)
+{
+#if CONFIG_IDF_TARGET_LINUX
+	g_nvs_saved = false;
+	return ESP_OK;
+#else
+	return app_nvs_clear_mqtt_session();
+#endif
+}
+
+/**
+ * @fn uint32_t mqtt_session_store_size(const mqtt_session_store_entry_t*)
+ * @brief data bytes of an entry
+ *
+ */
+static uint32_t mqtt_session_store_size(const mqtt_session_store_entry_t *entry)
+{
+	return (uint32_t)entry->topic_len + 1 + entry->payload_len;
+}
+
+/**
+ * @fn uint32_t mqtt_session_store_crc(const mqtt_session_store_entry_t*)
+ * @brief CRC of an entry and its data
+ *
+ */
+static uint32_t mqtt_session_store_crc(const mqtt_session_store_entry_t *entry)
+{
+	uint8_t retain = entry->retain ? 1 : 0;
+	//the 16-bit fields have no padding between them, the padding after retain is left out, its bytes are undefined
+	uint32_t crc = esp_rom_crc32_le(0, (const uint8_t*)entry, offsetof(mqtt_session_store_entry_t, retain));
+
+	crc = esp_rom_crc32_le(crc, &retain, sizeof(retain));
+
+	return esp_rom_crc32_le(crc, &g_journal.data[entry->offset], mqtt_session_store_size(entry));
+}
+
+/**
+ * @fn void mqtt_session_store_compact(void)
+ * @brief move the data of the live entries down to the start of the data area, oldest first. A reset in the
+ * 			middle loses the publish being moved
+ *
+ */
+static void mqtt_session_store_compact(void)
+{
+	uint16_t end = 0;
+
+	for(;;)
+	{
+		mqtt_session_store_entry_t *next = NULL;
+		for(int i = 0; i < MQTT_SESSION_STORE_MAX_PUBLISHES; i++)
+		{
+			mqtt_session_store_entry_t *entry = &g_journal.entries[i];
+			//entries already moved lie below end, the rest above it
+			if(entry->packet_id != 0 && entry->offset >= end && (next == NULL || entry->offset < next->offset))
+			{
+				next = entry;
+			}
+		}
+		if(next == NULL)
+		{
+			break;
+		}
+		uint16_t len = (uint16_t)mqtt_session_store_size(next);
+		if(next->offset != end)
+		{
+			memmove(&g_journal.data[end], &g_journal.data[next->offset], len);
+			next->offset = end;
+			next->crc = mqtt_session_store_crc(next);
+		}
+		end += len;
+	}
+	g_used = end;
+	g_stats.compactions++;
+}
+
+bool mqtt_session_store_restore(void)
+{
+	size_t len = sizeof(g_copy);
+	esp_err_t err = mqtt_session_store_nvs_load(&g_copy, &len);
+	const char *source = "RTC memory";
+
+	if(g_journal.magic != MQTT_SESSION_STORE_MAGIC)
+	{
+		if(err == ESP_OK && len == sizeof(g_copy) && g_copy.magic == MQTT_SESSION_STORE_MAGIC)
+		{
+			memcpy(&g_journal, &g_copy, sizeof(g_journal));
+			source = "NVS";
+		}
+		else
+		{
+			//power-on reset, nothing was kept
+			memset(&g_journal, 0, sizeof(g_journal));
+			g_journal.magic = MQTT_SESSION_STORE_MAGIC;
+			source = NULL;
+		}
+	}
+
+	g_used = 0;
+	for(int i = 0; i < MQTT_SESSION_STORE_MAX_PUBLISHES; i++)
+	{
+		mqtt_session_store_entry_t *entry = &g_journal.entries[i];
+		if(entry->packet_id == 0)
+		{
+			continue;
+		}
+		uint32_t end = entry->offset + mqtt_session_store_size(entry);
+		if(end > MQTT_SESSION_STORE_DATA_SIZE || entry->topic_len == 0 || entry->crc != mqtt_session_store_crc(entry))
+		{
+			entry->packet_id = 0;
+			g_stats.corrupt++;
+			continue;
+		}
+		if(end > g_used)
+		{
+			g_used = (uint16_t)end;
+		}
+		g_stats.restored++;
+	}
+
+	//the copy was taken over, an outdated one must not come back after a later power loss
+	if(err == ESP_OK && mqtt_session_store_nvs_clear() == ESP_OK)
+	{
+		g_stats.flash_writes++;
+	}
+	g_dirty = g_stats.restored > 0 || g_journal.session_present;
+	g_restored_us = mqtt_session_store_time_us();
+	if(g_journal_mutex == NULL)
+	{
+		g_journal_mutex = xSemaphoreCreateMutex();
+		g_flush_mutex = xSemaphoreCreateMutex();
+	}
+
+	if(source)
+	{
+		ESP_LOGI(TAG, "mqtt_session_store_restore: %lu publishes from %s, %lu corrupt, broker session %s",
+				(unsigned long)g_stats.restored, source, (unsigned long)g_stats.corrupt,
+				g_journal.session_present ? "present" : "absent");
+	}
+	return g_journal.session_present != 0;
+}
+
+void mqtt_session_store_foreach(mqtt_session_store_visit_t visit, void *ctx)
+{
+	uint16_t end = 0;
+
+	//data is appended and compacted in send order, so the offsets give the order
+	for(;;)
+	{
+		const mqtt_session_store_entry_t *next = NULL;
+		for(int i = 0; i < MQTT_SESSION_STORE_MAX_PUBLISHES; i++)
+		{
+			const mqtt_session_store_entry_t *entry = &g_journal.entries[i];
+			if(entry->packet_id != 0 && entry->offset >= end && (next == NULL || entry->offset < next->offset))
+			{
+				next = entry;
+			}
+		}
+		if(next == NULL)
+		{
+			return;
+		}
+		visit(ctx, next->packet_id, (const char*)&g_journal.data[next->offset], next->topic_len,
+			  &g_journal.data[next->offset + next->topic_len + 1], next->payload_len, next->retain);
+		end = (uint16_t)(next->offset + mqtt_session_store_size(next));
+	}
+}
+
+void mqtt_session_store_set_session(bool present)
+{
+	xSemaphoreTake(g_journal_mutex, portMAX_DELAY);
+	if(g_journal.session_present != present)
+	{
+		g_journal.session_present = present;
+		g_dirty = true;
+	}
+	xSemaphoreGive(g_journal_mutex);
+}
+
+esp_err_t mqtt_session_store_add(uint16_t packet_id, const char *topic, uint16_t topic_len, const void *payload, size_t len,
+								 bool retain)
+{
+	size_t need = (size_t)topic_len + 1 + len;
+	mqtt_session_store_entry_t *entry = NULL;
+	esp_err_t err = ESP_OK;
+
+	xSemaphoreTake(g_journal_mutex, portMAX_DELAY);
+	if(packet_id == 0 || topic_len == 0 || need > MQTT_SESSION_STORE_DATA_SIZE)
+	{
+		err = ESP_ERR_INVALID_SIZE;
+	}
+	else
+	{
+		for(int i = 0; i < MQTT_SESSION_STORE_MAX_PUBLISHES && entry == NULL; i++)
+		{
+			if(g_journal.entries[i].packet_id == 0)
+			{
+				entry = &g_journal.entries[i];
+			}
+		}
+		if(entry && g_used + need > MQTT_SESSION_STORE_DATA_SIZE)
+		{
+			mqtt_session_store_compact();
+		}
+		if(entry == NULL || g_used + need > MQTT_SESSION_STORE_DATA_SIZE)
+		{
+			err = ESP_ERR_NO_MEM;
+		}
+	}
+
+	if(err == ESP_OK)
+	{
+		memcpy(&g_journal.data[g_used], topic, topic_len);
+		g_journal.data[g_used + topic_len] = '\0';
+		memcpy(&g_journal.data[g_used + topic_len + 1], payload, len);
+		entry->topic_len = topic_len;
+		entry->payload_len = (uint16_t)len;
+		entry->offset = g_used;
+		entry->retain = retain;
+		entry->packet_id = packet_id;
+		entry->crc = mqtt_session_store_crc(entry);
+		g_used += (uint16_t)need;
+		g_dirty = true;
+		g_stats.journaled++;
+	}
+	else
+	{
+		g_stats.skipped++;
+	}
+	xSemaphoreGive(g_journal_mutex);
+	return err;
+}
+
+void mqtt_session_store_remove(uint16_t packet_id)
+{
+	bool empty = true;
+
+	if(packet_id == 0)
+	{
+		return;
+	}
+	xSemaphoreTake(g_journal_mutex, portMAX_DELAY);
+	for(int i = 0; i < MQTT_SESSION_STORE_MAX_PUBLISHES; i++)
+	{
+		mqtt_session_store_entry_t *entry = &g_journal.entries[i];
+		if(entry->packet_id == packet_id)
+		{
+			entry->packet_id = 0;
+			g_dirty = true;
+		}
+		else if(entry->packet_id != 0)
+		{
+			empty = false;
+		}
+	}
+	//PUBACKs come in send order, so the data area empties out without a compaction
+	if(empty)
+	{
+		g_used = 0;
+	}
+	xSemaphoreGive(g_journal_mutex);
+}
+
+void mqtt_session_store_clear(void)
+{
+	xSemaphoreTake(g_journal_mutex, portMAX_DELAY);
+	for(int i = 0; i < MQTT_SESSION_STORE_MAX_PUBLISHES; i++)
+	{
+		g_journal.entries[i].packet_id = 0;
+	}
+	g_used = 0;
+	g_dirty = true;
+	xSemaphoreGive(g_journal_mutex);
+}
+
+esp_err_t mqtt_session_store_flush(void)
+{
+	esp_err_t err = ESP_OK;
+	bool dirty;
+
+	//nothing to copy before the journal was taken over after boot
+	if(g_flush_mutex == NULL)
+	{
+		return ESP_OK;
+	}
+	xSemaphoreTake(g_flush_mutex, portMAX_DELAY);
+	xSemaphoreTake(g_journal_mutex, portMAX_DELAY);
+	dirty = g_dirty;
+	if(dirty)
+	{
+		memcpy(&g_copy, &g_journal, sizeof(g_copy));
+		g_dirty = false;
+	}
+	xSemaphoreGive(g_journal_mutex);
+
+	if(dirty)
+	{
+		err = mqtt_session_store_nvs_save(&g_copy);
+		xSemaphoreTake(g_journal_mutex, portMAX_DELAY);
+		if(err == ESP_OK)
+		{
+			g_stats.flash_writes++;
+		}
+		else
+		{
+			g_dirty = true;
+		}
+		xSemaphoreGive(g_journal_mutex);
+	}
+	xSemaphoreGive(g_flush_mutex);
+	return err;
+}
+
+void mqtt_session_store_recovered(void)
+{
+	int64_t now_us = mqtt_session_store_time_us();
+
+	if(g_journal_mutex == NULL || g_stats.recovery_ms != 0 || g_stats.restored == 0)
+	{
+		return;
+	}
+	xSemaphoreTake(g_journal_mutex, portMAX_DELAY);
+	g_stats.recovery_ms = (uint32_t)(now_us / 1000);
+	xSemaphoreGive(g_journal_mutex);
+	ESP_LOGI(TAG, "mqtt_session_store_recovered: %lu publishes resent %lu ms after boot, %lu ms after the restore",
+			(unsigned long)g_stats.restored, (unsigned long)g_stats.recovery_ms,
+			(unsigned long)((now_us - g_restored_us) / 1000));
+}
+
+void mqtt_session_store_get_stats(mqtt_session_store_stats_t *stats)
+{
+	//no counters before the journal was taken over after boot
+	if(g_journal_mutex == NULL)
+	{
+		*stats = (mqtt_session_store_stats_t){0};
+		return;
+	}
+	xSemaphoreTake(g_journal_mutex, portMAX_DELAY);
+	*stats = g_stats;
+	xSemaphoreGive(g_journal_mutex);
+}
+
+#if CONFIG_IDF_TARGET_LINUX
+void mqtt_session_store_reset(bool power_loss)
+{
+	//what a reset clears, the journal itself only goes with the RTC memory
+	g_used = 0;
+	g_dirty = false;
+	g_restored_us = 0;
+	g_stats = (mqtt_session_store_stats_t){0};
+	if(power_loss)
+	{
+		memset(&g_journal, 0, sizeof(g_journal));
+	}
+}
+#endif
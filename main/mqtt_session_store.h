@@ -0,0 +1,133 @@
+/*
+ * mqtt_session_store.h
+ *
+ *  Created on: Oct 18, 2026
+ *      Author: hamxa
+ */
+
+#ifndef MAIN_MQTT_SESSION_STORE_H_
+#define MAIN_MQTT_SESSION_STORE_H_
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "esp_err.h"
+#include "sdkconfig.h"
+
+//Publishes the journal holds, the largest MQTT_INFLIGHT_WINDOW
+#define MQTT_SESSION_STORE_MAX_PUBLISHES	32
+
+//Topic, terminator and payload bytes the journal holds, publishes that do not fit are not kept across a reset
+#define MQTT_SESSION_STORE_DATA_SIZE		2048
+
+/**
+ * Session store counters since boot
+ */
+typedef struct mqtt_session_store_stats
+{
+	uint32_t journaled;			///> publishes added to the journal
+	uint32_t skipped;			///> publishes that did not fit, lost on a reset
+	uint32_t compactions;		///> data moved down to make room at the end
+	uint32_t flash_writes;		///> NVS blob writes and erases of the journal copy
+	uint32_t restored;			///> publishes found in the journal after boot
+	uint32_t corrupt;			///> entries dropped after boot because their CRC did not match
+	uint32_t recovery_ms;		///> boot to the resend of the restored publishes, 0 until then
+}mqtt_session_store_stats_t;
+
+/**
+ * @brief called for every publish in the journal, oldest first
+ *
+ * @param ctx context given to mqtt_session_store_foreach
+ * @param packet_id packet identifier the publish was sent with
+ * @param topic topic of the publish, terminated
+ * @param topic_len topic length
+ * @param payload payload of the publish, only valid during the call
+ * @param len payload length
+ * @param retain retain flag of the publish
+ */
+typedef void (*mqtt_session_store_visit_t)(void *ctx, uint16_t packet_id, const char *topic, uint16_t topic_len,
+										   const uint8_t *payload, size_t len, bool retain);
+
+/**
+ * @fn bool mqtt_session_store_restore(void)
+ * @brief take over the journal left in RTC memory by the last reset, or the NVS copy after a power loss or a
+ * 			firmware update. Call once after boot, before any other call of the agent task
+ *
+ * @return true if the broker held a session for the client before the reset
+ */
+bool mqtt_session_store_restore(void);
+
+/**
+ * @fn void mqtt_session_store_foreach(mqtt_session_store_visit_t, void*)
+ * @brief visit the journaled publishes in the order they were sent
+ *
+ */
+void mqtt_session_store_foreach(mqtt_session_store_visit_t visit, void *ctx);
+
+/**
+ * @fn void mqtt_session_store_set_session(bool)
+ * @brief record whether the broker holds a session, the next boot connects without a clean session if so
+ *
+ */
+void mqtt_session_store_set_session(bool present);
+
+/**
+ * @fn esp_err_t mqtt_session_store_add(uint16_t, const char*, uint16_t, const void*, size_t, bool)
+ * @brief journal a QoS1 publish before it is sent, it stays until mqtt_session_store_remove
+ *
+ * @return ESP_OK, ESP_ERR_INVALID_SIZE if it can never fit, ESP_ERR_NO_MEM while the journal is full
+ */
+esp_err_t mqtt_session_store_add(uint16_t packet_id, const char *topic, uint16_t topic_len, const void *payload, size_t len,
+								 bool retain);
+
+/**
+ * @fn void mqtt_session_store_remove(uint16_t)
+ * @brief drop a publish once it was acked or failed
+ *
+ */
+void mqtt_session_store_remove(uint16_t packet_id);
+
+/**
+ * @fn void mqtt_session_store_clear(void)
+ * @brief drop every publish, the broker started a clean session
+ *
+ */
+void mqtt_session_store_clear(void);
+
+/**
+ * @fn esp_err_t mqtt_session_store_flush(void)
+ * @brief copy the journal to NVS if it changed since the last copy, one blob write whatever the number of
+ * 			publishes. Safe from any task, called before planned resets
+ *
+ * @return ESP_OK, or the NVS error
+ */
+esp_err_t mqtt_session_store_flush(void);
+
+/**
+ * @fn void mqtt_session_store_recovered(void)
+ * @brief note that the restored publishes were resent, the first time after boot is kept as the recovery time
+ *
+ */
+void mqtt_session_store_recovered(void);
+
+/**
+ * @fn void mqtt_session_store_get_stats(mqtt_session_store_stats_t*)
+ * @brief get the session store counters
+ *
+ * @param stats output counters
+ */
+void mqtt_session_store_get_stats(mqtt_session_store_stats_t *stats);
+
+#if CONFIG_IDF_TARGET_LINUX
+/**
+ * @fn void mqtt_session_store_reset(bool)
+ * @brief simulate a reset, what only lives in RAM is lost and mqtt_session_store_restore is called again as after
+ * 			boot
+ *
+ * @param power_loss the journal in RTC memory is lost too, only the NVS copy is left
+ */
+void mqtt_session_store_reset(bool power_loss);
+#endif
+
+#endif /* MAIN_MQTT_SESSION_STORE_H_ */
@@ -0,0 +1,341 @@
+/*
+ * mqtt_session_store_bench.c
+ *
+ *  Created on: Oct 19, 2026
+ *      Author: hamxa
+ */
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+
+#include "esp_log.h"
+
+#include "mqtt_session_store.h"
+#include "mqtt_session_store_bench.h"
+
+static const char TAG[] = "mqtt_session_store_bench";
+
+/**
+ * A publish the journal should hold
+ */
+typedef struct mqtt_session_store_bench_entry
+{
+	uint16_t packet_id;
+	uint16_t topic_len;
+	uint16_t len;
+	bool retain;
+	char topic[MQTT_SESSION_STORE_BENCH_TOPIC_LEN + 1];
+	uint8_t payload[MQTT_SESSION_STORE_BENCH_PAYLOAD];
+}mqtt_session_store_bench_entry_t;
+
+/**
+ * The publishes the journal should hold, in send order
+ */
+typedef struct mqtt_session_store_bench_model
+{
+	mqtt_session_store_bench_entry_t entries[MQTT_SESSION_STORE_MAX_PUBLISHES];
+	uint32_t count;
+	bool session_present;
+}mqtt_session_store_bench_model_t;
+
+/**
+ * Progress of mqtt_session_store_foreach through the model
+ */
+typedef struct mqtt_session_store_bench_visit
+{
+	const mqtt_session_store_bench_model_t *model;
+	uint32_t visited;
+	uint32_t mismatches;
+}mqtt_session_store_bench_visit_t;
+
+//the journal as it is, and as the last flush left it in NVS
+static mqtt_session_store_bench_model_t g_model;
+static mqtt_session_store_bench_model_t g_nvs;
+
+static uint8_t g_oversize[MQTT_SESSION_STORE_BENCH_OVERSIZE];
+
+/**
+ * @fn int64_t mqtt_session_store_bench_now_ns(void)
+ * @brief monotonic time
+ *
+ */
+static int64_t mqtt_session_store_bench_now_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (int64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+/**
+ * @fn uint32_t mqtt_session_store_bench_random(uint32_t*)
+ * @brief xorshift32, the same publishes on every run
+ *
+ */
+static uint32_t mqtt_session_store_bench_random(uint32_t *state)
+{
+	uint32_t x = *state;
+
+	x ^= x << 13;
+	x ^= x >> 17;
+	x ^= x << 5;
+	*state = x;
+	return x;
+}
+
+/**
+ * @fn uint32_t mqtt_session_store_bench_used(void)
+ * @brief data bytes of the publishes the journal should hold
+ *
+ */
+static uint32_t mqtt_session_store_bench_used(void)
+{
+	uint32_t used = 0;
+
+	for(uint32_t i = 0; i < g_model.count; i++)
+	{
+		used += (uint32_t)g_model.entries[i].topic_len + 1 + g_model.entries[i].len;
+	}
+	return used;
+}
+
+/**
+ * @fn void mqtt_session_store_bench_visit(void*, uint16_t, const char*, uint16_t, const uint8_t*, size_t, bool)
+ * @brief compare a restored publish with the next one of the model, the #mqtt_session_store_visit_t
+ *
+ */
+static void mqtt_session_store_bench_visit(void *ctx, uint16_t packet_id, const char *topic, uint16_t topic_len,
+										   const uint8_t *payload, size_t len, bool retain)
+{
+	mqtt_session_store_bench_visit_t *visit = ctx;
+
+	if(visit->visited >= visit->model->count)
+	{
+		visit->mismatches++;
+		return;
+	}
+	const mqtt_session_store_bench_entry_t *entry = &visit->model->entries[visit->visited++];
+	if(entry->packet_id != packet_id || entry->topic_len != topic_len ||
+	   entry->len != len || entry->retain != retain || topic[topic_len] != '\0' ||
+	   memcmp(entry->topic, topic, topic_len) != 0 || memcmp(entry->payload, payload, len) != 0)
+	{
+		visit->mismatches++;
+	}
+}
+
+/**
+ * @fn bool mqtt_session_store_bench_add(uint32_t*, uint16_t, int64_t*)
+ * @brief journal a random publish, and check the result against the free entries and data of the model
+ *
+ * @param elapsed_ns time of the add
+ */
+static bool mqtt_session_store_bench_add(uint32_t *seed, uint16_t packet_id, int64_t *elapsed_ns)
+{
+	mqtt_session_store_bench_entry_t entry = {
+			.packet_id = packet_id,
+			.topic_len = (uint16_t)(8 + mqtt_session_store_bench_random(seed) % (MQTT_SESSION_STORE_BENCH_TOPIC_LEN - 7)),
+			.len = (uint16_t)(mqtt_session_store_bench_random(seed) % (MQTT_SESSION_STORE_BENCH_PAYLOAD + 1)),
+			.retain = (mqtt_session_store_bench_random(seed) & 7) == 0,
+	};
+	bool oversize = mqtt_session_store_bench_random(seed) % 100 == 0;
+	esp_err_t expected = ESP_OK;
+
+	for(uint16_t i = 0; i < entry.topic_len; i++)
+	{
+		entry.topic[i] = (char)('a' + (packet_id + i) % 26);
+	}
+	for(uint16_t i = 0; i < entry.len; i++)
+	{
+		entry.payload[i] = (uint8_t)mqtt_session_store_bench_random(seed);
+	}
+
+	size_t len = oversize ? sizeof(g_oversize) : entry.len;
+	size_t need = (size_t)entry.topic_len + 1 + len;
+	if(need > MQTT_SESSION_STORE_DATA_SIZE)
+	{
+		expected = ESP_ERR_INVALID_SIZE;
+	}
+	//a compaction leaves exactly the data of the live publishes, anything that fits next to them goes in
+	else if(g_model.count == MQTT_SESSION_STORE_MAX_PUBLISHES ||
+			mqtt_session_store_bench_used() + need > MQTT_SESSION_STORE_DATA_SIZE)
+	{
+		expected = ESP_ERR_NO_MEM;
+	}
+
+	int64_t start = mqtt_session_store_bench_now_ns();
+	esp_err_t err = mqtt_session_store_add(packet_id, entry.topic, entry.topic_len, oversize ? g_oversize : entry.payload,
+										   len, entry.retain);
+	*elapsed_ns = mqtt_session_store_bench_now_ns() - start;
+
+	if(err == ESP_OK && expected == ESP_OK)
+	{
+		g_model.entries[g_model.count++] = entry;
+	}
+	return err == expected;
+}
+
+/**
+ * @fn void mqtt_session_store_bench_remove(uint32_t, int64_t*)
+ * @brief drop the publish at an index of the model, as its PUBACK does
+ *
+ */
+static void mqtt_session_store_bench_remove(uint32_t index, int64_t *elapsed_ns)
+{
+	int64_t start = mqtt_session_store_bench_now_ns();
+	mqtt_session_store_remove(g_model.entries[index].packet_id);
+	*elapsed_ns += mqtt_session_store_bench_now_ns() - start;
+
+	memmove(&g_model.entries[index], &g_model.entries[index + 1], (g_model.count - index - 1) * sizeof(g_model.entries[0]));
+	g_model.count--;
+}
+
+/**
+ * @fn bool mqtt_session_store_bench_restore(bool, int64_t*)
+ * @brief take the journal over after a reset and visit it as the agent task resends it
+ *
+ * @param power_loss the journal in RTC memory is lost, the publishes of the last flush come back from NVS
+ */
+static bool mqtt_session_store_bench_restore(bool power_loss, int64_t *elapsed_ns)
+{
+	mqtt_session_store_bench_visit_t visit = {0};
+	mqtt_session_store_stats_t stats;
+
+	if(power_loss)
+	{
+		g_model = g_nvs;
+	}
+	visit.model = &g_model;
+
+	mqtt_session_store_reset(power_loss);
+	int64_t start = mqtt_session_store_bench_now_ns();
+	bool session_present = mqtt_session_store_restore();
+	mqtt_session_store_foreach(mqtt_session_store_bench_visit, &visit);
+	*elapsed_ns = mqtt_session_store_bench_now_ns() - start;
+
+	//the copy is cleared once taken over
+	g_nvs = (mqtt_session_store_bench_model_t){0};
+	mqtt_session_store_get_stats(&stats);
+	return session_present == g_model.session_present && visit.visited == g_model.count && visit.mismatches == 0 &&
+			stats.restored == g_model.count && stats.corrupt == 0;
+}
+
+bool mqtt_session_store_bench_run(void)
+{
+	static const char *const kinds[] = {"software reset", "power loss", "reset into a new image"};
+	uint32_t seed = 1;
+	uint32_t adds = 0, rejected = 0, removes = 0, failures = 0, compactions = 0;
+	uint32_t restored = 0, resets = 0;
+	uint16_t packet_id = 0;
+	int64_t add_ns = 0, add_max_ns = 0, remove_ns = 0, restore_max_ns = 0, restore_ns = 0;
+	mqtt_session_store_stats_t stats;
+
+	//start from a power-on reset whatever ran before
+	g_model = (mqtt_session_store_bench_model_t){0};
+	g_nvs = g_model;
+	mqtt_session_store_reset(true);
+	mqtt_session_store_restore();
+	memset(g_oversize, 0x5a, sizeof(g_oversize));
+
+	while(adds < MQTT_SESSION_STORE_BENCH_ADDS)
+	{
+		uint32_t r = mqtt_session_store_bench_random(&seed) % 1000;
+
+		if(r < 490)
+		{
+			int64_t elapsed_ns;
+			//packet ids wrap and skip 0, the ones still awaiting a PUBACK are never reused
+			bool used;
+			do
+			{
+				packet_id = packet_id == UINT16_MAX ? 1 : packet_id + 1;
+				used = false;
+				for(uint32_t i = 0; i < g_model.count; i++)
+				{
+					used = used || g_model.entries[i].packet_id == packet_id;
+				}
+			}while(used);
+
+			uint32_t count = g_model.count;
+			if(!mqtt_session_store_bench_add(&seed, packet_id, &elapsed_ns))
+			{
+				failures++;
+			}
+			adds++;
+			rejected += g_model.count == count;
+			add_ns += elapsed_ns;
+			add_max_ns = elapsed_ns > add_max_ns ? elapsed_ns : add_max_ns;
+		}
+		else if(r < 985)
+		{
+			if(g_model.count > 0)
+			{
+				//PUBACKs come in send order, a resend after a reconnect may be acked out of it
+				uint32_t index = (mqtt_session_store_bench_random(&seed) % 10) == 0 ?
+						mqtt_session_store_bench_random(&seed) % g_model.count : 0;
+				mqtt_session_store_bench_remove(index, &remove_ns);
+				removes++;
+			}
+		}
+		else if(r < 995)
+		{
+			if(mqtt_session_store_flush() == ESP_OK)
+			{
+				g_nvs = g_model;
+			}
+			else
+			{
+				failures++;
+			}
+		}
+		else if(r < 998)
+		{
+			g_model.session_present = !g_model.session_present;
+			mqtt_session_store_set_session(g_model.session_present);
+		}
+		else
+		{
+			//the broker started a clean session
+			mqtt_session_store_clear();
+			g_model.count = 0;
+		}
+
+		if(adds * MQTT_SESSION_STORE_BENCH_RESETS / MQTT_SESSION_STORE_BENCH_ADDS > resets)
+		{
+			int64_t elapsed_ns;
+			uint32_t kind = resets % 3;
+
+			mqtt_session_store_get_stats(&stats);
+			compactions += stats.compactions;
+
+			//the OTA paths flush the journal before the reset, the new image takes the NVS copy over
+			if(kind == 2 && mqtt_session_store_flush() == ESP_OK)
+			{
+				g_nvs = g_model;
+			}
+			bool ok = mqtt_session_store_bench_restore(kind != 0, &elapsed_ns);
+			failures += !ok;
+			restored += g_model.count;
+			restore_ns += elapsed_ns;
+			restore_max_ns = elapsed_ns > restore_max_ns ? elapsed_ns : restore_max_ns;
+			ESP_LOGI(TAG, "%s: %s, %lu publishes restored in %lld us", kinds[kind], ok ? "PASS" : "FAIL",
+					(unsigned long)g_model.count, (long long)(elapsed_ns / 1000));
+			resets++;
+		}
+	}
+	mqtt_session_store_get_stats(&stats);
+	compactions += stats.compactions;
+
+	ESP_LOGI(TAG, "%s: %lu adds, %lu not journaled, %lu removes, %lu compactions, %lu mismatches, "
+			"%lld ns per add, %lld ns longest add, %lld ns per remove", failures == 0 ? "PASS" : "FAIL",
+			(unsigned long)adds, (unsigned long)rejected, (unsigned long)removes, (unsigned long)compactions,
+			(unsigned long)failures, (long long)(add_ns / adds), (long long)add_max_ns,
+			(long long)(removes ? remove_ns / removes : 0));
+	ESP_LOGI(TAG, "recovery: %lu resets, %lu publishes, %lld us average, %lld us longest to restore and visit the journal",
+			(unsigned long)resets, (unsigned long)restored, (long long)(restore_ns / resets / 1000),
+			(long long)(restore_max_ns / 1000));
+
+	//leave a journal as after a power-on reset to whatever runs next
+	mqtt_session_store_reset(true);
+	mqtt_session_store_restore();
+	return failures == 0;
+}
@@ -0,0 +1,32 @@
+/*
+ * mqtt_session_store_bench.h
+ *
+ *  Created on: Oct 19, 2026
+ *      Author: hamxa
+ */
+
+#ifndef MAIN_MQTT_SESSION_STORE_BENCH_H_
+#define MAIN_MQTT_SESSION_STORE_BENCH_H_
+
+#include <stdbool.h>
+
+//Publishes journaled over the run, and the resets spread evenly across it
+#define MQTT_SESSION_STORE_BENCH_ADDS		46000
+#define MQTT_SESSION_STORE_BENCH_RESETS		24
+
+//Longest topic and payload of the random publishes, a few payloads are larger than the whole journal
+#define MQTT_SESSION_STORE_BENCH_TOPIC_LEN	60
+#define MQTT_SESSION_STORE_BENCH_PAYLOAD	400
+#define MQTT_SESSION_STORE_BENCH_OVERSIZE	2100
+
+/**
+ * @fn bool mqtt_session_store_bench_run(void)
+ * @brief journal random QoS1 publishes acked mostly in order, checking every add against a model of the journal, and
+ * 			take it over after software resets, power losses and planned resets. Logs the time per add and remove,
+ * 			the longest add, compaction included, and the time to restore and visit the journal after each reset
+ *
+ * @return true if the journal matched the model after every step and reset
+ */
+bool mqtt_session_store_bench_run(void);
+
+#endif /* MAIN_MQTT_SESSION_STORE_BENCH_H_ */
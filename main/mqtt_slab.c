@@ -0,0 +1,119 @@
+/*
+ * mqtt_slab.c
+ *
+ *  Created on: Oct 18, 2026
+ *      Author: hamxa
+ */
+#include <stdbool.h>
+#include <stdlib.h>
+
+#include "mqtt_slab.h"
+
+#if MQTT_SLAB_SMALL_COUNT > 32 || MQTT_SLAB_LARGE_COUNT > 32
+	#error "slab classes are tracked in 32 bit maps"
+#endif
+
+/**
+ * One size class: fixed blocks and a map of the allocated ones, claimed and released with atomics
+ */
+typedef struct mqtt_slab_class
+{
+	uint8_t *blocks;
+	size_t block_size;
+	uint32_t count;
+	uint32_t used_map;
+	uint32_t used;
+	uint32_t peak;
+}mqtt_slab_class_t;
+
+//word aligned so the blocks can hold any payload
+static uint32_t g_small_blocks[MQTT_SLAB_SMALL_COUNT][MQTT_SLAB_SMALL_SIZE / sizeof(uint32_t)];
+static uint32_t g_large_blocks[MQTT_SLAB_LARGE_COUNT][(MQTT_SLAB_LARGE_SIZE + sizeof(uint32_t) - 1) / sizeof(uint32_t)];
+
+static mqtt_slab_class_t g_classes[] = {
+		{(uint8_t*)g_small_blocks, sizeof(g_small_blocks[0]), MQTT_SLAB_SMALL_COUNT, 0, 0, 0},
+		{(uint8_t*)g_large_blocks, sizeof(g_large_blocks[0]), MQTT_SLAB_LARGE_COUNT, 0, 0, 0},
+};
+
+static uint32_t g_heap_fallbacks;
+
+/**
+ * @fn void mqtt_slab_class_alloc*(mqtt_slab_class_t*)
+ * @brief claim the lowest free block of a class
+ *
+ * @return the block, NULL if the class is exhausted
+ */
+static void *mqtt_slab_class_alloc(mqtt_slab_class_t *slab)
+{
+	uint32_t full = slab->count == 32 ? UINT32_MAX : (1u << slab->count) - 1;
+	uint32_t map = __atomic_load_n(&slab->used_map, __ATOMIC_RELAXED);
+
+	for(;;)
+	{
+		if(map == full)
+		{
+			return NULL;
+		}
+
+		uint32_t index = __builtin_ctz(~map);
+		if(__atomic_compare_exchange_n(&slab->used_map, &map, map | (1u << index), true, __ATOMIC_ACQUIRE, __ATOMIC_RELAXED))
+		{
+			uint32_t used = __atomic_add_fetch(&slab->used, 1, __ATOMIC_RELAXED);
+			uint32_t peak = __atomic_load_n(&slab->peak, __ATOMIC_RELAXED);
+			while(used > peak &&
+				  !__atomic_compare_exchange_n(&slab->peak, &peak, used, true, __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+			{
+			}
+			return slab->blocks + index * slab->block_size;
+		}
+	}
+}
+
+void *mqtt_slab_alloc(size_t len)
+{
+	for(size_t i = 0; i < sizeof(g_classes) / sizeof(g_classes[0]); i++)
+	{
+		if(len <= g_classes[i].block_size)
+		{
+			void *block = mqtt_slab_class_alloc(&g_classes[i]);
+			if(block != NULL)
+			{
+				return block;
+			}
+		}
+	}
+
+	__atomic_add_fetch(&g_heap_fallbacks, 1, __ATOMIC_RELAXED);
+	return malloc(len);
+}
+
+void mqtt_slab_free(void *block)
+{
+	uint8_t *bytes = block;
+
+	if(block == NULL)
+	{
+		return;
+	}
+	for(size_t i = 0; i < sizeof(g_classes) / sizeof(g_classes[0]); i++)
+	{
+		mqtt_slab_class_t *slab = &g_classes[i];
+		if(bytes >= slab->blocks && bytes < slab->blocks + slab->count * slab->block_size)
+		{
+			uint32_t index = (bytes - slab->blocks) / slab->block_size;
+			__atomic_sub_fetch(&slab->used, 1, __ATOMIC_RELAXED);
+			__atomic_and_fetch(&slab->used_map, ~(1u << index), __ATOMIC_RELEASE);
+			return;
+		}
+	}
+	free(block);
+}
+
+void mqtt_slab_get_stats(mqtt_slab_stats_t *stats)
+{
+	stats->small_used = __atomic_load_n(&g_classes[0].used, __ATOMIC_RELAXED);
+	stats->large_used = __atomic_load_n(&g_classes[1].used, __ATOMIC_RELAXED);
+	stats->small_peak = __atomic_load_n(&g_classes[0].peak, __ATOMIC_RELAXED);
+	stats->large_peak = __atomic_load_n(&g_classes[1].peak, __ATOMIC_RELAXED);
+	stats->heap_fallbacks = __atomic_load_n(&g_heap_fallbacks, __ATOMIC_RELAXED);
+}
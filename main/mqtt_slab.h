@@ -0,0 +1,60 @@
+/*
+ * mqtt_slab.h
+ *
+ *  Created on: Oct 18, 2026
+ *      Author: hamxa
+ */
+
+#ifndef MAIN_MQTT_SLAB_H_
+#define MAIN_MQTT_SLAB_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "sdkconfig.h"
+
+//Block size and count of the small class, single samples, subscriptions and short topics
+#define MQTT_SLAB_SMALL_SIZE			128
+#define MQTT_SLAB_SMALL_COUNT			32
+
+//Block size and count of the large class, batches and summaries up to a whole network buffer
+#define MQTT_SLAB_LARGE_SIZE			CONFIG_MQTT_NETWORK_BUFFER_SIZE
+#define MQTT_SLAB_LARGE_COUNT			8
+
+/**
+ * Pool counters since boot
+ */
+typedef struct mqtt_slab_stats
+{
+	uint32_t small_used;			///> small blocks currently allocated
+	uint32_t large_used;			///> large blocks currently allocated
+	uint32_t small_peak;
+	uint32_t large_peak;
+	uint32_t heap_fallbacks;		///> allocations served by the heap: too large, or their class was exhausted
+}mqtt_slab_stats_t;
+
+/**
+ * @fn void mqtt_slab_alloc*(size_t)
+ * @brief take a block from the smallest class that fits, falls back to the heap. Safe from any task
+ *
+ * @param len bytes needed
+ * @return the block, NULL if the heap is exhausted too
+ */
+void *mqtt_slab_alloc(size_t len);
+
+/**
+ * @fn void mqtt_slab_free(void*)
+ * @brief give a block back to its class or to the heap. Safe from any task
+ *
+ * @param block block from mqtt_slab_alloc, may be NULL
+ */
+void mqtt_slab_free(void *block);
+
+/**
+ * @fn void mqtt_slab_get_stats(mqtt_slab_stats_t*)
+ * @brief get the pool counters
+ *
+ */
+void mqtt_slab_get_stats(mqtt_slab_stats_t *stats);
+
+#endif /* MAIN_MQTT_SLAB_H_ */
@@ -0,0 +1,133 @@
+/*
+ * mqtt_topic_alias.c
+ *
+ *  Created on: Oct 18, 2026
+ *      Author: hamxa
+ */
+#include <stdio.h>
+#include <string.h>
+
+#include "freertos/FreeRTOS.h"
+
+#include "mqtt_topic_alias.h"
+
+/**
+ * A topic and its alias, never changed once counted
+ */
+typedef struct mqtt_topic_alias_entry
+{
+	char topic[MQTT_TOPIC_ALIAS_TOPIC_MAX + 1];
+	uint16_t topic_len;
+	char alias[sizeof(MQTT_TOPIC_ALIAS_PREFIX) + 3];
+}mqtt_topic_alias_entry_t;
+
+//adds are serialized, lookups only read the entries below the counts
+static portMUX_TYPE g_alias_lock = portMUX_INITIALIZER_UNLOCKED;
+
+static mqtt_topic_alias_entry_t g_entries[MQTT_TOPIC_ALIAS_MAX];
+static uint8_t g_count;
+static uint8_t g_announced;
+
+/**
+ * @fn int mqtt_topic_alias_find(const char*, size_t, uint8_t)
+ * @brief index of the topic among the first count entries
+ *
+ * @return the index, or -1
+ */
+static int mqtt_topic_alias_find(const char *topic, size_t topic_len, uint8_t count)
+{
+	for(uint8_t i = 0; i < count; i++)
+	{
+		if(g_entries[i].topic_len == topic_len && memcmp(g_entries[i].topic, topic, topic_len) == 0)
+		{
+			return i;
+		}
+	}
+	return -1;
+}
+
+esp_err_t mqtt_topic_alias_add(const char *topic)
+{
+	size_t topic_len = strlen(topic);
+	esp_err_t err = ESP_OK;
+
+	//a topic no longer than its alias, the prefix and one digit, would gain nothing
+	if(topic_len <= sizeof(MQTT_TOPIC_ALIAS_PREFIX) || topic_len > MQTT_TOPIC_ALIAS_TOPIC_MAX)
+	{
+		return ESP_ERR_INVALID_SIZE;
+	}
+
+	portENTER_CRITICAL(&g_alias_lock);
+	if(mqtt_topic_alias_find(topic, topic_len, g_count) < 0)
+	{
+		if(g_count < MQTT_TOPIC_ALIAS_MAX)
+		{
+			mqtt_topic_alias_entry_t *entry = &g_entries[g_count];
+			memcpy(entry->topic, topic, topic_len + 1);
+			entry->topic_len = (uint16_t)topic_len;
+			snprintf(entry->alias, sizeof(entry->alias), MQTT_TOPIC_ALIAS_PREFIX "%u", (unsigned)(g_count + 1));
+			//readers that see the new count see the entry
+			__atomic_store_n(&g_count, g_count + 1, __ATOMIC_RELEASE);
+		}
+		else
+		{
+			err = ESP_ERR_NO_MEM;
+		}
+	}
+	portEXIT_CRITICAL(&g_alias_lock);
+	return err;
+}
+
+const char *mqtt_topic_alias_lookup(const char *topic)
+{
+	uint8_t announced = __atomic_load_n(&g_announced, __ATOMIC_ACQUIRE);
+
+	if(announced == 0)
+	{
+		return topic;
+	}
+	int i = mqtt_topic_alias_find(topic, strlen(topic), announced);
+	return i < 0 ? topic : g_entries[i].alias;
+}
+
+uint8_t mqtt_topic_alias_count(void)
+{
+	return __atomic_load_n(&g_count, __ATOMIC_ACQUIRE);
+}
+
+int mqtt_topic_alias_map_json(uint8_t count, char *buf, size_t size)
+{
+	size_t len = 0;
+	int n;
+
+	if(count > mqtt_topic_alias_count() || size < 2)
+	{
+		return -1;
+	}
+	buf[len++] = '{';
+	for(uint8_t i = 0; i < count; i++)
+	{
+		//the topics are the device's own, nothing in them needs escaping
+		n = snprintf(buf + len, size - len, "%s\"%s\":\"%s\"", i ? "," : "", g_entries[i].alias, g_entries[i].topic);
+		if(n < 0 || (size_t)n >= size - len)
+		{
+			return -1;
+		}
+		len += (size_t)n;
+	}
+	if(len + 2 > size)
+	{
+		return -1;
+	}
+	buf[len++] = '}';
+	buf[len] = '\0';
+	return (int)len;
+}
+
+void mqtt_topic_alias_set_announced(uint8_t count)
+{
+	if(count <= mqtt_topic_alias_count())
+	{
+		__atomic_store_n(&g_announced, count, __ATOMIC_RELEASE);
+	}
+}
@@ -0,0 +1,72 @@
+/*
+ * mqtt_topic_alias.h
+ *
+ *  Created on: Oct 18, 2026
+ *      Author: hamxa
+ */
+
+#ifndef MAIN_MQTT_TOPIC_ALIAS_H_
+#define MAIN_MQTT_TOPIC_ALIAS_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "esp_err.h"
+
+#include "device_topics.h"
+
+//Topics that can get an alias, the hot publish topics of the device
+#define MQTT_TOPIC_ALIAS_MAX			8
+
+//Longest topic that can get an alias
+#define MQTT_TOPIC_ALIAS_TOPIC_MAX		64
+
+//Alias topics are the prefix and the alias number: a/1. They are kept out of the device root, which alone is longer
+//than the telemetry topics, the broker knows the device from the client id of the connection
+#define MQTT_TOPIC_ALIAS_PREFIX			"a/"
+
+//Retained map of alias topic to full topic, the cloud side resolves the aliases with it
+#define MQTT_TOPIC_ALIAS_MAP_TOPIC		DEVICE_TOPICS_ROOT "/aliases"
+
+//Buffer size that holds mqtt_topic_alias_map_json() with every alias taken
+#define MQTT_TOPIC_ALIAS_MAP_MAX_LEN	(2 + MQTT_TOPIC_ALIAS_MAX * (sizeof(MQTT_TOPIC_ALIAS_PREFIX) + MQTT_TOPIC_ALIAS_TOPIC_MAX + 8))
+
+/**
+ * @fn esp_err_t mqtt_topic_alias_add(const char*)
+ * @brief give a topic the next alias, it is used once a map holding it was announced. Safe to call again
+ *
+ * @return ESP_OK, ESP_ERR_INVALID_SIZE if the topic is too long or no longer than its alias, ESP_ERR_NO_MEM once
+ * 			every alias is taken
+ */
+esp_err_t mqtt_topic_alias_add(const char *topic);
+
+/**
+ * @fn const char mqtt_topic_alias_lookup*(const char*)
+ * @brief topic to publish to: the alias topic if the topic has an announced alias, the topic itself otherwise
+ *
+ */
+const char *mqtt_topic_alias_lookup(const char *topic);
+
+/**
+ * @fn uint8_t mqtt_topic_alias_count(void)
+ * @brief number of aliases given, aliases are never taken back so it only grows
+ *
+ */
+uint8_t mqtt_topic_alias_count(void);
+
+/**
+ * @fn int mqtt_topic_alias_map_json(uint8_t, char*, size_t)
+ * @brief write the map of the first count aliases: {"a/1":"test_topic/esp32/cbor",...}
+ *
+ * @return length written, or -1 if the buffer is too small
+ */
+int mqtt_topic_alias_map_json(uint8_t count, char *buf, size_t size);
+
+/**
+ * @fn void mqtt_topic_alias_set_announced(uint8_t)
+ * @brief start using the first count aliases, called once the broker acked their map
+ *
+ */
+void mqtt_topic_alias_set_announced(uint8_t count);
+
+#endif /* MAIN_MQTT_TOPIC_ALIAS_H_ */
@@ -0,0 +1,344 @@
+/*
+ * mqtt_transport.c
+ *
+ *  Created on: Oct 18, 2026
+ *      Author: hamxa
+ */
+#include <string.h>
+
+#include "freertos/FreeRTOS.h"
+#include "esp_cpu.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "sdkconfig.h"
+
+#include "mqtt_transport.h"
+
+#if CONFIG_MQTT_TLS_SESSION_RESUMPTION
+#include <fcntl.h>
+#include <sys/select.h>
+
+#include "esp_tls.h"
+#include "mbedtls/ssl.h"
+#endif
+
+static const char TAG[] = "mqtt_transport";
+
+//the task that owns the MQTT context updates the counters, the metrics and telemetry tasks read them. 64-bit
+//counters are not written in one store, so both sides go through the lock
+static portMUX_TYPE g_transport_lock = portMUX_INITIALIZER_UNLOCKED;
+static mqtt_transport_stats_t g_transport_stats;
+
+#if CONFIG_MQTT_TRANSPORT_WRITEV
+//packet header and small payloads are gathered here, so a publish goes out as one TLS record
+static uint8_t g_coalesce_buf[MQTT_TRANSPORT_COALESCE_SIZE];
+#endif
+
+#if CONFIG_MQTT_TLS_SESSION_RESUMPTION
+
+//TLS timeout of the connect, same as xTlsConnect
+#define MQTT_TRANSPORT_TLS_TIMEOUT_MS		3000
+
+//longest wait for the broker between two steps of the handshake
+#define MQTT_TRANSPORT_HANDSHAKE_POLL_MS	10
+
+//last session negotiated with the broker, offered on the next connect
+static esp_tls_client_session_t *g_session = NULL;
+
+/**
+ * @fn int mqtt_transport_verify(void*, mbedtls_x509_crt*, int, uint32_t*)
+ * @brief verify callback of the handshake, counts the certificates the broker sent and leaves the verification
+ * 			to mbedtls. A resumed handshake skips the certificate exchange, so it is never called on one
+ *
+ */
+static int mqtt_transport_verify(void *ctx, mbedtls_x509_crt *crt, int depth, uint32_t *flags)
+{
+	(*(uint32_t*)ctx)++;
+	return 0;
+}
+
+/**
+ * @fn void mqtt_transport_session_free(void)
+ * @brief drop the cached session, the next connect does a full handshake
+ *
+ */
+static void mqtt_transport_session_free(void)
+{
+	if(g_session)
+	{
+		esp_tls_free_client_session(g_session);
+		g_session = NULL;
+	}
+}
+
+/**
+ * @fn int mqtt_transport_handshake(NetworkContext_t*, const esp_tls_cfg_t*, esp_tls_t*, uint32_t*, uint32_t*)
+ * @brief connect and run the handshake one non-blocking step at a time. The certificates the broker sends are
+ * 			counted from the first step on, and only the steps are timed, not the waits for the broker
+ *
+ * @param certs set to the certificates the broker sent, 0 on a resumed handshake, UINT32_MAX if they could not be
+ * 			counted
+ * @param cycles set to the CPU cycles spent in the handshake steps
+ * @return 1 once the handshake is done, -1 on error or timeout, as esp_tls_conn_new_async
+ */
+static int mqtt_transport_handshake(NetworkContext_t *pNetworkContext, const esp_tls_cfg_t *tls_config, esp_tls_t *tls,
+		uint32_t *certs, uint32_t *cycles)
+{
+	int64_t deadline_us = esp_timer_get_time() + MQTT_TRANSPORT_TLS_TIMEOUT_MS * 1000LL;
+	esp_tls_conn_state_t state;
+	bool hooked = false;
+	uint32_t start;
+	int fd = -1;
+	int ret;
+
+	*certs = 0;
+	*cycles = 0;
+	do
+	{
+		start = esp_cpu_get_cycle_count();
+		ret = esp_tls_conn_new_async(pNetworkContext->pcHostname, strlen(pNetworkContext->pcHostname),
+				pNetworkContext->xPort, tls_config, tls);
+		//the first call resolves and connects, the handshake is the steps after it
+		if(hooked)
+		{
+			*cycles += esp_cpu_get_cycle_count() - start;
+		}
+		if(ret != 0)
+		{
+			break;
+		}
+
+		//the ssl context is set up and the ClientHello sent, nothing of the broker's reply is read yet
+		if(!hooked && esp_tls_get_conn_state(tls, &state) == ESP_OK && state == ESP_TLS_HANDSHAKE)
+		{
+			mbedtls_ssl_set_verify(esp_tls_get_ssl_context(tls), mqtt_transport_verify, certs);
+			esp_tls_get_conn_sockfd(tls, &fd);
+			hooked = true;
+		}
+		if(fd >= 0)
+		{
+			struct timeval tv = { .tv_sec = 0, .tv_usec = MQTT_TRANSPORT_HANDSHAKE_POLL_MS * 1000 };
+			fd_set rset;
+
+			FD_ZERO(&rset);
+			FD_SET(fd, &rset);
+			select(fd + 1, &rset, NULL, NULL, &tv);
+		}
+	}while(esp_timer_get_time() < deadline_us);
+
+	if(ret == 1 && !hooked)
+	{
+		//done within the first call, the certificates were not counted
+		*certs = UINT32_MAX;
+	}
+	if(ret == 1 && esp_tls_get_conn_sockfd(tls, &fd) == ESP_OK)
+	{
+		//the transport reads and writes with the timeouts of a blocking socket
+		fcntl(fd, F_SETFL, fcntl(fd, F_GETFL, 0) & ~O_NONBLOCK);
+	}
+	return ret == 0 ? -1 : ret;
+}
+
+/**
+ * @fn TlsTransportStatus_t mqtt_transport_tls_connect(NetworkContext_t*, bool*, uint32_t*)
+ * @brief xTlsConnect with the cached session offered to the broker
+ *
+ * @param pNetworkContext network context filled in with the broker and credentials
+ * @param resumed set when the broker resumed the offered session: it sent no certificate
+ * @param cycles set to the CPU cycles spent in the handshake
+ * @return status as xTlsConnect would return it
+ */
+static TlsTransportStatus_t mqtt_transport_tls_connect(NetworkContext_t *pNetworkContext, bool *resumed, uint32_t *cycles)
+{
+	TlsTransportStatus_t status = TLS_TRANSPORT_SUCCESS;
+	esp_tls_error_handle_t tls_error = NULL;
+	bool handshake_failed = false;
+	bool offered = g_session != NULL;
+	uint32_t certs = 0;
+
+	esp_tls_cfg_t tls_config = {
+			.cacert_buf = (const unsigned char*)pNetworkContext->pcServerRootCA,
+			.cacert_bytes = pNetworkContext->pcServerRootCASize,
+			.clientcert_buf = (const unsigned char*)pNetworkContext->pcClientCert,
+			.clientcert_bytes = pNetworkContext->pcClientCertSize,
+			.clientkey_buf = (const unsigned char*)pNetworkContext->pcClientKey,
+			.clientkey_bytes = pNetworkContext->pcClientKeySize,
+			.skip_common_name = pNetworkContext->disableSni,
+			.alpn_protos = pNetworkContext->pAlpnProtos,
+			.non_block = true,
+			.timeout_ms = MQTT_TRANSPORT_TLS_TIMEOUT_MS,
+			.client_session = g_session,
+	};
+
+	esp_tls_t *tls = esp_tls_init();
+	if(tls == NULL)
+	{
+		return TLS_TRANSPORT_INSUFFICIENT_MEMORY;
+	}
+
+	xSemaphoreTake(pNetworkContext->xTlsContextSemaphore, portMAX_DELAY);
+	pNetworkContext->pxTls = tls;
+	if(mqtt_transport_handshake(pNetworkContext, &tls_config, tls, &certs, cycles) <= 0)
+	{
+		handshake_failed = esp_tls_get_error_handle(tls, &tls_error) == ESP_OK &&
+						   tls_error->last_error == ESP_ERR_MBEDTLS_SSL_HANDSHAKE_FAILED;
+		esp_tls_conn_destroy(tls);
+		pNetworkContext->pxTls = NULL;
+		status = TLS_TRANSPORT_CONNECT_FAILURE;
+	}
+	xSemaphoreGive(pNetworkContext->xTlsContextSemaphore);
+
+	if(status != TLS_TRANSPORT_SUCCESS)
+	{
+		//keep the session through link drops, but do not keep offering one the broker failed the handshake on
+		if(offered && handshake_failed)
+		{
+			ESP_LOGW(TAG, "mqtt_transport_tls_connect: handshake failed, dropping the cached session");
+			mqtt_transport_session_free();
+		}
+		return status;
+	}
+
+	//a broker that renewed its ticket on resumption still sent no certificate
+	*resumed = offered && certs == 0;
+
+	//the session of this connection, resumed, renewed or new, is the one to offer next
+	esp_tls_client_session_t *session = esp_tls_get_client_session(tls);
+	if(session)
+	{
+		mqtt_transport_session_free();
+		g_session = session;
+	}
+	return status;
+}
+#endif /* CONFIG_MQTT_TLS_SESSION_RESUMPTION */
+
+TlsTransportStatus_t mqtt_transport_connect(NetworkContext_t *pNetworkContext)
+{
+	bool resumed = false;
+	uint32_t cycles = 0;
+	int64_t start_us = esp_timer_get_time();
+#if CONFIG_MQTT_TLS_SESSION_RESUMPTION
+	TlsTransportStatus_t status = mqtt_transport_tls_connect(pNetworkContext, &resumed, &cycles);
+#else
+	TlsTransportStatus_t status = xTlsConnect(pNetworkContext);
+#endif
+	int64_t elapsed_us = esp_timer_get_time() - start_us;
+	uint32_t handshakes;
+
+	portENTER_CRITICAL(&g_transport_lock);
+	if(status == TLS_TRANSPORT_SUCCESS)
+	{
+		g_transport_stats.handshakes++;
+		g_transport_stats.handshake_us += elapsed_us;
+		g_transport_stats.handshake_cycles += cycles;
+		if(resumed)
+		{
+			g_transport_stats.resumed_handshakes++;
+			g_transport_stats.resumed_handshake_us += elapsed_us;
+			g_transport_stats.resumed_handshake_cycles += cycles;
+		}
+	}
+	else
+	{
+		g_transport_stats.handshake_failures++;
+	}
+	handshakes = g_transport_stats.handshakes;
+	portEXIT_CRITICAL(&g_transport_lock);
+
+	if(status == TLS_TRANSPORT_SUCCESS)
+	{
+		ESP_LOGI(TAG, "mqtt_transport_connect: %s handshake %lu took %lld ms, %lu cycles", resumed ? "resumed" : "full",
+				(unsigned long)handshakes, (long long)(elapsed_us / 1000), (unsigned long)cycles);
+	}
+	return status;
+}
+
+/**
+ * @fn int32_t mqtt_transport_write(NetworkContext_t*, const void*, size_t)
+ * @brief one TLS write, mbedtls puts it in one record up to the maximum fragment length
+ *
+ * @return bytes sent, or a negative value on error
+ */
+static int32_t mqtt_transport_write(NetworkContext_t *pNetworkContext, const void *pBuffer, size_t bytesToSend)
+{
+	uint32_t start = esp_cpu_get_cycle_count();
+	int32_t sent = espTlsTransportSend(pNetworkContext, pBuffer, bytesToSend);
+	uint32_t cycles = esp_cpu_get_cycle_count() - start;
+
+	portENTER_CRITICAL(&g_transport_lock);
+	g_transport_stats.tls_write_cycles += cycles;
+	g_transport_stats.tls_writes++;
+	if(sent > 0)
+	{
+		g_transport_stats.bytes_sent += sent;
+	}
+	portEXIT_CRITICAL(&g_transport_lock);
+	return sent;
+}
+
+int32_t mqtt_transport_send(NetworkContext_t *pNetworkContext, const void *pBuffer, size_t bytesToSend)
+{
+	return mqtt_transport_write(pNetworkContext, pBuffer, bytesToSend);
+}
+
+#if CONFIG_MQTT_TRANSPORT_WRITEV
+int32_t mqtt_transport_writev(NetworkContext_t *pNetworkContext, TransportOutVector_t *pIoVec, size_t ioVecCount)
+{
+	size_t staged = 0;
+	size_t i = 0;
+	int32_t sent;
+	int32_t total = 0;
+
+	//gather vectors while they fit, copying small ones is cheaper than a record of their own
+	while(i < ioVecCount && staged + pIoVec[i].iov_len <= sizeof(g_coalesce_buf))
+	{
+		memcpy(g_coalesce_buf + staged, pIoVec[i].iov_base, pIoVec[i].iov_len);
+		staged += pIoVec[i].iov_len;
+		i++;
+	}
+
+	if(staged > 0)
+	{
+		sent = mqtt_transport_write(pNetworkContext, g_coalesce_buf, staged);
+		if(sent < 0 || (size_t)sent < staged)
+		{
+			//coreMQTT calls again with the vectors advanced past what was sent
+			return sent;
+		}
+		total = sent;
+	}
+
+	//a vector that does not fit is written straight from the caller's buffer, the ones after it on the next call
+	if(i < ioVecCount)
+	{
+		sent = mqtt_transport_write(pNetworkContext, pIoVec[i].iov_base, pIoVec[i].iov_len);
+		if(sent < 0)
+		{
+			return total > 0 ? total : sent;
+		}
+		total += sent;
+	}
+	return total;
+}
+#endif
+
+int32_t mqtt_transport_recv(NetworkContext_t *pNetworkContext, void *pBuffer, size_t bytesToRecv)
+{
+	int32_t received = espTlsTransportRecv(pNetworkContext, pBuffer, bytesToRecv);
+	if(received > 0)
+	{
+		portENTER_CRITICAL(&g_transport_lock);
+		g_transport_stats.bytes_received += received;
+		portEXIT_CRITICAL(&g_transport_lock);
+	}
+	return received;
+}
+
+void mqtt_transport_get_stats(mqtt_transport_stats_t *stats)
+{
+	portENTER_CRITICAL(&g_transport_lock);
+	*stats = g_transport_stats;
+	portEXIT_CRITICAL(&g_transport_lock);
+	stats->uptime_us = esp_timer_get_time();
+}
@@ -0,0 +1,85 @@
+/*
+ * mqtt_transport.h
+ *
+ *  Created on: Oct 18, 2026
+ *      Author: hamxa
+ */
+
+#ifndef MAIN_MQTT_TRANSPORT_H_
+#define MAIN_MQTT_TRANSPORT_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "network_transport.h"
+#include "sdkconfig.h"
+
+//Size of the buffer mqtt_transport_writev gathers a packet in, larger parts are sent from their own buffer
+#define MQTT_TRANSPORT_COALESCE_SIZE		CONFIG_MQTT_NETWORK_BUFFER_SIZE
+
+/**
+ * Connection and traffic counters of the broker connection, counted since boot
+ */
+typedef struct mqtt_transport_stats
+{
+	uint32_t handshakes;			///> successful TLS handshakes
+	uint32_t handshake_failures;
+	uint64_t handshake_us;			///> total time spent in successful handshakes
+	uint64_t handshake_cycles;		///> CPU cycles spent in the handshake steps, the waits for the broker left out
+	uint32_t resumed_handshakes;	///> handshakes that resumed the cached TLS session, part of handshakes
+	uint64_t resumed_handshake_us;	///> total time spent in resumed handshakes
+	uint64_t resumed_handshake_cycles;	///> CPU cycles spent in resumed handshakes
+	uint64_t bytes_sent;			///> MQTT bytes handed to TLS
+	uint64_t bytes_received;		///> MQTT bytes returned by TLS
+	uint32_t tls_writes;			///> TLS writes issued, each goes out as at least one record
+	uint64_t tls_write_cycles;		///> CPU cycles spent in the TLS writes
+	int64_t uptime_us;				///> time the counters cover
+}mqtt_transport_stats_t;
+
+/**
+ * @fn TlsTransportStatus_t mqtt_transport_connect(NetworkContext_t*)
+ * @brief establish the TLS session to the broker, counting and timing the handshake. With
+ * CONFIG_MQTT_TLS_SESSION_RESUMPTION the previous session is offered so the broker can skip the full handshake,
+ * the handshake is run one step at a time and its CPU cycles are counted
+ *
+ * @param pNetworkContext network context filled in with the broker and credentials
+ * @return status of xTlsConnect
+ */
+TlsTransportStatus_t mqtt_transport_connect(NetworkContext_t *pNetworkContext);
+
+/**
+ * @fn int32_t mqtt_transport_send(NetworkContext_t*, const void*, size_t)
+ * @brief coreMQTT send function, forwards to the TLS transport and counts the bytes sent
+ *
+ * @return bytes sent, or a negative value on error
+ */
+int32_t mqtt_transport_send(NetworkContext_t *pNetworkContext, const void *pBuffer, size_t bytesToSend);
+
+#if CONFIG_MQTT_TRANSPORT_WRITEV
+/**
+ * @fn int32_t mqtt_transport_writev(NetworkContext_t*, TransportOutVector_t*, size_t)
+ * @brief coreMQTT vectored send. Gathers the packet header, topic and payload into one TLS write when they
+ * fit MQTT_TRANSPORT_COALESCE_SIZE, a larger payload is written straight from its buffer
+ *
+ * @return bytes sent, may be fewer than the vectors hold, or a negative value on error
+ */
+int32_t mqtt_transport_writev(NetworkContext_t *pNetworkContext, TransportOutVector_t *pIoVec, size_t ioVecCount);
+#endif
+
+/**
+ * @fn int32_t mqtt_transport_recv(NetworkContext_t*, void*, size_t)
+ * @brief coreMQTT receive function, forwards to the TLS transport and counts the bytes received
+ *
+ * @return bytes received, or a negative value on error
+ */
+int32_t mqtt_transport_recv(NetworkContext_t *pNetworkContext, void *pBuffer, size_t bytesToRecv);
+
+/**
+ * @fn void mqtt_transport_get_stats(mqtt_transport_stats_t*)
+ * @brief get the connection and traffic counters
+ *
+ * @param stats output counters
+ */
+void mqtt_transport_get_stats(mqtt_transport_stats_t *stats);
+
+#endif /* MAIN_MQTT_TRANSPORT_H_ */
@@ -0,0 +1,162 @@
+/*
+ * ota_health.c
+ *
+ *  Created on: Oct 19, 2026
+ *      Author: hamxa
+ */
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "esp_app_desc.h"
+#include "esp_http_client.h"
+#include "esp_log.h"
+#include "esp_ota_ops.h"
+#include "esp_timer.h"
+
+#include "mqtt_ota.h"
+#include "mqtt_session_store.h"
+#include "ota_health.h"
+#include "tasks_common.h"
+
+static const char TAG[] = "ota_health";
+
+//set while the first boot of an image is being checked
+static bool g_pending;
+//ota_health_check_e bits of the checks passed
+static uint32_t g_passed;
+
+/**
+ * @fn const char ota_health_name*(ota_health_check_e)
+ * @brief name of a check for the log
+ *
+ */
+static const char *ota_health_name(ota_health_check_e check)
+{
+	switch(check)
+	{
+	case OTA_HEALTH_WIFI:
+		return "wifi";
+	case OTA_HEALTH_SENSOR:
+		return "sensor";
+	default:
+		return "http";
+	}
+}
+
+/**
+ * @fn const char ota_health_result*(uint32_t, ota_health_check_e)
+ * @brief state of a check for the log
+ *
+ */
+static const char *ota_health_result(uint32_t passed, ota_health_check_e check)
+{
+	return (passed & check) ? "ok" : "missing";
+}
+
+/**
+ * @fn bool ota_health_http_check(void)
+ * @brief request the OTA status page of the web server, as a browser would
+ *
+ */
+static bool ota_health_http_check(void)
+{
+	esp_http_client_config_t config = {
+			.url = OTA_HEALTH_HTTP_URL,
+			.timeout_ms = OTA_HEALTH_HTTP_TIMEOUT_MS,
+	};
+	esp_http_client_handle_t client = esp_http_client_init(&config);
+	bool ok;
+
+	if(client == NULL)
+	{
+		return false;
+	}
+	ok = esp_http_client_perform(client) == ESP_OK && esp_http_client_get_status_code(client) == 200;
+	esp_http_client_cleanup(client);
+	return ok;
+}
+
+/**
+ * @fn void ota_health_task(void*)
+ * @brief wait for the checks, then mark the image valid or roll back to the previous one
+ *
+ */
+static void ota_health_task(void *pvParameters)
+{
+	int64_t start_us = esp_timer_get_time();
+	int64_t deadline_us = start_us + (int64_t)CONFIG_OTA_HEALTH_TIMEOUT_MS * 1000;
+	uint32_t passed = 0;
+	esp_err_t err;
+
+	while(passed != OTA_HEALTH_ALL && esp_timer_get_time() < deadline_us)
+	{
+		vTaskDelay(pdMS_TO_TICKS(OTA_HEALTH_POLL_MS));
+		if(!(__atomic_load_n(&g_passed, __ATOMIC_RELAXED) & OTA_HEALTH_HTTP) && ota_health_http_check())
+		{
+			ota_health_report(OTA_HEALTH_HTTP);
+		}
+		passed = __atomic_load_n(&g_passed, __ATOMIC_RELAXED);
+	}
+	__atomic_store_n(&g_pending, false, __ATOMIC_RELAXED);
+
+	if(passed == OTA_HEALTH_ALL)
+	{
+		err = esp_ota_mark_app_valid_cancel_rollback();
+		if(err == ESP_OK)
+		{
+			ESP_LOGI(TAG, "image %s confirmed %lld ms after boot", esp_app_get_description()->version,
+					(long long)(esp_timer_get_time() / 1000));
+		}
+		else
+		{
+			ESP_LOGE(TAG, "image %s passed its checks but was not confirmed: %s", esp_app_get_description()->version,
+					esp_err_to_name(err));
+		}
+		vTaskDelete(NULL);
+	}
+
+	ESP_LOGE(TAG, "image %s failed its checks in %d ms, wifi %s, sensor %s, http %s, rolling back",
+			esp_app_get_description()->version, CONFIG_OTA_HEALTH_TIMEOUT_MS,
+			ota_health_result(passed, OTA_HEALTH_WIFI), ota_health_result(passed, OTA_HEALTH_SENSOR),
+			ota_health_result(passed, OTA_HEALTH_HTTP));
+#if CONFIG_MQTT_OTA
+	//the cloud clears the job, so the previous image is not sent the same image again
+	mqtt_ota_report_rollback();
+#endif
+#if CONFIG_MQTT_SESSION_STORE
+	//the previous image takes the unacked publishes over from NVS
+	mqtt_session_store_flush();
+#endif
+	//only returns if there is no previous image to go back to
+	err = esp_ota_mark_app_invalid_rollback_and_reboot();
+	ESP_LOGE(TAG, "rollback failed, keeping image %s: %s", esp_app_get_description()->version, esp_err_to_name(err));
+	vTaskDelete(NULL);
+}
+
+void ota_health_start(void)
+{
+	const esp_partition_t *running = esp_ota_get_running_partition();
+	esp_ota_img_states_t state;
+
+	//the factory image and confirmed images have nothing to check
+	if(esp_ota_get_state_partition(running, &state) != ESP_OK || state != ESP_OTA_IMG_PENDING_VERIFY)
+	{
+		return;
+	}
+	ESP_LOGI(TAG, "first boot of image %s, it is confirmed once Wi-Fi, the sensor and the web server are up, within %d ms",
+			esp_app_get_description()->version, CONFIG_OTA_HEALTH_TIMEOUT_MS);
+	__atomic_store_n(&g_pending, true, __ATOMIC_RELAXED);
+	xTaskCreatePinnedToCore(&ota_health_task, "ota_health", OTA_HEALTH_TASK_STACK_SIZE, NULL, OTA_HEALTH_TASK_PRIORITY,
+			NULL, OTA_HEALTH_TASK_CORE_ID);
+}
+
+void ota_health_report(ota_health_check_e check)
+{
+	if(!__atomic_load_n(&g_pending, __ATOMIC_RELAXED))
+	{
+		return;
+	}
+	if(!(__atomic_fetch_or(&g_passed, (uint32_t)check, __ATOMIC_RELAXED) & check))
+	{
+		ESP_LOGI(TAG, "%s check passed %lld ms after boot", ota_health_name(check), (long long)(esp_timer_get_time() / 1000));
+	}
+}
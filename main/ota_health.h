@@ -0,0 +1,46 @@
+/*
+ * ota_health.h
+ *
+ *  Created on: Oct 19, 2026
+ *      Author: hamxa
+ */
+
+#ifndef MAIN_OTA_HEALTH_H_
+#define MAIN_OTA_HEALTH_H_
+
+//Request the HTTP check sends to the web server of the device, over the loopback interface
+#define OTA_HEALTH_HTTP_URL				"http://127.0.0.1/OTAstatus"
+#define OTA_HEALTH_HTTP_TIMEOUT_MS		2000
+
+//Interval between the HTTP checks, and between looks at the reported ones
+#define OTA_HEALTH_POLL_MS				1000
+
+/**
+ * Checks the first boot of an image written by OTA must pass before the image is marked valid
+ */
+typedef enum ota_health_check
+{
+	OTA_HEALTH_WIFI = 1 << 0,		/**< OTA_HEALTH_WIFI, the station got an IP, or the softAP runs without saved credentials */
+	OTA_HEALTH_SENSOR = 1 << 1,		/**< OTA_HEALTH_SENSOR, the DHT11 gave a reading */
+	OTA_HEALTH_HTTP = 1 << 2		/**< OTA_HEALTH_HTTP, the web server answered a request */
+}ota_health_check_e;
+
+#define OTA_HEALTH_ALL					(OTA_HEALTH_WIFI | OTA_HEALTH_SENSOR | OTA_HEALTH_HTTP)
+
+/**
+ * @fn void ota_health_start(void)
+ * @brief on the first boot of an image written by OTA, start the task that marks it valid once every check passed
+ * 			and rolls back to the previous image if they have not within CONFIG_OTA_HEALTH_TIMEOUT_MS. Does nothing
+ * 			for an image already confirmed. Called before the checked components start
+ *
+ */
+void ota_health_start(void);
+
+/**
+ * @fn void ota_health_report(ota_health_check_e)
+ * @brief report a check as passed, from any task. Only an atomic load once the image is confirmed
+ *
+ */
+void ota_health_report(ota_health_check_e check);
+
+#endif /* MAIN_OTA_HEALTH_H_ */
@@ -0,0 +1,213 @@
+/*
+ * ota_verify.c
+ *
+ *  Created on: Oct 19, 2026
+ *      Author: hamxa
+ */
+#include <string.h>
+
+#include "esp_ota_ops.h"
+#include "sys/param.h"
+
+#include "ota_verify.h"
+
+_Static_assert(sizeof(esp_image_header_t) <= OTA_VERIFY_DIGEST_LEN, "the image header is gathered in the digest field");
+
+/**
+ * @fn int ota_verify_hex_digit(char)
+ * @brief value of a hex digit
+ *
+ * @return 0 to 15, -1 for another character
+ */
+static int ota_verify_hex_digit(char c)
+{
+	if(c >= '0' && c <= '9')
+	{
+		return c - '0';
+	}
+	if(c >= 'a' && c <= 'f')
+	{
+		return c - 'a' + 10;
+	}
+	if(c >= 'A' && c <= 'F')
+	{
+		return c - 'A' + 10;
+	}
+	return -1;
+}
+
+bool ota_verify_parse_digest(const char *hex, size_t len, uint8_t *digest)
+{
+	if(len != OTA_VERIFY_DIGEST_HEX_LEN)
+	{
+		return false;
+	}
+	for(size_t i = 0; i < OTA_VERIFY_DIGEST_LEN; i++)
+	{
+		int high = ota_verify_hex_digit(hex[2 * i]);
+		int low = ota_verify_hex_digit(hex[2 * i + 1]);
+		if(high < 0 || low < 0)
+		{
+			return false;
+		}
+		digest[i] = (uint8_t)(high << 4 | low);
+	}
+	return true;
+}
+
+/**
+ * @fn void ota_verify_expect(ota_verify_t*, ota_verify_state_e, uint32_t, uint32_t)
+ * @brief gather the next header or the digest, at its offset in the image
+ *
+ */
+static void ota_verify_expect(ota_verify_t *verify, ota_verify_state_e state, uint32_t at, uint32_t len)
+{
+	verify->state = state;
+	verify->field_at = at;
+	verify->field_len = len;
+}
+
+/**
+ * @fn void ota_verify_field(ota_verify_t*)
+ * @brief follow the header or the digest just gathered, the layout is the one esp_image_verify reads
+ *
+ */
+static void ota_verify_field(ota_verify_t *verify)
+{
+	esp_image_header_t header;
+	esp_image_segment_header_t segment;
+	uint32_t end;
+
+	switch(verify->state)
+	{
+	case OTA_VERIFY_HEADER:
+		memcpy(&header, verify->field, sizeof(header));
+		if(header.magic != ESP_IMAGE_HEADER_MAGIC || header.segment_count == 0 ||
+		   header.segment_count > ESP_IMAGE_MAX_SEGMENTS)
+		{
+			verify->err = ESP_ERR_OTA_VALIDATE_FAILED;
+			return;
+		}
+		verify->segments = header.segment_count;
+		verify->hash_appended = header.hash_appended == 1;
+		ota_verify_expect(verify, OTA_VERIFY_SEGMENT, verify->offset, sizeof(esp_image_segment_header_t));
+		break;
+
+	case OTA_VERIFY_SEGMENT:
+		memcpy(&segment, verify->field, sizeof(segment));
+		end = verify->offset + segment.data_len;
+		if(end < verify->offset)
+		{
+			verify->err = ESP_ERR_OTA_VALIDATE_FAILED;
+			return;
+		}
+		if(--verify->segments > 0)
+		{
+			ota_verify_expect(verify, OTA_VERIFY_SEGMENT, end, sizeof(esp_image_segment_header_t));
+			break;
+		}
+		//a checksum byte pads the segments to 16 bytes, the appended digest covers the padding
+		verify->image_len = (end + 1 + 15) & ~15U;
+		if(verify->hash_appended)
+		{
+			ota_verify_expect(verify, OTA_VERIFY_DIGEST, verify->image_len, OTA_VERIFY_DIGEST_LEN);
+		}
+		else
+		{
+			verify->state = OTA_VERIFY_TRAILER;
+		}
+		break;
+
+	case OTA_VERIFY_DIGEST:
+		if(memcmp(verify->field, verify->image_digest, OTA_VERIFY_DIGEST_LEN) != 0)
+		{
+			verify->err = ESP_ERR_OTA_VALIDATE_FAILED;
+			return;
+		}
+		verify->state = OTA_VERIFY_TRAILER;
+		break;
+
+	default:
+		break;
+	}
+}
+
+void ota_verify_begin(ota_verify_t *verify, const uint8_t *expected)
+{
+	*verify = (ota_verify_t){0};
+	mbedtls_sha256_init(&verify->sha);
+	mbedtls_sha256_starts(&verify->sha, 0);
+	ota_verify_expect(verify, OTA_VERIFY_HEADER, 0, sizeof(esp_image_header_t));
+	if(expected != NULL)
+	{
+		memcpy(verify->expected, expected, OTA_VERIFY_DIGEST_LEN);
+		verify->has_expected = true;
+	}
+}
+
+esp_err_t ota_verify_update(ota_verify_t *verify, const void *data, size_t len)
+{
+	const uint8_t *bytes = data;
+
+	while(len > 0 && verify->err == ESP_OK)
+	{
+		size_t n = len;
+
+		if(verify->state != OTA_VERIFY_TRAILER)
+		{
+			if(verify->offset < verify->field_at)
+			{
+				//segment data, up to the next header or the digest
+				n = MIN(len, verify->field_at - verify->offset);
+			}
+			else
+			{
+				uint32_t gathered = verify->offset - verify->field_at;
+				n = MIN(len, verify->field_len - gathered);
+				memcpy(verify->field + gathered, bytes, n);
+			}
+		}
+		if(verify->state == OTA_VERIFY_DIGEST && verify->offset == verify->image_len)
+		{
+			//the hash so far is the one the build appended, the file hash goes on from a copy
+			mbedtls_sha256_context image;
+			mbedtls_sha256_init(&image);
+			mbedtls_sha256_clone(&image, &verify->sha);
+			mbedtls_sha256_finish(&image, verify->image_digest);
+			mbedtls_sha256_free(&image);
+		}
+		mbedtls_sha256_update(&verify->sha, bytes, n);
+		verify->offset += n;
+		bytes += n;
+		len -= n;
+
+		if(verify->state != OTA_VERIFY_TRAILER && verify->offset == verify->field_at + verify->field_len)
+		{
+			ota_verify_field(verify);
+		}
+	}
+	return verify->err;
+}
+
+esp_err_t ota_verify_finish(ota_verify_t *verify)
+{
+	uint8_t digest[OTA_VERIFY_DIGEST_LEN];
+	esp_err_t err = verify->err;
+
+	mbedtls_sha256_finish(&verify->sha, digest);
+	mbedtls_sha256_free(&verify->sha);
+	if(err == ESP_OK && (verify->state != OTA_VERIFY_TRAILER || verify->offset < verify->image_len))
+	{
+		err = ESP_ERR_OTA_VALIDATE_FAILED;
+	}
+	if(err == ESP_OK && verify->has_expected && memcmp(digest, verify->expected, OTA_VERIFY_DIGEST_LEN) != 0)
+	{
+		err = ESP_ERR_INVALID_CRC;
+	}
+	return err;
+}
+
+void ota_verify_abort(ota_verify_t *verify)
+{
+	mbedtls_sha256_free(&verify->sha);
+}
@@ -0,0 +1,96 @@
+/*
+ * ota_verify.h
+ *
+ *  Created on: Oct 19, 2026
+ *      Author: hamxa
+ */
+
+#ifndef MAIN_OTA_VERIFY_H_
+#define MAIN_OTA_VERIFY_H_
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "esp_err.h"
+#include "esp_app_format.h"
+#include "mbedtls/sha256.h"
+
+//SHA-256 digest, and its hex form in a job or a fetch request
+#define OTA_VERIFY_DIGEST_LEN			32
+#define OTA_VERIFY_DIGEST_HEX_LEN		(2 * OTA_VERIFY_DIGEST_LEN)
+
+/**
+ * Where the image bytes are being read
+ */
+typedef enum ota_verify_state
+{
+	OTA_VERIFY_HEADER = 0,		/**< OTA_VERIFY_HEADER, the image header */
+	OTA_VERIFY_SEGMENT,			/**< OTA_VERIFY_SEGMENT, a segment header and the data before it */
+	OTA_VERIFY_DIGEST,			/**< OTA_VERIFY_DIGEST, the SHA-256 appended to the image */
+	OTA_VERIFY_TRAILER			/**< OTA_VERIFY_TRAILER, the bytes after the image, a signature block or padding */
+}ota_verify_state_e;
+
+/**
+ * SHA-256 of an image computed as it is received. The header and segment headers are followed through the stream,
+ * so the digest the build appended to the image is checked as soon as it arrives, without reading the partition
+ * back
+ */
+typedef struct ota_verify
+{
+	mbedtls_sha256_context sha;	///> every byte received
+	ota_verify_state_e state;
+	uint32_t offset;			///> bytes received
+	uint32_t field_at;			///> offset of the header or digest being gathered
+	uint32_t field_len;
+	uint32_t segments;			///> segment headers still to come
+	uint32_t image_len;			///> bytes the appended digest covers, 0 until known
+	bool hash_appended;
+	bool has_expected;
+	esp_err_t err;				///> first error, the image is given up
+	uint8_t field[OTA_VERIFY_DIGEST_LEN];			///> header or digest gathered across chunks, the header is shorter
+	uint8_t image_digest[OTA_VERIFY_DIGEST_LEN];	///> SHA-256 of the first image_len bytes
+	uint8_t expected[OTA_VERIFY_DIGEST_LEN];		///> SHA-256 of the whole file, from the job or the request
+}ota_verify_t;
+
+/**
+ * @fn bool ota_verify_parse_digest(const char*, size_t, uint8_t*)
+ * @brief read a SHA-256 written as 64 hex digits, as sha256sum prints it
+ *
+ */
+bool ota_verify_parse_digest(const char *hex, size_t len, uint8_t *digest);
+
+/**
+ * @fn void ota_verify_begin(ota_verify_t*, const uint8_t*)
+ * @brief start hashing an image from its first byte
+ *
+ * @param expected SHA-256 of the whole file, NULL if the request did not carry one
+ */
+void ota_verify_begin(ota_verify_t *verify, const uint8_t *expected);
+
+/**
+ * @fn esp_err_t ota_verify_update(ota_verify_t*, const void*, size_t)
+ * @brief hash the next bytes of the image, in order, before they are written
+ *
+ * @return ESP_OK, ESP_ERR_OTA_VALIDATE_FAILED once the header is not one of an app image or the appended digest does
+ * 			not match, the same error for every later call
+ */
+esp_err_t ota_verify_update(ota_verify_t *verify, const void *data, size_t len);
+
+/**
+ * @fn esp_err_t ota_verify_finish(ota_verify_t*)
+ * @brief check the complete image and free the hash
+ *
+ * @return ESP_OK, ESP_ERR_OTA_VALIDATE_FAILED if the image is malformed or ended before its appended digest,
+ * 			ESP_ERR_INVALID_CRC if the file does not match the expected SHA-256
+ */
+esp_err_t ota_verify_finish(ota_verify_t *verify);
+
+/**
+ * @fn void ota_verify_abort(ota_verify_t*)
+ * @brief free the hash of an image given up, also safe after ota_verify_finish
+ *
+ */
+void ota_verify_abort(ota_verify_t *verify);
+
+#endif /* MAIN_OTA_VERIFY_H_ */
@@ -0,0 +1,90 @@
+/*
+ * report_filter.c
+ *
+ *  Created on: Oct 18, 2026
+ *      Author: hamxa
+ */
+#include <math.h>
+#include <string.h>
+
+#include "report_filter.h"
+
+void report_filter_init(report_filter_t *filter, const report_filter_metric_t *metrics, size_t count,
+						uint32_t base_interval_ms, uint32_t max_interval_ms, uint32_t max_silence_ms)
+{
+	memset(filter, 0, sizeof(*filter));
+	filter->count = count < REPORT_FILTER_MAX_METRICS ? count : REPORT_FILTER_MAX_METRICS;
+	memcpy(filter->metrics, metrics, filter->count * sizeof(metrics[0]));
+	filter->base_interval_ms = base_interval_ms ? base_interval_ms : 1;
+	filter->max_interval_ms = max_interval_ms > filter->base_interval_ms ? max_interval_ms : filter->base_interval_ms;
+	filter->max_silence_ms = max_silence_ms > filter->max_interval_ms ? max_silence_ms : filter->max_interval_ms;
+	filter->interval_ms = filter->base_interval_ms;
+}
+
+bool report_filter_due(const report_filter_t *filter, int64_t now_ms)
+{
+	return !filter->reported || now_ms >= filter->next_eval_ms;
+}
+
+bool report_filter_exceeds(const report_filter_t *filter, const float *values)
+{
+	if(!filter->reported)
+	{
+		return true;
+	}
+	for(size_t i = 0; i < filter->count; i++)
+	{
+		float change = fabsf(values[i] - filter->last[i]);
+		const report_filter_metric_t *metric = &filter->metrics[i];
+
+		//strictly past the relative band, a reference of 0 would otherwise let every reading through
+		if((metric->abs_deadband > 0 && change >= metric->abs_deadband) ||
+		   (metric->rel_deadband > 0 && change > metric->rel_deadband * fabsf(filter->last[i])))
+		{
+			return true;
+		}
+	}
+	return false;
+}
+
+bool report_filter_update(report_filter_t *filter, const float *values, int64_t now_ms)
+{
+	bool changed = report_filter_exceeds(filter, values);
+	bool heartbeat = !changed && now_ms - filter->last_report_ms >= filter->max_silence_ms;
+
+	filter->stats.evaluated++;
+
+	//a change brings the interval back to the base, a stable reading doubles it
+	if(changed)
+	{
+		filter->interval_ms = filter->base_interval_ms;
+	}
+	else
+	{
+		filter->interval_ms = filter->interval_ms > filter->max_interval_ms / 2 ? filter->max_interval_ms : filter->interval_ms * 2;
+	}
+
+	if(changed || heartbeat)
+	{
+		memcpy(filter->last, values, filter->count * sizeof(values[0]));
+		filter->last_report_ms = now_ms;
+		filter->reported = true;
+		filter->stats.reported++;
+		if(heartbeat)
+		{
+			filter->stats.heartbeats++;
+		}
+	}
+	else
+	{
+		filter->stats.suppressed++;
+	}
+
+	//never sleep past the heartbeat
+	filter->next_eval_ms = now_ms + filter->interval_ms;
+	if(filter->next_eval_ms > filter->last_report_ms + filter->max_silence_ms)
+	{
+		filter->next_eval_ms = filter->last_report_ms + filter->max_silence_ms;
+	}
+	return changed || heartbeat;
+}
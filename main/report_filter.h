@@ -0,0 +1,96 @@
+/*
+ * report_filter.h
+ *
+ *  Created on: Oct 18, 2026
+ *      Author: hamxa
+ */
+
+#ifndef MAIN_REPORT_FILTER_H_
+#define MAIN_REPORT_FILTER_H_
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+//Metrics one filter tracks
+#define REPORT_FILTER_MAX_METRICS		4
+
+/**
+ * Deadband of one metric, a report is due once the value moved past either bound since the last report
+ */
+typedef struct report_filter_metric
+{
+	float abs_deadband;				///> change in the metric's unit, 0 disables
+	float rel_deadband;				///> change beyond a fraction of the last reported value, 0 disables
+}report_filter_metric_t;
+
+/**
+ * Report-by-exception counters since init
+ */
+typedef struct report_filter_stats
+{
+	uint32_t evaluated;				///> readings compared against the deadbands
+	uint32_t reported;				///> reports due, changes and heartbeats
+	uint32_t heartbeats;			///> reports only due to the maximum silence, part of reported
+	uint32_t suppressed;			///> readings within the deadbands
+}report_filter_stats_t;
+
+/**
+ * Report-by-exception state of a set of metrics, owned by one task
+ */
+typedef struct report_filter
+{
+	report_filter_metric_t metrics[REPORT_FILTER_MAX_METRICS];
+	float last[REPORT_FILTER_MAX_METRICS];		///> values of the last report
+	size_t count;
+	uint32_t base_interval_ms;
+	uint32_t max_interval_ms;
+	uint32_t max_silence_ms;
+	uint32_t interval_ms;						///> current interval between evaluations
+	int64_t last_report_ms;
+	int64_t next_eval_ms;
+	bool reported;								///> there was a first report
+	report_filter_stats_t stats;
+}report_filter_t;
+
+/**
+ * @fn void report_filter_init(report_filter_t*, const report_filter_metric_t*, size_t, uint32_t, uint32_t, uint32_t)
+ * @brief set up a filter, the first reading is always reported
+ *
+ * @param filter filter to set up
+ * @param metrics deadband of every metric, in the order the values are passed
+ * @param count number of metrics, up to REPORT_FILTER_MAX_METRICS
+ * @param base_interval_ms interval between evaluations while values change
+ * @param max_interval_ms the interval doubles while values stay within their deadbands, up to this. A change past
+ * 			a deadband is reported at most this long after it happened
+ * @param max_silence_ms a heartbeat report is due after this long without one, at least max_interval_ms
+ */
+void report_filter_init(report_filter_t *filter, const report_filter_metric_t *metrics, size_t count,
+						uint32_t base_interval_ms, uint32_t max_interval_ms, uint32_t max_silence_ms);
+
+/**
+ * @fn bool report_filter_due(const report_filter_t*, int64_t)
+ * @brief check whether the next evaluation is due, readings in between need not be taken
+ *
+ * @param now_ms current time
+ */
+bool report_filter_due(const report_filter_t *filter, int64_t now_ms);
+
+/**
+ * @fn bool report_filter_update(report_filter_t*, const float*, int64_t)
+ * @brief compare a reading against the last report and schedule the next evaluation
+ *
+ * @param values one value per metric
+ * @param now_ms current time
+ * @return true if the reading is to be reported, it becomes the new reference
+ */
+bool report_filter_update(report_filter_t *filter, const float *values, int64_t now_ms);
+
+/**
+ * @fn bool report_filter_exceeds(const report_filter_t*, const float*)
+ * @brief check whether a reading moved past a deadband since the last report, without updating the filter
+ *
+ */
+bool report_filter_exceeds(const report_filter_t *filter, const float *values);
+
+#endif /* MAIN_REPORT_FILTER_H_ */
@@ -0,0 +1,140 @@
+/*
+ * report_filter_bench.c
+ *
+ *  Created on: Oct 18, 2026
+ *      Author: hamxa
+ */
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "esp_log.h"
+
+#include "dht11_sim.h"
+#include "report_filter.h"
+#include "report_filter_bench.h"
+
+static const char TAG[] = "report_filter_bench";
+
+/**
+ * One replayed trace, generated by the DHT11 simulation
+ */
+typedef struct report_filter_bench_trace
+{
+	const char *name;
+	dht11_sim_waveform_e waveform;
+	uint32_t period_ms;
+	int temperature_amplitude;
+	int humidity_amplitude;
+	int noise_amplitude;
+	uint32_t crc_error_ppm;
+	bool at_zero;				///> readings sit at 0 °C and 0 %RH instead of the default offsets
+	float rel_deadband;
+	uint32_t max_report_pct;	///> most samples reported, in percent, 0 for no bound
+}report_filter_bench_trace_t;
+
+static const report_filter_bench_trace_t g_traces[] = {
+		{"daily cycle", DHT11_SIM_WAVE_SINE, 24 * 3600 * 1000, 3, 8, 0, 0, false, 0, 0},
+		{"daily cycle, noisy, CRC errors", DHT11_SIM_WAVE_SINE, 24 * 3600 * 1000, 3, 8, 1, 5000, false, 0, 0},
+		{"thermostat steps", DHT11_SIM_WAVE_SQUARE, 130 * 60 * 1000 + 8000, 2, 5, 0, 0, false, 0, 0},
+		{"steady, noisy", DHT11_SIM_WAVE_CONSTANT, 0, 0, 0, 1, 0, false, 0, 0},
+		//a relative band around a reference of 0 must still suppress and back off
+		{"steady at zero, relative deadband", DHT11_SIM_WAVE_CONSTANT, 0, 0, 0, 0, 0, true, 0.05f, 5},
+};
+
+/**
+ * @fn bool report_filter_bench_replay(const report_filter_bench_trace_t*)
+ * @brief replay one trace sample by sample, the filter only sees the samples it asks for
+ *
+ * @return true if the staleness and silence bounds held
+ */
+static bool report_filter_bench_replay(const report_filter_bench_trace_t *trace)
+{
+	const report_filter_metric_t metrics[] = {
+			{REPORT_FILTER_BENCH_TEMP_DEADBAND, trace->rel_deadband},
+			{REPORT_FILTER_BENCH_HUM_DEADBAND, trace->rel_deadband},
+	};
+	dht11_sim_config_t config;
+	report_filter_t filter;
+	uint32_t samples = 0;
+	int64_t stale_since = -1;
+	int64_t max_stale = 0;
+	int64_t last_report = 0;
+	int64_t max_silence = 0;
+
+	DHT11_sim_get_default_config(&config);
+	config.waveform = trace->waveform;
+	config.period_ms = trace->period_ms;
+	config.temperature_amplitude = trace->temperature_amplitude;
+	config.humidity_amplitude = trace->humidity_amplitude;
+	config.noise_amplitude = trace->noise_amplitude;
+	config.crc_error_ppm = trace->crc_error_ppm;
+	if(trace->at_zero)
+	{
+		config.temperature_offset = 0;
+		config.humidity_offset = 0;
+	}
+	config.timeout_error_ppm = 0;
+	config.seed = 1;
+	DHT11_sim_configure(&config);
+
+	report_filter_init(&filter, metrics, sizeof(metrics) / sizeof(metrics[0]), REPORT_FILTER_BENCH_PERIOD_MS,
+					   REPORT_FILTER_BENCH_MAX_INTERVAL_MS, REPORT_FILTER_BENCH_MAX_SILENCE_MS);
+
+	for(int64_t now = 0; now < REPORT_FILTER_BENCH_TRACE_MS; now += REPORT_FILTER_BENCH_PERIOD_MS)
+	{
+		struct dht11_reading reading = DHT11_sim_read_at(now * 1000);
+		if(reading.status != DHT11_OK)
+		{
+			continue;
+		}
+		float values[] = {reading.temperature, reading.humidity};
+		samples++;
+
+		if(report_filter_due(&filter, now) && report_filter_update(&filter, values, now))
+		{
+			if(now - last_report > max_silence)
+			{
+				max_silence = now - last_report;
+			}
+			last_report = now;
+		}
+
+		//the reported values are stale from the first sample past a deadband until a report catches up
+		if(report_filter_exceeds(&filter, values))
+		{
+			if(stale_since < 0)
+			{
+				stale_since = now;
+			}
+		}
+		else if(stale_since >= 0)
+		{
+			if(now - stale_since > max_stale)
+			{
+				max_stale = now - stale_since;
+			}
+			stale_since = -1;
+		}
+	}
+
+	bool passed = max_stale <= REPORT_FILTER_BENCH_MAX_INTERVAL_MS && max_silence <= REPORT_FILTER_BENCH_MAX_SILENCE_MS &&
+			(trace->max_report_pct == 0 || (uint64_t)filter.stats.reported * 100 <= (uint64_t)samples * trace->max_report_pct);
+	ESP_LOGI(TAG, "%s: %s, %lu samples, %lu reports (%lu heartbeats), %lu%% fewer messages, "
+			"staleness max %lld ms bound %u ms, silence max %lld ms bound %u ms",
+			trace->name, passed ? "PASS" : "FAIL", (unsigned long)samples, (unsigned long)filter.stats.reported,
+			(unsigned long)filter.stats.heartbeats,
+			(unsigned long)(samples ? 100 - (uint64_t)filter.stats.reported * 100 / samples : 0),
+			(long long)max_stale, REPORT_FILTER_BENCH_MAX_INTERVAL_MS, (long long)max_silence, REPORT_FILTER_BENCH_MAX_SILENCE_MS);
+	return passed;
+}
+
+bool report_filter_bench_run(void)
+{
+	bool passed = true;
+
+	for(size_t i = 0; i < sizeof(g_traces) / sizeof(g_traces[0]); i++)
+	{
+		passed = report_filter_bench_replay(&g_traces[i]) && passed;
+	}
+	return passed;
+}
@@ -0,0 +1,34 @@
+/*
+ * report_filter_bench.h
+ *
+ *  Created on: Oct 18, 2026
+ *      Author: hamxa
+ */
+
+#ifndef MAIN_REPORT_FILTER_BENCH_H_
+#define MAIN_REPORT_FILTER_BENCH_H_
+
+#include <stdbool.h>
+
+//Length of every replayed trace
+#define REPORT_FILTER_BENCH_TRACE_MS		(24 * 3600 * 1000)
+
+//Sample period of the traces, the telemetry period
+#define REPORT_FILTER_BENCH_PERIOD_MS		4000
+
+//Deadbands and intervals replayed, the menuconfig defaults
+#define REPORT_FILTER_BENCH_TEMP_DEADBAND	2
+#define REPORT_FILTER_BENCH_HUM_DEADBAND	5
+#define REPORT_FILTER_BENCH_MAX_INTERVAL_MS	32000
+#define REPORT_FILTER_BENCH_MAX_SILENCE_MS	300000
+
+/**
+ * @fn bool report_filter_bench_run(void)
+ * @brief replay day-long DHT11 traces through the report-by-exception filter, log the messages saved against
+ * 			reporting every sample, and check the staleness and silence bounds
+ *
+ * @return true if every trace stayed within the bounds
+ */
+bool report_filter_bench_run(void);
+
+#endif /* MAIN_REPORT_FILTER_BENCH_H_ */
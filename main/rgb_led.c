@@ -139,3 +139,12 @@ void rgb_led_wifi_connected(void)
 
 
 
+
+void rgb_led_set(uint8_t red, uint8_t green, uint8_t blue)
+{
+	if(g_pwm_init_handle == false)
+	{
+		rgb_led_pwm_init();
+	}
+	rgb_led_set_color(red, green, blue);
+}
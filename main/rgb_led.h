@@ -8,6 +8,8 @@
 #ifndef MAIN_RGB_LED_H_
 #define MAIN_RGB_LED_H_
 
+#include <stdint.h>
+
 
 // RGB LED GPIOS
 #define RGB_LED_RED_GPIO 		21
@@ -48,5 +50,10 @@ void rgb_led_http_server_started(void);
  */
 void rgb_led_wifi_connected(void);
 
+/**
+ * Color set remotely, duty of each channel from 0 to 255
+ */
+void rgb_led_set(uint8_t red, uint8_t green, uint8_t blue);
+
 
 #endif /* MAIN_RGB_LED_H_ */
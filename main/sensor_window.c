@@ -0,0 +1,317 @@
+/*
+ * sensor_window.c
+ *
+ *  Created on: Oct 18, 2026
+ *      Author: hamxa
+ */
+#include <stdio.h>
+#include <string.h>
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+#include "esp_log.h"
+
+#include "cbor_writer.h"
+#include "sensor_window.h"
+
+#if (SENSOR_WINDOW_CAPACITY & (SENSOR_WINDOW_CAPACITY - 1)) != 0
+	#error "CONFIG_SENSOR_WINDOW_CAPACITY must be a power of two"
+#endif
+#if SENSOR_WINDOW_CAPACITY > 65536
+	#error "CONFIG_SENSOR_WINDOW_CAPACITY must fit the 16 bit deque indexes"
+#endif
+
+#define SENSOR_WINDOW_MASK		(SENSOR_WINDOW_CAPACITY - 1)
+
+static const char TAG[] = "sensor_window";
+
+/**
+ * Monotonic deque of sample ring indexes, the front holds the current extreme
+ */
+typedef struct sensor_window_deque
+{
+	uint16_t idx[SENSOR_WINDOW_CAPACITY];
+	uint32_t head;
+	uint32_t tail;
+}sensor_window_deque_t;
+
+/**
+ * One window over the shared sample ring of a metric
+ */
+typedef struct sensor_window
+{
+	uint32_t length_ms;
+	uint32_t tail_seq;		///> sequence number of the oldest sample inside the window
+	int64_t sum;
+	sensor_window_deque_t min_dq;
+	sensor_window_deque_t max_dq;
+}sensor_window_t;
+
+/**
+ * Sample ring shared by all windows of a metric, the longest window owns the oldest sample
+ */
+typedef struct sensor_window_metric
+{
+	int32_t value[SENSOR_WINDOW_CAPACITY];
+	uint32_t timestamp_ms[SENSOR_WINDOW_CAPACITY];
+	uint32_t head_seq;		///> sequence number of the next sample to be written
+	sensor_window_t window[SENSOR_WINDOW_COUNT];
+}sensor_window_metric_t;
+
+static const uint32_t g_window_lengths_s[SENSOR_WINDOW_COUNT] = SENSOR_WINDOW_LENGTHS_S;
+
+static const char *const g_metric_names[SENSOR_METRIC_MAX] = {
+		[SENSOR_METRIC_TEMPERATURE] = "temp",
+		[SENSOR_METRIC_HUMIDITY] = "humidity",
+#if CONFIG_ADC_ACQ_ENABLE
+		[SENSOR_METRIC_ANALOG] = "analog_mv",
+#endif
+};
+
+static sensor_window_metric_t g_metrics[SENSOR_METRIC_MAX];
+
+//mutex guarding the windows, written by the sampling task and read by the HTTP and MQTT tasks
+static SemaphoreHandle_t g_window_mutex = NULL;
+
+static inline uint32_t sensor_window_dq_size(const sensor_window_deque_t *dq)
+{
+	return dq->head - dq->tail;
+}
+
+static inline uint16_t sensor_window_dq_front(const sensor_window_deque_t *dq)
+{
+	return dq->idx[dq->tail & SENSOR_WINDOW_MASK];
+}
+
+static inline uint16_t sensor_window_dq_back(const sensor_window_deque_t *dq)
+{
+	return dq->idx[(dq->head - 1) & SENSOR_WINDOW_MASK];
+}
+
+/**
+ * @fn void sensor_window_evict_oldest(sensor_window_metric_t*, sensor_window_t*)
+ * @brief remove the oldest sample of a window, updating the running sum and both deques
+ *
+ * @param m metric owning the sample ring
+ * @param w window to shrink, must not be empty
+ */
+static void sensor_window_evict_oldest(sensor_window_metric_t *m, sensor_window_t *w)
+{
+	uint16_t idx = w->tail_seq & SENSOR_WINDOW_MASK;
+
+	w->sum -= m->value[idx];
+	if(sensor_window_dq_size(&w->min_dq) && sensor_window_dq_front(&w->min_dq) == idx)
+	{
+		w->min_dq.tail++;
+	}
+	if(sensor_window_dq_size(&w->max_dq) && sensor_window_dq_front(&w->max_dq) == idx)
+	{
+		w->max_dq.tail++;
+	}
+	w->tail_seq++;
+}
+
+/**
+ * @fn void sensor_window_expire(sensor_window_metric_t*, uint32_t)
+ * @brief drop samples that fell out of each window
+ *
+ * @param m metric to expire
+ * @param now_ms current monotonic time in milliseconds
+ */
+static void sensor_window_expire(sensor_window_metric_t *m, uint32_t now_ms)
+{
+	for(int i = 0; i < SENSOR_WINDOW_COUNT; i++)
+	{
+		sensor_window_t *w = &m->window[i];
+		while(w->tail_seq != m->head_seq &&
+			  (uint32_t)(now_ms - m->timestamp_ms[w->tail_seq & SENSOR_WINDOW_MASK]) >= w->length_ms)
+		{
+			sensor_window_evict_oldest(m, w);
+		}
+	}
+}
+
+void sensor_window_init(void)
+{
+	memset(g_metrics, 0x00, sizeof(g_metrics));
+	for(int metric = 0; metric < SENSOR_METRIC_MAX; metric++)
+	{
+		for(int i = 0; i < SENSOR_WINDOW_COUNT; i++)
+		{
+			g_metrics[metric].window[i].length_ms = g_window_lengths_s[i] * 1000;
+		}
+	}
+	if(g_window_mutex == NULL)
+	{
+		g_window_mutex = xSemaphoreCreateMutex();
+	}
+	ESP_LOGI(TAG, "sensor_window_init: %d windows per metric, %d samples capacity", SENSOR_WINDOW_COUNT, SENSOR_WINDOW_CAPACITY);
+}
+
+void sensor_window_add(sensor_metric_e metric, int32_t value, uint32_t timestamp_ms)
+{
+	if(metric >= SENSOR_METRIC_MAX || g_window_mutex == NULL)
+	{
+		return;
+	}
+	sensor_window_metric_t *m = &g_metrics[metric];
+
+	xSemaphoreTake(g_window_mutex, portMAX_DELAY);
+
+	sensor_window_expire(m, timestamp_ms);
+
+	//ring is full: the slot about to be overwritten leaves every window still holding it
+	if(m->head_seq - m->window[SENSOR_WINDOW_COUNT - 1].tail_seq == SENSOR_WINDOW_CAPACITY)
+	{
+		uint32_t oldest_seq = m->window[SENSOR_WINDOW_COUNT - 1].tail_seq;
+		for(int i = 0; i < SENSOR_WINDOW_COUNT; i++)
+		{
+			if(m->window[i].tail_seq == oldest_seq)
+			{
+				sensor_window_evict_oldest(m, &m->window[i]);
+			}
+		}
+	}
+
+	uint16_t idx = m->head_seq & SENSOR_WINDOW_MASK;
+	m->value[idx] = value;
+	m->timestamp_ms[idx] = timestamp_ms;
+	m->head_seq++;
+
+	for(int i = 0; i < SENSOR_WINDOW_COUNT; i++)
+	{
+		sensor_window_t *w = &m->window[i];
+		w->sum += value;
+
+		//keep min deque increasing and max deque decreasing from front to back
+		while(sensor_window_dq_size(&w->min_dq) && m->value[sensor_window_dq_back(&w->min_dq)] >= value)
+		{
+			w->min_dq.head--;
+		}
+		w->min_dq.idx[w->min_dq.head++ & SENSOR_WINDOW_MASK] = idx;
+
+		while(sensor_window_dq_size(&w->max_dq) && m->value[sensor_window_dq_back(&w->max_dq)] <= value)
+		{
+			w->max_dq.head--;
+		}
+		w->max_dq.idx[w->max_dq.head++ & SENSOR_WINDOW_MASK] = idx;
+	}
+
+	xSemaphoreGive(g_window_mutex);
+}
+
+bool sensor_window_get_stats(sensor_metric_e metric, uint8_t window, uint32_t now_ms, sensor_window_stats_t *stats)
+{
+	if(metric >= SENSOR_METRIC_MAX || window >= SENSOR_WINDOW_COUNT || g_window_mutex == NULL)
+	{
+		return false;
+	}
+	sensor_window_metric_t *m = &g_metrics[metric];
+	sensor_window_t *w = &m->window[window];
+
+	xSemaphoreTake(g_window_mutex, portMAX_DELAY);
+
+	sensor_window_expire(m, now_ms);
+
+	memset(stats, 0x00, sizeof(sensor_window_stats_t));
+	stats->window_s = g_window_lengths_s[window];
+	stats->count = m->head_seq - w->tail_seq;
+	if(stats->count)
+	{
+		stats->min = m->value[sensor_window_dq_front(&w->min_dq)];
+		stats->max = m->value[sensor_window_dq_front(&w->max_dq)];
+		stats->mean = (float)w->sum / (float)stats->count;
+	}
+
+	xSemaphoreGive(g_window_mutex);
+
+	return stats->count != 0;
+}
+
+int sensor_window_to_json(char *buf, size_t len, uint32_t now_ms)
+{
+	size_t pos = 0;
+	int n;
+	sensor_window_stats_t stats;
+
+	n = snprintf(buf, len, "{\"windows\":[");
+	if(n < 0 || (size_t)n >= len)
+	{
+		return -1;
+	}
+	pos += n;
+
+	for(uint8_t i = 0; i < SENSOR_WINDOW_COUNT; i++)
+	{
+		n = snprintf(buf + pos, len - pos, "%s{\"window_s\":%lu", i ? "," : "", (unsigned long)g_window_lengths_s[i]);
+		if(n < 0 || (size_t)n >= len - pos)
+		{
+			return -1;
+		}
+		pos += n;
+
+		for(int metric = 0; metric < SENSOR_METRIC_MAX; metric++)
+		{
+			sensor_window_get_stats(metric, i, now_ms, &stats);
+			n = snprintf(buf + pos, len - pos, ",\"%s\":{\"count\":%lu,\"min\":%ld,\"max\":%ld,\"mean\":%.2f}",
+					g_metric_names[metric], (unsigned long)stats.count, (long)stats.min, (long)stats.max, stats.mean);
+			if(n < 0 || (size_t)n >= len - pos)
+			{
+				return -1;
+			}
+			pos += n;
+		}
+
+		n = snprintf(buf + pos, len - pos, "}");
+		if(n < 0 || (size_t)n >= len - pos)
+		{
+			return -1;
+		}
+		pos += n;
+	}
+
+	n = snprintf(buf + pos, len - pos, "]}");
+	if(n < 0 || (size_t)n >= len - pos)
+	{
+		return -1;
+	}
+	pos += n;
+
+	return (int)pos;
+}
+
+int sensor_window_to_cbor(void *buf, size_t len, uint32_t now_ms)
+{
+	cbor_writer_t writer;
+	sensor_window_stats_t stats;
+
+	//same layout as sensor_window_to_json
+	cbor_writer_init(&writer, buf, len);
+	cbor_write_map(&writer, 1);
+	cbor_write_text(&writer, "windows");
+	cbor_write_array(&writer, SENSOR_WINDOW_COUNT);
+
+	for(uint8_t i = 0; i < SENSOR_WINDOW_COUNT; i++)
+	{
+		cbor_write_map(&writer, 1 + SENSOR_METRIC_MAX);
+		cbor_write_text(&writer, "window_s");
+		cbor_write_uint(&writer, g_window_lengths_s[i]);
+
+		for(int metric = 0; metric < SENSOR_METRIC_MAX; metric++)
+		{
+			sensor_window_get_stats(metric, i, now_ms, &stats);
+			cbor_write_text(&writer, g_metric_names[metric]);
+			cbor_write_map(&writer, 4);
+			cbor_write_text(&writer, "count");
+			cbor_write_uint(&writer, stats.count);
+			cbor_write_text(&writer, "min");
+			cbor_write_int(&writer, stats.min);
+			cbor_write_text(&writer, "max");
+			cbor_write_int(&writer, stats.max);
+			cbor_write_text(&writer, "mean");
+			cbor_write_float(&writer, stats.mean);
+		}
+	}
+
+	return cbor_writer_finish(&writer);
+}
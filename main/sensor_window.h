@@ -0,0 +1,105 @@
+/*
+ * sensor_window.h
+ *
+ *  Created on: Oct 18, 2026
+ *      Author: hamxa
+ */
+
+#ifndef MAIN_SENSOR_WINDOW_H_
+#define MAIN_SENSOR_WINDOW_H_
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "sdkconfig.h"
+
+//Number of simultaneous windows kept per metric
+#define SENSOR_WINDOW_COUNT			3
+
+//Window lengths in seconds, must be in ascending order
+#define SENSOR_WINDOW_LENGTHS_S		{ 60, 600, 1800 }
+
+//Samples kept per metric (power of two), bounds the longest window at high sample rates
+#define SENSOR_WINDOW_CAPACITY		CONFIG_SENSOR_WINDOW_CAPACITY
+
+//Buffer size that holds sensor_window_to_json() for every metric
+#define SENSOR_WINDOW_JSON_MAX_LEN	1024U
+
+/**
+ * Metrics fed into the sliding windows
+ */
+typedef enum sensor_metric
+{
+	SENSOR_METRIC_TEMPERATURE = 0,	/**< SENSOR_METRIC_TEMPERATURE */
+	SENSOR_METRIC_HUMIDITY,			/**< SENSOR_METRIC_HUMIDITY */
+#if CONFIG_ADC_ACQ_ENABLE
+	SENSOR_METRIC_ANALOG,			/**< SENSOR_METRIC_ANALOG, decimated analog probe in mV */
+#endif
+	SENSOR_METRIC_MAX
+}sensor_metric_e;
+
+/**
+ * Aggregate of one metric over one window
+ */
+typedef struct sensor_window_stats
+{
+	uint32_t window_s;
+	uint32_t count;
+	int32_t min;
+	int32_t max;
+	float mean;
+}sensor_window_stats_t;
+
+/**
+ * @fn void sensor_window_init(void)
+ * @brief initialize the sliding windows, must be called before any sample is added
+ *
+ */
+void sensor_window_init(void);
+
+/**
+ * @fn void sensor_window_add(sensor_metric_e, int32_t, uint32_t)
+ * @brief add a sample to every window of the metric and expire old samples, amortized O(1)
+ *
+ * @param metric the metric the sample belongs to
+ * @param value sample value
+ * @param timestamp_ms monotonic sample time in milliseconds
+ */
+void sensor_window_add(sensor_metric_e metric, int32_t value, uint32_t timestamp_ms);
+
+/**
+ * @fn bool sensor_window_get_stats(sensor_metric_e, uint8_t, uint32_t, sensor_window_stats_t*)
+ * @brief get min/max/mean/count of a metric over one window in constant time
+ *
+ * @param metric the metric to query
+ * @param window index of the window in SENSOR_WINDOW_LENGTHS_S
+ * @param now_ms current monotonic time in milliseconds, samples older than the window are expired
+ * @param stats output aggregate
+ * @return true if the window holds at least one sample
+ */
+bool sensor_window_get_stats(sensor_metric_e metric, uint8_t window, uint32_t now_ms, sensor_window_stats_t *stats);
+
+/**
+ * @fn int sensor_window_to_json(char*, size_t, uint32_t)
+ * @brief format the aggregates of all windows and metrics as JSON
+ *
+ * @param buf output buffer
+ * @param len size of the output buffer
+ * @param now_ms current monotonic time in milliseconds
+ * @return number of characters written, or -1 if the buffer is too small
+ */
+int sensor_window_to_json(char *buf, size_t len, uint32_t now_ms);
+
+/**
+ * @fn int sensor_window_to_cbor(void*, size_t, uint32_t)
+ * @brief encode the aggregates of all windows and metrics as CBOR, with the keys of sensor_window_to_json
+ *
+ * @param buf output buffer, SENSOR_WINDOW_JSON_MAX_LEN bytes always hold it
+ * @param len size of the output buffer
+ * @param now_ms current monotonic time in milliseconds
+ * @return number of bytes written, or -1 if the buffer is too small
+ */
+int sensor_window_to_cbor(void *buf, size_t len, uint32_t now_ms);
+
+#endif /* MAIN_SENSOR_WINDOW_H_ */
@@ -0,0 +1,181 @@
+/*
+ * sensor_window_bench.c
+ *
+ *  Created on: Oct 19, 2026
+ *      Author: hamxa
+ */
+#include <stdint.h>
+#include <time.h>
+
+#include "esp_log.h"
+
+#include "sensor_window.h"
+#include "sensor_window_bench.h"
+
+static const char TAG[] = "sensor_window_bench";
+
+/**
+ * Cost and outcome at one sample period
+ */
+typedef struct sensor_window_bench_result
+{
+	uint32_t samples;
+	uint32_t queries;
+	uint32_t mismatches;
+	uint32_t held[SENSOR_WINDOW_COUNT];	///> most samples a window held
+	int64_t add_ns;
+	int64_t query_ns;
+	int64_t rescan_ns;					///> rescans of the longest window
+}sensor_window_bench_result_t;
+
+//the samples the windows may still hold, newest at g_count - 1
+static int32_t g_values[SENSOR_WINDOW_CAPACITY];
+static uint32_t g_timestamps_ms[SENSOR_WINDOW_CAPACITY];
+static uint32_t g_count;
+
+static volatile int64_t g_sink;
+
+/**
+ * @fn int64_t sensor_window_bench_now_ns(void)
+ * @brief monotonic time
+ *
+ */
+static int64_t sensor_window_bench_now_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (int64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+/**
+ * @fn uint32_t sensor_window_bench_random(uint32_t*)
+ * @brief xorshift32, the same samples on every run
+ *
+ */
+static uint32_t sensor_window_bench_random(uint32_t *state)
+{
+	uint32_t x = *state;
+
+	x ^= x << 13;
+	x ^= x >> 17;
+	x ^= x << 5;
+	*state = x;
+	return x;
+}
+
+/**
+ * @fn void sensor_window_bench_rescan(uint32_t, uint32_t, sensor_window_stats_t*)
+ * @brief aggregate the samples of a window by scanning them, as a query without the deques would
+ *
+ */
+static void sensor_window_bench_rescan(uint32_t length_ms, uint32_t now_ms, sensor_window_stats_t *stats)
+{
+	int64_t sum = 0;
+
+	*stats = (sensor_window_stats_t){0};
+	for(uint32_t n = 0; n < g_count && n < SENSOR_WINDOW_CAPACITY; n++)
+	{
+		uint32_t i = (g_count - 1 - n) % SENSOR_WINDOW_CAPACITY;
+		if(now_ms - g_timestamps_ms[i] >= length_ms)
+		{
+			break;
+		}
+		stats->min = stats->count == 0 || g_values[i] < stats->min ? g_values[i] : stats->min;
+		stats->max = stats->count == 0 || g_values[i] > stats->max ? g_values[i] : stats->max;
+		sum += g_values[i];
+		stats->count++;
+	}
+	if(stats->count)
+	{
+		stats->mean = (float)sum / (float)stats->count;
+	}
+}
+
+/**
+ * @fn void sensor_window_bench_period(uint32_t, sensor_window_bench_result_t*)
+ * @brief feed the temperature windows a random walk with falling runs, the worst case of the min deque, at one
+ * 			sample period, starting an hour before the millisecond clock wraps
+ *
+ */
+static void sensor_window_bench_period(uint32_t period_ms, sensor_window_bench_result_t *result)
+{
+	static const uint32_t lengths_s[SENSOR_WINDOW_COUNT] = SENSOR_WINDOW_LENGTHS_S;
+	uint32_t now_ms = UINT32_MAX - 3600 * 1000;
+	uint32_t seed = period_ms;
+	int32_t value = 0;
+
+	*result = (sensor_window_bench_result_t){0};
+	sensor_window_init();
+	g_count = 0;
+
+	for(uint32_t elapsed_ms = 0; elapsed_ms < SENSOR_WINDOW_BENCH_DURATION_MS; elapsed_ms += period_ms, now_ms += period_ms)
+	{
+		//a quarter of the time the value only falls, every sample ends up in the min deque
+		value += (result->samples / 1024) % 4 == 3 ? -1 : (int32_t)(sensor_window_bench_random(&seed) % 7) - 3;
+		g_values[g_count % SENSOR_WINDOW_CAPACITY] = value;
+		g_timestamps_ms[g_count % SENSOR_WINDOW_CAPACITY] = now_ms;
+		g_count++;
+
+		int64_t start = sensor_window_bench_now_ns();
+		sensor_window_add(SENSOR_METRIC_TEMPERATURE, value, now_ms);
+		result->add_ns += sensor_window_bench_now_ns() - start;
+		result->samples++;
+
+		if(result->samples % SENSOR_WINDOW_BENCH_CHECK_EVERY != 0)
+		{
+			continue;
+		}
+		for(uint8_t w = 0; w < SENSOR_WINDOW_COUNT; w++)
+		{
+			sensor_window_stats_t stats, expected;
+
+			start = sensor_window_bench_now_ns();
+			sensor_window_get_stats(SENSOR_METRIC_TEMPERATURE, w, now_ms, &stats);
+			result->query_ns += sensor_window_bench_now_ns() - start;
+			result->queries++;
+
+			start = sensor_window_bench_now_ns();
+			sensor_window_bench_rescan(lengths_s[w] * 1000, now_ms, &expected);
+			if(w == SENSOR_WINDOW_COUNT - 1)
+			{
+				result->rescan_ns += sensor_window_bench_now_ns() - start;
+			}
+			g_sink += expected.count;
+
+			if(stats.count != expected.count || stats.min != expected.min || stats.max != expected.max ||
+			   stats.mean != expected.mean)
+			{
+				result->mismatches++;
+			}
+			result->held[w] = stats.count > result->held[w] ? stats.count : result->held[w];
+		}
+	}
+}
+
+bool sensor_window_bench_run(void)
+{
+	static const uint32_t periods_ms[] = SENSOR_WINDOW_BENCH_PERIODS_MS;
+	static const uint32_t lengths_s[SENSOR_WINDOW_COUNT] = SENSOR_WINDOW_LENGTHS_S;
+	sensor_window_bench_result_t result;
+	bool passed = true;
+
+	for(size_t p = 0; p < sizeof(periods_ms) / sizeof(periods_ms[0]); p++)
+	{
+		sensor_window_bench_period(periods_ms[p], &result);
+		passed = passed && result.mismatches == 0;
+		ESP_LOGI(TAG, "%lu ms period: %s, %lu samples, %lu queries, %lu mismatches; up to %lu/%lu/%lu samples in the "
+				"%lu/%lu/%lu s windows; %lld ns per add, %lld ns per query, %lld ns per rescan of the %lu s window",
+				(unsigned long)periods_ms[p], result.mismatches == 0 ? "PASS" : "FAIL", (unsigned long)result.samples,
+				(unsigned long)result.queries, (unsigned long)result.mismatches, (unsigned long)result.held[0],
+				(unsigned long)result.held[1], (unsigned long)result.held[2], (unsigned long)lengths_s[0],
+				(unsigned long)lengths_s[1], (unsigned long)lengths_s[2], (long long)(result.add_ns / result.samples),
+				(long long)(result.query_ns / result.queries),
+				(long long)(result.rescan_ns / (result.queries / SENSOR_WINDOW_COUNT)),
+				(unsigned long)lengths_s[SENSOR_WINDOW_COUNT - 1]);
+	}
+
+	//the sampling path starts from empty windows
+	sensor_window_init();
+	return passed;
+}
@@ -0,0 +1,33 @@
+/*
+ * sensor_window_bench.h
+ *
+ *  Created on: Oct 19, 2026
+ *      Author: hamxa
+ */
+
+#ifndef MAIN_SENSOR_WINDOW_BENCH_H_
+#define MAIN_SENSOR_WINDOW_BENCH_H_
+
+#include <stdbool.h>
+
+//Simulated time fed at each sample period, longer than the longest window
+#define SENSOR_WINDOW_BENCH_DURATION_MS		(2 * 3600 * 1000)
+
+//Sample periods, the DHT11 task's down to a rate where the capacity bounds every window
+#define SENSOR_WINDOW_BENCH_PERIODS_MS		{ 4000, 1000, 250, 50 }
+
+//Every this many samples each window is queried and checked against a rescan of the samples
+#define SENSOR_WINDOW_BENCH_CHECK_EVERY		16
+
+/**
+ * @fn bool sensor_window_bench_run(void)
+ * @brief feed samples at periods from the DHT11 task's upwards, so the windows hold from a few samples up to the
+ * 			capacity, through a wrap of the millisecond clock. Checks the min, max, mean and count of every window
+ * 			against a rescan of the samples it holds, and logs the time per add, per query and per rescan
+ * 			of the longest window. Leaves the windows initialized and empty
+ *
+ * @return true if every query matched the rescan
+ */
+bool sensor_window_bench_run(void);
+
+#endif /* MAIN_SENSOR_WINDOW_BENCH_H_ */
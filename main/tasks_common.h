@@ -34,6 +34,11 @@
 #define DHT11_TASK_PRIORITY					5
 #define DHT11_TASK_CORE_ID					1
 
+//Analog probe acquisition task
+#define ADC_ACQ_TASK_STACK_SIZE				4096
+#define ADC_ACQ_TASK_PRIORITY				5
+#define ADC_ACQ_TASK_CORE_ID				1
+
 //sntp time sync task
 #define SNTP_TIME_SYNC_TASK_TASK_STACK_SIZE	4096
 #define SNTP_TIME_SYNC_TASK_TASK_PRIORITY	4
@@ -43,4 +48,44 @@
 #define AWS_IOT_TASK_STACK_SIZE				9216
 #define AWS_IOT_TASK_PRIORITY				6
 #define AWS_IOT_TASK_CORE_ID				1
+
+//MQTT agent task, owns the broker connection
+#define MQTT_AGENT_TASK_STACK_SIZE			9216
+#define MQTT_AGENT_TASK_PRIORITY			6
+#define MQTT_AGENT_TASK_CORE_ID				1
+
+//MQTT RPC task, runs the remote calls through the device API
+#define MQTT_RPC_TASK_STACK_SIZE			4096
+#define MQTT_RPC_TASK_PRIORITY				6
+#define MQTT_RPC_TASK_CORE_ID				1
+
+//MQTT OTA task, writes the image blocks to flash below the agent
+#define MQTT_OTA_TASK_STACK_SIZE			4096
+#define MQTT_OTA_TASK_PRIORITY				5
+#define MQTT_OTA_TASK_CORE_ID				1
+
+//HTTP OTA fetch task, receives the image, TLS needs the larger stack
+#define HTTP_OTA_TASK_STACK_SIZE			8192
+#define HTTP_OTA_TASK_PRIORITY				5
+#define HTTP_OTA_TASK_CORE_ID				1
+
+//HTTP OTA flash task, writes the received image below the fetch task
+#define HTTP_OTA_FLASH_TASK_STACK_SIZE		3072
+#define HTTP_OTA_FLASH_TASK_PRIORITY		4
+#define HTTP_OTA_FLASH_TASK_CORE_ID			1
+
+//OTA health task, checks the first boot of a new image, its loopback request needs the HTTP client
+#define OTA_HEALTH_TASK_STACK_SIZE			4096
+#define OTA_HEALTH_TASK_PRIORITY			3
+#define OTA_HEALTH_TASK_CORE_ID				0
+
+//Telemetry producer task
+#define TELEMETRY_TASK_STACK_SIZE			4096
+#define TELEMETRY_TASK_PRIORITY				5
+#define TELEMETRY_TASK_CORE_ID				1
+
+//Telemetry sink tasks, one per sink that may block, below the producer
+#define TELEMETRY_SINK_TASK_STACK_SIZE		3072
+#define TELEMETRY_SINK_TASK_PRIORITY		4
+#define TELEMETRY_SINK_TASK_CORE_ID			1
 #endif /* MAIN_TASKS_COMMON_H_ */
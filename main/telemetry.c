@@ -0,0 +1,546 @@
+/*
+ * telemetry.c
+ *
+ *  Created on: Oct 18, 2026
+ *      Author: hamxa
+ */
+#include "sdkconfig.h"
+
+#if CONFIG_MQTT_PERSISTENT_SESSION
+
+#include <stdio.h>
+#include <string.h>
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+
+#include "dht11.h"
+#include "mqtt_agent.h"
+#include "mqtt_batch.h"
+#include "mqtt_metrics.h"
+#include "mqtt_outbox.h"
+#include "mqtt_topic_alias.h"
+#include "mqtt_transport.h"
+#include "report_filter.h"
+#include "sensor_window.h"
+#include "tasks_common.h"
+#include "telemetry.h"
+#include "telemetry_codec.h"
+#include "telemetry_sink.h"
+#include "wifi_app.h"
+
+//efficiency reports are only logged when there is something to report on
+#define TELEMETRY_REPORTS		(CONFIG_MQTT_BATCH_MAX_SAMPLES > 1 || CONFIG_MQTT_OUTBOX || CONFIG_MQTT_REPORT_BY_EXCEPTION || \
+								 CONFIG_TELEMETRY_UDP_SINK)
+
+static const char TAG[] = "telemetry";
+
+static TaskHandle_t g_telemetry_task = NULL;
+
+//samples neither the agent nor the outbox could take, the queue is not waited on so the schedule does not drift
+static uint32_t g_dropped = 0;
+
+#if CONFIG_MQTT_BATCH_MAX_SAMPLES <= 1
+//publishes the samples to the cloud broker, drained by the telemetry task itself since it never blocks. Batched
+//samples are encoded straight into the batch instead
+static telemetry_sink_t g_cloud_sink;
+#endif
+
+#if CONFIG_TELEMETRY_UDP_SINK
+//plant-floor collector, drained by a task of its own
+static telemetry_sink_udp_t g_udp;
+static telemetry_sink_t g_udp_sink;
+#endif
+
+#if CONFIG_MQTT_BATCH_MAX_SAMPLES > 1
+//samples waiting for the next batch publish
+static mqtt_batch_t g_batch;
+#endif
+
+#if CONFIG_MQTT_REPORT_BY_EXCEPTION
+//decides which samples changed enough to be published
+static report_filter_t g_report;
+#endif
+
+#if CONFIG_MQTT_TOPIC_ALIASES
+//every topic the task publishes to, the per-sample ones carry most of the traffic
+static const char *const g_alias_topics[] = {
+		TELEMETRY_SAMPLE_TOPIC,
+		TELEMETRY_BATCH_TOPIC,
+		TELEMETRY_SUMMARY_TOPIC,
+		TELEMETRY_DIAGNOSTICS_TOPIC,
+};
+#endif
+
+/**
+ * @fn void telemetry_publish(const char*, const char*, size_t, MQTTQoS_t)
+ * @brief queue one publish on the agent without waiting
+ *
+ */
+static void telemetry_publish(const char *topic, const char *payload, size_t len, MQTTQoS_t qos)
+{
+	esp_err_t err = mqtt_agent_publish(topic, payload, len, qos, NULL, NULL, 0);
+	if(err != ESP_OK)
+	{
+		g_dropped++;
+		ESP_LOGW(TAG, "telemetry_publish: %s dropped, %s, %lu dropped so far", topic, esp_err_to_name(err), (unsigned long)g_dropped);
+	}
+}
+
+#if CONFIG_MQTT_OUTBOX
+/**
+ * @fn esp_err_t telemetry_outbox_send(void*, const char*, const void*, size_t, void*)
+ * @brief hand a stored sample back to the agent, the outbox keeps it until the PUBACK
+ *
+ */
+static esp_err_t telemetry_outbox_send(void *ctx, const char *topic, const void *payload, size_t len, void *token)
+{
+	return mqtt_agent_publish(topic, payload, len, MQTTQoS1, mqtt_outbox_sent, token, 0);
+}
+
+/**
+ * @fn void telemetry_outbox_init(void)
+ * @brief open the outbox partition and recover what the last run left in it
+ *
+ */
+static void telemetry_outbox_init(void)
+{
+	mqtt_outbox_flash_t flash;
+#if CONFIG_MQTT_OUTBOX_DROP_NEWEST
+	mqtt_outbox_policy_e policy = MQTT_OUTBOX_DROP_NEWEST;
+#else
+	mqtt_outbox_policy_e policy = MQTT_OUTBOX_DROP_OLDEST;
+#endif
+
+	esp_err_t err = mqtt_outbox_flash_partition(&flash, MQTT_OUTBOX_PARTITION_LABEL);
+	if(err == ESP_OK)
+	{
+		err = mqtt_outbox_init(&flash, policy);
+	}
+	if(err != ESP_OK)
+	{
+		ESP_LOGE(TAG, "telemetry_outbox_init: outbox not available, %s", esp_err_to_name(err));
+	}
+}
+
+/**
+ * @fn void telemetry_drain_outbox(void)
+ * @brief write out the staged samples when due and send stored ones while connected
+ *
+ */
+static void telemetry_drain_outbox(void)
+{
+	size_t space = mqtt_agent_queue_space();
+	size_t budget = 0;
+
+	mqtt_outbox_poll(esp_timer_get_time(), CONFIG_MQTT_OUTBOX_FLUSH_MS);
+
+	//the backfill only takes the spare half of the agent queue, live samples always find room
+	if(mqtt_agent_is_connected() && space > MQTT_AGENT_QUEUE_LENGTH / 2)
+	{
+		budget = space - MQTT_AGENT_QUEUE_LENGTH / 2;
+		if(budget > CONFIG_MQTT_OUTBOX_DRAIN_RATE)
+		{
+			budget = CONFIG_MQTT_OUTBOX_DRAIN_RATE;
+		}
+	}
+	mqtt_outbox_drain(telemetry_outbox_send, NULL, budget);
+}
+#endif
+
+/**
+ * @fn esp_err_t telemetry_publish_reliable(const char*, const char*, size_t, mqtt_agent_done_cb_t, void*, bool*)
+ * @brief queue a QoS1 sample publish, or keep it in the flash outbox while the broker cannot be reached
+ *
+ * @param queued set if the agent took the publish, done_cb is only called then
+ * @return ESP_OK if the publish was queued or stored
+ */
+static esp_err_t telemetry_publish_reliable(const char *topic, const char *payload, size_t len,
+											mqtt_agent_done_cb_t done_cb, void *ctx, bool *queued)
+{
+	*queued = false;
+#if CONFIG_MQTT_OUTBOX
+	//the agent queue would hold the sample too, but only the outbox survives a reset
+	if(!mqtt_agent_is_connected())
+	{
+		return mqtt_outbox_put(topic, payload, len, esp_timer_get_time());
+	}
+#endif
+	esp_err_t err = mqtt_agent_publish(topic, payload, len, MQTTQoS1, done_cb, ctx, 0);
+	*queued = err == ESP_OK;
+#if CONFIG_MQTT_OUTBOX
+	if(err != ESP_OK && mqtt_outbox_put(topic, payload, len, esp_timer_get_time()) == ESP_OK)
+	{
+		return ESP_OK;
+	}
+#endif
+	return err;
+}
+
+#if CONFIG_MQTT_BATCH_MAX_SAMPLES > 1
+/**
+ * @fn void telemetry_flush_batch(int8_t)
+ * @brief queue the collected samples as one QoS1 publish and adapt the next batch size to the link
+ *
+ * @param rssi current Wi-Fi RSSI
+ */
+static void telemetry_flush_batch(int8_t rssi)
+{
+	size_t len = 0;
+	const char *payload = mqtt_batch_finish(&g_batch, &len);
+	if(payload == NULL)
+	{
+		return;
+	}
+
+	bool queued = false;
+	esp_err_t err = telemetry_publish_reliable(TELEMETRY_BATCH_TOPIC, payload, len, mqtt_batch_result, &g_batch, &queued);
+	if(err != ESP_OK)
+	{
+		g_dropped += g_batch.count;
+		ESP_LOGW(TAG, "telemetry_flush_batch: %u samples dropped, %s, %lu dropped so far", g_batch.count, esp_err_to_name(err),
+				(unsigned long)g_dropped);
+	}
+	mqtt_batch_sent(&g_batch, queued);
+	//publishes held by the pacer or a full window back up in the agent queue
+	mqtt_batch_adapt(&g_batch, rssi, mqtt_agent_queue_space() < MQTT_AGENT_QUEUE_LENGTH / 2);
+}
+
+#endif
+
+#if CONFIG_MQTT_BATCH_MAX_SAMPLES > 1
+/**
+ * @fn const char telemetry_batch_sample*(const telemetry_sample_t*, int8_t, size_t*)
+ * @brief encode a sample straight into the batch payload, a full batch goes out first and the sample starts the
+ * 			next one
+ *
+ * @param rssi current Wi-Fi RSSI
+ * @param len output length of the encoded sample
+ * @return the sample in the batch payload, valid until the batch is sent, NULL if it does not encode
+ */
+static const char *telemetry_batch_sample(const telemetry_sample_t *sample, int8_t rssi, size_t *len)
+{
+	int64_t now_us = esp_timer_get_time();
+	size_t room;
+	char *tail = mqtt_batch_reserve(&g_batch, &room);
+	int n = telemetry_codec_encode_sample(TELEMETRY_CODEC, sample, tail, room);
+
+	if(n < 0 && g_batch.count > 0)
+	{
+		telemetry_flush_batch(rssi);
+		tail = mqtt_batch_reserve(&g_batch, &room);
+		n = telemetry_codec_encode_sample(TELEMETRY_CODEC, sample, tail, room);
+	}
+	if(n < 0)
+	{
+		return NULL;
+	}
+	mqtt_batch_commit(&g_batch, (size_t)n, now_us);
+	*len = (size_t)n;
+	return tail;
+}
+#else
+/**
+ * @fn esp_err_t telemetry_cloud_send(void*, const char*, size_t)
+ * @brief send function of the cloud sink: queue the sample as a QoS1 publish
+ *
+ */
+static esp_err_t telemetry_cloud_send(void *ctx, const char *data, size_t len)
+{
+	bool queued = false;
+	esp_err_t err = telemetry_publish_reliable(TELEMETRY_SAMPLE_TOPIC, data, len, NULL, NULL, &queued);
+	if(err != ESP_OK)
+	{
+		g_dropped++;
+		ESP_LOGW(TAG, "telemetry_cloud_send: sample dropped, %s, %lu dropped so far", esp_err_to_name(err), (unsigned long)g_dropped);
+	}
+	return err;
+}
+#endif
+
+#if TELEMETRY_REPORTS
+/**
+ * @fn void telemetry_log_stats(void)
+ * @brief log the samples saved by report-by-exception, the batching efficiency: samples per publish, bytes per
+ * 			sample and PUBACKs, the outbox backlog and what each sink delivered and dropped
+ *
+ */
+static void telemetry_log_stats(void)
+{
+	for(size_t i = 0; i < telemetry_sink_count(); i++)
+	{
+		telemetry_sink_t *sink = telemetry_sink_get(i);
+		telemetry_sink_stats_t sink_stats;
+
+		telemetry_sink_get_stats(sink, &sink_stats);
+		ESP_LOGI(TAG, "telemetry_log_stats: sink %s %lu queued, %lu delivered, %lu failed, %lu dropped, peak %lu queued",
+				sink->name, (unsigned long)sink_stats.queued, (unsigned long)sink_stats.delivered,
+				(unsigned long)sink_stats.failed, (unsigned long)sink_stats.dropped, (unsigned long)sink_stats.max_depth);
+	}
+
+#if CONFIG_MQTT_REPORT_BY_EXCEPTION
+	ESP_LOGI(TAG, "telemetry_log_stats: %lu readings checked, %lu published (%lu heartbeats), %lu within the deadbands, "
+			"checking every %lu ms",
+			(unsigned long)g_report.stats.evaluated, (unsigned long)g_report.stats.reported,
+			(unsigned long)g_report.stats.heartbeats, (unsigned long)g_report.stats.suppressed,
+			(unsigned long)g_report.interval_ms);
+#endif
+#if CONFIG_MQTT_BATCH_MAX_SAMPLES > 1
+	mqtt_batch_stats_t stats;
+	mqtt_transport_stats_t transport;
+
+	mqtt_batch_get_stats(&g_batch, &stats);
+	mqtt_transport_get_stats(&transport);
+
+	ESP_LOGI(TAG, "telemetry_log_stats: %lu samples in %lu batches (target %u), %lu payload bytes per sample, "
+			"%lu MQTT bytes sent per sample, %lu PUBACKs, %lu failed, %lu rejected",
+			(unsigned long)stats.samples, (unsigned long)stats.batches, stats.target,
+			(unsigned long)(stats.samples ? stats.payload_bytes / stats.samples : 0),
+			(unsigned long)(stats.samples ? transport.bytes_sent / stats.samples : 0),
+			(unsigned long)stats.acked, (unsigned long)stats.failed, (unsigned long)stats.rejected);
+#endif
+#if CONFIG_MQTT_OUTBOX
+	mqtt_outbox_stats_t outbox;
+
+	mqtt_outbox_get_stats(&outbox);
+	ESP_LOGI(TAG, "telemetry_log_stats: outbox %lu pending, %lu stored, %lu delivered, %lu resent, %lu dropped, "
+			"%lu rejected, %lu corrupt, %lu unmarked, %lu flash writes, %lu erases",
+			(unsigned long)outbox.pending, (unsigned long)outbox.stored, (unsigned long)outbox.delivered,
+			(unsigned long)outbox.resent, (unsigned long)outbox.dropped, (unsigned long)outbox.rejected,
+			(unsigned long)outbox.corrupt, (unsigned long)outbox.unmarked, (unsigned long)outbox.flash_writes,
+			(unsigned long)outbox.erases);
+#endif
+}
+#endif
+
+/**
+ * @fn void telemetry_publish_sample(void)
+ * @brief queue the current RSSI, temperature and humidity, QoS1 so the sample survives a reconnect
+ *
+ */
+static void telemetry_publish_sample(void)
+{
+	struct dht11_reading reading;
+	int8_t rssi;
+
+#if CONFIG_MQTT_REPORT_BY_EXCEPTION
+	int64_t now_ms = esp_timer_get_time() / 1000;
+	if(!report_filter_due(&g_report, now_ms))
+	{
+		return;
+	}
+	reading = DHT11_read();
+	if(reading.status != DHT11_OK)
+	{
+		//checked again next period, a failed read says nothing about a change
+		return;
+	}
+	float values[] = {reading.temperature, reading.humidity};
+	if(!report_filter_update(&g_report, values, now_ms))
+	{
+		return;
+	}
+#else
+	reading = DHT11_read();
+#endif
+	rssi = wifi_app_get_rssi();
+
+	telemetry_sample_t sample = {
+			.t_ms = (uint32_t)(esp_timer_get_time() / 1000),
+			.temperature = reading.temperature,
+			.humidity = reading.humidity,
+			.rssi = rssi,
+			.status = reading.status,
+	};
+
+#if CONFIG_MQTT_BATCH_MAX_SAMPLES > 1
+	//the cloud path encodes in place, the local sinks share one copy of the encoded sample
+	size_t len = 0;
+	const char *encoded = telemetry_batch_sample(&sample, rssi, &len);
+	if(encoded == NULL)
+	{
+		return;
+	}
+	if(telemetry_sink_count() > 0)
+	{
+		telemetry_buf_t *buf = telemetry_buf_alloc();
+		if(buf == NULL)
+		{
+			ESP_LOGW(TAG, "telemetry_publish_sample: no sample buffer, the local sinks miss this sample");
+		}
+		else
+		{
+			memcpy(buf->data, encoded, len);
+			buf->len = len;
+			telemetry_sink_fanout(buf);
+		}
+	}
+	if(mqtt_batch_ready(&g_batch, esp_timer_get_time()))
+	{
+		telemetry_flush_batch(rssi);
+	}
+#else
+	//encoded once for every sink, each one holds the same buffer until it sent it
+	telemetry_buf_t *buf = telemetry_buf_alloc();
+	if(buf == NULL)
+	{
+		g_dropped++;
+		ESP_LOGW(TAG, "telemetry_publish_sample: no sample buffer, %lu dropped so far", (unsigned long)g_dropped);
+		return;
+	}
+	int len = telemetry_codec_encode_sample(TELEMETRY_CODEC, &sample, buf->data, sizeof(buf->data));
+	if(len < 0)
+	{
+		telemetry_buf_release(buf);
+		return;
+	}
+	buf->len = (size_t)len;
+	telemetry_sink_fanout(buf);
+	telemetry_sink_drain(&g_cloud_sink);
+#endif
+}
+
+/**
+ * @fn void telemetry_publish_summary(void)
+ * @brief queue the sliding-window summary, QoS0 since it is superseded by the next one
+ *
+ */
+static void telemetry_publish_summary(void)
+{
+	//kept off the stack, the summary grows with every metric fed to the windows
+	static char payload[SENSOR_WINDOW_JSON_MAX_LEN];
+
+#if CONFIG_MQTT_TELEMETRY_CBOR
+	int len = sensor_window_to_cbor(payload, sizeof(payload), (uint32_t)(esp_timer_get_time() / 1000));
+#else
+	int len = sensor_window_to_json(payload, sizeof(payload), (uint32_t)(esp_timer_get_time() / 1000));
+#endif
+	if(len < 0)
+	{
+		ESP_LOGE(TAG, "telemetry_publish_summary: summary does not fit in %u bytes", SENSOR_WINDOW_JSON_MAX_LEN);
+		return;
+	}
+	telemetry_publish(TELEMETRY_SUMMARY_TOPIC, payload, (size_t)len, MQTTQoS0);
+}
+
+#if CONFIG_MQTT_DIAGNOSTICS_PERIOD_S > 0
+/**
+ * @fn void telemetry_publish_diagnostics(void)
+ * @brief queue the PUBACK latency histogram and session health, QoS0 since it is superseded by the next one
+ *
+ */
+static void telemetry_publish_diagnostics(void)
+{
+	static char payload[MQTT_METRICS_JSON_MAX_LEN];
+
+	int len = mqtt_metrics_to_json(payload, sizeof(payload));
+	if(len < 0)
+	{
+		ESP_LOGE(TAG, "telemetry_publish_diagnostics: metrics do not fit in %u bytes", MQTT_METRICS_JSON_MAX_LEN);
+		return;
+	}
+	telemetry_publish(TELEMETRY_DIAGNOSTICS_TOPIC, payload, (size_t)len, MQTTQoS0);
+}
+#endif
+
+static void telemetry_task(void *pvParameter)
+{
+	TickType_t last_wake = xTaskGetTickCount();
+	TickType_t next_summary = last_wake + pdMS_TO_TICKS(CONFIG_MQTT_SUMMARY_PERIOD_S * 1000);
+#if CONFIG_MQTT_DIAGNOSTICS_PERIOD_S > 0
+	TickType_t next_diagnostics = last_wake + pdMS_TO_TICKS(CONFIG_MQTT_DIAGNOSTICS_PERIOD_S * 1000);
+#endif
+#if TELEMETRY_REPORTS
+	TickType_t next_report = last_wake + pdMS_TO_TICKS(TELEMETRY_REPORT_INTERVAL_MS);
+#endif
+
+	printf("***** Starting telemetry Task *****\n\n");
+
+	for(;;)
+	{
+		telemetry_publish_sample();
+
+		if((int32_t)(xTaskGetTickCount() - next_summary) >= 0)
+		{
+			telemetry_publish_summary();
+			next_summary += pdMS_TO_TICKS(CONFIG_MQTT_SUMMARY_PERIOD_S * 1000);
+		}
+
+#if CONFIG_MQTT_DIAGNOSTICS_PERIOD_S > 0
+		if((int32_t)(xTaskGetTickCount() - next_diagnostics) >= 0)
+		{
+			telemetry_publish_diagnostics();
+			next_diagnostics += pdMS_TO_TICKS(CONFIG_MQTT_DIAGNOSTICS_PERIOD_S * 1000);
+		}
+#endif
+
+#if CONFIG_MQTT_OUTBOX
+		telemetry_drain_outbox();
+#endif
+
+#if TELEMETRY_REPORTS
+		if((int32_t)(xTaskGetTickCount() - next_report) >= 0)
+		{
+			telemetry_log_stats();
+			next_report += pdMS_TO_TICKS(TELEMETRY_REPORT_INTERVAL_MS);
+		}
+#endif
+
+		vTaskDelayUntil(&last_wake, pdMS_TO_TICKS(CONFIG_MQTT_TELEMETRY_PERIOD_MS));
+	}
+}
+
+void telemetry_task_start(void)
+{
+	if(g_telemetry_task != NULL)
+	{
+		return;
+	}
+#if CONFIG_MQTT_BATCH_MAX_SAMPLES > 1
+	mqtt_batch_init(&g_batch, TELEMETRY_CODEC, CONFIG_MQTT_BATCH_SAMPLES, CONFIG_MQTT_BATCH_MAX_SAMPLES,
+					CONFIG_MQTT_BATCH_MAX_AGE_MS);
+#endif
+#if CONFIG_MQTT_REPORT_BY_EXCEPTION
+	const report_filter_metric_t metrics[] = {
+			{CONFIG_MQTT_REPORT_TEMP_DEADBAND, CONFIG_MQTT_REPORT_REL_DEADBAND_PCT / 100.0f},
+			{CONFIG_MQTT_REPORT_HUM_DEADBAND, CONFIG_MQTT_REPORT_REL_DEADBAND_PCT / 100.0f},
+	};
+	report_filter_init(&g_report, metrics, sizeof(metrics) / sizeof(metrics[0]), CONFIG_MQTT_TELEMETRY_PERIOD_MS,
+					   CONFIG_MQTT_REPORT_MAX_INTERVAL_MS, CONFIG_MQTT_REPORT_MAX_SILENCE_S * 1000);
+#endif
+#if CONFIG_MQTT_OUTBOX
+	telemetry_outbox_init();
+#endif
+#if CONFIG_MQTT_BATCH_MAX_SAMPLES <= 1
+	telemetry_sink_init(&g_cloud_sink, "cloud", telemetry_cloud_send, NULL, TELEMETRY_SINK_DROP_OLDEST);
+	telemetry_sink_add(&g_cloud_sink);
+#endif
+#if CONFIG_TELEMETRY_UDP_SINK
+	esp_err_t udp_err = telemetry_sink_udp_open(&g_udp, CONFIG_TELEMETRY_UDP_SINK_ADDR, CONFIG_TELEMETRY_UDP_SINK_PORT);
+	if(udp_err == ESP_OK)
+	{
+		telemetry_sink_init(&g_udp_sink, "udp_sink", telemetry_sink_udp_send, &g_udp, TELEMETRY_SINK_DROP_OLDEST);
+		udp_err = telemetry_sink_start(&g_udp_sink);
+	}
+	if(udp_err != ESP_OK)
+	{
+		ESP_LOGE(TAG, "telemetry_task_start: no UDP sink to %s:%u, %s", CONFIG_TELEMETRY_UDP_SINK_ADDR,
+				CONFIG_TELEMETRY_UDP_SINK_PORT, esp_err_to_name(udp_err));
+	}
+#endif
+#if CONFIG_MQTT_TOPIC_ALIASES
+	for(size_t i = 0; i < sizeof(g_alias_topics) / sizeof(g_alias_topics[0]); i++)
+	{
+		esp_err_t err = mqtt_topic_alias_add(g_alias_topics[i]);
+		if(err != ESP_OK)
+		{
+			ESP_LOGW(TAG, "telemetry_task_start: no alias for %s: %s", g_alias_topics[i], esp_err_to_name(err));
+		}
+	}
+#endif
+	xTaskCreatePinnedToCore(&telemetry_task, "telemetry_task", TELEMETRY_TASK_STACK_SIZE, NULL, TELEMETRY_TASK_PRIORITY, &g_telemetry_task, TELEMETRY_TASK_CORE_ID);
+}
+
+#endif /* CONFIG_MQTT_PERSISTENT_SESSION */
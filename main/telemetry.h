@@ -0,0 +1,47 @@
+/*
+ * telemetry.h
+ *
+ *  Created on: Oct 18, 2026
+ *      Author: hamxa
+ */
+
+#ifndef MAIN_TELEMETRY_H_
+#define MAIN_TELEMETRY_H_
+
+#include "sdkconfig.h"
+
+//Encoding of the samples and summaries, MQTT has no content type so CBOR topics end in /cbor
+#if CONFIG_MQTT_TELEMETRY_CBOR
+#define TELEMETRY_CODEC					TELEMETRY_CODEC_CBOR
+#define TELEMETRY_TOPIC_SUFFIX			"/cbor"
+#else
+#define TELEMETRY_CODEC					TELEMETRY_CODEC_JSON
+#define TELEMETRY_TOPIC_SUFFIX			""
+#endif
+
+//Topic of the periodic RSSI, temperature and humidity sample
+#define TELEMETRY_TOPIC					"test_topic/esp32"
+
+//Topic of the single samples, see telemetry_codec.h
+#define TELEMETRY_SAMPLE_TOPIC			TELEMETRY_TOPIC TELEMETRY_TOPIC_SUFFIX
+
+//Topic of the batched samples, an array of samples
+#define TELEMETRY_BATCH_TOPIC			TELEMETRY_TOPIC "/batch" TELEMETRY_TOPIC_SUFFIX
+
+//Topic of the sliding-window summary
+#define TELEMETRY_SUMMARY_TOPIC			TELEMETRY_TOPIC "/summary" TELEMETRY_TOPIC_SUFFIX
+
+//Topic of the MQTT latency and session health, always JSON like the /metrics.json endpoint
+#define TELEMETRY_DIAGNOSTICS_TOPIC		TELEMETRY_TOPIC "/diagnostics"
+
+//Interval between batching and outbox reports
+#define TELEMETRY_REPORT_INTERVAL_MS	60000
+
+/**
+ * @fn void telemetry_task_start(void)
+ * @brief start the task that queues the telemetry samples and summaries on the MQTT agent. Safe to call again
+ *
+ */
+void telemetry_task_start(void);
+
+#endif /* MAIN_TELEMETRY_H_ */
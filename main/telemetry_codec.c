@@ -0,0 +1,80 @@
+/*
+ * telemetry_codec.c
+ *
+ *  Created on: Oct 18, 2026
+ *      Author: hamxa
+ */
+#include <stdio.h>
+
+#include "cbor_writer.h"
+#include "dht11.h"
+#include "telemetry_codec.h"
+
+/**
+ * @fn int telemetry_codec_encode_cbor(const telemetry_sample_t*, void*, size_t)
+ * @brief encode a sample as a CBOR map with integer keys, 14 to 20 bytes for typical readings
+ *
+ */
+static int telemetry_codec_encode_cbor(const telemetry_sample_t *sample, void *buf, size_t len)
+{
+	cbor_writer_t writer;
+	bool failed = sample->status != DHT11_OK;
+
+	cbor_writer_init(&writer, buf, len);
+	cbor_write_map(&writer, failed ? 5 : 4);
+	cbor_write_uint(&writer, TELEMETRY_CODEC_KEY_TIME);
+	cbor_write_uint(&writer, sample->t_ms);
+	cbor_write_uint(&writer, TELEMETRY_CODEC_KEY_RSSI);
+	cbor_write_int(&writer, sample->rssi);
+	cbor_write_uint(&writer, TELEMETRY_CODEC_KEY_TEMP);
+	cbor_write_int(&writer, sample->temperature);
+	cbor_write_uint(&writer, TELEMETRY_CODEC_KEY_HUM);
+	cbor_write_int(&writer, sample->humidity);
+	if(failed)
+	{
+		cbor_write_uint(&writer, TELEMETRY_CODEC_KEY_STATUS);
+		cbor_write_int(&writer, sample->status);
+	}
+	return cbor_writer_finish(&writer);
+}
+
+/**
+ * @fn int telemetry_codec_encode_json(const telemetry_sample_t*, void*, size_t)
+ * @brief encode a sample as a JSON object
+ *
+ */
+static int telemetry_codec_encode_json(const telemetry_sample_t *sample, void *buf, size_t len)
+{
+	char status[16] = "";
+	if(sample->status != DHT11_OK)
+	{
+		snprintf(status, sizeof(status), ",\"status\":%d", sample->status);
+	}
+
+	int n = snprintf(buf, len, "{\"t\":%lu,\"rssi\":%d,\"temp\":%d,\"hum\":%d%s}",
+			(unsigned long)sample->t_ms, sample->rssi, sample->temperature, sample->humidity, status);
+	if(n < 0 || (size_t)n > len)
+	{
+		return -1;
+	}
+	//the sample is not terminated, it may fill the buffer with snprintf's terminator over the closing brace
+	if((size_t)n == len)
+	{
+		((char*)buf)[n - 1] = '}';
+	}
+	return n;
+}
+
+int telemetry_codec_encode_sample(telemetry_codec_e codec, const telemetry_sample_t *sample, void *buf, size_t len)
+{
+	if(codec == TELEMETRY_CODEC_CBOR)
+	{
+		return telemetry_codec_encode_cbor(sample, buf, len);
+	}
+	return telemetry_codec_encode_json(sample, buf, len);
+}
+
+const char *telemetry_codec_content_type(telemetry_codec_e codec)
+{
+	return codec == TELEMETRY_CODEC_CBOR ? "application/cbor" : "application/json";
+}
@@ -0,0 +1,64 @@
+/*
+ * telemetry_codec.h
+ *
+ *  Created on: Oct 18, 2026
+ *      Author: hamxa
+ */
+
+#ifndef MAIN_TELEMETRY_CODEC_H_
+#define MAIN_TELEMETRY_CODEC_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+//Keys of the CBOR sample map, the JSON object uses the names in the comments
+#define TELEMETRY_CODEC_KEY_TIME		0	///> "t", milliseconds since boot
+#define TELEMETRY_CODEC_KEY_RSSI		1	///> "rssi", Wi-Fi RSSI in dBm
+#define TELEMETRY_CODEC_KEY_TEMP		2	///> "temp", temperature in degrees Celsius
+#define TELEMETRY_CODEC_KEY_HUM			3	///> "hum", relative humidity in percent
+#define TELEMETRY_CODEC_KEY_STATUS		4	///> "status", DHT11 status, only present when the read failed
+
+//Longest encoded sample in either encoding
+#define TELEMETRY_CODEC_SAMPLE_MAX_LEN	80
+
+/**
+ * Encodings a sink can publish samples in
+ */
+typedef enum telemetry_codec
+{
+	TELEMETRY_CODEC_JSON = 0,		/**< TELEMETRY_CODEC_JSON, {"t":..,"rssi":..,"temp":..,"hum":..} */
+	TELEMETRY_CODEC_CBOR			/**< TELEMETRY_CODEC_CBOR, map with the integer keys above */
+}telemetry_codec_e;
+
+/**
+ * One telemetry sample, a batch is an array of them
+ */
+typedef struct telemetry_sample
+{
+	uint32_t t_ms;
+	int16_t temperature;
+	int16_t humidity;
+	int8_t rssi;
+	int8_t status;					///> DHT11_OK, or the error of the read
+}telemetry_sample_t;
+
+/**
+ * @fn int telemetry_codec_encode_sample(telemetry_codec_e, const telemetry_sample_t*, void*, size_t)
+ * @brief encode one sample
+ *
+ * @param codec encoding to use
+ * @param sample sample to encode
+ * @param buf output buffer, the JSON is not terminated
+ * @param len size of the output buffer
+ * @return number of bytes written, or -1 if the buffer is too small
+ */
+int telemetry_codec_encode_sample(telemetry_codec_e codec, const telemetry_sample_t *sample, void *buf, size_t len);
+
+/**
+ * @fn const char telemetry_codec_content_type*(telemetry_codec_e)
+ * @brief get the media type of an encoding
+ *
+ */
+const char *telemetry_codec_content_type(telemetry_codec_e codec);
+
+#endif /* MAIN_TELEMETRY_CODEC_H_ */
@@ -0,0 +1,196 @@
+/*
+ * telemetry_codec_bench.c
+ *
+ *  Created on: Oct 18, 2026
+ *      Author: hamxa
+ */
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+#include "esp_log.h"
+
+#include "dht11_sim.h"
+#include "mqtt_batch.h"
+#include "telemetry_codec.h"
+#include "telemetry_codec_bench.h"
+
+static const char TAG[] = "telemetry_codec_bench";
+
+static telemetry_sample_t g_samples[TELEMETRY_CODEC_BENCH_SAMPLES];
+
+//keeps the encoded lengths observable so the encoding is not optimized away
+static volatile size_t g_sink;
+
+/**
+ * @fn int64_t telemetry_codec_bench_now_ns(void)
+ * @brief monotonic time
+ *
+ */
+static int64_t telemetry_codec_bench_now_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (int64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+/**
+ * @fn bool telemetry_codec_bench_check(void)
+ * @brief encode one sample and compare it with its CBOR encoding worked out by hand
+ *
+ */
+static bool telemetry_codec_bench_check(void)
+{
+	//{0: 1000, 1: -60, 2: 23, 3: 45}
+	static const uint8_t expected[] = {0xa4, 0x00, 0x19, 0x03, 0xe8, 0x01, 0x38, 0x3b, 0x02, 0x17, 0x03, 0x18, 0x2d};
+	static const char expected_json[] = "{\"t\":1000,\"rssi\":-60,\"temp\":23,\"hum\":45}";
+	const telemetry_sample_t sample = {.t_ms = 1000, .temperature = 23, .humidity = 45, .rssi = -60, .status = DHT11_OK};
+	uint8_t buf[TELEMETRY_CODEC_SAMPLE_MAX_LEN];
+
+	int len = telemetry_codec_encode_sample(TELEMETRY_CODEC_CBOR, &sample, buf, sizeof(buf));
+	if(len != sizeof(expected) || memcmp(buf, expected, sizeof(expected)) != 0)
+	{
+		ESP_LOGE(TAG, "telemetry_codec_bench_check: CBOR sample encoded to %d bytes, expected %u", len, (unsigned)sizeof(expected));
+		return false;
+	}
+
+	//a sample that exactly fills the buffer is still complete
+	len = telemetry_codec_encode_sample(TELEMETRY_CODEC_JSON, &sample, buf, sizeof(expected_json) - 1);
+	if(len != sizeof(expected_json) - 1 || memcmp(buf, expected_json, len) != 0)
+	{
+		ESP_LOGE(TAG, "telemetry_codec_bench_check: JSON sample encoded to %d bytes, expected %u", len,
+				(unsigned)sizeof(expected_json) - 1);
+		return false;
+	}
+
+	//and one that does not fit is refused
+	if(telemetry_codec_encode_sample(TELEMETRY_CODEC_CBOR, &sample, buf, sizeof(expected) - 1) >= 0 ||
+	   telemetry_codec_encode_sample(TELEMETRY_CODEC_JSON, &sample, buf, sizeof(expected_json) - 2) >= 0)
+	{
+		ESP_LOGE(TAG, "telemetry_codec_bench_check: truncated sample accepted");
+		return false;
+	}
+	return true;
+}
+
+/**
+ * @fn int telemetry_codec_bench_text(const telemetry_sample_t*, char*, size_t)
+ * @brief the text format samples were published in before the codec
+ *
+ */
+static int telemetry_codec_bench_text(const telemetry_sample_t *sample, char *buf, size_t len)
+{
+	return snprintf(buf, len, "%s : %d, %s : %d, %s : %d", "WiFi RSSI", sample->rssi,
+					"Temperature", sample->temperature, "Humidity", sample->humidity);
+}
+
+/**
+ * @fn size_t telemetry_codec_bench_flush(mqtt_batch_t*)
+ * @brief close the batch and start the next one
+ *
+ * @return payload length of the closed batch
+ */
+static size_t telemetry_codec_bench_flush(mqtt_batch_t *batch)
+{
+	size_t len = 0;
+
+	mqtt_batch_finish(batch, &len);
+	mqtt_batch_sent(batch, true);
+	return len;
+}
+
+/**
+ * @fn void telemetry_codec_bench_measure(const char*, int)
+ * @brief encode every sample on its own, then in batches, and log the bytes and time per sample
+ *
+ * @param codec encoding, -1 for the original text format which was never batched
+ */
+static void telemetry_codec_bench_measure(const char *label, int codec)
+{
+	static mqtt_batch_t batch;
+	char buf[TELEMETRY_CODEC_SAMPLE_MAX_LEN];
+	uint64_t bytes = 0;
+	uint64_t batch_bytes = 0;
+	uint32_t batches = 0;
+	int64_t start;
+	int64_t sample_ns;
+
+	start = telemetry_codec_bench_now_ns();
+	for(size_t i = 0; i < TELEMETRY_CODEC_BENCH_SAMPLES; i++)
+	{
+		int len = codec < 0 ? telemetry_codec_bench_text(&g_samples[i], buf, sizeof(buf)) :
+				telemetry_codec_encode_sample(codec, &g_samples[i], buf, sizeof(buf));
+		bytes += len;
+		g_sink += len;
+	}
+	sample_ns = telemetry_codec_bench_now_ns() - start;
+
+	if(codec < 0)
+	{
+		ESP_LOGI(TAG, "%s: %llu bytes, %lld ns per sample", label,
+				(unsigned long long)(bytes / TELEMETRY_CODEC_BENCH_SAMPLES), (long long)(sample_ns / TELEMETRY_CODEC_BENCH_SAMPLES));
+		return;
+	}
+
+	//encoded in place, as the telemetry task does
+	mqtt_batch_init(&batch, codec, TELEMETRY_CODEC_BENCH_BATCH, TELEMETRY_CODEC_BENCH_BATCH,
+					TELEMETRY_CODEC_BENCH_BATCH * TELEMETRY_CODEC_BENCH_PERIOD_MS);
+	for(size_t i = 0; i < TELEMETRY_CODEC_BENCH_SAMPLES; i++)
+	{
+		int64_t now_us = (int64_t)g_samples[i].t_ms * 1000;
+		size_t room;
+		char *tail = mqtt_batch_reserve(&batch, &room);
+		int n = telemetry_codec_encode_sample(codec, &g_samples[i], tail, room);
+		if(n < 0)
+		{
+			batch_bytes += telemetry_codec_bench_flush(&batch);
+			batches++;
+			tail = mqtt_batch_reserve(&batch, &room);
+			n = telemetry_codec_encode_sample(codec, &g_samples[i], tail, room);
+		}
+		mqtt_batch_commit(&batch, (size_t)n, now_us);
+		if(mqtt_batch_ready(&batch, now_us) || i == TELEMETRY_CODEC_BENCH_SAMPLES - 1)
+		{
+			batch_bytes += telemetry_codec_bench_flush(&batch);
+			batches++;
+		}
+	}
+
+	ESP_LOGI(TAG, "%s: %llu bytes, %lld ns per sample; %lu batches of up to %u, %llu bytes per batched sample", label,
+			(unsigned long long)(bytes / TELEMETRY_CODEC_BENCH_SAMPLES), (long long)(sample_ns / TELEMETRY_CODEC_BENCH_SAMPLES),
+			(unsigned long)batches, TELEMETRY_CODEC_BENCH_BATCH,
+			(unsigned long long)(batch_bytes / TELEMETRY_CODEC_BENCH_SAMPLES));
+}
+
+bool telemetry_codec_bench_run(void)
+{
+	dht11_sim_config_t config;
+
+	if(!telemetry_codec_bench_check())
+	{
+		return false;
+	}
+
+	//readings as the DHT11 task would see them over a few hours, with the occasional failed read
+	DHT11_sim_get_default_config(&config);
+	config.noise_amplitude = 1;
+	config.crc_error_ppm = 5000;
+	config.seed = 1;
+	DHT11_sim_configure(&config);
+	for(size_t i = 0; i < TELEMETRY_CODEC_BENCH_SAMPLES; i++)
+	{
+		uint32_t t_ms = TELEMETRY_CODEC_BENCH_START_MS + i * TELEMETRY_CODEC_BENCH_PERIOD_MS;
+		struct dht11_reading reading = DHT11_sim_read_at((int64_t)t_ms * 1000);
+		g_samples[i].t_ms = t_ms;
+		g_samples[i].temperature = reading.temperature;
+		g_samples[i].humidity = reading.humidity;
+		g_samples[i].rssi = -45 - (int8_t)(i % 40);
+		g_samples[i].status = reading.status;
+	}
+
+	telemetry_codec_bench_measure("text", -1);
+	telemetry_codec_bench_measure("JSON", TELEMETRY_CODEC_JSON);
+	telemetry_codec_bench_measure("CBOR", TELEMETRY_CODEC_CBOR);
+	return true;
+}
@@ -0,0 +1,32 @@
+/*
+ * telemetry_codec_bench.h
+ *
+ *  Created on: Oct 18, 2026
+ *      Author: hamxa
+ */
+
+#ifndef MAIN_TELEMETRY_CODEC_BENCH_H_
+#define MAIN_TELEMETRY_CODEC_BENCH_H_
+
+#include <stdbool.h>
+
+//Samples encoded per measurement
+#define TELEMETRY_CODEC_BENCH_SAMPLES	20000
+
+//Sample period and uptime of the first sample, a device up for a day
+#define TELEMETRY_CODEC_BENCH_PERIOD_MS	4000
+#define TELEMETRY_CODEC_BENCH_START_MS	(24 * 3600 * 1000)
+
+//Samples per batch, the default batch size on a weak link
+#define TELEMETRY_CODEC_BENCH_BATCH		16
+
+/**
+ * @fn bool telemetry_codec_bench_run(void)
+ * @brief check the CBOR sample encoding against a known encoding, then log the bytes and encode time per sample
+ * 			of the original text format, JSON and CBOR, alone and in batches
+ *
+ * @return true if the encodings were as expected
+ */
+bool telemetry_codec_bench_run(void);
+
+#endif /* MAIN_TELEMETRY_CODEC_BENCH_H_ */
@@ -0,0 +1,287 @@
+/*
+ * telemetry_sink.c
+ *
+ *  Created on: Oct 18, 2026
+ *      Author: hamxa
+ */
+#include <arpa/inet.h>
+#include <errno.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include "esp_log.h"
+
+#include "telemetry_sink.h"
+
+#if !CONFIG_IDF_TARGET_LINUX
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+
+#include "tasks_common.h"
+#endif
+
+#if TELEMETRY_SINK_BUFFERS > 32
+#error "the free buffers are kept in a 32 bit mask"
+#endif
+
+static const char TAG[] = "telemetry_sink";
+
+static telemetry_buf_t g_bufs[TELEMETRY_SINK_BUFFERS];
+
+//bit per free buffer, taken and given back with compare and swap by any task
+static uint32_t g_free = (uint32_t)((1ULL << TELEMETRY_SINK_BUFFERS) - 1);
+
+static telemetry_sink_t *g_sinks[TELEMETRY_SINK_MAX];
+static size_t g_sink_count;
+
+telemetry_buf_t *telemetry_buf_alloc(void)
+{
+	uint32_t free_mask = __atomic_load_n(&g_free, __ATOMIC_RELAXED);
+	uint32_t bit;
+
+	do
+	{
+		if(free_mask == 0)
+		{
+			return NULL;
+		}
+		bit = free_mask & -free_mask;
+	} while(!__atomic_compare_exchange_n(&g_free, &free_mask, free_mask & ~bit, true, __ATOMIC_ACQUIRE, __ATOMIC_RELAXED));
+
+	telemetry_buf_t *buf = &g_bufs[__builtin_ctz(bit)];
+	buf->refs = 1;
+	buf->len = 0;
+	return buf;
+}
+
+void telemetry_buf_release(telemetry_buf_t *buf)
+{
+	if(__atomic_sub_fetch(&buf->refs, 1, __ATOMIC_ACQ_REL) == 0)
+	{
+		__atomic_or_fetch(&g_free, 1u << (buf - g_bufs), __ATOMIC_RELEASE);
+	}
+}
+
+uint32_t telemetry_buf_in_use(void)
+{
+	return TELEMETRY_SINK_BUFFERS - __builtin_popcount(__atomic_load_n(&g_free, __ATOMIC_RELAXED));
+}
+
+void telemetry_sink_init(telemetry_sink_t *sink, const char *name, telemetry_sink_send_t send, void *ctx,
+						 telemetry_sink_policy_e policy)
+{
+	*sink = (telemetry_sink_t){0};
+	sink->name = name;
+	sink->send = send;
+	sink->ctx = ctx;
+	sink->policy = policy;
+}
+
+esp_err_t telemetry_sink_add(telemetry_sink_t *sink)
+{
+	size_t count = __atomic_load_n(&g_sink_count, __ATOMIC_RELAXED);
+
+	if(count >= TELEMETRY_SINK_MAX)
+	{
+		return ESP_ERR_NO_MEM;
+	}
+	g_sinks[count] = sink;
+	__atomic_store_n(&g_sink_count, count + 1, __ATOMIC_RELEASE);
+	return ESP_OK;
+}
+
+/**
+ * @fn bool telemetry_sink_push(telemetry_sink_t*, telemetry_buf_t*)
+ * @brief queue a held buffer on one sink, applying its policy when the queue is full
+ *
+ * @return false if the buffer was not queued, the hold stays with the caller
+ */
+static bool telemetry_sink_push(telemetry_sink_t *sink, telemetry_buf_t *buf)
+{
+	uint32_t head = sink->head;
+	uint32_t tail = __atomic_load_n(&sink->tail, __ATOMIC_ACQUIRE);
+
+	if(head - tail >= TELEMETRY_SINK_QUEUE_LENGTH)
+	{
+		if(sink->policy == TELEMETRY_SINK_DROP_NEWEST)
+		{
+			__atomic_fetch_add(&sink->stats.dropped, 1, __ATOMIC_RELAXED);
+			return false;
+		}
+		//the drain may take the oldest at the same time, whoever moves the tail owns it
+		telemetry_buf_t *oldest = __atomic_load_n(&sink->queue[tail % TELEMETRY_SINK_QUEUE_LENGTH], __ATOMIC_RELAXED);
+		if(__atomic_compare_exchange_n(&sink->tail, &tail, tail + 1, false, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE))
+		{
+			telemetry_buf_release(oldest);
+			__atomic_fetch_add(&sink->stats.dropped, 1, __ATOMIC_RELAXED);
+			tail++;
+		}
+	}
+
+	__atomic_store_n(&sink->queue[head % TELEMETRY_SINK_QUEUE_LENGTH], buf, __ATOMIC_RELAXED);
+	__atomic_store_n(&sink->head, head + 1, __ATOMIC_RELEASE);
+	__atomic_fetch_add(&sink->stats.queued, 1, __ATOMIC_RELAXED);
+	if(head + 1 - tail > __atomic_load_n(&sink->stats.max_depth, __ATOMIC_RELAXED))
+	{
+		__atomic_store_n(&sink->stats.max_depth, head + 1 - tail, __ATOMIC_RELAXED);
+	}
+	return true;
+}
+
+size_t telemetry_sink_fanout(telemetry_buf_t *buf)
+{
+	size_t count = __atomic_load_n(&g_sink_count, __ATOMIC_ACQUIRE);
+	size_t queued = 0;
+
+	for(size_t i = 0; i < count; i++)
+	{
+		telemetry_sink_t *sink = g_sinks[i];
+
+		//held once more before it is visible to the drain
+		__atomic_add_fetch(&buf->refs, 1, __ATOMIC_RELAXED);
+		if(!telemetry_sink_push(sink, buf))
+		{
+			__atomic_sub_fetch(&buf->refs, 1, __ATOMIC_RELAXED);
+			continue;
+		}
+		queued++;
+		if(sink->wake)
+		{
+			sink->wake(sink->wake_ctx);
+		}
+	}
+	telemetry_buf_release(buf);
+	return queued;
+}
+
+size_t telemetry_sink_drain(telemetry_sink_t *sink)
+{
+	size_t sent = 0;
+
+	for(;;)
+	{
+		uint32_t tail = __atomic_load_n(&sink->tail, __ATOMIC_ACQUIRE);
+		if(tail == __atomic_load_n(&sink->head, __ATOMIC_ACQUIRE))
+		{
+			return sent;
+		}
+		telemetry_buf_t *buf = __atomic_load_n(&sink->queue[tail % TELEMETRY_SINK_QUEUE_LENGTH], __ATOMIC_RELAXED);
+		if(!__atomic_compare_exchange_n(&sink->tail, &tail, tail + 1, false, __ATOMIC_ACQ_REL, __ATOMIC_RELAXED))
+		{
+			//the producer dropped it to make room
+			continue;
+		}
+
+		if(sink->send(sink->ctx, buf->data, buf->len) == ESP_OK)
+		{
+			__atomic_fetch_add(&sink->stats.delivered, 1, __ATOMIC_RELAXED);
+		}
+		else
+		{
+			__atomic_fetch_add(&sink->stats.failed, 1, __ATOMIC_RELAXED);
+		}
+		telemetry_buf_release(buf);
+		sent++;
+	}
+}
+
+void telemetry_sink_clear(void)
+{
+	__atomic_store_n(&g_sink_count, 0, __ATOMIC_RELEASE);
+}
+
+size_t telemetry_sink_count(void)
+{
+	return __atomic_load_n(&g_sink_count, __ATOMIC_ACQUIRE);
+}
+
+telemetry_sink_t *telemetry_sink_get(size_t index)
+{
+	return index < telemetry_sink_count() ? g_sinks[index] : NULL;
+}
+
+void telemetry_sink_get_stats(const telemetry_sink_t *sink, telemetry_sink_stats_t *stats)
+{
+	stats->queued = __atomic_load_n(&sink->stats.queued, __ATOMIC_RELAXED);
+	stats->delivered = __atomic_load_n(&sink->stats.delivered, __ATOMIC_RELAXED);
+	stats->failed = __atomic_load_n(&sink->stats.failed, __ATOMIC_RELAXED);
+	stats->dropped = __atomic_load_n(&sink->stats.dropped, __ATOMIC_RELAXED);
+	stats->max_depth = __atomic_load_n(&sink->stats.max_depth, __ATOMIC_RELAXED);
+}
+
+esp_err_t telemetry_sink_udp_open(telemetry_sink_udp_t *udp, const char *ip, uint16_t port)
+{
+	memset(&udp->addr, 0, sizeof(udp->addr));
+	udp->addr.sin_family = AF_INET;
+	udp->addr.sin_port = htons(port);
+	if(inet_pton(AF_INET, ip, &udp->addr.sin_addr) != 1)
+	{
+		return ESP_ERR_INVALID_ARG;
+	}
+	udp->socket = socket(AF_INET, SOCK_DGRAM, 0);
+	if(udp->socket < 0)
+	{
+		ESP_LOGE(TAG, "telemetry_sink_udp_open: socket failed, errno %d", errno);
+		return ESP_FAIL;
+	}
+	return ESP_OK;
+}
+
+esp_err_t telemetry_sink_udp_send(void *ctx, const char *data, size_t len)
+{
+	telemetry_sink_udp_t *udp = ctx;
+
+	//a full socket buffer loses the datagram, as the network would
+	if(sendto(udp->socket, data, len, MSG_DONTWAIT, (const struct sockaddr*)&udp->addr, sizeof(udp->addr)) != (ssize_t)len)
+	{
+		return ESP_FAIL;
+	}
+	return ESP_OK;
+}
+
+#if !CONFIG_IDF_TARGET_LINUX
+/**
+ * @fn void telemetry_sink_wake_task(void*)
+ * @brief wake function of a sink started with telemetry_sink_start
+ *
+ */
+static void telemetry_sink_wake_task(void *ctx)
+{
+	xTaskNotifyGive((TaskHandle_t)ctx);
+}
+
+/**
+ * @fn void telemetry_sink_task(void*)
+ * @brief drain one sink whenever the producer queued samples
+ *
+ */
+static void telemetry_sink_task(void *pvParameters)
+{
+	telemetry_sink_t *sink = pvParameters;
+
+	for(;;)
+	{
+		ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+		telemetry_sink_drain(sink);
+	}
+}
+
+esp_err_t telemetry_sink_start(telemetry_sink_t *sink)
+{
+	TaskHandle_t task;
+
+	if(telemetry_sink_count() >= TELEMETRY_SINK_MAX)
+	{
+		return ESP_ERR_NO_MEM;
+	}
+	if(xTaskCreatePinnedToCore(&telemetry_sink_task, sink->name, TELEMETRY_SINK_TASK_STACK_SIZE, sink,
+							   TELEMETRY_SINK_TASK_PRIORITY, &task, TELEMETRY_SINK_TASK_CORE_ID) != pdPASS)
+	{
+		return ESP_ERR_NO_MEM;
+	}
+	sink->wake = telemetry_sink_wake_task;
+	sink->wake_ctx = task;
+	return telemetry_sink_add(sink);
+}
+#endif
@@ -0,0 +1,207 @@
+/*
+ * telemetry_sink.h
+ *
+ *  Created on: Oct 18, 2026
+ *      Author: hamxa
+ */
+
+#ifndef MAIN_TELEMETRY_SINK_H_
+#define MAIN_TELEMETRY_SINK_H_
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <netinet/in.h>
+
+#include "esp_err.h"
+#include "sdkconfig.h"
+
+#include "telemetry_codec.h"
+
+//Sinks a sample can be handed to: the cloud broker, the UDP collector and one more
+#define TELEMETRY_SINK_MAX				3
+
+//Samples waiting in each sink's queue, a power of two
+#define TELEMETRY_SINK_QUEUE_LENGTH		8
+
+//Shared sample buffers, every queue full still leaves two for the producer
+#define TELEMETRY_SINK_BUFFERS			(TELEMETRY_SINK_MAX * TELEMETRY_SINK_QUEUE_LENGTH + 2)
+
+/**
+ * What a sink does with a new sample when its queue is full
+ */
+typedef enum telemetry_sink_policy
+{
+	TELEMETRY_SINK_DROP_OLDEST = 0,		/**< TELEMETRY_SINK_DROP_OLDEST, the oldest queued sample makes room */
+	TELEMETRY_SINK_DROP_NEWEST			/**< TELEMETRY_SINK_DROP_NEWEST, the new sample is not queued */
+}telemetry_sink_policy_e;
+
+/**
+ * One encoded sample, shared by every sink it was handed to and freed when the last one is done with it
+ */
+typedef struct telemetry_buf
+{
+	uint32_t refs;
+	size_t len;
+	char data[TELEMETRY_CODEC_SAMPLE_MAX_LEN];
+}telemetry_buf_t;
+
+/**
+ * Sink counters since init
+ */
+typedef struct telemetry_sink_stats
+{
+	uint32_t queued;
+	uint32_t delivered;			///> samples the send function took
+	uint32_t failed;			///> samples the send function refused, not retried
+	uint32_t dropped;			///> samples dropped by the policy of a full queue
+	uint32_t max_depth;			///> highest number of samples queued
+}telemetry_sink_stats_t;
+
+/**
+ * @brief deliver one encoded sample, called from the task that drains the sink
+ */
+typedef esp_err_t (*telemetry_sink_send_t)(void *ctx, const char *data, size_t len);
+
+/**
+ * @brief wake the task that drains the sink, called from the producer after a sample was queued
+ */
+typedef void (*telemetry_sink_wake_t)(void *ctx);
+
+/**
+ * Consumer of the samples with a queue of its own. The producer task queues, one other task drains, so a sink
+ * that is slow or blocked only fills its own queue
+ */
+typedef struct telemetry_sink
+{
+	const char *name;
+	telemetry_sink_send_t send;
+	void *ctx;
+	telemetry_sink_policy_e policy;
+	telemetry_sink_wake_t wake;			///> optional, set before the sink is added
+	void *wake_ctx;
+	telemetry_buf_t *queue[TELEMETRY_SINK_QUEUE_LENGTH];
+	uint32_t head;						///> written by the producer only
+	uint32_t tail;						///> advanced by the drain, and by the producer dropping the oldest
+	telemetry_sink_stats_t stats;
+}telemetry_sink_t;
+
+/**
+ * @fn telemetry_buf_t telemetry_buf_alloc*(void)
+ * @brief take a free sample buffer, held once by the caller
+ *
+ * @return the buffer, NULL if every buffer is in use
+ */
+telemetry_buf_t *telemetry_buf_alloc(void);
+
+/**
+ * @fn void telemetry_buf_release(telemetry_buf_t*)
+ * @brief drop one hold of a buffer, it is free again after the last
+ *
+ */
+void telemetry_buf_release(telemetry_buf_t *buf);
+
+/**
+ * @fn uint32_t telemetry_buf_in_use(void)
+ * @brief buffers held by the producer or a sink queue
+ *
+ */
+uint32_t telemetry_buf_in_use(void);
+
+/**
+ * @fn void telemetry_sink_init(telemetry_sink_t*, const char*, telemetry_sink_send_t, void*, telemetry_sink_policy_e)
+ * @brief set up a sink with an empty queue
+ *
+ */
+void telemetry_sink_init(telemetry_sink_t *sink, const char *name, telemetry_sink_send_t send, void *ctx,
+						 telemetry_sink_policy_e policy);
+
+/**
+ * @fn esp_err_t telemetry_sink_add(telemetry_sink_t*)
+ * @brief make a sink receive the samples handed to telemetry_sink_fanout, before the producer starts
+ *
+ * @return ESP_OK, ESP_ERR_NO_MEM if TELEMETRY_SINK_MAX sinks were added
+ */
+esp_err_t telemetry_sink_add(telemetry_sink_t *sink);
+
+/**
+ * @fn size_t telemetry_sink_fanout(telemetry_buf_t*)
+ * @brief queue a sample on every sink without copying it or waiting, and wake their drains. Takes over the
+ * 			caller's hold of the buffer. Called from one producer task only
+ *
+ * @return sinks that queued the sample
+ */
+size_t telemetry_sink_fanout(telemetry_buf_t *buf);
+
+/**
+ * @fn size_t telemetry_sink_drain(telemetry_sink_t*)
+ * @brief send the queued samples in order, called from one task per sink
+ *
+ * @return samples sent or failed
+ */
+size_t telemetry_sink_drain(telemetry_sink_t *sink);
+
+/**
+ * @fn void telemetry_sink_clear(void)
+ * @brief remove every sink, only while no producer or drain runs
+ *
+ */
+void telemetry_sink_clear(void);
+
+/**
+ * @fn size_t telemetry_sink_count(void)
+ * @brief number of sinks added
+ *
+ */
+size_t telemetry_sink_count(void);
+
+/**
+ * @fn telemetry_sink_t telemetry_sink_get*(size_t)
+ * @brief sink by the order it was added in
+ *
+ */
+telemetry_sink_t *telemetry_sink_get(size_t index);
+
+/**
+ * @fn void telemetry_sink_get_stats(const telemetry_sink_t*, telemetry_sink_stats_t*)
+ * @brief get the counters of a sink
+ *
+ */
+void telemetry_sink_get_stats(const telemetry_sink_t *sink, telemetry_sink_stats_t *stats);
+
+/**
+ * UDP collector, each sample one datagram
+ */
+typedef struct telemetry_sink_udp
+{
+	int socket;
+	struct sockaddr_in addr;
+}telemetry_sink_udp_t;
+
+/**
+ * @fn esp_err_t telemetry_sink_udp_open(telemetry_sink_udp_t*, const char*, uint16_t)
+ * @brief open a non-blocking UDP socket to a collector
+ *
+ * @param ip IPv4 address of the collector
+ * @return ESP_OK, ESP_ERR_INVALID_ARG for a bad address, ESP_FAIL if the socket cannot be opened
+ */
+esp_err_t telemetry_sink_udp_open(telemetry_sink_udp_t *udp, const char *ip, uint16_t port);
+
+/**
+ * @fn esp_err_t telemetry_sink_udp_send(void*, const char*, size_t)
+ * @brief send function of a UDP sink, ctx is its telemetry_sink_udp_t
+ *
+ */
+esp_err_t telemetry_sink_udp_send(void *ctx, const char *data, size_t len);
+
+#if !CONFIG_IDF_TARGET_LINUX
+/**
+ * @fn esp_err_t telemetry_sink_start(telemetry_sink_t*)
+ * @brief add a sink drained by a task of its own, woken by the producer
+ *
+ * @return ESP_OK, ESP_ERR_NO_MEM if the sink cannot be added or the task not created
+ */
+esp_err_t telemetry_sink_start(telemetry_sink_t *sink);
+#endif
+
+#endif /* MAIN_TELEMETRY_SINK_H_ */
@@ -0,0 +1,295 @@
+/*
+ * telemetry_sink_bench.c
+ *
+ *  Created on: Oct 18, 2026
+ *      Author: hamxa
+ */
+#include <pthread.h>
+#include <semaphore.h>
+#include <time.h>
+
+#include "esp_log.h"
+
+#include "dht11.h"
+#include "telemetry_codec.h"
+#include "telemetry_sink.h"
+#include "telemetry_sink_bench.h"
+
+static const char TAG[] = "telemetry_sink_bench";
+
+/**
+ * Sink of the bench drained by a thread of its own
+ */
+typedef struct telemetry_sink_bench_drain
+{
+	telemetry_sink_t sink;
+	sem_t wake;
+	pthread_t thread;
+	bool stop;
+}telemetry_sink_bench_drain_t;
+
+static telemetry_sink_bench_drain_t g_drains[TELEMETRY_SINK_MAX];
+
+//keeps the delivered bytes observable so the send is not optimized away
+static size_t g_delivered_bytes;
+
+/**
+ * @fn int64_t telemetry_sink_bench_now_ns(void)
+ * @brief monotonic time
+ *
+ */
+static int64_t telemetry_sink_bench_now_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (int64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+/**
+ * @fn void telemetry_sink_bench_sample(uint32_t, telemetry_sample_t*)
+ * @brief the i-th sample of a device sampling every 4 s
+ *
+ */
+static void telemetry_sink_bench_sample(uint32_t i, telemetry_sample_t *sample)
+{
+	sample->t_ms = i * 4000;
+	sample->temperature = 20 + (int)(i % 8);
+	sample->humidity = 40 + (int)(i % 16);
+	sample->rssi = -45 - (int8_t)(i % 40);
+	sample->status = DHT11_OK;
+}
+
+/**
+ * @fn bool telemetry_sink_bench_produce(uint32_t, int64_t*)
+ * @brief encode one sample into a shared buffer and fan it out to every sink
+ *
+ * @param fanout_ns time spent in the fan-out, added to
+ * @return false if no buffer was free
+ */
+static bool telemetry_sink_bench_produce(uint32_t i, int64_t *fanout_ns)
+{
+	telemetry_sample_t sample;
+	telemetry_buf_t *buf = telemetry_buf_alloc();
+
+	if(buf == NULL)
+	{
+		return false;
+	}
+	telemetry_sink_bench_sample(i, &sample);
+	buf->len = (size_t)telemetry_codec_encode_sample(TELEMETRY_CODEC_CBOR, &sample, buf->data, sizeof(buf->data));
+
+	int64_t start = telemetry_sink_bench_now_ns();
+	telemetry_sink_fanout(buf);
+	*fanout_ns += telemetry_sink_bench_now_ns() - start;
+	return true;
+}
+
+/**
+ * @fn esp_err_t telemetry_sink_bench_fast_send(void*, const char*, size_t)
+ * @brief sink that takes every sample at once
+ *
+ */
+static esp_err_t telemetry_sink_bench_fast_send(void *ctx, const char *data, size_t len)
+{
+	__atomic_fetch_add(&g_delivered_bytes, len, __ATOMIC_RELAXED);
+	return ESP_OK;
+}
+
+/**
+ * @fn esp_err_t telemetry_sink_bench_slow_send(void*, const char*, size_t)
+ * @brief sink that blocks for longer than the interval between samples
+ *
+ */
+static esp_err_t telemetry_sink_bench_slow_send(void *ctx, const char *data, size_t len)
+{
+	struct timespec delay = {.tv_sec = 0, .tv_nsec = TELEMETRY_SINK_BENCH_SLOW_SEND_US * 1000};
+
+	nanosleep(&delay, NULL);
+	__atomic_fetch_add(&g_delivered_bytes, len, __ATOMIC_RELAXED);
+	return ESP_OK;
+}
+
+/**
+ * @fn void telemetry_sink_bench_wake(void*)
+ * @brief wake function of the threaded sinks
+ *
+ */
+static void telemetry_sink_bench_wake(void *ctx)
+{
+	sem_post(ctx);
+}
+
+/**
+ * @fn void telemetry_sink_bench_drain_thread*(void*)
+ * @brief drain one sink whenever the producer queued samples, as telemetry_sink_start does on the device
+ *
+ */
+static void *telemetry_sink_bench_drain_thread(void *arg)
+{
+	telemetry_sink_bench_drain_t *drain = arg;
+
+	for(;;)
+	{
+		sem_wait(&drain->wake);
+		//stopped after the last sample was queued, so this drain is the final one
+		bool stop = __atomic_load_n(&drain->stop, __ATOMIC_ACQUIRE);
+		telemetry_sink_drain(&drain->sink);
+		if(stop)
+		{
+			return NULL;
+		}
+	}
+}
+
+/**
+ * @fn int64_t telemetry_sink_bench_inline(size_t, int64_t*)
+ * @brief fan the samples out to sinks drained right after each sample, as the cloud sink is
+ *
+ * @return ns per sample for the encode, fan-out and sends
+ */
+static int64_t telemetry_sink_bench_inline(size_t sinks, int64_t *fanout_ns)
+{
+	telemetry_sink_clear();
+	for(size_t i = 0; i < sinks; i++)
+	{
+		telemetry_sink_init(&g_drains[i].sink, "inline", telemetry_sink_bench_fast_send, NULL, TELEMETRY_SINK_DROP_OLDEST);
+		telemetry_sink_add(&g_drains[i].sink);
+	}
+
+	*fanout_ns = 0;
+	int64_t start = telemetry_sink_bench_now_ns();
+	for(uint32_t i = 0; i < TELEMETRY_SINK_BENCH_SAMPLES; i++)
+	{
+		telemetry_sink_bench_produce(i, fanout_ns);
+		for(size_t s = 0; s < sinks; s++)
+		{
+			telemetry_sink_drain(&g_drains[s].sink);
+		}
+	}
+	*fanout_ns /= TELEMETRY_SINK_BENCH_SAMPLES;
+	return (telemetry_sink_bench_now_ns() - start) / TELEMETRY_SINK_BENCH_SAMPLES;
+}
+
+/**
+ * @fn bool telemetry_sink_bench_slow(void)
+ * @brief fast sinks next to a slow one, each on its own thread, with the producer paced like the telemetry task
+ *
+ * @return true if the fast sinks delivered every sample
+ */
+static bool telemetry_sink_bench_slow(void)
+{
+	const struct timespec period = {.tv_sec = 0, .tv_nsec = TELEMETRY_SINK_BENCH_SLOW_PERIOD_US * 1000};
+	int64_t fanout_ns = 0;
+	int64_t worst_ns = 0;
+	uint32_t produced = 0;
+	uint32_t no_buffer = 0;
+	bool ok = true;
+
+	telemetry_sink_clear();
+	for(size_t i = 0; i < TELEMETRY_SINK_MAX; i++)
+	{
+		telemetry_sink_bench_drain_t *drain = &g_drains[i];
+		bool slow = i == TELEMETRY_SINK_MAX - 1;
+
+		telemetry_sink_init(&drain->sink, slow ? "slow" : "fast", slow ? telemetry_sink_bench_slow_send :
+							telemetry_sink_bench_fast_send, NULL, TELEMETRY_SINK_DROP_OLDEST);
+		sem_init(&drain->wake, 0, 0);
+		drain->stop = false;
+		drain->sink.wake = telemetry_sink_bench_wake;
+		drain->sink.wake_ctx = &drain->wake;
+		pthread_create(&drain->thread, NULL, telemetry_sink_bench_drain_thread, drain);
+		telemetry_sink_add(&drain->sink);
+	}
+
+	for(uint32_t i = 0; i < TELEMETRY_SINK_BENCH_SLOW_SAMPLES; i++)
+	{
+		int64_t before = fanout_ns;
+
+		if(telemetry_sink_bench_produce(i, &fanout_ns))
+		{
+			produced++;
+		}
+		else
+		{
+			no_buffer++;
+		}
+		if(fanout_ns - before > worst_ns)
+		{
+			worst_ns = fanout_ns - before;
+		}
+		nanosleep(&period, NULL);
+	}
+
+	for(size_t i = 0; i < TELEMETRY_SINK_MAX; i++)
+	{
+		__atomic_store_n(&g_drains[i].stop, true, __ATOMIC_RELEASE);
+		sem_post(&g_drains[i].wake);
+		pthread_join(g_drains[i].thread, NULL);
+		sem_destroy(&g_drains[i].wake);
+	}
+
+	ESP_LOGI(TAG, "slow sink: %lu samples every %u us, %lld ns per fan-out, worst %lld ns, %lu without a buffer",
+			(unsigned long)produced, TELEMETRY_SINK_BENCH_SLOW_PERIOD_US, (long long)(fanout_ns / (produced ? produced : 1)),
+			(long long)worst_ns, (unsigned long)no_buffer);
+	for(size_t i = 0; i < TELEMETRY_SINK_MAX; i++)
+	{
+		telemetry_sink_t *sink = &g_drains[i].sink;
+		telemetry_sink_stats_t stats;
+
+		telemetry_sink_get_stats(sink, &stats);
+		ESP_LOGI(TAG, "slow sink: %s %lu delivered, %lu dropped, peak %lu queued", sink->name,
+				(unsigned long)stats.delivered, (unsigned long)stats.dropped, (unsigned long)stats.max_depth);
+		if(sink->send == telemetry_sink_bench_fast_send && stats.delivered != produced)
+		{
+			ESP_LOGE(TAG, "slow sink: %s missed %lu samples", sink->name, (unsigned long)(produced - stats.delivered));
+			ok = false;
+		}
+	}
+	if(no_buffer)
+	{
+		ESP_LOGE(TAG, "slow sink: the producer ran out of buffers");
+		ok = false;
+	}
+	return ok;
+}
+
+bool telemetry_sink_bench_run(void)
+{
+	telemetry_sample_t sample;
+	char encoded[TELEMETRY_CODEC_SAMPLE_MAX_LEN];
+	int64_t base_ns;
+	int64_t fanout_ns;
+	int64_t one_ns = 0;
+	bool ok;
+
+	//the encode alone, paid once whatever the number of sinks
+	int64_t start = telemetry_sink_bench_now_ns();
+	for(uint32_t i = 0; i < TELEMETRY_SINK_BENCH_SAMPLES; i++)
+	{
+		telemetry_sink_bench_sample(i, &sample);
+		g_delivered_bytes += telemetry_codec_encode_sample(TELEMETRY_CODEC_CBOR, &sample, encoded, sizeof(encoded));
+	}
+	base_ns = (telemetry_sink_bench_now_ns() - start) / TELEMETRY_SINK_BENCH_SAMPLES;
+	ESP_LOGI(TAG, "encode: %lld ns per sample", (long long)base_ns);
+
+	for(size_t sinks = 1; sinks <= TELEMETRY_SINK_MAX; sinks++)
+	{
+		int64_t sample_ns = telemetry_sink_bench_inline(sinks, &fanout_ns);
+		if(sinks == 1)
+		{
+			one_ns = sample_ns;
+		}
+		ESP_LOGI(TAG, "%u sinks: %lld ns per sample, %lld ns of it in the fan-out, %lld ns per extra sink", (unsigned)sinks,
+				(long long)sample_ns, (long long)fanout_ns, (long long)(sinks > 1 ? (sample_ns - one_ns) / (int64_t)(sinks - 1) : 0));
+	}
+
+	ok = telemetry_sink_bench_slow();
+	telemetry_sink_clear();
+	if(telemetry_buf_in_use() != 0)
+	{
+		ESP_LOGE(TAG, "%lu sample buffers leaked", (unsigned long)telemetry_buf_in_use());
+		ok = false;
+	}
+	return ok;
+}
@@ -0,0 +1,33 @@
+/*
+ * telemetry_sink_bench.h
+ *
+ *  Created on: Oct 18, 2026
+ *      Author: hamxa
+ */
+
+#ifndef MAIN_TELEMETRY_SINK_BENCH_H_
+#define MAIN_TELEMETRY_SINK_BENCH_H_
+
+#include <stdbool.h>
+
+//Samples fanned out per measurement of the cost per sink
+#define TELEMETRY_SINK_BENCH_SAMPLES		100000
+
+//Samples of the slow sink run and the interval between them, faster than the slow sink sends
+#define TELEMETRY_SINK_BENCH_SLOW_SAMPLES	2000
+#define TELEMETRY_SINK_BENCH_SLOW_PERIOD_US	200
+
+//Time the slow sink takes per sample, a collector behind a congested link
+#define TELEMETRY_SINK_BENCH_SLOW_SEND_US	2000
+
+/**
+ * @fn bool telemetry_sink_bench_run(void)
+ * @brief log the time to encode a sample and fan it out to one sink and to each extra sink, then run fast sinks
+ * 			next to a slow one on their own threads and check the fast ones got every sample, the producer never
+ * 			waited on the slow one and every buffer was freed
+ *
+ * @return true if no fast sink dropped a sample and no buffer leaked
+ */
+bool telemetry_sink_bench_run(void);
+
+#endif /* MAIN_TELEMETRY_SINK_BENCH_H_ */
@@ -11,6 +11,7 @@
 #include "freertos/event_groups.h"
 #include "freertos/task.h"
 #include "http_server.h"
+#include "ota_health.h"
 #include "esp_err.h"
 #include "esp_log.h"
 #include "esp_event.h"
@@ -247,6 +248,10 @@ static void wifi_app_task(void *pvParameters)
 					else
 					{
 						ESP_LOGI(TAG, "Unable to load station configuration");
+#if CONFIG_OTA_HEALTH
+						//the softAP is the only Wi-Fi of a device without station credentials
+						ota_health_report(OTA_HEALTH_WIFI);
+#endif
 					}
 
 					// Next, start the web server
@@ -282,6 +287,9 @@ static void wifi_app_task(void *pvParameters)
 					ESP_LOGI(TAG, "WIFI_APP_MSG_STA_CONNECTED_GOT_IP");
 
 					xEventGroupSetBits(wifi_app_event_group, WIFI_APP_STA_CONNECTED_GOT_IP_BIT);
+#if CONFIG_OTA_HEALTH
+					ota_health_report(OTA_HEALTH_WIFI);
+#endif
 
 					rgb_led_wifi_connected();
 					http_server_monitor_send_message(HTTP_MSG_WIFI_CONNECT_SUCCESS);
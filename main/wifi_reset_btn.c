@@ -27,8 +27,14 @@ SemaphoreHandle_t  wifi_reset_semaphore = NULL;
  */
 void IRAM_ATTR wifi_reset_button_isr_handler(void *arg)
 {
+	BaseType_t woken = pdFALSE;
+
 	//Notify the button task
-	xSemaphoreGiveFromISR(wifi_reset_semaphore,NULL);  
+	xSemaphoreGiveFromISR(wifi_reset_semaphore, &woken);
+	if(woken == pdTRUE)
+	{
+		portYIELD_FROM_ISR();
+	}
 }
 
 /**
@@ -70,8 +76,13 @@ void wifi_reset_button_config(void)
 	//create the wifi reset button task
 	xTaskCreatePinnedToCore(&wifi_reset_button_task, "wifi_reset_button_task", WIFI_RESET_BUTTON_TASK_STACK_SIZE, NULL, WIFI_RESET_BUTTON_TASK_PRIORITY, NULL, WIFI_RESET_BUTTON_TASK_CORE_ID);
 	
-	//install gpio isr service
-	gpio_install_isr_service(ESP_INTR_FLAG_DEFUALT);
+	//install gpio isr service, the DHT11 edge capture may have installed it already
+	esp_err_t err = gpio_install_isr_service(WIFI_RESET_BUTTON_INTR_FLAGS);
+	if(err != ESP_OK && err != ESP_ERR_INVALID_STATE)
+	{
+		ESP_LOGE(TAG, "wifi_reset_button_config: GPIO ISR service failed: %s", esp_err_to_name(err));
+		return;
+	}
 	
 	//Attach the ISR
 	gpio_isr_handler_add(WIFI_RESET_BUTTON, wifi_reset_button_isr_handler, NULL);
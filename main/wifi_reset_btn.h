@@ -8,8 +8,9 @@
 #ifndef MAIN_WIFI_RESET_BTN_H_
 #define MAIN_WIFI_RESET_BTN_H_
 
-//Default interupt flag
-#define ESP_INTR_FLAG_DEFUALT		0
+//GPIO ISR service flags, the service is shared with the DHT11 edge capture, whose timestamps must not wait for
+//a flash operation. Every handler of the service has to be in IRAM
+#define WIFI_RESET_BUTTON_INTR_FLAGS	ESP_INTR_FLAG_IRAM
 
 //wifi reset button is the BOOT button on the ESP32
 #define WIFI_RESET_BUTTON			0